@@ -94,6 +94,10 @@ pylcm_msg_handler (const lcm_recv_buf_t *rbuf, const char *channel,
       return;
     }
 
+    subs_obj->lcm_obj->recv_utime = rbuf->recv_utime;
+    subs_obj->lcm_obj->send_utime = rbuf->send_utime;
+    subs_obj->lcm_obj->send_seqno = rbuf->send_seqno;
+
     #if PY_MAJOR_VERSION >= 3
     PyObject *arglist = Py_BuildValue ("sy#", channel, // build from bytes
             rbuf->data, rbuf->data_size);
@@ -260,6 +264,22 @@ PyDoc_STRVAR (pylcm_fileno_doc,
 Returns a file descriptor suitable for use with select, poll, etc.\n\
 ");
 
+static PyObject *
+pylcm_receive_info (PyLCMObject *lcm_obj)
+{
+    return Py_BuildValue ("LLI", (PY_LONG_LONG) lcm_obj->recv_utime,
+            (PY_LONG_LONG) lcm_obj->send_utime,
+            (unsigned int) lcm_obj->send_seqno);
+}
+PyDoc_STRVAR (pylcm_receive_info_doc,
+"receive_info() -> (recv_utime, send_utime, send_seqno)\n\
+\n\
+Returns when the message being handled was received and published, in\n\
+microseconds since the epoch, and how many messages its publisher had\n\
+published on its channel before it.  send_utime is 0 if the publisher\n\
+didn't trace the message.  Only valid inside a message handler.\n\
+");
+
 static PyObject *
 pylcm_handle (PyLCMObject *lcm_obj)
 {
@@ -360,6 +380,8 @@ static PyMethodDef pylcm_methods[] = {
     { "publish", (PyCFunction)pylcm_publish, METH_VARARGS,
         pylcm_publish_doc },
     { "fileno", (PyCFunction)pylcm_fileno, METH_NOARGS, pylcm_fileno_doc },
+    { "receive_info", (PyCFunction)pylcm_receive_info, METH_NOARGS,
+        pylcm_receive_info_doc },
     { NULL, NULL }
 };
 
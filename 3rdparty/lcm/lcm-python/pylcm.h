@@ -19,6 +19,12 @@ typedef struct {
     // Stores the state of the thread that calls LCM.handle() or
     // LCM.handle_timeout()
     PyThreadState *saved_thread_state;
+
+    // Timestamps and sequence number of the message being handled, for
+    // LCM.receive_info()
+    int64_t recv_utime;
+    int64_t send_utime;
+    uint32_t send_seqno;
 } PyLCMObject;
 
 #ifdef __cplusplus
@@ -105,7 +105,9 @@ lcm_eventlog_event_t *lcm_eventlog_read_next_event(lcm_eventlog_t *l)
     // Check that there's a valid event or the EOF after this event.
     int32_t next_magic;
     if (0 == fread32(l->f, &next_magic)) {
-        if (next_magic != MAGIC) {
+        // zeros are the unwritten rest of a log whose lcm_eventlog_writer_t
+        // wasn't destroyed, the next read stops at the end of the file
+        if (next_magic != MAGIC && next_magic != 0) {
             fprintf(stderr, "Invalid header after log data\n");
             free(le->channel);
             free(le->data);
@@ -141,6 +141,185 @@ int lcm_eventlog_write_event(lcm_eventlog_t *eventlog,
 LCM_API_FUNCTION
 void lcm_eventlog_destroy(lcm_eventlog_t *eventlog);
 
+/**
+ * @}
+ */
+
+/**
+ * @defgroup LcmC_lcm_eventlog_writer_t lcm_eventlog_writer_t
+ * @ingroup LcmC
+ * @brief Write %LCM log files at full rate
+ *
+ * Writes the same log format as lcm_eventlog_write_event(), but appends each
+ * event to a large memory mapped segment of the file with one copy instead of
+ * going through stdio.  A background thread maps and preallocates the next
+ * segment before it's needed, unmaps filled ones, and writes the index, so
+ * writing an event never waits on the disk.
+ *
+ * Alongside the log, the writer keeps an index file named after the log with
+ * #LCM_EVENTLOG_INDEX_SUFFIX appended.  It starts with the 32 bit
+ * #LCM_EVENTLOG_INDEX_MAGIC and #LCM_EVENTLOG_INDEX_VERSION, followed by one
+ * #LCM_EVENTLOG_INDEX_ENTRY_SIZE byte entry per event:  its 64 bit offset in
+ * the log, 64 bit timestamp, 32 bit channel number and 32 bit size in the
+ * log.  Channels are numbered from 0 in the order they first appear, so the
+ * name of a channel number is read from the log at the first entry that has
+ * it.  Every integer is big endian like the log itself.
+ *
+ * @code
+ * #include <lcm/lcm.h>
+ * @endcode
+ * Linking: <tt> `pkg-config --libs lcm` </tt>
+ * @{
+ */
+
+#define LCM_EVENTLOG_INDEX_SUFFIX ".idx"
+#define LCM_EVENTLOG_INDEX_MAGIC ((int32_t) 0xEDA1DA1DL)
+#define LCM_EVENTLOG_INDEX_VERSION 1
+#define LCM_EVENTLOG_INDEX_HEADER_SIZE 8
+#define LCM_EVENTLOG_INDEX_ENTRY_SIZE 24
+
+/**
+ * Size of the segments the log file grows by when lcm_eventlog_writer_create()
+ * is given 0, in bytes.
+ */
+#define LCM_EVENTLOG_WRITER_DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024)
+
+typedef struct _lcm_eventlog_writer_t lcm_eventlog_writer_t;
+
+/**
+ * Create a log file, and an index file next to it, and start the writer's
+ * background thread.  Existing files are overwritten.
+ *
+ * A log whose writer wasn't destroyed, because the process died, keeps the
+ * zeroed rest of its last segment, which lcm_eventlog_read_next_event() reads
+ * as the end of the log.
+ *
+ * @param path Log file to create
+ * @param segment_size How many bytes the file is grown and mapped by at a
+ * time, rounded up to whole pages.  0 for
+ * #LCM_EVENTLOG_WRITER_DEFAULT_SEGMENT_SIZE.
+ * @return a newly allocated lcm_eventlog_writer_t, or NULL on failure.
+ */
+LCM_API_FUNCTION
+lcm_eventlog_writer_t *lcm_eventlog_writer_create(const char *path,
+        int64_t segment_size);
+
+/**
+ * Append an event to the log.  Safe to call from any thread.
+ *
+ * @param writer The log writer
+ * @param timestamp Time the message was received, in microseconds since the
+ * UNIX epoch
+ * @param channel Channel the message was received on
+ * @param data The message payload
+ * @param datalen Length of @c data, in bytes
+ * @return 0 on success, -1 on failure.  Once a write fails, every later one
+ * does too.
+ */
+LCM_API_FUNCTION
+int lcm_eventlog_writer_write(lcm_eventlog_writer_t *writer,
+        int64_t timestamp, const char *channel, const void *data,
+        int32_t datalen);
+
+/**
+ * Write what's left of the log and index, truncate the log to the events in
+ * it, and release the writer.
+ *
+ * @param writer The log writer
+ */
+LCM_API_FUNCTION
+void lcm_eventlog_writer_destroy(lcm_eventlog_writer_t *writer);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup LcmC_lcm_eventlog_index_t lcm_eventlog_index_t
+ * @ingroup LcmC
+ * @brief Find events in %LCM log files without reading through them
+ *
+ * Reads the index file lcm_eventlog_writer_t writes next to a log, or builds
+ * one for a log written some other way.  The index is memory mapped instead of
+ * loaded, so opening the index of a long log is quick.  The file provider uses
+ * it to start playback at a timestamp and to skip the events of channels
+ * nothing is subscribed to without reading them.
+ *
+ * @code
+ * #include <lcm/lcm.h>
+ * @endcode
+ * Linking: <tt> `pkg-config --libs lcm` </tt>
+ * @{
+ */
+
+typedef struct _lcm_eventlog_index_t lcm_eventlog_index_t;
+
+/**
+ * Open the index of a log file, named after it with
+ * #LCM_EVENTLOG_INDEX_SUFFIX appended.
+ *
+ * @param log_path The log file, not the index
+ * @return a newly allocated lcm_eventlog_index_t, or NULL if the log has no
+ * valid index.
+ */
+LCM_API_FUNCTION
+lcm_eventlog_index_t *lcm_eventlog_index_open(const char *log_path);
+
+/**
+ * Read through a log file to write its index, then open it.  An existing
+ * index is overwritten.
+ *
+ * @param log_path The log file, not the index
+ * @return a newly allocated lcm_eventlog_index_t, or NULL on failure.
+ */
+LCM_API_FUNCTION
+lcm_eventlog_index_t *lcm_eventlog_index_build(const char *log_path);
+
+/**
+ * @return the number of events in the index.
+ */
+LCM_API_FUNCTION
+int64_t lcm_eventlog_index_size(const lcm_eventlog_index_t *index);
+
+/**
+ * @return the offset in the log of event @c i, to seek the log's file handle
+ * to before lcm_eventlog_read_next_event().
+ */
+LCM_API_FUNCTION
+int64_t lcm_eventlog_index_offset(const lcm_eventlog_index_t *index, int64_t i);
+
+/**
+ * @return the timestamp of event @c i.
+ */
+LCM_API_FUNCTION
+int64_t lcm_eventlog_index_timestamp(const lcm_eventlog_index_t *index,
+        int64_t i);
+
+/**
+ * @return the channel event @c i was received on.
+ */
+LCM_API_FUNCTION
+const char *lcm_eventlog_index_channel(const lcm_eventlog_index_t *index,
+        int64_t i);
+
+/**
+ * Find the first event at or after a timestamp, with a binary search.  Logs
+ * are in the order events were received, so timestamps only go backwards
+ * when the clock did.
+ *
+ * @return the number of the event, or lcm_eventlog_index_size() if every
+ * event is older.
+ */
+LCM_API_FUNCTION
+int64_t lcm_eventlog_index_find_timestamp(const lcm_eventlog_index_t *index,
+        int64_t timestamp);
+
+/**
+ * Close an index and release it.
+ */
+LCM_API_FUNCTION
+void lcm_eventlog_index_destroy(lcm_eventlog_index_t *index);
+
 /**
  * @}
  */
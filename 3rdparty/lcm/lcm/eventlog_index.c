@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <glib.h>
+
+#include "lcm.h"
+#include "ioutils.h"
+#include "eventlog.h"
+
+#ifndef WIN32
+
+// magic, event number, timestamp, channel length and data length
+#define EVENT_HEADER_SIZE 28
+
+// offset of the channel length in an event, after its magic, event number and
+// timestamp
+#define EVENT_CHANNELLEN_OFFSET 20
+
+struct _lcm_eventlog_index_t {
+    const uint8_t *map;     // the whole index file
+    size_t map_size;
+    const uint8_t *entries;
+    int64_t num_entries;
+
+    char **channels;        // name of each channel number
+    int32_t num_channels;
+};
+
+static const uint8_t *
+_entry (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return index->entries + i * LCM_EVENTLOG_INDEX_ENTRY_SIZE;
+}
+
+// reads the name of the channel of the event at offset in the log
+static char *
+_read_channel (FILE *f, int64_t offset)
+{
+    int32_t channellen;
+    if (0 != fseeko (f, offset + EVENT_CHANNELLEN_OFFSET, SEEK_SET) ||
+        0 != fread32 (f, &channellen) ||
+        channellen < 0 || channellen > LCM_MAX_CHANNEL_NAME_LENGTH)
+        return NULL;
+    if (0 != fseeko (f, 4, SEEK_CUR))
+        return NULL;
+
+    char *channel = (char *) calloc (1, channellen + 1);
+    if (fread (channel, 1, channellen, f) != (size_t) channellen) {
+        free (channel);
+        return NULL;
+    }
+    return channel;
+}
+
+lcm_eventlog_index_t *
+lcm_eventlog_index_open (const char *log_path)
+{
+    char *index_path = g_strdup_printf ("%s%s", log_path,
+            LCM_EVENTLOG_INDEX_SUFFIX);
+    int fd = open (index_path, O_RDONLY);
+    g_free (index_path);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (0 != fstat (fd, &st) || st.st_size < LCM_EVENTLOG_INDEX_HEADER_SIZE) {
+        close (fd);
+        return NULL;
+    }
+    void *map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    lcm_eventlog_index_t *index =
+        (lcm_eventlog_index_t *) calloc (1, sizeof (lcm_eventlog_index_t));
+    index->map = (const uint8_t *) map;
+    index->map_size = st.st_size;
+    index->entries = index->map + LCM_EVENTLOG_INDEX_HEADER_SIZE;
+    // a writer that died mid entry leaves part of one at the end
+    index->num_entries = (st.st_size - LCM_EVENTLOG_INDEX_HEADER_SIZE) /
+        LCM_EVENTLOG_INDEX_ENTRY_SIZE;
+
+    if (decode32 (index->map) != LCM_EVENTLOG_INDEX_MAGIC ||
+        decode32 (index->map + 4) != LCM_EVENTLOG_INDEX_VERSION) {
+        fprintf (stderr, "lcm_eventlog_index: %s%s is not a version %d index\n",
+                log_path, LCM_EVENTLOG_INDEX_SUFFIX, LCM_EVENTLOG_INDEX_VERSION);
+        lcm_eventlog_index_destroy (index);
+        return NULL;
+    }
+
+    // channels are numbered in the order they first appear, so each one's
+    // name is read from its first event
+    FILE *f = fopen (log_path, "rb");
+    if (!f) {
+        lcm_eventlog_index_destroy (index);
+        return NULL;
+    }
+    for (int64_t i = 0; i < index->num_entries; i++) {
+        int32_t channel = decode32 (_entry (index, i) + 16);
+        if (channel < index->num_channels)
+            continue;
+        if (channel != index->num_channels) {
+            fprintf (stderr, "lcm_eventlog_index: bad channel number in %s%s\n",
+                    log_path, LCM_EVENTLOG_INDEX_SUFFIX);
+            break;
+        }
+        char *name = _read_channel (f, decode64 (_entry (index, i)));
+        if (!name) {
+            fprintf (stderr, "lcm_eventlog_index: %s doesn't match its index\n",
+                    log_path);
+            break;
+        }
+        index->channels = (char **) realloc (index->channels,
+                (index->num_channels + 1) * sizeof (char *));
+        index->channels[index->num_channels++] = name;
+    }
+    fclose (f);
+
+    // drop whatever the names couldn't be found for, rather than the index
+    for (int64_t i = 0; i < index->num_entries; i++) {
+        if (decode32 (_entry (index, i) + 16) >= index->num_channels) {
+            index->num_entries = i;
+            break;
+        }
+    }
+    return index;
+}
+
+lcm_eventlog_index_t *
+lcm_eventlog_index_build (const char *log_path)
+{
+    lcm_eventlog_t *log = lcm_eventlog_create (log_path, "r");
+    if (!log)
+        return NULL;
+
+    char *index_path = g_strdup_printf ("%s%s", log_path,
+            LCM_EVENTLOG_INDEX_SUFFIX);
+    FILE *index_f = fopen (index_path, "wb");
+    g_free (index_path);
+    if (!index_f) {
+        perror ("lcm_eventlog_index: can't create index");
+        lcm_eventlog_destroy (log);
+        return NULL;
+    }
+
+    uint8_t buf[LCM_EVENTLOG_INDEX_ENTRY_SIZE];
+    encode32 (buf, LCM_EVENTLOG_INDEX_MAGIC);
+    encode32 (buf + 4, LCM_EVENTLOG_INDEX_VERSION);
+    int status = fwrite (buf, 1, LCM_EVENTLOG_INDEX_HEADER_SIZE, index_f) ==
+        LCM_EVENTLOG_INDEX_HEADER_SIZE ? 0 : -1;
+
+    // channel name to its number plus one
+    GHashTable *channels = g_hash_table_new_full (g_str_hash, g_str_equal,
+            free, NULL);
+    int32_t num_channels = 0;
+
+    lcm_eventlog_event_t *event;
+    while (status == 0 && (event = lcm_eventlog_read_next_event (log))) {
+        // read_next_event skips garbage before the event it returns
+        int64_t size = EVENT_HEADER_SIZE + event->channellen + event->datalen;
+        int64_t offset = ftello (log->f) - size;
+
+        int32_t channel = GPOINTER_TO_INT (g_hash_table_lookup (channels,
+                    event->channel)) - 1;
+        if (channel < 0) {
+            channel = num_channels++;
+            g_hash_table_insert (channels, strdup (event->channel),
+                    GINT_TO_POINTER (channel + 1));
+        }
+
+        encode64 (buf, offset);
+        encode64 (buf + 8, event->timestamp);
+        encode32 (buf + 16, channel);
+        encode32 (buf + 20, size);
+        if (fwrite (buf, 1, LCM_EVENTLOG_INDEX_ENTRY_SIZE, index_f) !=
+                LCM_EVENTLOG_INDEX_ENTRY_SIZE)
+            status = -1;
+        lcm_eventlog_free_event (event);
+    }
+
+    g_hash_table_destroy (channels);
+    lcm_eventlog_destroy (log);
+    if (0 != fclose (index_f) || status != 0) {
+        perror ("lcm_eventlog_index: can't write index");
+        return NULL;
+    }
+    return lcm_eventlog_index_open (log_path);
+}
+
+int64_t
+lcm_eventlog_index_size (const lcm_eventlog_index_t *index)
+{
+    return index->num_entries;
+}
+
+int64_t
+lcm_eventlog_index_offset (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return decode64 (_entry (index, i));
+}
+
+int64_t
+lcm_eventlog_index_timestamp (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return decode64 (_entry (index, i) + 8);
+}
+
+const char *
+lcm_eventlog_index_channel (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return index->channels[decode32 (_entry (index, i) + 16)];
+}
+
+int64_t
+lcm_eventlog_index_find_timestamp (const lcm_eventlog_index_t *index,
+        int64_t timestamp)
+{
+    int64_t lo = 0;
+    int64_t hi = index->num_entries;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (lcm_eventlog_index_timestamp (index, mid) < timestamp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void
+lcm_eventlog_index_destroy (lcm_eventlog_index_t *index)
+{
+    for (int32_t i = 0; i < index->num_channels; i++)
+        free (index->channels[i]);
+    free (index->channels);
+    munmap ((void *) index->map, index->map_size);
+    free (index);
+}
+
+#else
+
+lcm_eventlog_index_t *
+lcm_eventlog_index_open (const char *log_path)
+{
+    return NULL;
+}
+
+lcm_eventlog_index_t *
+lcm_eventlog_index_build (const char *log_path)
+{
+    fprintf (stderr, "lcm_eventlog_index is not supported on this platform\n");
+    return NULL;
+}
+
+int64_t
+lcm_eventlog_index_size (const lcm_eventlog_index_t *index)
+{
+    return 0;
+}
+
+int64_t
+lcm_eventlog_index_offset (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return -1;
+}
+
+int64_t
+lcm_eventlog_index_timestamp (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return -1;
+}
+
+const char *
+lcm_eventlog_index_channel (const lcm_eventlog_index_t *index, int64_t i)
+{
+    return NULL;
+}
+
+int64_t
+lcm_eventlog_index_find_timestamp (const lcm_eventlog_index_t *index,
+        int64_t timestamp)
+{
+    return 0;
+}
+
+void
+lcm_eventlog_index_destroy (lcm_eventlog_index_t *index)
+{
+}
+
+#endif
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <glib.h>
+
+#include "ioutils.h"
+#include "eventlog.h"
+
+#ifndef WIN32
+
+#define MAGIC ((int32_t) 0xEDA1DA01L)
+
+// magic, event number, timestamp, channel length and data length
+#define EVENT_HEADER_SIZE 28
+
+// how long the background thread sleeps when there is nothing to do
+#define WRITER_IDLE_US 100000
+
+// encoded index entries the write path buffers before waking the thread
+#define WRITER_INDEX_WAKE_SIZE (64 * 1024)
+
+typedef struct _segment segment_t;
+struct _segment {
+    uint8_t *base;      // NULL if not mapped
+    int64_t offset;     // in the log file
+};
+
+struct _lcm_eventlog_writer_t {
+    int fd;
+    FILE *index_f;
+    int64_t segment_size;
+
+    GThread *thread;
+
+    GMutex *mutex;      // guards everything below
+    GCond *cond;        // wakes the background thread
+    int exit_flag;
+    int failed;
+
+    segment_t cur;      // segment events are appended to
+    int64_t cur_used;   // bytes of cur already written
+    segment_t next;     // mapped ahead by the background thread
+    GPtrArray *retired; // filled segments (segment_t*) left to unmap
+
+    int64_t length;     // bytes of events written
+    int64_t eventcount;
+
+    GHashTable *channels;   // channel name to its number plus one
+    int32_t num_channels;
+
+    uint8_t *index_buf; // encoded index entries not written yet
+    size_t index_len;
+    size_t index_cap;
+};
+
+// grows the log file to hold the segment at offset and maps it, faulting its
+// pages in now so writes to it don't.  Returns 0 on success
+static int
+_map_segment (int fd, int64_t offset, int64_t size, segment_t *seg)
+{
+#ifdef __linux__
+    int status = posix_fallocate (fd, offset, size);
+    if (status != 0) {
+        fprintf (stderr, "lcm_eventlog_writer: can't grow log: %s\n",
+                strerror (status));
+        return -1;
+    }
+    int flags = MAP_SHARED | MAP_POPULATE;
+#else
+    struct stat st;
+    if (fstat (fd, &st) < 0 ||
+        (st.st_size < offset + size && ftruncate (fd, offset + size) < 0)) {
+        perror ("lcm_eventlog_writer: can't grow log");
+        return -1;
+    }
+    int flags = MAP_SHARED;
+#endif
+    void *base = mmap (NULL, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+    if (base == MAP_FAILED) {
+        perror ("lcm_eventlog_writer: can't map log");
+        return -1;
+    }
+    seg->base = (uint8_t *) base;
+    seg->offset = offset;
+    return 0;
+}
+
+// moves on to the segment after cur, mapping it here if the background thread
+// hasn't yet.  Needs mutex
+static int
+_next_segment (lcm_eventlog_writer_t *w)
+{
+    int64_t offset = w->cur.offset + w->segment_size;
+
+    if (w->cur.base) {
+        segment_t *retired = (segment_t *) malloc (sizeof (segment_t));
+        *retired = w->cur;
+        g_ptr_array_add (w->retired, retired);
+        w->cur.base = NULL;
+    }
+
+    if (w->next.base) {
+        w->cur = w->next;
+        w->next.base = NULL;
+    } else if (0 != _map_segment (w->fd, offset, w->segment_size, &w->cur)) {
+        return -1;
+    }
+    w->cur_used = 0;
+
+    g_cond_broadcast (w->cond);
+    return 0;
+}
+
+// copies len bytes to the end of the log, across segments if needed.  Needs
+// mutex
+static int
+_append (lcm_eventlog_writer_t *w, const void *src, int64_t len)
+{
+    const uint8_t *p = (const uint8_t *) src;
+    while (len > 0) {
+        if (!w->cur.base || w->cur_used == w->segment_size) {
+            if (0 != _next_segment (w))
+                return -1;
+        }
+        int64_t n = MIN (len, w->segment_size - w->cur_used);
+        memcpy (w->cur.base + w->cur_used, p, n);
+        w->cur_used += n;
+        w->length += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// returns the number of channel, numbering it if it's new.  Needs mutex
+static int32_t
+_channel_number (lcm_eventlog_writer_t *w, const char *channel)
+{
+    gpointer num = g_hash_table_lookup (w->channels, channel);
+    if (num)
+        return GPOINTER_TO_INT (num) - 1;
+
+    int32_t new_num = w->num_channels++;
+    g_hash_table_insert (w->channels, strdup (channel),
+            GINT_TO_POINTER (new_num + 1));
+    return new_num;
+}
+
+static int
+_add_index_entry (lcm_eventlog_writer_t *w, int64_t offset, int64_t timestamp,
+        int32_t channel, int32_t size)
+{
+    if (w->index_len + LCM_EVENTLOG_INDEX_ENTRY_SIZE > w->index_cap) {
+        size_t cap = MAX (w->index_cap * 2, 1024 * LCM_EVENTLOG_INDEX_ENTRY_SIZE);
+        uint8_t *buf = (uint8_t *) realloc (w->index_buf, cap);
+        if (!buf)
+            return -1;
+        w->index_buf = buf;
+        w->index_cap = cap;
+    }
+    uint8_t *entry = w->index_buf + w->index_len;
+    encode64 (entry, offset);
+    encode64 (entry + 8, timestamp);
+    encode32 (entry + 16, channel);
+    encode32 (entry + 20, size);
+    w->index_len += LCM_EVENTLOG_INDEX_ENTRY_SIZE;
+    return 0;
+}
+
+// writes buffered index entries, without mutex.  Returns 0 on success
+static int
+_write_index (FILE *f, const uint8_t *buf, size_t len)
+{
+    if (len == 0)
+        return 0;
+    if (fwrite (buf, 1, len, f) != len || fflush (f) != 0) {
+        perror ("lcm_eventlog_writer: can't write index");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+_unmap_retired (lcm_eventlog_writer_t *w, GPtrArray *retired)
+{
+    for (unsigned int i = 0; i < retired->len; i++) {
+        segment_t *seg = (segment_t *) g_ptr_array_index (retired, i);
+        // the kernel writes the pages back on its own schedule
+        munmap (seg->base, w->segment_size);
+        free (seg);
+    }
+    g_ptr_array_free (retired, TRUE);
+}
+
+// maps the next segment ahead of time, and unmaps filled segments and writes
+// the index away from the threads writing events
+static void *
+writer_thread (void *user_data)
+{
+    lcm_eventlog_writer_t *w = (lcm_eventlog_writer_t *) user_data;
+    uint8_t *index_buf = NULL;
+    size_t index_cap = 0;
+
+    g_mutex_lock (w->mutex);
+    while (!w->exit_flag) {
+        int worked = 0;
+
+        if (!w->next.base && !w->failed) {
+            int64_t offset = w->cur.offset + w->segment_size;
+            segment_t seg;
+            g_mutex_unlock (w->mutex);
+            int status = _map_segment (w->fd, offset, w->segment_size, &seg);
+            g_mutex_lock (w->mutex);
+
+            // the write path maps it itself if it got there first
+            if (status == 0 && !w->next.base &&
+                    w->cur.offset + w->segment_size == offset) {
+                w->next = seg;
+            } else if (status == 0) {
+                munmap (seg.base, w->segment_size);
+            }
+            worked = status == 0;
+        }
+
+        if (w->retired->len > 0 || w->index_len > 0) {
+            GPtrArray *retired = w->retired;
+            w->retired = g_ptr_array_new ();
+
+            // swap buffers, so writers keep appending entries meanwhile
+            uint8_t *buf = w->index_buf;
+            size_t len = w->index_len;
+            size_t cap = w->index_cap;
+            w->index_buf = index_buf;
+            w->index_cap = index_cap;
+            w->index_len = 0;
+            index_buf = buf;
+            index_cap = cap;
+
+            g_mutex_unlock (w->mutex);
+            _unmap_retired (w, retired);
+            int status = _write_index (w->index_f, index_buf, len);
+            g_mutex_lock (w->mutex);
+
+            if (status != 0)
+                w->failed = 1;
+            worked = 1;
+        }
+
+        if (!worked && !w->exit_flag) {
+            GTimeVal until;
+            g_get_current_time (&until);
+            g_time_val_add (&until, WRITER_IDLE_US);
+            g_cond_timed_wait (w->cond, w->mutex, &until);
+        }
+    }
+    g_mutex_unlock (w->mutex);
+
+    free (index_buf);
+    return NULL;
+}
+
+lcm_eventlog_writer_t *
+lcm_eventlog_writer_create (const char *path, int64_t segment_size)
+{
+    if (!g_thread_supported ()) g_thread_init (NULL);
+
+    int64_t page_size = sysconf (_SC_PAGESIZE);
+    if (segment_size <= 0)
+        segment_size = LCM_EVENTLOG_WRITER_DEFAULT_SEGMENT_SIZE;
+    segment_size = (segment_size + page_size - 1) / page_size * page_size;
+
+    int fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror ("lcm_eventlog_writer: can't create log");
+        return NULL;
+    }
+
+    // the first segment is mapped now, the thread maps the ones after it
+    segment_t first;
+    if (0 != _map_segment (fd, 0, segment_size, &first)) {
+        close (fd);
+        return NULL;
+    }
+
+    char *index_path = g_strdup_printf ("%s%s", path, LCM_EVENTLOG_INDEX_SUFFIX);
+    FILE *index_f = fopen (index_path, "wb");
+    g_free (index_path);
+    uint8_t header[LCM_EVENTLOG_INDEX_HEADER_SIZE];
+    encode32 (header, LCM_EVENTLOG_INDEX_MAGIC);
+    encode32 (header + 4, LCM_EVENTLOG_INDEX_VERSION);
+    if (!index_f || fwrite (header, 1, sizeof (header), index_f) != sizeof (header)) {
+        perror ("lcm_eventlog_writer: can't create index");
+        if (index_f)
+            fclose (index_f);
+        munmap (first.base, segment_size);
+        close (fd);
+        return NULL;
+    }
+
+    lcm_eventlog_writer_t *w =
+        (lcm_eventlog_writer_t *) calloc (1, sizeof (lcm_eventlog_writer_t));
+    w->fd = fd;
+    w->index_f = index_f;
+    w->segment_size = segment_size;
+    w->cur = first;
+    w->mutex = g_mutex_new ();
+    w->cond = g_cond_new ();
+    w->retired = g_ptr_array_new ();
+    w->channels = g_hash_table_new_full (g_str_hash, g_str_equal, free, NULL);
+
+    w->thread = g_thread_create (writer_thread, w, TRUE, NULL);
+    if (!w->thread) {
+        fprintf (stderr, "lcm_eventlog_writer: can't start thread\n");
+        lcm_eventlog_writer_destroy (w);
+        return NULL;
+    }
+    return w;
+}
+
+int
+lcm_eventlog_writer_write (lcm_eventlog_writer_t *w, int64_t timestamp,
+        const char *channel, const void *data, int32_t datalen)
+{
+    int32_t channellen = strlen (channel);
+    int64_t size = EVENT_HEADER_SIZE + channellen + datalen;
+
+    g_mutex_lock (w->mutex);
+    if (w->failed) {
+        g_mutex_unlock (w->mutex);
+        return -1;
+    }
+
+    int64_t offset = w->length;
+    uint8_t header[EVENT_HEADER_SIZE];
+    encode32 (header, MAGIC);
+    encode64 (header + 4, w->eventcount);
+    encode64 (header + 12, timestamp);
+    encode32 (header + 20, channellen);
+    encode32 (header + 24, datalen);
+
+    if (0 != _append (w, header, EVENT_HEADER_SIZE) ||
+        0 != _append (w, channel, channellen) ||
+        0 != _append (w, data, datalen) ||
+        0 != _add_index_entry (w, offset, timestamp,
+            _channel_number (w, channel), size)) {
+        // the log ends at the last whole event
+        w->length = offset;
+        w->failed = 1;
+        g_mutex_unlock (w->mutex);
+        return -1;
+    }
+    w->eventcount++;
+
+    if (w->index_len >= WRITER_INDEX_WAKE_SIZE)
+        g_cond_broadcast (w->cond);
+    g_mutex_unlock (w->mutex);
+    return 0;
+}
+
+void
+lcm_eventlog_writer_destroy (lcm_eventlog_writer_t *w)
+{
+    g_mutex_lock (w->mutex);
+    w->exit_flag = 1;
+    g_cond_broadcast (w->cond);
+    g_mutex_unlock (w->mutex);
+    if (w->thread)
+        g_thread_join (w->thread);
+
+    _unmap_retired (w, w->retired);
+    if (w->cur.base)
+        munmap (w->cur.base, w->segment_size);
+    if (w->next.base)
+        munmap (w->next.base, w->segment_size);
+    _write_index (w->index_f, w->index_buf, w->index_len);
+
+    // drop the preallocated space past the last event
+    if (ftruncate (w->fd, w->length) < 0)
+        perror ("lcm_eventlog_writer: can't truncate log");
+    close (w->fd);
+    fclose (w->index_f);
+
+    g_hash_table_destroy (w->channels);
+    free (w->index_buf);
+    g_cond_free (w->cond);
+    g_mutex_free (w->mutex);
+    free (w);
+}
+
+#else
+
+lcm_eventlog_writer_t *
+lcm_eventlog_writer_create (const char *path, int64_t segment_size)
+{
+    fprintf (stderr, "lcm_eventlog_writer is not supported on this platform\n");
+    return NULL;
+}
+
+int
+lcm_eventlog_writer_write (lcm_eventlog_writer_t *w, int64_t timestamp,
+        const char *channel, const void *data, int32_t datalen)
+{
+    return -1;
+}
+
+void
+lcm_eventlog_writer_destroy (lcm_eventlog_writer_t *w)
+{
+}
+
+#endif
@@ -60,6 +60,34 @@ static inline int fread64(FILE *f, int64_t *v64)
     return 0;
 }
 
+// Big endian like the f* functions, for buffers and memory mapped files
+
+static inline void encode32(uint8_t *buf, int32_t v)
+{
+    buf[0] = ((uint32_t) v) >> 24;
+    buf[1] = ((uint32_t) v) >> 16;
+    buf[2] = ((uint32_t) v) >> 8;
+    buf[3] = ((uint32_t) v);
+}
+
+static inline void encode64(uint8_t *buf, int64_t v64)
+{
+    encode32(buf, ((uint64_t) v64) >> 32);
+    encode32(buf + 4, v64 & 0xffffffff);
+}
+
+static inline int32_t decode32(const uint8_t *buf)
+{
+    return (int32_t) (((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
+            ((uint32_t) buf[2] << 8) | buf[3]);
+}
+
+static inline int64_t decode64(const uint8_t *buf)
+{
+    return (int64_t) (((uint64_t) (uint32_t) decode32(buf) << 32) |
+            (uint32_t) decode32(buf + 4));
+}
+
 #ifdef __cplusplus
 }
 #endif
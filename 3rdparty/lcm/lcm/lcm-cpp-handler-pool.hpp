@@ -0,0 +1,391 @@
+#ifndef __lcm_cpp_handler_pool_hpp__
+#define __lcm_cpp_handler_pool_hpp__
+
+#if __cplusplus < 201103L
+#error "lcm-cpp-handler-pool.hpp requires C++11"
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "lcm-cpp.hpp"
+
+namespace lcm {
+
+/**
+ * @defgroup LcmCppHandlerPool C++ handler pools
+ * @ingroup LcmCpp
+ *
+ * LCM::handle() calls every handler on the thread that calls it, one after
+ * another, so one slow handler holds up every other subscription.  A
+ * HandlerPool runs the handlers of the subscriptions made through it on its
+ * own threads instead.  LCM::handle() still receives their messages, but only
+ * copies them into the pool, and subscriptions made directly on the LCM
+ * instance keep running on the handle() thread.
+ *
+ * Messages of one subscription are handled one at a time, in the order they
+ * were received, by whichever of the pool's threads is free.  Different
+ * subscriptions are handled concurrently when the pool has more than one
+ * thread, so give a channel that must never wait behind another its own pool.
+ *
+ * @{
+ */
+
+/**
+ * @brief Runs the handlers of its subscriptions on a set of worker threads.
+ *
+ * @code
+ * lcm::LCM lcm;
+ * lcm::HandlerPool planner(&lcm);
+ *
+ * // handled on the handle() thread
+ * lcm.subscribe("POSE", &State::onPose, &state);
+ * // handled on the planner's thread, so poses keep coming in while it plans
+ * planner.subscribe("GOAL", &State::onGoal, &state);
+ *
+ * while (lcm.handle() == 0);
+ * @endcode
+ *
+ * The pool must be destroyed before its LCM instance, which it unsubscribes
+ * from when it is destroyed.  Messages still queued then are dropped, and a
+ * handler already running is waited for.
+ *
+ * @headerfile lcm/lcm-cpp-handler-pool.hpp
+ */
+class HandlerPool {
+    public:
+        /**
+         * @brief Starts the pool's threads.
+         *
+         * @param lcm the LCM instance whose messages the pool handles.
+         * @param num_threads how many handlers can run at once.  One thread
+         * handles every subscription of the pool in turn.
+         */
+        inline HandlerPool(LCM* lcm, int num_threads = 1);
+
+        /**
+         * @brief Unsubscribes the pool's subscriptions and stops its threads.
+         */
+        inline ~HandlerPool();
+
+        /**
+         * @brief Subscribes a callback method of an object to a channel, like
+         * LCM::subscribe(), with the callback called on one of the pool's
+         * threads.
+         *
+         * The message is decoded on the pool's thread too.  The
+         * ReceiveBuffer passed to the callback points to the pool's copy of
+         * the message, which is only valid during the callback.
+         *
+         * @return a Subscription object that can be used to unsubscribe with
+         * HandlerPool::unsubscribe().  Its queue capacity and latest only
+         * options apply to the queue of the LCM instance, which handle()
+         * empties into the pool as fast as messages arrive.
+         */
+        template <class MessageType, class MessageHandlerClass>
+        Subscription* subscribe(const std::string& channel,
+                void (MessageHandlerClass::*handlerMethod)(const ReceiveBuffer* rbuf, const std::string& channel, const MessageType* msg),
+                MessageHandlerClass* handler);
+
+        /**
+         * @brief Subscribes a raw callback method of an object to a channel,
+         * like LCM::subscribe(), with the callback called on one of the pool's
+         * threads.
+         */
+        template <class MessageHandlerClass>
+        Subscription* subscribe(const std::string& channel,
+                void (MessageHandlerClass::*handlerMethod)(const ReceiveBuffer* rbuf, const std::string& channel),
+                MessageHandlerClass* handler);
+
+        /**
+         * @brief Unsubscribes a subscription made through the pool, dropping
+         * its queued messages.
+         *
+         * Its handler may still be running when this returns.
+         *
+         * @return 0 on success, -1 if the subscription wasn't made through
+         * this pool.
+         */
+        inline int unsubscribe(Subscription* subscription);
+
+        /**
+         * @brief Waits until the pool has handled every message it was given.
+         */
+        inline void waitForIdle();
+
+    private:
+        // A received message, copied out of the LCM instance's buffer
+        struct Message {
+            std::string channel;
+            std::vector<uint8_t> data;
+            int64_t recv_utime;
+            int64_t send_utime;
+            uint32_t send_seqno;
+        };
+
+        // The queue of one subscription.  A Strand is in ready or being
+        // handled (scheduled) while it has queued messages, never both, so
+        // its messages are handled one at a time and in order
+        class Strand {
+            public:
+                Strand() : pool(NULL), subscription(NULL), scheduled(false) {}
+                virtual ~Strand() {}
+
+                // Called by LCM::handle() for each message of the subscription
+                inline void enqueue(const ReceiveBuffer* rbuf, const std::string& channel);
+
+                virtual void handle(const Message& message) = 0;
+
+                HandlerPool* pool;
+                Subscription* subscription;
+                std::deque<Message> pending;
+                bool scheduled;
+        };
+
+        template <class MessageType, class MessageHandlerClass>
+        class TypedStrand;
+
+        template <class MessageHandlerClass>
+        class UntypedStrand;
+
+        inline Subscription* add(Strand* strand, const std::string& channel);
+        inline void push(Strand* strand, Message& message);
+        inline void run();
+
+        LCM* lcm;
+        std::vector<std::thread> threads;
+
+        // Guards everything below, and the pending and scheduled of every strand
+        std::mutex mutex;
+        std::condition_variable ready_cv;
+        std::condition_variable idle_cv;
+        std::vector<std::unique_ptr<Strand>> strands;
+        std::deque<Strand*> ready;
+        int running;
+        bool stopping;
+
+        HandlerPool(const HandlerPool&);
+        HandlerPool& operator=(const HandlerPool&);
+};
+
+/**
+ * @}
+ */
+
+// =============== implementation ===============
+
+template <class MessageType, class MessageHandlerClass>
+class HandlerPool::TypedStrand : public HandlerPool::Strand {
+    public:
+        MessageHandlerClass* handler;
+        void (MessageHandlerClass::*handlerMethod)(const ReceiveBuffer* rbuf, const std::string& channel, const MessageType* msg);
+
+        void handle(const Message& message)
+        {
+            MessageType msg;
+            int status = msg.decode(message.data.data(), 0, message.data.size());
+            if (status < 0) {
+                fprintf (stderr, "error %d decoding %s!!!\n", status,
+                        MessageType::getTypeName());
+                return;
+            }
+            const ReceiveBuffer rb = {
+                const_cast<uint8_t*>(message.data.data()),
+                static_cast<uint32_t>(message.data.size()),
+                message.recv_utime,
+                message.send_utime,
+                message.send_seqno
+            };
+            (handler->*handlerMethod)(&rb, message.channel, &msg);
+        }
+};
+
+template <class MessageHandlerClass>
+class HandlerPool::UntypedStrand : public HandlerPool::Strand {
+    public:
+        MessageHandlerClass* handler;
+        void (MessageHandlerClass::*handlerMethod)(const ReceiveBuffer* rbuf, const std::string& channel);
+
+        void handle(const Message& message)
+        {
+            const ReceiveBuffer rb = {
+                const_cast<uint8_t*>(message.data.data()),
+                static_cast<uint32_t>(message.data.size()),
+                message.recv_utime,
+                message.send_utime,
+                message.send_seqno
+            };
+            (handler->*handlerMethod)(&rb, message.channel);
+        }
+};
+
+void
+HandlerPool::Strand::enqueue(const ReceiveBuffer* rbuf, const std::string& channel)
+{
+    Message message;
+    message.channel = channel;
+    message.data.assign(static_cast<const uint8_t*>(rbuf->data),
+            static_cast<const uint8_t*>(rbuf->data) + rbuf->data_size);
+    message.recv_utime = rbuf->recv_utime;
+    message.send_utime = rbuf->send_utime;
+    message.send_seqno = rbuf->send_seqno;
+    pool->push(this, message);
+}
+
+inline
+HandlerPool::HandlerPool(LCM* lcm, int num_threads) :
+    lcm(lcm), running(0), stopping(false)
+{
+    if (num_threads < 1)
+        num_threads = 1;
+    for (int i = 0; i < num_threads; i++)
+        threads.push_back(std::thread(&HandlerPool::run, this));
+}
+
+inline
+HandlerPool::~HandlerPool()
+{
+    for (size_t i = 0; i < strands.size(); i++) {
+        if (strands[i]->subscription)
+            lcm->unsubscribe(strands[i]->subscription);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready_cv.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+template <class MessageType, class MessageHandlerClass>
+Subscription*
+HandlerPool::subscribe(const std::string& channel,
+        void (MessageHandlerClass::*handlerMethod)(const ReceiveBuffer* rbuf, const std::string& channel, const MessageType* msg),
+        MessageHandlerClass* handler)
+{
+    TypedStrand<MessageType, MessageHandlerClass>* strand =
+        new TypedStrand<MessageType, MessageHandlerClass>();
+    strand->handler = handler;
+    strand->handlerMethod = handlerMethod;
+    return add(strand, channel);
+}
+
+template <class MessageHandlerClass>
+Subscription*
+HandlerPool::subscribe(const std::string& channel,
+        void (MessageHandlerClass::*handlerMethod)(const ReceiveBuffer* rbuf, const std::string& channel),
+        MessageHandlerClass* handler)
+{
+    UntypedStrand<MessageHandlerClass>* strand = new UntypedStrand<MessageHandlerClass>();
+    strand->handler = handler;
+    strand->handlerMethod = handlerMethod;
+    return add(strand, channel);
+}
+
+inline Subscription*
+HandlerPool::add(Strand* strand, const std::string& channel)
+{
+    strand->pool = this;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        strands.push_back(std::unique_ptr<Strand>(strand));
+    }
+
+    // handle() copies messages into the pool without decoding them
+    strand->subscription = lcm->subscribe(channel, &Strand::enqueue, strand);
+    return strand->subscription;
+}
+
+inline int
+HandlerPool::unsubscribe(Subscription* subscription)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < strands.size(); i++) {
+        Strand* strand = strands[i].get();
+        if (strand->subscription != subscription || !subscription)
+            continue;
+
+        // The strand stays until the pool is destroyed, since a thread may
+        // still be handling its last message
+        strand->subscription = NULL;
+        strand->pending.clear();
+        lock.unlock();
+        return lcm->unsubscribe(subscription);
+    }
+    return -1;
+}
+
+inline void
+HandlerPool::push(Strand* strand, Message& message)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    strand->pending.push_back(std::move(message));
+
+    if (strand->scheduled)
+        return;
+    strand->scheduled = true;
+    ready.push_back(strand);
+    lock.unlock();
+    ready_cv.notify_one();
+}
+
+inline void
+HandlerPool::waitForIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!ready.empty() || running > 0)
+        idle_cv.wait(lock);
+}
+
+inline void
+HandlerPool::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (ready.empty() && !stopping)
+            ready_cv.wait(lock);
+        if (stopping)
+            return;
+
+        Strand* strand = ready.front();
+        ready.pop_front();
+        if (strand->pending.empty()) {
+            // unsubscribed while it was waiting its turn
+            strand->scheduled = false;
+            if (ready.empty() && running == 0)
+                idle_cv.notify_all();
+            continue;
+        }
+        Message message = std::move(strand->pending.front());
+        strand->pending.pop_front();
+        running++;
+        lock.unlock();
+
+        strand->handle(message);
+
+        lock.lock();
+        running--;
+        if (!strand->pending.empty()) {
+            // to the back of the line, so busy subscriptions take turns
+            ready.push_back(strand);
+            ready_cv.notify_one();
+        } else {
+            strand->scheduled = false;
+        }
+        if (ready.empty() && running == 0)
+            idle_cv.notify_all();
+    }
+}
+
+}
+
+#endif
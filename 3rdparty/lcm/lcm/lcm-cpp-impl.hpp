@@ -12,6 +12,12 @@ Subscription::setQueueCapacity(int num_messages)
     return lcm_subscription_set_queue_capacity(c_subs, num_messages);
 }
 
+int
+Subscription::setLatestOnly(bool latest_only)
+{
+    return lcm_subscription_set_latest_only(c_subs, latest_only ? 1 : 0);
+}
+
 template <class MessageType, class ContextClass>
 class LCMTypedSubscription : public Subscription {
     friend class LCM;
@@ -34,7 +40,9 @@ class LCMTypedSubscription : public Subscription {
             const ReceiveBuffer rb = {
                 rbuf->data,
                 rbuf->data_size,
-                rbuf->recv_utime
+                rbuf->recv_utime,
+                rbuf->send_utime,
+                rbuf->send_seqno
             };
             subs->handler(&rb, channel, &msg, subs->context);
         }
@@ -55,7 +63,9 @@ class LCMUntypedSubscription : public Subscription {
             const ReceiveBuffer rb = {
                 rbuf->data,
                 rbuf->data_size,
-                rbuf->recv_utime
+                rbuf->recv_utime,
+                rbuf->send_utime,
+                rbuf->send_seqno
             };
             subs->handler(&rb, channel, subs->context);
         }
@@ -82,7 +92,9 @@ class LCMMHSubscription : public Subscription {
             const ReceiveBuffer rb = {
                 rbuf->data,
                 rbuf->data_size,
-                rbuf->recv_utime
+                rbuf->recv_utime,
+                rbuf->send_utime,
+                rbuf->send_seqno
             };
             std::string chan_str(channel);
             (subs->handler->*subs->handlerMethod)(&rb, chan_str, &msg);
@@ -102,7 +114,9 @@ class LCMMHUntypedSubscription : public Subscription {
             const ReceiveBuffer rb = {
                 rbuf->data,
                 rbuf->data_size,
-                rbuf->recv_utime
+                rbuf->recv_utime,
+                rbuf->send_utime,
+                rbuf->send_seqno
             };
             std::string chan_str(channel);
             (subs->handler->*subs->handlerMethod)(&rb, chan_str);
@@ -153,6 +167,11 @@ template<class MessageType>
 inline int
 LCM::publish(const std::string& channel, const MessageType *msg) {
     unsigned int datalen = msg->getEncodedSize();
+    if(datalen <= LCM_CPP_PUBLISH_STACK_SIZE) {
+        uint8_t buf[LCM_CPP_PUBLISH_STACK_SIZE];
+        msg->encode(buf, 0, datalen);
+        return this->publish(channel, buf, datalen);
+    }
     uint8_t *buf = new uint8_t[datalen];
     msg->encode(buf, 0, datalen);
     int status = this->publish(channel, buf, datalen);
@@ -160,6 +179,26 @@ LCM::publish(const std::string& channel, const MessageType *msg) {
     return status;
 }
 
+int
+LCM::beginBatch() {
+    if(!this->lcm) {
+        fprintf(stderr,
+            "LCM instance not initialized.  Ignoring call to beginBatch()\n");
+        return -1;
+    }
+    return lcm_batch_begin(this->lcm);
+}
+
+int
+LCM::endBatch() {
+    if(!this->lcm) {
+        fprintf(stderr,
+            "LCM instance not initialized.  Ignoring call to endBatch()\n");
+        return -1;
+    }
+    return lcm_batch_end(this->lcm);
+}
+
 inline int
 LCM::unsubscribe(Subscription *subscription) {
     if(!this->lcm) {
@@ -299,6 +338,28 @@ LCM::getUnderlyingLCM()
     return this->lcm;
 }
 
+PublishBatch::PublishBatch(LCM& lcm) :
+    lcm(lcm),
+    open(lcm.beginBatch() == 0)
+{
+}
+
+PublishBatch::~PublishBatch()
+{
+    if(open)
+        lcm.endBatch();
+}
+
+int
+PublishBatch::flush()
+{
+    if(!open)
+        return 0;
+    int status = lcm.endBatch();
+    open = (lcm.beginBatch() == 0);
+    return status;
+}
+
 LogFile::LogFile(const std::string & path, const std::string & mode) :
   eventlog(lcm_eventlog_create(path.c_str(), mode.c_str())),
   last_event(NULL)
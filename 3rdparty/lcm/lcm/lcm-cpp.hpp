@@ -6,6 +6,15 @@
 #include <cstdio>  /* needed for FILE* */
 #include "lcm.h"
 
+/**
+ * Messages that encode to at most this many bytes are encoded on the stack
+ * by LCM::publish(const std::string&, const MessageType*), so publishing them
+ * doesn't allocate.  Larger messages are encoded into a heap buffer.
+ */
+#ifndef LCM_CPP_PUBLISH_STACK_SIZE
+#define LCM_CPP_PUBLISH_STACK_SIZE 4096
+#endif
+
 namespace lcm {
 
 /**
@@ -83,7 +92,9 @@ class LCM {
          * @brief Publishes a message with automatic message encoding.
          *
          * This template method is designed for use with C++ classes generated
-         * by lcm-gen.
+         * by lcm-gen.  Messages up to LCM_CPP_PUBLISH_STACK_SIZE bytes are
+         * encoded on the stack, so publishing them at a high rate doesn't
+         * allocate.
          *
          * @param channel the channel to publish the message on.
          * @param msg the message to publish.
@@ -93,6 +104,26 @@ class LCM {
         template<class MessageType>
         inline int publish(const std::string& channel, const MessageType* msg);
 
+        /**
+         * @brief Starts a publish batch on the calling thread.
+         *
+         * The messages the calling thread publishes until the matching
+         * endBatch() are queued and sent together.  PublishBatch ends the
+         * batch when it goes out of scope.
+         *
+         * @return 0 on success, or -1 if another thread has a batch open.
+         * @sa lcm_batch_begin()
+         */
+        inline int beginBatch();
+
+        /**
+         * @brief Ends a publish batch started with beginBatch().
+         *
+         * @return 0 on success, -1 on failure.
+         * @sa lcm_batch_end()
+         */
+        inline int endBatch();
+
         /**
          * @brief Returns a file descriptor or socket that can be used with
          * @c select(), @c poll(), or other event loops for asynchronous
@@ -408,6 +439,16 @@ struct ReceiveBuffer {
      * microseconds since the UNIX epoch.
      */
     int64_t recv_utime;
+    /**
+     * Timestamp identifying when the message was published, in microseconds
+     * since the UNIX epoch, or 0 if the publisher didn't trace it.
+     */
+    int64_t send_utime;
+    /**
+     * How many messages the publisher had published on the channel before
+     * this one, if send_utime is set.
+     */
+    uint32_t send_seqno;
 };
 
 /**
@@ -443,6 +484,23 @@ class Subscription {
          */
         inline int setQueueCapacity(int num_messages);
 
+        /**
+         * @brief Makes this subscription handle only the newest message of
+         * each channel.
+         *
+         * @param latest_only true to skip a queued message when a newer one
+         * on the same channel is queued behind it, false to handle every
+         * message (the default).
+         *
+         * For subscribers that only care about the current value, like a
+         * pose.  A subscriber that falls behind catches up with one handler
+         * call, and typed subscriptions don't decode the skipped messages.
+         * The queue capacity doesn't apply while this is set.  LCM::handle()
+         * may return without calling a handler when the message it dequeued
+         * was skipped.
+         */
+        inline int setLatestOnly(bool latest_only = true);
+
     friend class LCM;
     protected:
         Subscription() {};
@@ -453,6 +511,44 @@ class Subscription {
         lcm_subscription_t *c_subs;
 };
 
+/**
+ * @brief Publishes the messages of one scope as a batch.
+ *
+ * Calls LCM::beginBatch() when constructed and LCM::endBatch() when
+ * destroyed, so everything the scope publishes goes out together:
+ *
+ * @code
+ * {
+ *     lcm::PublishBatch batch(lcm);
+ *     lcm.publish("POSE", &pose);
+ *     lcm.publish("STATUS", &status);
+ * }
+ * @endcode
+ *
+ * @headerfile lcm/lcm-cpp.hpp
+ */
+class PublishBatch {
+    public:
+        inline explicit PublishBatch(LCM& lcm);
+
+        inline ~PublishBatch();
+
+        /**
+         * @brief Sends what the batch has queued so far and keeps it open.
+         *
+         * @return 0 on success, -1 on failure.
+         */
+        inline int flush();
+
+    private:
+        // Not copyable, the batch is ended once.
+        PublishBatch(const PublishBatch& other);
+        PublishBatch& operator=(const PublishBatch& other);
+
+        LCM& lcm;
+        bool open;
+};
+
 /**
  * @brief Represents a single event (message) in a log file.
  *
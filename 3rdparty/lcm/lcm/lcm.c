@@ -28,12 +28,19 @@ struct _lcm_t {
     GPtrArray   *handlers_all;  // list containing *all* handlers
     GHashTable  *handlers_map;  // map of channel name (string) to GPtrArray 
                                 // of matching handlers (lcm_subscription_t*)
+    GHashTable  *handlers_literal;  // map of channel name to GPtrArray of the
+                                    // handlers subscribed to exactly that name
+    int num_pattern_handlers;   // handlers whose channel is a regex
 
     lcm_provider_vtable_t * vtable;
     lcm_provider_t * provider;
 
     int default_max_num_queued_messages;
     int in_handle;
+
+    // set while lcm_log_start() is logging
+    lcm_eventlog_writer_t *log_writer;
+    lcm_subscription_t *log_subs;
 };
 
 struct _lcm_subscription_t {
@@ -41,12 +48,18 @@ struct _lcm_subscription_t {
     lcm_msg_handler_t  handler;
     void             *userdata;
     lcm_t* lcm;
-    GRegex * regex;
+    GRegex * regex;     // NULL if the channel has no regex metacharacters
     int callback_scheduled;
     int marked_for_deletion;
 
     int max_num_queued_messages;
     int num_queued_messages;
+
+    // if set, only the newest queued message of each channel is handled.
+    // latest_queued maps a channel name to how many of its messages are
+    // queued for this subscription.
+    int latest_only;
+    GHashTable *latest_queued;
 };
 
 extern void lcm_udpm_provider_init (GPtrArray * providers);
@@ -54,6 +67,7 @@ extern void lcm_logprov_provider_init (GPtrArray * providers);
 extern void lcm_tcpq_provider_init (GPtrArray * providers);
 extern void lcm_mpudpm_provider_init(GPtrArray * providers);
 extern void lcm_memq_provider_init(GPtrArray * providers);
+extern void lcm_shm_provider_init(GPtrArray * providers);
 
 lcm_t * 
 lcm_create (const char *url)
@@ -82,6 +96,7 @@ lcm_create (const char *url)
     lcm_tcpq_provider_init (providers);
     lcm_mpudpm_provider_init (providers);
     lcm_memq_provider_init (providers);
+    lcm_shm_provider_init (providers);
     if (providers->len == 0) {
         fprintf (stderr, "Error: no LCM providers found\n");
         goto fail;
@@ -122,6 +137,7 @@ lcm_create (const char *url)
     lcm->vtable = info->vtable;
     lcm->handlers_all = g_ptr_array_new();
     lcm->handlers_map = g_hash_table_new (g_str_hash, g_str_equal);
+    lcm->handlers_literal = g_hash_table_new (g_str_hash, g_str_equal);
 
     g_static_rec_mutex_init (&lcm->mutex);
     g_static_rec_mutex_init (&lcm->handle_mutex);
@@ -169,7 +185,10 @@ static void
 lcm_handler_free (lcm_subscription_t *h) 
 {
     assert (!h->callback_scheduled);
-    g_regex_unref(h->regex);
+    if (h->regex)
+        g_regex_unref(h->regex);
+    if (h->latest_queued)
+        g_hash_table_destroy (h->latest_queued);
     free (h->channel);
     memset (h, 0, sizeof (lcm_subscription_t));
     free (h);
@@ -187,8 +206,12 @@ lcm_destroy (lcm_t * lcm)
         }
         lcm->vtable->destroy (lcm->provider);
     }
+    if (lcm->log_writer)
+        lcm_eventlog_writer_destroy (lcm->log_writer);
     g_hash_table_foreach (lcm->handlers_map, map_free_handlers_callback, NULL);
     g_hash_table_destroy (lcm->handlers_map);
+    g_hash_table_foreach (lcm->handlers_literal, map_free_handlers_callback, NULL);
+    g_hash_table_destroy (lcm->handlers_literal);
 
     for (unsigned int i = 0; i < lcm->handlers_all->len; i++) {
         lcm_subscription_t *h = (lcm_subscription_t *) g_ptr_array_index(
@@ -267,12 +290,42 @@ lcm_publish (lcm_t *lcm, const char *channel, const void *data,
         return -1;
 }
 
+int
+lcm_batch_begin (lcm_t *lcm)
+{
+    if (!lcm->provider)
+        return -1;
+    if (!lcm->vtable->begin_batch)
+        return 0;
+    return lcm->vtable->begin_batch (lcm->provider);
+}
+
+int
+lcm_batch_end (lcm_t *lcm)
+{
+    if (!lcm->provider)
+        return -1;
+    if (!lcm->vtable->end_batch)
+        return 0;
+    return lcm->vtable->end_batch (lcm->provider);
+}
+
 static int 
 is_handler_subscriber(lcm_subscription_t *h, const char *channel_name)
 {
+    if (!h->regex)
+        return !strcmp(h->channel, channel_name);
     return g_regex_match(h->regex, channel_name, (GRegexMatchFlags) 0, NULL);
 }
 
+// a channel without regex metacharacters only matches itself, so it can be
+// compared and looked up as a string instead of compiled
+static int
+is_literal_channel(const char *channel)
+{
+    return !strpbrk(channel, ".^$*+?()[]{}|\\");
+}
+
 // add the handler to any channel's handler list if its subscription matches
 static void 
 map_add_handler_callback(gpointer _key, gpointer _value, gpointer _data)
@@ -297,6 +350,27 @@ map_remove_handler_callback(gpointer _key, gpointer _value,
     g_ptr_array_remove_fast(handlers, h);
 }
 
+// remove the handler from the lists it was added to when it subscribed and
+// from its channels' handler lists.  lcm's mutex must be held.
+static void
+remove_handler_from_lists(lcm_t *lcm, lcm_subscription_t *h)
+{
+    g_ptr_array_remove(lcm->handlers_all, h);
+    if (h->regex) {
+        lcm->num_pattern_handlers--;
+        g_hash_table_foreach(lcm->handlers_map, map_remove_handler_callback, h);
+        return;
+    }
+
+    GPtrArray *literal = (GPtrArray *) g_hash_table_lookup(
+            lcm->handlers_literal, h->channel);
+    g_ptr_array_remove(literal, h);
+    GPtrArray *handlers = (GPtrArray *) g_hash_table_lookup(
+            lcm->handlers_map, h->channel);
+    if (handlers)
+        g_ptr_array_remove_fast(handlers, h);
+}
+
 lcm_subscription_t
 *lcm_subscribe (lcm_t *lcm, const char *channel, 
                      lcm_msg_handler_t handler, void *userdata)
@@ -320,20 +394,39 @@ lcm_subscription_t
     h->num_queued_messages = 0;
     h->lcm = lcm;
 
-    char *regexbuf = g_strdup_printf("^%s$", channel);
-    GError *rerr = NULL;
-    h->regex = g_regex_new(regexbuf, (GRegexCompileFlags) 0, (GRegexMatchFlags) 0, &rerr);
-    g_free(regexbuf);
-    if(rerr) {
-        fprintf(stderr, "%s: %s\n", __FUNCTION__, rerr->message);
-        dbg(DBG_LCM, "%s: %s\n", __FUNCTION__, rerr->message);
-        g_error_free(rerr);
-        free(h);
-        return NULL;
+    if (!is_literal_channel(channel)) {
+        char *regexbuf = g_strdup_printf("^%s$", channel);
+        GError *rerr = NULL;
+        h->regex = g_regex_new(regexbuf, (GRegexCompileFlags) 0, (GRegexMatchFlags) 0, &rerr);
+        g_free(regexbuf);
+        if(rerr) {
+            fprintf(stderr, "%s: %s\n", __FUNCTION__, rerr->message);
+            dbg(DBG_LCM, "%s: %s\n", __FUNCTION__, rerr->message);
+            g_error_free(rerr);
+            free(h->channel);
+            free(h);
+            return NULL;
+        }
     }
     g_static_rec_mutex_lock (&lcm->mutex);
     g_ptr_array_add(lcm->handlers_all, h);
-    g_hash_table_foreach(lcm->handlers_map, map_add_handler_callback, h);
+    if (h->regex) {
+        lcm->num_pattern_handlers++;
+        g_hash_table_foreach(lcm->handlers_map, map_add_handler_callback, h);
+    } else {
+        // only the channel's own handler list can match
+        GPtrArray *literal = (GPtrArray *) g_hash_table_lookup(
+                lcm->handlers_literal, channel);
+        if (!literal) {
+            literal = g_ptr_array_new();
+            g_hash_table_insert(lcm->handlers_literal, strdup(channel), literal);
+        }
+        g_ptr_array_add(literal, h);
+        GPtrArray *handlers = (GPtrArray *) g_hash_table_lookup(
+                lcm->handlers_map, channel);
+        if (handlers)
+            g_ptr_array_add(handlers, h);
+    }
     g_static_rec_mutex_unlock (&lcm->mutex);
 
     return h;
@@ -344,16 +437,16 @@ lcm_unsubscribe (lcm_t *lcm, lcm_subscription_t *h)
 {
     g_static_rec_mutex_lock (&lcm->mutex);
 
-    // remove the handler from the master list
-    int foundit = g_ptr_array_remove(lcm->handlers_all, h);
+    int foundit = FALSE;
+    for (unsigned int i = 0; i < lcm->handlers_all->len && !foundit; i++)
+        foundit = g_ptr_array_index(lcm->handlers_all, i) == h;
 
     if (lcm->provider && lcm->vtable->unsubscribe) {
         lcm->vtable->unsubscribe(lcm->provider, h->channel);
     }
 
     if (foundit) {
-        // remove the handler from all the lists in the hash table
-        g_hash_table_foreach(lcm->handlers_map, map_remove_handler_callback, h);
+        remove_handler_from_lists(lcm, h);
         if (!h->callback_scheduled)
             lcm_handler_free (h);
         else
@@ -381,7 +474,15 @@ lcm_get_handlers (lcm_t * lcm, const char * channel)
     // alloc channel name
     g_hash_table_insert (lcm->handlers_map, strdup(channel), handlers);
 
-    // find all the matching handlers
+    // find all the matching handlers.  Without any regex subscriptions they
+    // are the ones subscribed to exactly this name.
+    if (!lcm->num_pattern_handlers) {
+        GPtrArray *literal = (GPtrArray *) g_hash_table_lookup(
+                lcm->handlers_literal, channel);
+        for (unsigned int i = 0; literal && i < literal->len; i++)
+            g_ptr_array_add(handlers, g_ptr_array_index(literal, i));
+        goto finished;
+    }
     for (unsigned int i = 0; i < lcm->handlers_all->len; i++) {
         lcm_subscription_t *h = (lcm_subscription_t *) g_ptr_array_index (lcm->handlers_all, i);
         if (is_handler_subscriber (h, channel))
@@ -393,15 +494,32 @@ finished:
     return handlers;
 }
 
-int
-lcm_try_enqueue_message(lcm_t* lcm, const char* channel)
+// count a newly queued message on channel for a latest only subscription
+static void
+_latest_enqueue (lcm_subscription_t *h, const char *channel)
+{
+    int queued = GPOINTER_TO_INT (
+            g_hash_table_lookup (h->latest_queued, channel));
+    g_hash_table_replace (h->latest_queued, strdup (channel),
+            GINT_TO_POINTER (queued + 1));
+}
+
+static int
+_try_enqueue_message (lcm_t* lcm, const char* channel, int count_latest)
 {
     g_static_rec_mutex_lock (&lcm->mutex);
     GPtrArray * handlers = lcm_get_handlers (lcm, channel);
     int num_keepers = 0;
     for(unsigned int i=0; i<handlers->len; i++) {
         lcm_subscription_t* h = (lcm_subscription_t*) g_ptr_array_index(handlers, i);
-        if(h->num_queued_messages <= h->max_num_queued_messages ||
+        if (h->latest_only) {
+            // always keep the newest message, the ones before it are
+            // skipped when they're dispatched
+            if (count_latest)
+                _latest_enqueue (h, channel);
+            h->num_queued_messages++;
+            num_keepers++;
+        } else if(h->num_queued_messages <= h->max_num_queued_messages ||
                 h->max_num_queued_messages <= 0) {
             h->num_queued_messages++;
             num_keepers++;
@@ -411,6 +529,31 @@ lcm_try_enqueue_message(lcm_t* lcm, const char* channel)
     return num_keepers > 0;
 }
 
+int
+lcm_try_enqueue_message(lcm_t* lcm, const char* channel)
+{
+    return _try_enqueue_message (lcm, channel, 1);
+}
+
+void
+lcm_count_latest_only (lcm_t * lcm, const char * channel)
+{
+    g_static_rec_mutex_lock (&lcm->mutex);
+    GPtrArray * handlers = lcm_get_handlers (lcm, channel);
+    for(unsigned int i=0; i<handlers->len; i++) {
+        lcm_subscription_t* h = (lcm_subscription_t*) g_ptr_array_index(handlers, i);
+        if (h->latest_only)
+            _latest_enqueue (h, channel);
+    }
+    g_static_rec_mutex_unlock (&lcm->mutex);
+}
+
+int
+lcm_try_dispatch_message (lcm_t * lcm, const char * channel)
+{
+    return _try_enqueue_message (lcm, channel, 0);
+}
+
 int
 lcm_has_handlers (lcm_t * lcm, const char * channel)
 {
@@ -423,6 +566,24 @@ lcm_has_handlers (lcm_t * lcm, const char * channel)
     return has_handlers;
 }
 
+// count one message on channel as dequeued for a latest only subscription.
+// Returns how many newer messages on channel are still queued for it.
+static int
+_latest_dequeue (lcm_subscription_t *h, const char *channel)
+{
+    int queued = GPOINTER_TO_INT (
+            g_hash_table_lookup (h->latest_queued, channel));
+    // the message was queued before the subscription became latest only
+    if (queued <= 0)
+        return 0;
+    if (queued == 1)
+        g_hash_table_remove (h->latest_queued, channel);
+    else
+        g_hash_table_replace (h->latest_queued, strdup (channel),
+                GINT_TO_POINTER (queued - 1));
+    return queued - 1;
+}
+
 int
 lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
 {
@@ -446,6 +607,12 @@ lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
         lcm_subscription_t *h = (lcm_subscription_t *) g_ptr_array_index(handlers, i);
         if (!h->marked_for_deletion && h->num_queued_messages > 0) {
             h->num_queued_messages--;
+            if (h->latest_only && _latest_dequeue (h, channel) > 0) {
+                // a newer message on this channel is queued, so this one is
+                // stale.  Skip it without calling (and decoding in) the
+                // handler.
+                continue;
+            }
             int depth = g_static_rec_mutex_unlock_full (&lcm->mutex);
             h->handler (buf, channel, h->userdata);
             g_static_rec_mutex_lock_full (&lcm->mutex, depth);
@@ -463,9 +630,7 @@ lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
     // actually delete handlers marked for deletion
     for (;to_remove; to_remove = g_list_delete_link (to_remove, to_remove)) {
         lcm_subscription_t *h = (lcm_subscription_t *) to_remove->data;
-        g_ptr_array_remove (lcm->handlers_all, h);
-        g_hash_table_foreach (lcm->handlers_map, 
-                map_remove_handler_callback, h);
+        // lcm_unsubscribe already took it out of the handler lists
         lcm_handler_free (h);
     }
     g_static_rec_mutex_unlock (&lcm->mutex);
@@ -528,3 +693,72 @@ lcm_subscription_set_queue_capacity(lcm_subscription_t* subs, int num_messages)
     g_static_rec_mutex_unlock(&subs->lcm->mutex);
     return 0;
 }
+
+static void
+_log_handler (const lcm_recv_buf_t *rbuf, const char *channel, void *user_data)
+{
+    lcm_eventlog_writer_t *writer = (lcm_eventlog_writer_t *) user_data;
+    lcm_eventlog_writer_write (writer, rbuf->recv_utime, channel, rbuf->data,
+            rbuf->data_size);
+}
+
+lcm_subscription_t *
+lcm_log_start (lcm_t *lcm, const char *path, const char *channel)
+{
+    g_static_rec_mutex_lock (&lcm->handle_mutex);
+    if (lcm->log_writer) {
+        g_static_rec_mutex_unlock (&lcm->handle_mutex);
+        fprintf (stderr, "lcm_log_start: already logging\n");
+        return NULL;
+    }
+
+    lcm_eventlog_writer_t *writer = lcm_eventlog_writer_create (path, 0);
+    if (!writer) {
+        g_static_rec_mutex_unlock (&lcm->handle_mutex);
+        return NULL;
+    }
+    lcm->log_subs = lcm_subscribe (lcm, channel ? channel : ".*",
+            _log_handler, writer);
+    if (!lcm->log_subs) {
+        lcm_eventlog_writer_destroy (writer);
+        g_static_rec_mutex_unlock (&lcm->handle_mutex);
+        return NULL;
+    }
+    lcm->log_writer = writer;
+    g_static_rec_mutex_unlock (&lcm->handle_mutex);
+    return lcm->log_subs;
+}
+
+int
+lcm_log_stop (lcm_t *lcm)
+{
+    // handle_mutex keeps another thread from being in _log_handler meanwhile
+    g_static_rec_mutex_lock (&lcm->handle_mutex);
+    if (!lcm->log_writer) {
+        g_static_rec_mutex_unlock (&lcm->handle_mutex);
+        return -1;
+    }
+    lcm_unsubscribe (lcm, lcm->log_subs);
+    lcm_eventlog_writer_destroy (lcm->log_writer);
+    lcm->log_writer = NULL;
+    lcm->log_subs = NULL;
+    g_static_rec_mutex_unlock (&lcm->handle_mutex);
+    return 0;
+}
+
+int
+lcm_subscription_set_latest_only(lcm_subscription_t* subs, int latest_only)
+{
+    g_static_rec_mutex_lock(&subs->lcm->mutex);
+    if (latest_only && !subs->latest_queued) {
+        subs->latest_queued = g_hash_table_new_full (g_str_hash, g_str_equal,
+                free, NULL);
+    } else if (!latest_only && subs->latest_queued) {
+        // forget the counts, they would be stale by the time it's set again
+        g_hash_table_destroy (subs->latest_queued);
+        subs->latest_queued = NULL;
+    }
+    subs->latest_only = latest_only ? 1 : 0;
+    g_static_rec_mutex_unlock(&subs->lcm->mutex);
+    return 0;
+}
@@ -76,6 +76,18 @@ struct _lcm_recv_buf_t
      * pointer to the lcm_t struct that owns this buffer
      */
     lcm_t *lcm;
+    /**
+     * timestamp (microseconds since the epoch) at which the message was
+     * published, or 0 if the publisher didn't trace it.  See the trace
+     * option of the udpm provider.
+     */
+    int64_t send_utime;
+    /**
+     * how many messages the publisher had published on the channel before
+     * this one, if send_utime is set.  A gap between two messages counts the
+     * messages lost in between.
+     */
+    uint32_t send_seqno;
 };
 
 /**
@@ -114,11 +126,42 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
      options:
          recv_buf_size = N
              size of the kernel UDP receive buffer to request.  Defaults to
-             operating system defaults
+             2 MB, or as much of it as the operating system allows.  A size
+             that is given explicitly is forced past the system limit when
+             the process is privileged, and a warning is printed if the
+             system gives less.
+
+     Message loss, whether from bad packets or packets the kernel dropped
+     because its receive buffer was full, is reported on stderr every 2
+     seconds while it happens.
 
          ttl = N
              time to live of transmitted packets.  Default 0
 
+         multicast_loopback = 0 | 1
+             whether transmitted packets are also received on the local
+             host.  Default 1
+
+         trace = 0 | 1
+             whether transmitted messages carry the time they were published
+             and a sequence number per channel, for receivers to measure
+             latency and loss with.  Costs 12 bytes per message.  Default 0
+
+         frag_rate = N
+             bytes per second to pace the fragments of large messages to,
+             so that a large message doesn't go out as one burst that
+             overflows switch and receive buffers and drops other traffic.
+             Small messages aren't paced and are sent between the
+             fragments.  Default 0, as fast as possible
+
+         groups = REGEX@ADDRESS;REGEX@ADDRESS;...
+             sends the channels matching each regex to their own multicast
+             address, on the same port, instead of the default one.  The
+             first regex a channel matches decides.  Subscribers only join
+             the groups their subscriptions can match, so the kernel drops
+             the traffic of the rest rather than every process receiving
+             it.  Every process has to be given the same groups.
+
      examples:
          "udpm://239.255.76.67:7667"
              Default initialization string
@@ -126,6 +169,10 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
          "udpm://239.255.76.67:7667?ttl=1"
              Sets the multicast TTL to 1 so that packets published will enter
              the local network.
+
+         "udpm://239.255.76.67:7667?ttl=1&groups=/camera_.*@239.255.76.68"
+             Sends the /camera_ channels to 239.255.76.68:7667, so only the
+             processes subscribed to them receive the images.
  @endverbatim
  *
  * @verbatim
@@ -156,6 +203,15 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
              log file.  If it is after the last event, calls to lcm_handle will
              return -1.
 
+         index = auto | build | off
+             Whether to read the log through its index, which lets playback
+             seek to start_timestamp without reading up to it, and skip the
+             events of unsubscribed channels without reading them.  'auto',
+             the default, uses the index if the log has one.  'build' indexes
+             the log first if it has none.  Logs written with
+             lcm_eventlog_writer_t or lcm_log_start() are indexed as they
+             are written.
+
      examples:
          "file:///home/albert/path/to/logfile"
              Loads the file "/home/albert/path/to/logfile" as an LCM event
@@ -182,6 +238,81 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
         "memq://"
             This is the only valid way to instantiate this provider.
 
+ @endverbatim
+ *
+ * @verbatim
+ shm://
+    Shared memory provider, Linux only
+
+    Passes messages between LCM instances on the same host through a
+    shared memory ring per channel, without going through the kernel's
+    network stack.  Each ring keeps the latest messages of its channel, and
+    a subscriber that falls more than a ring behind loses the oldest ones.
+    The first instance on the host creates the shared memory and chooses
+    the ring size.
+
+    network is optional, and of the same form as for udpm://.  If it's
+    given, messages are also published on UDP multicast, without loopback
+    so the host doesn't receive its own messages twice, and messages
+    published on UDP multicast by other hosts are received too.  Every
+    instance on the host has to use shm:// then.
+
+    options:
+        slots = N
+            messages kept for each channel.  Default 16
+
+        slot_size = N
+            bytes of each slot, including a 24 byte header.  Larger
+            messages can't be published.  Default 65536
+
+        name = NAME
+            prefix of the shared memory objects in /dev/shm, so separate
+            groups of instances don't see each other's messages.
+            Default "lcm"
+
+        ttl = N, recv_buf_size = N, trace = 0 | 1, frag_rate = N,
+        groups = ...
+            passed on to UDP multicast
+
+    Messages passed through shared memory are always traced, since each
+    slot has their publish time and sequence number anyway.
+
+    examples:
+        "shm://"
+            Messages stay on the local host.
+
+        "shm://239.255.76.67:7667?ttl=255"
+            Messages between local instances go through shared memory, and
+            other hosts on 239.255.76.67:7667 still receive them.
+
+ @endverbatim
+ *
+ * @verbatim
+ tcpq://
+    TCP provider, through an LCM TCP server
+
+    For links without multicast.  network is of the form "host:port", and
+    defaults to "127.0.0.1:7700".  Each message is written with one call,
+    with Nagle's algorithm off, and the messages of a publish batch are
+    written together.  A message the socket can't take without blocking
+    is queued, and written by the next publish, or by lcm_handle() while
+    it waits for incoming messages.
+
+    options:
+        latest = REGEX
+            channels only the newest message matters on.  A message queued
+            on one of them is dropped when a newer one is published, and
+            publishing on them never waits for the server.  Default none
+
+        queue_size = N
+            bytes that can be queued before publishing on any other
+            channel waits for the server to take some.  Default 1 MB
+
+    examples:
+        "tcpq://10.0.0.1:7700?latest=/odometry|/camera_.*"
+            Pose and camera messages that the link falls behind on are
+            replaced by the newest ones instead of piling up.
+
  @endverbatim
  *
  * @return a newly allocated lcm_t instance, or NULL on failure.  Free with
@@ -278,6 +409,40 @@ LCM_API_FUNCTION
 int lcm_publish (lcm_t *lcm, const char *channel, const void *data,
         unsigned int datalen);
 
+/**
+ * @brief Starts a publish batch on the calling thread.
+ *
+ * Until the matching lcm_batch_end(), the messages the calling thread
+ * publishes on @p lcm are queued and then sent together, so a module that
+ * publishes several messages every cycle sends them back to back with as
+ * few system calls as the provider allows.  udpm queues short messages and
+ * sends them with one sendmmsg() call where it's available.  Batches on the
+ * same thread nest, and only the outermost lcm_batch_end() sends.
+ * Providers that don't batch send every message when it is published.
+ *
+ * Messages published from other threads while the batch is open are sent
+ * as usual.
+ *
+ * @param lcm The %LCM object
+ *
+ * @return 0 on success, or -1 if another thread has a batch open, in which
+ * case the calling thread's messages are sent as usual.
+ */
+LCM_API_FUNCTION
+int lcm_batch_begin (lcm_t *lcm);
+
+/**
+ * @brief Ends a publish batch started with lcm_batch_begin(), sending what
+ * it queued if it's the outermost one.
+ *
+ * @param lcm The %LCM object
+ *
+ * @return 0 on success, or -1 if the calling thread has no batch open or
+ * not all of the queued messages could be sent.
+ */
+LCM_API_FUNCTION
+int lcm_batch_end (lcm_t *lcm);
+
 /**
  * @brief Wait for and dispatch the next incoming message.
  *
@@ -344,6 +509,62 @@ int lcm_handle_timeout (lcm_t *lcm, int timeout_millis);
 LCM_API_FUNCTION
 int lcm_subscription_set_queue_capacity(lcm_subscription_t* handler, int num_messages);
 
+/**
+ * @brief Makes a subscription handle only the newest message of each channel.
+ *
+ * For subscribers that only care about the current value, like a pose or a
+ * joint angle.  A message is skipped when it's dispatched if a newer one on
+ * the same channel is already queued, so a subscriber that falls behind
+ * catches up with one handler call instead of working through the backlog.
+ * Skipped messages are never passed to the handler, so typed subscriptions
+ * don't decode them.  The queue capacity doesn't apply while this is set,
+ * since the newest message must always be kept.
+ *
+ * Messages are still dequeued one at a time, so lcm_handle() may return
+ * without calling the handler when the message it dequeued was stale.
+ *
+ * @param handler the subscription object
+ * @param latest_only 1 to only handle the newest message of each channel, 0
+ * to handle every queued message (the default).
+ *
+ */
+LCM_API_FUNCTION
+int lcm_subscription_set_latest_only(lcm_subscription_t* handler, int latest_only);
+
+/**
+ * @brief Log the messages this instance receives to a log file.
+ *
+ * Logs from inside the process instead of through a separate lcm-logger,
+ * with an lcm_eventlog_writer_t, so logging a message is one copy into the
+ * mapped log file on the thread calling lcm_handle().  The log is in the
+ * usual format, with an index file next to it.  Logging stops with
+ * lcm_log_stop(), or when the instance is destroyed.
+ *
+ * Messages are only logged while lcm_handle() is called, like those of any
+ * subscription.  The returned subscription's queue capacity can be raised so
+ * that slow handlers of other subscriptions don't cost logged messages.
+ *
+ * @param lcm the LCM object
+ * @param path the log file to create
+ * @param channel a regular expression of the channels to log, like
+ * lcm_subscribe(), or NULL for every channel
+ *
+ * @return the subscription doing the logging, or NULL if the log couldn't
+ * be created or this instance is already logging.  lcm_log_stop()
+ * unsubscribes it.
+ */
+LCM_API_FUNCTION
+lcm_subscription_t *lcm_log_start(lcm_t *lcm, const char *path,
+        const char *channel);
+
+/**
+ * @brief Stop logging started by lcm_log_start(), and finish the log file.
+ *
+ * @return 0 on success, or -1 if the instance wasn't logging.
+ */
+LCM_API_FUNCTION
+int lcm_log_stop(lcm_t *lcm);
+
 /// LCM release major version - the X in version X.Y.Z
 #define LCM_MAJOR_VERSION 1
 
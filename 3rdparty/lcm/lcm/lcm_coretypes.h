@@ -6,6 +6,18 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define __LCM_SWAP_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#define __LCM_SWAP_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define __LCM_BIG_ENDIAN_HOST 1
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +41,120 @@ struct ___lcm_hash_ptr
     void *v;
 };
 
+/**
+ * BYTE ORDER
+ *
+ * Arrays of 16, 32 and 64 bit numbers are converted between the host's
+ * byte order and the big endian wire format a block at a time: 16 bytes
+ * per vector shuffle with NEON or SSSE3, and one element per byte swap
+ * instruction otherwise. Big endian hosts copy them as they are. src and
+ * dst need no alignment and must not overlap.
+ */
+static inline uint16_t __lcm_bswap16(uint16_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap16(v);
+#else
+    return (uint16_t) ((v << 8) | (v >> 8));
+#endif
+}
+
+static inline uint32_t __lcm_bswap32(uint32_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap32(v);
+#else
+    return (v << 24) | ((v << 8) & 0xff0000) | ((v >> 8) & 0xff00) | (v >> 24);
+#endif
+}
+
+static inline uint64_t __lcm_bswap64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap64(v);
+#else
+    return ((uint64_t) __lcm_bswap32((uint32_t) v) << 32) | __lcm_bswap32((uint32_t) (v >> 32));
+#endif
+}
+
+static inline void __lcm_swap16_array(uint8_t *dst, const uint8_t *src, int elements)
+{
+#ifdef __LCM_BIG_ENDIAN_HOST
+    if (elements > 0)
+        memcpy(dst, src, elements * 2);
+#else
+    int element = 0;
+#if defined(__LCM_SWAP_NEON)
+    for (; element + 8 <= elements; element += 8)
+        vst1q_u8(dst + element * 2, vrev16q_u8(vld1q_u8(src + element * 2)));
+#elif defined(__LCM_SWAP_SSSE3)
+    const __m128i order = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; element + 8 <= elements; element += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + element * 2));
+        _mm_storeu_si128((__m128i *) (dst + element * 2), _mm_shuffle_epi8(v, order));
+    }
+#endif
+    for (; element < elements; element++) {
+        uint16_t v;
+        memcpy(&v, src + element * 2, 2);
+        v = __lcm_bswap16(v);
+        memcpy(dst + element * 2, &v, 2);
+    }
+#endif
+}
+
+static inline void __lcm_swap32_array(uint8_t *dst, const uint8_t *src, int elements)
+{
+#ifdef __LCM_BIG_ENDIAN_HOST
+    if (elements > 0)
+        memcpy(dst, src, elements * 4);
+#else
+    int element = 0;
+#if defined(__LCM_SWAP_NEON)
+    for (; element + 4 <= elements; element += 4)
+        vst1q_u8(dst + element * 4, vrev32q_u8(vld1q_u8(src + element * 4)));
+#elif defined(__LCM_SWAP_SSSE3)
+    const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; element + 4 <= elements; element += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + element * 4));
+        _mm_storeu_si128((__m128i *) (dst + element * 4), _mm_shuffle_epi8(v, order));
+    }
+#endif
+    for (; element < elements; element++) {
+        uint32_t v;
+        memcpy(&v, src + element * 4, 4);
+        v = __lcm_bswap32(v);
+        memcpy(dst + element * 4, &v, 4);
+    }
+#endif
+}
+
+static inline void __lcm_swap64_array(uint8_t *dst, const uint8_t *src, int elements)
+{
+#ifdef __LCM_BIG_ENDIAN_HOST
+    if (elements > 0)
+        memcpy(dst, src, elements * 8);
+#else
+    int element = 0;
+#if defined(__LCM_SWAP_NEON)
+    for (; element + 2 <= elements; element += 2)
+        vst1q_u8(dst + element * 8, vrev64q_u8(vld1q_u8(src + element * 8)));
+#elif defined(__LCM_SWAP_SSSE3)
+    const __m128i order = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for (; element + 2 <= elements; element += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + element * 8));
+        _mm_storeu_si128((__m128i *) (dst + element * 8), _mm_shuffle_epi8(v, order));
+    }
+#endif
+    for (; element < elements; element++) {
+        uint64_t v;
+        memcpy(&v, src + element * 8, 8);
+        v = __lcm_bswap64(v);
+        memcpy(dst + element * 8, &v, 8);
+    }
+#endif
+}
+
 /**
  * BOOLEAN
  */
@@ -138,21 +264,11 @@ static inline int __int16_t_encode_array(void *_buf, int offset, int maxlen, con
 {
     int total_size = sizeof(int16_t) * elements;
     uint8_t *buf = (uint8_t*) _buf;
-    int pos = offset;
-    int element;
 
     if (maxlen < total_size)
         return -1;
 
-    //  See Section 5.8 paragraph 3 of the standard
-    //  http://open-std.org/JTC1/SC22/WG21/docs/papers/2015/n4527.pdf
-    //  use uint for shifting instead if int
-    const uint16_t *unsigned_p = (uint16_t*)p;
-    for (element = 0; element < elements; element++) {
-        uint16_t v = unsigned_p[element];
-        buf[pos++] = (v>>8) & 0xff;
-        buf[pos++] = (v & 0xff);
-    }
+    __lcm_swap16_array(&buf[offset], (const uint8_t*) p, elements);
 
     return total_size;
 }
@@ -160,17 +276,12 @@ static inline int __int16_t_encode_array(void *_buf, int offset, int maxlen, con
 static inline int __int16_t_decode_array(const void *_buf, int offset, int maxlen, int16_t *p, int elements)
 {
     int total_size = sizeof(int16_t) * elements;
-    uint8_t *buf = (uint8_t*) _buf;
-    int pos = offset;
-    int element;
+    const uint8_t *buf = (const uint8_t*) _buf;
 
     if (maxlen < total_size)
         return -1;
 
-    for (element = 0; element < elements; element++) {
-        p[element] = (buf[pos]<<8) + buf[pos+1];
-        pos+=2;
-    }
+    __lcm_swap16_array((uint8_t*) p, &buf[offset], elements);
 
     return total_size;
 }
@@ -198,23 +309,11 @@ static inline int __int32_t_encode_array(void *_buf, int offset, int maxlen, con
 {
     int total_size = sizeof(int32_t) * elements;
     uint8_t *buf = (uint8_t*) _buf;
-    int pos = offset;
-    int element;
 
     if (maxlen < total_size)
         return -1;
 
-    //  See Section 5.8 paragraph 3 of the standard
-    //  http://open-std.org/JTC1/SC22/WG21/docs/papers/2015/n4527.pdf
-    //  use uint for shifting instead if int
-    const uint32_t* unsigned_p = (uint32_t*)p;
-    for (element = 0; element < elements; element++) {
-        const uint32_t v = unsigned_p[element];
-        buf[pos++] = (v>>24)&0xff;
-        buf[pos++] = (v>>16)&0xff;
-        buf[pos++] = (v>>8)&0xff;
-        buf[pos++] = (v & 0xff);
-    }
+    __lcm_swap32_array(&buf[offset], (const uint8_t*) p, elements);
 
     return total_size;
 }
@@ -222,20 +321,12 @@ static inline int __int32_t_encode_array(void *_buf, int offset, int maxlen, con
 static inline int __int32_t_decode_array(const void *_buf, int offset, int maxlen, int32_t *p, int elements)
 {
     int total_size = sizeof(int32_t) * elements;
-    uint8_t *buf = (uint8_t*) _buf;
-    int pos = offset;
-    int element;
+    const uint8_t *buf = (const uint8_t*) _buf;
 
     if (maxlen < total_size)
         return -1;
 
-    //  See Section 5.8 paragraph 3 of the standard
-    //  http://open-std.org/JTC1/SC22/WG21/docs/papers/2015/n4527.pdf
-    //  use uint for shifting instead if int
-    for (element = 0; element < elements; element++) {
-        p[element] = (((uint32_t)buf[pos+0])<<24) + (((uint32_t)buf[pos+1])<<16) + (((uint32_t)buf[pos+2])<<8) + ((uint32_t)buf[pos+3]);
-        pos+=4;
-    }
+    __lcm_swap32_array((uint8_t*) p, &buf[offset], elements);
 
     return total_size;
 }
@@ -263,27 +354,11 @@ static inline int __int64_t_encode_array(void *_buf, int offset, int maxlen, con
 {
     int total_size = sizeof(int64_t) * elements;
     uint8_t *buf = (uint8_t*) _buf;
-    int pos = offset;
-    int element;
 
     if (maxlen < total_size)
         return -1;
 
-    //  See Section 5.8 paragraph 3 of the standard
-    //  http://open-std.org/JTC1/SC22/WG21/docs/papers/2015/n4527.pdf
-    //  use uint for shifting instead if int
-    const uint64_t * unsigned_p = (uint64_t*)p;
-    for (element = 0; element < elements; element++) {
-        const uint64_t v = unsigned_p[element];
-        buf[pos++] = (v>>56)&0xff;
-        buf[pos++] = (v>>48)&0xff;
-        buf[pos++] = (v>>40)&0xff;
-        buf[pos++] = (v>>32)&0xff;
-        buf[pos++] = (v>>24)&0xff;
-        buf[pos++] = (v>>16)&0xff;
-        buf[pos++] = (v>>8)&0xff;
-        buf[pos++] = (v & 0xff);
-    }
+    __lcm_swap64_array(&buf[offset], (const uint8_t*) p, elements);
 
     return total_size;
 }
@@ -291,23 +366,12 @@ static inline int __int64_t_encode_array(void *_buf, int offset, int maxlen, con
 static inline int __int64_t_decode_array(const void *_buf, int offset, int maxlen, int64_t *p, int elements)
 {
     int total_size = sizeof(int64_t) * elements;
-    uint8_t *buf = (uint8_t*) _buf;
-    int pos = offset;
-    int element;
+    const uint8_t *buf = (const uint8_t*) _buf;
 
     if (maxlen < total_size)
         return -1;
 
-    //  See Section 5.8 paragraph 3 of the standard
-    //  http://open-std.org/JTC1/SC22/WG21/docs/papers/2015/n4527.pdf
-    //  use uint for shifting instead if int
-    for (element = 0; element < elements; element++) {
-        uint64_t a = (((uint32_t)buf[pos+0])<<24) + (((uint32_t)buf[pos+1])<<16) + (((uint32_t)buf[pos+2])<<8) + (uint32_t)buf[pos+3];
-        pos+=4;
-        uint64_t b = (((uint32_t)buf[pos+0])<<24) + (((uint32_t)buf[pos+1])<<16) + (((uint32_t)buf[pos+2])<<8) + (uint32_t)buf[pos+3];
-        pos+=4;
-        p[element] = (a<<32) + (b&0xffffffff);
-    }
+    __lcm_swap64_array((uint8_t*) p, &buf[offset], elements);
 
     return total_size;
 }
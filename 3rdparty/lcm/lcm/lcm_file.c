@@ -20,6 +20,12 @@ typedef enum {
   LCM_LOGPROV_APPEND_MODE=2,
 } lcm_log_provider_mode_t;
 
+typedef enum {
+  LCM_LOGPROV_INDEX_AUTO=0,   // use the log's index if it has one
+  LCM_LOGPROV_INDEX_BUILD=1,  // build an index if the log has none
+  LCM_LOGPROV_INDEX_OFF=2,
+} lcm_log_provider_index_mode_t;
+
 typedef struct _lcm_provider_t lcm_logprov_t;
 struct _lcm_provider_t {
     lcm_t * lcm;
@@ -32,6 +38,10 @@ struct _lcm_provider_t {
     lcm_eventlog_t * log;
     lcm_eventlog_event_t * event;
 
+    lcm_log_provider_index_mode_t index_mode;
+    lcm_eventlog_index_t * index;
+    int64_t next_entry;     // index entry of the event after lr->event
+
     double speed;
     int64_t next_clock_time;
     int64_t start_timestamp;
@@ -65,6 +75,8 @@ lcm_logprov_destroy (lcm_logprov_t *lr)
         lcm_eventlog_free_event (lr->event);
     if (lr->log)
         lcm_eventlog_destroy (lr->log);
+    if (lr->index)
+        lcm_eventlog_index_destroy (lr->index);
 
     free (lr->filename);
     free (lr);
@@ -144,23 +156,75 @@ new_argument (gpointer key, gpointer value, gpointer user)
         } else {
           fprintf(stderr, "Warning: Invalid value for mode: %s\n", mode);
         }
+    } else if (!strcmp ((char *) key, "index")) {
+        const char *mode = (char *) value;
+        if (!strcmp(mode, "auto")) {
+            lr->index_mode = LCM_LOGPROV_INDEX_AUTO;
+        } else if (!strcmp(mode, "build")) {
+            lr->index_mode = LCM_LOGPROV_INDEX_BUILD;
+        } else if (!strcmp(mode, "off")) {
+            lr->index_mode = LCM_LOGPROV_INDEX_OFF;
+        } else {
+            fprintf(stderr, "Warning: Invalid value for index: %s\n", mode);
+        }
     } else {
         fprintf(stderr, "Warning: unrecognized option: [%s]\n",
                 (const char*)key);
     }
 }
 
+// past the end of the index, which can lag behind a log that is still being
+// written, the log is read like it had no index
+static void
+drop_index (lcm_logprov_t * lr)
+{
+    int64_t num_entries = lcm_eventlog_index_size (lr->index);
+    if (num_entries > 0) {
+        // the last indexed events may have been skipped, so read past them
+        fseeko (lr->log->f, lcm_eventlog_index_offset (lr->index,
+                    num_entries - 1), SEEK_SET);
+        lcm_eventlog_event_t *le = lcm_eventlog_read_next_event (lr->log);
+        if (le)
+            lcm_eventlog_free_event (le);
+    }
+    lcm_eventlog_index_destroy (lr->index);
+    lr->index = NULL;
+}
+
+// reads the next event into lr->event.  If skip is set, events on channels
+// without subscribers are skipped, and not even read when the log is indexed
 static int
-load_next_event (lcm_logprov_t * lr)
+load_next_event (lcm_logprov_t * lr, int skip)
 {
     if (lr->event)
         lcm_eventlog_free_event (lr->event);
+    lr->event = NULL;
+
+    if (lr->index) {
+        int64_t num_entries = lcm_eventlog_index_size (lr->index);
+        while (skip && lr->next_entry < num_entries &&
+               !lcm_has_handlers (lr->lcm,
+                   lcm_eventlog_index_channel (lr->index, lr->next_entry)))
+            lr->next_entry++;
+
+        if (lr->next_entry < num_entries) {
+            int64_t offset = lcm_eventlog_index_offset (lr->index,
+                    lr->next_entry);
+            if (ftello (lr->log->f) != offset)
+                fseeko (lr->log->f, offset, SEEK_SET);
+            lr->next_entry++;
+            lr->event = lcm_eventlog_read_next_event (lr->log);
+            return lr->event ? 0 : -1;
+        }
+        drop_index (lr);
+    }
 
-    lr->event = lcm_eventlog_read_next_event (lr->log);
-    if (!lr->event)
-        return -1;
-
-    return 0;
+    while ((lr->event = lcm_eventlog_read_next_event (lr->log))) {
+        if (!skip || lcm_has_handlers (lr->lcm, lr->event->channel))
+            return 0;
+        lcm_eventlog_free_event (lr->event);
+    }
+    return -1;
 }
 
 static lcm_provider_t *
@@ -220,7 +284,24 @@ lcm_logprov_create (lcm_t * parent, const char *target, const GHashTable *args)
 
     // only start the reader thread if we're in read mode
     if (lr->log_mode == LCM_LOGPROV_READ_MODE){
-        if (load_next_event (lr) < 0) {
+        if (lr->index_mode != LCM_LOGPROV_INDEX_OFF)
+            lr->index = lcm_eventlog_index_open (lr->filename);
+        if (!lr->index && lr->index_mode == LCM_LOGPROV_INDEX_BUILD) {
+            dbg (DBG_LCM, "Indexing %s\n", lr->filename);
+            lr->index = lcm_eventlog_index_build (lr->filename);
+        }
+
+        if(lr->start_timestamp > 0){
+            dbg (DBG_LCM, "Seeking to timestamp: %lld\n", (long long)lr->start_timestamp);
+            if (lr->index)
+                lr->next_entry = lcm_eventlog_index_find_timestamp (lr->index,
+                        lr->start_timestamp);
+            else
+                lcm_eventlog_seek_to_timestamp(lr->log, lr->start_timestamp);
+        }
+
+        // nothing is subscribed yet, so the first event can't be skipped
+        if (load_next_event (lr, 0) < 0) {
             fprintf (stderr, "Error: Failed to read first event from log\n");
             lcm_logprov_destroy (lr);
             return NULL;
@@ -238,11 +319,6 @@ lcm_logprov_create (lcm_t * parent, const char *target, const GHashTable *args)
         if(lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
             perror(__FILE__ " - write (reader create)");
         }
-
-        if(lr->start_timestamp > 0){
-            dbg (DBG_LCM, "Seeking to timestamp: %lld\n", (long long)lr->start_timestamp);
-            lcm_eventlog_seek_to_timestamp(lr->log, lr->start_timestamp);
-        }
     }
 
     return lr;
@@ -283,12 +359,14 @@ lcm_logprov_handle (lcm_logprov_t * lr)
     rbuf.data_size = lr->event->datalen;
     rbuf.recv_utime = lr->next_clock_time;
     rbuf.lcm = lr->lcm;
+    rbuf.send_utime = 0;
+    rbuf.send_seqno = 0;
 
     if(lcm_try_enqueue_message(lr->lcm, lr->event->channel))
         lcm_dispatch_handlers (lr->lcm, &rbuf, lr->event->channel);
 
     int64_t prev_log_time = lr->event->timestamp;
-    if (load_next_event (lr) < 0) {
+    if (load_next_event (lr, 1) < 0) {
         /* end-of-file reached.  This call succeeds, but next call to
          * _handle will fail */
         lr->event = NULL;
@@ -370,6 +448,8 @@ lcm_logprov_provider_init (GPtrArray * providers)
     logprov_vtable.publish     = lcm_logprov_publish;
     logprov_vtable.handle      = lcm_logprov_handle;
     logprov_vtable.get_fileno  = lcm_logprov_get_fileno;
+    logprov_vtable.begin_batch = NULL;
+    logprov_vtable.end_batch   = NULL;
 
     logprov_info.name = "file";
     logprov_info.vtable = &logprov_vtable;
@@ -42,6 +42,10 @@ struct _lcm_provider_vtable_t {
             unsigned int);
     int (*handle)(lcm_provider_t *);
     int (*get_fileno)(lcm_provider_t *);
+    // optional, queue the messages the calling thread publishes until the
+    // batch ends
+    int (*begin_batch)(lcm_provider_t *);
+    int (*end_batch)(lcm_provider_t *);
 };
 
 int
@@ -56,6 +60,22 @@ lcm_parse_url (const char * url, char ** provider, char ** target,
 int
 lcm_try_enqueue_message (lcm_t * lcm, const char * channel);
 
+/**
+ * For providers that queue messages without calling lcm_try_enqueue_message,
+ * and only call lcm_try_dispatch_message right before dispatching one.  Counts
+ * a message on channel as queued for latest only subscriptions, so they can
+ * skip it if a newer one is queued behind it.
+ */
+void
+lcm_count_latest_only (lcm_t * lcm, const char * channel);
+
+/**
+ * Like lcm_try_enqueue_message, for a message that was counted with
+ * lcm_count_latest_only when it was queued.
+ */
+int
+lcm_try_dispatch_message (lcm_t * lcm, const char * channel);
+
 int
 lcm_has_handlers (lcm_t * lcm, const char * channel);
 
@@ -34,6 +34,8 @@ memq_msg_new(lcm_t* lcm, const char* channel, const void* data, int data_size, i
     memcpy(msg->rbuf.data, data, data_size);
     msg->rbuf.recv_utime = utime;
     msg->rbuf.lcm = lcm;
+    msg->rbuf.send_utime = 0;
+    msg->rbuf.send_seqno = 0;
     msg->channel = g_strdup(channel);
     return msg;
 }
@@ -118,7 +120,7 @@ lcm_memq_handle(lcm_memq_t* self)
     dbg(DBG_LCM, "Dispatching message on channel [%s], size [%d]\n",
         msg->channel, msg->rbuf.data_size);
 
-    if (lcm_try_enqueue_message(self->lcm, msg->channel)) {
+    if (lcm_try_dispatch_message(self->lcm, msg->channel)) {
       lcm_dispatch_handlers(self->lcm, &msg->rbuf, msg->channel);
     }
 
@@ -141,6 +143,8 @@ lcm_memq_publish (lcm_memq_t *self, const char *channel, const void *data,
     memq_msg_t* msg =
       memq_msg_new(self->lcm, channel, data, datalen, timestamp_now());
 
+    lcm_count_latest_only(self->lcm, channel);
+
     g_mutex_lock(self->mutex);
     int was_empty = g_queue_is_empty(self->queue);
     g_queue_push_tail(self->queue, msg);
@@ -166,6 +170,8 @@ lcm_memq_provider_init (GPtrArray * providers)
     memq_vtable.publish     = lcm_memq_publish;
     memq_vtable.handle      = lcm_memq_handle;
     memq_vtable.get_fileno  = lcm_memq_get_fileno;
+    memq_vtable.begin_batch = NULL;
+    memq_vtable.end_batch   = NULL;
 
     memq_info.name = "memq";
     memq_info.vtable = &memq_vtable;
@@ -1360,6 +1360,8 @@ lcm_mpudpm_handle (lcm_mpudpm_t *lcm)
     rbuf.data_size = lcmb->data_size;
     rbuf.recv_utime = lcmb->recv_utime;
     rbuf.lcm = lcm->lcm;
+    rbuf.send_utime = 0;
+    rbuf.send_seqno = 0;
 
     if(lcm->creating_read_thread) {
         // special case:  If we're creating the read thread and are in
@@ -1894,6 +1896,8 @@ lcm_mpudpm_provider_init (GPtrArray * providers)
     mpudpm_vtable.publish     = lcm_mpudpm_publish;
     mpudpm_vtable.handle      = lcm_mpudpm_handle;
     mpudpm_vtable.get_fileno  = lcm_mpudpm_get_fileno;
+    mpudpm_vtable.begin_batch = NULL;
+    mpudpm_vtable.end_batch   = NULL;
 
     mpudpm_info.name = "mpudpm";
     mpudpm_info.vtable = &mpudpm_vtable;
@@ -0,0 +1,786 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "lcm_internal.h"
+#include "dbg.h"
+
+#ifdef __linux__
+
+/**
+ * Shared memory provider, for LCM instances on the same host.
+ *
+ * Every channel has a ring of fixed size slots in its own shared memory
+ * object, and a directory object maps channel names to rings.  Publishers
+ * copy the message into the next slot under a process shared mutex, then bump
+ * a doorbell word in the directory that readers wait on with a futex.  Readers
+ * never lock: each slot has a sequence number that is odd while it is being
+ * written, so a reader that falls more than a ring behind detects the
+ * overwritten slots and counts them as lost instead of blocking publishers.
+ *
+ * With a network, every message is also published on UDPM, with multicast
+ * loopback off so the host's own shm instances don't receive it twice, and
+ * UDPM messages from other hosts are received alongside the shared memory
+ * ones.  Every LCM instance on the host must then use the same shm URL.
+ */
+
+#define SHM_MAGIC 0x534d434c
+#define SHM_VERSION 1
+
+#define SHM_MAX_CHANNELS 256
+
+#define SHM_DEFAULT_SLOTS 16
+#define SHM_DEFAULT_SLOT_SIZE (64 * 1024)
+
+// longest wait on the doorbell, so the read thread notices it should quit
+#define SHM_WAIT_MS 100
+
+// how long to wait for another process to finish creating the directory
+#define SHM_OPEN_RETRIES 100
+#define SHM_OPEN_RETRY_US 10000
+
+typedef struct _shm_dir shm_dir_t;
+struct _shm_dir {
+    uint32_t magic;          // stored last by the creator, once the rest is set
+    uint32_t version;
+    uint32_t slots;          // ring geometry, chosen by the creator
+    uint32_t slot_size;
+    uint32_t doorbell;       // futex word, bumped after every publish
+    uint32_t waiters;        // read threads waiting on the doorbell
+    uint32_t num_channels;   // entries of channels in use, only grows
+    pthread_mutex_t mutex;   // process shared, guards adding channels
+    char channels[SHM_MAX_CHANNELS][LCM_MAX_CHANNEL_NAME_LENGTH + 1];
+};
+
+// each ring is this header followed by slots of slot_size bytes
+#define SHM_RING_HEADER_SIZE 128
+
+typedef struct _shm_ring shm_ring_t;
+struct _shm_ring {
+    uint64_t write_seq;      // messages ever published on the channel
+    pthread_mutex_t mutex;   // process shared, one publisher at a time
+};
+
+typedef char shm_ring_header_fits[
+    sizeof (shm_ring_t) <= SHM_RING_HEADER_SIZE ? 1 : -1];
+
+// each slot is this header followed by the message
+typedef struct _shm_slot shm_slot_t;
+struct _shm_slot {
+    uint64_t seq;            // 2n+1 while message n is written, 2n+2 after
+    uint32_t data_size;
+    uint32_t reserved;
+    int64_t recv_utime;
+};
+
+typedef struct _shm_channel shm_channel_t;
+struct _shm_channel {
+    shm_ring_t *ring;        // mapped on first use
+    int subscribed;          // read thread only, from here on
+    uint64_t read_seq;       // read thread only, next message to read
+    uint64_t lost;           // read thread only
+};
+
+typedef struct _shm_msg shm_msg_t;
+struct _shm_msg {
+    char* channel;
+    lcm_recv_buf_t rbuf;
+};
+
+typedef struct _shm_params_t shm_params_t;
+struct _shm_params_t {
+    char name[64];
+    uint32_t slots;
+    uint32_t slot_size;
+    GString *udpm_args;      // options passed on to the UDPM provider
+};
+
+typedef struct _lcm_provider_t lcm_shm_t;
+struct _lcm_provider_t {
+    lcm_t *lcm;
+    shm_params_t params;
+
+    shm_dir_t *dir;
+    size_t ring_size;
+    shm_channel_t channels[SHM_MAX_CHANNELS];
+    GHashTable *channel_index;   // channel name to index + 1
+    GMutex *channels_mutex;      // guards channel_index and mapping rings
+
+    // messages received and not handled yet, as in the memq provider
+    GQueue *queue;
+    GMutex *mutex;
+    int notify_pipe[2];
+
+    GPtrArray *subscriptions;    // GRegex of each subscribed channel
+    int num_subscriptions;       // read with atomics by the read thread
+    GMutex *subscriptions_mutex;
+
+    volatile int quit;
+    GThread *read_thread;
+
+    lcm_t *udpm;                 // NULL without a network
+    GThread *udpm_thread;
+};
+
+static int64_t
+timestamp_now (void)
+{
+    GTimeVal tv;
+    g_get_current_time(&tv);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+futex_wait (uint32_t *word, uint32_t value, int timeout_ms)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall (SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void
+futex_wake_all (uint32_t *word)
+{
+    syscall (SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static void
+init_shared_mutex (pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_setpshared (&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust (&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init (mutex, &attr);
+    pthread_mutexattr_destroy (&attr);
+}
+
+// locks a process shared mutex, recovering it if its owner died holding it
+static void
+lock_shared_mutex (pthread_mutex_t *mutex)
+{
+    if (pthread_mutex_lock (mutex) == EOWNERDEAD) {
+        dbg (DBG_LCM, "recovering shm mutex of a dead process\n");
+        pthread_mutex_consistent (mutex);
+    }
+}
+
+// maps the shared memory object name of size bytes, creating it if create is
+// set and it doesn't exist.  Sets created if it was created here.
+static void *
+map_object (const char *name, size_t size, int create, int *created)
+{
+    *created = 0;
+    int fd = -1;
+    if (create) {
+        fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) {
+            // so processes of other users can open it regardless of umask
+            fchmod (fd, 0666);
+            if (ftruncate (fd, size) < 0) {
+                perror (__FILE__ " - ftruncate");
+                close (fd);
+                shm_unlink (name);
+                return NULL;
+            }
+            *created = 1;
+        }
+        else if (errno != EEXIST) {
+            perror (__FILE__ " - shm_open");
+            return NULL;
+        }
+    }
+
+    if (fd < 0) {
+        fd = shm_open (name, O_RDWR, 0666);
+        if (fd < 0) {
+            perror (__FILE__ " - shm_open");
+            return NULL;
+        }
+
+        // the creator may not have sized it yet
+        struct stat st;
+        int retries = 0;
+        while (fstat (fd, &st) == 0 && (size_t) st.st_size < size &&
+                retries++ < SHM_OPEN_RETRIES) {
+            usleep (SHM_OPEN_RETRY_US);
+        }
+        if ((size_t) st.st_size < size) {
+            fprintf (stderr, "LCM shm: %s is smaller than expected\n", name);
+            close (fd);
+            return NULL;
+        }
+    }
+
+    void *addr = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (addr == MAP_FAILED) {
+        perror (__FILE__ " - mmap");
+        return NULL;
+    }
+    return addr;
+}
+
+static void
+ring_object_name (lcm_shm_t *self, int index, char *name, size_t size)
+{
+    snprintf (name, size, "/%s_%d", self->params.name, index);
+}
+
+static shm_slot_t *
+ring_slot (lcm_shm_t *self, shm_ring_t *ring, uint64_t seq)
+{
+    uint8_t *slots = (uint8_t *) ring + SHM_RING_HEADER_SIZE;
+    return (shm_slot_t *) (slots + (seq % self->dir->slots) * self->dir->slot_size);
+}
+
+// returns the ring of the channel at index, mapping it the first time
+static shm_ring_t *
+get_ring (lcm_shm_t *self, int index)
+{
+    g_mutex_lock (self->channels_mutex);
+    shm_channel_t *channel = &self->channels[index];
+    if (!channel->ring) {
+        char name[128];
+        int created;
+        ring_object_name (self, index, name, sizeof (name));
+        channel->ring = (shm_ring_t *) map_object (name, self->ring_size, 0, &created);
+    }
+    shm_ring_t *ring = channel->ring;
+    g_mutex_unlock (self->channels_mutex);
+    return ring;
+}
+
+// returns the index of channel in the directory, adding it if it's new, or -1
+static int
+find_channel (lcm_shm_t *self, const char *channel)
+{
+    g_mutex_lock (self->channels_mutex);
+    int index = GPOINTER_TO_INT (g_hash_table_lookup (self->channel_index, channel)) - 1;
+    g_mutex_unlock (self->channels_mutex);
+    if (index >= 0)
+        return index;
+
+    shm_dir_t *dir = self->dir;
+    lock_shared_mutex (&dir->mutex);
+
+    uint32_t num_channels = __atomic_load_n (&dir->num_channels, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < num_channels; i++) {
+        if (!strcmp (dir->channels[i], channel)) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        if (num_channels == SHM_MAX_CHANNELS) {
+            pthread_mutex_unlock (&dir->mutex);
+            fprintf (stderr, "LCM shm: no room for channel %s, all %d are used\n",
+                    channel, SHM_MAX_CHANNELS);
+            return -1;
+        }
+
+        // the ring is initialized before the channel is visible, so other
+        // processes never map a ring that isn't ready
+        char name[128];
+        int created;
+        ring_object_name (self, num_channels, name, sizeof (name));
+        shm_unlink (name);
+        shm_ring_t *ring = (shm_ring_t *) map_object (name, self->ring_size, 1, &created);
+        if (!ring) {
+            pthread_mutex_unlock (&dir->mutex);
+            return -1;
+        }
+        init_shared_mutex (&ring->mutex);
+        ring->write_seq = 0;
+
+        index = num_channels;
+        strcpy (dir->channels[index], channel);
+        __atomic_store_n (&dir->num_channels, num_channels + 1, __ATOMIC_RELEASE);
+
+        g_mutex_lock (self->channels_mutex);
+        self->channels[index].ring = ring;
+        g_mutex_unlock (self->channels_mutex);
+    }
+    pthread_mutex_unlock (&dir->mutex);
+
+    g_mutex_lock (self->channels_mutex);
+    g_hash_table_insert (self->channel_index, g_strdup (channel), GINT_TO_POINTER (index + 1));
+    g_mutex_unlock (self->channels_mutex);
+    return index;
+}
+
+static shm_msg_t*
+shm_msg_new (lcm_t* lcm, const char* channel, const void* data, int data_size, int64_t utime,
+        int64_t send_utime, uint32_t send_seqno)
+{
+    shm_msg_t* msg = (shm_msg_t*)malloc(sizeof(shm_msg_t));
+    msg->rbuf.data = malloc(data_size);
+    msg->rbuf.data_size = data_size;
+    memcpy(msg->rbuf.data, data, data_size);
+    msg->rbuf.recv_utime = utime;
+    msg->rbuf.lcm = lcm;
+    msg->rbuf.send_utime = send_utime;
+    msg->rbuf.send_seqno = send_seqno;
+    msg->channel = g_strdup(channel);
+    return msg;
+}
+
+static void
+shm_msg_destroy (shm_msg_t* msg)
+{
+    free(msg->rbuf.data);
+    g_free(msg->channel);
+    memset(msg, 0, sizeof(shm_msg_t));
+    free(msg);
+}
+
+// queues msg for lcm_shm_handle, which must already have been allowed by
+// lcm_try_enqueue_message
+static void
+shm_enqueue (lcm_shm_t *self, shm_msg_t *msg)
+{
+    g_mutex_lock(self->mutex);
+    int was_empty = g_queue_is_empty(self->queue);
+    g_queue_push_tail(self->queue, msg);
+    if (was_empty) {
+        if(lcm_internal_pipe_write(self->notify_pipe[1], "+", 1) < 0) {
+            perror(__FILE__ " - write to notify pipe (shm_enqueue)");
+        }
+    }
+    g_mutex_unlock(self->mutex);
+}
+
+// queues every message published on the channel at index since the last call
+static void
+read_channel (lcm_shm_t *self, int index)
+{
+    shm_channel_t *channel = &self->channels[index];
+    shm_ring_t *ring = channel->ring;
+    const char *name = self->dir->channels[index];
+    uint32_t max_data_size = self->dir->slot_size - sizeof (shm_slot_t);
+    uint64_t lost_before = channel->lost;
+
+    uint64_t end = __atomic_load_n (&ring->write_seq, __ATOMIC_ACQUIRE);
+    if (end - channel->read_seq > self->dir->slots) {
+        channel->lost += end - channel->read_seq - self->dir->slots;
+        channel->read_seq = end - self->dir->slots;
+    }
+
+    for (; channel->read_seq < end; channel->read_seq++) {
+        uint64_t seq = channel->read_seq;
+        shm_slot_t *slot = ring_slot (self, ring, seq);
+
+        uint64_t before = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+        if (before != 2 * seq + 2) {
+            channel->lost++;
+            continue;
+        }
+        uint32_t data_size = slot->data_size;
+        if (data_size > max_data_size) {
+            channel->lost++;
+            continue;
+        }
+
+        shm_msg_t *msg = shm_msg_new (self->lcm, name, slot + 1, data_size,
+                slot->recv_utime, slot->recv_utime, (uint32_t) seq);
+
+        // a publisher that lapped this reader overwrote the slot meanwhile
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) != before) {
+            shm_msg_destroy (msg);
+            channel->lost++;
+            continue;
+        }
+
+        if (lcm_try_enqueue_message (self->lcm, name)) {
+            shm_enqueue (self, msg);
+        }
+        else {
+            shm_msg_destroy (msg);
+        }
+    }
+
+    if (channel->lost != lost_before) {
+        dbg (DBG_LCM, "LCM shm: %s lost %lu messages, the reader fell behind\n",
+                name, (unsigned long) (channel->lost - lost_before));
+    }
+}
+
+static int
+is_subscribed (lcm_shm_t *self, const char *channel)
+{
+    int subscribed = 0;
+    g_mutex_lock (self->subscriptions_mutex);
+    for (unsigned int i = 0; i < self->subscriptions->len && !subscribed; i++) {
+        GRegex *regex = (GRegex *) g_ptr_array_index (self->subscriptions, i);
+        subscribed = g_regex_match (regex, channel, (GRegexMatchFlags) 0, NULL);
+    }
+    g_mutex_unlock (self->subscriptions_mutex);
+    return subscribed;
+}
+
+static gpointer
+shm_read_thread (gpointer user)
+{
+    lcm_shm_t *self = (lcm_shm_t *) user;
+    shm_dir_t *dir = self->dir;
+    uint32_t checked_channels = 0;
+    int checked_subscriptions = 0;
+
+    while (!self->quit) {
+        uint32_t doorbell = __atomic_load_n (&dir->doorbell, __ATOMIC_SEQ_CST);
+
+        // start reading channels that were added or newly subscribed, from
+        // their latest message
+        uint32_t num_channels = __atomic_load_n (&dir->num_channels, __ATOMIC_ACQUIRE);
+        int num_subscriptions = __atomic_load_n (&self->num_subscriptions, __ATOMIC_ACQUIRE);
+        if (num_channels != checked_channels || num_subscriptions != checked_subscriptions) {
+            for (uint32_t i = 0; i < num_channels; i++) {
+                shm_channel_t *channel = &self->channels[i];
+                if (channel->subscribed || !is_subscribed (self, dir->channels[i]))
+                    continue;
+
+                shm_ring_t *ring = get_ring (self, i);
+                if (!ring)
+                    continue;
+                channel->read_seq = __atomic_load_n (&ring->write_seq, __ATOMIC_ACQUIRE);
+                channel->subscribed = 1;
+            }
+            checked_channels = num_channels;
+            checked_subscriptions = num_subscriptions;
+        }
+
+        for (uint32_t i = 0; i < checked_channels; i++) {
+            if (self->channels[i].subscribed)
+                read_channel (self, i);
+        }
+
+        // publishers only wake the doorbell when someone waits on it
+        __atomic_add_fetch (&dir->waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n (&dir->doorbell, __ATOMIC_SEQ_CST) == doorbell)
+            futex_wait (&dir->doorbell, doorbell, SHM_WAIT_MS);
+        __atomic_sub_fetch (&dir->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+// queues a message received over UDPM from another host
+static void
+shm_udpm_forward (const lcm_recv_buf_t *rbuf, const char *channel, void *user)
+{
+    lcm_shm_t *self = (lcm_shm_t *) user;
+    if (!lcm_try_enqueue_message (self->lcm, channel))
+        return;
+    shm_enqueue (self, shm_msg_new (self->lcm, channel, rbuf->data,
+                rbuf->data_size, rbuf->recv_utime, rbuf->send_utime,
+                rbuf->send_seqno));
+}
+
+static gpointer
+shm_udpm_thread (gpointer user)
+{
+    lcm_shm_t *self = (lcm_shm_t *) user;
+    while (!self->quit) {
+        lcm_handle_timeout (self->udpm, SHM_WAIT_MS);
+    }
+    return NULL;
+}
+
+static void
+lcm_shm_destroy (lcm_shm_t *self)
+{
+    dbg(DBG_LCM, "destroying LCM shm provider context\n");
+    self->quit = 1;
+    if (self->read_thread)
+        g_thread_join (self->read_thread);
+    if (self->udpm_thread)
+        g_thread_join (self->udpm_thread);
+    if (self->udpm)
+        lcm_destroy (self->udpm);
+
+    for (int i = 0; i < SHM_MAX_CHANNELS; i++) {
+        if (self->channels[i].ring)
+            munmap (self->channels[i].ring, self->ring_size);
+    }
+    if (self->dir)
+        munmap (self->dir, sizeof (shm_dir_t));
+
+    if(self->notify_pipe[0] >= 0) lcm_internal_pipe_close(self->notify_pipe[0]);
+    if(self->notify_pipe[1] >= 0) lcm_internal_pipe_close(self->notify_pipe[1]);
+
+    while (!g_queue_is_empty(self->queue)) {
+        shm_msg_t* msg = (shm_msg_t*) g_queue_pop_head(self->queue);
+        shm_msg_destroy(msg);
+    }
+    g_queue_free(self->queue);
+    g_mutex_free(self->mutex);
+
+    for (unsigned int i = 0; i < self->subscriptions->len; i++)
+        g_regex_unref ((GRegex *) g_ptr_array_index (self->subscriptions, i));
+    g_ptr_array_free (self->subscriptions, TRUE);
+    g_mutex_free (self->subscriptions_mutex);
+
+    g_hash_table_destroy (self->channel_index);
+    g_mutex_free (self->channels_mutex);
+    g_string_free (self->params.udpm_args, TRUE);
+
+    memset(self, 0, sizeof(lcm_shm_t));
+    free (self);
+}
+
+static void
+new_argument (gpointer key, gpointer value, gpointer user)
+{
+    shm_params_t * params = (shm_params_t *) user;
+    char *endptr = NULL;
+    if (!strcmp ((char *) key, "name")) {
+        snprintf (params->name, sizeof (params->name), "%s", (char *) value);
+    }
+    else if (!strcmp ((char *) key, "slots")) {
+        params->slots = strtol ((char *) value, &endptr, 0);
+        if (endptr == value || params->slots == 0) {
+            fprintf (stderr, "Warning: Invalid value for slots\n");
+            params->slots = SHM_DEFAULT_SLOTS;
+        }
+    }
+    else if (!strcmp ((char *) key, "slot_size")) {
+        params->slot_size = strtol ((char *) value, &endptr, 0);
+        if (endptr == value || params->slot_size <= sizeof (shm_slot_t)) {
+            fprintf (stderr, "Warning: Invalid value for slot_size\n");
+            params->slot_size = SHM_DEFAULT_SLOT_SIZE;
+        }
+    }
+    else if (!strcmp ((char *) key, "ttl") || !strcmp ((char *) key, "recv_buf_size") ||
+             !strcmp ((char *) key, "trace") ||
+             !strcmp ((char *) key, "frag_rate") ||
+             !strcmp ((char *) key, "groups")) {
+        g_string_append_printf (params->udpm_args, "&%s=%s", (char *) key, (char *) value);
+    }
+    else {
+        fprintf(stderr, "%s:%d -- unknown provider argument %s\n",
+                __FILE__, __LINE__, (char *)key);
+    }
+}
+
+static lcm_provider_t*
+lcm_shm_create (lcm_t* parent, const char* network, const GHashTable* args)
+{
+    lcm_shm_t * self = (lcm_shm_t*) calloc(1, sizeof(lcm_shm_t));
+    self->lcm = parent;
+    self->notify_pipe[0] = self->notify_pipe[1] = -1;
+    self->queue = g_queue_new();
+    self->mutex = g_mutex_new();
+    self->subscriptions = g_ptr_array_new();
+    self->subscriptions_mutex = g_mutex_new();
+    self->channel_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    self->channels_mutex = g_mutex_new();
+
+    strcpy (self->params.name, "lcm");
+    self->params.slots = SHM_DEFAULT_SLOTS;
+    self->params.slot_size = SHM_DEFAULT_SLOT_SIZE;
+    self->params.udpm_args = g_string_new ("?multicast_loopback=0");
+    g_hash_table_foreach ((GHashTable*) args, new_argument, &self->params);
+
+    dbg(DBG_LCM, "Initializing LCM shm provider context...\n");
+
+    if(lcm_internal_pipe_create(self->notify_pipe) != 0) {
+        perror(__FILE__ " - pipe (notify)");
+        lcm_shm_destroy (self);
+        return NULL;
+    }
+
+    char dir_name[128];
+    int created;
+    snprintf (dir_name, sizeof (dir_name), "/%s_dir", self->params.name);
+    self->dir = (shm_dir_t *) map_object (dir_name, sizeof (shm_dir_t), 1, &created);
+    if (!self->dir) {
+        lcm_shm_destroy (self);
+        return NULL;
+    }
+
+    shm_dir_t *dir = self->dir;
+    if (created) {
+        dir->version = SHM_VERSION;
+        dir->slots = self->params.slots;
+        dir->slot_size = self->params.slot_size;
+        init_shared_mutex (&dir->mutex);
+        __atomic_store_n (&dir->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    else {
+        int retries = 0;
+        while (__atomic_load_n (&dir->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC &&
+                retries++ < SHM_OPEN_RETRIES) {
+            usleep (SHM_OPEN_RETRY_US);
+        }
+        if (dir->magic != SHM_MAGIC || dir->version != SHM_VERSION) {
+            fprintf (stderr, "LCM shm: %s isn't an LCM shm directory of this version, "
+                    "remove it from /dev/shm\n", dir_name);
+            lcm_shm_destroy (self);
+            return NULL;
+        }
+        if (dir->slots != self->params.slots || dir->slot_size != self->params.slot_size) {
+            fprintf (stderr, "LCM shm: using the %u slots of %u bytes %s was created with\n",
+                    dir->slots, dir->slot_size, dir_name);
+        }
+    }
+    self->ring_size = SHM_RING_HEADER_SIZE + (size_t) dir->slots * dir->slot_size;
+
+    if (network && strlen (network)) {
+        char *url = g_strdup_printf ("udpm://%s%s", network, self->params.udpm_args->str);
+        self->udpm = lcm_create (url);
+        g_free (url);
+        if (!self->udpm) {
+            lcm_shm_destroy (self);
+            return NULL;
+        }
+    }
+
+    return self;
+}
+
+static int
+lcm_shm_subscribe (lcm_shm_t *self, const char *channel)
+{
+    char *regexbuf = g_strdup_printf ("^%s$", channel);
+    GRegex *regex = g_regex_new (regexbuf, (GRegexCompileFlags) 0, (GRegexMatchFlags) 0, NULL);
+    g_free (regexbuf);
+    if (!regex)
+        return -1;
+
+    if (self->udpm && !lcm_subscribe (self->udpm, channel, shm_udpm_forward, self))
+        return -1;
+
+    g_mutex_lock (self->subscriptions_mutex);
+    g_ptr_array_add (self->subscriptions, regex);
+    __atomic_add_fetch (&self->num_subscriptions, 1, __ATOMIC_RELEASE);
+
+    // only allocate receive resources once something is subscribed
+    if (!self->read_thread) {
+        self->read_thread = g_thread_create (shm_read_thread, self, TRUE, NULL);
+        if (self->udpm)
+            self->udpm_thread = g_thread_create (shm_udpm_thread, self, TRUE, NULL);
+    }
+    g_mutex_unlock (self->subscriptions_mutex);
+
+    // wake the read thread so it starts on the channel right away
+    futex_wake_all (&self->dir->doorbell);
+    return 0;
+}
+
+static int
+lcm_shm_get_fileno(lcm_shm_t* self)
+{
+    return self->notify_pipe[0];
+}
+
+static int
+lcm_shm_handle(lcm_shm_t* self)
+{
+    char ch;
+    int status = lcm_internal_pipe_read(self->notify_pipe[0], &ch, 1);
+    if (status == 0) {
+        fprintf(stderr,
+            "Error: lcm_shm_handle read 0 bytes from notify_pipe\n");
+        return -1;
+    }
+
+    g_mutex_lock(self->mutex);
+    shm_msg_t* msg = (shm_msg_t*)g_queue_pop_head(self->queue);
+    if (!g_queue_is_empty(self->queue)) {
+        if(lcm_internal_pipe_write(self->notify_pipe[1], "+", 1) < 0) {
+            perror(__FILE__ " - write to notify pipe (lcm_shm_handle)");
+        }
+    }
+    g_mutex_unlock(self->mutex);
+
+    dbg(DBG_LCM, "Dispatching message on channel [%s], size [%d]\n",
+        msg->channel, msg->rbuf.data_size);
+
+    lcm_dispatch_handlers(self->lcm, &msg->rbuf, msg->channel);
+
+    shm_msg_destroy(msg);
+    return 0;
+}
+
+static int
+lcm_shm_publish (lcm_shm_t *self, const char *channel, const void *data,
+        unsigned int datalen)
+{
+    shm_dir_t *dir = self->dir;
+    if (datalen > dir->slot_size - sizeof (shm_slot_t)) {
+        fprintf (stderr, "LCM shm: %u byte message on %s doesn't fit in a "
+                "%u byte slot, raise slot_size\n", datalen, channel, dir->slot_size);
+        return -1;
+    }
+
+    int index = find_channel (self, channel);
+    shm_ring_t *ring = index < 0 ? NULL : get_ring (self, index);
+    if (!ring)
+        return -1;
+
+    dbg(DBG_LCM, "Publishing to [%s] message size [%d]\n", channel, datalen);
+
+    lock_shared_mutex (&ring->mutex);
+    uint64_t seq = ring->write_seq;
+    shm_slot_t *slot = ring_slot (self, ring, seq);
+
+    // readers that see an odd or newer sequence number skip the slot
+    __atomic_store_n (&slot->seq, 2 * seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    slot->data_size = datalen;
+    slot->recv_utime = timestamp_now ();
+    memcpy (slot + 1, data, datalen);
+    __atomic_store_n (&slot->seq, 2 * seq + 2, __ATOMIC_RELEASE);
+
+    __atomic_store_n (&ring->write_seq, seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock (&ring->mutex);
+
+    __atomic_add_fetch (&dir->doorbell, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&dir->waiters, __ATOMIC_SEQ_CST))
+        futex_wake_all (&dir->doorbell);
+
+    if (self->udpm)
+        return lcm_publish (self->udpm, channel, data, datalen);
+    return 0;
+}
+
+static lcm_provider_vtable_t shm_vtable;
+static lcm_provider_info_t shm_info;
+
+#endif
+
+void
+lcm_shm_provider_init (GPtrArray * providers)
+{
+#ifdef __linux__
+    shm_vtable.create      = lcm_shm_create;
+    shm_vtable.destroy     = lcm_shm_destroy;
+    shm_vtable.subscribe   = lcm_shm_subscribe;
+    shm_vtable.unsubscribe = NULL;
+    shm_vtable.publish     = lcm_shm_publish;
+    shm_vtable.handle      = lcm_shm_handle;
+    shm_vtable.get_fileno  = lcm_shm_get_fileno;
+    shm_vtable.begin_batch = NULL;
+    shm_vtable.end_batch   = NULL;
+
+    shm_info.name = "shm";
+    shm_info.vtable = &shm_vtable;
+
+    g_ptr_array_add (providers, &shm_info);
+#endif
+}
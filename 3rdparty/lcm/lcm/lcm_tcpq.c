@@ -1,15 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 
 #ifndef WIN32
 #include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/time.h>
+#include <sys/select.h>
 #include <signal.h>
 #else
 #include "windows/WinPorting.h"
@@ -28,6 +31,29 @@
 #define MESSAGE_TYPE_SUBSCRIBE   2
 #define MESSAGE_TYPE_UNSUBSCRIBE 3
 
+// bytes of published messages that can wait to be written before
+// publishing on a channel that isn't latest-only blocks
+#define DEFAULT_QUEUE_SIZE (1024 * 1024)
+
+#ifndef MSG_DONTWAIT
+// without it writes block like they always did, and nothing gets queued
+// unless a batch queues it
+#define MSG_DONTWAIT 0
+#endif
+
+/**
+ * tcpq_queued_t:
+ * @channel:        channel the message was published on
+ * @size:           size of the framed message in send_bytes
+ * @latest:         whether a newer message on the channel replaces it
+ */
+typedef struct _tcpq_queued_t tcpq_queued_t;
+struct _tcpq_queued_t {
+    char *channel;
+    unsigned int size;
+    int latest;
+};
+
 typedef struct _lcm_provider_t lcm_tcpq_t;
 struct _lcm_provider_t {
     lcm_t * lcm;
@@ -42,6 +68,20 @@ struct _lcm_provider_t {
     struct in_addr server_addr;
     uint16_t server_port;
     GSList* subs;
+
+    /* Send queue.  A message that can't be written without blocking, or
+     * that is published in a batch, is framed into send_bytes, and written
+     * on the next publish, handle or batch end.  The first send_written
+     * bytes have been written already.  send_lock guards the queue and
+     * writes to the socket, so frames from different threads don't mix. */
+    GStaticRecMutex send_lock;
+    GByteArray *send_bytes;
+    GArray *send_queued;
+    unsigned int send_written;
+    unsigned int queue_size;
+    GRegex *latest;         // latest-only channels, or NULL
+    GThread *batch_thread;  // thread with a batch open, if batch_depth
+    int batch_depth;
 };
 
 static int _sub_unsub_helper(lcm_tcpq_t *self, const char *channel, uint32_t msg_type);
@@ -106,6 +146,52 @@ _send_fully(int fd, const void *b, int len)
     return cnt;
 }
 
+// writes the parts with as few system calls as it takes.  With MSG_DONTWAIT
+// in flags, stops once the socket would block.  Returns the number of bytes
+// written, or -1 on error.
+static int
+_sendv(int fd, const struct iovec *parts, int nparts, int flags)
+{
+    struct iovec iov[5];
+    assert(nparts <= 5);
+    memcpy(iov, parts, nparts * sizeof(struct iovec));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nparts;
+
+    int total = 0;
+    size_t skip = 0;
+    while(1) {
+        // step past what was written
+        while(msg.msg_iovlen && skip >= msg.msg_iov->iov_len) {
+            skip -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if(!msg.msg_iovlen)
+            break;
+        msg.msg_iov->iov_base = (char*) msg.msg_iov->iov_base + skip;
+        msg.msg_iov->iov_len -= skip;
+        skip = 0;
+
+        int thiscnt = sendmsg(fd, &msg, flags);
+        if(thiscnt < 0 && errno == EINTR)
+            continue;
+        if(thiscnt < 0 && (flags & MSG_DONTWAIT) &&
+           (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if(thiscnt <= 0) {
+            perror("_sendv");
+            return -1;
+        }
+        total += thiscnt;
+        skip = thiscnt;
+    }
+    return total;
+}
+
 static int
 _recv_uint32(int fd, uint32_t *result)
 {
@@ -123,6 +209,107 @@ _send_uint32(int fd, uint32_t v)
     return (_send_fully(fd, &n, 4) == 4) ? 0 : -1;
 }
 
+// forgets everything queued, when the connection it was for is gone.
+// Called with send_lock held.
+static void
+_clear_queue(lcm_tcpq_t *self)
+{
+    for(guint i = 0; i < self->send_queued->len; i++)
+        g_free(g_array_index(self->send_queued, tcpq_queued_t, i).channel);
+    g_array_set_size(self->send_queued, 0);
+    g_byte_array_set_size(self->send_bytes, 0);
+    self->send_written = 0;
+}
+
+static void
+_disconnect(lcm_tcpq_t *self)
+{
+    g_static_rec_mutex_lock(&self->send_lock);
+    dbg(DBG_LCM, "Disconnected!\n");
+    _close_socket(self->socket);
+    self->socket = -1;
+    _clear_queue(self);
+    g_static_rec_mutex_unlock(&self->send_lock);
+}
+
+// writes what's queued, waiting for the socket only if block is set, and
+// drops the messages that are all written.  Returns -1 if the connection
+// broke.  Called with send_lock held.
+static int
+_write_queue(lcm_tcpq_t *self, int block)
+{
+    if(self->send_written < self->send_bytes->len) {
+        struct iovec part;
+        part.iov_base = (char*) self->send_bytes->data + self->send_written;
+        part.iov_len = self->send_bytes->len - self->send_written;
+        int written = _sendv(self->socket, &part, 1, block ? 0 : MSG_DONTWAIT);
+        if(written < 0)
+            return -1;
+        self->send_written += written;
+    }
+
+    guint done = 0;
+    unsigned int done_bytes = 0;
+    while(done < self->send_queued->len) {
+        tcpq_queued_t *queued =
+            &g_array_index(self->send_queued, tcpq_queued_t, done);
+        if(done_bytes + queued->size > self->send_written)
+            break;
+        done_bytes += queued->size;
+        g_free(queued->channel);
+        done++;
+    }
+    if(done) {
+        g_array_remove_range(self->send_queued, 0, done);
+        g_byte_array_remove_range(self->send_bytes, 0, done_bytes);
+        self->send_written -= done_bytes;
+    }
+    return 0;
+}
+
+// frames a message onto the end of the queue.  On a latest-only channel,
+// the message queued for it before is dropped, unless it's partly written.
+// Called with send_lock held.
+static void
+_queue_message(lcm_tcpq_t *self, const char *channel, int latest,
+        const struct iovec *parts, int nparts)
+{
+    if(latest) {
+        unsigned int offset = 0;
+        for(guint i = 0; i < self->send_queued->len; i++) {
+            tcpq_queued_t *queued =
+                &g_array_index(self->send_queued, tcpq_queued_t, i);
+            if(offset >= self->send_written && queued->latest &&
+               !strcmp(queued->channel, channel)) {
+                dbg(DBG_LCM, "LCM tcpq: replacing queued [%s]\n", channel);
+                g_byte_array_remove_range(self->send_bytes, offset, queued->size);
+                g_free(queued->channel);
+                g_array_remove_index(self->send_queued, i);
+                break;
+            }
+            offset += queued->size;
+        }
+    }
+
+    tcpq_queued_t queued;
+    queued.channel = g_strdup(channel);
+    queued.size = 0;
+    queued.latest = latest;
+    for(int i = 0; i < nparts; i++) {
+        g_byte_array_append(self->send_bytes,
+                (const guint8*) parts[i].iov_base, parts[i].iov_len);
+        queued.size += parts[i].iov_len;
+    }
+    g_array_append_val(self->send_queued, queued);
+}
+
+// whether the calling thread has a batch open.  Called with send_lock held.
+static int
+_in_batch(lcm_tcpq_t *self)
+{
+    return self->batch_depth && self->batch_thread == g_thread_self();
+}
+
 static void
 lcm_tcpq_destroy (lcm_tcpq_t *self)
 {
@@ -133,6 +320,12 @@ lcm_tcpq_destroy (lcm_tcpq_t *self)
         g_free(self->server_addr_str);
     free(self->recv_channel_buf);
     free(self->data_buf);
+    _clear_queue(self);
+    g_byte_array_free(self->send_bytes, TRUE);
+    g_array_free(self->send_queued, TRUE);
+    if(self->latest)
+        g_regex_unref(self->latest);
+    g_static_rec_mutex_free(&self->send_lock);
     free(self);
 }
 
@@ -141,12 +334,15 @@ _connect_to_server(lcm_tcpq_t *self)
 {
     fprintf(stderr, "LCM tcpq: connecting...\n");
 
+    g_static_rec_mutex_lock(&self->send_lock);
     if(self->socket)
         _close_socket(self->socket);
+    _clear_queue(self);
 
     self->socket=socket(AF_INET,SOCK_STREAM,0);
     if(self->socket < 0) {
         perror("lcm_tcpq socket");
+        g_static_rec_mutex_unlock(&self->send_lock);
         return -1;
     }
 
@@ -160,6 +356,14 @@ _connect_to_server(lcm_tcpq_t *self)
         goto fail;
     }
 
+    // every message is written with one call, so there's nothing for Nagle
+    // to gather and it would only hold small messages back
+    int nodelay = 1;
+    if(0 != setsockopt(self->socket, IPPROTO_TCP, TCP_NODELAY,
+                (char*) &nodelay, sizeof(nodelay))) {
+        perror("lcm_tcpq setsockopt(TCP_NODELAY)");
+    }
+
     if(_send_uint32(self->socket, MAGIC_CLIENT) ||
        _send_uint32(self->socket, PROTOCOL_VERSION)) {
         goto fail;
@@ -187,15 +391,61 @@ _connect_to_server(lcm_tcpq_t *self)
     }
 
     dbg(DBG_LCM, "LCM tcpq: connected (%d)\n", self->socket);
+    g_static_rec_mutex_unlock(&self->send_lock);
     return 0;
 
 fail:
         fprintf(stderr, "LCM tcpq: Unable to connect to server\n");
         _close_socket(self->socket);
         self->socket = -1;
+        g_static_rec_mutex_unlock(&self->send_lock);
         return -1;
 }
 
+// parses the latest option, a regex of the channels only the newest message
+// matters on
+static int
+_parse_latest(lcm_tcpq_t *self, const char *str)
+{
+    char *regexbuf = g_strdup_printf("^%s$", str);
+    GError *rerr = NULL;
+    self->latest = g_regex_new(regexbuf, (GRegexCompileFlags) 0,
+            (GRegexMatchFlags) 0, &rerr);
+    g_free(regexbuf);
+    if(rerr) {
+        fprintf(stderr, "Error: Bad latest channels \"%s\": %s\n", str,
+                rerr->message);
+        g_error_free(rerr);
+        self->latest = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+new_argument(gpointer key, gpointer value, gpointer user)
+{
+    lcm_tcpq_t *self = (lcm_tcpq_t *) user;
+    if(!strcmp((char *) key, "queue_size")) {
+        char *endptr = NULL;
+        long queue_size = strtol((char *) value, &endptr, 0);
+        if(endptr == value || queue_size < 0)
+            fprintf(stderr, "Warning: Invalid value for queue_size\n");
+        else
+            self->queue_size = queue_size;
+    }
+    else if(!strcmp((char *) key, "latest")) {
+        if(self->latest)
+            g_regex_unref(self->latest);
+        if(0 != _parse_latest(self, (char *) value))
+            fprintf(stderr, "Warning: Invalid value for latest\n");
+    }
+    else {
+        fprintf(stderr, "%s:%d -- unknown provider argument %s\n",
+                __FILE__, __LINE__, (char *)key);
+    }
+}
+
 static lcm_provider_t *
 lcm_tcpq_create(lcm_t * parent, const char *network, const GHashTable *args)
 {
@@ -215,6 +465,13 @@ lcm_tcpq_create(lcm_t * parent, const char *network, const GHashTable *args)
     self->data_buf = calloc(1, self->data_buf_len);
     self->subs = NULL;
 
+    g_static_rec_mutex_init(&self->send_lock);
+    self->send_bytes = g_byte_array_new();
+    self->send_queued = g_array_new(FALSE, FALSE, sizeof(tcpq_queued_t));
+    self->queue_size = DEFAULT_QUEUE_SIZE;
+    if(args)
+        g_hash_table_foreach((GHashTable*) args, new_argument, self);
+
     // parse server address and port
     if (!network || !strlen(network)) {
         network = "127.0.0.1:7700";
@@ -270,19 +527,26 @@ _sub_unsub_helper(lcm_tcpq_t *self, const char *channel, uint32_t msg_type)
         return -1;
     }
 
-    uint32_t channel_len = strlen(channel);
-    if(_send_uint32(self->socket, msg_type) ||
-       _send_uint32(self->socket, channel_len) ||
-       (channel_len != _send_fully(self->socket, channel, channel_len)))
-    {
+    uint32_t header[2] = { htonl(msg_type), htonl(strlen(channel)) };
+    struct iovec parts[2];
+    parts[0].iov_base = (char*) header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = (char*) channel;
+    parts[1].iov_len = strlen(channel);
+
+    // what's queued goes first, so the message doesn't land in the middle
+    // of a partly written one
+    g_static_rec_mutex_lock(&self->send_lock);
+    int status = _write_queue(self, 1);
+    if(0 == status &&
+       (int) (parts[0].iov_len + parts[1].iov_len) != _sendv(self->socket, parts, 2, 0))
+        status = -1;
+    if(status) {
         perror("LCM tcpq");
-        dbg(DBG_LCM, "Disconnected!\n");
-        _close_socket(self->socket);
-        self->socket = -1;
-        return -1;
+        _disconnect(self);
     }
-
-    return 0;
+    g_static_rec_mutex_unlock(&self->send_lock);
+    return status;
 }
 
 static int
@@ -345,6 +609,35 @@ lcm_tcpq_handle(lcm_tcpq_t * self)
         return -1;
     }
 
+    // until a message arrives, write what's queued as the server takes it,
+    // so a link that fell behind catches up without anything published
+    while(1) {
+        g_static_rec_mutex_lock(&self->send_lock);
+        // an open batch is written when it ends
+        int status = 0;
+        int pending = 0;
+        if(!self->batch_depth) {
+            status = _write_queue(self, 0);
+            pending = self->send_queued->len > 0;
+        }
+        g_static_rec_mutex_unlock(&self->send_lock);
+        if(status)
+            goto disconnected;
+        if(!pending)
+            break;
+
+        fd_set readfds, writefds;
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_SET(self->socket, &readfds);
+        FD_SET(self->socket, &writefds);
+        if(select(self->socket + 1, &readfds, &writefds, NULL, NULL) < 0 &&
+           errno != EINTR)
+            goto disconnected;
+        if(FD_ISSET(self->socket, &readfds))
+            break;
+    }
+
     // read, ignore message type
     uint32_t msg_type;
     if(_recv_uint32(self->socket, &msg_type))
@@ -380,14 +673,15 @@ lcm_tcpq_handle(lcm_tcpq_t * self)
     rbuf.data_size = data_len;
     rbuf.recv_utime = timestamp_now();
     rbuf.lcm = self->lcm;
+    rbuf.send_utime = 0;
+    rbuf.send_seqno = 0;
 
     if(lcm_try_enqueue_message(self->lcm, self->recv_channel_buf))
         lcm_dispatch_handlers(self->lcm, &rbuf, self->recv_channel_buf);
     return 0;
 
 disconnected:
-    _close_socket(self->socket);
-    self->socket = -1;
+    _disconnect(self);
     return -1;
 }
 
@@ -395,26 +689,97 @@ static int
 lcm_tcpq_publish(lcm_tcpq_t *self, const char *channel, const void *data,
         unsigned int datalen)
 {
+    g_static_rec_mutex_lock(&self->send_lock);
     if(self->socket < 0 && 0 != _connect_to_server(self)) {
-            return -1;
+        g_static_rec_mutex_unlock(&self->send_lock);
+        return -1;
     }
 
     uint32_t channel_len = strlen(channel);
+    uint32_t header[2] = { htonl(MESSAGE_TYPE_PUBLISH), htonl(channel_len) };
+    uint32_t datalen_n = htonl(datalen);
+    struct iovec parts[4];
+    parts[0].iov_base = (char*) header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = (char*) channel;
+    parts[1].iov_len = channel_len;
+    parts[2].iov_base = (char*) &datalen_n;
+    parts[2].iov_len = sizeof(datalen_n);
+    parts[3].iov_base = (char*) data;
+    parts[3].iov_len = datalen;
+    int size = sizeof(header) + channel_len + sizeof(datalen_n) + datalen;
+
+    int latest = self->latest &&
+        g_regex_match(self->latest, channel, (GRegexMatchFlags) 0, NULL);
+
+    int status = 0;
+    if(!_in_batch(self) && !self->send_queued->len) {
+        // nothing is waiting ahead of it, so it's written straight from
+        // the caller's buffer, and what the socket doesn't take is queued
+        int written = _sendv(self->socket, parts, 4, MSG_DONTWAIT);
+        if(written == size) {
+            g_static_rec_mutex_unlock(&self->send_lock);
+            return 0;
+        }
+        if(written < 0) {
+            status = -1;
+        } else {
+            _queue_message(self, channel, latest, parts, 4);
+            self->send_written = written;
+        }
+    } else {
+        _queue_message(self, channel, latest, parts, 4);
+        if(!_in_batch(self))
+            status = _write_queue(self, 0);
+    }
+
+    // the queue is bounded by waiting for the server to take some of it.
+    // Latest-only channels don't wait, the newest message replaced theirs
+    if(0 == status && !latest &&
+       self->send_bytes->len - self->send_written > self->queue_size)
+        status = _write_queue(self, 1);
 
-    if(_send_uint32(self->socket, MESSAGE_TYPE_PUBLISH) ||
-       _send_uint32(self->socket, channel_len) ||
-       (channel_len != _send_fully(self->socket, channel, channel_len)) ||
-       _send_uint32(self->socket, datalen) ||
-       (datalen != _send_fully(self->socket, data, datalen)))
-    {
+    if(status) {
         perror("LCM tcpq send");
-        dbg(DBG_LCM, "Disconnected!\n");
-        _close_socket(self->socket);
-        self->socket = -1;
-        return -1;
+        _disconnect(self);
     }
+    g_static_rec_mutex_unlock(&self->send_lock);
+    return status;
+}
 
-    return 0;
+static int
+lcm_tcpq_begin_batch(lcm_tcpq_t *self)
+{
+    int status = 0;
+    g_static_rec_mutex_lock(&self->send_lock);
+    if(!self->batch_depth)
+        self->batch_thread = g_thread_self();
+    if(self->batch_thread == g_thread_self())
+        self->batch_depth++;
+    else
+        status = -1;
+    g_static_rec_mutex_unlock(&self->send_lock);
+    return status;
+}
+
+static int
+lcm_tcpq_end_batch(lcm_tcpq_t *self)
+{
+    int status = 0;
+    g_static_rec_mutex_lock(&self->send_lock);
+    if(!_in_batch(self)) {
+        status = -1;
+    } else if(0 == --self->batch_depth) {
+        // the whole batch goes out in one write, as far as the socket takes it
+        self->batch_thread = NULL;
+        if(self->socket >= 0 && 0 != _write_queue(self, 0)) {
+            perror("LCM tcpq send");
+            _disconnect(self);
+            status = -1;
+        }
+    }
+    g_static_rec_mutex_unlock(&self->send_lock);
+    return status;
 }
 
 static lcm_provider_vtable_t tcpq_vtable;
@@ -430,6 +795,8 @@ lcm_tcpq_provider_init (GPtrArray * providers)
     tcpq_vtable.publish     = lcm_tcpq_publish;
     tcpq_vtable.handle      = lcm_tcpq_handle;
     tcpq_vtable.get_fileno  = lcm_tcpq_get_fileno;
+    tcpq_vtable.begin_batch = lcm_tcpq_begin_batch;
+    tcpq_vtable.end_batch   = lcm_tcpq_end_batch;
 
     tcpq_info.name = "tcpq";
     tcpq_info.vtable = &tcpq_vtable;
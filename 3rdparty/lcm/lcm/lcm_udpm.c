@@ -1,3 +1,8 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for recvmmsg and sendmmsg
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,6 +46,31 @@
 
 #define SELF_TEST_CHANNEL "LCM_SELF_TEST"
 
+// size of the kernel receive buffer requested when recv_buf_size isn't given.
+// The kernel caps it at its own limit (net.core.rmem_max on Linux).
+#define LCM_UDPM_DEFAULT_RECV_BUF_SIZE (2048 * 1024)
+
+// how often the receive thread reports message loss, in seconds
+#define LCM_UDPM_LOSS_REPORT_PERIOD 2
+
+// where available, the receive thread reads up to this many datagrams per
+// system call with recvmmsg, instead of one per recvmsg
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define USE_RECVMMSG
+#define LCM_UDPM_RECV_BATCH 16
+#endif
+
+// where available, a publish batch sends up to this many datagrams per
+// system call with sendmmsg, instead of one per sendmsg
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define USE_SENDMMSG
+#endif
+#define LCM_UDPM_SEND_BATCH 32
+
+// a publish batch is sent early once it holds this many bytes, so a cycle
+// that publishes a lot doesn't build up an unbounded queue
+#define LCM_UDPM_BATCH_MAX_BYTES (256 * 1024)
+
 /**
  * udpm_params_t:
  * @mc_addr:        multicast address
@@ -50,7 +80,14 @@
  *                        and never traverse a router
  *                  don't use > 1.  that's just rude. 
  * @recv_buf_size:  requested size of the kernel receive buffer, set with
- *                  SO_RCVBUF.  0 indicates to use the default settings.
+ *                  SO_RCVBUF.  0 indicates to request
+ *                  LCM_UDPM_DEFAULT_RECV_BUF_SIZE.
+ * @mc_loopback:    if 0, then packets aren't received by the local host.
+ * @trace:          if 1, then transmitted messages carry a trace.
+ * @frag_rate:      bytes per second fragments of large messages are paced
+ *                  to, or 0 to send them as fast as possible.
+ * @groups:         the groups option, only valid while the provider is
+ *                  being created.
  *
  */
 typedef struct _udpm_params_t udpm_params_t;
@@ -59,6 +96,37 @@ struct _udpm_params_t {
     uint16_t mc_port;
     uint8_t mc_ttl; 
     int recv_buf_size;
+    int mc_loopback;
+    int trace;
+    int frag_rate;
+    const char *groups;
+};
+
+/**
+ * udpm_group_t:
+ * @regex:          channels sent to this group
+ * @addr:           multicast address of the group, on the same port as the
+ *                  default one
+ * @joined:         whether the receive socket is a member
+ */
+typedef struct _udpm_group_t udpm_group_t;
+struct _udpm_group_t {
+    GRegex *regex;
+    struct in_addr addr;
+    int joined;
+};
+
+/**
+ * udpm_queued_t:
+ * @offset:         where the datagram starts in batch_packets
+ * @size:           size of the datagram
+ * @dest_addr:      where it's sent
+ */
+typedef struct _udpm_queued_t udpm_queued_t;
+struct _udpm_queued_t {
+    unsigned int offset;
+    unsigned int size;
+    struct sockaddr_in dest_addr;
 };
 
 typedef struct _lcm_provider_t lcm_udpm_t;
@@ -93,7 +161,23 @@ struct _lcm_provider_t {
     int notify_pipe[2];         // pipe to notify application when messages arrive
     int thread_msg_pipe[2];     // pipe to notify read thread when to quit
 
-    GStaticMutex transmit_lock; // so that only thread at a time can transmit
+    GStaticMutex transmit_lock; // so that only one thread at a time transmits
+                                // fragments, which receivers can't tell apart
+                                // if they're interleaved
+    int64_t frag_next_utime;    // when the next fragment may be sent, if the
+                                // fragments are paced.  Guarded by
+                                // transmit_lock
+    GStaticMutex channel_lock;  // guards group_cache and trace_seqnos
+
+    /* Publish batch.  Short messages published by batch_thread while
+     * batch_depth is above 0 are queued in batch_packets instead of being
+     * sent, and go out together when the outermost batch ends.  Only
+     * batch_thread touches the queue, batch_lock guards who owns it. */
+    GStaticMutex batch_lock;
+    GThread *batch_thread;
+    int batch_depth;
+    GByteArray *batch_packets;
+    GArray *batch_queued;
 
     /* synchronization variables used only while allocating receive resources
      */
@@ -108,10 +192,36 @@ struct _lcm_provider_t {
     uint32_t     udp_rx;            // packets received and processed
     uint32_t     udp_discarded_bad; // packets discarded because they were bad 
                                     // somehow
+    uint32_t     udp_kernel_dropped; // packets dropped by the kernel because
+                                     // its receive buffer was full
+    uint32_t     udp_kernel_dropped_total; // running count last reported by
+                                           // the kernel
     double       udp_low_watermark; // least buffer available
     int32_t      udp_last_report_secs;
 
-    uint32_t     msg_seqno; // rolling counter of how many messages transmitted
+#ifdef USE_RECVMMSG
+    /* Datagrams read by the last recvmmsg.  Those before batch_next have been
+     * processed already. */
+    char *batch_data;
+    struct mmsghdr batch_msgs[LCM_UDPM_RECV_BATCH];
+    struct iovec batch_vecs[LCM_UDPM_RECV_BATCH];
+    struct sockaddr batch_from[LCM_UDPM_RECV_BATCH];
+    char batch_control[LCM_UDPM_RECV_BATCH][64];
+    int batch_count;
+    int batch_next;
+#endif
+
+    volatile gint msg_seqno; // rolling counter of how many messages
+                             // transmitted, incremented atomically
+
+    // channel to how many messages were transmitted on it, if tracing
+    GHashTable  *trace_seqnos;
+
+    // multicast groups other than the default one, by channel.  group_cache
+    // maps a channel name to its index in groups plus one, or to 0 if it's
+    // in the default group.
+    GPtrArray   *groups;
+    GHashTable  *group_cache;
 };
 
 static int _setup_recv_parts (lcm_udpm_t *lcm);
@@ -143,6 +253,8 @@ _destroy_recv_parts (lcm_udpm_t *lcm)
         lcm_close_socket(lcm->recvfd);
         lcm->recvfd = -1;
     }
+    for (unsigned int i = 0; lcm->groups && i < lcm->groups->len; i++)
+        ((udpm_group_t *) g_ptr_array_index (lcm->groups, i))->joined = 0;
 
     if (lcm->frag_bufs) {
         lcm_frag_buf_store_destroy(lcm->frag_bufs);
@@ -161,6 +273,12 @@ _destroy_recv_parts (lcm_udpm_t *lcm)
         lcm_ringbuf_free (lcm->ringbuf);
         lcm->ringbuf = NULL;
     }
+
+#ifdef USE_RECVMMSG
+    free (lcm->batch_data);
+    lcm->batch_data = NULL;
+    lcm->batch_count = lcm->batch_next = 0;
+#endif
 }
 
 void
@@ -177,6 +295,23 @@ lcm_udpm_destroy (lcm_udpm_t *lcm)
 
     g_static_rec_mutex_free (&lcm->mutex);
     g_static_mutex_free (&lcm->transmit_lock);
+    g_static_mutex_free (&lcm->channel_lock);
+    g_static_mutex_free (&lcm->batch_lock);
+    if (lcm->batch_packets) {
+        g_byte_array_free (lcm->batch_packets, TRUE);
+        g_array_free (lcm->batch_queued, TRUE);
+    }
+    if (lcm->trace_seqnos)
+        g_hash_table_destroy (lcm->trace_seqnos);
+    if (lcm->groups) {
+        for (unsigned int i = 0; i < lcm->groups->len; i++) {
+            udpm_group_t *group = (udpm_group_t *) g_ptr_array_index (lcm->groups, i);
+            g_regex_unref (group->regex);
+            free (group);
+        }
+        g_ptr_array_free (lcm->groups, TRUE);
+        g_hash_table_destroy (lcm->group_cache);
+    }
     if(lcm->create_read_thread_mutex) {
         g_mutex_free(lcm->create_read_thread_mutex);
         g_cond_free(lcm->create_read_thread_cond);
@@ -228,6 +363,29 @@ new_argument (gpointer key, gpointer value, gpointer user)
         if (endptr == value)
             fprintf (stderr, "Warning: Invalid value for ttl\n");
     }
+    else if (!strcmp ((char *) key, "multicast_loopback")) {
+        char *endptr = NULL;
+        params->mc_loopback = strtol ((char *) value, &endptr, 0);
+        if (endptr == value)
+            fprintf (stderr, "Warning: Invalid value for multicast_loopback\n");
+    }
+    else if (!strcmp ((char *) key, "trace")) {
+        char *endptr = NULL;
+        params->trace = strtol ((char *) value, &endptr, 0);
+        if (endptr == value)
+            fprintf (stderr, "Warning: Invalid value for trace\n");
+    }
+    else if (!strcmp ((char *) key, "frag_rate")) {
+        char *endptr = NULL;
+        params->frag_rate = strtol ((char *) value, &endptr, 0);
+        if (endptr == value || params->frag_rate < 0) {
+            fprintf (stderr, "Warning: Invalid value for frag_rate\n");
+            params->frag_rate = 0;
+        }
+    }
+    else if (!strcmp ((char *) key, "groups")) {
+        params->groups = (const char *) value;
+    }
     else if (!strcmp ((char *) key, "transmit_only")) {
         fprintf (stderr, "%s:%d -- transmit_only option is now obsolete\n",
                 __FILE__, __LINE__);
@@ -238,6 +396,185 @@ new_argument (gpointer key, gpointer value, gpointer user)
     }
 }
 
+// parses the groups option, "REGEX@ADDRESS;REGEX@ADDRESS;...", into
+// lcm->groups
+static int
+parse_groups (lcm_udpm_t *lcm, const char *str)
+{
+    lcm->groups = g_ptr_array_new ();
+    lcm->group_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+            free, NULL);
+
+    int status = 0;
+    char **entries = g_strsplit (str, ";", -1);
+    for (int i = 0; entries[i] && status == 0; i++) {
+        if (!strlen (entries[i]))
+            continue;
+        char *at = strrchr (entries[i], '@');
+        if (!at || at == entries[i]) {
+            fprintf (stderr, "Error: Bad multicast group \"%s\"\n", entries[i]);
+            status = -1;
+            break;
+        }
+        *at = 0;
+
+        udpm_group_t *group = (udpm_group_t *) calloc (1, sizeof (udpm_group_t));
+        if (inet_aton (at + 1, &group->addr) == 0 ||
+                !IN_MULTICAST (ntohl (group->addr.s_addr))) {
+            fprintf (stderr, "Error: Bad multicast IP address \"%s\"\n", at + 1);
+            free (group);
+            status = -1;
+            break;
+        }
+
+        char *regexbuf = g_strdup_printf ("^%s$", entries[i]);
+        GError *rerr = NULL;
+        group->regex = g_regex_new (regexbuf, (GRegexCompileFlags) 0,
+                (GRegexMatchFlags) 0, &rerr);
+        g_free (regexbuf);
+        if (rerr) {
+            fprintf (stderr, "Error: Bad multicast group channels \"%s\": %s\n",
+                    entries[i], rerr->message);
+            g_error_free (rerr);
+            free (group);
+            status = -1;
+            break;
+        }
+        g_ptr_array_add (lcm->groups, group);
+    }
+    g_strfreev (entries);
+    return status;
+}
+
+// the group messages on channel are sent to, or NULL for the default group.
+// Called with the channel lock held.
+static udpm_group_t *
+_channel_group (lcm_udpm_t *lcm, const char *channel)
+{
+    gpointer value;
+    if (!g_hash_table_lookup_extended (lcm->group_cache, channel, NULL, &value)) {
+        // the first group that matches wins
+        int index = 0;
+        for (unsigned int i = 0; i < lcm->groups->len && !index; i++) {
+            udpm_group_t *group = (udpm_group_t *) g_ptr_array_index (lcm->groups, i);
+            if (g_regex_match (group->regex, channel, (GRegexMatchFlags) 0, NULL))
+                index = i + 1;
+        }
+        value = GINT_TO_POINTER (index);
+        g_hash_table_insert (lcm->group_cache, strdup (channel), value);
+    }
+    int index = GPOINTER_TO_INT (value);
+    return index ? (udpm_group_t *) g_ptr_array_index (lcm->groups, index - 1) : NULL;
+}
+
+static int
+_join_group (lcm_udpm_t *lcm, udpm_group_t *group)
+{
+    if (group->joined)
+        return 0;
+
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = group->addr;
+    mreq.imr_interface.s_addr = INADDR_ANY;
+    dbg (DBG_LCM, "LCM: joining multicast group %s\n", inet_ntoa (group->addr));
+    if (setsockopt (lcm->recvfd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+            (char*)&mreq, sizeof (mreq)) < 0) {
+        perror ("setsockopt (IPPROTO_IP, IP_ADD_MEMBERSHIP)");
+        return -1;
+    }
+    group->joined = 1;
+    return 0;
+}
+
+// joins the groups that messages matching a subscription to channel can be
+// sent to.  A regex could match channels of any group, so it joins them all.
+static int
+_join_channel_groups (lcm_udpm_t *lcm, const char *channel)
+{
+    if (!lcm->groups)
+        return 0;
+
+    int status = 0;
+    g_static_rec_mutex_lock (&lcm->mutex);
+    if (lcm->recvfd >= 0) {
+        if (strpbrk (channel, ".^$*+?()[]{}|\\")) {
+            for (unsigned int i = 0; i < lcm->groups->len && status == 0; i++)
+                status = _join_group (lcm,
+                        (udpm_group_t *) g_ptr_array_index (lcm->groups, i));
+        } else {
+            g_static_mutex_lock (&lcm->channel_lock);
+            udpm_group_t *group = _channel_group (lcm, channel);
+            g_static_mutex_unlock (&lcm->channel_lock);
+            if (group)
+                status = _join_group (lcm, group);
+        }
+    }
+    g_static_rec_mutex_unlock (&lcm->mutex);
+    return status;
+}
+
+static int64_t
+_trace_utime (const lcm2_trace_t *trace)
+{
+    return (int64_t) (((uint64_t) ntohl (trace->send_utime_hi) << 32) |
+            ntohl (trace->send_utime_lo));
+}
+
+// fills in the trace of the next message on channel.  Called with the
+// channel lock held
+static void
+_next_trace (lcm_udpm_t *lcm, const char *channel, lcm2_trace_t *trace)
+{
+    uint32_t seqno = GPOINTER_TO_UINT (
+            g_hash_table_lookup (lcm->trace_seqnos, channel));
+    g_hash_table_replace (lcm->trace_seqnos, strdup (channel),
+            GUINT_TO_POINTER (seqno + 1));
+
+    uint64_t now = lcm_timestamp_now ();
+    trace->send_utime_hi = htonl ((uint32_t) (now >> 32));
+    trace->send_utime_lo = htonl ((uint32_t) now);
+    trace->send_seqno = htonl (seqno);
+}
+
+// sets dest_addr to where messages on channel are sent and, if trace isn't
+// NULL, fills in the trace of the next one.  Only the lookups are locked, so
+// publishers on different threads don't wait on each other's sends.
+static void
+_prepare_send (lcm_udpm_t *lcm, const char *channel,
+        struct sockaddr_in *dest_addr, lcm2_trace_t *trace)
+{
+    *dest_addr = lcm->dest_addr;
+    if (!lcm->groups && !trace)
+        return;
+
+    g_static_mutex_lock (&lcm->channel_lock);
+    if (lcm->groups) {
+        udpm_group_t *group = _channel_group (lcm, channel);
+        if (group)
+            dest_addr->sin_addr = group->addr;
+    }
+    if (trace)
+        _next_trace (lcm, channel, trace);
+    g_static_mutex_unlock (&lcm->channel_lock);
+}
+
+// waits until a fragment of packet_size bytes can be sent without exceeding
+// frag_rate.  Called with the transmit lock held, which short messages don't
+// need, so they go out in the gaps.
+static void
+_pace_fragment (lcm_udpm_t *lcm, int packet_size)
+{
+    if (!lcm->params.frag_rate)
+        return;
+
+    int64_t now = lcm_timestamp_now ();
+    if (lcm->frag_next_utime > now)
+        g_usleep (lcm->frag_next_utime - now);
+    else
+        lcm->frag_next_utime = now;
+    lcm->frag_next_utime += (int64_t) packet_size * 1000000 / lcm->params.frag_rate;
+}
+
 static int 
 _recv_message_fragment (lcm_udpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
 {
@@ -275,7 +612,17 @@ _recv_message_fragment (lcm_udpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
 
     // create a new fragment buffer if necessary
     if (!fbuf && hdr->fragment_no == 0) {
-        char *channel = (char*) (hdr + 1);
+        lcm2_trace_t trace;
+        if (ntohl (hdr->magic) == LCM2_MAGIC_LONG_TRACED) {
+            if (frag_size < sizeof (trace)) {
+                lcm->udp_discarded_bad++;
+                return 0;
+            }
+            memcpy (&trace, data_start, sizeof (trace));
+            data_start += sizeof (trace);
+            frag_size -= sizeof (trace);
+        }
+        char *channel = data_start;
         int channel_sz = strlen (channel);
         if (channel_sz > LCM_MAX_CHANNEL_NAME_LENGTH) {
             dbg (DBG_LCM, "bad channel name length\n");
@@ -290,6 +637,10 @@ _recv_message_fragment (lcm_udpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
         fbuf = lcm_frag_buf_new (*((struct sockaddr_in*) &lcmb->from),
                 channel, msg_seqno, data_size, fragments_in_msg,
                 lcmb->recv_utime);
+        if (ntohl (hdr->magic) == LCM2_MAGIC_LONG_TRACED) {
+            fbuf->send_utime = _trace_utime (&trace);
+            fbuf->send_seqno = ntohl (trace.send_seqno);
+        }
         lcm_frag_buf_store_add (lcm->frag_bufs, fbuf);
         data_start += channel_sz + 1;
         frag_size -= (channel_sz + 1);
@@ -351,6 +702,8 @@ _recv_message_fragment (lcm_udpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
         lcmb->data_offset = 0;
         lcmb->data_size = fbuf->data_size;
         lcmb->recv_utime = fbuf->last_packet_utime;
+        lcmb->send_utime = fbuf->send_utime;
+        lcmb->send_seqno = fbuf->send_seqno;
 
         // don't need the fragment buffer anymore
         lcm_frag_buf_store_remove (lcm->frag_bufs, fbuf);
@@ -362,13 +715,28 @@ _recv_message_fragment (lcm_udpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
 }
 
 static int
-_recv_short_message (lcm_udpm_t *lcm, lcm_buf_t *lcmb, int sz)
+_recv_short_message (lcm_udpm_t *lcm, lcm_buf_t *lcmb, int sz, int traced)
 {
     lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
+    int header_size = sizeof (lcm2_header_short_t);
+
+    lcmb->send_utime = 0;
+    lcmb->send_seqno = 0;
+    if (traced) {
+        lcm2_trace_t trace;
+        if (sz < header_size + sizeof (trace)) {
+            lcm->udp_discarded_bad++;
+            return 0;
+        }
+        memcpy (&trace, hdr2 + 1, sizeof (trace));
+        lcmb->send_utime = _trace_utime (&trace);
+        lcmb->send_seqno = ntohl (trace.send_seqno);
+        header_size += sizeof (trace);
+    }
 
     // shouldn't have to worry about buffer overflow here because we
     // zeroed out byte #65536, which is never written to by recv
-    const char *pkt_channel_str = (char*) (hdr2 + 1);
+    const char *pkt_channel_str = lcmb->buf + header_size;
 
     lcmb->channel_size = strlen (pkt_channel_str);
 
@@ -386,13 +754,194 @@ _recv_short_message (lcm_udpm_t *lcm, lcm_buf_t *lcmb, int sz)
 
     strcpy (lcmb->channel_name, pkt_channel_str);
 
-    lcmb->data_offset = 
-        sizeof (lcm2_header_short_t) + lcmb->channel_size + 1;
+    lcmb->data_offset = header_size + lcmb->channel_size + 1;
 
     lcmb->data_size = sz - lcmb->data_offset;
     return 1;
 }
 
+// report message loss every LCM_UDPM_LOSS_REPORT_PERIOD seconds, if there
+// was any, then start counting over
+static void
+_report_loss (lcm_udpm_t *lcm)
+{
+    g_static_rec_mutex_lock (&lcm->mutex);
+    unsigned int ring_capacity = lcm_ringbuf_capacity(lcm->ringbuf);
+    unsigned int ring_used = lcm_ringbuf_used(lcm->ringbuf);
+    g_static_rec_mutex_unlock (&lcm->mutex);
+    double buf_avail = ((double)(ring_capacity - ring_used)) / ring_capacity;
+    if (buf_avail < lcm->udp_low_watermark)
+        lcm->udp_low_watermark = buf_avail;
+
+    int64_t now = lcm_timestamp_now ();
+    int32_t now_secs = (int32_t) (now / 1000000);
+    if (now_secs - lcm->udp_last_report_secs < LCM_UDPM_LOSS_REPORT_PERIOD)
+        return;
+
+    uint32_t total_lost = lcm->udp_discarded_bad + lcm->udp_kernel_dropped;
+    if (total_lost > 0 || lcm->udp_low_watermark < 0.5) {
+        fprintf(stderr,
+                "%d.%03d LCM loss %4.1f%% : %5d err, %5d dropped by kernel, "
+                "buf avail %4.1f%%\n",
+                (int) now_secs, (int) (now % 1000000) / 1000,
+                total_lost * 100.0 / (lcm->udp_rx + total_lost),
+                lcm->udp_discarded_bad, lcm->udp_kernel_dropped,
+                100.0 * lcm->udp_low_watermark);
+    }
+
+    lcm->udp_rx = 0;
+    lcm->udp_discarded_bad = 0;
+    lcm->udp_kernel_dropped = 0;
+    lcm->udp_last_report_secs = now_secs;
+    lcm->udp_low_watermark = 1.0;
+}
+
+// read the kernel receive timestamp and the kernel's count of dropped packets
+// out of a received datagram's control messages.  Returns the timestamp, or 0
+// if there was none.
+static int64_t
+_read_control_messages (lcm_udpm_t *lcm, struct msghdr *msg)
+{
+    int64_t recv_utime = 0;
+#ifdef SO_TIMESTAMP
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR (msg);
+    while (cmsg) {
+        if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_TIMESTAMP) {
+            struct timeval * t = (struct timeval*) CMSG_DATA (cmsg);
+            recv_utime = (int64_t) t->tv_sec * 1000000 + t->tv_usec;
+        }
+#ifdef SO_RXQ_OVFL
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t dropped_total = *(uint32_t*) CMSG_DATA (cmsg);
+            lcm->udp_kernel_dropped +=
+                dropped_total - lcm->udp_kernel_dropped_total;
+            lcm->udp_kernel_dropped_total = dropped_total;
+        }
+#endif
+        cmsg = CMSG_NXTHDR (msg, cmsg);
+    }
+#endif
+    return recv_utime;
+}
+
+// returns 1 if datagrams already read from the socket are waiting to be
+// processed, so the receive thread shouldn't wait for more
+static int
+_recv_pending (lcm_udpm_t *lcm)
+{
+#ifdef USE_RECVMMSG
+    return lcm->batch_next < lcm->batch_count;
+#else
+    return 0;
+#endif
+}
+
+#ifdef USE_RECVMMSG
+// point the batch's message headers at its buffers
+static void
+_setup_recv_batch (lcm_udpm_t *lcm)
+{
+    lcm->batch_data = (char *) malloc (LCM_UDPM_RECV_BATCH * 65536);
+    lcm->batch_count = lcm->batch_next = 0;
+
+    memset (lcm->batch_msgs, 0, sizeof (lcm->batch_msgs));
+    int i;
+    for (i = 0; i < LCM_UDPM_RECV_BATCH; i++) {
+        lcm->batch_vecs[i].iov_base = lcm->batch_data + i * 65536;
+        lcm->batch_vecs[i].iov_len = 65535;
+
+        struct msghdr *msg = &lcm->batch_msgs[i].msg_hdr;
+        msg->msg_name = &lcm->batch_from[i];
+        msg->msg_iov = &lcm->batch_vecs[i];
+        msg->msg_iovlen = 1;
+        msg->msg_control = lcm->batch_control[i];
+    }
+}
+#endif
+
+// receive the next datagram into lcmb, taking it from the last batch if there
+// is one left.  Returns its size, or -1 if none could be read
+static int
+_recv_datagram (lcm_udpm_t *lcm, lcm_buf_t *lcmb)
+{
+    int sz;
+#ifdef USE_RECVMMSG
+    if (!_recv_pending (lcm)) {
+        int i;
+        for (i = 0; i < LCM_UDPM_RECV_BATCH; i++) {
+            struct msghdr *msg = &lcm->batch_msgs[i].msg_hdr;
+            msg->msg_namelen = sizeof (struct sockaddr);
+            msg->msg_controllen = sizeof (lcm->batch_control[i]);
+            msg->msg_flags = 0;
+        }
+
+        // select only says the first datagram is there, so don't wait for
+        // the rest of the batch
+        int n = recvmmsg (lcm->recvfd, lcm->batch_msgs, LCM_UDPM_RECV_BATCH,
+                MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror ("udp_read_packet -- recvmmsg");
+                lcm->udp_discarded_bad++;
+            }
+            lcm->batch_count = lcm->batch_next = 0;
+            return -1;
+        }
+        lcm->batch_count = n;
+        lcm->batch_next = 0;
+    }
+
+    int i = lcm->batch_next++;
+    struct msghdr *msg = &lcm->batch_msgs[i].msg_hdr;
+    sz = lcm->batch_msgs[i].msg_len;
+
+    // the datagram was read into the batch, so copy it to where the message
+    // is kept.  Only the bytes received are copied, which is the whole
+    // packet for every message small enough to matter
+    memcpy (lcmb->buf, lcm->batch_vecs[i].iov_base, sz);
+    memcpy (&lcmb->from, msg->msg_name, sizeof (struct sockaddr));
+    lcmb->fromlen = msg->msg_namelen;
+#else
+    struct iovec        vec;
+    vec.iov_base = lcmb->buf;
+    vec.iov_len = 65535;
+
+    struct msghdr msgbuf;
+    struct msghdr *msg = &msgbuf;
+    memset(msg, 0, sizeof(struct msghdr));
+    msg->msg_name = &lcmb->from;
+    msg->msg_namelen = sizeof (struct sockaddr);
+    msg->msg_iov = &vec;
+    msg->msg_iovlen = 1;
+#ifdef MSG_EXT_HDR
+    // operating systems that provide SO_TIMESTAMP allow us to obtain more
+    // accurate timestamps by having the kernel produce timestamps as soon
+    // as packets are received.
+    char controlbuf[64];
+    msg->msg_control = controlbuf;
+    msg->msg_controllen = sizeof (controlbuf);
+    msg->msg_flags = 0;
+#endif
+    sz = recvmsg (lcm->recvfd, msg, 0);
+
+    if (sz < 0) {
+        perror ("udp_read_packet -- recvmsg");
+        lcm->udp_discarded_bad++;
+        return -1;
+    }
+
+    lcmb->fromlen = msg->msg_namelen;
+#endif
+
+    lcmb->recv_utime = _read_control_messages (lcm, msg);
+    if (!lcmb->recv_utime)
+        lcmb->recv_utime = lcm_timestamp_now ();
+
+    return sz;
+}
+
 // read continuously until a complete message arrives
 static lcm_buf_t *
 udp_read_packet (lcm_udpm_t *lcm)
@@ -401,102 +950,53 @@ udp_read_packet (lcm_udpm_t *lcm)
 
     int sz = 0;
 
-    // TODO warn about message loss somewhere else.
-
-//    g_static_rec_mutex_lock (&lcm->mutex);
-//    unsigned int ring_capacity = lcm_ringbuf_capacity(lcm->ringbuf);
-//    unsigned int ring_used = lcm_ringbuf_used(lcm->ringbuf);
-//    double buf_avail = ((double)(ring_capacity - ring_used)) / ring_capacity;
-//    g_static_rec_mutex_unlock (&lcm->mutex);
-//    if (buf_avail < lcm->udp_low_watermark)
-//        lcm->udp_low_watermark = buf_avail;
-//
-//    GTimeVal tv;
-//    g_get_current_time(&tv);
-//    int elapsedsecs = tv.tv_sec - lcm->udp_last_report_secs;
-//    if (elapsedsecs > 2) {
-//        uint32_t total_bad = lcm->udp_discarded_bad;
-//        if (total_bad > 0 || lcm->udp_low_watermark < 0.5) {
-//            fprintf(stderr, 
-//                    "%d.%03d LCM loss %4.1f%% : %5d err, "
-//                    "buf avail %4.1f%%\n", 
-//                   (int) tv.tv_sec, (int) tv.tv_usec/1000,
-//                   total_bad * 100.0 / (lcm->udp_rx + total_bad),
-//                   lcm->udp_discarded_bad,
-//                   100.0 * lcm->udp_low_watermark);
-//            
-//            lcm->udp_rx = 0;
-//            lcm->udp_discarded_bad = 0;
-//            lcm->udp_last_report_secs = tv.tv_sec;
-//            lcm->udp_low_watermark = HUGE;
-//        }
-//    }
-    
     int got_complete_message = 0;
 
     while (!got_complete_message) {
-        // wait for either incoming UDP data, or for an abort message
-        fd_set fds;
-        FD_ZERO (&fds);
-        FD_SET (lcm->recvfd, &fds);
-        FD_SET (lcm->thread_msg_pipe[0], &fds);
-        SOCKET maxfd = MAX(lcm->recvfd, lcm->thread_msg_pipe[0]);
-
-        if (select (maxfd + 1, &fds, NULL, NULL, NULL) <= 0) { 
-            perror ("udp_read_packet -- select:");
-            continue;
-        }
+        // datagrams left from the last batch are processed before waiting
+        // on the socket, or checking for an exit command
+        if (!_recv_pending (lcm)) {
+            // wait for either incoming UDP data, or for an abort message
+            fd_set fds;
+            FD_ZERO (&fds);
+            FD_SET (lcm->recvfd, &fds);
+            FD_SET (lcm->thread_msg_pipe[0], &fds);
+            SOCKET maxfd = MAX(lcm->recvfd, lcm->thread_msg_pipe[0]);
+
+            if (select (maxfd + 1, &fds, NULL, NULL, NULL) <= 0) { 
+                perror ("udp_read_packet -- select:");
+                continue;
+            }
 
-        if (FD_ISSET (lcm->thread_msg_pipe[0], &fds)) {
-            // received an exit command.
-            dbg (DBG_LCM, "read thread received exit command\n");
-            if (lcmb) {
-                // lcmb is not on one of the memory managed buffer queues.  We could
-                // either put it back on one of the queues, or just free it here.  Do the
-                // latter.
-                //
-                // Can also just free its lcm_buf_t here.  Its data buffer is
-                // managed either by the ring buffer or the fragment buffer, so
-                // we can ignore it.
-                free (lcmb);
+            if (FD_ISSET (lcm->thread_msg_pipe[0], &fds)) {
+                // received an exit command.
+                dbg (DBG_LCM, "read thread received exit command\n");
+                if (lcmb) {
+                    // lcmb is not on one of the memory managed buffer queues.  We could
+                    // either put it back on one of the queues, or just free it here.  Do the
+                    // latter.
+                    //
+                    // Can also just free its lcm_buf_t here.  Its data buffer is
+                    // managed either by the ring buffer or the fragment buffer, so
+                    // we can ignore it.
+                    free (lcmb);
+                }
+                return NULL;
             }
-            return NULL;
-        }
 
-        // there is incoming UDP data ready.
-        assert (FD_ISSET (lcm->recvfd, &fds));
+            // there is incoming UDP data ready.
+            assert (FD_ISSET (lcm->recvfd, &fds));
+        }
 
         if (!lcmb) {
             g_static_rec_mutex_lock (&lcm->mutex);
             lcmb = lcm_buf_allocate_data(lcm->inbufs_empty, &lcm->ringbuf);
             g_static_rec_mutex_unlock (&lcm->mutex);
         }
-        struct iovec        vec;
-        vec.iov_base = lcmb->buf;
-        vec.iov_len = 65535;
-
-        struct msghdr msg;
-        memset(&msg, 0, sizeof(struct msghdr));
-        msg.msg_name = &lcmb->from;
-        msg.msg_namelen = sizeof (struct sockaddr);
-        msg.msg_iov = &vec;
-        msg.msg_iovlen = 1;
-#ifdef MSG_EXT_HDR
-        // operating systems that provide SO_TIMESTAMP allow us to obtain more
-        // accurate timestamps by having the kernel produce timestamps as soon
-        // as packets are received.
-        char controlbuf[64];
-        msg.msg_control = controlbuf;
-        msg.msg_controllen = sizeof (controlbuf);
-        msg.msg_flags = 0;
-#endif
-        sz = recvmsg (lcm->recvfd, &msg, 0);
 
-        if (sz < 0) {
-            perror ("udp_read_packet -- recvmsg");
-            lcm->udp_discarded_bad++;
+        sz = _recv_datagram (lcm, lcmb);
+        if (sz < 0)
             continue;
-        }
 
         if (sz < sizeof(lcm2_header_short_t)) { 
             // packet too short to be LCM
@@ -504,31 +1004,14 @@ udp_read_packet (lcm_udpm_t *lcm)
             continue;
         }
 
-        lcmb->fromlen = msg.msg_namelen;
-
-        int got_utime = 0;
-#ifdef SO_TIMESTAMP
-        struct cmsghdr * cmsg = CMSG_FIRSTHDR (&msg);
-        /* Get the receive timestamp out of the packet headers if possible */
-        while (!lcmb->recv_utime && cmsg) {
-            if (cmsg->cmsg_level == SOL_SOCKET &&
-                    cmsg->cmsg_type == SCM_TIMESTAMP) {
-                struct timeval * t = (struct timeval*) CMSG_DATA (cmsg);
-                lcmb->recv_utime = (int64_t) t->tv_sec * 1000000 + t->tv_usec;
-                got_utime = 1;
-                break;
-            }
-            cmsg = CMSG_NXTHDR (&msg, cmsg);
-        }
-#endif
-        if (!got_utime)
-            lcmb->recv_utime = lcm_timestamp_now ();
-
         lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
         uint32_t rcvd_magic = ntohl(hdr2->magic);
-        if (rcvd_magic == LCM2_MAGIC_SHORT)
-            got_complete_message = _recv_short_message (lcm, lcmb, sz);
-        else if (rcvd_magic == LCM2_MAGIC_LONG)
+        if (rcvd_magic == LCM2_MAGIC_SHORT ||
+            rcvd_magic == LCM2_MAGIC_SHORT_TRACED)
+            got_complete_message = _recv_short_message (lcm, lcmb, sz,
+                    rcvd_magic == LCM2_MAGIC_SHORT_TRACED);
+        else if (rcvd_magic == LCM2_MAGIC_LONG ||
+                 rcvd_magic == LCM2_MAGIC_LONG_TRACED)
             got_complete_message = _recv_message_fragment (lcm, lcmb, sz);
         else {
             dbg (DBG_LCM, "LCM: bad magic\n");
@@ -565,6 +1048,7 @@ recv_thread (void * user)
     lcm_udpm_t * lcm = (lcm_udpm_t *) user;
 
     while (1) {
+        _report_loss (lcm);
 
         lcm_buf_t *lcmb = udp_read_packet(lcm);
         if (!lcmb) break;
@@ -600,7 +1084,142 @@ lcm_udpm_get_fileno (lcm_udpm_t *lcm)
 static int
 lcm_udpm_subscribe (lcm_udpm_t *lcm, const char *channel)
 {
-    return _setup_recv_parts (lcm);
+    if (0 != _setup_recv_parts (lcm))
+        return -1;
+    return _join_channel_groups (lcm, channel);
+}
+
+// whether the calling thread has a batch open
+static int
+_in_batch (lcm_udpm_t *lcm)
+{
+    return g_atomic_pointer_get (&lcm->batch_thread) == (gpointer) g_thread_self ();
+}
+
+// sends every datagram the batch queued, as few system calls as sendmmsg
+// takes.  Returns 0 if they were all sent, -1 otherwise.  Only called by the
+// thread that owns the batch.
+static int
+_send_batch (lcm_udpm_t *lcm)
+{
+    int status = 0;
+    unsigned int count = lcm->batch_queued->len;
+    unsigned int sent = 0;
+    while (sent < count) {
+        unsigned int n = MIN (count - sent, LCM_UDPM_SEND_BATCH);
+        struct iovec vecs[LCM_UDPM_SEND_BATCH];
+#ifdef USE_SENDMMSG
+        struct mmsghdr msgs[LCM_UDPM_SEND_BATCH];
+#else
+        struct msghdr msgs[LCM_UDPM_SEND_BATCH];
+#endif
+        for (unsigned int i = 0; i < n; i++) {
+            udpm_queued_t *queued = &g_array_index (lcm->batch_queued,
+                    udpm_queued_t, sent + i);
+            vecs[i].iov_base = (char *) lcm->batch_packets->data + queued->offset;
+            vecs[i].iov_len = queued->size;
+#ifdef USE_SENDMMSG
+            struct msghdr *msg = &msgs[i].msg_hdr;
+            msgs[i].msg_len = 0;
+#else
+            struct msghdr *msg = &msgs[i];
+#endif
+            msg->msg_name = (struct sockaddr*) &queued->dest_addr;
+            msg->msg_namelen = sizeof (queued->dest_addr);
+            msg->msg_iov = &vecs[i];
+            msg->msg_iovlen = 1;
+            msg->msg_control = NULL;
+            msg->msg_controllen = 0;
+            msg->msg_flags = 0;
+        }
+
+#ifdef USE_SENDMMSG
+        int nsent = sendmmsg (lcm->sendfd, msgs, n, 0);
+        if (nsent <= 0) {
+            // the datagram that failed is dropped, like a failed sendmsg
+            // would have dropped it, and the rest still go out
+            perror ("LCM udpm: sendmmsg");
+            status = -1;
+            nsent = 1;
+        }
+        sent += nsent;
+#else
+        for (unsigned int i = 0; i < n; i++) {
+            if (sendmsg (lcm->sendfd, &msgs[i], 0) != (int) vecs[i].iov_len)
+                status = -1;
+        }
+        sent += n;
+#endif
+    }
+    dbg (DBG_LCM_MSG, "transmitted a batch of %u datagrams\n", count);
+
+    g_byte_array_set_size (lcm->batch_packets, 0);
+    g_array_set_size (lcm->batch_queued, 0);
+    return status;
+}
+
+// copies one short message's datagram into the batch, sending the batch
+// first if it's full
+static int
+_queue_datagram (lcm_udpm_t *lcm, const struct sockaddr_in *dest_addr,
+        const struct iovec *parts, int nparts)
+{
+    unsigned int size = 0;
+    for (int i = 0; i < nparts; i++)
+        size += parts[i].iov_len;
+
+    int status = 0;
+    if (lcm->batch_queued->len &&
+            lcm->batch_packets->len + size > LCM_UDPM_BATCH_MAX_BYTES)
+        status = _send_batch (lcm);
+
+    udpm_queued_t queued;
+    queued.offset = lcm->batch_packets->len;
+    queued.size = size;
+    queued.dest_addr = *dest_addr;
+    for (int i = 0; i < nparts; i++)
+        g_byte_array_append (lcm->batch_packets,
+                (const guint8 *) parts[i].iov_base, parts[i].iov_len);
+    g_array_append_val (lcm->batch_queued, queued);
+    return status;
+}
+
+static int
+lcm_udpm_begin_batch (lcm_udpm_t *lcm)
+{
+    int status = 0;
+    g_static_mutex_lock (&lcm->batch_lock);
+    if (!lcm->batch_depth) {
+        if (!lcm->batch_packets) {
+            lcm->batch_packets = g_byte_array_new ();
+            lcm->batch_queued = g_array_new (FALSE, FALSE, sizeof (udpm_queued_t));
+        }
+        g_atomic_pointer_set (&lcm->batch_thread, g_thread_self ());
+        lcm->batch_depth = 1;
+    } else if (_in_batch (lcm)) {
+        lcm->batch_depth++;
+    } else {
+        // another thread's batch is open, publishes from this one go out
+        // as usual
+        status = -1;
+    }
+    g_static_mutex_unlock (&lcm->batch_lock);
+    return status;
+}
+
+static int
+lcm_udpm_end_batch (lcm_udpm_t *lcm)
+{
+    if (!_in_batch (lcm))
+        return -1;
+    if (--lcm->batch_depth)
+        return 0;
+
+    int status = _send_batch (lcm);
+    g_static_mutex_lock (&lcm->batch_lock);
+    g_atomic_pointer_set (&lcm->batch_thread, NULL);
+    g_static_mutex_unlock (&lcm->batch_lock);
+    return status;
 }
 
 static int 
@@ -614,43 +1233,52 @@ lcm_udpm_publish (lcm_udpm_t *lcm, const char *channel, const void *data,
         return -1;
     }
 
-    int payload_size = channel_size + 1 + datalen;
-    if (payload_size <= LCM_SHORT_MESSAGE_MAX_SIZE) {
-        // message is short.  send in a single packet
+    // an empty trace leaves the message as it would be without one
+    lcm2_trace_t trace;
+    int trace_size = lcm->trace_seqnos ? sizeof (trace) : 0;
 
-        g_static_mutex_lock (&lcm->transmit_lock);
+    int payload_size = trace_size + channel_size + 1 + datalen;
+    if (payload_size <= LCM_SHORT_MESSAGE_MAX_SIZE) {
+        // message is short.  send in a single packet.  A datagram is sent
+        // whole, so no lock is needed around it.
+        struct sockaddr_in dest_addr;
+        _prepare_send (lcm, channel, &dest_addr, trace_size ? &trace : NULL);
 
         lcm2_header_short_t hdr;
-        hdr.magic = htonl (LCM2_MAGIC_SHORT);
-        hdr.msg_seqno = htonl(lcm->msg_seqno);
+        hdr.magic = htonl (trace_size ? LCM2_MAGIC_SHORT_TRACED : LCM2_MAGIC_SHORT);
+        hdr.msg_seqno = htonl ((uint32_t)
+                g_atomic_int_exchange_and_add (&lcm->msg_seqno, 1));
 
-        struct iovec sendbufs[3];
+        struct iovec sendbufs[4];
         sendbufs[0].iov_base = (char *) &hdr;
         sendbufs[0].iov_len = sizeof (hdr);
-        sendbufs[1].iov_base = (char *) channel;
-        sendbufs[1].iov_len = channel_size + 1;
-        sendbufs[2].iov_base = (char *) data;
-        sendbufs[2].iov_len = datalen;
+        sendbufs[1].iov_base = (char *) &trace;
+        sendbufs[1].iov_len = trace_size;
+        sendbufs[2].iov_base = (char *) channel;
+        sendbufs[2].iov_len = channel_size + 1;
+        sendbufs[3].iov_base = (char *) data;
+        sendbufs[3].iov_len = datalen;
+
+        // a batch copies it out and sends it later
+        if (_in_batch (lcm))
+            return _queue_datagram (lcm, &dest_addr, sendbufs, 4);
 
         // transmit
-        int packet_size = datalen + sizeof (hdr) + channel_size + 1;
+        int packet_size = datalen + sizeof (hdr) + trace_size + channel_size + 1;
         dbg (DBG_LCM_MSG, "transmitting %d byte [%s] payload (%d byte pkt)\n", 
                 datalen, channel, packet_size);
 
 //        int status = writev (lcm->sendfd, sendbufs, 3);
         struct msghdr msg;
-        msg.msg_name = (struct sockaddr*) &lcm->dest_addr;
-        msg.msg_namelen = sizeof(lcm->dest_addr);
+        msg.msg_name = (struct sockaddr*) &dest_addr;
+        msg.msg_namelen = sizeof(dest_addr);
         msg.msg_iov = sendbufs;
-        msg.msg_iovlen = 3;
+        msg.msg_iovlen = 4;
         msg.msg_control = NULL;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
         int status = sendmsg(lcm->sendfd, &msg, 0);
 
-        lcm->msg_seqno ++;
-        g_static_mutex_unlock (&lcm->transmit_lock);
-
         if (status == packet_size) return 0;
         else return status;
     } else {
@@ -665,9 +1293,17 @@ lcm_udpm_publish (lcm_udpm_t *lcm, const char *channel, const void *data,
             return -1;
         }
 
+        // fragments are sent as they are, after what the batch queued
+        // before them so the order the messages were published in is kept
+        if (_in_batch (lcm) && lcm->batch_queued->len)
+            _send_batch (lcm);
+
+        struct sockaddr_in dest_addr;
+        _prepare_send (lcm, channel, &dest_addr, trace_size ? &trace : NULL);
+
         // acquire transmit lock so that all fragments are transmitted
-        // together, and so that no other message uses the same sequence number
-        // (at least until the sequence # rolls over)
+        // together.  Short messages don't take it, and can go out between
+        // the fragments.
         g_static_mutex_lock (&lcm->transmit_lock);
         dbg (DBG_LCM_MSG, "transmitting %d byte [%s] payload in %d fragments\n",
                 payload_size, channel, nfragments);
@@ -675,36 +1311,42 @@ lcm_udpm_publish (lcm_udpm_t *lcm, const char *channel, const void *data,
         uint32_t fragment_offset = 0;
 
         lcm2_header_long_t hdr;
-        hdr.magic = htonl (LCM2_MAGIC_LONG);
-        hdr.msg_seqno = htonl (lcm->msg_seqno);
+        hdr.magic = htonl (trace_size ? LCM2_MAGIC_LONG_TRACED : LCM2_MAGIC_LONG);
+        hdr.msg_seqno = htonl ((uint32_t)
+                g_atomic_int_exchange_and_add (&lcm->msg_seqno, 1));
         hdr.msg_size = htonl (datalen);
         hdr.fragment_offset = 0;
         hdr.fragment_no = 0;
         hdr.fragments_in_msg = htons (nfragments);
 
-        // first fragment is special.  insert channel before data
-        int firstfrag_datasize = fragment_size - (channel_size + 1);
+        // first fragment is special.  insert the trace and channel before
+        // data
+        int firstfrag_datasize = fragment_size - (trace_size + channel_size + 1);
         assert (firstfrag_datasize <= datalen);
 
-        struct iovec    first_sendbufs[3];
+        struct iovec    first_sendbufs[4];
         first_sendbufs[0].iov_base = (char *) &hdr;
         first_sendbufs[0].iov_len = sizeof (hdr);
-        first_sendbufs[1].iov_base = (char *) channel;
-        first_sendbufs[1].iov_len = channel_size + 1;
-        first_sendbufs[2].iov_base = (char *) data;
-        first_sendbufs[2].iov_len = firstfrag_datasize;
-
-        int packet_size = sizeof (hdr) + channel_size + 1 + firstfrag_datasize;
+        first_sendbufs[1].iov_base = (char *) &trace;
+        first_sendbufs[1].iov_len = trace_size;
+        first_sendbufs[2].iov_base = (char *) channel;
+        first_sendbufs[2].iov_len = channel_size + 1;
+        first_sendbufs[3].iov_base = (char *) data;
+        first_sendbufs[3].iov_len = firstfrag_datasize;
+
+        int packet_size = sizeof (hdr) + trace_size + channel_size + 1 +
+            firstfrag_datasize;
         fragment_offset += firstfrag_datasize;
 //        int status = writev (lcm->sendfd, first_sendbufs, 3);
         struct msghdr msg;
-        msg.msg_name = (struct sockaddr*) &lcm->dest_addr;
-        msg.msg_namelen = sizeof(lcm->dest_addr);
+        msg.msg_name = (struct sockaddr*) &dest_addr;
+        msg.msg_namelen = sizeof(dest_addr);
         msg.msg_iov = first_sendbufs;
-        msg.msg_iovlen = 3;
+        msg.msg_iovlen = 4;
         msg.msg_control = NULL;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
+        _pace_fragment (lcm, packet_size);
         int status = sendmsg(lcm->sendfd, &msg, 0);
 
         // transmit the rest of the fragments
@@ -726,10 +1368,11 @@ lcm_udpm_publish (lcm_udpm_t *lcm, const char *channel, const void *data,
 //            status = writev (lcm->sendfd, sendbufs, 2);
             msg.msg_iov = sendbufs;
             msg.msg_iovlen = 2;
+            packet_size = sizeof (hdr) + fraglen;
+            _pace_fragment (lcm, packet_size);
             status = sendmsg(lcm->sendfd, &msg, 0);
 
             fragment_offset += fraglen;
-            packet_size = sizeof (hdr) + fraglen;
         }
 
         // sanity check
@@ -737,7 +1380,6 @@ lcm_udpm_publish (lcm_udpm_t *lcm, const char *channel, const void *data,
             assert (fragment_offset == datalen);
         }
 
-        lcm->msg_seqno ++;
         g_static_mutex_unlock (&lcm->transmit_lock);
     }
 
@@ -787,6 +1429,8 @@ lcm_udpm_handle (lcm_udpm_t *lcm)
     rbuf.data_size = lcmb->data_size;
     rbuf.recv_utime = lcmb->recv_utime;
     rbuf.lcm = lcm->lcm;
+    rbuf.send_utime = lcmb->send_utime;
+    rbuf.send_seqno = lcmb->send_seqno;
 
     if(lcm->creating_read_thread) {
         // special case:  If we're creating the read thread and are in
@@ -968,13 +1612,13 @@ _setup_recv_parts (lcm_udpm_t *lcm)
     }
 #endif
 
-#ifdef WIN32
-    // Windows has small (8k) buffer by default
-    // Increase it to a default reasonable amount
-    int recv_buf_size = 2048 * 1024;
-    setsockopt(lcm->recvfd, SOL_SOCKET, SO_RCVBUF, 
-            (char*)&recv_buf_size, sizeof(recv_buf_size));
-#endif
+    // The default buffer is small for bursts of large messages (only 8k on
+    // Windows), so ask for a reasonable amount.  Unlike an explicitly
+    // requested size, it isn't a problem if the kernel gives less.
+    int recv_buf_size = LCM_UDPM_DEFAULT_RECV_BUF_SIZE;
+    if (!lcm->params.recv_buf_size)
+        setsockopt(lcm->recvfd, SOL_SOCKET, SO_RCVBUF, 
+                (char*)&recv_buf_size, sizeof(recv_buf_size));
 
     // debugging... how big is the receive buffer?
     unsigned int retsize = sizeof (int);
@@ -982,7 +1626,15 @@ _setup_recv_parts (lcm_udpm_t *lcm)
             (char*)&lcm->kernel_rbuf_sz, (socklen_t *) &retsize);
     dbg (DBG_LCM, "LCM: receive buffer is %d bytes\n", lcm->kernel_rbuf_sz);
     if (lcm->params.recv_buf_size) {
-        if (setsockopt (lcm->recvfd, SOL_SOCKET, SO_RCVBUF,
+        int status = -1;
+#ifdef SO_RCVBUFFORCE
+        // privileged processes can go past net.core.rmem_max
+        status = setsockopt (lcm->recvfd, SOL_SOCKET, SO_RCVBUFFORCE,
+                (char *) &lcm->params.recv_buf_size,
+                sizeof (lcm->params.recv_buf_size));
+#endif
+        if (status < 0 &&
+                setsockopt (lcm->recvfd, SOL_SOCKET, SO_RCVBUF,
                 (char *) &lcm->params.recv_buf_size, 
                 sizeof (lcm->params.recv_buf_size)) < 0) {
             perror ("setsockopt(SOL_SOCKET, SO_RCVBUF)");
@@ -1007,11 +1659,28 @@ _setup_recv_parts (lcm_udpm_t *lcm)
     setsockopt (lcm->recvfd, SOL_SOCKET, SO_TIMESTAMP, &opt, sizeof (opt));
 #endif
 
+    /* Have the kernel count packets it drops for lack of buffer space */
+#ifdef SO_RXQ_OVFL
+    opt = 1;
+    setsockopt (lcm->recvfd, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof (opt));
+#endif
+
     if (bind (lcm->recvfd, (struct sockaddr*)&addr, sizeof (addr)) < 0) {
         perror ("bind");
         goto setup_recv_thread_fail;
     }
 
+#ifdef IP_MULTICAST_ALL
+    // by default linux delivers a group's packets to every socket bound to
+    // the port once any socket on the host joins it.  Only receive the
+    // groups this socket joins, so the kernel drops the ones nobody here
+    // subscribed to.
+    if (lcm->groups) {
+        opt = 0;
+        setsockopt (lcm->recvfd, IPPROTO_IP, IP_MULTICAST_ALL, &opt, sizeof (opt));
+    }
+#endif
+
     struct ip_mreq mreq;
     mreq.imr_multiaddr = lcm->params.mc_addr;
     mreq.imr_interface.s_addr = INADDR_ANY;
@@ -1026,6 +1695,9 @@ _setup_recv_parts (lcm_udpm_t *lcm)
     lcm->inbufs_empty = lcm_buf_queue_new ();
     lcm->inbufs_filled = lcm_buf_queue_new ();
     lcm->ringbuf = lcm_ringbuf_new (LCM_RINGBUF_SIZE);
+#ifdef USE_RECVMMSG
+    _setup_recv_batch (lcm);
+#endif
 
     int i;
     for (i = 0; i < LCM_DEFAULT_RECV_BUFS; i++) {
@@ -1085,6 +1757,7 @@ lcm_udpm_create (lcm_t * parent, const char *network, const GHashTable *args)
 {
     udpm_params_t params;
     memset (&params, 0, sizeof (udpm_params_t));
+    params.mc_loopback = 1;
 
     g_hash_table_foreach ((GHashTable*) args, new_argument, &params);
 
@@ -1096,6 +1769,7 @@ lcm_udpm_create (lcm_t * parent, const char *network, const GHashTable *args)
 
     lcm->lcm = parent;
     lcm->params = params;
+    lcm->params.groups = NULL;
     lcm->recvfd = -1;
     lcm->sendfd = -1;
     lcm->thread_msg_pipe[0] = lcm->thread_msg_pipe[1] = -1;
@@ -1121,6 +1795,15 @@ lcm_udpm_create (lcm_t * parent, const char *network, const GHashTable *args)
 
     g_static_rec_mutex_init (&lcm->mutex);
     g_static_mutex_init (&lcm->transmit_lock);
+    g_static_mutex_init (&lcm->channel_lock);
+    g_static_mutex_init (&lcm->batch_lock);
+    if (params.trace)
+        lcm->trace_seqnos = g_hash_table_new_full (g_str_hash, g_str_equal,
+                free, NULL);
+    if (params.groups && 0 != parse_groups (lcm, params.groups)) {
+        lcm_udpm_destroy (lcm);
+        return NULL;
+    }
 
     dbg (DBG_LCM, "Initializing LCM UDPM context...\n");
     dbg (DBG_LCM, "Multicast %s:%d\n", inet_ntoa(params.mc_addr), ntohs (params.mc_port));
@@ -1181,9 +1864,9 @@ lcm_udpm_create (lcm_t * parent, const char *network, const GHashTable *args)
 
     // set loopback option on the send socket
 #ifdef __sun__
-    unsigned char send_lo_opt = 1;
+    unsigned char send_lo_opt = params.mc_loopback ? 1 : 0;
 #else
-    unsigned int send_lo_opt = 1;
+    unsigned int send_lo_opt = params.mc_loopback ? 1 : 0;
 #endif
     if (setsockopt (lcm->sendfd, IPPROTO_IP, IP_MULTICAST_LOOP, 
                 (char *) &send_lo_opt, sizeof (send_lo_opt)) < 0) {
@@ -1229,6 +1912,8 @@ lcm_udpm_provider_init (GPtrArray * providers)
     udpm_vtable.publish     = lcm_udpm_publish;
     udpm_vtable.handle      = lcm_udpm_handle;
     udpm_vtable.get_fileno  = lcm_udpm_get_fileno;
+    udpm_vtable.begin_batch = lcm_udpm_begin_batch;
+    udpm_vtable.end_batch   = lcm_udpm_end_batch;
 
     udpm_info.name = "udpm";
     udpm_info.vtable = &udpm_vtable;
@@ -23,6 +23,8 @@ lcm_frag_buf_new (struct sockaddr_in from, const char *channel,
     fbuf->data_size = data_size;
     fbuf->fragments_remaining = nfragments;
     fbuf->last_packet_utime = first_packet_utime;
+    fbuf->send_utime = 0;
+    fbuf->send_seqno = 0;
     return fbuf;
 }
 
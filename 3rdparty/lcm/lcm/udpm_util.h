@@ -35,6 +35,8 @@ typedef int SOCKET;
 /************************* Important Defines *******************/
 #define LCM2_MAGIC_SHORT 0x4c433032   // hex repr of ascii "LC02" 
 #define LCM2_MAGIC_LONG  0x4c433033   // hex repr of ascii "LC03" 
+#define LCM2_MAGIC_SHORT_TRACED 0x4c433034   // "LC04", LC02 with a trace
+#define LCM2_MAGIC_LONG_TRACED  0x4c433035   // "LC05", LC03 with a trace
 
 #ifdef __APPLE__
 #define LCM_SHORT_MESSAGE_MAX_SIZE 1435
@@ -83,6 +85,15 @@ typedef struct _lcm2_header_long {
 // ASCII-encoded channel name, followed by the payload data
 // if fragment_no > 0, then header is immediately followed by the payload data
 
+// Traced messages have this between the header and the channel name, in the
+// first fragment if they're fragmented.  The time is split in two so the
+// struct has no padding.
+typedef struct _lcm2_trace {
+    uint32_t send_utime_hi;
+    uint32_t send_utime_lo;
+    uint32_t send_seqno;    // messages published on the channel before
+} lcm2_trace_t;
+
 
 /************************* Utility Functions *******************/
 static inline int
@@ -141,6 +152,8 @@ typedef struct _lcm_buf {
     int   channel_size;      // length of channel name
 
     int64_t recv_utime;      // timestamp of first datagram receipt
+    int64_t send_utime;      // 0 unless the message was traced
+    uint32_t send_seqno;
     char *buf;               // pointer to beginning of message.  This includes
                              // the header for unfragmented messages, and does
                              // not include the header for fragmented messages.
@@ -191,6 +204,8 @@ typedef struct _lcm_frag_buf {
     uint16_t  fragments_remaining;
     uint32_t  msg_seqno;
     int64_t   last_packet_utime;
+    int64_t   send_utime;
+    uint32_t  send_seqno;
 } lcm_frag_buf_t;
 
 lcm_frag_buf_t * lcm_frag_buf_new(struct sockaddr_in from, const char *channel,
@@ -126,6 +126,70 @@ map_type_name(const char *t)
     return dots_to_double_colons (t);
 }
 
+// Size of an encoded primitive type, or 0 if it doesn't have a fixed size
+static int primitive_encoded_size(const char *t)
+{
+    if (!strcmp(t, "int8_t") || !strcmp(t, "boolean") || !strcmp(t, "byte"))
+        return 1;
+    if (!strcmp(t, "int16_t"))
+        return 2;
+    if (!strcmp(t, "int32_t") || !strcmp(t, "float"))
+        return 4;
+    if (!strcmp(t, "int64_t") || !strcmp(t, "double"))
+        return 8;
+    return 0;
+}
+
+// Returns 1 if every member of the struct is a fixed size primitive or a
+// constant size array of one, so every field has the same offset in every
+// encoded message and a View can read it in place.
+static int is_fixed_layout(lcm_struct_t *ls)
+{
+    if (0 == g_ptr_array_size(ls->members))
+        return 0;
+    for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
+        lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, m);
+        if (!primitive_encoded_size(lm->type->lctypename))
+            return 0;
+        if (g_ptr_array_size(lm->dimensions) && !lcm_is_constant_size_array(lm))
+            return 0;
+    }
+    return 1;
+}
+
+// Number of elements in a member, 1 for a scalar
+static int member_num_elements(lcm_member_t *lm)
+{
+    int n = 1;
+    for (unsigned int d = 0; d < g_ptr_array_size(lm->dimensions); d++) {
+        lcm_dimension_t *ld = (lcm_dimension_t *) g_ptr_array_index(lm->dimensions, d);
+        n *= strtol(ld->size, NULL, 0);
+    }
+    return n;
+}
+
+// Size of every encoded message of a fixed layout struct, including the hash
+static int fixed_encoded_size(lcm_struct_t *ls)
+{
+    int size = 8;
+    for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
+        lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, m);
+        size += primitive_encoded_size(lm->type->lctypename) * member_num_elements(lm);
+    }
+    return size;
+}
+
+static int is_cpp11(lcmgen_t *lcmgen)
+{
+    char *cpp_std = getopt_get_string(lcmgen->gopt, "cpp-std");
+    if(strcmp("c++98",cpp_std) && strcmp("c++11",cpp_std)) {
+        printf("%s is not a valid cpp_std. Use --cpp-std=c++98 or --cpp-std=c++11 instead\n\n", cpp_std);
+        fflush(stdout);
+        _exit(1);
+    }
+    return !strcmp(cpp_std, "c++11");
+}
+
 void setup_cpp_options(getopt_t *gopt)
 {
     getopt_add_string (gopt, 0, "cpp-std",    "c++98",      "C++ standard(c++98, c++11)");
@@ -188,6 +252,136 @@ emit_package_namespace_close(lcmgen_t* lcmgen, FILE* f, lcm_struct_t* ls)
     g_strfreev(namespaces);
 }
 
+static void emit_view_declaration(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
+{
+    const char *sn = ls->structname->shortname;
+
+    emit(0, "");
+    emit(1, "public:");
+    emit(2, "/**");
+    emit(2, " * Read only view of an encoded %s, for reading a received message", sn);
+    emit(2, " * without decoding all of it.  Each accessor decodes its field from the");
+    emit(2, " * buffer when it is called, so the view is only valid while the buffer is.");
+    emit(2, " *");
+    emit(2, " * decode() has the same signature as %s::decode(), so a subscription", sn);
+    emit(2, " * whose handler takes a const %s::View* is handed a view of the", sn);
+    emit(2, " * receive buffer instead of a decoded copy.");
+    emit(2, " */");
+    emit(2, "class View");
+    emit(2, "{");
+    emit(3, "public:");
+    emit(4, "View() : _buf(NULL) {}");
+    emit(0, "");
+    emit(4, "/**");
+    emit(4, " * Point this view at an encoded message, checking its fingerprint and");
+    emit(4, " * size without decoding or copying it.");
+    emit(4, " *");
+    emit(4, " * @return The size of the encoded message, or <0 if @p buf doesn't hold one.");
+    emit(4, " */");
+    emit(4, "inline int decode(const void *buf, int offset, int maxlen);");
+    emit(0, "");
+    emit(4, "inline static int getEncodedSize();");
+    emit(4, "inline static int64_t getHash();");
+    emit(4, "inline static const char* getTypeName();");
+    emit(0, "");
+    emit(4, "/**");
+    emit(4, " * Decodes every field into @p msg.");
+    emit(4, " */");
+    emit(4, "inline void get(%s *msg) const;", sn);
+
+    for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
+        lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, m);
+        char *mapped_typename = map_type_name(lm->type->lctypename);
+        int ndim = g_ptr_array_size(lm->dimensions);
+
+        emit(0, "");
+        emit_comment(f, 4, lm->comment);
+        emit_start(4, "inline %s %s(", mapped_typename, lm->membername);
+        for (int d = 0; d < ndim; d++)
+            emit_continue("%sint a%d", d ? ", " : "", d);
+        emit_end(") const;");
+        free(mapped_typename);
+    }
+
+    emit(0, "");
+    emit(3, "private:");
+    emit(4, "const uint8_t *_buf;");
+    emit(2, "};");
+}
+
+static void emit_view(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
+{
+    const char *sn = ls->structname->shortname;
+    int size = fixed_encoded_size(ls);
+
+    emit(0, "int %s::View::decode(const void *buf, int offset, int maxlen)", sn);
+    emit(0, "{");
+    emit(1,     "int64_t msg_hash;");
+    emit(1,     "int thislen = __int64_t_decode_array(buf, offset, maxlen, &msg_hash, 1);");
+    emit(1,     "if (thislen < 0) return thislen;");
+    emit(1,     "if (msg_hash != getHash()) return -1;");
+    emit(1,     "if (maxlen < getEncodedSize()) return -1;");
+    emit(0, "");
+    emit(1,     "_buf = (const uint8_t*) buf + offset;");
+    emit(1,     "return getEncodedSize();");
+    emit(0, "}");
+    emit(0, "");
+    emit(0, "int %s::View::getEncodedSize()", sn);
+    emit(0, "{");
+    emit(1,     "return %d;", size);
+    emit(0, "}");
+    emit(0, "");
+    emit(0, "int64_t %s::View::getHash()", sn);
+    emit(0, "{");
+    emit(1,     "return %s::getHash();", sn);
+    emit(0, "}");
+    emit(0, "");
+    emit(0, "const char* %s::View::getTypeName()", sn);
+    emit(0, "{");
+    emit(1,     "return %s::getTypeName();", sn);
+    emit(0, "}");
+    emit(0, "");
+    emit(0, "void %s::View::get(%s *msg) const", sn, sn);
+    emit(0, "{");
+    emit(1,     "msg->_decodeNoHash(_buf, 8, getEncodedSize() - 8);");
+    emit(0, "}");
+    emit(0, "");
+
+    int offset = 8;
+    for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
+        lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, m);
+        char *mapped_typename = map_type_name(lm->type->lctypename);
+        int elem_size = primitive_encoded_size(lm->type->lctypename);
+        int ndim = g_ptr_array_size(lm->dimensions);
+
+        emit_start(0, "%s %s::View::%s(", mapped_typename, sn, lm->membername);
+        for (int d = 0; d < ndim; d++)
+            emit_continue("%sint a%d", d ? ", " : "", d);
+        emit_end(") const");
+        emit(0, "{");
+        emit(1,     "%s v;", mapped_typename);
+        if (ndim == 0) {
+            emit(1, "__%s_decode_array(_buf, %d, %d, &v, 1);",
+                    lm->type->lctypename, offset, elem_size);
+        } else {
+            // row major index of the element, like the encoded array
+            emit(1, "int index = a0;");
+            for (int d = 1; d < ndim; d++) {
+                lcm_dimension_t *ld = (lcm_dimension_t *) g_ptr_array_index(lm->dimensions, d);
+                emit(1, "index = index * %s + a%d;", ld->size, d);
+            }
+            emit(1, "__%s_decode_array(_buf, %d + index * %d, %d, &v, 1);",
+                    lm->type->lctypename, offset, elem_size, elem_size);
+        }
+        emit(1,     "return v;");
+        emit(0, "}");
+        emit(0, "");
+
+        offset += elem_size * member_num_elements(lm);
+        free(mapped_typename);
+    }
+}
+
 /** Emit header file **/
 static void emit_header_start(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
 {
@@ -220,6 +414,9 @@ static void emit_header_start(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
         }
     }
 
+    if (is_fixed_layout(ls) && is_cpp11(lcmgen))
+        emit(0, "#include <array>");
+
     // include header files for other LCM types
     for (unsigned int mind = 0; mind < g_ptr_array_size(ls->members); mind++) {
         lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, mind);
@@ -299,14 +496,7 @@ static void emit_header_start(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
               if (!strcmp(lc->lctypename, "int64_t"))
                 suffix = "LL";
               char* mapped_typename = map_type_name(lc->lctypename);
-              char *cpp_std = getopt_get_string(lcmgen->gopt, "cpp-std");
-              if(strcmp("c++98",cpp_std) && strcmp("c++11",cpp_std)) {
-                  printf("%s is not a valid cpp_std. Use --cpp-std=c++98 or --cpp-std=c++11 instead\n\n", cpp_std);
-                  fflush(stdout);
-                  _exit(1);
-              }
-
-              if(!strcmp (cpp_std, "c++11")) {
+              if(is_cpp11(lcmgen)) {
                 emit(2, "static constexpr %-8s %s = %s%s;", mapped_typename,
                   lc->membername, lc->val_str, suffix);
               } else {
@@ -335,6 +525,21 @@ static void emit_header_start(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
     emit(2, " */");
     emit(2, "inline int encode(void *buf, int offset, int maxlen) const;");
     emit(0, "");
+    if (is_fixed_layout(ls) && is_cpp11(lcmgen)) {
+        emit(2, "/**");
+        emit(2, " * Size of every encoded %s, which has no variable length fields.", ls->structname->shortname);
+        emit(2, " */");
+        emit(2, "static constexpr int ENCODED_SIZE = %d;", fixed_encoded_size(ls));
+        emit(0, "");
+        emit(2, "/**");
+        emit(2, " * Encode a message into a buffer of exactly its size, which needs no");
+        emit(2, " * allocation and no length checks at run time.");
+        emit(2, " *");
+        emit(2, " * @return The number of bytes encoded, ENCODED_SIZE.");
+        emit(2, " */");
+        emit(2, "inline int encode(std::array<uint8_t, ENCODED_SIZE> &buf) const;");
+        emit(0, "");
+    }
     emit(2, "/**");
     emit(2, " * Check how many bytes are required to encode this message.");
     emit(2, " */");
@@ -369,6 +574,10 @@ static void emit_header_start(lcmgen_t *lcmgen, FILE *f, lcm_struct_t *ls)
     emit(2, "inline int _getEncodedSizeNoHash() const;");
     emit(2, "inline int _decodeNoHash(const void *buf, int offset, int maxlen);");
     emit(2, "inline static uint64_t _computeHash(const __lcm_hash_ptr *p);");
+
+    if (is_fixed_layout(ls))
+        emit_view_declaration(lcmgen, f, ls);
+
     emit(0, "};");
     emit(0, "");
 
@@ -392,6 +601,14 @@ static void emit_encode(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
     emit(1,     "return pos;");
     emit(0, "}");
     emit(0, "");
+
+    if (is_fixed_layout(ls) && is_cpp11(lcm)) {
+        emit(0, "int %s::encode(std::array<uint8_t, ENCODED_SIZE> &buf) const", sn);
+        emit(0, "{");
+        emit(1,     "return encode(buf.data(), 0, ENCODED_SIZE);");
+        emit(0, "}");
+        emit(0, "");
+    }
 }
 
 static void emit_encoded_size(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
@@ -399,11 +616,36 @@ static void emit_encoded_size(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
     const char *sn = ls->structname->shortname;
     emit(0,"int %s::getEncodedSize() const", sn);
     emit(0,"{");
-    emit(1, "return 8 + _getEncodedSizeNoHash();");
+    if (is_fixed_layout(ls))
+        emit(1, "return %d;", fixed_encoded_size(ls));
+    else
+        emit(1, "return 8 + _getEncodedSizeNoHash();");
     emit(0,"}");
     emit(0,"");
 }
 
+// Encodes or decodes each member of a fixed layout struct at its constant
+// offset, after checking the buffer once, so the compiler can fold the
+// length checks of the primitive functions away.
+static void emit_fixed_layout_coding(FILE *f, lcm_struct_t *ls, const char *op)
+{
+    int size = fixed_encoded_size(ls) - 8;
+    emit(1, "if (maxlen < %d) return -1;", size);
+    int offset = 0;
+    for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
+        lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, m);
+        int n = member_num_elements(lm);
+        int len = primitive_encoded_size(lm->type->lctypename) * n;
+        emit_start(1, "__%s_%s_array(buf, offset + %d, %d, &this->%s",
+                lm->type->lctypename, op, offset, len, lm->membername);
+        for (unsigned int d = 0; d < g_ptr_array_size(lm->dimensions); d++)
+            emit_continue("[0]");
+        emit_end(", %d);", n);
+        offset += len;
+    }
+    emit(1, "return %d;", size);
+}
+
 static void emit_decode(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
 {
     const char* sn = ls->structname->shortname;
@@ -538,6 +780,12 @@ static void emit_encode_nohash(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
     }
     emit(0, "int %s::_encodeNoHash(void *buf, int offset, int maxlen) const", sn);
     emit(0, "{");
+    if (is_fixed_layout(ls)) {
+        emit_fixed_layout_coding(f, ls, "encode");
+        emit(0,"}");
+        emit(0,"");
+        return;
+    }
     emit(1,     "int pos = 0, tlen;");
     emit(0, "");
     for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
@@ -593,6 +841,12 @@ static void emit_encoded_size_nohash(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
         emit(0,"");
         return;
     }
+    if (is_fixed_layout(ls)) {
+        emit(1, "return %d;", fixed_encoded_size(ls) - 8);
+        emit(0,"}");
+        emit(0,"");
+        return;
+    }
     emit(1,     "int enc_size = 0;");
     for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
         lcm_member_t *lm = (lcm_member_t *) g_ptr_array_index(ls->members, m);
@@ -713,6 +967,12 @@ static void emit_decode_nohash(lcmgen_t *lcm, FILE *f, lcm_struct_t *ls)
     }
     emit(0, "int %s::_decodeNoHash(const void *buf, int offset, int maxlen)", sn);
     emit(0, "{");
+    if (is_fixed_layout(ls)) {
+        emit_fixed_layout_coding(f, ls, "decode");
+        emit(0, "}");
+        emit(0, "");
+        return;
+    }
     emit(1,     "int pos = 0, tlen;");
     emit(0, "");
     for (unsigned int m = 0; m < g_ptr_array_size(ls->members); m++) {
@@ -779,6 +1039,8 @@ int emit_cpp(lcmgen_t *lcmgen)
             emit_decode_nohash(lcmgen, f, lr);
             emit_encoded_size_nohash(lcmgen, f, lr);
             emit_compute_hash(lcmgen, f, lr);
+            if (is_fixed_layout(lr))
+                emit_view(lcmgen, f, lr);
 
             emit_package_namespace_close(lcmgen, f, lr);
             emit(0, "#endif");
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm_coretypes.h>
+
+// Lengths around the 16 byte blocks the arrays are converted in, so both
+// the vector loop and the element by element tail get covered.
+static const int kLengths[] = { 0, 1, 2, 3, 4, 7, 8, 9, 15, 16, 17, 31, 32, 33, 100 };
+
+// Big endian bytes of v, the way the wire format is defined.
+template <typename T>
+static void BigEndianBytes(T v, uint8_t* out) {
+    uint64_t u = 0;
+    memcpy(&u, &v, sizeof(T));
+    for (size_t byte = 0; byte < sizeof(T); ++byte) {
+        out[byte] = (u >> (8 * (sizeof(T) - 1 - byte))) & 0xff;
+    }
+}
+
+template <typename T>
+static void FillRandom(std::vector<T>& values) {
+    for (size_t i = 0; i < values.size(); ++i) {
+        uint64_t u = ((uint64_t) rand() << 40) ^ ((uint64_t) rand() << 20) ^ rand();
+        memcpy(&values[i], &u, sizeof(T));
+    }
+}
+
+// Encodes values at an odd offset into a buffer, so the encoded bytes
+// aren't aligned, and checks every byte and the decoded values.
+template <typename T, typename Encode, typename Decode>
+static void CheckArrays(Encode encode, Decode decode) {
+    for (int length : kLengths) {
+        std::vector<T> values(length);
+        FillRandom(values);
+
+        const int offset = 3;
+        const int size = length * sizeof(T);
+        std::vector<uint8_t> buf(offset + size + 1, 0xab);
+        EXPECT_EQ(size, encode(&buf[0], offset, size, values.data(), length));
+
+        std::vector<uint8_t> expected(sizeof(T));
+        for (int i = 0; i < length; ++i) {
+            BigEndianBytes(values[i], &expected[0]);
+            EXPECT_EQ(0, memcmp(&expected[0], &buf[offset + i * sizeof(T)], sizeof(T)))
+                << "element " << i << " of " << length;
+        }
+        // Nothing past the array is written.
+        EXPECT_EQ(0xab, buf[offset + size]);
+
+        std::vector<T> decoded(length + 1);
+        EXPECT_EQ(size, decode(&buf[0], offset, size, decoded.data(), length));
+        EXPECT_EQ(0, memcmp(values.data(), decoded.data(), size)) << "length " << length;
+
+        if (length > 0) {
+            EXPECT_EQ(-1, encode(&buf[0], offset, size - 1, values.data(), length));
+            EXPECT_EQ(-1, decode(&buf[0], offset, size - 1, decoded.data(), length));
+        }
+    }
+}
+
+TEST(LCM_C, CoretypesInt16Arrays) {
+    CheckArrays<int16_t>(__int16_t_encode_array, __int16_t_decode_array);
+}
+
+TEST(LCM_C, CoretypesInt32Arrays) {
+    CheckArrays<int32_t>(__int32_t_encode_array, __int32_t_decode_array);
+}
+
+TEST(LCM_C, CoretypesInt64Arrays) {
+    CheckArrays<int64_t>(__int64_t_encode_array, __int64_t_decode_array);
+}
+
+TEST(LCM_C, CoretypesFloatArrays) {
+    CheckArrays<float>(__float_encode_array, __float_decode_array);
+}
+
+TEST(LCM_C, CoretypesDoubleArrays) {
+    CheckArrays<double>(__double_encode_array, __double_decode_array);
+}
+
+TEST(LCM_C, CoretypesKnownBytes) {
+    // A fixed value, so a round trip through a wrong byte order can't pass.
+    const int32_t value = 0x01020304;
+    uint8_t buf[4];
+    EXPECT_EQ(4, __int32_t_encode_array(buf, 0, 4, &value, 1));
+    EXPECT_EQ(1, buf[0]);
+    EXPECT_EQ(2, buf[1]);
+    EXPECT_EQ(3, buf[2]);
+    EXPECT_EQ(4, buf[3]);
+}
@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 #include <lcm/lcm.h>
@@ -128,3 +130,245 @@ TEST(LCM_C, EventLogCorrupt) {
     lcm_eventlog_destroy(rlog);
     free_tmpnam(fname);
 }
+
+static int64_t ReadIndex64(const unsigned char* p) {
+    int64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int32_t ReadIndex32(const unsigned char* p) {
+    return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                     ((uint32_t)p[2] << 8) | p[3]);
+}
+
+TEST(LCM_C, EventLogWriter) {
+    // Events written through the writer read back like any log, and the
+    // index points at each of them.  A tiny segment size makes events span
+    // segments.
+    char* fname = make_tmpnam();
+
+    lcm_eventlog_writer_t* writer = lcm_eventlog_writer_create(fname, 1);
+    ASSERT_NE((void*)NULL, writer);
+
+    const char* channels[] = { "CHANNEL_A", "CHANNEL_B" };
+    const int num_events = 200;
+    char data[3000];
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        int datalen = (event_num * 37) % (int)sizeof(data);
+        memset(data, event_num & 0xff, datalen);
+        EXPECT_EQ(0, lcm_eventlog_writer_write(writer, 1000 + event_num,
+                    channels[event_num % 2], data, datalen));
+    }
+    lcm_eventlog_writer_destroy(writer);
+
+    std::string index_name = std::string(fname) + LCM_EVENTLOG_INDEX_SUFFIX;
+    FILE* index_f = fopen(index_name.c_str(), "rb");
+    ASSERT_NE((void*)NULL, index_f);
+    unsigned char header[LCM_EVENTLOG_INDEX_HEADER_SIZE];
+    ASSERT_EQ(sizeof(header), fread(header, 1, sizeof(header), index_f));
+    EXPECT_EQ(LCM_EVENTLOG_INDEX_MAGIC, ReadIndex32(header));
+    EXPECT_EQ(LCM_EVENTLOG_INDEX_VERSION, ReadIndex32(header + 4));
+
+    lcm_eventlog_t* rlog = lcm_eventlog_create(fname, "r");
+    ASSERT_NE((void*)NULL, rlog);
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        unsigned char entry[LCM_EVENTLOG_INDEX_ENTRY_SIZE];
+        ASSERT_EQ(sizeof(entry), fread(entry, 1, sizeof(entry), index_f));
+        int64_t offset = ReadIndex64(entry);
+        EXPECT_EQ(1000 + event_num, ReadIndex64(entry + 8));
+        EXPECT_EQ(event_num % 2, ReadIndex32(entry + 16));
+        EXPECT_EQ(offset, ftello(rlog->f));
+
+        lcm_eventlog_event_t* revent = lcm_eventlog_read_next_event(rlog);
+        ASSERT_NE((void*)NULL, revent);
+        EXPECT_EQ(event_num, revent->eventnum);
+        EXPECT_EQ(1000 + event_num, revent->timestamp);
+        EXPECT_STREQ(channels[event_num % 2], revent->channel);
+        EXPECT_EQ((event_num * 37) % (int)sizeof(data), revent->datalen);
+        EXPECT_EQ(ftello(rlog->f) - offset, ReadIndex32(entry + 20));
+        bool bytes_match = true;
+        for (int i = 0; i < revent->datalen; ++i) {
+            bytes_match &= ((const unsigned char*)revent->data)[i] == (event_num & 0xff);
+        }
+        EXPECT_TRUE(bytes_match);
+        lcm_eventlog_free_event(revent);
+    }
+    EXPECT_EQ((void*)NULL, lcm_eventlog_read_next_event(rlog));
+
+    unsigned char extra;
+    EXPECT_EQ(0, fread(&extra, 1, 1, index_f));
+    fclose(index_f);
+    lcm_eventlog_destroy(rlog);
+    remove(index_name.c_str());
+    free_tmpnam(fname);
+}
+
+static void CountEvents(const char* fname, int* count) {
+    *count = 0;
+    lcm_eventlog_t* rlog = lcm_eventlog_create(fname, "r");
+    ASSERT_NE((void*)NULL, rlog);
+    lcm_eventlog_event_t* revent;
+    while ((revent = lcm_eventlog_read_next_event(rlog)) != NULL) {
+        EXPECT_STREQ("LOGGED", revent->channel);
+        ++*count;
+        lcm_eventlog_free_event(revent);
+    }
+    lcm_eventlog_destroy(rlog);
+}
+
+TEST(LCM_C, LogStart) {
+    // An instance logs what it receives on the matching channels.
+    char* fname = make_tmpnam();
+    lcm_t* lcm = lcm_create("memq://");
+    ASSERT_NE((void*)NULL, lcm);
+
+    ASSERT_NE((void*)NULL, lcm_log_start(lcm, fname, "LOGGED"));
+    EXPECT_EQ((void*)NULL, lcm_log_start(lcm, fname, NULL));
+
+    int value = 5;
+    for (int i = 0; i < 10; ++i) {
+        lcm_publish(lcm, "LOGGED", &value, sizeof(value));
+        lcm_publish(lcm, "NOT_LOGGED", &value, sizeof(value));
+    }
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(0, lcm_handle(lcm));
+    }
+    EXPECT_EQ(0, lcm_log_stop(lcm));
+    EXPECT_EQ(-1, lcm_log_stop(lcm));
+
+    int count;
+    CountEvents(fname, &count);
+    EXPECT_EQ(10, count);
+
+    lcm_destroy(lcm);
+    remove((std::string(fname) + LCM_EVENTLOG_INDEX_SUFFIX).c_str());
+    free_tmpnam(fname);
+}
+
+TEST(LCM_C, EventLogIndex) {
+    // An index built for a log finds each of its events again.
+    char* fname = make_tmpnam();
+    const char* channels[] = { "CHANNEL_A", "CHANNEL_B", "CHANNEL_C" };
+    const int num_events = 100;
+
+    lcm_eventlog_t* wlog = lcm_eventlog_create(fname, "w");
+    ASSERT_NE((void*)NULL, wlog);
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        lcm_eventlog_event_t event;
+        event.eventnum = event_num;
+        event.timestamp = 1000 + 10 * event_num;
+        event.channel = (char*)channels[(event_num / 3) % 3];
+        event.channellen = strlen(event.channel);
+        event.data = &event_num;
+        event.datalen = sizeof(event_num);
+        ASSERT_EQ(0, lcm_eventlog_write_event(wlog, &event));
+    }
+    lcm_eventlog_destroy(wlog);
+
+    std::string index_name = std::string(fname) + LCM_EVENTLOG_INDEX_SUFFIX;
+    EXPECT_EQ((void*)NULL, lcm_eventlog_index_open(fname));
+    lcm_eventlog_index_t* index = lcm_eventlog_index_build(fname);
+    ASSERT_NE((void*)NULL, index);
+    ASSERT_EQ(num_events, lcm_eventlog_index_size(index));
+
+    lcm_eventlog_t* rlog = lcm_eventlog_create(fname, "r");
+    ASSERT_NE((void*)NULL, rlog);
+    for (int event_num = num_events - 1; event_num >= 0; event_num -= 7) {
+        EXPECT_EQ(1000 + 10 * event_num, lcm_eventlog_index_timestamp(index, event_num));
+        EXPECT_STREQ(channels[(event_num / 3) % 3], lcm_eventlog_index_channel(index, event_num));
+
+        fseeko(rlog->f, lcm_eventlog_index_offset(index, event_num), SEEK_SET);
+        lcm_eventlog_event_t* revent = lcm_eventlog_read_next_event(rlog);
+        ASSERT_NE((void*)NULL, revent);
+        EXPECT_EQ(event_num, *(int*)revent->data);
+        lcm_eventlog_free_event(revent);
+    }
+    lcm_eventlog_destroy(rlog);
+
+    EXPECT_EQ(0, lcm_eventlog_index_find_timestamp(index, 0));
+    EXPECT_EQ(50, lcm_eventlog_index_find_timestamp(index, 1500));
+    EXPECT_EQ(51, lcm_eventlog_index_find_timestamp(index, 1501));
+    EXPECT_EQ(num_events, lcm_eventlog_index_find_timestamp(index, 1000000));
+    lcm_eventlog_index_destroy(index);
+
+    // Opening it again doesn't need the log to be read through
+    index = lcm_eventlog_index_open(fname);
+    ASSERT_NE((void*)NULL, index);
+    EXPECT_EQ(num_events, lcm_eventlog_index_size(index));
+    EXPECT_STREQ(channels[((num_events - 1) / 3) % 3], lcm_eventlog_index_channel(index, num_events - 1));
+    lcm_eventlog_index_destroy(index);
+
+    remove(index_name.c_str());
+    free_tmpnam(fname);
+}
+
+struct PlaybackCount {
+    int count;
+    int64_t first;
+};
+
+static void PlaybackHandler(const lcm_recv_buf_t* rbuf, const char* channel, void* user) {
+    PlaybackCount* counts = (PlaybackCount*)user;
+    if (counts->count++ == 0) {
+        counts->first = *(const int64_t*)rbuf->data;
+    }
+}
+
+static void PlayLog(const char* fname, const char* options, PlaybackCount* counts) {
+    std::string url = std::string("file://") + fname + "?speed=0&" + options;
+    lcm_t* lcm = lcm_create(url.c_str());
+    ASSERT_NE((void*)NULL, lcm);
+    counts->count = 0;
+    counts->first = -1;
+    lcm_subscribe(lcm, "WANTED", PlaybackHandler, counts);
+    while (lcm_handle(lcm) == 0) {
+    }
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, FilePlaybackIndex) {
+    // Playback through the index skips to start_timestamp and past the
+    // channels nothing is subscribed to, and delivers the same events as
+    // playback without it.
+    char* fname = make_tmpnam();
+    lcm_eventlog_writer_t* writer = lcm_eventlog_writer_create(fname, 0);
+    ASSERT_NE((void*)NULL, writer);
+    const int num_events = 300;
+    for (int64_t event_num = 0; event_num < num_events; ++event_num) {
+        EXPECT_EQ(0, lcm_eventlog_writer_write(writer, 1000 + event_num,
+                    event_num % 3 ? "UNWANTED" : "WANTED", &event_num, sizeof(event_num)));
+    }
+    lcm_eventlog_writer_destroy(writer);
+
+    PlaybackCount indexed, unindexed;
+    PlayLog(fname, "start_timestamp=1150", &indexed);
+    PlayLog(fname, "start_timestamp=1150&index=off", &unindexed);
+    EXPECT_EQ(50, indexed.count);
+    EXPECT_EQ(150, indexed.first);
+    EXPECT_EQ(indexed.count, unindexed.count);
+    EXPECT_EQ(indexed.first, unindexed.first);
+
+    // Past the end of an index that lags behind its log, the log is read
+    // through without it
+    std::string index_name = std::string(fname) + LCM_EVENTLOG_INDEX_SUFFIX;
+    ASSERT_EQ(0, truncate(index_name.c_str(), LCM_EVENTLOG_INDEX_HEADER_SIZE +
+                100 * LCM_EVENTLOG_INDEX_ENTRY_SIZE));
+    PlayLog(fname, "", &indexed);
+    EXPECT_EQ(100, indexed.count);
+
+    // A log without an index gets one
+    remove(index_name.c_str());
+    PlayLog(fname, "index=build", &indexed);
+    EXPECT_EQ(100, indexed.count);
+    EXPECT_EQ(0, indexed.first);
+    lcm_eventlog_index_t* index = lcm_eventlog_index_open(fname);
+    ASSERT_NE((void*)NULL, index);
+    EXPECT_EQ(num_events, lcm_eventlog_index_size(index));
+    lcm_eventlog_index_destroy(index);
+
+    remove(index_name.c_str());
+    free_tmpnam(fname);
+}
@@ -113,3 +113,91 @@ TEST(LCM_C, MemqTimeout) {
 
   lcm_destroy(lcm);
 }
+
+TEST(LCM_C, MemqLatestOnly) {
+    // Publish many messages on two channels, then check that a latest only
+    // subscription only handles the newest one of each.
+    lcm_t* lcm = lcm_create("memq://");
+    std::vector<std::vector<uint8_t> > received_buffers;
+
+    lcm_subscription_t* subs = lcm_subscribe(lcm, "channel.*",
+            MemqBufferedHandler, &received_buffers);
+    lcm_subscription_set_latest_only(subs, 1);
+
+    const char* channels[] = { "channel_a", "channel_b" };
+    int num_bufs = 50;
+    std::vector<std::vector<uint8_t> > buffers(num_bufs);
+    for (int buf_num = 0; buf_num < num_bufs; ++buf_num) {
+        std::vector<uint8_t>& buf = buffers[buf_num];
+        buf.resize(100);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        lcm_publish(lcm, channels[buf_num % 2], &buf[0], buf.size());
+    }
+
+    for (int buf_num = 0; buf_num < num_bufs; ++buf_num) {
+        lcm_handle(lcm);
+    }
+
+    ASSERT_EQ(2, received_buffers.size());
+    EXPECT_EQ(buffers[num_bufs - 2], received_buffers[0]);
+    EXPECT_EQ(buffers[num_bufs - 1], received_buffers[1]);
+
+    // Once caught up, every new message is handled.
+    lcm_publish(lcm, channels[0], &buffers[0][0], buffers[0].size());
+    lcm_handle(lcm);
+    ASSERT_EQ(3, received_buffers.size());
+    EXPECT_EQ(buffers[0], received_buffers[2]);
+
+    lcm_destroy(lcm);
+}
+
+void MemqCountHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    (*(int*)user_data)++;
+}
+
+TEST(LCM_C, MemqLiteralChannels) {
+    // Mix subscriptions to plain channel names, which are matched without a
+    // regex, with a regex subscription, and check each gets what it matches.
+    lcm_t* lcm = lcm_create("memq://");
+    uint8_t byte = 0;
+    int literal = 0, pattern = 0, second = 0, other = 0;
+
+    lcm_subscription_t* literal_subs = lcm_subscribe(lcm, "chan",
+            MemqCountHandler, &literal);
+    lcm_publish(lcm, "chan", &byte, 1);
+    lcm_handle(lcm);
+    EXPECT_EQ(1, literal);
+
+    lcm_subscription_t* pattern_subs = lcm_subscribe(lcm, "chan.*",
+            MemqCountHandler, &pattern);
+    lcm_subscribe(lcm, "chan", MemqCountHandler, &second);
+    lcm_publish(lcm, "chan", &byte, 1);
+    lcm_handle(lcm);
+    EXPECT_EQ(2, literal);
+    EXPECT_EQ(1, pattern);
+    EXPECT_EQ(1, second);
+
+    lcm_unsubscribe(lcm, literal_subs);
+    lcm_publish(lcm, "chan", &byte, 1);
+    lcm_handle(lcm);
+    lcm_publish(lcm, "chan_x", &byte, 1);
+    lcm_handle(lcm);
+    EXPECT_EQ(2, literal);
+    EXPECT_EQ(3, pattern);
+    EXPECT_EQ(2, second);
+
+    lcm_unsubscribe(lcm, pattern_subs);
+    lcm_subscribe(lcm, "chan_y", MemqCountHandler, &other);
+    lcm_publish(lcm, "chan_y", &byte, 1);
+    lcm_handle(lcm);
+    lcm_publish(lcm, "chan", &byte, 1);
+    lcm_handle(lcm);
+    EXPECT_EQ(3, pattern);
+    EXPECT_EQ(3, second);
+    EXPECT_EQ(1, other);
+
+    lcm_destroy(lcm);
+}
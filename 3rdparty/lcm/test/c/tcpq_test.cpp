@@ -0,0 +1,217 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+
+#define MAGIC_SERVER 0x287617fa
+#define MAGIC_CLIENT 0x287617fb
+#define MESSAGE_TYPE_PUBLISH 1
+
+// Just enough of an LCM TCP server to accept one client and read what it
+// publishes.
+struct TestServer {
+    int listen_fd;
+    int fd;
+    int port;
+};
+
+static int RecvFully(int fd, void* b, int len) {
+    int cnt = 0;
+    while (cnt < len) {
+        int n = recv(fd, (char*)b + cnt, len - cnt, 0);
+        if (n <= 0)
+            return -1;
+        cnt += n;
+    }
+    return cnt;
+}
+
+static int RecvUint32(int fd, uint32_t* v) {
+    if (RecvFully(fd, v, 4) != 4)
+        return -1;
+    *v = ntohl(*v);
+    return 0;
+}
+
+static void SendUint32(int fd, uint32_t v) {
+    v = htonl(v);
+    ASSERT_EQ(4, send(fd, &v, 4, 0));
+}
+
+static void StartServer(TestServer* server) {
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, bind(server->listen_fd, (struct sockaddr*)&sa, sizeof(sa)));
+    ASSERT_EQ(0, listen(server->listen_fd, 1));
+    socklen_t len = sizeof(sa);
+    getsockname(server->listen_fd, (struct sockaddr*)&sa, &len);
+    server->port = ntohs(sa.sin_port);
+    server->fd = -1;
+}
+
+// The client connects when it's created, so the handshake is answered once
+// it has, from the test's thread.
+static void AcceptClient(TestServer* server) {
+    server->fd = accept(server->listen_fd, NULL, NULL);
+    ASSERT_GE(server->fd, 0);
+    uint32_t magic, version;
+    ASSERT_EQ(0, RecvUint32(server->fd, &magic));
+    ASSERT_EQ(0, RecvUint32(server->fd, &version));
+    EXPECT_EQ(MAGIC_CLIENT, magic);
+    SendUint32(server->fd, MAGIC_SERVER);
+    SendUint32(server->fd, version);
+}
+
+static void StopServer(TestServer* server) {
+    close(server->fd);
+    close(server->listen_fd);
+}
+
+struct Published {
+    std::string channel;
+    std::vector<uint8_t> data;
+};
+
+static bool ReadPublished(TestServer* server, Published* msg) {
+    uint32_t type, channel_len, data_len;
+    if (RecvUint32(server->fd, &type) || RecvUint32(server->fd, &channel_len))
+        return false;
+    EXPECT_EQ(MESSAGE_TYPE_PUBLISH, type);
+    msg->channel.resize(channel_len);
+    if (RecvFully(server->fd, &msg->channel[0], channel_len) != (int)channel_len ||
+            RecvUint32(server->fd, &data_len))
+        return false;
+    msg->data.resize(data_len);
+    return data_len == 0 ||
+        RecvFully(server->fd, &msg->data[0], data_len) == (int)data_len;
+}
+
+struct ConnectArgs {
+    std::string url;
+    lcm_t* lcm;
+};
+
+static void* ConnectThread(void* user_data) {
+    ConnectArgs* args = (ConnectArgs*)user_data;
+    args->lcm = lcm_create(args->url.c_str());
+    return NULL;
+}
+
+static lcm_t* Connect(TestServer* server, const std::string& options) {
+    ConnectArgs args;
+    char url[64];
+    snprintf(url, sizeof(url), "tcpq://127.0.0.1:%d", server->port);
+    args.url = url + options;
+    pthread_t thread;
+    pthread_create(&thread, NULL, ConnectThread, &args);
+    AcceptClient(server);
+    pthread_join(thread, NULL);
+    return args.lcm;
+}
+
+TEST(LCM_C, TcpqBatch) {
+    // Messages published in a batch reach the server intact and in order.
+    TestServer server;
+    StartServer(&server);
+    lcm_t* lcm = Connect(&server, "");
+    ASSERT_TRUE(lcm != NULL);
+
+    const char* channels[] = { "BATCH_A", "BATCH_B", "BATCH_A", "BATCH_C" };
+    std::vector<uint8_t> buf(5000);
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = i & 0xff;
+    ASSERT_EQ(0, lcm_batch_begin(lcm));
+    for (int i = 0; i < 4; ++i)
+        ASSERT_EQ(0, lcm_publish(lcm, channels[i], &buf[0], 1000 * (i + 1)));
+    ASSERT_EQ(0, lcm_batch_end(lcm));
+    ASSERT_EQ(0, lcm_publish(lcm, "AFTER", &buf[0], 0));
+
+    for (int i = 0; i < 4; ++i) {
+        Published msg;
+        ASSERT_TRUE(ReadPublished(&server, &msg));
+        EXPECT_EQ(channels[i], msg.channel);
+        ASSERT_EQ(1000 * (i + 1), msg.data.size());
+        EXPECT_EQ(0, memcmp(&buf[0], &msg.data[0], msg.data.size()));
+    }
+    Published after;
+    ASSERT_TRUE(ReadPublished(&server, &after));
+    EXPECT_EQ("AFTER", after.channel);
+    EXPECT_EQ(0, after.data.size());
+
+    lcm_destroy(lcm);
+    StopServer(&server);
+}
+
+static int64_t NowUtime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void* HandleThread(void* user_data) {
+    lcm_handle((lcm_t*)user_data);
+    return NULL;
+}
+
+TEST(LCM_C, TcpqLatestOnly) {
+    // While the server isn't reading, publishing on a latest-only channel
+    // doesn't block, older queued messages on it are dropped, and the
+    // newest one and every message on other channels still arrive.
+    TestServer server;
+    StartServer(&server);
+    lcm_t* lcm = Connect(&server, "?latest=POSE_.*");
+    ASSERT_TRUE(lcm != NULL);
+
+    const int count = 300;
+    std::vector<uint8_t> pose(100000);
+    int64_t start = NowUtime();
+    for (int i = 0; i < count; ++i) {
+        memcpy(&pose[0], &i, sizeof(i));
+        ASSERT_EQ(0, lcm_publish(lcm, "POSE_ZED", &pose[0], pose.size()));
+        if (i % 100 == 0) {
+            ASSERT_EQ(0, lcm_publish(lcm, "STATUS", &i, sizeof(i)));
+        }
+    }
+    EXPECT_LT(NowUtime() - start, 1000000);
+
+    // handle() writes what's queued as the server reads, and returns once
+    // the server closes the connection
+    pthread_t handler;
+    pthread_create(&handler, NULL, HandleThread, lcm);
+
+    std::vector<int> poses, statuses;
+    while (poses.empty() || poses.back() != count - 1) {
+        Published msg;
+        ASSERT_TRUE(ReadPublished(&server, &msg));
+        int value;
+        memcpy(&value, &msg.data[0], sizeof(value));
+        if (msg.channel == "STATUS")
+            statuses.push_back(value);
+        else
+            poses.push_back(value);
+    }
+    StopServer(&server);
+    pthread_join(handler, NULL);
+
+    EXPECT_LT(poses.size(), count);
+    for (size_t i = 1; i < poses.size(); ++i)
+        EXPECT_LT(poses[i - 1], poses[i]);
+    ASSERT_EQ(3, statuses.size());
+    EXPECT_EQ(0, statuses[0]);
+    EXPECT_EQ(100, statuses[1]);
+    EXPECT_EQ(200, statuses[2]);
+
+    lcm_destroy(lcm);
+}
@@ -0,0 +1,181 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm-cpp.hpp>
+#include <lcm/lcm-cpp-handler-pool.hpp>
+#include "lcmtest/fixed_layout_t.hpp"
+
+class OrderHandler {
+  public:
+    std::mutex mutex;
+    std::vector<int> received;
+
+    void handle(const lcm::ReceiveBuffer *rbuf, const std::string &channel)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(*static_cast<const int *>(rbuf->data));
+    }
+};
+
+TEST(LCM_CPP, HandlerPoolOrder) {
+    // Messages of one subscription are handled in order, even with several threads.
+    lcm::LCM lcm("memq://");
+    ASSERT_TRUE(lcm.good());
+
+    OrderHandler a, b;
+    lcm::HandlerPool pool(&lcm, 4);
+    pool.subscribe("A", &OrderHandler::handle, &a);
+    pool.subscribe("B", &OrderHandler::handle, &b);
+
+    const int num_messages = 200;
+    for (int i = 0; i < num_messages; ++i) {
+        lcm.publish("A", &i, sizeof(i));
+        lcm.publish("B", &i, sizeof(i));
+    }
+    for (int i = 0; i < 2 * num_messages; ++i) {
+        ASSERT_EQ(0, lcm.handle());
+    }
+    pool.waitForIdle();
+
+    ASSERT_EQ(num_messages, a.received.size());
+    ASSERT_EQ(num_messages, b.received.size());
+    for (int i = 0; i < num_messages; ++i) {
+        EXPECT_EQ(i, a.received[i]);
+        EXPECT_EQ(i, b.received[i]);
+    }
+}
+
+class BlockingHandler {
+  public:
+    BlockingHandler() : released(false), handled(0) {}
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool released;
+    std::atomic<int> handled;
+
+    void slow(const lcm::ReceiveBuffer *rbuf, const std::string &channel)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!released)
+            cv.wait(lock);
+        ++handled;
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+        cv.notify_all();
+    }
+};
+
+class CountHandler {
+  public:
+    CountHandler() : handled(0) {}
+
+    int handled;
+
+    void handle(const lcm::ReceiveBuffer *rbuf, const std::string &channel) { ++handled; }
+};
+
+TEST(LCM_CPP, HandlerPoolDoesNotBlockHandle) {
+    // A handler still running on the pool doesn't hold up handle().
+    lcm::LCM lcm("memq://");
+    ASSERT_TRUE(lcm.good());
+
+    BlockingHandler slow;
+    CountHandler fast;
+    lcm::HandlerPool pool(&lcm);
+    pool.subscribe("SLOW", &BlockingHandler::slow, &slow);
+    lcm.subscribe("FAST", &CountHandler::handle, &fast);
+
+    int value = 0;
+    lcm.publish("SLOW", &value, sizeof(value));
+    lcm.publish("SLOW", &value, sizeof(value));
+    lcm.publish("FAST", &value, sizeof(value));
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(0, lcm.handle());
+    }
+    EXPECT_EQ(1, fast.handled);
+    EXPECT_EQ(0, slow.handled);
+
+    slow.release();
+    pool.waitForIdle();
+    EXPECT_EQ(2, slow.handled);
+}
+
+class LayoutHandler {
+  public:
+    lcmtest::fixed_layout_t last;
+    std::string channel;
+
+    void handle(const lcm::ReceiveBuffer *rbuf, const std::string &chan,
+                const lcmtest::fixed_layout_t *msg)
+    {
+        last = *msg;
+        channel = chan;
+    }
+};
+
+TEST(LCM_CPP, HandlerPoolTyped) {
+    // Typed subscriptions are decoded on the pool.
+    lcm::LCM lcm("memq://");
+    ASSERT_TRUE(lcm.good());
+
+    LayoutHandler handler;
+    lcm::HandlerPool pool(&lcm);
+    pool.subscribe("LAYOUT", &LayoutHandler::handle, &handler);
+
+    lcmtest::fixed_layout_t msg;
+    msg.i8 = 0;
+    msg.i16 = 0;
+    msg.i32 = 42;
+    msg.i64 = -6400000000LL;
+    msg.f = 0;
+    msg.d = 2.5;
+    msg.enabled = 1;
+    msg.b = 7;
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            msg.matrix[i][j] = i * 10 + j;
+        }
+    }
+    lcm.publish("LAYOUT", &msg);
+    ASSERT_EQ(0, lcm.handle());
+    pool.waitForIdle();
+
+    EXPECT_EQ("LAYOUT", handler.channel);
+    EXPECT_EQ(42, handler.last.i32);
+    EXPECT_EQ(-6400000000LL, handler.last.i64);
+    EXPECT_EQ(2.5, handler.last.d);
+    EXPECT_EQ(12, handler.last.matrix[1][2]);
+}
+
+TEST(LCM_CPP, HandlerPoolUnsubscribe) {
+    // Unsubscribing drops what is still queued for the subscription.
+    lcm::LCM lcm("memq://");
+    ASSERT_TRUE(lcm.good());
+
+    BlockingHandler slow;
+    lcm::HandlerPool pool(&lcm);
+    lcm::Subscription *subs = pool.subscribe("SLOW", &BlockingHandler::slow, &slow);
+
+    int value = 0;
+    for (int i = 0; i < 3; ++i) {
+        lcm.publish("SLOW", &value, sizeof(value));
+        ASSERT_EQ(0, lcm.handle());
+    }
+
+    EXPECT_EQ(0, pool.unsubscribe(subs));
+    EXPECT_EQ(-1, pool.unsubscribe(subs));
+    slow.release();
+    pool.waitForIdle();
+
+    // The first message was already being handled
+    EXPECT_GE(1, slow.handled);
+}
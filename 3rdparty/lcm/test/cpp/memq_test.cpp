@@ -104,3 +104,32 @@ TEST(LCM_CPP, MemqTimeout) {
     EXPECT_LT(0, lcm.handleTimeout(10000));
     EXPECT_TRUE(msg_handled);
 }
+
+TEST(LCM_CPP, MemqLatestOnly) {
+    // Publish many messages, then check that a latest only subscription
+    // only handles the newest one.
+    lcm::LCM lcm("memq://");
+    std::vector<std::vector<uint8_t> > received_buffers;
+
+    lcm::Subscription* subs = lcm.subscribeFunction("channel",
+            MemqBufferedHandler, &received_buffers);
+    subs->setLatestOnly();
+
+    int num_bufs = 50;
+    std::vector<std::vector<uint8_t> > buffers(num_bufs);
+    for (int buf_num = 0; buf_num < num_bufs; ++buf_num) {
+        std::vector<uint8_t>& buf = buffers[buf_num];
+        buf.resize(100);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        lcm.publish("channel", &buf[0], buf.size());
+    }
+
+    for (int buf_num = 0; buf_num < num_bufs; ++buf_num) {
+        lcm.handle();
+    }
+
+    ASSERT_EQ(1, received_buffers.size());
+    EXPECT_EQ(buffers.back(), received_buffers[0]);
+}
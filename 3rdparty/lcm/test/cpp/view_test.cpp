@@ -0,0 +1,101 @@
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm-cpp.hpp>
+#include "lcmtest/fixed_layout_t.hpp"
+#include "lcmtest/primitives_t.hpp"
+
+static lcmtest::fixed_layout_t MakeFixedLayout() {
+    lcmtest::fixed_layout_t msg;
+    msg.i8 = -8;
+    msg.i16 = -1600;
+    msg.i32 = 320000;
+    msg.i64 = -6400000000LL;
+    msg.f = 1.5f;
+    msg.d = -2.25;
+    msg.enabled = 1;
+    msg.b = 200;
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            msg.matrix[i][j] = i * 10 + j;
+        }
+    }
+    return msg;
+}
+
+TEST(LCM_CPP, ViewAccessors) {
+    // A view reads every field the same as a full decode would.
+    lcmtest::fixed_layout_t msg = MakeFixedLayout();
+    std::vector<uint8_t> buf(msg.getEncodedSize());
+    ASSERT_EQ(msg.getEncodedSize(), msg.encode(&buf[0], 0, buf.size()));
+
+    lcmtest::fixed_layout_t::View view;
+    EXPECT_EQ(msg.getEncodedSize(), lcmtest::fixed_layout_t::View::getEncodedSize());
+    ASSERT_EQ(msg.getEncodedSize(), view.decode(&buf[0], 0, buf.size()));
+
+    EXPECT_EQ(msg.i8, view.i8());
+    EXPECT_EQ(msg.i16, view.i16());
+    EXPECT_EQ(msg.i32, view.i32());
+    EXPECT_EQ(msg.i64, view.i64());
+    EXPECT_EQ(msg.f, view.f());
+    EXPECT_EQ(msg.d, view.d());
+    EXPECT_EQ(msg.enabled, view.enabled());
+    EXPECT_EQ(msg.b, view.b());
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            EXPECT_EQ(msg.matrix[i][j], view.matrix(i, j));
+        }
+    }
+
+    lcmtest::fixed_layout_t copy;
+    view.get(&copy);
+    EXPECT_EQ(msg.i64, copy.i64);
+    EXPECT_EQ(msg.matrix[1][2], copy.matrix[1][2]);
+}
+
+TEST(LCM_CPP, ViewRejectsOtherMessages) {
+    // A view checks the fingerprint and size like decode does.
+    lcmtest::fixed_layout_t msg = MakeFixedLayout();
+    std::vector<uint8_t> buf(msg.getEncodedSize());
+    msg.encode(&buf[0], 0, buf.size());
+
+    lcmtest::fixed_layout_t::View view;
+    EXPECT_GT(0, view.decode(&buf[0], 0, buf.size() - 1));
+
+    lcmtest::primitives_t other;
+    other.num_ranges = 0;
+    std::vector<uint8_t> other_buf(other.getEncodedSize());
+    other.encode(&other_buf[0], 0, other_buf.size());
+    EXPECT_GT(0, view.decode(&other_buf[0], 0, other_buf.size()));
+}
+
+struct ViewState {
+    int handled;
+    int64_t i64;
+};
+
+class ViewHandler {
+    public:
+        ViewState state;
+
+        void handle(const lcm::ReceiveBuffer* rbuf, const std::string& channel,
+                const lcmtest::fixed_layout_t::View* view) {
+            state.handled++;
+            state.i64 = view->i64();
+        }
+};
+
+TEST(LCM_CPP, ViewSubscription) {
+    // A handler taking a View is handed one pointing into the receive buffer.
+    lcm::LCM lcm("memq://");
+    ViewHandler handler;
+    handler.state.handled = 0;
+    lcm.subscribe("channel", &ViewHandler::handle, &handler);
+
+    lcmtest::fixed_layout_t msg = MakeFixedLayout();
+    lcm.publish("channel", &msg);
+    lcm.handle();
+
+    EXPECT_EQ(1, handler.state.handled);
+    EXPECT_EQ(msg.i64, handler.state.i64);
+}
@@ -27,10 +27,14 @@ def run_tests():
     print("Running C unit tests")
     run_gtest(os.path.join("c", "memq_test"))
     run_gtest(os.path.join("c", "eventlog_test"))
+    run_gtest(os.path.join("c", "coretypes_test"))
+    run_gtest(os.path.join("c", "tcpq_test"))
 
     # C++ unit tests
     print("Running C++ unit tests")
     run_gtest(os.path.join("cpp", "memq_test"))
+    run_gtest(os.path.join("cpp", "view_test"))
+    run_gtest(os.path.join("cpp", "handler_pool_test"))
 
 def summarize_results():
     # Parse and summarize unit test results
@@ -0,0 +1,217 @@
+#include "arm_link.hpp"
+
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define ARM_LINK_MAGIC 0x4d41524c
+
+//Slots of each ring. A reader only has to retry if the writer laps it this many times while it copies one value
+#define ARM_LINK_RING_SIZE 8
+
+//Single writer ring of the newest values of T. Slot n % ARM_LINK_RING_SIZE holds value n, whose sequence is 2n once written and odd while being written
+template <typename T>
+struct ArmLinkRing
+{
+    //Values written so far, which is also the futex word readers sleep on
+    std::atomic<uint32_t> count;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        T value;
+    } slots[ARM_LINK_RING_SIZE];
+};
+
+struct ArmLinkSegment
+{
+    uint32_t magic;
+    uint32_t version;
+
+    //steady_clock time of the bridge's latest feedback in ns, the clock is the same in every process
+    std::atomic<int64_t> feedback_time_ns;
+
+    ArmLinkRing<ArmLinkSetpoint> setpoints;
+    ArmLinkRing<ArmLinkFeedback> feedback;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "the futex word has to be a plain 32 bit integer");
+
+namespace
+{
+    //Shared between processes, so the futex calls aren't FUTEX_PRIVATE
+    void futex_wake(std::atomic<uint32_t> &word)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    void futex_wait(std::atomic<uint32_t> &word, uint32_t expected, std::chrono::milliseconds timeout)
+    {
+        timespec ts;
+        ts.tv_sec = timeout.count() / 1000;
+        ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+    }
+
+    template <typename T>
+    void write(ArmLinkRing<T> &ring, const T &value)
+    {
+        const uint32_t n = ring.count.load(std::memory_order_relaxed) + 1;
+        typename ArmLinkRing<T>::Slot &slot = ring.slots[n % ARM_LINK_RING_SIZE];
+        slot.sequence.store(2 * (uint64_t)n - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.value = value;
+        slot.sequence.store(2 * (uint64_t)n, std::memory_order_release);
+        ring.count.store(n, std::memory_order_release);
+        futex_wake(ring.count);
+    }
+
+    template <typename T>
+    bool read(ArmLinkRing<T> &ring, T &value, uint32_t &read_count, std::chrono::milliseconds timeout)
+    {
+        uint32_t n = ring.count.load(std::memory_order_acquire);
+        if (n == read_count)
+        {
+            futex_wait(ring.count, n, timeout);
+            n = ring.count.load(std::memory_order_acquire);
+            if (n == read_count)
+            {
+                return false;
+            }
+        }
+
+        //If the writer laps this read, start over from whatever is newest by then
+        while (true)
+        {
+            typename ArmLinkRing<T>::Slot &slot = ring.slots[n % ARM_LINK_RING_SIZE];
+            const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            T copy = slot.value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+            if (before == after && before == 2 * (uint64_t)n)
+            {
+                value = copy;
+                read_count = n;
+                return true;
+            }
+            n = ring.count.load(std::memory_order_acquire);
+        }
+    }
+
+    int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+ArmLink::ArmLink(ArmLinkSegment *segment, bool owner) : segment(segment), owner(owner) {}
+
+std::unique_ptr<ArmLink> ArmLink::create()
+{
+    //A kinematics process still mapping the old segment sees it go quiet and opens this one
+    shm_unlink(ARM_LINK_NAME);
+    int fd = shm_open(ARM_LINK_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    //The umask would keep a kinematics process running as another user out
+    fchmod(fd, 0666);
+    if (ftruncate(fd, sizeof(ArmLinkSegment)) != 0)
+    {
+        close(fd);
+        shm_unlink(ARM_LINK_NAME);
+        return nullptr;
+    }
+    void *map = mmap(nullptr, sizeof(ArmLinkSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(ARM_LINK_NAME);
+        return nullptr;
+    }
+
+    //A new segment is all zero, which is an empty ring with no feedback yet. The magic goes last so open() never takes a half set up segment
+    ArmLinkSegment *segment = static_cast<ArmLinkSegment *>(map);
+    segment->version = ARM_LINK_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = ARM_LINK_MAGIC;
+    return std::unique_ptr<ArmLink>(new ArmLink(segment, true));
+}
+
+std::unique_ptr<ArmLink> ArmLink::open()
+{
+    int fd = shm_open(ARM_LINK_NAME, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(ArmLinkSegment))
+    {
+        close(fd);
+        return nullptr;
+    }
+    void *map = mmap(nullptr, sizeof(ArmLinkSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    ArmLinkSegment *segment = static_cast<ArmLinkSegment *>(map);
+    if (segment->magic != ARM_LINK_MAGIC || segment->version != ARM_LINK_VERSION)
+    {
+        munmap(map, sizeof(ArmLinkSegment));
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    //Setpoints already written are old news, but the newest feedback is the arm's current position
+    std::unique_ptr<ArmLink> link(new ArmLink(segment, false));
+    link->setpoints_read = segment->setpoints.count.load(std::memory_order_acquire);
+    return link;
+}
+
+ArmLink::~ArmLink()
+{
+    munmap(segment, sizeof(ArmLinkSegment));
+    if (owner)
+    {
+        shm_unlink(ARM_LINK_NAME);
+    }
+}
+
+void ArmLink::write_setpoint(const ArmLinkSetpoint &setpoint)
+{
+    write(segment->setpoints, setpoint);
+}
+
+bool ArmLink::read_setpoint(ArmLinkSetpoint &setpoint, std::chrono::milliseconds timeout)
+{
+    return read(segment->setpoints, setpoint, setpoints_read, timeout);
+}
+
+void ArmLink::write_feedback(const ArmLinkFeedback &feedback)
+{
+    write(segment->feedback, feedback);
+    segment->feedback_time_ns.store(now_ns(), std::memory_order_release);
+}
+
+bool ArmLink::read_feedback(ArmLinkFeedback &feedback, std::chrono::milliseconds timeout)
+{
+    return read(segment->feedback, feedback, feedback_read, timeout);
+}
+
+bool ArmLink::is_alive() const
+{
+    const int64_t feedback_time = segment->feedback_time_ns.load(std::memory_order_acquire);
+    return feedback_time != 0 &&
+        now_ns() - feedback_time < std::chrono::duration_cast<std::chrono::nanoseconds>(ARM_LINK_ALIVE_TIME).count();
+}
@@ -0,0 +1,81 @@
+#ifndef ARM_LINK_HPP
+#define ARM_LINK_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+//Name of the shared memory segment, under /dev/shm
+#define ARM_LINK_NAME "/mrover_arm_link"
+
+//Changed whenever the layout of the segment changes, so builds that disagree about it don't talk
+#define ARM_LINK_VERSION 1
+
+#define ARM_LINK_JOINTS 6
+
+//How recently the bridge has to have written feedback for the link to be up, a few of its telemetry periods
+#define ARM_LINK_ALIVE_TIME std::chrono::milliseconds(1000)
+
+//A target for every RA joint, in the bridge's radians (encoder offsets applied), with a feedforward torque in Nm
+struct ArmLinkSetpoint
+{
+    float angle[ARM_LINK_JOINTS];
+    float torque[ARM_LINK_JOINTS];
+};
+
+//The angles the bridge last read, as on /arm_position
+struct ArmLinkFeedback
+{
+    float angle[ARM_LINK_JOINTS];
+    int32_t stale_joints;
+};
+
+struct ArmLinkSegment;
+
+/*
+ArmLink carries RA setpoints from ra_kinematics to a nucleo bridge on the same machine, and the bridge's feedback back, through shared memory instead of LCM.
+The bridge creates the segment and kinematics opens it. Each direction is a ring with one writer, so writing never waits for the reader and reading the newest value never waits for a write in progress.
+Readers sleep on a futex in the segment until the other side writes, so a setpoint reaches the bus thread's queue without a socket, a message encoding or a poll interval in between.
+*/
+class ArmLink
+{
+private:
+    ArmLinkSegment *segment;
+    bool owner;
+
+    //Counts of the values this end has already read
+    uint32_t setpoints_read = 0;
+    uint32_t feedback_read = 0;
+
+    ArmLink(ArmLinkSegment *segment, bool owner);
+
+public:
+    //Creates the segment, replacing one a bridge that didn't exit cleanly left behind. Returns nullptr if it can't
+    static std::unique_ptr<ArmLink> create();
+
+    //Opens the segment a bridge created. Returns nullptr if there is none, or it was built with another layout
+    static std::unique_ptr<ArmLink> open();
+
+    //Unmaps the segment, and removes it if this end created it
+    ~ArmLink();
+
+    ArmLink(const ArmLink &) = delete;
+    ArmLink &operator=(const ArmLink &) = delete;
+
+    //Publishes setpoint as the newest one. Only one thread may write setpoints
+    void write_setpoint(const ArmLinkSetpoint &setpoint);
+
+    //Waits up to timeout for a setpoint newer than the last one read, and reads the newest. Returns false if none came
+    bool read_setpoint(ArmLinkSetpoint &setpoint, std::chrono::milliseconds timeout);
+
+    //Publishes feedback as the newest, and marks the link as up. Only one thread may write feedback
+    void write_feedback(const ArmLinkFeedback &feedback);
+
+    //Waits up to timeout for feedback newer than the last read, and reads the newest. Returns false if none came
+    bool read_feedback(ArmLinkFeedback &feedback, std::chrono::milliseconds timeout);
+
+    //Returns whether the bridge has written feedback in the last ARM_LINK_ALIVE_TIME
+    bool is_alive() const;
+};
+
+#endif
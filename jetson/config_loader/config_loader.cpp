@@ -0,0 +1,84 @@
+#include "config_loader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ConfigFile::ConfigFile()
+    : mMapping( nullptr )
+    , mMappingSize( 0 )
+{
+} // ConfigFile()
+
+ConfigFile::~ConfigFile()
+{
+    // The strings have to go before the mapping they point into.
+    SetNull();
+    unmap();
+} // ~ConfigFile()
+
+bool ConfigFile::load( const std::string& path )
+{
+    // A failed parse leaves the old value in place, so drop it and its
+    // allocations with the mapping they point into.
+    rapidjson::Document old;
+    Swap( old );
+    old.SetNull();
+    unmap();
+
+    const int fd = open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+    {
+        return false;
+    }
+    struct stat st;
+    if( fstat( fd, &st ) != 0 )
+    {
+        close( fd );
+        return false;
+    }
+
+    // Reserves the file's size rounded up past a page boundary, which is
+    // zero filled, and maps the file over the start of it. The bytes of
+    // the last page past the end of the file are zero too, so there is
+    // always a terminator. The mapping is private, so the parser's writes
+    // never reach the file.
+    const std::size_t pageSize = sysconf( _SC_PAGESIZE );
+    const std::size_t fileSize = st.st_size;
+    const std::size_t size = ( fileSize / pageSize + 1 ) * pageSize;
+    void* mapping = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( mapping == MAP_FAILED )
+    {
+        close( fd );
+        return false;
+    }
+    if( fileSize > 0 &&
+        mmap( mapping, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED )
+    {
+        munmap( mapping, size );
+        close( fd );
+        return false;
+    }
+    close( fd );
+    mMapping = static_cast<char*>( mapping );
+    mMappingSize = size;
+
+    ParseInsitu( mMapping );
+    if( HasParseError() )
+    {
+        SetNull();
+        return false;
+    }
+    return true;
+} // load()
+
+void ConfigFile::unmap()
+{
+    if( mMapping )
+    {
+        munmap( mMapping, mMappingSize );
+        mMapping = nullptr;
+        mMappingSize = 0;
+    }
+} // unmap()
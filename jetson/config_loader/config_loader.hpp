@@ -0,0 +1,38 @@
+#ifndef CONFIG_LOADER_HPP
+#define CONFIG_LOADER_HPP
+
+#include <cstddef>
+#include <string>
+#include "rapidjson/document.h"
+
+// A JSON config file, parsed in place in a private memory mapping of the
+// file. Nothing is copied: the document's strings point into the mapping,
+// so it lives exactly as long as the document does. This is a
+// rapidjson::Document and can be passed wherever one is read.
+class ConfigFile : public rapidjson::Document
+{
+public:
+    ConfigFile();
+
+    ~ConfigFile();
+
+    ConfigFile( const ConfigFile& ) = delete;
+
+    ConfigFile& operator=( const ConfigFile& ) = delete;
+
+    // Maps the file at path and parses it, replacing what was loaded
+    // before. Returns false, leaving the document null, if the file can't
+    // be read or isn't valid JSON.
+    bool load( const std::string& path );
+
+private:
+    void unmap();
+
+    // The mapping, the file followed by at least one zero byte, which
+    // terminates the in place parse.
+    char* mMapping;
+
+    std::size_t mMappingSize;
+};
+
+#endif // CONFIG_LOADER_HPP
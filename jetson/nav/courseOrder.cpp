@@ -0,0 +1,153 @@
+#include "courseOrder.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // Length of the drive from start through the points of order,
+    // ending at end if hasEnd.
+    double runLength( const std::vector<LocalPoint>& points, const std::vector<size_t>& order,
+                      const LocalPoint& start, const bool hasEnd, const LocalPoint& end )
+    {
+        double length = 0;
+        LocalPoint previous = start;
+        for( const size_t index : order )
+        {
+            length += distance( previous, points[ index ] );
+            previous = points[ index ];
+        }
+        if( hasEnd )
+        {
+            length += distance( previous, end );
+        }
+        return length;
+    } // runLength()
+
+    // Orders the points of a run of waypoints that can be visited in any
+    // order, between start and end if hasEnd. The order is built by
+    // going to the nearest point next, then improved with 2-opt, which
+    // reverses parts of the order for as long as that makes the drive
+    // shorter.
+    std::vector<size_t> orderRun( const std::vector<LocalPoint>& points, const LocalPoint& start,
+                                  const bool hasEnd, const LocalPoint& end )
+    {
+        std::vector<size_t> order;
+        std::vector<bool> visited( points.size(), false );
+        LocalPoint previous = start;
+        for( size_t i = 0; i < points.size(); ++i )
+        {
+            size_t nearest = 0;
+            double nearestDistance = -1;
+            for( size_t j = 0; j < points.size(); ++j )
+            {
+                const double pointDistance = distance( previous, points[ j ] );
+                if( !visited[ j ] && ( nearestDistance < 0 || pointDistance < nearestDistance ) )
+                {
+                    nearest = j;
+                    nearestDistance = pointDistance;
+                }
+            }
+            visited[ nearest ] = true;
+            order.push_back( nearest );
+            previous = points[ nearest ];
+        }
+
+        // Reversing order[ i ] to order[ j ] only changes the legs into
+        // order[ i ] and out of order[ j ]. Without an end, the last point
+        // has no leg out of it.
+        bool improved = true;
+        while( improved )
+        {
+            improved = false;
+            for( size_t i = 0; i < order.size(); ++i )
+            {
+                const LocalPoint& before = i == 0 ? start : points[ order[ i - 1 ] ];
+                for( size_t j = i + 1; j < order.size(); ++j )
+                {
+                    const bool hasAfter = j + 1 < order.size() || hasEnd;
+                    const LocalPoint& after = j + 1 < order.size() ? points[ order[ j + 1 ] ] : end;
+                    const LocalPoint& first = points[ order[ i ] ];
+                    const LocalPoint& last = points[ order[ j ] ];
+                    double change = distance( before, last ) - distance( before, first );
+                    if( hasAfter )
+                    {
+                        change += distance( first, after ) - distance( last, after );
+                    }
+                    // Ignore changes too small to matter so rounding can't
+                    // keep this going.
+                    if( change < -1e-6 )
+                    {
+                        std::reverse( order.begin() + i, order.begin() + j + 1 );
+                        improved = true;
+                    }
+                }
+            }
+        }
+        return order;
+    } // orderRun()
+} // namespace
+
+// Returns the length in meters of the straight legs from start through
+// every waypoint of path in order.
+double courseLength( const std::deque<Waypoint>& path, const LocalFrame& frame, const LocalPoint& start )
+{
+    double length = 0;
+    LocalPoint previous = start;
+    for( const Waypoint& waypoint : path )
+    {
+        const LocalPoint point = frame.toLocal( waypoint.odom );
+        length += distance( previous, point );
+        previous = point;
+    }
+    return length;
+} // courseLength()
+
+// Reorders the waypoints of path so that driving them from start is
+// shorter. Gates stay where they are in the course, since the gate has
+// to be driven through in the order it was given, so only the runs of
+// waypoints between gates are reordered. A run is only reordered if
+// the new order is shorter than the order it was sent in. Returns true
+// if the order changed.
+bool orderCourse( std::deque<Waypoint>& path, const LocalFrame& frame, const LocalPoint& start )
+{
+    bool changed = false;
+    LocalPoint runStart = start;
+    size_t runBegin = 0;
+    while( runBegin < path.size() )
+    {
+        size_t runEnd = runBegin;
+        while( runEnd < path.size() && !path[ runEnd ].gate )
+        {
+            ++runEnd;
+        }
+        const bool hasEnd = runEnd < path.size();
+        const LocalPoint end = hasEnd ? frame.toLocal( path[ runEnd ].odom ) : runStart;
+
+        if( runEnd - runBegin > 1 )
+        {
+            std::vector<Waypoint> run( path.begin() + runBegin, path.begin() + runEnd );
+            std::vector<LocalPoint> points;
+            std::vector<size_t> sentOrder;
+            for( size_t i = 0; i < run.size(); ++i )
+            {
+                points.push_back( frame.toLocal( run[ i ].odom ) );
+                sentOrder.push_back( i );
+            }
+            const std::vector<size_t> order = orderRun( points, runStart, hasEnd, end );
+            if( runLength( points, order, runStart, hasEnd, end ) <
+                runLength( points, sentOrder, runStart, hasEnd, end ) - 1e-6 )
+            {
+                for( size_t i = 0; i < order.size(); ++i )
+                {
+                    path[ runBegin + i ] = run[ order[ i ] ];
+                }
+                changed = true;
+            }
+        }
+
+        runStart = hasEnd ? end : runStart;
+        runBegin = runEnd + 1;
+    }
+    return changed;
+} // orderCourse()
@@ -0,0 +1,15 @@
+#ifndef COURSE_ORDER_HPP
+#define COURSE_ORDER_HPP
+
+#include <deque>
+
+#include "rover_msgs/Waypoint.hpp"
+#include "localFrame.hpp"
+
+using namespace rover_msgs;
+
+double courseLength( const std::deque<Waypoint>& path, const LocalFrame& frame, const LocalPoint& start );
+
+bool orderCourse( std::deque<Waypoint>& path, const LocalFrame& frame, const LocalPoint& start );
+
+#endif // COURSE_ORDER_HPP
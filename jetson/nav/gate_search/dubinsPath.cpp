@@ -0,0 +1,202 @@
+#include "dubinsPath.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+
+namespace
+{
+    // The ways the rover can move along a part of a Dubins path.
+    enum class Motion
+    {
+        Left,
+        Straight,
+        Right
+    };
+
+    // A position in the local frame facing an angle counterclockwise
+    // from east, in radians.
+    struct Pose
+    {
+        double x;
+        double y;
+        double angle;
+    };
+
+    // Wraps an angle in radians to [0, 2 pi).
+    double mod2pi( const double angle )
+    {
+        double wrapped = fmod( angle, 2 * PI );
+        if( wrapped < 0 )
+        {
+            wrapped += 2 * PI;
+        }
+        return wrapped;
+    }
+
+    // Moves the pose length meters along an arc of the given radius or
+    // along a straight line.
+    Pose move( const Pose& pose, const Motion motion, const double length, const double radius )
+    {
+        const double turned = length / radius;
+        switch( motion )
+        {
+            case Motion::Left:
+            {
+                return { pose.x + radius * ( sin( pose.angle + turned ) - sin( pose.angle ) ),
+                         pose.y + radius * ( cos( pose.angle ) - cos( pose.angle + turned ) ),
+                         pose.angle + turned };
+            }
+            case Motion::Right:
+            {
+                return { pose.x + radius * ( sin( pose.angle ) - sin( pose.angle - turned ) ),
+                         pose.y + radius * ( cos( pose.angle - turned ) - cos( pose.angle ) ),
+                         pose.angle - turned };
+            }
+            default:
+            {
+                return { pose.x + length * cos( pose.angle ), pose.y + length * sin( pose.angle ), pose.angle };
+            }
+        }
+    }
+} // namespace
+
+// Finds the shortest of the six kinds of Dubins path. The lengths of
+// the three parts of each kind use the closed forms from Shkel and
+// Lumelsky, in a frame where the line from start to end points along
+// the x axis and lengths are in multiples of radius.
+std::vector<LocalPoint> dubinsPath( const LocalPoint& start, const double startHeading,
+                                    const LocalPoint& end, const double endHeading,
+                                    const double radius, const double spacing )
+{
+    const Pose startPose = { start.east, start.north, degreeToRadian( 90 - startHeading ) };
+    const double endAngle = degreeToRadian( 90 - endHeading );
+    const double dx = end.east - start.east;
+    const double dy = end.north - start.north;
+    const double d = hypot( dx, dy ) / radius;
+    const double theta = d > 0 ? mod2pi( atan2( dy, dx ) ) : 0;
+    const double alpha = mod2pi( startPose.angle - theta );
+    const double beta = mod2pi( endAngle - theta );
+    const double sa = sin( alpha );
+    const double sb = sin( beta );
+    const double ca = cos( alpha );
+    const double cb = cos( beta );
+    const double cab = cos( alpha - beta );
+
+    const Motion L = Motion::Left;
+    const Motion S = Motion::Straight;
+    const Motion R = Motion::Right;
+    const Motion words[ 6 ][ 3 ] = { { L, S, L }, { R, S, R }, { L, S, R }, { R, S, L }, { R, L, R }, { L, R, L } };
+    double best[ 3 ] = { 0, 0, 0 };
+    int bestWord = -1;
+    for( int word = 0; word < 6; ++word )
+    {
+        double t = 0;
+        double p = 0;
+        double q = 0;
+        switch( word )
+        {
+            case 0:
+            {
+                const double pSquared = 2 + d * d - 2 * cab + 2 * d * ( sa - sb );
+                const double angle = atan2( cb - ca, d + sa - sb );
+                t = mod2pi( angle - alpha );
+                p = sqrt( fmax( pSquared, 0 ) );
+                q = mod2pi( beta - angle );
+                break;
+            }
+            case 1:
+            {
+                const double pSquared = 2 + d * d - 2 * cab + 2 * d * ( sb - sa );
+                const double angle = atan2( ca - cb, d - sa + sb );
+                t = mod2pi( alpha - angle );
+                p = sqrt( fmax( pSquared, 0 ) );
+                q = mod2pi( angle - beta );
+                break;
+            }
+            case 2:
+            {
+                const double pSquared = -2 + d * d + 2 * cab + 2 * d * ( sa + sb );
+                if( pSquared < 0 )
+                {
+                    continue;
+                }
+                p = sqrt( pSquared );
+                const double angle = atan2( -ca - cb, d + sa + sb ) - atan2( -2.0, p );
+                t = mod2pi( angle - alpha );
+                q = mod2pi( angle - beta );
+                break;
+            }
+            case 3:
+            {
+                const double pSquared = -2 + d * d + 2 * cab - 2 * d * ( sa + sb );
+                if( pSquared < 0 )
+                {
+                    continue;
+                }
+                p = sqrt( pSquared );
+                const double angle = atan2( ca + cb, d - sa - sb ) - atan2( 2.0, p );
+                t = mod2pi( alpha - angle );
+                q = mod2pi( beta - angle );
+                break;
+            }
+            case 4:
+            {
+                const double cosP = ( 6 - d * d + 2 * cab + 2 * d * ( sa - sb ) ) / 8;
+                if( fabs( cosP ) > 1 )
+                {
+                    continue;
+                }
+                const double angle = atan2( ca - cb, d - sa + sb );
+                p = mod2pi( 2 * PI - acos( cosP ) );
+                t = mod2pi( alpha - angle + p / 2 );
+                q = mod2pi( alpha - beta - t + p );
+                break;
+            }
+            default:
+            {
+                const double cosP = ( 6 - d * d + 2 * cab + 2 * d * ( sb - sa ) ) / 8;
+                if( fabs( cosP ) > 1 )
+                {
+                    continue;
+                }
+                const double angle = atan2( ca - cb, d + sa - sb );
+                p = mod2pi( 2 * PI - acos( cosP ) );
+                t = mod2pi( -alpha - angle + p / 2 );
+                q = mod2pi( beta - alpha - t + p );
+                break;
+            }
+        }
+        if( bestWord < 0 || t + p + q < best[ 0 ] + best[ 1 ] + best[ 2 ] )
+        {
+            best[ 0 ] = t;
+            best[ 1 ] = p;
+            best[ 2 ] = q;
+            bestWord = word;
+        }
+    }
+
+    // Poses at the start of each part of the path.
+    Pose partStart[ 3 ];
+    partStart[ 0 ] = startPose;
+    for( int part = 1; part < 3; ++part )
+    {
+        partStart[ part ] = move( partStart[ part - 1 ], words[ bestWord ][ part - 1 ], best[ part - 1 ] * radius, radius );
+    }
+
+    std::vector<LocalPoint> path;
+    const double length = ( best[ 0 ] + best[ 1 ] + best[ 2 ] ) * radius;
+    int part = 0;
+    double partOffset = 0;
+    for( double along = 0; along < length; along += spacing )
+    {
+        while( part < 2 && along - partOffset > best[ part ] * radius )
+        {
+            partOffset += best[ part ] * radius;
+            ++part;
+        }
+        const Pose pose = move( partStart[ part ], words[ bestWord ][ part ], along - partOffset, radius );
+        path.push_back( { pose.x, pose.y } );
+    }
+    path.push_back( end );
+    return path;
+} // dubinsPath()
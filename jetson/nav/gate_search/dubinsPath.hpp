@@ -0,0 +1,16 @@
+#ifndef DUBINS_PATH_HPP
+#define DUBINS_PATH_HPP
+
+#include <vector>
+#include "../localFrame.hpp"
+
+// The shortest path from start, facing the absolute bearing
+// startHeading, to end, facing endHeading, for a rover that can't turn
+// tighter than radius. The path is made of at most three arcs and
+// straight lines (a Dubins path), and is returned as points spacing
+// meters apart along it, including both ends.
+std::vector<LocalPoint> dubinsPath( const LocalPoint& start, const double startHeading,
+                                    const LocalPoint& end, const double endHeading,
+                                    const double radius, const double spacing );
+
+#endif // DUBINS_PATH_HPP
@@ -3,13 +3,27 @@
 #include "utilities.hpp"
 #include "stateMachine.hpp"
 #include "./gate_search/diamondGateSearch.hpp"
+#include "./gate_search/dubinsPath.hpp"
 #include <cmath>
 #include <iostream>
 
+namespace
+{
+    // How much farther apart than the gate width the fused posts can be
+    // and still be taken as the two posts of the gate.
+    const double MAX_GATE_WIDTH_RATIO = 1.5;
+} // namespace
+
 // Constructs a GateStateMachine object with roverStateMachine
 GateStateMachine::GateStateMachine( StateMachine* stateMachine, Rover* rover, const rapidjson::Document& roverConfig )
     : mRoverStateMachine( stateMachine )
     , mRoverConfig( roverConfig )
+    , mNextStop( 0 )
+    , mOriginalSpinAngle( 0 )
+    , mWaitStarted( false )
+    , mShimmyDirection( 1 )
+    , mApproachSegments( 0 )
+    , mObservedFrame( -1 )
     , mRover( rover ) {}
 
 GateStateMachine::~GateStateMachine() {}
@@ -64,6 +78,11 @@ NavState GateStateMachine::run()
             return executeGateDriveThrough();
         }
 
+        case NavState::GateTrajectory:
+        {
+            return executeGateTrajectory();
+        }
+
         default:
         {
             cerr << "Entered Unknown NavState in search state machine" << endl;
@@ -76,32 +95,27 @@ NavState GateStateMachine::run()
 NavState GateStateMachine::executeGateSpin()
 {
     // degrees to turn to before performing a search wait.
-    double waitStepSize = mRoverConfig[ "search" ][ "searchWaitStepSize" ].GetDouble();
-    static double nextStop = 0; // to force the rover to wait initially
-    static double mOriginalSpinAngle = 0; //initialize, is corrected on first call
+    double waitStepSize = mRover->config().search.searchWaitStepSize;
 
-    if( mRover->roverStatus().target2().distance >= 0 ||
-        ( mRover->roverStatus().target().distance >= 0 && mRover->roverStatus().target().id != lastKnownPost1.id ))
+    if( isSecondPostFound() )
     {
-        updatePost2Info();
-        calcCenterPoint();
-        return NavState::GateTurnToCentPoint;
+        return approachGate();
     }
 
-    if ( nextStop == 0 )
+    if ( mNextStop == 0 )
     {
         // get current angle and set as origAngle
         mOriginalSpinAngle = mRover->roverStatus().odometry().bearing_deg; //doublecheck
-        nextStop = mOriginalSpinAngle;
+        mNextStop = mOriginalSpinAngle;
     }
-    if( mRover->turn( nextStop ) )
+    if( mRover->turn( mNextStop ) )
     {
-        if( nextStop - mOriginalSpinAngle >= 360 )
+        if( mNextStop - mOriginalSpinAngle >= 360 )
         {
-            nextStop = 0;
+            mNextStop = 0;
             return NavState::GateTurn;
         }
-        nextStop += waitStepSize;
+        mNextStop += waitStepSize;
         return NavState::GateSpinWait;
     }
     return NavState::GateSpin;
@@ -110,27 +124,21 @@ NavState GateStateMachine::executeGateSpin()
 //
 NavState GateStateMachine::executeGateSpinWait()
 {
-    static bool started = false;
-    static time_t startTime;
-
-    if( mRover->roverStatus().target2().distance >= 0 ||
-        ( mRover->roverStatus().target().distance >= 0 && mRover->roverStatus().target().id != lastKnownPost1.id ))
+    if( isSecondPostFound() )
     {
-        updatePost2Info();
-        calcCenterPoint();
-        return NavState::GateTurnToCentPoint;
+        return approachGate();
     }
 
-    if( !started )
+    if( !mWaitStarted )
     {
         mRover->stop();
-        startTime = time( nullptr );
-        started = true;
+        mWaitStartTime = mRoverStateMachine->now();
+        mWaitStarted = true;
     }
-    double waitTime = mRoverConfig[ "search" ][ "searchWaitTime" ].GetDouble();
-    if( difftime( time( nullptr ), startTime ) > waitTime )
+    double waitTime = mRover->config().search.searchWaitTime;
+    if( chrono::duration<double>( mRoverStateMachine->now() - mWaitStartTime ).count() > waitTime )
     {
-        started = false;
+        mWaitStarted = false;
         return NavState::GateSpin;
     }
     return NavState::GateSpinWait;
@@ -144,12 +152,9 @@ NavState GateStateMachine::executeGateTurn()
         initializeSearch();
     }
 
-    if( mRover->roverStatus().target2().distance >= 0 ||
-        ( mRover->roverStatus().target().distance >= 0 && mRover->roverStatus().target().id != lastKnownPost1.id ))
+    if( isSecondPostFound() )
     {
-        updatePost2Info();
-        calcCenterPoint();
-        return NavState::GateTurnToCentPoint;
+        return approachGate();
     }
 
     Odometry& nextSearchPoint = mGateSearchPoints.front();
@@ -163,12 +168,9 @@ NavState GateStateMachine::executeGateTurn()
 //
 NavState GateStateMachine::executeGateDrive()
 {
-    if( mRover->roverStatus().target2().distance >= 0 ||
-        ( mRover->roverStatus().target().distance >= 0 && mRover->roverStatus().target().id != lastKnownPost1.id ))
+    if( isSecondPostFound() )
     {
-        updatePost2Info();
-        calcCenterPoint();
-        return NavState::GateTurnToCentPoint;
+        return approachGate();
     }
 
     // TODO
@@ -229,17 +231,16 @@ NavState GateStateMachine::executeGateFace()
 
 NavState GateStateMachine::executeGateShimmy()
 {
-    static int direction = 1; // 1 = forward, -1 = backwards
-    const double fovDepth = mRoverConfig["computerVision"]["visionDistance"].GetDouble();
-    const double fovAngle = mRoverConfig["computerVision"]["fieldOfViewSafeAngle"].GetDouble();
+    const double fovDepth = mRover->config().computerVision.visionDistance;
+    const double fovAngle = mRover->config().computerVision.fieldOfViewSafeAngle;
     const Odometry currOdom = mRover->roverStatus().odometry();
 
     // If we are centered
     const double targetAnglesDiff = mRover->roverStatus().target().bearing +
                                     mRover->roverStatus().target2().bearing;
-    if(targetAnglesDiff < mRoverConfig["navThresholds"]["gateCenteredAngleDiff"].GetDouble())
+    if(targetAnglesDiff < mRover->config().navThresholds.gateCenteredAngleDiff)
     {
-        direction = 1;
+        mShimmyDirection = 1;
         return NavState::GateDriveThrough;
     }
 
@@ -251,16 +252,16 @@ NavState GateStateMachine::executeGateShimmy()
     if(!visibleTargetAngles || !visibleTargetDists)
     {
         mRover->stop();
-        direction = direction == 1 ? -1 : 1;
+        mShimmyDirection = mShimmyDirection == 1 ? -1 : 1;
         return NavState::GateFace;
     }
 
     // Otherwise keep driving
     const double gateWidth = mRover->roverStatus().path().front().gate_width;
-    const double gateAngle = calcBearing(lastKnownPost1.odom, lastKnownPost2.odom); // Angle from post 1 to post 2
+    const double gateAngle = mRover->localFrame().bearing(lastKnownPost1.odom, lastKnownPost2.odom); // Angle from post 1 to post 2
     const Odometry gateCent = createOdom(lastKnownPost1.odom, gateAngle, gateWidth / 2, mRover);
-    const double roverToGateCentAngle = calcBearing(currOdom, gateCent); // ablsolute angle
-    mRover->drive(direction, roverToGateCentAngle); // TODO: drive straight when going backwards
+    const double roverToGateCentAngle = mRover->localFrame().bearing(currOdom, gateCent); // ablsolute angle
+    mRover->drive(mShimmyDirection, roverToGateCentAngle); // TODO: drive straight when going backwards
     return NavState::GateShimmy;
 } // executeGateShimmy()
 
@@ -271,17 +272,7 @@ NavState GateStateMachine::executeGateDriveThrough()
 
     if( driveStatus == DriveStatus::Arrived )
     {
-        if(!CP1ToCP2CorrectDir)
-        {
-            const Odometry temp = centerPoint1;
-            centerPoint1 = centerPoint2;
-            centerPoint2 = temp;
-            CP1ToCP2CorrectDir = true;
-            return NavState::GateFace;
-        }
-        mRover->roverStatus().path().pop_front();
-        mRoverStateMachine->updateCompletedPoints();
-        return NavState::Turn;
+        return passedGate();
     }
     if( driveStatus == DriveStatus::OnCourse )
     {
@@ -291,9 +282,114 @@ NavState GateStateMachine::executeGateDriveThrough()
     return NavState::GateDriveThrough;
 } // executeGateDriveThrough()
 
-// Update stored location and id for second post.
+// Follows the approach trajectory through the gate without stopping.
+// Until the rover reaches centerPoint1, the trajectory is replanned
+// from the rover's current pose whenever the posts are seen far enough
+// from where they were when it was planned.
+NavState GateStateMachine::executeGateTrajectory()
+{
+    if( mApproach.segment() < mApproachSegments && updatePostsInfo() )
+    {
+        const Odometry oldCenterPoint1 = centerPoint1;
+        const Odometry oldCenterPoint2 = centerPoint2;
+        const bool oldCorrectDir = CP1ToCP2CorrectDir;
+        calcCenterPoint();
+
+        // Keep approaching the gate from the same side even if the
+        // rover is now closer to the other center point.
+        const LocalFrame& frame = mRover->localFrame();
+        if( frame.distance( oldCenterPoint1, centerPoint2 ) < frame.distance( oldCenterPoint1, centerPoint1 ) )
+        {
+            const Odometry temp = centerPoint1;
+            centerPoint1 = centerPoint2;
+            centerPoint2 = temp;
+            CP1ToCP2CorrectDir = !CP1ToCP2CorrectDir;
+        }
+        const double replanDistance = mRover->config().gate.replanDistance;
+        if( frame.distance( oldCenterPoint1, centerPoint1 ) > replanDistance ||
+            frame.distance( oldCenterPoint2, centerPoint2 ) > replanDistance )
+        {
+            planApproach();
+        }
+        else
+        {
+            centerPoint1 = oldCenterPoint1;
+            centerPoint2 = oldCenterPoint2;
+            CP1ToCP2CorrectDir = oldCorrectDir;
+        }
+    }
+
+    DriveStatus driveStatus = mRover->drive( mApproach );
+    if( driveStatus == DriveStatus::Arrived )
+    {
+        mApproach.clear();
+        return passedGate();
+    }
+    if( driveStatus == DriveStatus::OffCourse )
+    {
+        mRover->turn( mApproach.target() );
+    }
+    return NavState::GateTrajectory;
+} // executeGateTrajectory()
+
+// Starts going through the gate once both posts have been found.
+NavState GateStateMachine::approachGate()
+{
+    updatePost2Info();
+    calcCenterPoint();
+    if( mRover->config().gate.trajectory )
+    {
+        planApproach();
+        return NavState::GateTrajectory;
+    }
+    return NavState::GateTurnToCentPoint;
+} // approachGate()
+
+// Finishes the gate once the rover reaches centerPoint2. If the rover
+// went through the gate in the wrong direction, it turns around and
+// goes back through it.
+NavState GateStateMachine::passedGate()
+{
+    if(!CP1ToCP2CorrectDir)
+    {
+        const Odometry temp = centerPoint1;
+        centerPoint1 = centerPoint2;
+        centerPoint2 = temp;
+        CP1ToCP2CorrectDir = true;
+        return NavState::GateFace;
+    }
+    mRover->roverStatus().path().pop_front();
+    mRoverStateMachine->updateCompletedPoints();
+    return NavState::Turn;
+} // passedGate()
+
+// Returns true if the second post is in view, or has been seen well
+// enough before to be located without looking at it again.
+bool GateStateMachine::isSecondPostFound()
+{
+    int id;
+    return mRover->roverStatus().target2().distance >= 0 ||
+           ( mRover->roverStatus().target().distance >= 0 && mRover->roverStatus().target().id != lastKnownPost1.id ) ||
+           findLocatedPost2( id );
+} // isSecondPostFound()
+
+// Sets id to a located post that is about a gate width from the first
+// post, so posts of other legs seen on the way aren't taken for it.
+// Returns false if there is none.
+bool GateStateMachine::findLocatedPost2( int& id )
+{
+    useFusedPost( lastKnownPost1 );
+    const LocalPoint post1 = mRover->localFrame().toLocal( lastKnownPost1.odom );
+    const double gateWidth = mRover->roverStatus().path().front().gate_width;
+    return mPosts.findLocated( lastKnownPost1.id, post1, gateWidth * MAX_GATE_WIDTH_RATIO,
+                               mRover->config().gate.postMaxError, id );
+} // findLocatedPost2()
+
+// Update stored location and id for second post, and move both posts
+// to their fused estimates where those are good enough.
 void GateStateMachine::updatePost2Info()
 {
+    int locatedId;
     if(mRover->roverStatus().target2().distance >= 0 && mRover->roverStatus().target().id == lastKnownPost1.id)
     {
         const double targetAbsAngle = mod(mRover->roverStatus().odometry().bearing_deg +
@@ -305,7 +401,7 @@ void GateStateMachine::updatePost2Info()
                                           mRover );
         lastKnownPost2.id = mRover->roverStatus().target2().id;
     }
-    else
+    else if( mRover->roverStatus().target().distance >= 0 && mRover->roverStatus().target().id != lastKnownPost1.id )
     {
         const double targetAbsAngle = mod(mRover->roverStatus().odometry().bearing_deg +
                                           mRover->roverStatus().target().bearing,
@@ -316,8 +412,114 @@ void GateStateMachine::updatePost2Info()
                                           mRover );
         lastKnownPost2.id = mRover->roverStatus().target().id;
     }
+    // Out of view, but seen earlier
+    else if( findLocatedPost2( locatedId ) )
+    {
+        lastKnownPost2.id = locatedId;
+    }
+    useFusedPost( lastKnownPost1 );
+    useFusedPost( lastKnownPost2 );
 } // updatePost2Info()
 
+// Moves post to its fused estimate if the estimate is good enough.
+void GateStateMachine::useFusedPost( Waypoint& post )
+{
+    LocalPoint position;
+    double error;
+    if( mPosts.estimate( post.id, position, error ) && error <= mRover->config().gate.postMaxError )
+    {
+        post.odom = mRover->localFrame().toOdometry( position, mRover->roverStatus().odometry() );
+    }
+} // useFusedPost()
+
+// Adds the posts in the latest target list to the post estimates.
+// Called by the state machine whenever a target list comes in, in every
+// state, so posts seen while searching or avoiding count too.
+void GateStateMachine::observePosts()
+{
+    const CaptureStamp& capture = mRover->roverStatus().targetCapture();
+    if( capture.frameSeq >= 0 && capture.frameSeq == mObservedFrame )
+    {
+        return;
+    }
+    mObservedFrame = capture.frameSeq;
+
+    const Odometry& odometry = mRover->roverStatus().odometry();
+    const LocalPoint position = mRover->localFrame().toLocal( odometry );
+    for( const Target& target : seenPosts() )
+    {
+        mPosts.add( target.id, position, mod( odometry.bearing_deg + target.bearing, 360 ), target.distance,
+                    mRover->config().gate.postRangeError, mRover->config().gate.postBearingError );
+    }
+} // observePosts()
+
+// Returns every ranged tag perception is tracking, or the two targets if
+// perception only sent those, so posts are seen even when more than two
+// tags are in view.
+vector<Target> GateStateMachine::seenPosts()
+{
+    vector<Target> seen;
+    if( mRover->roverStatus().tags().empty() )
+    {
+        for( const Target* target : { &mRover->roverStatus().target(), &mRover->roverStatus().target2() } )
+        {
+            if( target->distance >= 0 )
+            {
+                seen.push_back( *target );
+            }
+        }
+        return seen;
+    }
+    for( const DetectedTag& tag : mRover->roverStatus().tags() )
+    {
+        if( tag.distance >= 0 )
+        {
+            Target target;
+            target.id = tag.id;
+            target.bearing = tag.bearing;
+            target.distance = tag.distance;
+            seen.push_back( target );
+        }
+    }
+    return seen;
+} // seenPosts()
+
+// Forgets every post sighting, when auton turns off.
+void GateStateMachine::forgetPosts()
+{
+    mPosts.clear();
+    mObservedFrame = -1;
+} // forgetPosts()
+
+// Update the stored locations of whichever posts are visible, to their
+// fused estimates once those are good enough. Returns true if either
+// post was seen, false otherwise.
+bool GateStateMachine::updatePostsInfo()
+{
+    bool updated = false;
+    for( const Target& target : seenPosts() )
+    {
+        Waypoint* post = nullptr;
+        if( target.id == lastKnownPost1.id )
+        {
+            post = &lastKnownPost1;
+        }
+        else if( target.id == lastKnownPost2.id )
+        {
+            post = &lastKnownPost2;
+        }
+        else
+        {
+            continue;
+        }
+        const double targetAbsAngle = mod( mRover->roverStatus().odometry().bearing_deg + target.bearing, 360 );
+        post->odom = createOdom( mRover->roverStatus().odometry(), targetAbsAngle, target.distance, mRover );
+        useFusedPost( *post );
+        updated = true;
+    }
+    return updated;
+} // updatePostsInfo()
+
 // Find the point centered in front of the gate.
 // Find the angle that the rover should face from that point to face the gate.
 // This point should be on the correct side of the gate so that we drive
@@ -328,7 +530,7 @@ void GateStateMachine::calcCenterPoint()
     const double distFromGate = 3;
     const double gateWidth = mRover->roverStatus().path().front().gate_width;
     const double tagToPointAngle = radianToDegree(atan2(distFromGate, gateWidth / 2));
-    const double gateAngle = calcBearing(lastKnownPost1.odom, lastKnownPost2.odom);
+    const double gateAngle = mRover->localFrame().bearing(lastKnownPost1.odom, lastKnownPost2.odom);
     const double absAngle1 = mod(gateAngle + tagToPointAngle, 360);
     const double absAngle2 = mod(absAngle1 + 180, 360);
     const double tagToPointDist = sqrt(pow(gateWidth / 2, 2) + pow(distFromGate, 2));
@@ -337,8 +539,8 @@ void GateStateMachine::calcCenterPoint()
     // TODO: verify this
     centerPoint1 = createOdom(lastKnownPost1.odom, absAngle1, tagToPointDist, mRover);
     centerPoint2 = createOdom(lastKnownPost2.odom, absAngle2, tagToPointDist, mRover);
-    const double cp1Dist = estimateNoneuclid(currOdom, centerPoint1);
-    const double cp2Dist = estimateNoneuclid(currOdom, centerPoint2);
+    const double cp1Dist = mRover->localFrame().distance(currOdom, centerPoint1);
+    const double cp2Dist = mRover->localFrame().distance(currOdom, centerPoint2);
     if(lastKnownPost1.id % 2)
     {
         CP1ToCP2CorrectDir = true;
@@ -357,8 +559,21 @@ void GateStateMachine::calcCenterPoint()
 
 } // calcCenterPoint()
 
-// Creates an GateStateMachine object
-GateStateMachine* GateFactory( StateMachine* stateMachine, Rover* rover, const rapidjson::Document& roverConfig )
+// Plans a trajectory from the rover's current pose to centerPoint1,
+// arriving facing centerPoint2, then straight through the gate to
+// centerPoint2. The turns in the trajectory are no tighter than the
+// configured turning radius.
+void GateStateMachine::planApproach()
 {
-    return new DiamondGateSearch( stateMachine, rover, roverConfig );
-} // GateFactor()
+    const LocalFrame& frame = mRover->localFrame();
+    const Odometry& currOdom = mRover->roverStatus().odometry();
+    const LocalPoint start = frame.toLocal( currOdom );
+    const LocalPoint cp1 = frame.toLocal( centerPoint1 );
+    const LocalPoint cp2 = frame.toLocal( centerPoint2 );
+    vector<LocalPoint> trajectory = dubinsPath( start, currOdom.bearing_deg, cp1, bearing( cp1, cp2 ),
+                                                mRover->config().gate.turningRadius,
+                                                mRover->config().gate.pathSpacing );
+    mApproachSegments = trajectory.size() - 1;
+    trajectory.push_back( cp2 );
+    mApproach.setPath( trajectory );
+} // planApproach()
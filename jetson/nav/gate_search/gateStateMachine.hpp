@@ -1,9 +1,12 @@
 #ifndef GATE_STATE_MACHINE_HPP
 #define GATE_STATE_MACHINE_HPP
 
+#include <chrono>
 #include <deque>
 
 #include "../rover.hpp"
+#include "../purePursuit.hpp"
+#include "postEstimator.hpp"
 #include "rover_msgs/Odometry.hpp"
 // #include "../gate_search/gateStateMachine.hpp"
 
@@ -23,6 +26,10 @@ public:
 
     virtual void initializeSearch() = 0;
 
+    void observePosts();
+
+    void forgetPosts();
+
     /*************************************************************************/
     /* Public Member Variables */
     /*************************************************************************/
@@ -57,10 +64,28 @@ private:
 
     NavState executeGateDriveThrough();
 
+    NavState executeGateTrajectory();
+
+    NavState approachGate();
+
+    NavState passedGate();
+
+    bool isSecondPostFound();
+
+    bool findLocatedPost2( int& id );
+
     void updatePost2Info();
 
+    void useFusedPost( Waypoint& post );
+
+    bool updatePostsInfo();
+
+    vector<Target> seenPosts();
+
     void calcCenterPoint();
 
+    void planApproach();
+
     /*************************************************************************/
     /* Private Member Variables */
     /*************************************************************************/
@@ -77,6 +102,32 @@ private:
     //
     bool CP1ToCP2CorrectDir;
 
+    // Next bearing to stop at during the spin, 0 to force the rover to
+    // wait initially, and the bearing the spin started at.
+    double mNextStop;
+    double mOriginalSpinAngle;
+
+    // Whether the rover is waiting during the spin, and since when.
+    bool mWaitStarted;
+    std::chrono::steady_clock::time_point mWaitStartTime;
+
+    // Direction the rover shimmies in, 1 = forward, -1 = backwards.
+    int mShimmyDirection;
+
+    // Follows the trajectory from the rover through both center points
+    // when the gate approach is "trajectory".
+    PurePursuit mApproach;
+
+    // Number of segments of the approach trajectory before centerPoint1.
+    size_t mApproachSegments;
+
+    // Fuses every sighting of the posts into where they are.
+    PostEstimator mPosts;
+
+    // Frame number of the last target list added to mPosts, so a target
+    // list that is copied twice isn't counted twice.
+    int64_t mObservedFrame;
+
 protected:
     /*************************************************************************/
     /* Protected Member Variables */
@@ -85,6 +136,4 @@ protected:
     Rover* mRover;
 };
 
-GateStateMachine* GateFactory( StateMachine* stateMachine, Rover* rover, const rapidjson::Document& roverConfig );
-
 #endif //GATE_STATE_MACHINE_HPP
@@ -0,0 +1,149 @@
+#include "postEstimator.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Sightings closer than this are weighted as if they were this far,
+    // so a post right in front of the camera isn't taken as perfect.
+    const double MIN_SIGHTING_DISTANCE = 1.0;
+} // namespace
+
+// Constructs an estimator that hasn't seen any posts.
+PostEstimator::PostEstimator()
+    : mCount( 0 )
+{
+} // PostEstimator()
+
+// Forgets every post.
+void PostEstimator::clear()
+{
+    mCount = 0;
+} // clear()
+
+// Adds a sighting of post id from the rover's position at the absolute
+// bearing and distance. The sighting's error along the line of sight is
+// rangeError times the distance, and across it bearingError degrees.
+// If MAX_POSTS are already kept, the one seen the fewest times is
+// replaced.
+void PostEstimator::add( const int id, const LocalPoint& rover, const double bearing, const double distance,
+                         const double rangeError, const double bearingError )
+{
+    const int index = find( id );
+    Post* post = index >= 0 ? &mPosts[ index ] : nullptr;
+    if( !post )
+    {
+        if( mCount < MAX_POSTS )
+        {
+            post = &mPosts[ mCount++ ];
+        }
+        else
+        {
+            post = &*min_element( mPosts.begin(), mPosts.end(), []( const Post& a, const Post& b )
+            {
+                return a.sightings < b.sightings;
+            } );
+        }
+        *post = Post{ id, 0, 0, 0, 0, 0, 0 };
+    }
+
+    const double weightedDistance = max( distance, MIN_SIGHTING_DISTANCE );
+    const double alongError = rangeError * weightedDistance;
+    const double acrossError = degreeToRadian( bearingError ) * weightedDistance;
+    const double alongInfo = 1 / ( alongError * alongError );
+    const double acrossInfo = 1 / ( acrossError * acrossError );
+
+    // The information of the sighting is alongInfo along the line of
+    // sight ( s, c ) and acrossInfo across it ( c, -s ).
+    const double s = sin( degreeToRadian( bearing ) );
+    const double c = cos( degreeToRadian( bearing ) );
+    const double infoEastEast = alongInfo * s * s + acrossInfo * c * c;
+    const double infoEastNorth = ( alongInfo - acrossInfo ) * s * c;
+    const double infoNorthNorth = alongInfo * c * c + acrossInfo * s * s;
+    const LocalPoint seen = offset( rover, bearing, distance );
+
+    post->infoEastEast += infoEastEast;
+    post->infoEastNorth += infoEastNorth;
+    post->infoNorthNorth += infoNorthNorth;
+    post->infoEast += infoEastEast * seen.east + infoEastNorth * seen.north;
+    post->infoNorth += infoEastNorth * seen.east + infoNorthNorth * seen.north;
+    ++post->sightings;
+} // add()
+
+// Sets position to the least squares estimate of where post id is and
+// error to the standard deviation of the estimate in the direction it
+// is least certain in. Returns false if the post hasn't been seen.
+bool PostEstimator::estimate( const int id, LocalPoint& position, double& error ) const
+{
+    const int index = find( id );
+    if( index < 0 )
+    {
+        return false;
+    }
+    const Post* post = &mPosts[ index ];
+    const double determinant = post->infoEastEast * post->infoNorthNorth - post->infoEastNorth * post->infoEastNorth;
+    if( determinant <= 0 )
+    {
+        return false;
+    }
+
+    // The covariance is the inverse of the information.
+    const double covEastEast = post->infoNorthNorth / determinant;
+    const double covEastNorth = -post->infoEastNorth / determinant;
+    const double covNorthNorth = post->infoEastEast / determinant;
+    position.east = covEastEast * post->infoEast + covEastNorth * post->infoNorth;
+    position.north = covEastNorth * post->infoEast + covNorthNorth * post->infoNorth;
+
+    const double halfTrace = ( covEastEast + covNorthNorth ) / 2;
+    const double halfDifference = ( covEastEast - covNorthNorth ) / 2;
+    const double largestVariance = halfTrace + sqrt( halfDifference * halfDifference + covEastNorth * covEastNorth );
+    error = sqrt( largestVariance );
+    return true;
+} // estimate()
+
+// Returns true if post id's estimate is within maxError meters in
+// every direction, false otherwise.
+bool PostEstimator::isLocated( const int id, const double maxError ) const
+{
+    LocalPoint position;
+    double error;
+    return estimate( id, position, error ) && error <= maxError;
+} // isLocated()
+
+// Sets id to the best located post other than excludedId that is
+// within maxDistance meters of near. Returns false if no such post is
+// located within maxError meters.
+bool PostEstimator::findLocated( const int excludedId, const LocalPoint& near, const double maxDistance,
+                                 const double maxError, int& id ) const
+{
+    bool found = false;
+    double bestError = maxError;
+    for( size_t i = 0; i < mCount; ++i )
+    {
+        LocalPoint position;
+        double error;
+        if( mPosts[ i ].id != excludedId && estimate( mPosts[ i ].id, position, error ) && error <= bestError &&
+            distance( position, near ) <= maxDistance )
+        {
+            found = true;
+            bestError = error;
+            id = mPosts[ i ].id;
+        }
+    }
+    return found;
+} // findLocated()
+
+// Returns the index of the post with id, or -1 if it hasn't been seen.
+int PostEstimator::find( const int id ) const
+{
+    for( size_t i = 0; i < mCount; ++i )
+    {
+        if( mPosts[ i ].id == id )
+        {
+            return static_cast<int>( i );
+        }
+    }
+    return -1;
+} // find()
@@ -0,0 +1,68 @@
+#ifndef POST_ESTIMATOR_HPP
+#define POST_ESTIMATOR_HPP
+
+#include <array>
+#include "../localFrame.hpp"
+
+// This class fuses every sighting of each gate post into one estimate
+// of where the post is in the local frame. A sighting is the rover's
+// position and the post's absolute bearing and distance from it, so it
+// places the post with an error that is long along the line of sight,
+// where perception's depth is least certain, and narrow across it. The
+// sightings are combined by weighted least squares, kept as the sum of
+// their information, so adding one is a few multiplications and the
+// estimate and its covariance are a 2x2 solve.
+//
+// Sightings from different places cross each other, so a post seen
+// once from far away while spinning and again from somewhere else is
+// located well without the rover going back to look at it.
+class PostEstimator
+{
+public:
+    // Posts kept at once. Each gate only has two, the rest are for
+    // posts of other legs seen on the way.
+    static const size_t MAX_POSTS = 8;
+
+    PostEstimator();
+
+    void clear();
+
+    void add( const int id, const LocalPoint& rover, const double bearing, const double distance,
+              const double rangeError, const double bearingError );
+
+    bool estimate( const int id, LocalPoint& position, double& error ) const;
+
+    bool isLocated( const int id, const double maxError ) const;
+
+    bool findLocated( const int excludedId, const LocalPoint& near, const double maxDistance,
+                      const double maxError, int& id ) const;
+
+private:
+    struct Post
+    {
+        int id;
+        int sightings;
+
+        // Sum of the sightings' information matrices, the inverse of
+        // their covariances, and of the information times the point
+        // each one saw.
+        double infoEastEast;
+        double infoEastNorth;
+        double infoNorthNorth;
+        double infoEast;
+        double infoNorth;
+    };
+
+    int find( const int id ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The posts seen so far, the first mCount of them.
+    std::array<Post, MAX_POSTS> mPosts;
+
+    size_t mCount;
+};
+
+#endif // POST_ESTIMATOR_HPP
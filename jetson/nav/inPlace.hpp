@@ -0,0 +1,57 @@
+#ifndef IN_PLACE_HPP
+#define IN_PLACE_HPP
+
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Storage for a T inside the object that owns it, for members that can
+// only be constructed after their owner's constructor has done some
+// work. The T is constructed in place, so it doesn't need an allocation
+// of its own, and is destroyed with the owner.
+template <typename T>
+class InPlace
+{
+public:
+    InPlace()
+        : mConstructed( false )
+    {}
+
+    InPlace( const InPlace& ) = delete;
+
+    InPlace& operator=( const InPlace& ) = delete;
+
+    ~InPlace()
+    {
+        if( mConstructed )
+        {
+            get()->~T();
+        }
+    }
+
+    // Constructs the T from args. Must only be called once.
+    template <typename... Args>
+    T* emplace( Args&&... args )
+    {
+        assert( !mConstructed );
+        new ( &mStorage ) T( std::forward<Args>( args )... );
+        mConstructed = true;
+        return get();
+    }
+
+    // Returns the T, which must have been constructed.
+    T* get()
+    {
+        assert( mConstructed );
+        return reinterpret_cast<T*>( &mStorage );
+    }
+
+private:
+    typename std::aligned_storage<sizeof( T ), alignof( T )>::type mStorage;
+
+    // Whether the T has been constructed.
+    bool mConstructed;
+};
+
+#endif // IN_PLACE_HPP
@@ -0,0 +1,194 @@
+#include "latencyTest.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    // Channel perception sends its frames on, the test's frames are sent
+    // on it so they reach nav the same way.
+    const char* const PERCEPTION_FRAME_CHANNEL = "/perception_frame";
+
+    // Id of the synthetic target.
+    const int32_t STEP_TARGET_ID = 0;
+} // namespace
+
+// Constructs a latency test that hasn't injected anything yet. The
+// first step is the frame with nothing in it.
+LatencyTest::LatencyTest( lcm::LCM& lcmObject )
+    : mLcmObject( lcmObject )
+    , mStepOn( true )
+    , mStepUs( 0 )
+    , mFrameSeq( 0 )
+    , mWaiting( false )
+    , mNext( 0 )
+    , mCount( 0 )
+    , mSteps( 0 )
+    , mMissed( 0 )
+{
+    mBaseline.forward_back = 0;
+    mBaseline.left_right = 0;
+    mBaseline.dampen = 0;
+    mBaseline.kill = false;
+    mBaseline.restart = false;
+    mFrame.has_profile = false;
+    mFrame.profile.start_bearing = 0;
+    mFrame.profile.resolution = 0;
+    mFrame.profile.max_range = 0;
+    fill( begin( mFrame.profile.ranges ), end( mFrame.profile.ranges ), -1 );
+} // LatencyTest()
+
+// Runs the test for one run of the state machine at nowUs, in
+// microseconds of the steady clock. joystick is the last command the
+// rover sent, at joystickUs. Does nothing while the test is off.
+void LatencyTest::update( const NavConfig& config, const int64_t nowUs,
+                          const Joystick& joystick, const int64_t joystickUs )
+{
+    const NavConfig::LatencyTest& test = config.latencyTest;
+    if( !test.enabled )
+    {
+        mWaiting = false;
+        return;
+    }
+    if( mSamples.size() != size_t( test.window ) )
+    {
+        mSamples.assign( test.window, 0 );
+        mNext = 0;
+        mCount = 0;
+    }
+
+    // A command sent since the last run may be the response.
+    if( mWaiting && joystickUs >= mStepUs && isResponse( test, joystick ) )
+    {
+        mWaiting = false;
+        finishStep( config, ( joystickUs - mStepUs ) / 1000.0 );
+    }
+
+    if( nowUs - mStepUs >= int64_t( test.period * 1000000 ) )
+    {
+        if( mWaiting )
+        {
+            mWaiting = false;
+            ++mMissed;
+            finishStep( config, -1 );
+        }
+        mStepOn = !mStepOn;
+        mStepUs = nowUs;
+        if( mStepOn )
+        {
+            mWaiting = true;
+            mBaseline = joystick;
+            ++mSteps;
+        }
+    }
+    publishFrame( test, nowUs );
+} // update()
+
+// Sends the frame of the current step, captured at nowUs.
+void LatencyTest::publishFrame( const NavConfig::LatencyTest& config, const int64_t nowUs )
+{
+    const bool target = mStepOn && !config.obstacle;
+    const bool obstacle = mStepOn && config.obstacle;
+
+    TargetList& targets = mFrame.targets;
+    for( Target& slot : targets.targetList )
+    {
+        slot.distance = -1;
+        slot.bearing = 0;
+        slot.id = -1;
+    }
+    targets.tags.clear();
+    if( target )
+    {
+        targets.targetList[ 0 ].distance = config.distance;
+        targets.targetList[ 0 ].bearing = config.bearing;
+        targets.targetList[ 0 ].id = STEP_TARGET_ID;
+        DetectedTag tag;
+        tag.id = STEP_TARGET_ID;
+        tag.bearing = config.bearing;
+        tag.distance = config.distance;
+        tag.range_confidence = 1;
+        tag.corner_confidence = 1;
+        tag.missed_frames = 0;
+        targets.tags.push_back( tag );
+    }
+    targets.num_tags = targets.tags.size();
+
+    Obstacle& seen = mFrame.obstacle;
+    seen.distance = obstacle ? config.distance : -1;
+    seen.bearing = obstacle ? config.bearing : 0;
+    seen.rightBearing = seen.bearing;
+
+    targets.capture_time_us = nowUs;
+    targets.frame_seq = mFrameSeq;
+    seen.capture_time_us = nowUs;
+    seen.frame_seq = mFrameSeq;
+    mFrame.profile.capture_time_us = nowUs;
+    mFrame.profile.frame_seq = mFrameSeq;
+    mFrame.capture_time_us = nowUs;
+    mFrame.frame_seq = mFrameSeq;
+    ++mFrameSeq;
+    mLcmObject.publish( PERCEPTION_FRAME_CHANNEL, &mFrame );
+} // publishFrame()
+
+// Records the latency of the step that was on, or that it was missed
+// if latencyMs is negative, and sends and prints the summary of the
+// last window steps.
+void LatencyTest::finishStep( const NavConfig& config, const double latencyMs )
+{
+    if( latencyMs >= 0 )
+    {
+        mSamples[ mNext ] = latencyMs;
+        mNext = ( mNext + 1 ) % mSamples.size();
+        mCount = min( mCount + 1, mSamples.size() );
+    }
+
+    NavLatency message;
+    message.step = config.latencyTest.obstacle ? "obstacle" : "target";
+    message.steps = mSteps;
+    message.missed = mMissed;
+    message.latency.stage = "step_to_joystick";
+    message.latency.samples = mCount;
+    message.latency.p50_ms = 0;
+    message.latency.p90_ms = 0;
+    message.latency.p99_ms = 0;
+    message.latency.max_ms = 0;
+    if( mCount > 0 )
+    {
+        mSorted.assign( mSamples.begin(), mSamples.begin() + mCount );
+        sort( mSorted.begin(), mSorted.end() );
+        auto percentile = [this]( const double p )
+        {
+            return mSorted[ min( mSorted.size() - 1, size_t( p * mSorted.size() ) ) ];
+        };
+        message.latency.p50_ms = percentile( 0.50 );
+        message.latency.p90_ms = percentile( 0.90 );
+        message.latency.p99_ms = percentile( 0.99 );
+        message.latency.max_ms = mSorted.back();
+    }
+    mLcmObject.publish( config.lcmChannels.navLatencyChannel, &message );
+
+    cerr << "Latency test: " << message.step << " step ";
+    if( latencyMs >= 0 )
+    {
+        cerr << latencyMs << " ms";
+    }
+    else
+    {
+        cerr << "missed";
+    }
+    cerr << ", p50 " << message.latency.p50_ms << " p90 " << message.latency.p90_ms
+         << " p99 " << message.latency.p99_ms << " max " << message.latency.max_ms
+         << " ms over " << mCount << ", " << mMissed << " of " << mSteps << " missed\n";
+} // finishStep()
+
+// Returns true if joystick differs from the command sent before the
+// step by more than the minimum change, false otherwise.
+bool LatencyTest::isResponse( const NavConfig::LatencyTest& config, const Joystick& joystick ) const
+{
+    return fabs( joystick.forward_back - mBaseline.forward_back ) > config.minChange ||
+           fabs( joystick.left_right - mBaseline.left_right ) > config.minChange;
+} // isResponse()
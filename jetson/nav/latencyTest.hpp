@@ -0,0 +1,67 @@
+#ifndef LATENCY_TEST_HPP
+#define LATENCY_TEST_HPP
+
+#include <lcm/lcm-cpp.hpp>
+#include <vector>
+
+#include "navConfig.hpp"
+#include "rover_msgs/Joystick.hpp"
+#include "rover_msgs/NavLatency.hpp"
+#include "rover_msgs/PerceptionFrame.hpp"
+
+using namespace rover_msgs;
+
+// This class measures how long nav takes from a perception event to
+// the joystick command that responds to it. Every run it publishes a
+// perception frame the way perception would, and every step period it
+// switches between a frame with nothing in it and one with the
+// configured target or obstacle. The first joystick command after the
+// step is injected that differs from the one before it is the response,
+// so the latency covers LCM, the input mailboxes, the obstacle filter,
+// and however many runs the state machine takes to react.
+class LatencyTest
+{
+public:
+    LatencyTest( lcm::LCM& lcmObject );
+
+    void update( const NavConfig& config, const int64_t nowUs,
+                 const Joystick& joystick, const int64_t joystickUs );
+
+private:
+    void publishFrame( const NavConfig::LatencyTest& config, const int64_t nowUs );
+
+    void finishStep( const NavConfig& config, const double latencyMs );
+
+    bool isResponse( const NavConfig::LatencyTest& config, const Joystick& joystick ) const;
+
+    // Lcm object the frames and summaries are sent on.
+    lcm::LCM& mLcmObject;
+
+    // The frame sent every run, only its contents change.
+    PerceptionFrame mFrame;
+
+    // Whether the step is in the frames, when it last changed, and the
+    // number of frames sent.
+    bool mStepOn;
+    int64_t mStepUs;
+    int64_t mFrameSeq;
+
+    // Whether the step that is on has been responded to yet, and the
+    // joystick command sent before it was injected.
+    bool mWaiting;
+    Joystick mBaseline;
+
+    // The last window latencies in milliseconds, the next one to
+    // overwrite, and how many there are. Sorted into mSorted when
+    // summarized.
+    std::vector<double> mSamples;
+    size_t mNext;
+    size_t mCount;
+    std::vector<double> mSorted;
+
+    // Steps injected and steps not responded to since the test started.
+    int mSteps;
+    int mMissed;
+};
+
+#endif // LATENCY_TEST_HPP
@@ -0,0 +1,122 @@
+#include "legPlanner.hpp"
+
+#include <utility>
+
+using namespace std;
+
+// Starts the planner thread, with nothing to plan yet.
+LegPlanner::LegPlanner()
+    : mRequestedCoverage{ { 0, 0 }, 0, 0 }
+    , mRequested( false )
+    , mStopping( false )
+{
+    mReady.hasSearch = false;
+    mReady.hasCoverage = false;
+    mWorking.hasSearch = false;
+    mWorking.hasCoverage = false;
+    mThread = thread( &LegPlanner::work, this );
+} // LegPlanner()
+
+// Stops the planner thread, dropping whatever it is asked to plan.
+LegPlanner::~LegPlanner()
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        mStopping = true;
+    }
+    mWake.notify_one();
+    mThread.join();
+} // ~LegPlanner()
+
+// Asks for the search and coverage grid of the next search leg. Only
+// the settings of search are used, not its points. Asking for the leg
+// that was last asked for does nothing, so this can be called on every
+// run. A newer request replaces one the planner hasn't started.
+void LegPlanner::request( const SearchPlan& search, const Coverage& coverage )
+{
+    {
+        lock_guard<mutex> lock( mMutex );
+        if( mRequestedSearch.sameSearch( search ) && sameCoverage( mRequestedCoverage, coverage ) )
+        {
+            return;
+        }
+        mRequestedSearch.type = search.type;
+        mRequestedSearch.center = search.center;
+        mRequestedSearch.distance = search.distance;
+        mRequestedSearch.bailThresh = search.bailThresh;
+        mRequestedSearch.maxGap = search.maxGap;
+        mRequestedCoverage = coverage;
+        mRequested = true;
+    }
+    mWake.notify_one();
+} // request()
+
+// Gives search the planned points if they were planned for its
+// settings. The points search had are kept for the next plan, so this
+// never allocates. Returns false if no such plan is ready.
+bool LegPlanner::takeSearch( SearchPlan& search )
+{
+    lock_guard<mutex> lock( mMutex );
+    if( !mReady.hasSearch || !mReady.search.sameSearch( search ) )
+    {
+        return false;
+    }
+    swap( search.points, mReady.search.points );
+    mReady.hasSearch = false;
+    return true;
+} // takeSearch()
+
+// Gives grid the planned coverage grid if it was planned for coverage.
+// The grid's old memory is kept for the next plan. Returns false if no
+// such grid is ready.
+bool LegPlanner::takeCoverage( const Coverage& coverage, CoverageGrid& grid )
+{
+    lock_guard<mutex> lock( mMutex );
+    if( !mReady.hasCoverage || !sameCoverage( mReady.coverage, coverage ) )
+    {
+        return false;
+    }
+    grid.swap( mReady.grid );
+    mReady.hasCoverage = false;
+    return true;
+} // takeCoverage()
+
+// Plans every leg asked for until the planner stops. Planning happens
+// without the lock, so the control thread never waits on it.
+void LegPlanner::work()
+{
+    unique_lock<mutex> lock( mMutex );
+    while( true )
+    {
+        mWake.wait( lock, [this]() { return mRequested || mStopping; } );
+        if( mStopping )
+        {
+            return;
+        }
+        mWorking.search.type = mRequestedSearch.type;
+        mWorking.search.center = mRequestedSearch.center;
+        mWorking.search.distance = mRequestedSearch.distance;
+        mWorking.search.bailThresh = mRequestedSearch.bailThresh;
+        mWorking.search.maxGap = mRequestedSearch.maxGap;
+        mWorking.coverage = mRequestedCoverage;
+        mRequested = false;
+        lock.unlock();
+
+        planSearch( mWorking.search );
+        mWorking.grid.reset( mWorking.coverage.center, mWorking.coverage.halfWidth, mWorking.coverage.cellSize );
+
+        lock.lock();
+        mWorking.hasSearch = true;
+        mWorking.hasCoverage = true;
+        swap( mReady, mWorking );
+    }
+} // work()
+
+// Returns true if the two coverage grids are the same, false otherwise.
+bool LegPlanner::sameCoverage( const Coverage& coverage1, const Coverage& coverage2 )
+{
+    return coverage1.center.east == coverage2.center.east &&
+           coverage1.center.north == coverage2.center.north &&
+           coverage1.halfWidth == coverage2.halfWidth &&
+           coverage1.cellSize == coverage2.cellSize;
+} // sameCoverage()
@@ -0,0 +1,75 @@
+#ifndef LEG_PLANNER_HPP
+#define LEG_PLANNER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "search/coverageGrid.hpp"
+#include "search/searchPlan.hpp"
+
+// This class plans the next search leg on its own thread while the
+// rover drives to it: the points of the search the rover will start
+// there and the coverage grid around the waypoint. The control thread
+// asks for a plan whenever the next leg changes, and takes it once the
+// rover arrives, so arriving at a waypoint or starting its search
+// doesn't plan or allocate on the control thread. A plan that isn't
+// ready, or was made for other settings, isn't used, and the control
+// thread plans the leg itself as it did before.
+class LegPlanner
+{
+public:
+    // The coverage grid a search leg starts with.
+    struct Coverage
+    {
+        LocalPoint center;
+        double halfWidth;
+        double cellSize;
+    };
+
+    LegPlanner();
+
+    ~LegPlanner();
+
+    void request( const SearchPlan& search, const Coverage& coverage );
+
+    bool takeSearch( SearchPlan& search );
+
+    bool takeCoverage( const Coverage& coverage, CoverageGrid& grid );
+
+private:
+    // A planned leg, and whether each part is still there to be taken.
+    struct Leg
+    {
+        SearchPlan search;
+        Coverage coverage;
+        CoverageGrid grid;
+        bool hasSearch;
+        bool hasCoverage;
+    };
+
+    void work();
+
+    static bool sameCoverage( const Coverage& coverage1, const Coverage& coverage2 );
+
+    // Guards everything below but mWorking, which only the planner
+    // thread uses.
+    std::mutex mMutex;
+    std::condition_variable mWake;
+
+    // The leg the planner is asked for, whether the request hasn't been
+    // started yet, and whether the planner is stopping.
+    SearchPlan mRequestedSearch;
+    Coverage mRequestedCoverage;
+    bool mRequested;
+    bool mStopping;
+
+    // The last planned leg, and the one being planned. They swap once
+    // a plan is done, so their memory is reused from leg to leg.
+    Leg mReady;
+    Leg mWorking;
+
+    std::thread mThread;
+};
+
+#endif // LEG_PLANNER_HPP
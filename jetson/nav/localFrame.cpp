@@ -0,0 +1,100 @@
+#include "localFrame.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+
+// Constructs an unanchored local frame.
+LocalFrame::LocalFrame()
+    : mAnchored( false )
+    , mOriginLatMin( 0 )
+    , mOriginLonMin( 0 )
+    , mLongMeterInMinutes( -1 )
+{
+} // LocalFrame()
+
+// Moves the frame's anchor to origin. This is the only place that
+// needs trig, to find the length of a longitude minute.
+void LocalFrame::anchor( const Odometry& origin )
+{
+    mOriginLatMin = origin.latitude_deg * 60 + origin.latitude_min;
+    mOriginLonMin = origin.longitude_deg * 60 + origin.longitude_min;
+    mLongMeterInMinutes = 60 / ( EARTH_CIRCUM * cos( degreeToRadian(
+        origin.latitude_deg, origin.latitude_min ) ) / 360 );
+    mAnchored = true;
+} // anchor()
+
+// Returns true if the frame has been anchored, false otherwise.
+bool LocalFrame::anchored() const
+{
+    return mAnchored;
+} // anchored()
+
+// Converts the odometry into meters east and north of the anchor.
+LocalPoint LocalFrame::toLocal( const Odometry& odom ) const
+{
+    LocalPoint point;
+    point.east = ( odom.longitude_deg * 60 + odom.longitude_min - mOriginLonMin ) / mLongMeterInMinutes;
+    point.north = ( odom.latitude_deg * 60 + odom.latitude_min - mOriginLatMin ) / LAT_METER_IN_MINUTES;
+    return point;
+} // toLocal()
+
+// Converts the local point back into an odometry. The bearing and
+// speed are copied from base.
+Odometry LocalFrame::toOdometry( const LocalPoint& point, const Odometry& base ) const
+{
+    Odometry odom = base;
+    double totalLatMin = mOriginLatMin + point.north * LAT_METER_IN_MINUTES;
+    double totalLonMin = mOriginLonMin + point.east * mLongMeterInMinutes;
+    odom.latitude_deg = int( totalLatMin / 60 );
+    odom.latitude_min = totalLatMin - odom.latitude_deg * 60;
+    odom.longitude_deg = int( totalLonMin / 60 );
+    odom.longitude_min = totalLonMin - odom.longitude_deg * 60;
+    return odom;
+} // toOdometry()
+
+// Calculates the distance in meters between the two odometries.
+double LocalFrame::distance( const Odometry& start, const Odometry& dest ) const
+{
+    return ::distance( toLocal( start ), toLocal( dest ) );
+} // distance()
+
+// Calculates the absolute bearing in degrees from start to dest.
+double LocalFrame::bearing( const Odometry& start, const Odometry& dest ) const
+{
+    return ::bearing( toLocal( start ), toLocal( dest ) );
+} // bearing()
+
+// Creates a new odometry at an absolute bearing and distance from start.
+Odometry LocalFrame::offset( const Odometry& start, const double bearing, const double distance ) const
+{
+    return toOdometry( ::offset( toLocal( start ), bearing, distance ), start );
+} // offset()
+
+// Gets the conversion factor from meters to longitude minutes at the
+// anchor's latitude.
+double LocalFrame::longMeterInMinutes() const
+{
+    return mLongMeterInMinutes;
+} // longMeterInMinutes()
+
+// Calculates the distance in meters between the two local points.
+double distance( const LocalPoint& start, const LocalPoint& dest )
+{
+    return hypot( dest.east - start.east, dest.north - start.north );
+} // distance()
+
+// Calculates the absolute bearing in degrees from start to dest, where
+// north is 0 and east is 90.
+double bearing( const LocalPoint& start, const LocalPoint& dest )
+{
+    return mod( radianToDegree( atan2( dest.east - start.east, dest.north - start.north ) ), 360 );
+} // bearing()
+
+// Creates a new local point at an absolute bearing and distance from start.
+LocalPoint offset( const LocalPoint& start, const double bearing, const double distance )
+{
+    LocalPoint point;
+    point.east = start.east + distance * sin( degreeToRadian( bearing ) );
+    point.north = start.north + distance * cos( degreeToRadian( bearing ) );
+    return point;
+} // offset()
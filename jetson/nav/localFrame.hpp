@@ -0,0 +1,59 @@
+#ifndef LOCAL_FRAME_HPP
+#define LOCAL_FRAME_HPP
+
+#include "rover_msgs/Odometry.hpp"
+
+using namespace rover_msgs;
+
+// A point in the local frame, in meters east and north of the anchor.
+struct LocalPoint
+{
+    double east;
+    double north;
+};
+
+// This class is a flat east-north tangent frame anchored at a single
+// odometry point. Converting into the frame is only a few
+// multiplications, so distances and bearings between points near the
+// anchor are plain 2D math instead of spherical trig.
+class LocalFrame
+{
+public:
+    LocalFrame();
+
+    void anchor( const Odometry& origin );
+
+    bool anchored() const;
+
+    LocalPoint toLocal( const Odometry& odom ) const;
+
+    Odometry toOdometry( const LocalPoint& point, const Odometry& base ) const;
+
+    double distance( const Odometry& start, const Odometry& dest ) const;
+
+    double bearing( const Odometry& start, const Odometry& dest ) const;
+
+    Odometry offset( const Odometry& start, const double bearing, const double distance ) const;
+
+    double longMeterInMinutes() const;
+
+private:
+    // Whether anchor has been called.
+    bool mAnchored;
+
+    // The anchor's latitude and longitude in total minutes.
+    double mOriginLatMin;
+    double mOriginLonMin;
+
+    // The conversion factor from meters to longitude minutes at the
+    // anchor's latitude.
+    double mLongMeterInMinutes;
+};
+
+double distance( const LocalPoint& start, const LocalPoint& dest );
+
+double bearing( const LocalPoint& start, const LocalPoint& dest );
+
+LocalPoint offset( const LocalPoint& start, const double bearing, const double distance );
+
+#endif // LOCAL_FRAME_HPP
@@ -1,79 +1,33 @@
+#include <atomic>
+#include <csignal>
 #include <iostream>
 #include <lcm/lcm-cpp.hpp>
-#include "stateMachine.hpp"
+#include "navComponent.hpp"
+#include "memory_report.hpp"
+#include "rover_runtime.hpp"
+#include "trace.hpp"
 
-using namespace rover_msgs;
 using namespace std;
 
-// This class handles all incoming LCM messages for the autonomous
-// navigation of the rover.
-class LcmHandlers
-{
-public:
-    // Constructs an LcmHandler with the given state machine to work
-    // with.
-    LcmHandlers( StateMachine* stateMachine )
-        : mStateMachine( stateMachine )
-    {}
-
-    // Sends the auton state lcm message to the state machine.
-    void autonState(
-        const lcm::ReceiveBuffer* recieveBuffer,
-        const string& channel,
-        const AutonState* autonState
-        )
-    {
-        mStateMachine->updateRoverStatus( *autonState );
-    }
-
-    // Sends the course lcm message to the state machine.
-    void course(
-        const lcm::ReceiveBuffer* recieveBuffer,
-        const string& channel,
-        const Course* course
-        )
-    {
-        mStateMachine->updateRoverStatus( *course );
-    }
-
-    // Sends the obstacle lcm message to the state machine.
-    void obstacle(
-        const lcm::ReceiveBuffer* receiveBuffer,
-        const string& channel,
-        const Obstacle* obstacle
-        )
-    {
-        mStateMachine->updateRoverStatus( *obstacle );
-    }
+// The component the signal handlers forward to.
+NavComponent* navComponent = nullptr;
 
-    // Sends the odometry lcm message to the state machine.
-    void odometry(
-        const lcm::ReceiveBuffer* recieveBuffer,
-        const string& channel,
-        const Odometry* odometry
-        )
-    {
-        mStateMachine->updateRoverStatus( *odometry );
-    }
-
-    // Sends the target lcm message to the state machine.
-    void targetList(
-        const lcm::ReceiveBuffer* receiveBuffer,
-        const string& channel,
-        const TargetList* targetListIn
-        )
-    {
-        mStateMachine->updateRoverStatus( *targetListIn );
-    }
+// Asks the control loop to reload the config, on SIGHUP.
+void requestReload( int signal )
+{
+    navComponent->requestReload();
+} // requestReload()
 
-private:
-    // The state machine to send the lcm messages to.
-    StateMachine* mStateMachine;
-};
+// Asks the control loop to dump the state change trace, on SIGUSR1.
+void requestDump( int signal )
+{
+    navComponent->requestDump();
+} // requestDump()
 
 // Runs the autonomous navigation of the rover.
 int main()
 {
+    Trace::start( "nav" );
     lcm::LCM lcmObject;
     if( !lcmObject.good() )
     {
@@ -81,18 +35,17 @@ int main()
         return 1;
     }
 
-    StateMachine roverStateMachine( lcmObject );
-    LcmHandlers lcmHandlers( &roverStateMachine );
+    // Sent on /memory/nav every second, from a thread config/threads
+    // places.
+    ThreadConfig threads( "nav" );
+    MemoryReport memoryReport( threads, "nav" );
 
-    lcmObject.subscribe( "/auton", &LcmHandlers::autonState, &lcmHandlers );
-    lcmObject.subscribe( "/course", &LcmHandlers::course, &lcmHandlers );
-    lcmObject.subscribe( "/obstacle", &LcmHandlers::obstacle, &lcmHandlers );
-    lcmObject.subscribe( "/odometry", &LcmHandlers::odometry, &lcmHandlers );
-    lcmObject.subscribe( "/target_list", &LcmHandlers::targetList, &lcmHandlers );
+    NavComponent nav( lcmObject );
+    navComponent = &nav;
+    signal( SIGHUP, requestReload );
+    signal( SIGUSR1, requestDump );
 
-    while( lcmObject.handle() == 0 )
-    {
-        roverStateMachine.run();
-    }
+    atomic<bool> running( true );
+    nav.run( running );
     return 0;
 } // main()
@@ -0,0 +1,243 @@
+#include "navComponent.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <thread>
+
+using namespace rover_msgs;
+using namespace std;
+
+// Mixed into the flow id of a perception message to get the id of the
+// flow on from its handler to the run of the state machine that uses it.
+const uint64_t RUN_FLOW_MASK = 0x6e6176;
+
+// This class handles all incoming LCM messages for the autonomous
+// navigation of the rover.
+class LcmHandlers
+{
+public:
+    // Constructs an LcmHandler with the given state machine to work
+    // with.
+    LcmHandlers( StateMachine* stateMachine, atomic<uint64_t>* perceptionFlow )
+        : mStateMachine( stateMachine )
+        , mPerceptionFlow( perceptionFlow )
+    {}
+
+    // Sends the auton state lcm message to the state machine.
+    void autonState(
+        const lcm::ReceiveBuffer* recieveBuffer,
+        const string& channel,
+        const AutonState* autonState
+        )
+    {
+        mStateMachine->updateRoverStatus( *autonState );
+    }
+
+    // Sends the course lcm message to the state machine.
+    void course(
+        const lcm::ReceiveBuffer* recieveBuffer,
+        const string& channel,
+        const Course* course
+        )
+    {
+        mStateMachine->updateRoverStatus( *course );
+    }
+
+    // Sends the config value lcm message to the state machine.
+    void configValue(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const NavConfigValue* configValue
+        )
+    {
+        mStateMachine->updateConfig( *configValue );
+    }
+
+    // Sends the pid constants lcm message to the state machine.
+    void pidConstants(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const PIDConstants* pidConstants
+        )
+    {
+        mStateMachine->updateConfig( *pidConstants );
+    }
+
+    // Sends the odometry lcm message to the state machine.
+    void odometry(
+        const lcm::ReceiveBuffer* recieveBuffer,
+        const string& channel,
+        const Odometry::View* odometryView
+        )
+    {
+        // Decoded straight from the receive buffer into the copy the
+        // state machine keeps
+        Odometry odometry;
+        odometryView->get( &odometry );
+        mStateMachine->updateRoverStatus( odometry );
+    }
+
+    // Sends the visual odometry lcm message to the state machine.
+    void visualOdometry(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const VisualOdometry::View* visualOdometryView
+        )
+    {
+        VisualOdometry visualOdometry;
+        visualOdometryView->get( &visualOdometry );
+        mStateMachine->updateRoverStatus( visualOdometry );
+    }
+
+    // Sends the workload governor lcm message to the state machine.
+    void workloadGovernor(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const WorkloadGovernor* governor
+        )
+    {
+        mStateMachine->updateRoverStatus( *governor );
+    }
+
+    // Sends the perception latency lcm message to the state machine.
+    void perceptionLatency(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const PerceptionLatency* perceptionLatency
+        )
+    {
+        mStateMachine->updateRoverStatus( *perceptionLatency );
+    }
+
+    // Sends the perception frame lcm message to the state machine.
+    void perceptionFrame(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const PerceptionFrame* perceptionFrame
+        )
+    {
+        Trace::Span span( "perception frame" );
+        tracePerception( receiveBuffer );
+        mStateMachine->updateRoverStatus( *perceptionFrame );
+    }
+
+private:
+    // Ends the flow of a perception message from its publisher and
+    // starts the one to the next run of the state machine.
+    void tracePerception( const lcm::ReceiveBuffer* receiveBuffer )
+    {
+        if( Trace::enabled() )
+        {
+            const uint64_t flow = Trace::messageId( receiveBuffer->data, receiveBuffer->data_size );
+            Trace::flowIn( flow );
+            Trace::flowOut( flow ^ RUN_FLOW_MASK );
+            mPerceptionFlow->store( flow ^ RUN_FLOW_MASK );
+        }
+    }
+
+    // The state machine to send the lcm messages to.
+    StateMachine* mStateMachine;
+
+    // Where the flow of the newest perception message is left for run().
+    atomic<uint64_t>* mPerceptionFlow;
+};
+
+// Constructs the state machine and subscribes it to its messages.
+NavComponent::NavComponent( lcm::LCM& lcmObject, bool perceptionInProcess )
+    : mLcmObject( lcmObject )
+    , mStateMachine( lcmObject )
+    , mLcmHandlers( new LcmHandlers( &mStateMachine, &mPerceptionFlow ) )
+    , mReloadRequested( false )
+    , mDumpRequested( false )
+    , mPerceptionFlow( 0 )
+{
+    LcmHandlers* handlers = mLcmHandlers.get();
+    mLcmObject.subscribe( "/auton", &LcmHandlers::autonState, handlers );
+    mLcmObject.subscribe( "/course", &LcmHandlers::course, handlers );
+    // Only the newest pose matters, so a backlog of odometry is skipped
+    // instead of decoded and handled one message at a time.
+    mLcmObject.subscribe( "/odometry", &LcmHandlers::odometry, handlers )->setLatestOnly();
+    mLcmObject.subscribe( "/nav_config_value", &LcmHandlers::configValue, handlers );
+    mLcmObject.subscribe( "/nav_pidconfig_cmd", &LcmHandlers::pidConstants, handlers );
+    // Every delta counts, so unlike odometry none are skipped. Perception
+    // publishes these over LCM even when it runs in this process.
+    mLcmObject.subscribe( "/visual_odometry", &LcmHandlers::visualOdometry, handlers );
+    mLcmObject.subscribe( "/workload_governor", &LcmHandlers::workloadGovernor, handlers )->setLatestOnly();
+    if( !perceptionInProcess )
+    {
+        mLcmObject.subscribe( "/perception_frame", &LcmHandlers::perceptionFrame, handlers );
+        mLcmObject.subscribe( "/perception_latency", &LcmHandlers::perceptionLatency, handlers );
+    }
+} // NavComponent()
+
+// The handlers are only declared in the header, so they're destroyed
+// here where they're complete.
+NavComponent::~NavComponent()
+{
+} // ~NavComponent()
+
+// Handles LCM messages and runs the state machine until running is
+// cleared.
+void NavComponent::run( atomic<bool>& running )
+{
+    // LCM messages are handled on their own thread and only update the
+    // rover status, so the control rate doesn't depend on message arrival.
+    thread lcmThread( [&]()
+    {
+        while( running && mLcmObject.handleTimeout( 100 ) >= 0 ) {}
+        running = false;
+    } );
+
+    // Runs the state machine at a fixed rate. If an iteration overruns
+    // the schedule restarts from now instead of running back to back.
+    // Turning auton on or off or a new course runs it right away, in
+    // place of the next scheduled run.
+    const auto controlPeriod = mStateMachine.controlPeriod();
+    auto nextRun = chrono::steady_clock::now();
+    while( running )
+    {
+        if( mReloadRequested.exchange( false ) )
+        {
+            mStateMachine.reloadConfig();
+        }
+        if( mDumpRequested.exchange( false ) )
+        {
+            mStateMachine.dumpTrace();
+        }
+        {
+            Trace::Span span( "state machine" );
+            const uint64_t perceptionFlow = mPerceptionFlow.exchange( 0 );
+            if( perceptionFlow != 0 )
+            {
+                Trace::flowIn( perceptionFlow );
+            }
+            mStateMachine.run();
+        }
+        nextRun += controlPeriod;
+        auto now = chrono::steady_clock::now();
+        if( nextRun < now )
+        {
+            nextRun = now;
+        }
+        mStateMachine.waitForInput( nextRun );
+    }
+
+    lcmThread.join();
+} // run()
+
+// Asks the control loop to reload the config.
+void NavComponent::requestReload()
+{
+    mReloadRequested = true;
+} // requestReload()
+
+// Asks the control loop to dump the trace.
+void NavComponent::requestDump()
+{
+    mDumpRequested = true;
+} // requestDump()
+
+StateMachine& NavComponent::stateMachine()
+{
+    return mStateMachine;
+} // stateMachine()
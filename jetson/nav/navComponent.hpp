@@ -0,0 +1,55 @@
+#ifndef NAV_COMPONENT_HPP
+#define NAV_COMPONENT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <lcm/lcm-cpp.hpp>
+#include "stateMachine.hpp"
+
+class LcmHandlers;
+
+// The autonomous navigation of the rover, as a component that can run in
+// its own process (main.cpp) or share one with other components on the
+// same LCM object.
+class NavComponent
+{
+public:
+    // Constructs the state machine and subscribes it to its messages. If
+    // perceptionInProcess is set, the perception outputs (the perception
+    // frame and latency) aren't subscribed to, since whatever hosts the
+    // component hands them to stateMachine() directly.
+    NavComponent( lcm::LCM& lcmObject, bool perceptionInProcess = false );
+
+    ~NavComponent();
+
+    // Handles LCM messages on their own thread and runs the state machine
+    // at its control rate until running is cleared or LCM fails, which
+    // clears it.
+    void run( std::atomic<bool>& running );
+
+    // Asks the control loop to reload the config, or to dump the state
+    // change trace, before the next run of the state machine. Safe to
+    // call from a signal handler.
+    void requestReload();
+    void requestDump();
+
+    StateMachine& stateMachine();
+
+private:
+    lcm::LCM& mLcmObject;
+
+    StateMachine mStateMachine;
+
+    std::unique_ptr<LcmHandlers> mLcmHandlers;
+
+    std::atomic<bool> mReloadRequested;
+
+    std::atomic<bool> mDumpRequested;
+
+    // Trace flow id from the newest perception message to the next run
+    // of the state machine, 0 if it has been used. Only set while tracing.
+    std::atomic<uint64_t> mPerceptionFlow;
+};
+
+#endif // NAV_COMPONENT_HPP
@@ -0,0 +1,336 @@
+#include "navConfig.hpp"
+#include "temporal_filter.hpp"
+
+#include <map>
+
+namespace
+{
+    // Gets the object named name in parent. Returns nullptr if there is
+    // no such object.
+    const rapidjson::Value* section( const rapidjson::Value& parent, const char* name )
+    {
+        if( !parent.IsObject() || !parent.HasMember( name ) || !parent[ name ].IsObject() )
+        {
+            return nullptr;
+        }
+        return &parent[ name ];
+    }
+
+    // Reads the number named name in section into value. Returns false
+    // if there is no such number.
+    bool read( const rapidjson::Value* section, const char* name, double& value )
+    {
+        if( !section || !section->HasMember( name ) || !( *section )[ name ].IsNumber() )
+        {
+            return false;
+        }
+        value = ( *section )[ name ].GetDouble();
+        return true;
+    }
+
+    // Reads the integer named name in section into value. Returns false
+    // if there is no such integer.
+    bool read( const rapidjson::Value* section, const char* name, int& value )
+    {
+        if( !section || !section->HasMember( name ) || !( *section )[ name ].IsInt() )
+        {
+            return false;
+        }
+        value = ( *section )[ name ].GetInt();
+        return true;
+    }
+
+    // Reads the bool named name in section into value. Returns false if
+    // there is no such bool.
+    bool read( const rapidjson::Value* section, const char* name, bool& value )
+    {
+        if( !section || !section->HasMember( name ) || !( *section )[ name ].IsBool() )
+        {
+            return false;
+        }
+        value = ( *section )[ name ].GetBool();
+        return true;
+    }
+
+    // Reads the pid settings in section into pid. Returns false if any
+    // are missing.
+    bool read( const rapidjson::Value* section, NavConfig::Pid& pid )
+    {
+        return read( section, "kP", pid.kP ) &&
+               read( section, "kI", pid.kI ) &&
+               read( section, "kD", pid.kD ) &&
+               read( section, "antiWindup", pid.antiWindup ) &&
+               read( section, "derivativeFilter", pid.derivativeFilter );
+    }
+
+    // Reads the perception rates in section into rates. Returns false if
+    // any are missing.
+    bool read( const rapidjson::Value* section, NavConfig::PerceptionRates::Rates& rates )
+    {
+        return read( section, "arHz", rates.arHz ) &&
+               read( section, "obstacleHz", rates.obstacleHz );
+    }
+
+    // Reads the string named name in section into value. Returns false
+    // if there is no such string.
+    bool read( const rapidjson::Value* section, const char* name, std::string& value )
+    {
+        if( !section || !section->HasMember( name ) || !( *section )[ name ].IsString() )
+        {
+            return false;
+        }
+        value = ( *section )[ name ].GetString();
+        return true;
+    }
+
+    // Reads the array of integers named name in section into values.
+    // Returns false if there is no such array.
+    bool read( const rapidjson::Value* section, const char* name, std::vector<int>& values )
+    {
+        if( !section || !section->HasMember( name ) || !( *section )[ name ].IsArray() )
+        {
+            return false;
+        }
+        values.clear();
+        for( const rapidjson::Value& value : ( *section )[ name ].GetArray() )
+        {
+            if( !value.IsInt() )
+            {
+                return false;
+            }
+            values.push_back( value.GetInt() );
+        }
+        return true;
+    }
+
+    // Returns true if filter is a fraction a pid derivative filter can
+    // keep, false otherwise.
+    bool isFilter( const double filter )
+    {
+        return filter >= 0 && filter < 1;
+    }
+
+    // Returns true if the obstacle filter's counts fit in its window and
+    // the window fits in the filter, false otherwise.
+    bool isFilterRule( const NavConfig::ObstacleFilter& filter )
+    {
+        return filter.window >= 1 && filter.window <= TemporalFilter::MAX_WINDOW &&
+               filter.onCount >= 1 && filter.onCount <= filter.window &&
+               filter.offCount >= 1 && filter.offCount <= filter.window;
+    }
+
+    // Gets a pointer to one setting of config.
+    typedef double* ( *NumberSetting )( NavConfig& config );
+
+    // The settings that can be changed while nav is running. Settings
+    // only read at startup and ones with other types aren't here.
+    const std::map<std::string, NumberSetting>& tunableSettings()
+    {
+        static const std::map<std::string, NumberSetting> settings =
+        {
+            { "bearingPid.kP", []( NavConfig& c ) { return &c.bearingPid.kP; } },
+            { "bearingPid.kI", []( NavConfig& c ) { return &c.bearingPid.kI; } },
+            { "bearingPid.kD", []( NavConfig& c ) { return &c.bearingPid.kD; } },
+            { "bearingPid.derivativeFilter", []( NavConfig& c ) { return &c.bearingPid.derivativeFilter; } },
+            { "distancePid.kP", []( NavConfig& c ) { return &c.distancePid.kP; } },
+            { "distancePid.kI", []( NavConfig& c ) { return &c.distancePid.kI; } },
+            { "distancePid.kD", []( NavConfig& c ) { return &c.distancePid.kD; } },
+            { "distancePid.derivativeFilter", []( NavConfig& c ) { return &c.distancePid.derivativeFilter; } },
+            { "control.navStatusPeriod", []( NavConfig& c ) { return &c.control.navStatusPeriod; } },
+            { "joystick.bearingPower", []( NavConfig& c ) { return &c.joystick.bearingPower; } },
+            { "joystick.drivingPower", []( NavConfig& c ) { return &c.joystick.drivingPower; } },
+            { "joystick.dampen", []( NavConfig& c ) { return &c.joystick.dampen; } },
+            { "navThresholds.turningBearing", []( NavConfig& c ) { return &c.navThresholds.turningBearing; } },
+            { "navThresholds.drivingBearing", []( NavConfig& c ) { return &c.navThresholds.drivingBearing; } },
+            { "navThresholds.waypointDistance", []( NavConfig& c ) { return &c.navThresholds.waypointDistance; } },
+            { "navThresholds.targetDistance", []( NavConfig& c ) { return &c.navThresholds.targetDistance; } },
+            { "navThresholds.minTurningEffort", []( NavConfig& c ) { return &c.navThresholds.minTurningEffort; } },
+            { "navThresholds.gateCenteredAngleDiff", []( NavConfig& c ) { return &c.navThresholds.gateCenteredAngleDiff; } },
+            { "navThresholds.obstacleDistanceThreshold", []( NavConfig& c ) { return &c.navThresholds.obstacleDistanceThreshold; } },
+            { "pathFollowing.minLookahead", []( NavConfig& c ) { return &c.pathFollowing.minLookahead; } },
+            { "pathFollowing.maxLookahead", []( NavConfig& c ) { return &c.pathFollowing.maxLookahead; } },
+            { "pathFollowing.lookaheadTime", []( NavConfig& c ) { return &c.pathFollowing.lookaheadTime; } },
+            { "pathFollowing.turnGain", []( NavConfig& c ) { return &c.pathFollowing.turnGain; } },
+            { "gate.turningRadius", []( NavConfig& c ) { return &c.gate.turningRadius; } },
+            { "gate.pathSpacing", []( NavConfig& c ) { return &c.gate.pathSpacing; } },
+            { "gate.replanDistance", []( NavConfig& c ) { return &c.gate.replanDistance; } },
+            { "gate.postRangeError", []( NavConfig& c ) { return &c.gate.postRangeError; } },
+            { "gate.postBearingError", []( NavConfig& c ) { return &c.gate.postBearingError; } },
+            { "gate.postMaxError", []( NavConfig& c ) { return &c.gate.postMaxError; } },
+            { "computerVision.maxDetectionAge", []( NavConfig& c ) { return &c.computerVision.maxDetectionAge; } },
+            { "visualOdometry.maxFixAge", []( NavConfig& c ) { return &c.visualOdometry.maxFixAge; } },
+            { "search.bailThresh", []( NavConfig& c ) { return &c.search.bailThresh; } },
+            { "search.searchWaitStepSize", []( NavConfig& c ) { return &c.search.searchWaitStepSize; } },
+            { "search.searchWaitTime", []( NavConfig& c ) { return &c.search.searchWaitTime; } },
+            { "search.coveredFraction", []( NavConfig& c ) { return &c.search.coveredFraction; } },
+            { "search.obstacleShift", []( NavConfig& c ) { return &c.search.obstacleShift; } },
+            { "search.targetMemoryTime", []( NavConfig& c ) { return &c.search.targetMemoryTime; } },
+            { "search.spinFramesPerHeading", []( NavConfig& c ) { return &c.search.spinFramesPerHeading; } },
+            { "search.spinMaxRate", []( NavConfig& c ) { return &c.search.spinMaxRate; } },
+            { "search.spinFallbackDetectionRate", []( NavConfig& c ) { return &c.search.spinFallbackDetectionRate; } },
+            { "search.driveSpeed", []( NavConfig& c ) { return &c.search.driveSpeed; } },
+            { "search.turnRate", []( NavConfig& c ) { return &c.search.turnRate; } }
+        };
+        return settings;
+    }
+} // namespace
+
+// Reads the nav config out of the parsed json document. Returns false,
+// leaving config unchanged, if any setting is missing or has the wrong
+// type, so a bad file can't leave the rover with half of its settings.
+bool readNavConfig( const rapidjson::Document& document, NavConfig& config )
+{
+    NavConfig newConfig;
+    std::string pathFollowingMode;
+    std::string gateApproach;
+    std::string spinMode;
+    std::string courseOrderMode;
+    std::string latencyTestMode;
+    std::string searchSelection;
+
+    const rapidjson::Value* control = section( document, "control" );
+    const rapidjson::Value* joystick = section( document, "joystick" );
+    const rapidjson::Value* navThresholds = section( document, "navThresholds" );
+    const rapidjson::Value* obstacleFilter = section( document, "obstacleFilter" );
+    const rapidjson::Value* pathFollowing = section( document, "pathFollowing" );
+    const rapidjson::Value* courseOrder = section( document, "courseOrder" );
+    const rapidjson::Value* gate = section( document, "gate" );
+    const rapidjson::Value* roverMeasurements = section( document, "roverMeasurements" );
+    const rapidjson::Value* computerVision = section( document, "computerVision" );
+    const rapidjson::Value* lcmChannels = section( document, "lcmChannels" );
+    const rapidjson::Value* search = section( document, "search" );
+    const rapidjson::Value* perceptionRates = section( document, "perceptionRates" );
+    const rapidjson::Value* latencyTest = section( document, "latencyTest" );
+
+    const bool valid =
+        read( section( document, "bearingPid" ), newConfig.bearingPid ) &&
+        read( section( document, "distancePid" ), newConfig.distancePid ) &&
+        read( control, "rateHz", newConfig.control.rateHz ) &&
+        read( control, "navStatusPeriod", newConfig.control.navStatusPeriod ) &&
+        read( joystick, "bearingPower", newConfig.joystick.bearingPower ) &&
+        read( joystick, "drivingPower", newConfig.joystick.drivingPower ) &&
+        read( joystick, "dampen", newConfig.joystick.dampen ) &&
+        read( navThresholds, "turningBearing", newConfig.navThresholds.turningBearing ) &&
+        read( navThresholds, "drivingBearing", newConfig.navThresholds.drivingBearing ) &&
+        read( navThresholds, "waypointDistance", newConfig.navThresholds.waypointDistance ) &&
+        read( navThresholds, "targetDistance", newConfig.navThresholds.targetDistance ) &&
+        read( navThresholds, "minTurningEffort", newConfig.navThresholds.minTurningEffort ) &&
+        read( navThresholds, "gateCenteredAngleDiff", newConfig.navThresholds.gateCenteredAngleDiff ) &&
+        read( navThresholds, "obstacleDistanceThreshold", newConfig.navThresholds.obstacleDistanceThreshold ) &&
+        read( obstacleFilter, "window", newConfig.obstacleFilter.window ) &&
+        read( obstacleFilter, "onCount", newConfig.obstacleFilter.onCount ) &&
+        read( obstacleFilter, "offCount", newConfig.obstacleFilter.offCount ) &&
+        read( pathFollowing, "mode", pathFollowingMode ) &&
+        read( pathFollowing, "minLookahead", newConfig.pathFollowing.minLookahead ) &&
+        read( pathFollowing, "maxLookahead", newConfig.pathFollowing.maxLookahead ) &&
+        read( pathFollowing, "lookaheadTime", newConfig.pathFollowing.lookaheadTime ) &&
+        read( pathFollowing, "turnGain", newConfig.pathFollowing.turnGain ) &&
+        read( courseOrder, "mode", courseOrderMode ) &&
+        read( gate, "approach", gateApproach ) &&
+        read( gate, "turningRadius", newConfig.gate.turningRadius ) &&
+        read( gate, "pathSpacing", newConfig.gate.pathSpacing ) &&
+        read( gate, "replanDistance", newConfig.gate.replanDistance ) &&
+        read( gate, "postRangeError", newConfig.gate.postRangeError ) &&
+        read( gate, "postBearingError", newConfig.gate.postBearingError ) &&
+        read( gate, "postMaxError", newConfig.gate.postMaxError ) &&
+        read( roverMeasurements, "width", newConfig.roverMeasurements.width ) &&
+        read( computerVision, "visionDistance", newConfig.computerVision.visionDistance ) &&
+        read( computerVision, "fieldOfViewAngle", newConfig.computerVision.fieldOfViewAngle ) &&
+        read( computerVision, "fieldOfViewSafeAngle", newConfig.computerVision.fieldOfViewSafeAngle ) &&
+        read( computerVision, "maxDetectionAge", newConfig.computerVision.maxDetectionAge ) &&
+        read( section( document, "visualOdometry" ), "maxFixAge", newConfig.visualOdometry.maxFixAge ) &&
+        read( lcmChannels, "navStatusChannel", newConfig.lcmChannels.navStatusChannel ) &&
+        read( lcmChannels, "joystickChannel", newConfig.lcmChannels.joystickChannel ) &&
+        read( lcmChannels, "navTraceChannel", newConfig.lcmChannels.navTraceChannel ) &&
+        read( lcmChannels, "perceptionRatesChannel", newConfig.lcmChannels.perceptionRatesChannel ) &&
+        read( lcmChannels, "navLatencyChannel", newConfig.lcmChannels.navLatencyChannel ) &&
+        read( search, "order", newConfig.search.order ) &&
+        read( search, "numSearches", newConfig.search.numSearches ) &&
+        read( search, "bailThresh", newConfig.search.bailThresh ) &&
+        read( search, "searchWaitStepSize", newConfig.search.searchWaitStepSize ) &&
+        read( search, "searchWaitTime", newConfig.search.searchWaitTime ) &&
+        read( search, "coverageCellSize", newConfig.search.coverageCellSize ) &&
+        read( search, "coveredFraction", newConfig.search.coveredFraction ) &&
+        read( search, "obstacleShift", newConfig.search.obstacleShift ) &&
+        read( search, "targetMemoryTime", newConfig.search.targetMemoryTime ) &&
+        read( search, "spinMode", spinMode ) &&
+        read( search, "spinFramesPerHeading", newConfig.search.spinFramesPerHeading ) &&
+        read( search, "spinMaxRate", newConfig.search.spinMaxRate ) &&
+        read( search, "spinFallbackDetectionRate", newConfig.search.spinFallbackDetectionRate ) &&
+        read( search, "preplan", newConfig.search.preplan ) &&
+        read( search, "selection", searchSelection ) &&
+        read( search, "driveSpeed", newConfig.search.driveSpeed ) &&
+        read( search, "turnRate", newConfig.search.turnRate ) &&
+        perceptionRates &&
+        read( section( *perceptionRates, "drive" ), newConfig.perceptionRates.drive ) &&
+        read( section( *perceptionRates, "search" ), newConfig.perceptionRates.search ) &&
+        read( section( *perceptionRates, "target" ), newConfig.perceptionRates.target ) &&
+        read( section( *perceptionRates, "avoidance" ), newConfig.perceptionRates.avoidance ) &&
+        read( latencyTest, "mode", latencyTestMode ) &&
+        read( latencyTest, "period", newConfig.latencyTest.period ) &&
+        read( latencyTest, "window", newConfig.latencyTest.window ) &&
+        read( latencyTest, "minChange", newConfig.latencyTest.minChange ) &&
+        read( latencyTest, "distance", newConfig.latencyTest.distance ) &&
+        read( latencyTest, "bearing", newConfig.latencyTest.bearing );
+
+    // The search order is indexed by the number of failed searches mod
+    // numSearches, so it must have that many entries.
+    if( !valid || newConfig.control.rateHz <= 0 || newConfig.search.numSearches <= 0 ||
+        int( newConfig.search.order.size() ) < newConfig.search.numSearches ||
+        newConfig.search.spinFramesPerHeading <= 0 ||
+        newConfig.search.driveSpeed <= 0 || newConfig.search.turnRate <= 0 ||
+        newConfig.latencyTest.period <= 0 || newConfig.latencyTest.window <= 0 ||
+        !isFilterRule( newConfig.obstacleFilter ) ||
+        !isFilter( newConfig.bearingPid.derivativeFilter ) || !isFilter( newConfig.distancePid.derivativeFilter ) )
+    {
+        return false;
+    }
+    newConfig.pathFollowing.purePursuit = pathFollowingMode == "purePursuit";
+    newConfig.courseOrder.optimize = courseOrderMode == "optimize";
+    newConfig.gate.trajectory = gateApproach == "trajectory";
+    newConfig.search.continuousSpin = spinMode == "continuous";
+    newConfig.search.predictSelection = searchSelection == "predict";
+    newConfig.latencyTest.enabled = latencyTestMode == "target" || latencyTestMode == "obstacle";
+    newConfig.latencyTest.obstacle = latencyTestMode == "obstacle";
+    config = newConfig;
+    return true;
+} // readNavConfig()
+
+// Reads and parses the nav config file at path. Returns false if the
+// file can't be read or parsed.
+bool loadNavConfig( const std::string& path, ConfigFile& document )
+{
+    return document.load( path ) && document.IsObject();
+} // loadNavConfig()
+
+// Changes the setting named like "navThresholds.turningBearing" to
+// value. The pid anti windup switches and search.continuousSpin are
+// set by any nonzero value.
+// Returns false if there is no such setting that can be changed while
+// nav is running, or the value isn't allowed.
+bool setNavConfigValue( NavConfig& config, const std::string& name, const double value )
+{
+    if( name == "bearingPid.antiWindup" || name == "distancePid.antiWindup" )
+    {
+        ( name[ 0 ] == 'b' ? config.bearingPid : config.distancePid ).antiWindup = value != 0;
+        return true;
+    }
+    if( name == "search.continuousSpin" )
+    {
+        config.search.continuousSpin = value != 0;
+        return true;
+    }
+    const auto setting = tunableSettings().find( name );
+    if( setting == tunableSettings().end() )
+    {
+        return false;
+    }
+    if( ( name.find( "derivativeFilter" ) != std::string::npos && !isFilter( value ) ) ||
+        ( ( name == "search.spinFramesPerHeading" || name == "search.driveSpeed" || name == "search.turnRate" ) &&
+          value <= 0 ) )
+    {
+        return false;
+    }
+    *setting->second( config ) = value;
+    return true;
+} // setNavConfigValue()
@@ -0,0 +1,190 @@
+#ifndef NAV_CONFIG_HPP
+#define NAV_CONFIG_HPP
+
+#include <string>
+#include <vector>
+
+#include "config_loader.hpp"
+#include "rapidjson/document.h"
+
+// The parts of the nav config that the state machines read every
+// iteration, parsed once so they are plain member reads instead of
+// string-keyed json lookups. The members are named like the config.
+// Settings only used when nav starts up, like the costmap size, are
+// still read from the json document.
+struct NavConfig
+{
+    struct Pid
+    {
+        double kP;
+        double kI;
+        double kD;
+        bool antiWindup;
+        double derivativeFilter;
+    } bearingPid, distancePid;
+
+    struct Control
+    {
+        double rateHz;
+        double navStatusPeriod;
+    } control;
+
+    struct Joystick
+    {
+        double bearingPower;
+        double drivingPower;
+        double dampen;
+    } joystick;
+
+    struct NavThresholds
+    {
+        double turningBearing;
+        double drivingBearing;
+        double waypointDistance;
+        double targetDistance;
+        double minTurningEffort;
+        double gateCenteredAngleDiff;
+        double obstacleDistanceThreshold;
+    } navThresholds;
+
+    struct ObstacleFilter
+    {
+        int window;
+        int onCount;
+        int offCount;
+    } obstacleFilter;
+
+    struct PathFollowing
+    {
+        // True if the mode is "purePursuit".
+        bool purePursuit;
+        double minLookahead;
+        double maxLookahead;
+        double lookaheadTime;
+        double turnGain;
+    } pathFollowing;
+
+    struct CourseOrder
+    {
+        // True if the mode is "optimize".
+        bool optimize;
+    } courseOrder;
+
+    struct Gate
+    {
+        // True if the approach is "trajectory".
+        bool trajectory;
+        double turningRadius;
+        double pathSpacing;
+        double replanDistance;
+
+        // Error of a post sighting along the line of sight, as a
+        // fraction of its distance, and across it in degrees, and the
+        // largest error in meters a post's fused estimate can have to
+        // be used.
+        double postRangeError;
+        double postBearingError;
+        double postMaxError;
+    } gate;
+
+    struct RoverMeasurements
+    {
+        double width;
+    } roverMeasurements;
+
+    struct ComputerVision
+    {
+        double visionDistance;
+        double fieldOfViewAngle;
+        double fieldOfViewSafeAngle;
+        // Seconds after capture that targets are dropped as not seen, so
+        // the rover doesn't steer by a stale bearing. 0 keeps them all.
+        double maxDetectionAge;
+    } computerVision;
+
+    // How long past a GPS fix, in seconds, perception's visual odometry
+    // keeps moving the rover's odometry on from it. 0 only uses the
+    // fixes.
+    struct VisualOdometry
+    {
+        double maxFixAge;
+    } visualOdometry;
+
+    struct LcmChannels
+    {
+        std::string navStatusChannel;
+        std::string joystickChannel;
+        std::string navTraceChannel;
+        std::string perceptionRatesChannel;
+        std::string navLatencyChannel;
+    } lcmChannels;
+
+    struct Search
+    {
+        std::vector<int> order;
+        int numSearches;
+        double bailThresh;
+        double searchWaitStepSize;
+        double searchWaitTime;
+        double coverageCellSize;
+        double coveredFraction;
+        // Farthest in meters a search point inside a known obstacle is
+        // moved to get it out, points that can't be are skipped.
+        double obstacleShift;
+        double targetMemoryTime;
+        // True if the spin mode is "continuous".
+        bool continuousSpin;
+        double spinFramesPerHeading;
+        double spinMaxRate;
+        double spinFallbackDetectionRate;
+        // True to plan the next search leg in the background while the
+        // rover drives to it.
+        bool preplan;
+        // True if the selection is "predict", which picks the search
+        // and loop distance that is expected to see new ground fastest
+        // instead of going through the order. The rover is expected to
+        // drive at driveSpeed meters a second and turn at turnRate
+        // degrees a second.
+        bool predictSelection;
+        double driveSpeed;
+        double turnRate;
+    } search;
+
+    // Rates in hz nav asks perception to run its workers at while in
+    // each kind of state. 0 runs a worker on every frame and negative
+    // leaves it at the rate in perception's config.
+    struct PerceptionRates
+    {
+        struct Rates
+        {
+            double arHz;
+            double obstacleHz;
+        } drive, search, target, avoidance;
+    } perceptionRates;
+
+    // Injects a synthetic target or obstacle every period seconds, for
+    // period seconds at a time, and times how long nav takes to change
+    // its joystick command by more than minChange, see latencyTest.cpp.
+    // The step is distance meters away at bearing degrees. The last
+    // window latencies are summarized.
+    struct LatencyTest
+    {
+        // True if the mode is "target" or "obstacle".
+        bool enabled;
+        // True if the mode is "obstacle".
+        bool obstacle;
+        double period;
+        int window;
+        double minChange;
+        double distance;
+        double bearing;
+    } latencyTest;
+};
+
+bool readNavConfig( const rapidjson::Document& document, NavConfig& config );
+
+bool loadNavConfig( const std::string& path, ConfigFile& document );
+
+bool setNavConfigValue( NavConfig& config, const std::string& name, const double value );
+
+#endif // NAV_CONFIG_HPP
@@ -0,0 +1,139 @@
+#include "costmapAvoidance.hpp"
+
+#include "stateMachine.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+
+// Constructs a CostmapAvoidance object that plans through costmap.
+CostmapAvoidance::CostmapAvoidance( StateMachine* roverStateMachine, Rover* rover, const rapidjson::Document& roverConfig,
+                                    LocalCostmap& costmap )
+    : ObstacleAvoidanceStateMachine( roverStateMachine, rover, roverConfig )
+    , mCostmap( costmap )
+    , mPlanner( costmap, roverConfig[ "obstacleAvoidance" ][ "maxExpansions" ].GetInt() )
+    , mLookaheadCells( roverConfig[ "obstacleAvoidance" ][ "lookaheadCells" ].GetInt() )
+    , mAvoidancePoint{ 0, 0 }
+{
+} // CostmapAvoidance()
+
+// Destructs the CostmapAvoidance object.
+CostmapAvoidance::~CostmapAvoidance() {}
+
+// Turns toward the next point on the path around the obstacles. If
+// there is no known path yet, turns toward the clear side of the
+// obstacle so perception can see more of it.
+// If in search state and target is both detected and reachable, return NavState TurnToTarget.
+NavState CostmapAvoidance::executeTurnAroundObs( Rover* rover, const rapidjson::Document& roverConfig )
+{
+    if( isTargetDetected() && isTargetReachable( rover ) )
+    {
+        return NavState::TurnToTarget;
+    }
+    if( !planAvoidancePoint( rover ) )
+    {
+        rover->turn( rover->roverStatus().odometry().bearing_deg + mOriginalObstacleAngle );
+        return rover->roverStatus().currentState();
+    }
+
+    // Rover::turn never finishes while turning around an obstacle, since
+    // it keeps the old avoidance's exact alignment, so the heading is
+    // checked against the normal threshold here.
+    const Odometry& odometry = rover->roverStatus().odometry();
+    double bearing = ::bearing( rover->localFrame().toLocal( odometry ), mAvoidancePoint );
+    throughZero( bearing, odometry.bearing_deg );
+    if( fabs( bearing - odometry.bearing_deg ) <= rover->config().navThresholds.turningBearing )
+    {
+        return driveState( rover );
+    }
+    rover->turn( bearing );
+    return rover->roverStatus().currentState();
+} // executeTurnAroundObs()
+
+// Drives along the path around the obstacles until the straight line
+// to the destination is clear. The path is replanned every iteration,
+// which only repairs the parts of the search that changed.
+NavState CostmapAvoidance::executeDriveAroundObs( Rover* rover, const rapidjson::Document& roverConfig )
+{
+    if( isBackOnCourse( rover, roverConfig ) )
+    {
+        return rover->roverStatus().currentState() == NavState::DriveAroundObs ?
+               NavState::Turn : NavState::SearchTurn;
+    }
+    if( !planAvoidancePoint( rover ) )
+    {
+        return turnState( rover );
+    }
+
+    const Odometry& odometry = rover->roverStatus().odometry();
+    double bearing = ::bearing( rover->localFrame().toLocal( odometry ), mAvoidancePoint );
+    throughZero( bearing, odometry.bearing_deg );
+    if( fabs( bearing - odometry.bearing_deg ) > rover->config().navThresholds.drivingBearing )
+    {
+        return turnState( rover );
+    }
+    rover->drive( 1, bearing );
+    return rover->roverStatus().currentState();
+} // executeDriveAroundObs()
+
+// Creates the odometry point of the next point on the path around the
+// obstacles. The distance is not used since the path decides how far
+// to go.
+Odometry CostmapAvoidance::createAvoidancePoint( Rover* rover, const double distance )
+{
+    planAvoidancePoint( rover );
+    mObstacleAvoidancePoint = rover->localFrame().toOdometry( mAvoidancePoint, rover->roverStatus().odometry() );
+    return mObstacleAvoidancePoint;
+} // createAvoidancePoint()
+
+// Scales the cells the planner may expand in one plan.
+void CostmapAvoidance::setPlannerScale( const double scale )
+{
+    mPlanner.setBudgetScale( scale );
+} // setPlannerScale()
+
+// Plans a path from the rover to the avoidance goal and picks the
+// farthest point near the start of the path that the rover can drive
+// to in a straight line. Returns true if there is a path, false
+// otherwise.
+bool CostmapAvoidance::planAvoidancePoint( Rover* rover )
+{
+    const LocalPoint position = rover->localFrame().toLocal( rover->roverStatus().odometry() );
+    CostmapCell start;
+    if( !mCostmap.toCell( position, start ) )
+    {
+        return false;
+    }
+    const CostmapCell goal = mCostmap.clampToGrid( mAvoidanceGoal );
+    if( !mPlanner.plan( start, goal, mPath, mLookaheadCells ) )
+    {
+        return false;
+    }
+    if( mPath.empty() )
+    {
+        mAvoidancePoint = mAvoidanceGoal;
+        return true;
+    }
+    mAvoidancePoint = mCostmap.cellCenter( mPath.front().col, mPath.front().row );
+    for( const CostmapCell& cell : mPath )
+    {
+        const LocalPoint point = mCostmap.cellCenter( cell.col, cell.row );
+        if( !mCostmap.isLineClear( position, point ) )
+        {
+            break;
+        }
+        mAvoidancePoint = point;
+    }
+    return true;
+} // planAvoidancePoint()
+
+// Returns true if the rover can drive straight to the avoidance goal
+// without going through a known obstacle, false otherwise.
+bool CostmapAvoidance::isBackOnCourse( Rover* rover, const rapidjson::Document& roverConfig ) const
+{
+    if( isObstacleDetected( rover ) && isObstacleInThreshold( rover ) )
+    {
+        return false;
+    }
+    const LocalPoint position = rover->localFrame().toLocal( rover->roverStatus().odometry() );
+    return mCostmap.isLineClear( position, mAvoidanceGoal );
+} // isBackOnCourse()
@@ -0,0 +1,55 @@
+#ifndef COSTMAP_AVOIDANCE_HPP
+#define COSTMAP_AVOIDANCE_HPP
+
+#include "obstacleAvoidanceStateMachine.hpp"
+#include "dStarLite.hpp"
+
+// This class implements obstacle avoidance with the local costmap.
+// Obstacles stay in the costmap after they leave the camera's view, and
+// D* Lite plans a path around all of them to the point the rover was
+// driving to. The rover drives toward the farthest point on the path it
+// can reach in a straight line, and goes back to its previous behavior
+// once the straight line to its destination is clear.
+class CostmapAvoidance : public ObstacleAvoidanceStateMachine
+{
+public:
+    CostmapAvoidance( StateMachine* roverStateMachine, Rover* rover, const rapidjson::Document& roverConfig,
+                      LocalCostmap& costmap );
+
+    ~CostmapAvoidance();
+
+    NavState executeTurnAroundObs( Rover* rover, const rapidjson::Document& roverConfig );
+
+    NavState executeDriveAroundObs( Rover* rover, const rapidjson::Document& roverConfig );
+
+    Odometry createAvoidancePoint( Rover* rover, const double distance );
+
+    void setPlannerScale( const double scale );
+
+private:
+    bool planAvoidancePoint( Rover* rover );
+
+    bool isBackOnCourse( Rover* rover, const rapidjson::Document& roverConfig ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The costmap obstacles are remembered in.
+    LocalCostmap& mCostmap;
+
+    // The planner for paths through the costmap.
+    DStarLite mPlanner;
+
+    // Number of cells of the planned path that are looked at when
+    // picking the avoidance point.
+    const size_t mLookaheadCells;
+
+    // The planned path, kept to avoid allocating on every plan.
+    std::vector<CostmapCell> mPath;
+
+    // The point in the local frame that the rover is driving toward.
+    LocalPoint mAvoidancePoint;
+};
+
+#endif //COSTMAP_AVOIDANCE_HPP
@@ -0,0 +1,265 @@
+#include "dStarLite.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const double INF = std::numeric_limits<double>::infinity();
+
+    // Column and row offsets of the eight neighbors of a cell.
+    const int NEIGHBOR_COLS[ 8 ] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+    const int NEIGHBOR_ROWS[ 8 ] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+} // namespace
+
+// Constructs a planner for the costmap that gives up after expanding
+// maxExpansions cells in one plan.
+DStarLite::DStarLite( LocalCostmap& costmap, const int maxExpansions )
+    : mCostmap( costmap )
+    , mMaxExpansions( maxExpansions )
+    , mExpansionBudget( maxExpansions )
+    , mGeneration( 0 )
+    , mStart( -1 )
+    , mLast( -1 )
+    , mGoal( -1 )
+    , mKeyModifier( 0 )
+{
+} // DStarLite()
+
+// Plans a path from start to goal through the cells that aren't
+// blocked. The first maxLength cells of the path after start are put
+// in path. Returns true if there is a path, false otherwise.
+bool DStarLite::plan( const CostmapCell& start, const CostmapCell& goal, std::vector<CostmapCell>& path, const size_t maxLength )
+{
+    path.clear();
+    const int startIndex = toIndex( start );
+    const int goalIndex = toIndex( goal );
+    std::vector<CostmapCell>& changedCells = mCostmap.changedCells();
+    if( mGoal != goalIndex || mGeneration != mCostmap.generation() )
+    {
+        reset( start, goal );
+    }
+    else
+    {
+        if( startIndex != mStart )
+        {
+            mKeyModifier += heuristic( mLast, startIndex );
+            mLast = startIndex;
+            mStart = startIndex;
+        }
+        // A changed cell changes the cost of entering it, so the cells
+        // that can step into it need their lookahead recalculated.
+        for( const CostmapCell& cell : changedCells )
+        {
+            const int index = toIndex( cell );
+            for( int direction = 0; direction < 8; ++direction )
+            {
+                const int pred = neighbor( index, direction );
+                if( pred >= 0 )
+                {
+                    updateRhs( pred );
+                }
+            }
+        }
+    }
+    changedCells.clear();
+
+    if( !computeShortestPath() || mRhs[ mStart ] == INF )
+    {
+        return false;
+    }
+
+    const int cells = mCostmap.cells();
+    int current = mStart;
+    while( current != mGoal && path.size() < maxLength )
+    {
+        int best = -1;
+        double bestCost = INF;
+        for( int direction = 0; direction < 8; ++direction )
+        {
+            const int next = neighbor( current, direction );
+            if( next < 0 )
+            {
+                continue;
+            }
+            const double nextCost = cost( current, next ) + mG[ next ];
+            if( nextCost < bestCost )
+            {
+                best = next;
+                bestCost = nextCost;
+            }
+        }
+        if( best < 0 )
+        {
+            return false;
+        }
+        current = best;
+        path.push_back( { current % cells, current / cells } );
+    }
+    return true;
+} // plan()
+
+// Lets a plan expand scale of the configured number of cells. A plan
+// that runs out gives up, and the rover keeps the last path it found.
+void DStarLite::setBudgetScale( const double scale )
+{
+    mExpansionBudget = std::max( 1, static_cast<int>( mMaxExpansions * scale ) );
+} // setBudgetScale()
+
+// Throws away the search and starts a new one toward goal.
+void DStarLite::reset( const CostmapCell& start, const CostmapCell& goal )
+{
+    const size_t size = size_t( mCostmap.cells() ) * mCostmap.cells();
+    mG.assign( size, INF );
+    mRhs.assign( size, INF );
+    mOpenKey.assign( size, Key( INF, INF ) );
+    mInOpen.assign( size, false );
+    mOpen.clear();
+    mGeneration = mCostmap.generation();
+    mStart = toIndex( start );
+    mLast = mStart;
+    mGoal = toIndex( goal );
+    mKeyModifier = 0;
+    mRhs[ mGoal ] = 0;
+    updateVertex( mGoal );
+} // reset()
+
+// Expands cells from the open list until the rover's cell has its
+// shortest cost to the goal. Returns false if this takes more than the
+// expansion limit.
+bool DStarLite::computeShortestPath()
+{
+    int expansions = 0;
+    while( !mOpen.empty() &&
+           ( mOpen.begin()->first < calculateKey( mStart ) || mRhs[ mStart ] > mG[ mStart ] ) )
+    {
+        if( ++expansions > mExpansionBudget )
+        {
+            return false;
+        }
+        const Key oldKey = mOpen.begin()->first;
+        const int index = mOpen.begin()->second;
+        const Key newKey = calculateKey( index );
+        if( oldKey < newKey )
+        {
+            updateVertex( index );
+        }
+        else if( mG[ index ] > mRhs[ index ] )
+        {
+            mG[ index ] = mRhs[ index ];
+            updateVertex( index );
+            for( int direction = 0; direction < 8; ++direction )
+            {
+                const int pred = neighbor( index, direction );
+                if( pred >= 0 && pred != mGoal )
+                {
+                    mRhs[ pred ] = std::min( mRhs[ pred ], cost( pred, index ) + mG[ index ] );
+                    updateVertex( pred );
+                }
+            }
+        }
+        else
+        {
+            const double oldG = mG[ index ];
+            mG[ index ] = INF;
+            updateRhs( index );
+            for( int direction = 0; direction < 8; ++direction )
+            {
+                const int pred = neighbor( index, direction );
+                if( pred >= 0 && mRhs[ pred ] == cost( pred, index ) + oldG )
+                {
+                    updateRhs( pred );
+                }
+            }
+        }
+    }
+    return true;
+} // computeShortestPath()
+
+// Puts the cell in the open list with its current key if its g and rhs
+// disagree, and takes it out otherwise.
+void DStarLite::updateVertex( const int index )
+{
+    if( mInOpen[ index ] )
+    {
+        mOpen.erase( std::make_pair( mOpenKey[ index ], index ) );
+        mInOpen[ index ] = false;
+    }
+    if( mG[ index ] != mRhs[ index ] )
+    {
+        mOpenKey[ index ] = calculateKey( index );
+        mOpen.insert( std::make_pair( mOpenKey[ index ], index ) );
+        mInOpen[ index ] = true;
+    }
+} // updateVertex()
+
+// Recalculates the cell's rhs from its neighbors and updates its place
+// in the open list.
+void DStarLite::updateRhs( const int index )
+{
+    if( index != mGoal )
+    {
+        double rhs = INF;
+        for( int direction = 0; direction < 8; ++direction )
+        {
+            const int next = neighbor( index, direction );
+            if( next >= 0 )
+            {
+                rhs = std::min( rhs, cost( index, next ) + mG[ next ] );
+            }
+        }
+        mRhs[ index ] = rhs;
+    }
+    updateVertex( index );
+} // updateRhs()
+
+// Calculates the cell's priority in the open list.
+DStarLite::Key DStarLite::calculateKey( const int index ) const
+{
+    const double best = std::min( mG[ index ], mRhs[ index ] );
+    return Key( best + heuristic( mStart, index ) + mKeyModifier, best );
+} // calculateKey()
+
+// Calculates the cost of stepping between two neighboring cells. The
+// rover can always leave a blocked cell but can't enter one.
+double DStarLite::cost( const int from, const int to ) const
+{
+    const int cells = mCostmap.cells();
+    if( mCostmap.isBlocked( to % cells, to / cells ) )
+    {
+        return INF;
+    }
+    const bool diagonal = ( from % cells != to % cells ) && ( from / cells != to / cells );
+    return mCostmap.cellSize() * ( diagonal ? M_SQRT2 : 1 );
+} // cost()
+
+// Estimates the cost between two cells with the octile distance, which
+// never overestimates the cost of an eight-connected path.
+double DStarLite::heuristic( const int from, const int to ) const
+{
+    const int cells = mCostmap.cells();
+    const int dCol = std::abs( from % cells - to % cells );
+    const int dRow = std::abs( from / cells - to / cells );
+    return mCostmap.cellSize() * ( std::max( dCol, dRow ) + ( M_SQRT2 - 1 ) * std::min( dCol, dRow ) );
+} // heuristic()
+
+// Gets the index of the cell's neighbor in the given direction, or -1
+// if the neighbor is off of the grid.
+int DStarLite::neighbor( const int index, const int direction ) const
+{
+    const int cells = mCostmap.cells();
+    const int col = index % cells + NEIGHBOR_COLS[ direction ];
+    const int row = index / cells + NEIGHBOR_ROWS[ direction ];
+    if( col < 0 || row < 0 || col >= cells || row >= cells )
+    {
+        return -1;
+    }
+    return row * cells + col;
+} // neighbor()
+
+// Gets the index of the cell in the search's arrays.
+int DStarLite::toIndex( const CostmapCell& cell ) const
+{
+    return cell.row * mCostmap.cells() + cell.col;
+} // toIndex()
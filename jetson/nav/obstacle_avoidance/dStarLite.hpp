@@ -0,0 +1,82 @@
+#ifndef D_STAR_LITE_HPP
+#define D_STAR_LITE_HPP
+
+#include <set>
+#include <utility>
+#include <vector>
+#include "localCostmap.hpp"
+
+// This class plans paths through a LocalCostmap with D* Lite. The
+// search runs backward from the goal, so when the rover moves or a few
+// cells change only the affected part of the search is repaired
+// instead of planning again from scratch. The planner starts over when
+// the goal or the costmap's generation changes.
+class DStarLite
+{
+public:
+    DStarLite( LocalCostmap& costmap, const int maxExpansions );
+
+    bool plan( const CostmapCell& start, const CostmapCell& goal, std::vector<CostmapCell>& path, const size_t maxLength );
+
+    void setBudgetScale( const double scale );
+
+private:
+    // Priority of a cell in the open list, compared lexicographically.
+    typedef std::pair<double, double> Key;
+
+    void reset( const CostmapCell& start, const CostmapCell& goal );
+
+    bool computeShortestPath();
+
+    void updateVertex( const int index );
+
+    void updateRhs( const int index );
+
+    Key calculateKey( const int index ) const;
+
+    double cost( const int from, const int to ) const;
+
+    double heuristic( const int from, const int to ) const;
+
+    int neighbor( const int index, const int direction ) const;
+
+    int toIndex( const CostmapCell& cell ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The costmap that is planned through.
+    LocalCostmap& mCostmap;
+
+    // Largest number of cells expanded in one plan, as configured and
+    // as scaled down by the workload governor.
+    const int mMaxExpansions;
+    int mExpansionBudget;
+
+    // Costmap generation the search was built on.
+    unsigned mGeneration;
+
+    // Indices of the rover's cell, the rover's cell when the keys were
+    // last corrected, and the goal's cell. These are -1 before the
+    // first plan.
+    int mStart;
+    int mLast;
+    int mGoal;
+
+    // Amount that keys in the open list are behind because the rover
+    // moved since they were added.
+    double mKeyModifier;
+
+    // Cost to the goal from each cell, and its one-step lookahead.
+    std::vector<double> mG;
+    std::vector<double> mRhs;
+
+    // Cells whose g and rhs disagree, ordered by key. The key each cell
+    // was added with is kept so it can be removed.
+    std::set<std::pair<Key, int>> mOpen;
+    std::vector<Key> mOpenKey;
+    std::vector<bool> mInOpen;
+};
+
+#endif // D_STAR_LITE_HPP
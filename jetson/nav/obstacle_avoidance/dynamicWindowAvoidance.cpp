@@ -0,0 +1,216 @@
+#include "dynamicWindowAvoidance.hpp"
+
+#include "stateMachine.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Constructs a DynamicWindowAvoidance object that drives arcs through
+// costmap.
+DynamicWindowAvoidance::DynamicWindowAvoidance( StateMachine* roverStateMachine, Rover* rover,
+                                                const rapidjson::Document& roverConfig, LocalCostmap& costmap )
+    : ObstacleAvoidanceStateMachine( roverStateMachine, rover, roverConfig )
+    , mCostmap( costmap )
+    , mMaxSpeed( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "maxSpeed" ].GetDouble() )
+    , mMaxAcceleration( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "maxAcceleration" ].GetDouble() )
+    , mMaxCurvature( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "maxCurvature" ].GetDouble() )
+    , mSpeedSamples( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "speedSamples" ].GetInt() )
+    , mCurvatureSamples( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "curvatureSamples" ].GetInt() )
+    , mCurvatureBudget( mCurvatureSamples )
+    , mHorizon( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "horizon" ].GetDouble() )
+    , mClearanceHorizon( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "clearanceHorizon" ].GetDouble() )
+    , mHeadingWeight( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "headingWeight" ].GetDouble() )
+    , mProgressWeight( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "progressWeight" ].GetDouble() )
+    , mClearanceWeight( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "clearanceWeight" ].GetDouble() )
+    , mSpeedWeight( roverConfig[ "obstacleAvoidance" ][ "dynamicWindow" ][ "speedWeight" ].GetDouble() )
+    , mSpeed( 0 )
+    , mCurvature( 0 )
+{
+} // DynamicWindowAvoidance()
+
+// Destructs the DynamicWindowAvoidance object.
+DynamicWindowAvoidance::~DynamicWindowAvoidance() {}
+
+// Starts avoiding from the speed the rover is driving at. There is
+// nothing to turn toward first, so this goes straight to driving.
+// If in search state and target is both detected and reachable, return NavState TurnToTarget.
+NavState DynamicWindowAvoidance::executeTurnAroundObs( Rover* rover, const rapidjson::Document& roverConfig )
+{
+    if( isTargetDetected() && isTargetReachable( rover ) )
+    {
+        return NavState::TurnToTarget;
+    }
+    mSpeed = min( fabs( rover->roverStatus().odometry().speed ), mMaxSpeed );
+    mCurvature = 0;
+    return driveState( rover );
+} // executeTurnAroundObs()
+
+// Drives the best arc until the straight line to the destination is
+// clear. If every arc hits an obstacle, the rover stops and turns in
+// place toward the clear side of the obstacle, and starts over from
+// turning around the obstacle.
+NavState DynamicWindowAvoidance::executeDriveAroundObs( Rover* rover, const rapidjson::Document& roverConfig )
+{
+    if( isBackOnCourse( rover ) )
+    {
+        return rover->roverStatus().currentState() == NavState::DriveAroundObs ?
+               NavState::Turn : NavState::SearchTurn;
+    }
+    if( !chooseMotion( rover ) )
+    {
+        mSpeed = 0;
+        mCurvature = 0;
+        rover->turn( rover->roverStatus().odometry().bearing_deg + mOriginalObstacleAngle );
+        return turnState( rover );
+    }
+    rover->driveArc( mSpeed / mMaxSpeed, mCurvature );
+    return rover->roverStatus().currentState();
+} // executeDriveAroundObs()
+
+// Creates the odometry point at the end of the chosen arc. The distance
+// is not used since the arc decides how far to go.
+Odometry DynamicWindowAvoidance::createAvoidancePoint( Rover* rover, const double distance )
+{
+    const Odometry& odometry = rover->roverStatus().odometry();
+    LocalPoint end = rover->localFrame().toLocal( odometry );
+    double endHeading = odometry.bearing_deg;
+    double clearance = 0;
+    if( chooseMotion( rover ) )
+    {
+        rollOut( end, odometry.bearing_deg, mSpeed, mCurvature, end, endHeading, clearance );
+    }
+    mObstacleAvoidancePoint = rover->localFrame().toOdometry( end, odometry );
+    return mObstacleAvoidancePoint;
+} // createAvoidancePoint()
+
+// Scales the number of curvatures tried, and so the number of arcs
+// rolled out. The count is kept odd so driving straight is always one
+// of them.
+void DynamicWindowAvoidance::setPlannerScale( const double scale )
+{
+    mCurvatureBudget = max( 1, static_cast<int>( mCurvatureSamples * scale ) );
+    if( mCurvatureBudget % 2 == 0 && mCurvatureBudget < mCurvatureSamples )
+    {
+        ++mCurvatureBudget;
+    }
+} // setPlannerScale()
+
+// Scores every arc in the dynamic window and keeps the best one in
+// mSpeed and mCurvature. Returns true if an arc that moves the rover is
+// clear, false otherwise. There are few enough arcs that scoring them
+// all takes a fraction of an iteration.
+bool DynamicWindowAvoidance::chooseMotion( Rover* rover )
+{
+    const Odometry& odometry = rover->roverStatus().odometry();
+    const LocalPoint position = rover->localFrame().toLocal( odometry );
+    const double heading = odometry.bearing_deg;
+    const double period = 1 / rover->config().control.rateHz;
+    const double lowSpeed = max( mSpeed - mMaxAcceleration * period, 0.0 );
+    const double highSpeed = min( mSpeed + mMaxAcceleration * period, mMaxSpeed );
+    const double startDistance = distance( position, mAvoidanceGoal );
+
+    bool found = false;
+    double bestScore = 0;
+    double bestSpeed = 0;
+    double bestCurvature = 0;
+    for( int i = 0; i < mSpeedSamples; ++i )
+    {
+        const double speed = mSpeedSamples == 1 ? highSpeed :
+                             lowSpeed + ( highSpeed - lowSpeed ) * i / ( mSpeedSamples - 1 );
+        if( speed <= 0 )
+        {
+            continue;
+        }
+        for( int j = 0; j < mCurvatureBudget; ++j )
+        {
+            const double curvature = mCurvatureBudget == 1 ? 0 :
+                                     mMaxCurvature * ( 2.0 * j / ( mCurvatureBudget - 1 ) - 1 );
+            LocalPoint end;
+            double endHeading;
+            double clearance;
+            if( !rollOut( position, heading, speed, curvature, end, endHeading, clearance ) )
+            {
+                continue;
+            }
+
+            // How well the rover would face the goal at the end of the
+            // arc, from 0 facing away to 1 facing it.
+            const double headingScore = ( 1 + cos( degreeToRadian( ::bearing( end, mAvoidanceGoal ) - endHeading ) ) ) / 2;
+            const double progressScore = ( startDistance - distance( end, mAvoidanceGoal ) ) / ( mMaxSpeed * mHorizon );
+            const double score = mHeadingWeight * headingScore +
+                                 mProgressWeight * progressScore +
+                                 mClearanceWeight * clearance +
+                                 mSpeedWeight * speed / mMaxSpeed;
+            if( !found || score > bestScore )
+            {
+                found = true;
+                bestScore = score;
+                bestSpeed = speed;
+                bestCurvature = curvature;
+            }
+        }
+    }
+    if( found )
+    {
+        mSpeed = bestSpeed;
+        mCurvature = bestCurvature;
+    }
+    return found;
+} // chooseMotion()
+
+// Follows the arc of speed and curvature from start for the horizon,
+// setting end and endHeading to where it ends. Clearance is how much of
+// the clearance horizon the arc stays out of obstacles for, from 0 to 1.
+// Returns false if the arc hits an obstacle within the horizon. Cells
+// within a cell of start are not checked, so a rover that is already
+// inside an obstacle's inflation can still drive out of it.
+bool DynamicWindowAvoidance::rollOut( const LocalPoint& start, const double heading, const double speed,
+                                      const double curvature, LocalPoint& end, double& endHeading,
+                                      double& clearance ) const
+{
+    const double step = mCostmap.cellSize() / 2;
+    const double length = speed * mHorizon;
+    const double clearanceLength = max( speed * mClearanceHorizon, length );
+    LocalPoint point = start;
+    double pointHeading = heading;
+    end = start;
+    endHeading = heading;
+    clearance = 1;
+    for( double travelled = 0; travelled < clearanceLength; )
+    {
+        const double move = min( step, clearanceLength - travelled );
+        // Positive curvature turns right, the same as pure pursuit.
+        point = offset( point, pointHeading + radianToDegree( curvature * move / 2 ), move );
+        pointHeading += radianToDegree( curvature * move );
+        travelled += move;
+        if( travelled <= length )
+        {
+            end = point;
+            endHeading = pointHeading;
+        }
+        if( travelled > mCostmap.cellSize() && mCostmap.isBlocked( point ) )
+        {
+            if( travelled <= length )
+            {
+                return false;
+            }
+            clearance = travelled / clearanceLength;
+            break;
+        }
+    }
+    endHeading = mod( endHeading, 360 );
+    return true;
+} // rollOut()
+
+// Returns true if the rover can drive straight to the avoidance goal
+// without going through a known obstacle, false otherwise.
+bool DynamicWindowAvoidance::isBackOnCourse( Rover* rover ) const
+{
+    if( isObstacleDetected( rover ) && isObstacleInThreshold( rover ) )
+    {
+        return false;
+    }
+    const LocalPoint position = rover->localFrame().toLocal( rover->roverStatus().odometry() );
+    return mCostmap.isLineClear( position, mAvoidanceGoal );
+} // isBackOnCourse()
@@ -0,0 +1,78 @@
+#ifndef DYNAMIC_WINDOW_AVOIDANCE_HPP
+#define DYNAMIC_WINDOW_AVOIDANCE_HPP
+
+#include "obstacleAvoidanceStateMachine.hpp"
+#include "localCostmap.hpp"
+
+// This class implements obstacle avoidance with a dynamic window local
+// planner. Every iteration it rolls out arcs of constant speed and
+// curvature from the rover through the local costmap, throws out the
+// ones that hit an obstacle and drives the one that best trades off
+// heading to and progress toward the point the rover was driving to,
+// clearance and speed. Speeds are limited to the ones the rover can
+// reach from its last one within an iteration, so the rover steers
+// around obstacles while driving instead of stopping to turn.
+class DynamicWindowAvoidance : public ObstacleAvoidanceStateMachine
+{
+public:
+    DynamicWindowAvoidance( StateMachine* roverStateMachine, Rover* rover, const rapidjson::Document& roverConfig,
+                            LocalCostmap& costmap );
+
+    ~DynamicWindowAvoidance();
+
+    NavState executeTurnAroundObs( Rover* rover, const rapidjson::Document& roverConfig );
+
+    NavState executeDriveAroundObs( Rover* rover, const rapidjson::Document& roverConfig );
+
+    Odometry createAvoidancePoint( Rover* rover, const double distance );
+
+    void setPlannerScale( const double scale );
+
+private:
+    bool chooseMotion( Rover* rover );
+
+    bool rollOut( const LocalPoint& start, const double heading, const double speed, const double curvature,
+                  LocalPoint& end, double& endHeading, double& clearance ) const;
+
+    bool isBackOnCourse( Rover* rover ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The costmap the arcs are checked against.
+    LocalCostmap& mCostmap;
+
+    // Speed in meters a second the rover drives at full effort, and the
+    // most it can speed up or slow down in a second.
+    const double mMaxSpeed;
+    const double mMaxAcceleration;
+
+    // The sharpest turn tried, in 1 / meters.
+    const double mMaxCurvature;
+
+    // Number of speeds and curvatures tried. Every pair of them is an
+    // arc.
+    const int mSpeedSamples;
+    const int mCurvatureSamples;
+
+    // Number of curvatures tried as scaled down by the workload governor.
+    int mCurvatureBudget;
+
+    // Seconds each arc is followed for when scoring progress, and for
+    // how long it has to be clear for full clearance.
+    const double mHorizon;
+    const double mClearanceHorizon;
+
+    // Weights of the parts of an arc's score.
+    const double mHeadingWeight;
+    const double mProgressWeight;
+    const double mClearanceWeight;
+    const double mSpeedWeight;
+
+    // The speed and curvature last chosen.
+    double mSpeed;
+    double mCurvature;
+};
+
+#endif //DYNAMIC_WINDOW_AVOIDANCE_HPP
@@ -0,0 +1,349 @@
+#include "localCostmap.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Constructs an empty costmap that is halfWidth meters to each side of
+// the rover. The costmap centers itself on the rover's position in the
+// first update.
+LocalCostmap::LocalCostmap( const double halfWidth, const double cellSize, const double inflationRadius,
+                            const int hitValue, const int missValue, const int occupiedValue, const int maxValue,
+                            const double recenterDistance )
+    : mOrigin{ 0, 0 }
+    , mCellSize( cellSize )
+    , mCells( int( ceil( 2 * halfWidth / cellSize ) ) )
+    , mOccupancy( size_t( mCells ) * mCells, 0 )
+    , mBlockers( size_t( mCells ) * mCells, 0 )
+    , mInflationRadius( inflationRadius )
+    , mTouched( size_t( mCells ) * mCells, 0 )
+    , mUpdates( 0 )
+    , mHitValue( hitValue )
+    , mMissValue( missValue )
+    , mOccupiedValue( occupiedValue )
+    , mMaxValue( maxValue )
+    , mRecenterDistance( recenterDistance )
+    , mGeneration( 0 )
+{
+    const int reach = int( ceil( inflationRadius / cellSize ) );
+    for( int dRow = -reach; dRow <= reach; ++dRow )
+    {
+        for( int dCol = -reach; dCol <= reach; ++dCol )
+        {
+            if( hypot( dCol, dRow ) * cellSize <= inflationRadius )
+            {
+                mInflation.push_back( { dCol, dRow } );
+            }
+        }
+    }
+} // LocalCostmap()
+
+// Updates the costmap with an obstacle message seen from position with
+// the rover facing the absolute bearing. The obstacle message blocks
+// the cone between its left and right bearings at its distance. The
+// rest of the camera's field of view is seen to be free out to range.
+void LocalCostmap::update( const LocalPoint& position, const double bearing, const Obstacle& obstacle,
+                           const double range, const double fieldOfView )
+{
+    recenter( position );
+    ++mUpdates;
+
+    const bool detected = obstacle.distance >= 0;
+    const double farthest = detected ? max( range, obstacle.distance ) : range;
+    const double angleStep = radianToDegree( mCellSize / farthest ) / 2;
+
+    // The clear bearings from perception already allow for the rover's
+    // width, which the costmap adds back when it inflates the obstacle.
+    double leftEdge = 0;
+    double rightEdge = 0;
+    if( detected )
+    {
+        const double margin = obstacle.distance > 0 ?
+            radianToDegree( atan( mInflationRadius / obstacle.distance ) ) : 0;
+        leftEdge = min( obstacle.bearing + margin, 0.0 );
+        rightEdge = max( obstacle.rightBearing - margin, 0.0 );
+
+        // Hits go first so that rays which only pass by the obstacle
+        // can't clear the cells it was seen in.
+        for( double angle = leftEdge; angle <= rightEdge; angle += angleStep )
+        {
+            markRay( position, bearing + angle, obstacle.distance, true );
+        }
+    }
+    for( double angle = -fieldOfView / 2; angle <= fieldOfView / 2; angle += angleStep )
+    {
+        if( detected && angle >= leftEdge && angle <= rightEdge )
+        {
+            continue;
+        }
+        markRay( position, bearing + angle, range, false );
+    }
+    limitChangedCells();
+} // update()
+
+// Updates the costmap with an obstacle profile seen from position with
+// the rover facing the absolute bearing. Every bin of the profile is
+// marked on its own, so obstacles on both sides of the rover and the
+// free space between them are all kept. Bins without an obstacle are
+// seen to be free out to the smaller of range and the profile's range.
+// Bins outside the field of view are also -1 but weren't seen, so they
+// are skipped.
+void LocalCostmap::update( const LocalPoint& position, const double bearing, const ObstacleProfile& profile,
+                           const double range, const double fieldOfView )
+{
+    recenter( position );
+    ++mUpdates;
+
+    const int bins = sizeof( profile.ranges ) / sizeof( profile.ranges[ 0 ] );
+    const double freeRange = min( range, profile.max_range );
+    if( profile.resolution <= 0 || freeRange <= 0 )
+    {
+        return;
+    }
+    const double angleStep = min( profile.resolution, radianToDegree( mCellSize / freeRange ) / 2 );
+
+    // Hits go first so that rays from clear bins can't clear the cells
+    // an obstacle was seen in.
+    for( int pass = 0; pass < 2; ++pass )
+    {
+        const bool hits = pass == 0;
+        for( int i = 0; i < bins; ++i )
+        {
+            const bool detected = profile.ranges[ i ] >= 0 && profile.ranges[ i ] <= freeRange;
+            if( detected != hits )
+            {
+                continue;
+            }
+            const double center = profile.start_bearing + i * profile.resolution;
+            if( fabs( center ) > fieldOfView / 2 )
+            {
+                continue;
+            }
+            for( double angle = center - profile.resolution / 2; angle < center + profile.resolution / 2; angle += angleStep )
+            {
+                markRay( position, bearing + angle, detected ? profile.ranges[ i ] : freeRange, detected );
+            }
+        }
+    }
+    limitChangedCells();
+} // update()
+
+// Nothing has planned in a while. Starting the planner over is cheaper
+// than letting the list of changed cells grow.
+void LocalCostmap::limitChangedCells()
+{
+    if( mChangedCells.size() > mOccupancy.size() )
+    {
+        mChangedCells.clear();
+        ++mGeneration;
+    }
+} // limitChangedCells()
+
+// Lowers the occupancy of the cells along the ray out to freeRange. If
+// hit is true, the occupancy of the cell at freeRange is raised.
+void LocalCostmap::markRay( const LocalPoint& position, const double bearing, const double freeRange, const bool hit )
+{
+    const double step = mCellSize / 2;
+    for( double dist = 0; dist <= freeRange; dist += step )
+    {
+        const bool isHit = hit && dist + step > freeRange;
+        CostmapCell cell;
+        if( !toCell( offset( position, bearing, isHit ? freeRange : dist ), cell ) )
+        {
+            return;
+        }
+        unsigned& touched = mTouched[ size_t( cell.row ) * mCells + cell.col ];
+        if( touched == mUpdates )
+        {
+            continue;
+        }
+        touched = mUpdates;
+        addOccupancy( cell.col, cell.row, isHit ? mHitValue : -mMissValue );
+    }
+} // markRay()
+
+// Changes the occupancy of the cell and updates the blocked cells
+// around it if the cell became occupied or free.
+void LocalCostmap::addOccupancy( const int col, const int row, const int change )
+{
+    int& occupancy = mOccupancy[ size_t( row ) * mCells + col ];
+    const bool wasOccupied = occupancy >= mOccupiedValue;
+    occupancy = max( 0, min( mMaxValue, occupancy + change ) );
+    const bool isOccupied = occupancy >= mOccupiedValue;
+    if( wasOccupied != isOccupied )
+    {
+        inflate( col, row, isOccupied ? 1 : -1 );
+    }
+} // addOccupancy()
+
+// Adds change to the blockers of every cell within the inflation
+// radius of the cell and records the cells that became blocked or
+// unblocked.
+void LocalCostmap::inflate( const int col, const int row, const int change )
+{
+    for( const CostmapCell& offset : mInflation )
+    {
+        const int c = col + offset.col;
+        const int r = row + offset.row;
+        if( c < 0 || r < 0 || c >= mCells || r >= mCells )
+        {
+            continue;
+        }
+        int& blockers = mBlockers[ size_t( r ) * mCells + c ];
+        const bool wasBlocked = blockers > 0;
+        blockers += change;
+        if( wasBlocked != ( blockers > 0 ) )
+        {
+            mChangedCells.push_back( { c, r } );
+        }
+    }
+} // inflate()
+
+// Moves the grid by whole cells so that it is centered on the rover
+// once the rover gets too far from the center. Cells that move off of
+// the grid are forgotten.
+void LocalCostmap::recenter( const LocalPoint& position )
+{
+    const double halfExtent = mCells * mCellSize / 2;
+    const LocalPoint center = { mOrigin.east + halfExtent, mOrigin.north + halfExtent };
+    // The grid is empty until the first update, so it can be placed
+    // anywhere.
+    if( mGeneration == 0 )
+    {
+        mOrigin = { position.east - halfExtent, position.north - halfExtent };
+        ++mGeneration;
+        return;
+    }
+    if( distance( position, center ) <= mRecenterDistance )
+    {
+        return;
+    }
+    const LocalPoint newOrigin = { position.east - halfExtent, position.north - halfExtent };
+    const int shiftCol = int( round( ( newOrigin.east - mOrigin.east ) / mCellSize ) );
+    const int shiftRow = int( round( ( newOrigin.north - mOrigin.north ) / mCellSize ) );
+    mOrigin.east += shiftCol * mCellSize;
+    mOrigin.north += shiftRow * mCellSize;
+
+    std::vector<int> oldOccupancy( mOccupancy.size(), 0 );
+    oldOccupancy.swap( mOccupancy );
+    fill( mBlockers.begin(), mBlockers.end(), 0 );
+    for( int row = 0; row < mCells; ++row )
+    {
+        for( int col = 0; col < mCells; ++col )
+        {
+            const int oldCol = col + shiftCol;
+            const int oldRow = row + shiftRow;
+            if( oldCol < 0 || oldRow < 0 || oldCol >= mCells || oldRow >= mCells )
+            {
+                continue;
+            }
+            mOccupancy[ size_t( row ) * mCells + col ] = oldOccupancy[ size_t( oldRow ) * mCells + oldCol ];
+        }
+    }
+    for( int row = 0; row < mCells; ++row )
+    {
+        for( int col = 0; col < mCells; ++col )
+        {
+            if( mOccupancy[ size_t( row ) * mCells + col ] >= mOccupiedValue )
+            {
+                inflate( col, row, 1 );
+            }
+        }
+    }
+    ++mGeneration;
+    mChangedCells.clear();
+} // recenter()
+
+// Returns true if the cell is too close to an obstacle for the rover
+// to drive through, false otherwise.
+bool LocalCostmap::isBlocked( const int col, const int row ) const
+{
+    return mBlockers[ size_t( row ) * mCells + col ] > 0;
+} // isBlocked()
+
+// Returns true if the point is in a blocked cell, false otherwise.
+// Points outside of the grid are unknown and treated as free.
+bool LocalCostmap::isBlocked( const LocalPoint& point ) const
+{
+    CostmapCell cell;
+    return toCell( point, cell ) && isBlocked( cell.col, cell.row );
+} // isBlocked()
+
+// Returns true if the rover can drive straight from start to dest
+// without entering a blocked cell, false otherwise.
+bool LocalCostmap::isLineClear( const LocalPoint& start, const LocalPoint& dest ) const
+{
+    const double length = distance( start, dest );
+    const int steps = int( ceil( length / ( mCellSize / 2 ) ) );
+    for( int i = 0; i <= steps; ++i )
+    {
+        const double fraction = steps == 0 ? 0 : double( i ) / steps;
+        const LocalPoint point = { start.east + fraction * ( dest.east - start.east ),
+                                   start.north + fraction * ( dest.north - start.north ) };
+        if( isBlocked( point ) )
+        {
+            return false;
+        }
+    }
+    return true;
+} // isLineClear()
+
+// Finds the cell that the point is in. Returns false if the point is
+// outside of the grid.
+bool LocalCostmap::toCell( const LocalPoint& point, CostmapCell& cell ) const
+{
+    cell.col = int( floor( ( point.east - mOrigin.east ) / mCellSize ) );
+    cell.row = int( floor( ( point.north - mOrigin.north ) / mCellSize ) );
+    return cell.col >= 0 && cell.row >= 0 && cell.col < mCells && cell.row < mCells;
+} // toCell()
+
+// Finds the cell that the point is in. Points outside of the grid are
+// moved toward the center of the grid until they are on its edge.
+CostmapCell LocalCostmap::clampToGrid( const LocalPoint& point ) const
+{
+    CostmapCell cell;
+    if( toCell( point, cell ) )
+    {
+        return cell;
+    }
+    const double halfExtent = mCells * mCellSize / 2;
+    const LocalPoint center = { mOrigin.east + halfExtent, mOrigin.north + halfExtent };
+    const double dEast = point.east - center.east;
+    const double dNorth = point.north - center.north;
+    const double limit = halfExtent - mCellSize;
+    const double scale = min( fabs( dEast ) > 0 ? limit / fabs( dEast ) : 1.0,
+                              fabs( dNorth ) > 0 ? limit / fabs( dNorth ) : 1.0 );
+    toCell( { center.east + dEast * scale, center.north + dNorth * scale }, cell );
+    return cell;
+} // clampToGrid()
+
+// Gets the local point at the center of the cell.
+LocalPoint LocalCostmap::cellCenter( const int col, const int row ) const
+{
+    return { mOrigin.east + ( col + 0.5 ) * mCellSize, mOrigin.north + ( row + 0.5 ) * mCellSize };
+} // cellCenter()
+
+// Gets the number of cells along each side of the grid.
+int LocalCostmap::cells() const
+{
+    return mCells;
+} // cells()
+
+// Gets the width of a cell in meters.
+double LocalCostmap::cellSize() const
+{
+    return mCellSize;
+} // cellSize()
+
+// Gets the number of times the grid has moved.
+unsigned LocalCostmap::generation() const
+{
+    return mGeneration;
+} // generation()
+
+// Gets the cells that became blocked or unblocked since the list was
+// last cleared. The planner clears the list after reading it.
+std::vector<CostmapCell>& LocalCostmap::changedCells()
+{
+    return mChangedCells;
+} // changedCells()
@@ -0,0 +1,117 @@
+#ifndef LOCAL_COSTMAP_HPP
+#define LOCAL_COSTMAP_HPP
+
+#include <vector>
+#include "localFrame.hpp"
+#include "rover_msgs/Obstacle.hpp"
+#include "rover_msgs/ObstacleProfile.hpp"
+
+using namespace rover_msgs;
+
+// A cell of the costmap.
+struct CostmapCell
+{
+    int col;
+    int row;
+};
+
+// This class is a rolling occupancy grid around the rover, in the
+// rover's local frame. Obstacle messages raise the occupancy of the
+// cells they hit and lower the occupancy of the cells the camera sees
+// through, so obstacles are remembered after they leave the camera's
+// view. Cells within half the rover's width of an occupied cell are
+// blocked for planning.
+class LocalCostmap
+{
+public:
+    LocalCostmap( const double halfWidth, const double cellSize, const double inflationRadius,
+                  const int hitValue, const int missValue, const int occupiedValue, const int maxValue,
+                  const double recenterDistance );
+
+    void update( const LocalPoint& position, const double bearing, const Obstacle& obstacle,
+                 const double range, const double fieldOfView );
+
+    void update( const LocalPoint& position, const double bearing, const ObstacleProfile& profile,
+                 const double range, const double fieldOfView );
+
+    bool isBlocked( const int col, const int row ) const;
+
+    bool isBlocked( const LocalPoint& point ) const;
+
+    bool isLineClear( const LocalPoint& start, const LocalPoint& dest ) const;
+
+    bool toCell( const LocalPoint& point, CostmapCell& cell ) const;
+
+    CostmapCell clampToGrid( const LocalPoint& point ) const;
+
+    LocalPoint cellCenter( const int col, const int row ) const;
+
+    int cells() const;
+
+    double cellSize() const;
+
+    unsigned generation() const;
+
+    std::vector<CostmapCell>& changedCells();
+
+private:
+    void recenter( const LocalPoint& position );
+
+    void limitChangedCells();
+
+    void markRay( const LocalPoint& position, const double bearing, const double freeRange, const bool hit );
+
+    void addOccupancy( const int col, const int row, const int change );
+
+    void inflate( const int col, const int row, const int change );
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The local point at the corner of cell ( 0, 0 ).
+    LocalPoint mOrigin;
+
+    // Width of a cell in meters.
+    const double mCellSize;
+
+    // Number of cells along each side of the grid.
+    const int mCells;
+
+    // Occupancy of each cell, stored row by row.
+    std::vector<int> mOccupancy;
+
+    // Number of occupied cells within the inflation radius of each cell.
+    std::vector<int> mBlockers;
+
+    // Offsets of the cells within the inflation radius.
+    std::vector<CostmapCell> mInflation;
+
+    // Distance around occupied cells that is blocked.
+    const double mInflationRadius;
+
+    // The update that last marked each cell, so that a cell is only
+    // marked once per update when rays overlap.
+    std::vector<unsigned> mTouched;
+    unsigned mUpdates;
+
+    // Amounts occupancy goes up for a hit and down for a miss, the
+    // occupancy at which a cell is occupied, and the largest occupancy.
+    const int mHitValue;
+    const int mMissValue;
+    const int mOccupiedValue;
+    const int mMaxValue;
+
+    // How far the rover can get from the center of the grid before the
+    // grid is moved.
+    const double mRecenterDistance;
+
+    // Incremented every time the grid moves, which invalidates every
+    // cell index.
+    unsigned mGeneration;
+
+    // Cells that became blocked or unblocked since the list was cleared.
+    std::vector<CostmapCell> mChangedCells;
+};
+
+#endif // LOCAL_COSTMAP_HPP
@@ -3,12 +3,14 @@
 #include "utilities.hpp"
 #include "stateMachine.hpp"
 #include "simpleAvoidance.hpp"
+#include "costmapAvoidance.hpp"
 #include <cmath>
 #include <iostream>
 
 // Constructs an ObstacleAvoidanceStateMachine object with roverStateMachine, mRoverConfig, and mRover
 ObstacleAvoidanceStateMachine::ObstacleAvoidanceStateMachine( StateMachine* stateMachine_, Rover* rover, const rapidjson::Document& roverConfig )
     : roverStateMachine( stateMachine_ )
+    , mAvoidanceGoal{ 0, 0 }
     , mJustDetectedObstacle( false )
     , mRover( rover ) 
     , mRoverConfig( roverConfig ) {}
@@ -35,6 +37,13 @@ void ObstacleAvoidanceStateMachine::updateObstacleElements( double bearing, doub
     updateObstacleDistance( distance );
 }
 
+// Allows outside objects to set the point the rover was driving to
+// before it had to avoid an obstacle
+void ObstacleAvoidanceStateMachine::updateAvoidanceGoal( const LocalPoint& goal )
+{
+    mAvoidanceGoal = goal;
+}
+
 // Runs the avoidance state machine through one iteration. This will be called by StateMachine
 // when NavState is in an obstacle avoidance state. This will call the corresponding function based
 // on the current state and return the next NavState
@@ -71,23 +80,24 @@ bool ObstacleAvoidanceStateMachine::isTargetDetected ()
              mRover->roverStatus().target().distance >= 0 );
 }
 
-// The obstacle avoidance factory allows for the creation of obstacle avoidance objects and
-// an ease of transition between obstacle avoidance algorithms
-ObstacleAvoidanceStateMachine* ObstacleAvoiderFactory ( StateMachine* roverStateMachine,
-                                                        ObstacleAvoidanceAlgorithm algorithm, Rover* rover, const rapidjson::Document& roverConfig )
+// Gets the turning avoidance state for the rover's current behavior.
+NavState ObstacleAvoidanceStateMachine::turnState( Rover* rover ) const
 {
-    ObstacleAvoidanceStateMachine* avoid = nullptr;
-    switch ( algorithm )
+    NavState state = rover->roverStatus().currentState();
+    if( state == NavState::DriveAroundObs || state == NavState::TurnAroundObs )
     {
-        case ObstacleAvoidanceAlgorithm::SimpleAvoidance:
-            avoid = new SimpleAvoidance( roverStateMachine, rover, roverConfig );
-            break;
-
-        default:
-            std::cerr << "Unkown Search Type. Defaulting to original\n";
-            avoid = new SimpleAvoidance( roverStateMachine, rover, roverConfig );
-            break;
-    } // switch
-    return avoid;
-} // ObstacleAvoiderFactory
+        return NavState::TurnAroundObs;
+    }
+    return NavState::SearchTurnAroundObs;
+} // turnState()
 
+// Gets the driving avoidance state for the rover's current behavior.
+NavState ObstacleAvoidanceStateMachine::driveState( Rover* rover ) const
+{
+    NavState state = rover->roverStatus().currentState();
+    if( state == NavState::DriveAroundObs || state == NavState::TurnAroundObs )
+    {
+        return NavState::DriveAroundObs;
+    }
+    return NavState::SearchDriveAroundObs;
+} // driveState()
@@ -5,13 +5,6 @@
 
 class StateMachine;
 
-// This class is the representation of different 
-// obstacle avoidance algorithms
-enum class ObstacleAvoidanceAlgorithm
-{
-    SimpleAvoidance
-};
-
 // This class is the base class for the logic of the obstacle avoidance state machine 
 class ObstacleAvoidanceStateMachine 
 {
@@ -29,6 +22,8 @@ public:
 
     void updateObstacleElements( double bearing, double distance );  
 
+    void updateAvoidanceGoal( const LocalPoint& goal );
+
     NavState run();
 
     bool isTargetDetected();
@@ -40,8 +35,16 @@ public:
 
     virtual NavState executeDriveAroundObs( Rover* rover, const rapidjson::Document& roverConfig ) = 0;
 
+    // Scales how much work the planner may do in one iteration, 1 for
+    // its whole configured budget. Avoidances without a planner ignore it.
+    virtual void setPlannerScale( const double scale ) {}
+
 
 protected:
+    NavState turnState( Rover* rover ) const;
+
+    NavState driveState( Rover* rover ) const;
+
     /*************************************************************************/
     /* Protected Member Variables */
     /*************************************************************************/
@@ -58,6 +61,10 @@ protected:
     // Initial angle to go around obstacle upon detection.
     double mOriginalObstacleDistance;
 
+    // Point in the local frame the rover was driving to when it saw the
+    // obstacle.
+    LocalPoint mAvoidanceGoal;
+
     // bool for consecutive obstacle detections
     bool mJustDetectedObstacle;
 
@@ -77,10 +84,4 @@ private:
 
 };
 
-// Creates an ObstacleAvoidanceStateMachine object based on the inputted obstacle 
-// avoidance algorithm. This allows for an an ease of transition between obstacle 
-// avoidance algorithms
-ObstacleAvoidanceStateMachine* ObstacleAvoiderFactory( StateMachine* roverStateMachine,
-                                                       ObstacleAvoidanceAlgorithm algorithm, Rover* rover, const rapidjson::Document& roverConfig );
-
 #endif //OBSTACLE_AVOIDANCE_STATE_MACHINE_HPP
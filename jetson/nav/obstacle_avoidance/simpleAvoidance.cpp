@@ -22,7 +22,7 @@ SimpleAvoidance::~SimpleAvoidance() {}
 NavState SimpleAvoidance::executeTurnAroundObs( Rover* rover,
                                                 const rapidjson::Document& roverConfig )
 {
-    if( isTargetDetected () && isTargetReachable( rover, roverConfig ) )
+    if( isTargetDetected () && isTargetReachable( rover ) )
     {
         return NavState::TurnToTarget;
     }
@@ -56,7 +56,7 @@ NavState SimpleAvoidance::executeTurnAroundObs( Rover* rover,
 // ( original waypoint is the waypoint before obstacle avoidance was triggered )
 NavState SimpleAvoidance::executeDriveAroundObs( Rover* rover, const rapidjson::Document& roverConfig )
 {
-    if( isObstacleDetected( rover )  && isObstacleInThreshold( rover, roverConfig ) )
+    if( isObstacleDetected( rover )  && isObstacleInThreshold( rover ) )
 
     {
         if( rover->roverStatus().currentState() == NavState::DriveAroundObs )
@@ -4,22 +4,35 @@ PidLoop::PidLoop(double Kp, double Ki, double Kd) :
     Kp_(Kp),
     Ki_(Ki),
     Kd_(Kd),
+    anti_windup_(false),
+    derivative_filter_(0.0),
     first_(true),
     accumulated_error_(0.0),
-    last_error_(0.0)
+    last_error_(0.0),
+    last_derivative_(0.0)
 {
 }
 
 double PidLoop::update(double current, double desired) {
     double err = this->error(current, desired);
-    accumulated_error_ += err;
-    double effort = Kp_*err + Ki_*accumulated_error_;
+    double accumulated = accumulated_error_ + err;
+    double effort = Kp_*err + Ki_*accumulated;
     if (!first_) {
-        effort += Kd_*(err - last_error_);
+        double derivative = derivative_filter_*last_derivative_ + (1.0 - derivative_filter_)*(err - last_error_);
+        effort += Kd_*derivative;
+        last_derivative_ = derivative;
     }
     last_error_ = err;
     first_ = false;
 
+    // Clamping anti-windup: the error is only integrated if it doesn't
+    // drive the effort further into saturation.
+    bool winding_up = (effort > sat_max_out_ && Ki_*err > 0) ||
+                      (effort < sat_min_out_ && Ki_*err < 0);
+    if (!anti_windup_ || !winding_up) {
+        accumulated_error_ = accumulated;
+    }
+
     if (effort < sat_min_out_) effort = sat_min_out_;
     if (effort > sat_max_out_) effort = sat_max_out_;
 
@@ -30,6 +43,21 @@ void PidLoop::reset() {
     first_ = true;
     accumulated_error_ = 0.0;
     last_error_ = 0.0;
+    last_derivative_ = 0.0;
+}
+
+void PidLoop::setGains(double Kp, double Ki, double Kd) {
+    Kp_ = Kp;
+    Ki_ = Ki;
+    Kd_ = Kd;
+}
+
+void PidLoop::setAntiWindup(bool antiWindup) {
+    anti_windup_ = antiWindup;
+}
+
+void PidLoop::setDerivativeFilter(double filter) {
+    derivative_filter_ = filter;
 }
 
 double PidLoop::error(double current, double desired) {
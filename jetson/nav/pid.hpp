@@ -7,6 +7,18 @@ class PidLoop {
         double update(double current, double desired);
         void reset();
 
+        // Gains can be changed between updates, the accumulated error is
+        // kept so the loop doesn't jump back to zero integral.
+        void setGains(double Kp, double Ki, double Kd);
+
+        // Stops integrating error that would push a saturated effort
+        // further past its limit.
+        void setAntiWindup(bool antiWindup);
+
+        // Low pass filters the derivative, keeping this fraction (0 to
+        // less than 1) of the last derivative each update. 0 is unfiltered.
+        void setDerivativeFilter(double filter);
+
     private:
         double error(double current, double desired);
 
@@ -17,7 +29,11 @@ class PidLoop {
         const double sat_min_out_ = -1.0;
         const double sat_max_out_ = +1.0;
 
+        bool anti_windup_;
+        double derivative_filter_;
+
         bool first_;
         double accumulated_error_;
         double last_error_;
+        double last_derivative_;
 };
@@ -0,0 +1,87 @@
+#include "poseHistory.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+
+// Constructs an empty history.
+PoseHistory::PoseHistory()
+    : mNext( 0 )
+    , mCount( 0 )
+{
+} // PoseHistory()
+
+// Adds the pose the rover had at timeUs. Poses have to be added in
+// order, one older than the newest is ignored.
+void PoseHistory::add( const int64_t timeUs, const Odometry& pose )
+{
+    if( mCount > 0 && timeUs < entry( 0 ).timeUs )
+    {
+        return;
+    }
+    mEntries[ mNext ].timeUs = timeUs;
+    mEntries[ mNext ].pose = pose;
+    mNext = ( mNext + 1 ) % SIZE;
+    if( mCount < SIZE )
+    {
+        ++mCount;
+    }
+} // add()
+
+// Finds the pose the rover had at timeUs, interpolated between the two
+// poses around it. A time after the newest pose gets the newest pose.
+// Returns false if the time is older than the whole history, since the
+// rover could have been anywhere then.
+bool PoseHistory::at( const int64_t timeUs, Odometry& pose ) const
+{
+    if( mCount == 0 || timeUs < entry( mCount - 1 ).timeUs )
+    {
+        return false;
+    }
+    if( timeUs >= entry( 0 ).timeUs )
+    {
+        pose = entry( 0 ).pose;
+        return true;
+    }
+
+    // Newest first, the pose asked for is rarely more than a few back.
+    for( size_t age = 1; age < mCount; ++age )
+    {
+        const Entry& before = entry( age );
+        if( before.timeUs > timeUs )
+        {
+            continue;
+        }
+        const Entry& after = entry( age - 1 );
+        const double fraction = after.timeUs == before.timeUs ? 1.0 :
+                                static_cast<double>( timeUs - before.timeUs ) / ( after.timeUs - before.timeUs );
+        pose = before.pose;
+        pose.latitude_min += ( after.pose.latitude_deg - before.pose.latitude_deg ) * 60 * fraction +
+                             ( after.pose.latitude_min - before.pose.latitude_min ) * fraction;
+        pose.longitude_min += ( after.pose.longitude_deg - before.pose.longitude_deg ) * 60 * fraction +
+                              ( after.pose.longitude_min - before.pose.longitude_min ) * fraction;
+
+        // The short way around, so 359 to 1 passes through 0.
+        double turned = mod( after.pose.bearing_deg - before.pose.bearing_deg, 360 );
+        if( turned > 180 )
+        {
+            turned -= 360;
+        }
+        pose.bearing_deg = mod( before.pose.bearing_deg + turned * fraction, 360 );
+        pose.speed = before.pose.speed + ( after.pose.speed - before.pose.speed ) * fraction;
+        return true;
+    }
+    return false;
+} // at()
+
+// Forgets every pose.
+void PoseHistory::clear()
+{
+    mNext = 0;
+    mCount = 0;
+} // clear()
+
+// Returns the entry added age poses before the newest one.
+const PoseHistory::Entry& PoseHistory::entry( const size_t age ) const
+{
+    return mEntries[ ( mNext + SIZE - 1 - age ) % SIZE ];
+} // entry()
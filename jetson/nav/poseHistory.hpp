@@ -0,0 +1,56 @@
+#ifndef POSE_HISTORY_HPP
+#define POSE_HISTORY_HPP
+
+#include <array>
+#include <cstdint>
+
+#include "rover_msgs/Odometry.hpp"
+
+using namespace rover_msgs;
+
+// This class keeps the rover's last odometry messages with the time
+// each one arrived, so a perception output can be put back in the pose
+// the rover had when its camera frame was captured. Times are
+// microseconds of the monotonic clock every process on the Jetson
+// shares, the clock perception stamps its outputs with.
+//
+// The history is a fixed ring, so adding a pose never allocates and the
+// oldest pose is simply overwritten.
+class PoseHistory
+{
+public:
+    // Poses kept. At odometry's 10 to 50 Hz this covers well over the
+    // age of any detection nav still uses.
+    static const size_t SIZE = 128;
+
+    PoseHistory();
+
+    void add( const int64_t timeUs, const Odometry& pose );
+
+    bool at( const int64_t timeUs, Odometry& pose ) const;
+
+    void clear();
+
+private:
+    struct Entry
+    {
+        int64_t timeUs;
+        Odometry pose;
+    };
+
+    const Entry& entry( const size_t age ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The poses, mNext is where the next one goes.
+    std::array<Entry, SIZE> mEntries;
+
+    size_t mNext;
+
+    // How many of the entries hold a pose.
+    size_t mCount;
+};
+
+#endif // POSE_HISTORY_HPP
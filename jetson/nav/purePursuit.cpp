@@ -0,0 +1,148 @@
+#include "purePursuit.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Constructs a pure pursuit follower without a path.
+PurePursuit::PurePursuit()
+    : mSegment( 0 )
+    , mTarget{ 0, 0 }
+{
+} // PurePursuit()
+
+// Starts following path from its first point.
+void PurePursuit::setPath( const std::vector<LocalPoint>& path )
+{
+    mPath = path;
+    mSegment = 0;
+} // setPath()
+
+// Removes the path being followed.
+void PurePursuit::clear()
+{
+    mPath.clear();
+    mSegment = 0;
+} // clear()
+
+// Returns true if there is a path to follow, false otherwise.
+bool PurePursuit::hasPath() const
+{
+    return !mPath.empty();
+} // hasPath()
+
+// Gets the path being followed.
+const std::vector<LocalPoint>& PurePursuit::path() const
+{
+    return mPath;
+} // path()
+
+// Gets the segment of the path the rover is on.
+size_t PurePursuit::segment() const
+{
+    return mSegment;
+} // segment()
+
+// Gets the point the rover was last steering toward.
+const LocalPoint& PurePursuit::target() const
+{
+    return mTarget;
+} // target()
+
+// Moves the rover's place on the path forward to the closest point
+// that is not much farther along than the lookahead distance, then gets
+// the point lookaheadDistance past it. Near the end of the path, the
+// end of the path is returned.
+LocalPoint PurePursuit::lookahead( const LocalPoint& position, const double lookaheadDistance )
+{
+    if( mPath.size() < 2 )
+    {
+        mTarget = mPath.empty() ? position : mPath.front();
+        return mTarget;
+    }
+
+    // Only segments that start within reach of the lookahead point are
+    // considered, so the rover doesn't skip ahead to a later part of
+    // the path that happens to pass nearby.
+    const LocalPoint closest = closestOnSegment( position, mSegment );
+    double bestDist = distance( position, closest );
+    size_t best = mSegment;
+    double along = distance( closest, mPath[ mSegment + 1 ] );
+    for( size_t i = mSegment + 1; i + 1 < mPath.size() && along < bestDist + lookaheadDistance; ++i )
+    {
+        const double dist = distance( position, closestOnSegment( position, i ) );
+        if( dist < bestDist )
+        {
+            bestDist = dist;
+            best = i;
+        }
+        along += distance( mPath[ i ], mPath[ i + 1 ] );
+    }
+    mSegment = best;
+
+    LocalPoint point = closestOnSegment( position, mSegment );
+    double left = lookaheadDistance;
+    for( size_t i = mSegment; i + 1 < mPath.size(); ++i )
+    {
+        const double length = distance( point, mPath[ i + 1 ] );
+        if( length >= left )
+        {
+            const double fraction = left / length;
+            mTarget = { point.east + fraction * ( mPath[ i + 1 ].east - point.east ),
+                        point.north + fraction * ( mPath[ i + 1 ].north - point.north ) };
+            return mTarget;
+        }
+        left -= length;
+        point = mPath[ i + 1 ];
+    }
+    mTarget = mPath.back();
+    return mTarget;
+} // lookahead()
+
+// Calculates the distance left along the path from the rover's place
+// on it to the end of the path.
+double PurePursuit::remaining( const LocalPoint& position ) const
+{
+    if( mPath.size() < 2 )
+    {
+        return mPath.empty() ? 0 : distance( position, mPath.front() );
+    }
+    LocalPoint point = closestOnSegment( position, mSegment );
+    double length = 0;
+    for( size_t i = mSegment; i + 1 < mPath.size(); ++i )
+    {
+        length += distance( point, mPath[ i + 1 ] );
+        point = mPath[ i + 1 ];
+    }
+    return length;
+} // remaining()
+
+// Calculates the curvature of the arc from position, with the rover
+// facing the absolute heading, that ends at target. Positive curvature
+// turns right.
+double PurePursuit::curvature( const LocalPoint& position, const double heading, const LocalPoint& target )
+{
+    const double lookaheadDistance = distance( position, target );
+    if( lookaheadDistance <= 0 )
+    {
+        return 0;
+    }
+    return 2 * sin( degreeToRadian( bearing( position, target ) - heading ) ) / lookaheadDistance;
+} // curvature()
+
+// Finds the closest point to position on the segment.
+LocalPoint PurePursuit::closestOnSegment( const LocalPoint& position, const size_t segment ) const
+{
+    const LocalPoint& start = mPath[ segment ];
+    const LocalPoint& end = mPath[ segment + 1 ];
+    const double dEast = end.east - start.east;
+    const double dNorth = end.north - start.north;
+    const double lengthSquared = dEast * dEast + dNorth * dNorth;
+    if( lengthSquared <= 0 )
+    {
+        return start;
+    }
+    double fraction = ( ( position.east - start.east ) * dEast + ( position.north - start.north ) * dNorth ) / lengthSquared;
+    fraction = std::max( 0.0, std::min( 1.0, fraction ) );
+    return { start.east + fraction * dEast, start.north + fraction * dNorth };
+} // closestOnSegment()
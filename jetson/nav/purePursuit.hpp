@@ -0,0 +1,53 @@
+#ifndef PURE_PURSUIT_HPP
+#define PURE_PURSUIT_HPP
+
+#include <vector>
+#include "localFrame.hpp"
+
+// This class follows a path of local points with pure pursuit. Every
+// update finds where the rover is along the path and picks the point
+// that is the lookahead distance farther along it, which the rover
+// steers toward on a constant curvature arc.
+class PurePursuit
+{
+public:
+    PurePursuit();
+
+    void setPath( const std::vector<LocalPoint>& path );
+
+    void clear();
+
+    bool hasPath() const;
+
+    const std::vector<LocalPoint>& path() const;
+
+    size_t segment() const;
+
+    const LocalPoint& target() const;
+
+    LocalPoint lookahead( const LocalPoint& position, const double lookaheadDistance );
+
+    double remaining( const LocalPoint& position ) const;
+
+    static double curvature( const LocalPoint& position, const double heading, const LocalPoint& target );
+
+private:
+    LocalPoint closestOnSegment( const LocalPoint& position, const size_t segment ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The path being followed.
+    std::vector<LocalPoint> mPath;
+
+    // The segment of the path the rover is on. Segment i goes from
+    // point i to point i + 1. The rover never moves back a segment, so
+    // paths that cross themselves are followed in order.
+    size_t mSegment;
+
+    // The point the last lookahead returned.
+    LocalPoint mTarget;
+};
+
+#endif // PURE_PURSUIT_HPP
@@ -1,7 +1,11 @@
 #include "rover.hpp"
 #include "utilities.hpp"
+#include "courseOrder.hpp"
 #include "rover_msgs/Joystick.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 
@@ -11,6 +15,9 @@ Rover::RoverStatus::RoverStatus()
     : mCurrentState( NavState::Off )
 {
     mAutonState.is_auton = false;
+    mTargetCapture.timeUs = 0;
+    mTargetCapture.frameSeq = -1;
+    mOdometryTimeUs = 0;
 } // RoverStatus()
 
 // Gets a reference to the rover's current navigation state.
@@ -59,23 +66,37 @@ Target& Rover::RoverStatus::target2() {
     return mTarget2;
 }
 
+// Gets a reference to every tag perception is tracking.
+vector<DetectedTag>& Rover::RoverStatus::tags()
+{
+    return mTags;
+} // tags()
+
+// Gets a reference to when the frame the targets were seen in was
+// captured.
+CaptureStamp& Rover::RoverStatus::targetCapture()
+{
+    return mTargetCapture;
+} // targetCapture()
+
+// Gets a reference to when the rover's current odometry information
+// arrived.
+int64_t& Rover::RoverStatus::odometryTimeUs()
+{
+    return mOdometryTimeUs;
+} // odometryTimeUs()
+
 unsigned Rover::RoverStatus::getPathTargets()
 {
   return mPathTargets;
 } // getPathTargets()
 
-// Assignment operator for the rover status object. Does a "deep" copy
-// where necessary.
-Rover::RoverStatus& Rover::RoverStatus::operator=( Rover::RoverStatus& newRoverStatus )
+// Rebuilds the rover's path from the course. The path holds the
+// waypoints that haven't been visited yet, so this restarts the course.
+void Rover::RoverStatus::resetPath()
 {
-    mAutonState = newRoverStatus.autonState();
-    mCourse = newRoverStatus.course();
     mPathTargets = 0;
-
-    while( !mPath.empty() )
-    {
-        mPath.pop_front();
-    }
+    mPath.clear();
     for( int courseIndex = 0; courseIndex < mCourse.num_waypoints; ++courseIndex )
     {
         auto &wp = mCourse.waypoints[ courseIndex ];
@@ -84,28 +105,39 @@ Rover::RoverStatus& Rover::RoverStatus::operator=( Rover::RoverStatus& newRoverS
             ++mPathTargets;
         }
     }
-    mObstacle = newRoverStatus.obstacle();
-    mOdometry = newRoverStatus.odometry();
-    mTarget1 = newRoverStatus.target();
-    mTarget2 = newRoverStatus.target2();
-    return *this;
-} // operator=
-
-// Constructs a rover object with the given configuration file and lcm
+} // resetPath()
+
+// Constructs a rover object with the given configuration and lcm
 // object with which to use for communications.
-Rover::Rover( const rapidjson::Document& config, lcm::LCM& lcmObject )
-    : mRoverConfig( config )
+Rover::Rover( const NavConfig& navConfig, lcm::LCM& lcmObject )
+    : mConfig( navConfig )
     , mLcmObject( lcmObject )
-    , mDistancePid( config[ "distancePid" ][ "kP" ].GetDouble(),
-                    config[ "distancePid" ][ "kI" ].GetDouble(),
-                    config[ "distancePid" ][ "kD" ].GetDouble() )
-    , mBearingPid( config[ "bearingPid" ][ "kP" ].GetDouble(),
-                   config[ "bearingPid" ][ "kI" ].GetDouble(),
-                   config[ "bearingPid" ][ "kD" ].GetDouble() )
-    , mLongMeterInMinutes( -1 )
+    , mDistancePid( navConfig.distancePid.kP, navConfig.distancePid.kI, navConfig.distancePid.kD )
+    , mBearingPid( navConfig.bearingPid.kP, navConfig.bearingPid.kI, navConfig.bearingPid.kD )
+    , mTargetCaptureHeading( 0 )
+    , mObstacleCaptureHeading( 0 )
+    , mLastJoystickUs( 0 )
 {
+    mLastJoystick.forward_back = 0;
+    mLastJoystick.left_right = 0;
+    mLastJoystick.dampen = 0;
+    mLastJoystick.kill = false;
+    mLastJoystick.restart = false;
+    updatePidConfig();
 } // Rover()
 
+// Gives the pid loops the gains and options in the config. Called
+// whenever the config changes, between runs of the state machine.
+void Rover::updatePidConfig()
+{
+    mDistancePid.setGains( mConfig.distancePid.kP, mConfig.distancePid.kI, mConfig.distancePid.kD );
+    mDistancePid.setAntiWindup( mConfig.distancePid.antiWindup );
+    mDistancePid.setDerivativeFilter( mConfig.distancePid.derivativeFilter );
+    mBearingPid.setGains( mConfig.bearingPid.kP, mConfig.bearingPid.kI, mConfig.bearingPid.kD );
+    mBearingPid.setAntiWindup( mConfig.bearingPid.antiWindup );
+    mBearingPid.setDerivativeFilter( mConfig.bearingPid.derivativeFilter );
+} // updatePidConfig()
+
 // Sends a joystick command to drive forward from the current odometry
 // to the destination odometry. This joystick command will also turn
 // the rover small amounts as "course corrections".
@@ -113,11 +145,19 @@ Rover::Rover( const rapidjson::Document& config, lcm::LCM& lcmObject )
 // on-course or off-course.
 DriveStatus Rover::drive( const Odometry& destination )
 {
-    double distance = estimateNoneuclid( mRoverStatus.odometry(), destination );
-    double bearing = calcBearing( mRoverStatus.odometry(), destination );
+    double distance = mLocalFrame.distance( mRoverStatus.odometry(), destination );
+    double bearing = mLocalFrame.bearing( mRoverStatus.odometry(), destination );
     return drive( distance, bearing, false );
 } // drive()
 
+// Sends a joystick command to drive forward from the current odometry
+// to the destination point in the rover's local frame.
+DriveStatus Rover::drive( const LocalPoint& destination )
+{
+    LocalPoint current = mLocalFrame.toLocal( mRoverStatus.odometry() );
+    return drive( ::distance( current, destination ), ::bearing( current, destination ), false );
+} // drive()
+
 // Sends a joystick command to drive forward from the current odometry
 // in the direction of bearing. The distance is used to determine how
 // quickly to drive forward. This joystick command will also turn the
@@ -128,8 +168,8 @@ DriveStatus Rover::drive( const Odometry& destination )
 // on-course or off-course.
 DriveStatus Rover::drive( const double distance, const double bearing, const bool target )
 {
-    if( (!target && distance < mRoverConfig[ "navThresholds" ][ "waypointDistance" ].GetDouble()) ||
-        (target && distance < mRoverConfig[ "navThresholds" ][ "targetDistance" ].GetDouble()) )
+    if( (!target && distance < mConfig.navThresholds.waypointDistance) ||
+        (target && distance < mConfig.navThresholds.targetDistance) )
     {
         return DriveStatus::Arrived;
     }
@@ -137,7 +177,7 @@ DriveStatus Rover::drive( const double distance, const double bearing, const boo
     double destinationBearing = mod( bearing, 360 );
     throughZero( destinationBearing, mRoverStatus.odometry().bearing_deg ); // will go off course if inside if because through zero not calculated
 
-    if( fabs( destinationBearing - mRoverStatus.odometry().bearing_deg ) < mRoverConfig[ "navThresholds" ][ "drivingBearing" ].GetDouble() )
+    if( fabs( destinationBearing - mRoverStatus.odometry().bearing_deg ) < mConfig.navThresholds.drivingBearing )
     {
         double distanceEffort = mDistancePid.update( -1 * distance, 0 );
         double turningEffort = mBearingPid.update( mRoverStatus.odometry().bearing_deg, destinationBearing );
@@ -162,15 +202,82 @@ void Rover::drive(const int direction, const double bearing)
     publishJoystick(distanceEffort, turningEffort, false);
 } // drive()
 
+// Sends a joystick command to follow the follower's path with pure
+// pursuit, so the rover drives arcs instead of stopping to turn. The
+// lookahead distance grows with the rover's speed so that it doesn't
+// weave at speed or cut corners wide when slow. The
+// turning effort is set so that a skid steer rover of the configured
+// width drives the pure pursuit curvature at the commanded speed.
+// The return value indicates if the rover has arrived at the end of
+// the path, or if it is on-course or if the path is too far to the side
+// to steer to without turning in place first.
+DriveStatus Rover::drive( PurePursuit& follower )
+{
+    const LocalPoint current = mLocalFrame.toLocal( mRoverStatus.odometry() );
+    const double heading = mRoverStatus.odometry().bearing_deg;
+    const double minLookahead = mConfig.pathFollowing.minLookahead;
+    const double maxLookahead = mConfig.pathFollowing.maxLookahead;
+    const double lookahead = minLookahead + mConfig.pathFollowing.lookaheadTime *
+                             fabs( mRoverStatus.odometry().speed );
+    const LocalPoint target = follower.lookahead( current, min( lookahead, maxLookahead ) );
+    const double remaining = follower.remaining( current );
+    if( remaining < mConfig.navThresholds.waypointDistance )
+    {
+        return DriveStatus::Arrived;
+    }
+
+    double targetBearing = ::bearing( current, target );
+    throughZero( targetBearing, heading );
+    if( fabs( targetBearing - heading ) >= mConfig.navThresholds.drivingBearing )
+    {
+        return DriveStatus::OffCourse;
+    }
+
+    // The joystick efforts are scaled by the driving and bearing powers
+    // before they reach the wheels.
+    const double distanceEffort = mDistancePid.update( -1 * remaining, 0 );
+    const double drivingPower = mConfig.joystick.drivingPower;
+    const double bearingPower = mConfig.joystick.bearingPower;
+    const double halfWidth = mConfig.roverMeasurements.width / 2;
+    const double turnGain = mConfig.pathFollowing.turnGain;
+    double turningEffort = turnGain * PurePursuit::curvature( current, heading, target ) *
+                           halfWidth * drivingPower * distanceEffort / bearingPower;
+    turningEffort = max( -1.0, min( 1.0, turningEffort ) );
+    publishJoystick( distanceEffort, turningEffort, false );
+    return DriveStatus::OnCourse;
+} // drive()
+
+// Sends a joystick command to drive forward at effort, from 0 to 1, on
+// an arc of curvature in 1 / meters. Positive curvature turns right.
+// The turning effort is scaled the same way as pure pursuit's, so the
+// path following turn gain applies here too.
+void Rover::driveArc( const double effort, const double curvature )
+{
+    const double drivingPower = mConfig.joystick.drivingPower;
+    const double bearingPower = mConfig.joystick.bearingPower;
+    const double halfWidth = mConfig.roverMeasurements.width / 2;
+    double turningEffort = mConfig.pathFollowing.turnGain * curvature * halfWidth * drivingPower * effort / bearingPower;
+    turningEffort = max( -1.0, min( 1.0, turningEffort ) );
+    publishJoystick( effort, turningEffort, false );
+} // driveArc()
+
 // Sends a joystick command to turn the rover toward the destination
 // odometry. Returns true if the rover has finished turning, false
 // otherwise.
 bool Rover::turn( Odometry& destination )
 {
-    double bearing = calcBearing( mRoverStatus.odometry(), destination );
+    double bearing = mLocalFrame.bearing( mRoverStatus.odometry(), destination );
     return turn( bearing );
 } // turn()
 
+// Sends a joystick command to turn the rover toward the destination
+// point in the rover's local frame. Returns true if the rover has
+// finished turning, false otherwise.
+bool Rover::turn( const LocalPoint& destination )
+{
+    return turn( ::bearing( mLocalFrame.toLocal( mRoverStatus.odometry() ), destination ) );
+} // turn()
+
 // Sends a joystick command to turn the rover. The bearing is the
 // absolute bearing. Returns true if the rover has finished turning, false
 // otherwise.
@@ -185,14 +292,14 @@ bool Rover::turn( double bearing )
     }
     else
     {
-        turningBearingThreshold = mRoverConfig[ "navThresholds" ][ "turningBearing" ].GetDouble();
+        turningBearingThreshold = mConfig.navThresholds.turningBearing;
     }
     if( fabs( bearing - mRoverStatus.odometry().bearing_deg ) <= turningBearingThreshold )
     {
         return true;
     }
     double turningEffort = mBearingPid.update( mRoverStatus.odometry().bearing_deg, bearing );
-    double minTurningEffort = mRoverConfig[ "navThresholds" ][ "minTurningEffort" ].GetDouble() * (turningEffort < 0 ? -1 : 1);
+    double minTurningEffort = mConfig.navThresholds.minTurningEffort * (turningEffort < 0 ? -1 : 1);
     if( isTurningAroundObstacle( mRoverStatus.currentState() ) && fabs(turningEffort) < minTurningEffort )
     {
         turningEffort = minTurningEffort;
@@ -207,13 +314,18 @@ void Rover::stop()
     publishJoystick( 0, 0, false );
 } // stop()
 
-// Checks if the rover should be updated based on what information in
-// the rover's status has changed. Returns true if the rover was
-// updated, false otherwise.
-// TODO: unconditionally update everygthing. When abstracting search class
-// we got rid of NavStates TurnToTarget and DriveToTarget (oops) fix this soon :P
-bool Rover::updateRover( RoverStatus newRoverStatus )
+// Updates the rover's status with the parts of newRoverStatus that are
+// flagged in changedFields, so unchanged messages are never copied.
+// Returns true if the rover was updated, false otherwise.
+bool Rover::updateRover( RoverStatus& newRoverStatus, unsigned changedFields )
 {
+    // Poses are kept while the rover is off too, so detections that come
+    // in right as it turns on can be put back where they were seen.
+    if( changedFields & OdometryField )
+    {
+        mPoseHistory.add( newRoverStatus.odometryTimeUs(), newRoverStatus.odometry() );
+    }
+
     // Rover currently on.
     if( mRoverStatus.autonState().is_auton )
     {
@@ -224,50 +336,181 @@ bool Rover::updateRover( RoverStatus newRoverStatus )
             return true;
         }
 
-        // If any data has changed, update all data
-        if( !isEqual( mRoverStatus.obstacle(), newRoverStatus.obstacle() ) ||
-            !isEqual( mRoverStatus.odometry(), newRoverStatus.odometry() ) ||
-            !isEqual( mRoverStatus.target(), newRoverStatus.target()) ||
-            !isEqual( mRoverStatus.target2(), newRoverStatus.target2()) )
+        bool updated = false;
+        if( ( changedFields & OdometryField ) && !isEqual( mRoverStatus.odometry(), newRoverStatus.odometry() ) )
         {
-            mRoverStatus.obstacle() = newRoverStatus.obstacle();
             mRoverStatus.odometry() = newRoverStatus.odometry();
-            mRoverStatus.target() = newRoverStatus.target();
-            return true;
+            updated = true;
         }
-
-        return false;
+        // An obstacle message is only taken if it agrees with the
+        // filtered detection, otherwise the last one that did is kept.
+        if( changedFields & ObstacleField )
+        {
+            const bool obstacleSeen = newRoverStatus.obstacle().distance >= 0;
+            if( mObstacleFilter.update( obstacleSeen ) == obstacleSeen &&
+                !isEqual( mSeenObstacle, newRoverStatus.obstacle() ) )
+            {
+                mSeenObstacle = newRoverStatus.obstacle();
+                mObstacleCaptureHeading = headingAt( mSeenObstacle.capture_time_us );
+                updated = true;
+            }
+        }
+        if( ( changedFields & TargetField ) &&
+            ( !isEqual( mSeenTarget1, newRoverStatus.target() ) ||
+              !isEqual( mSeenTarget2, newRoverStatus.target2() ) ||
+              !isEqual( mSeenTags, newRoverStatus.tags() ) ) )
+        {
+            mSeenTarget1 = newRoverStatus.target();
+            mSeenTarget2 = newRoverStatus.target2();
+            mSeenTags = newRoverStatus.tags();
+            mRoverStatus.targetCapture() = newRoverStatus.targetCapture();
+            mTargetCaptureHeading = headingAt( mRoverStatus.targetCapture().timeUs );
+            updated = true;
+        }
+        if( updated )
+        {
+            compensateDetections();
+        }
+        return updated;
     }
 
     // Rover currently off.
     else
     {
-        // Rover turned on.
+        // Rover turned on. Everything may have changed while the rover
+        // was off, but the course is only copied if it is a new one.
         if( newRoverStatus.autonState().is_auton )
         {
-            mRoverStatus = newRoverStatus;
-            // Calculate longitude minutes/meter conversion.
-            mLongMeterInMinutes = 60 / ( EARTH_CIRCUM * cos( degreeToRadian(
-                mRoverStatus.odometry().latitude_deg, mRoverStatus.odometry().latitude_min ) ) / 360 );
+            mRoverStatus.autonState() = newRoverStatus.autonState();
+            if( mRoverStatus.course().hash != newRoverStatus.course().hash ||
+                mRoverStatus.course().num_waypoints != newRoverStatus.course().num_waypoints )
+            {
+                mRoverStatus.course() = newRoverStatus.course();
+            }
+            mRoverStatus.resetPath();
+            mRoverStatus.odometry() = newRoverStatus.odometry();
+            mSeenObstacle = newRoverStatus.obstacle();
+            mObstacleCaptureHeading = headingAt( mSeenObstacle.capture_time_us );
+            mObstacleFilter.configure( mConfig.obstacleFilter.window, mConfig.obstacleFilter.onCount,
+                                       mConfig.obstacleFilter.offCount );
+            mObstacleFilter.reset( newRoverStatus.obstacle().distance >= 0 );
+            mSeenTarget1 = newRoverStatus.target();
+            mSeenTarget2 = newRoverStatus.target2();
+            mSeenTags = newRoverStatus.tags();
+            mRoverStatus.targetCapture() = newRoverStatus.targetCapture();
+            mTargetCaptureHeading = headingAt( mRoverStatus.targetCapture().timeUs );
+            compensateDetections();
+            // Anchor the local frame at the first waypoint so the whole
+            // course stays close to the anchor.
+            if( mRoverStatus.course().num_waypoints > 0 )
+            {
+                mLocalFrame.anchor( mRoverStatus.course().waypoints[ 0 ].odom );
+            }
+            else
+            {
+                mLocalFrame.anchor( mRoverStatus.odometry() );
+            }
+            if( mConfig.courseOrder.optimize )
+            {
+                const LocalPoint start = mLocalFrame.toLocal( mRoverStatus.odometry() );
+                const double sentLength = courseLength( mRoverStatus.path(), mLocalFrame, start );
+                if( orderCourse( mRoverStatus.path(), mLocalFrame, start ) )
+                {
+                    cerr << "Reordered the course from " << sentLength << " m to "
+                         << courseLength( mRoverStatus.path(), mLocalFrame, start ) << " m\n";
+                }
+            }
             return true;
         }
         return false;
     }
 } // updateRover()
 
+// Returns the rover's heading at timeUs, a capture stamp. Detections
+// without a stamp, or older than the pose history, are taken as seen
+// from the current heading.
+double Rover::headingAt( const int64_t timeUs )
+{
+    Odometry pose;
+    if( timeUs > 0 && mPoseHistory.at( timeUs, pose ) )
+    {
+        return pose.bearing_deg;
+    }
+    return mRoverStatus.odometry().bearing_deg;
+} // headingAt()
+
+// Sets the bearings of the targets and obstacle in the rover status to
+// be from the rover's current heading instead of the heading it had
+// when their frames were captured. Perception's outputs are a few
+// hundred milliseconds old, so while the rover spins a target's bearing
+// would otherwise point where the target was, and the rover would turn
+// past it and back. Called whenever the odometry or a detection changes.
+void Rover::compensateDetections()
+{
+    const double heading = mRoverStatus.odometry().bearing_deg;
+    const auto turnedSince = [heading]( const double captureHeading )
+    {
+        const double turned = mod( heading - captureHeading, 360 );
+        return turned > 180 ? turned - 360 : turned;
+    };
+    // Bearings from straight ahead, between -180 and 180.
+    const auto fromHeading = []( const double bearing )
+    {
+        const double wrapped = mod( bearing, 360 );
+        return wrapped > 180 ? wrapped - 360 : wrapped;
+    };
+
+    const double targetTurned = turnedSince( mTargetCaptureHeading );
+    mRoverStatus.target() = mSeenTarget1;
+    mRoverStatus.target2() = mSeenTarget2;
+    if( mSeenTarget1.distance >= 0 )
+    {
+        mRoverStatus.target().bearing = fromHeading( mSeenTarget1.bearing - targetTurned );
+    }
+    if( mSeenTarget2.distance >= 0 )
+    {
+        mRoverStatus.target2().bearing = fromHeading( mSeenTarget2.bearing - targetTurned );
+    }
+    mRoverStatus.tags() = mSeenTags;
+    for( DetectedTag& tag : mRoverStatus.tags() )
+    {
+        tag.bearing = fromHeading( tag.bearing - targetTurned );
+    }
+
+    const double obstacleTurned = turnedSince( mObstacleCaptureHeading );
+    mRoverStatus.obstacle() = mSeenObstacle;
+    if( mSeenObstacle.distance >= 0 )
+    {
+        mRoverStatus.obstacle().bearing = fromHeading( mSeenObstacle.bearing - obstacleTurned );
+        mRoverStatus.obstacle().rightBearing = fromHeading( mSeenObstacle.rightBearing - obstacleTurned );
+    }
+} // compensateDetections()
+
 // Calculates the conversion from minutes to meters based on the
 // rover's current latitude.
 const double Rover::longMeterInMinutes() const
 {
-    return mLongMeterInMinutes;
+    return mLocalFrame.longMeterInMinutes();
 }
 
+// Gets the rover's local frame.
+const LocalFrame& Rover::localFrame() const
+{
+    return mLocalFrame;
+} // localFrame()
+
 // Gets the rover's status object.
 Rover::RoverStatus& Rover::roverStatus()
 {
     return mRoverStatus;
 } // roverStatus()
 
+// Gets the settings the rover and state machines read every iteration.
+const NavConfig& Rover::config() const
+{
+    return mConfig;
+} // config()
+
 // Gets the rover's driving pid object.
 PidLoop& Rover::distancePid()
 {
@@ -280,20 +523,50 @@ PidLoop& Rover::bearingPid()
     return mBearingPid;
 } // bearingPid()
 
+// Gets the rover's pure pursuit path follower.
+PurePursuit& Rover::pathFollower()
+{
+    return mPathFollower;
+} // pathFollower()
+
+// Returns true if the course and search are driven as paths with pure
+// pursuit, false if the rover turns in place toward every point.
+bool Rover::isFollowingPaths() const
+{
+    return mConfig.pathFollowing.purePursuit;
+} // isFollowingPaths()
+
+// Gets the last joystick command the rover sent.
+const Joystick& Rover::lastJoystick() const
+{
+    return mLastJoystick;
+} // lastJoystick()
+
+// Gets when the last joystick command was sent, in microseconds of the
+// steady clock, or 0 if none has been.
+int64_t Rover::lastJoystickUs() const
+{
+    return mLastJoystickUs;
+} // lastJoystickUs()
+
 // Publishes a joystick command with the given forwardBack and
 // leftRight efforts.
 void Rover::publishJoystick( const double forwardBack, const double leftRight, const bool kill )
 {
     Joystick joystick;
     // power limit (0 = 50%, 1 = 0%, -1 = 100% power)
-    joystick.dampen = mRoverConfig[ "joystick" ][ "dampen" ].GetDouble();
-    double drivingPower = mRoverConfig[ "joystick" ][ "drivingPower" ].GetDouble();
+    joystick.dampen = mConfig.joystick.dampen;
+    double drivingPower = mConfig.joystick.drivingPower;
     joystick.forward_back = drivingPower * forwardBack;
-    double bearingPower = mRoverConfig[ "joystick" ][ "bearingPower" ].GetDouble();
+    double bearingPower = mConfig.joystick.bearingPower;
     joystick.left_right = bearingPower * leftRight;
     joystick.kill = kill;
-    string joystickChannel = mRoverConfig[ "lcmChannels" ][ "joystickChannel" ].GetString();
-    mLcmObject.publish( joystickChannel, &joystick );
+    joystick.restart = false;
+    mLcmObject.publish( mConfig.lcmChannels.joystickChannel, &joystick );
+    Trace::flowOut( Trace::messageId( joystick ) );
+    mLastJoystick = joystick;
+    mLastJoystickUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
 } // publishJoystick()
 
 // Returns true if the two obstacle messages are equal, false
@@ -335,6 +608,26 @@ bool Rover::isEqual( const Target& target, const Target& target2 ) const
     return false;
 } // isEqual( Target )
 
+// Returns true if the two lists of tracked tags are equal, false
+// otherwise.
+bool Rover::isEqual( const vector<DetectedTag>& tags1, const vector<DetectedTag>& tags2 ) const
+{
+    if( tags1.size() != tags2.size() )
+    {
+        return false;
+    }
+    for( size_t i = 0; i < tags1.size(); ++i )
+    {
+        if( tags1[ i ].id != tags2[ i ].id ||
+            tags1[ i ].distance != tags2[ i ].distance ||
+            tags1[ i ].bearing != tags2[ i ].bearing )
+        {
+            return false;
+        }
+    }
+    return true;
+} // isEqual( DetectedTag )
+
 // Return true if the current state is TurnAroundObs or SearchTurnAroundObs,
 // false otherwise.
 bool Rover::isTurningAroundObstacle( const NavState currentState ) const
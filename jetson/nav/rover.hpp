@@ -7,12 +7,18 @@
 #include "rover_msgs/AutonState.hpp"
 #include "rover_msgs/Bearing.hpp"
 #include "rover_msgs/Course.hpp"
+#include "rover_msgs/Joystick.hpp"
 #include "rover_msgs/Obstacle.hpp"
 #include "rover_msgs/Odometry.hpp"
 #include "rover_msgs/TargetList.hpp"
 #include "rover_msgs/Waypoint.hpp"
 #include "rapidjson/document.h"
+#include "navConfig.hpp"
 #include "pid.hpp"
+#include "localFrame.hpp"
+#include "poseHistory.hpp"
+#include "purePursuit.hpp"
+#include "temporal_filter.hpp"
 
 using namespace rover_msgs;
 using namespace std;
@@ -57,6 +63,7 @@ enum class NavState
     GateFace = 46,
     GateShimmy = 47,
     GateDriveThrough = 48,
+    GateTrajectory = 49,
 
     // Unknown State
     Unknown = 255
@@ -71,6 +78,30 @@ enum class DriveStatus
     OffCourse
 }; // DriveStatus
 
+// When the camera frame a perception output came from was captured.
+struct CaptureStamp
+{
+    // Microseconds of the monotonic clock every process on the Jetson
+    // shares, 0 if unknown.
+    int64_t timeUs;
+
+    // Frames captured since perception started, -1 if unknown.
+    int64_t frameSeq;
+}; // CaptureStamp
+
+// The parts of the rover status that come from LCM messages. Used as
+// bit flags to tell the rover which parts changed since the last update.
+enum RoverStatusField : unsigned
+{
+    AutonStateField = 1 << 0,
+    CourseField = 1 << 1,
+    ObstacleField = 1 << 2,
+    OdometryField = 1 << 3,
+    TargetField = 1 << 4,
+    ObstacleProfileField = 1 << 5,
+    AllFields = ( 1 << 6 ) - 1
+}; // RoverStatusField
+
 // This class creates a Rover object which can perform operations that
 // the real rover can perform.
 class Rover
@@ -109,9 +140,20 @@ public:
 
         Target& target2();
 
+        // Every tag perception is tracking, leftmost first. Empty if
+        // perception only sent the two targets.
+        vector<DetectedTag>& tags();
+
+        // When the frame both targets were seen in was captured.
+        CaptureStamp& targetCapture();
+
+        // When the odometry message arrived, in microseconds of the
+        // same clock as the capture stamps.
+        int64_t& odometryTimeUs();
+
         unsigned getPathTargets();
 
-        RoverStatus& operator=( RoverStatus& newRoverStatus );
+        void resetPath();
 
     private:
         // The rover's current navigation state.
@@ -141,34 +183,62 @@ public:
 
         Target mTarget2;
 
+        vector<DetectedTag> mTags;
+
+        CaptureStamp mTargetCapture;
+
+        int64_t mOdometryTimeUs;
+
         // Total targets to seach for in the course
         unsigned mPathTargets;
     };
 
-    Rover( const rapidjson::Document& config, lcm::LCM& lcm_in );
+    Rover( const NavConfig& config, lcm::LCM& lcm_in );
 
     DriveStatus drive( const Odometry& destination );
 
+    DriveStatus drive( const LocalPoint& destination );
+
     DriveStatus drive( const double distance, const double bearing, const bool target = false );
 
     void drive(const int direction, const double bearing);
 
+    DriveStatus drive( PurePursuit& follower );
+
+    void driveArc( const double effort, const double curvature );
+
     bool turn( Odometry& destination );
 
+    bool turn( const LocalPoint& destination );
+
     bool turn( double bearing );
 
     void stop();
 
-    bool updateRover( RoverStatus newRoverStatus );
+    bool updateRover( RoverStatus& newRoverStatus, unsigned changedFields );
 
     RoverStatus& roverStatus();
 
+    const NavConfig& config() const;
+
     PidLoop& distancePid();
 
     PidLoop& bearingPid();
 
+    void updatePidConfig();
+
+    PurePursuit& pathFollower();
+
+    bool isFollowingPaths() const;
+
     const double longMeterInMinutes() const;
 
+    const LocalFrame& localFrame() const;
+
+    const Joystick& lastJoystick() const;
+
+    int64_t lastJoystickUs() const;
+
   
 private:
     /*************************************************************************/
@@ -182,8 +252,14 @@ private:
 
     bool isEqual( const Target& target, const Target& target2 ) const;
 
+    bool isEqual( const vector<DetectedTag>& tags1, const vector<DetectedTag>& tags2 ) const;
+
     bool isTurningAroundObstacle( const NavState currentState ) const;
 
+    double headingAt( const int64_t timeUs );
+
+    void compensateDetections();
+
     /*************************************************************************/
     /* Private Member Variables */
     /*************************************************************************/
@@ -191,8 +267,9 @@ private:
     // The rover's current status.
     RoverStatus mRoverStatus;
 
-    // A reference to the configuration file.
-    const rapidjson::Document& mRoverConfig;
+    // A reference to the parsed configuration, owned by the state
+    // machine so it can reload it.
+    const NavConfig& mConfig;
 
     // A reference to the lcm object that will be used for
     // communicating with the actual rover and the base station.
@@ -204,11 +281,44 @@ private:
     // The pid loop for turning.
     PidLoop mBearingPid;
 
-  
+    // The path the rover is following when driving with pure pursuit.
+    // It is cleared on every state change, like the pid loops.
+    PurePursuit mPathFollower;
+
+    // Debounces the obstacle messages perception sends, so one dropped
+    // or spurious detection doesn't start or end avoiding an obstacle.
+    TemporalFilter mObstacleFilter;
+
+    // The rover's recent poses, to find the heading it had when a
+    // detection's camera frame was captured.
+    PoseHistory mPoseHistory;
+
+    // The targets and obstacle as perception sent them, with bearings
+    // from where the rover was heading when the frame was captured, and
+    // that heading. The ones in the rover status have their bearings
+    // turned to be from the rover's current heading.
+    Target mSeenTarget1;
+
+    Target mSeenTarget2;
+
+    vector<DetectedTag> mSeenTags;
+
+    double mTargetCaptureHeading;
+
+    Obstacle mSeenObstacle;
+
+    double mObstacleCaptureHeading;
+
+    // The last joystick command sent and when it was sent, in
+    // microseconds of the steady clock, 0 before the first one.
+    Joystick mLastJoystick;
+
+    int64_t mLastJoystickUs;
 
-    // The conversion factor from arcminutes to meters. This is based
-    // on the rover's current latitude.
-    double mLongMeterInMinutes;
+    // The flat frame that distances and bearings are calculated in.
+    // This is anchored at the start of the course when the rover
+    // turns on.
+    LocalFrame mLocalFrame;
 };
 
 #endif // ROVER_HPP
@@ -0,0 +1,123 @@
+#include "coverageGrid.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Constructs an empty coverage grid. Nothing is stamped until the grid
+// is reset around a search.
+CoverageGrid::CoverageGrid()
+    : mOrigin{ 0, 0 }
+    , mCellSize( 1 )
+    , mCells( 0 )
+{
+} // CoverageGrid()
+
+// Resizes the grid to cover halfWidth meters around center and marks
+// every cell as unseen.
+void CoverageGrid::reset( const LocalPoint& center, const double halfWidth, const double cellSize )
+{
+    mCellSize = cellSize;
+    mCells = int( ceil( 2 * halfWidth / cellSize ) );
+    mOrigin.east = center.east - mCells * cellSize / 2;
+    mOrigin.north = center.north - mCells * cellSize / 2;
+    mSeen.assign( size_t( mCells ) * mCells, 0 );
+} // reset()
+
+// Marks every cell as unseen without moving the grid.
+void CoverageGrid::clear()
+{
+    fill( mSeen.begin(), mSeen.end(), 0 );
+} // clear()
+
+// Swaps the two grids, without copying or allocating cells.
+void CoverageGrid::swap( CoverageGrid& other )
+{
+    std::swap( mOrigin, other.mOrigin );
+    std::swap( mCellSize, other.mCellSize );
+    std::swap( mCells, other.mCells );
+    mSeen.swap( other.mSeen );
+} // swap()
+
+// Marks the cells inside the camera's footprint as seen. The footprint
+// is a wedge of the given range and field of view, both in meters and
+// degrees, facing the absolute bearing from position. Returns the
+// number of cells that hadn't been seen before.
+int CoverageGrid::stamp( const LocalPoint& position, const double bearing, const double range, const double fieldOfView )
+{
+    int newlySeen = 0;
+    if( mCells == 0 )
+    {
+        return newlySeen;
+    }
+    const int minCol = max( 0, int( floor( ( position.east - range - mOrigin.east ) / mCellSize ) ) );
+    const int maxCol = min( mCells - 1, int( floor( ( position.east + range - mOrigin.east ) / mCellSize ) ) );
+    const int minRow = max( 0, int( floor( ( position.north - range - mOrigin.north ) / mCellSize ) ) );
+    const int maxRow = min( mCells - 1, int( floor( ( position.north + range - mOrigin.north ) / mCellSize ) ) );
+    for( int row = minRow; row <= maxRow; ++row )
+    {
+        for( int col = minCol; col <= maxCol; ++col )
+        {
+            LocalPoint cellCenter = { mOrigin.east + ( col + 0.5 ) * mCellSize,
+                                      mOrigin.north + ( row + 0.5 ) * mCellSize };
+            const double cellDistance = distance( position, cellCenter );
+            if( cellDistance > range )
+            {
+                continue;
+            }
+            // The cell the rover is in is always visible.
+            double offAngle = mod( ::bearing( position, cellCenter ) - bearing + 180, 360 ) - 180;
+            unsigned char& seen = mSeen[ size_t( row ) * mCells + col ];
+            if( !seen && ( cellDistance < mCellSize || fabs( offAngle ) <= fieldOfView / 2 ) )
+            {
+                seen = 1;
+                ++newlySeen;
+            }
+        }
+    }
+    return newlySeen;
+} // stamp()
+
+// Returns the fraction of the cells within radius of point that have
+// been seen. Cells outside of the grid count as unseen.
+double CoverageGrid::coverage( const LocalPoint& point, const double radius ) const
+{
+    const int minCol = int( floor( ( point.east - radius - mOrigin.east ) / mCellSize ) );
+    const int maxCol = int( floor( ( point.east + radius - mOrigin.east ) / mCellSize ) );
+    const int minRow = int( floor( ( point.north - radius - mOrigin.north ) / mCellSize ) );
+    const int maxRow = int( floor( ( point.north + radius - mOrigin.north ) / mCellSize ) );
+    int total = 0;
+    int seen = 0;
+    for( int row = minRow; row <= maxRow; ++row )
+    {
+        for( int col = minCol; col <= maxCol; ++col )
+        {
+            LocalPoint cellCenter = { mOrigin.east + ( col + 0.5 ) * mCellSize,
+                                      mOrigin.north + ( row + 0.5 ) * mCellSize };
+            if( distance( point, cellCenter ) > radius )
+            {
+                continue;
+            }
+            ++total;
+            size_t index;
+            if( cellIndex( col, row, index ) && mSeen[ index ] )
+            {
+                ++seen;
+            }
+        }
+    }
+    return total == 0 ? 0 : double( seen ) / total;
+} // coverage()
+
+// Finds the index of the cell in mSeen. Returns false if the cell is
+// outside of the grid.
+bool CoverageGrid::cellIndex( const int col, const int row, size_t& index ) const
+{
+    if( col < 0 || row < 0 || col >= mCells || row >= mCells )
+    {
+        return false;
+    }
+    index = size_t( row ) * mCells + col;
+    return true;
+} // cellIndex()
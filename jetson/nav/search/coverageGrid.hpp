@@ -0,0 +1,41 @@
+#ifndef COVERAGE_GRID_HPP
+#define COVERAGE_GRID_HPP
+
+#include <vector>
+#include "localFrame.hpp"
+
+// This class keeps track of the ground that the camera has seen during
+// a search. The grid is a square of cells in the rover's local frame
+// and is centered on the search waypoint.
+class CoverageGrid
+{
+public:
+    CoverageGrid();
+
+    void reset( const LocalPoint& center, const double halfWidth, const double cellSize );
+
+    void clear();
+
+    void swap( CoverageGrid& other );
+
+    int stamp( const LocalPoint& position, const double bearing, const double range, const double fieldOfView );
+
+    double coverage( const LocalPoint& point, const double radius ) const;
+
+private:
+    bool cellIndex( const int col, const int row, size_t& index ) const;
+
+    // The local point at the corner of cell ( 0, 0 ).
+    LocalPoint mOrigin;
+
+    // Width of a cell in meters.
+    double mCellSize;
+
+    // Number of cells along each side of the grid.
+    int mCells;
+
+    // Whether each cell has been seen, stored row by row.
+    std::vector<unsigned char> mSeen;
+};
+
+#endif // COVERAGE_GRID_HPP
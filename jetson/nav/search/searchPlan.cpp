@@ -0,0 +1,140 @@
+#include "searchPlan.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace std;
+
+namespace
+{
+    // Every search has four multipliers. Each pass through them is one
+    // loop of the search, and they move outward after every use.
+    typedef pair<short, short> Multiplier;
+
+    // Sets multipliers to the intermost loop of a search of type.
+    void initializeMultipliers( const SearchType type, Multiplier* multipliers )
+    {
+        switch( type )
+        {
+            case SearchType::LAWNMOWER:
+            {
+                multipliers[ 0 ] = Multiplier(  0, 1 );
+                multipliers[ 1 ] = Multiplier( -1, 1 );
+                multipliers[ 2 ] = Multiplier( -1, 0 );
+                multipliers[ 3 ] = Multiplier( -2, 0 );
+                break;
+            }
+
+            case SearchType::SPIRALIN:
+            {
+                multipliers[ 0 ] = Multiplier( -1,  0 );
+                multipliers[ 1 ] = Multiplier( -1,  1 );
+                multipliers[ 2 ] = Multiplier(  1,  1 );
+                multipliers[ 3 ] = Multiplier(  1, -1 );
+                break;
+            }
+
+            case SearchType::SPIRALOUT:
+            default:
+            {
+                multipliers[ 0 ] = Multiplier(  0,  1 );
+                multipliers[ 1 ] = Multiplier( -1,  1 );
+                multipliers[ 2 ] = Multiplier( -1, -1 );
+                multipliers[ 3 ] = Multiplier(  1, -1 );
+                break;
+            }
+        }
+    } // initializeMultipliers()
+
+    // Generates the next corner of the search from the multipliers.
+    // Returns false once the search has no more corners. A lawn mower
+    // sweeps across the search area and back on every pass, and the
+    // spirals make one loop.
+    bool nextCorner( const SearchPlan& plan, Multiplier* multipliers, size_t& index, LocalPoint& corner )
+    {
+        Multiplier& multiplier = multipliers[ index ];
+        corner = plan.center;
+        if( plan.type == SearchType::LAWNMOWER )
+        {
+            if( index == 0 && fabs( multipliers[ 0 ].first * plan.distance ) >= plan.bailThresh )
+            {
+                return false;
+            }
+            corner.north += multiplier.first * plan.distance;
+            corner.east += multiplier.second * ( 2 * plan.bailThresh );
+            multiplier.first -= 2;
+        }
+        else
+        {
+            if( index == 0 && multipliers[ 0 ].second * plan.distance >= plan.bailThresh )
+            {
+                return false;
+            }
+            corner.north += multiplier.first * plan.distance;
+            corner.east += multiplier.second * plan.distance;
+            multiplier.first < 0 ? --multiplier.first : ++multiplier.first;
+            multiplier.second < 0 ? --multiplier.second : ++multiplier.second;
+        }
+        index = ( index + 1 ) % 4;
+        return true;
+    } // nextCorner()
+} // namespace
+
+// Constructs an empty plan.
+SearchPlan::SearchPlan()
+    : type( SearchType::SPIRALOUT )
+    , center{ 0, 0 }
+    , distance( 0 )
+    , bailThresh( 0 )
+    , maxGap( 0 )
+{
+} // SearchPlan()
+
+// Returns true if the two plans are for the same search, whatever
+// their points are.
+bool SearchPlan::sameSearch( const SearchPlan& other ) const
+{
+    return type == other.type &&
+           center.east == other.center.east &&
+           center.north == other.center.north &&
+           distance == other.distance &&
+           bailThresh == other.bailThresh &&
+           maxGap == other.maxGap;
+} // sameSearch()
+
+// Fills the plan's points from its settings. Points are added between
+// the corners of the search so that no two points are farther apart
+// than maxGap. Reuses the points' memory, so planning a search no
+// bigger than the last one doesn't allocate.
+void planSearch( SearchPlan& plan )
+{
+    plan.points.clear();
+    if( plan.distance <= 0 || plan.maxGap <= 0 )
+    {
+        return;
+    }
+    Multiplier multipliers[ 4 ];
+    initializeMultipliers( plan.type, multipliers );
+    size_t index = 0;
+    LocalPoint corner;
+    if( !nextCorner( plan, multipliers, index, corner ) )
+    {
+        return;
+    }
+    plan.points.push_back( corner );
+    LocalPoint legStart = corner;
+    while( nextCorner( plan, multipliers, index, corner ) )
+    {
+        const int steps = max( 1, int( ceil( ::distance( legStart, corner ) / plan.maxGap ) ) );
+        for( int step = 1; step <= steps; ++step )
+        {
+            const double fraction = double( step ) / steps;
+            LocalPoint point;
+            point.east = legStart.east + fraction * ( corner.east - legStart.east );
+            point.north = legStart.north + fraction * ( corner.north - legStart.north );
+            plan.points.push_back( point );
+        }
+        legStart = corner;
+    }
+} // planSearch()
@@ -0,0 +1,47 @@
+#ifndef SEARCH_PLAN_HPP
+#define SEARCH_PLAN_HPP
+
+#include <vector>
+#include "localFrame.hpp"
+
+// This class is the representation of different
+// search algorithms
+enum class SearchType
+{
+    SPIRALOUT,
+    LAWNMOWER,
+    SPIRALIN
+};
+
+// Every point a search visits, in order. The points only depend on the
+// settings here, so a search can be planned ahead of time, off the
+// control thread, and handed to the search once the rover gets there.
+struct SearchPlan
+{
+    SearchPlan();
+
+    // Returns true if the two plans are for the same search, whatever
+    // their points are.
+    bool sameSearch( const SearchPlan& other ) const;
+
+    SearchType type;
+
+    // The point in the rover's local frame the search is centered on.
+    LocalPoint center;
+
+    // Distance between the loops of the search.
+    double distance;
+
+    // Size of the search area, the search ends once it is covered.
+    double bailThresh;
+
+    // No two points are farther apart than this. Points are added
+    // between the corners of the search to keep them this close.
+    double maxGap;
+
+    std::vector<LocalPoint> points;
+};
+
+void planSearch( SearchPlan& plan );
+
+#endif // SEARCH_PLAN_HPP
@@ -0,0 +1,74 @@
+#include "searchSelector.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Sets best to the index of the candidate that sees new ground fastest
+// from the rover's position and bearing. Earlier candidates win ties.
+// Returns false if none of them would see any new ground.
+bool SearchSelector::select( const vector<Candidate>& candidates, const CoverageGrid& coverage,
+                             const LocalPoint& position, const double bearing, const double bailThresh,
+                             const Model& model, size_t& best )
+{
+    double bestCost = -1;
+    for( size_t i = 0; i < candidates.size(); ++i )
+    {
+        const double cost = secondsPerCell( candidates[ i ], coverage, position, bearing, bailThresh, model );
+        if( cost >= 0 && ( bestCost < 0 || cost < bestCost ) )
+        {
+            bestCost = cost;
+            best = i;
+        }
+    }
+    return bestCost >= 0;
+} // select()
+
+// Simulates the candidate search from the rover's position and bearing
+// over a copy of the coverage grid. Returns the seconds it takes for
+// every cell of ground it newly sees, or -1 if it sees none.
+double SearchSelector::secondsPerCell( const Candidate& candidate, const CoverageGrid& coverage,
+                                       const LocalPoint& position, const double bearing, const double bailThresh,
+                                       const Model& model )
+{
+    mPlan.type = candidate.type;
+    mPlan.center = candidate.center;
+    mPlan.distance = candidate.distance;
+    mPlan.bailThresh = bailThresh;
+    mPlan.maxGap = 2 * model.visionDistance;
+    planSearch( mPlan );
+    mCoverage = coverage;
+
+    // The camera is stamped along every leg at half its range apart, so
+    // its footprints overlap like they do while driving.
+    const double stampGap = max( model.visionDistance / 2, 0.1 );
+    LocalPoint from = position;
+    double heading = bearing;
+    double seconds = 0;
+    int newCells = 0;
+    for( const LocalPoint& point : mPlan.points )
+    {
+        if( mCoverage.coverage( point, mPlan.distance ) >= model.coveredFraction )
+        {
+            continue;
+        }
+        const double legLength = ::distance( from, point );
+        const double legBearing = legLength > 0 ? ::bearing( from, point ) : heading;
+        const double turn = fabs( mod( legBearing - heading + 180, 360 ) - 180 );
+        seconds += turn / model.turnRate + legLength / model.driveSpeed + model.spinTime;
+        const int stamps = int( ceil( legLength / stampGap ) );
+        for( int i = 1; i <= stamps; ++i )
+        {
+            const double fraction = double( i ) / stamps;
+            const LocalPoint along = { from.east + fraction * ( point.east - from.east ),
+                                       from.north + fraction * ( point.north - from.north ) };
+            newCells += mCoverage.stamp( along, legBearing, model.visionDistance, model.fieldOfView );
+        }
+        newCells += mCoverage.stamp( point, legBearing, model.visionDistance, 360 );
+        from = point;
+        heading = legBearing;
+    }
+    return newCells == 0 ? -1 : seconds / newCells;
+} // secondsPerCell()
@@ -0,0 +1,61 @@
+#ifndef SEARCH_SELECTOR_HPP
+#define SEARCH_SELECTOR_HPP
+
+#include <vector>
+#include "coverageGrid.hpp"
+#include "searchPlan.hpp"
+
+// This class picks the search to run next at a search waypoint. Every
+// candidate search is planned and driven in simulation over a copy of
+// the coverage grid: the rover drives between the points that aren't
+// already covered, the camera stamps the ground ahead of it on the way,
+// and it spins at every point. The candidate that sees new ground
+// fastest, in seconds per newly seen cell, is picked.
+class SearchSelector
+{
+public:
+    // How fast the rover is expected to do each part of a search.
+    struct Model
+    {
+        // Meters a second driving and degrees a second turning toward
+        // the next point.
+        double driveSpeed;
+        double turnRate;
+
+        // Seconds a spin at a search point takes.
+        double spinTime;
+
+        // The camera's range in meters and field of view in degrees.
+        double visionDistance;
+        double fieldOfView;
+
+        // Points whose surroundings are at least this covered are
+        // skipped, like the search does.
+        double coveredFraction;
+    };
+
+    // A search that can be picked, planned around its center without
+    // its points.
+    struct Candidate
+    {
+        SearchType type;
+        LocalPoint center;
+        double distance;
+    };
+
+    bool select( const std::vector<Candidate>& candidates, const CoverageGrid& coverage,
+                 const LocalPoint& position, const double bearing, const double bailThresh,
+                 const Model& model, size_t& best );
+
+    double secondsPerCell( const Candidate& candidate, const CoverageGrid& coverage,
+                           const LocalPoint& position, const double bearing, const double bailThresh,
+                           const Model& model );
+
+private:
+    // The plan and coverage grid candidates are simulated with. They
+    // are kept so simulating another candidate reuses their memory.
+    SearchPlan mPlan;
+    CoverageGrid mCoverage;
+};
+
+#endif // SEARCH_SELECTOR_HPP
@@ -14,7 +14,32 @@
 SearchStateMachine::SearchStateMachine(StateMachine* roverStateMachine, Rover* rover, const rapidjson::Document& roverConfig)
     : roverStateMachine( roverStateMachine ) 
     , mRover( rover ) 
-    , mRoverConfig( roverConfig ) {}
+    , mHasSearchPoint( false )
+    , mNextPoint( 0 )
+    , mNextStop( 0 )
+    , mOriginalSpinAngle( 0 )
+    , mSpinning( false )
+    , mSpinStartBearing( 0 )
+    , mSpinSetpoint( 0 )
+    , mSpunAngle( 0 )
+    , mLastSpinBearing( 0 )
+    , mWaitStarted( false )
+    , mRoverConfig( roverConfig )
+{
+} // SearchStateMachine()
+
+// Puts the search back the way it was constructed, so the same search
+// can be started again instead of making a new one.
+void SearchStateMachine::reset()
+{
+    mHasSearchPoint = false;
+    mNextPoint = 0;
+    mNextStop = 0;
+    mOriginalSpinAngle = 0;
+    mSpinning = false;
+    mWaitStarted = false;
+    mTargetMemory.forget();
+} // reset()
 
 
 // Runs the search state machine through one iteration. This will be called by
@@ -22,6 +47,12 @@ SearchStateMachine::SearchStateMachine(StateMachine* roverStateMachine, Rover* r
 // function based on the current state and return the next NavState
 NavState SearchStateMachine::run()
 {
+    const Target& seenTarget = mRover->roverStatus().target();
+    if( seenTarget.distance >= 0 )
+    {
+        mTargetMemory.see( mRover->localFrame().toLocal( mRover->roverStatus().odometry() ),
+                           mRover->roverStatus().odometry().bearing_deg, seenTarget, roverStateMachine->now() );
+    }
     switch ( mRover->roverStatus().currentState() )
     {
         case NavState::SearchSpin:
@@ -70,10 +101,13 @@ NavState SearchStateMachine::run()
 // to search spin.
 NavState SearchStateMachine::executeSearchSpin()
 {
+    if( mRover->config().search.continuousSpin )
+    {
+        return executeContinuousSpin();
+    }
+
     // degrees to turn to before performing a search wait.
-    double waitStepSize = mRoverConfig[ "search" ][ "searchWaitStepSize" ].GetDouble();
-    static double nextStop = 0; // to force the rover to wait initially
-    static double mOriginalSpinAngle = 0; //initialize, is corrected on first call
+    double waitStepSize = mRover->config().search.searchWaitStepSize;
 
     if( mRover->roverStatus().target().distance >= 0 )
     {
@@ -81,25 +115,105 @@ NavState SearchStateMachine::executeSearchSpin()
                                            mRover->roverStatus().odometry().bearing_deg );
         return NavState::TurnToTarget;
     }
-    if ( nextStop == 0 )
+    if ( mNextStop == 0 )
     {
         //get current angle and set as origAngle
         mOriginalSpinAngle = mRover->roverStatus().odometry().bearing_deg; //doublecheck
-        nextStop = mOriginalSpinAngle;
+        mNextStop = mOriginalSpinAngle;
     }
-    if( mRover->turn( nextStop ) )
+    if( mRover->turn( mNextStop ) )
     {
-        if( nextStop - mOriginalSpinAngle >= 360 )
+        if( mNextStop - mOriginalSpinAngle >= 360 )
         {
-            nextStop = 0;
+            mNextStop = 0;
             return NavState::SearchTurn;
         }
-        nextStop += waitStepSize;
+        mNextStop += waitStepSize;
         return NavState::SearchSpinWait;
     }
     return NavState::SearchSpin;
 } // executeSearchSpin()
 
+// Executes the logic for a continuous search spin, which turns a full
+// circle at the spin rate without stopping. If the rover detects the
+// target, it proceeds to the target. If finished with a 360, the rover
+// moves on to the next phase of the search. Else continues to search
+// spin. The setpoint is kept at most the turn between two detections
+// ahead of where the rover has turned to, so the rover can't race past
+// bearings after falling behind, and the rover waits for the setpoint
+// whenever it gets ahead of it.
+NavState SearchStateMachine::executeContinuousSpin()
+{
+    if( mRover->roverStatus().target().distance >= 0 )
+    {
+        mSpinning = false;
+        updateTargetDetectionElements( mRover->roverStatus().target().bearing,
+                                       mRover->roverStatus().odometry().bearing_deg );
+        return NavState::TurnToTarget;
+    }
+    const NavConfig& config = mRover->config();
+    const chrono::steady_clock::time_point now = roverStateMachine->now();
+    const double bearing = mRover->roverStatus().odometry().bearing_deg;
+    double elapsed = chrono::duration<double>( now - mLastSpinTime ).count();
+
+    // A spin that hasn't run for a while was left for another state, so
+    // it is started over.
+    if( !mSpinning || elapsed > 1 )
+    {
+        mSpinning = true;
+        mSpinStartBearing = bearing;
+        mSpinSetpoint = 0;
+        mSpunAngle = 0;
+        mLastSpinBearing = bearing;
+        elapsed = 0;
+    }
+    double turned = mod( bearing - mLastSpinBearing, 360 );
+    if( turned > 180 )
+    {
+        turned -= 360;
+    }
+    mSpunAngle += turned;
+    mLastSpinBearing = bearing;
+    mLastSpinTime = now;
+    if( mSpunAngle >= 360 )
+    {
+        mSpinning = false;
+        return NavState::SearchTurn;
+    }
+
+    const double rate = spinRate();
+    const double maxLead = max( config.computerVision.fieldOfViewAngle / config.search.spinFramesPerHeading,
+                                2 * config.navThresholds.turningBearing );
+    mSpinSetpoint = min( mSpinSetpoint + rate * elapsed, mSpunAngle + maxLead );
+
+    // The rover keeps turning with the last command once it's within the
+    // turning threshold, so it is stopped whenever it gets ahead.
+    if( mSpunAngle >= mSpinSetpoint )
+    {
+        mRover->stop();
+    }
+    else
+    {
+        mRover->turn( mSpinStartBearing + min( mSpinSetpoint, 360.0 ) );
+    }
+    return NavState::SearchSpin;
+} // executeContinuousSpin()
+
+// Returns the rate in degrees a second to spin at so that every bearing
+// stays in the camera's field of view for search.spinFramesPerHeading
+// detections, at the rate perception is running AR tag detection.
+double SearchStateMachine::spinRate() const
+{
+    const NavConfig& config = mRover->config();
+    double detectionRate = roverStateMachine->detectionRate();
+    if( detectionRate <= 0 )
+    {
+        detectionRate = config.search.spinFallbackDetectionRate;
+    }
+    return min( config.computerVision.fieldOfViewAngle * detectionRate / config.search.spinFramesPerHeading,
+                config.search.spinMaxRate );
+} // spinRate()
+
 
 // Executes the logic for waiting during a search spin so that CV can
 // look for the target. If the rover detects the target, it proceeds
@@ -107,25 +221,22 @@ NavState SearchStateMachine::executeSearchSpin()
 // spin. Else the rover keeps waiting.
 NavState SearchStateMachine::executeRoverWait()
 {
-    static bool started = false;
-    static time_t startTime;
-
     if( mRover->roverStatus().target().distance >= 0 )
     {
         updateTargetDetectionElements( mRover->roverStatus().target().bearing,
                                        mRover->roverStatus().odometry().bearing_deg );
         return NavState::TurnToTarget;
     }
-    if( !started )
+    if( !mWaitStarted )
     {
         mRover->stop();
-        startTime = time( nullptr );
-        started = true;
+        mWaitStartTime = roverStateMachine->now();
+        mWaitStarted = true;
     }
-    double waitTime = mRoverConfig[ "search" ][ "searchWaitTime" ].GetDouble();
-    if( difftime( time( nullptr ), startTime ) > waitTime )
+    double waitTime = mRover->config().search.searchWaitTime;
+    if( chrono::duration<double>( roverStateMachine->now() - mWaitStartTime ).count() > waitTime )
     {
-        started = false;
+        mWaitStarted = false;
         if ( mRover->roverStatus().currentState() == NavState::SearchSpinWait )
         {
             return NavState::SearchSpin;
@@ -143,13 +254,16 @@ NavState SearchStateMachine::executeRoverWait()
 }
 
 // Executes the logic for turning while searching.
+// Skips search points that are covered or can't be moved out of known
+// obstacles.
 // If no remaining search points, it proceeds to change search algorithms.
 // If the rover detects the target, it proceeds to the target.
 // If the rover finishes turning, it proceeds to driving while searching.
 // Else the rover keeps turning to the next Waypoint.
 NavState SearchStateMachine::executeSearchTurn()
 {
-    if( mSearchPoints.empty() )
+    skipSearchPoints();
+    if( !mHasSearchPoint )
     {
         return NavState::ChangeSearchAlg;
     }
@@ -159,8 +273,7 @@ NavState SearchStateMachine::executeSearchTurn()
                                        mRover->roverStatus().odometry().bearing_deg );
         return NavState::TurnToTarget;
     }
-    Odometry& nextSearchPoint = mSearchPoints.front();
-    if( mRover->turn( nextSearchPoint ) )
+    if( mRover->turn( mSearchPoint ) )
     {
         return NavState::SearchDrive;
     }
@@ -169,6 +282,8 @@ NavState SearchStateMachine::executeSearchTurn()
 
 // Executes the logic for driving while searching.
 // If the rover detects the target, it proceeds to the target.
+// If the costmap finds the search point inside an obstacle, the point is
+// moved out of it, or dropped, and the rover turns to the new point.
 // If the rover detects an obstacle and is within the obstacle 
 // distance threshold, it proceeds to obstacle avoidance.
 // If the rover finishes driving, it proceeds to turning to the next Waypoint.
@@ -183,18 +298,27 @@ NavState SearchStateMachine::executeSearchDrive()
         return NavState::TurnToTarget;
     }
 
-    if( isObstacleDetected( mRover )  && isObstacleInThreshold( mRover, mRoverConfig ) )
+    if( roverStateMachine->mCostmap->isBlocked( mSearchPoint ) )
+    {
+        skipSearchPoints();
+        return NavState::SearchTurn;
+    }
+    if( isObstacleDetected( mRover )  && isObstacleInThreshold( mRover ) )
     {
         roverStateMachine->updateObstacleAngle( mRover->roverStatus().obstacle().bearing );
         roverStateMachine->updateObstacleDistance( mRover->roverStatus().obstacle().distance );
+        roverStateMachine->updateAvoidanceGoal( mSearchPoint );
         return NavState::SearchTurnAroundObs;
     }
-    const Odometry& nextSearchPoint = mSearchPoints.front();
-    DriveStatus driveStatus = mRover->drive( nextSearchPoint );
+    if( mRover->isFollowingPaths() )
+    {
+        return executeFollowSearchLeg();
+    }
+    DriveStatus driveStatus = mRover->drive( mSearchPoint );
 
     if( driveStatus == DriveStatus::Arrived )
     {
-        mSearchPoints.pop_front();
+        popSearchPoint();
         return NavState::SearchSpin;
     }
     if( driveStatus == DriveStatus::OnCourse )
@@ -204,14 +328,41 @@ NavState SearchStateMachine::executeSearchDrive()
     return NavState::SearchTurn;
 } // executeSearchDrive()
 
+// Executes the logic for driving to the search point with pure
+// pursuit. The rover spins at every search point, so each point is its
+// own path, from where the rover started driving to the point. Pure
+// pursuit keeps the rover on the line between them instead of only
+// pointing at the search point.
+NavState SearchStateMachine::executeFollowSearchLeg()
+{
+    PurePursuit& follower = mRover->pathFollower();
+    if( !follower.hasPath() )
+    {
+        follower.setPath( { mRover->localFrame().toLocal( mRover->roverStatus().odometry() ), mSearchPoint } );
+    }
+    DriveStatus driveStatus = mRover->drive( follower );
+    if( driveStatus == DriveStatus::Arrived )
+    {
+        popSearchPoint();
+        return NavState::SearchSpin;
+    }
+    if( driveStatus == DriveStatus::OffCourse )
+    {
+        mRover->turn( follower.target() );
+    }
+    return NavState::SearchDrive;
+} // executeFollowSearchLeg()
+
 // Executes the logic for turning to the target.
-// If the rover loses the target, will continue to turn using last known angles.
+// If the rover loses the target for longer than it remembers it, will
+// continue to turn using last known angles.
 // If the rover finishes turning to the target, it goes into waiting state to
 // give CV time to relocate the target
 // Else the rover continues to turn to to the target.
 NavState SearchStateMachine::executeTurnToTarget()
 {
-    if( mRover->roverStatus().target().distance < 0 )
+    Target target;
+    if( !findTarget( target ) )
     {
         cerr << "Lost the target. Continuing to turn to last known angle\n";
         if( mRover->turn( mTargetAngle + mTurnToTargetRoverAngle ) )
@@ -220,19 +371,19 @@ NavState SearchStateMachine::executeTurnToTarget()
         }
         return NavState::TurnToTarget;
     }
-    if( mRover->turn( mRover->roverStatus().target().bearing +
-                      mRover->roverStatus().odometry().bearing_deg ) )
+    if( mRover->turn( target.bearing + mRover->roverStatus().odometry().bearing_deg ) )
     {
         return NavState::DriveToTarget;
     }
-    updateTargetDetectionElements( mRover->roverStatus().target().bearing,
-                                       mRover->roverStatus().odometry().bearing_deg );
+    updateTargetDetectionElements( target.bearing, mRover->roverStatus().odometry().bearing_deg );
     return NavState::TurnToTarget;
 } // executeTurnToTarget()
 
 // Executes the logic for driving to the target.
-// If the rover loses the target, it continues with search by going to
-// the last point before the rover turned to the target
+// If the rover loses the target for longer than it remembers it, it
+// continues with search by going to the last point before the rover
+// turned to the target. The target is often lost right before the
+// rover reaches it, so a remembered target can also be arrived at.
 // If the rover detects an obstacle and is within the obstacle 
 // distance threshold, it proceeds to go around the obstacle.
 // If the rover finishes driving to the target, it moves on to the next Waypoint.
@@ -240,38 +391,45 @@ NavState SearchStateMachine::executeTurnToTarget()
 // Else, it turns back to face the target.
 NavState SearchStateMachine::executeDriveToTarget()
 {
-    if( mRover->roverStatus().target().distance < 0 )
+    Target target;
+    if( !findTarget( target ) )
     {
         cerr << "Lost the target\n";
         return NavState::SearchTurn; //NavState::SearchSpin
     }
 
     if( isObstacleDetected( mRover ) &&
-        !isTargetReachable( mRover, mRoverConfig )  && isObstacleInThreshold( mRover, mRoverConfig ) )
+        !isLocationReachable( mRover, target.distance, mRover->config().navThresholds.targetDistance ) &&
+        isObstacleInThreshold( mRover ) )
     {
         roverStateMachine->updateObstacleAngle( mRover->roverStatus().obstacle().bearing );
         roverStateMachine->updateObstacleDistance( mRover->roverStatus().obstacle().distance );
+        roverStateMachine->updateAvoidanceGoal( offset( mRover->localFrame().toLocal( mRover->roverStatus().odometry() ),
+                                                        mRover->roverStatus().odometry().bearing_deg +
+                                                        target.bearing,
+                                                        target.distance ) );
         return NavState::SearchTurnAroundObs;
     }
 
-    DriveStatus driveStatus = mRover->drive( mRover->roverStatus().target().distance,
-                                             mRover->roverStatus().target().bearing +
+    DriveStatus driveStatus = mRover->drive( target.distance,
+                                             target.bearing +
                                              mRover->roverStatus().odometry().bearing_deg,
                                              true );
     if( driveStatus == DriveStatus::Arrived )
     {
-        mSearchPoints.clear();
+        mHasSearchPoint = false;
+        mTargetMemory.forget();
         if( mRover->roverStatus().path().front().gate )
         {
             roverStateMachine->mGateStateMachine->mGateSearchPoints.clear();
             const double absAngle = mod(mRover->roverStatus().odometry().bearing_deg +
-                                        mRover->roverStatus().target().bearing,
+                                        target.bearing,
                                         360);
             roverStateMachine->mGateStateMachine->lastKnownPost1.odom = createOdom( mRover->roverStatus().odometry(),
                                                                                     absAngle,
-                                                                                    mRover->roverStatus().target().distance,
+                                                                                    target.distance,
                                                                                     mRover );
-            roverStateMachine->mGateStateMachine->lastKnownPost1.id = mRover->roverStatus().target().id;
+            roverStateMachine->mGateStateMachine->lastKnownPost1.id = target.id;
             return NavState::GateSpin;
         }
         mRover->roverStatus().path().pop_front();
@@ -308,61 +466,120 @@ void SearchStateMachine::updateTargetDetectionElements( double target_bearing, d
     updateTurnToTargetRoverAngle( rover_bearing );
 } // updateTargetDetectionElements
 
-// add intermediate points between the existing search points in a path generated by a search algorithm.
-// The maximum separation between any points in the search point list is determined by the rover's sight distance.
-void SearchStateMachine::insertIntermediatePoints()
+// Gets the target the rover sees, or where the target the rover saw
+// last is if it was seen recently enough. Returns false if there is no
+// such target.
+bool SearchStateMachine::findTarget( Target& target ) const
+{
+    if( mRover->roverStatus().target().distance >= 0 )
+    {
+        target = mRover->roverStatus().target();
+        return true;
+    }
+    return mTargetMemory.recall( mRover->localFrame().toLocal( mRover->roverStatus().odometry() ),
+                                 mRover->roverStatus().odometry().bearing_deg,
+                                 roverStateMachine->now(),
+                                 mRover->config().search.targetMemoryTime,
+                                 target );
+} // findTarget()
+
+// Starts a search of type around center, with its loops distance
+// apart. The search is taken from the leg planner if it planned this
+// one while the rover drove here, and planned now otherwise.
+void SearchStateMachine::startSearch( const SearchType type, const LocalPoint& center, const double distance )
 {
-    double visionDistance = mRoverConfig[ "computerVision" ][ "visionDistance" ].GetDouble();
-    const double maxDifference = 2 * visionDistance;
+    mPlan.type = type;
+    mPlan.center = center;
+    mPlan.distance = distance;
+    mPlan.bailThresh = mRover->config().search.bailThresh;
+    mPlan.maxGap = 2 * mRover->config().computerVision.visionDistance;
+    if( !roverStateMachine->mLegPlanner.takeSearch( mPlan ) )
+    {
+        planSearch( mPlan );
+    }
+    mNextPoint = 0;
+    advanceSearchPoint();
+    skipSearchPoints();
+} // startSearch()
+
+// Returns true if the search still has points to visit, false otherwise.
+bool SearchStateMachine::hasSearchPoint() const
+{
+    return mHasSearchPoint;
+} // hasSearchPoint()
+
+// Moves on to the next search point that the camera hasn't already
+// seen the area around and that isn't stuck in an obstacle.
+void SearchStateMachine::popSearchPoint()
+{
+    advanceSearchPoint();
+    skipSearchPoints();
+} // popSearchPoint()
+
+// Skips search points whose surroundings are already covered, so the
+// rover drives straight to the next point with unseen ground instead.
+// A point inside an obstacle the costmap knows about is moved to the
+// nearest free ground instead of being driven to, so the rover doesn't
+// find the obstacle on the way and detour around it, and is skipped if
+// there is no free ground close enough.
+void SearchStateMachine::skipSearchPoints()
+{
+    const double coveredFraction = mRover->config().search.coveredFraction;
+    while( mHasSearchPoint &&
+           ( !moveOutOfObstacles( mSearchPoint ) ||
+             roverStateMachine->mSearchCoverage.coverage( mSearchPoint, mPlan.distance ) >= coveredFraction ) )
+    {
+        advanceSearchPoint();
+    }
+} // skipSearchPoints()
 
-    for( int i = 0; i < int( mSearchPoints.size() ) - 1; ++i )
+// Moves point to the center of the nearest free costmap cell within
+// search.obstacleShift meters if it is in a blocked cell. Returns false
+// if it is blocked and there is no such cell, true otherwise.
+bool SearchStateMachine::moveOutOfObstacles( LocalPoint& point ) const
+{
+    const LocalCostmap& costmap = *roverStateMachine->mCostmap;
+    CostmapCell cell;
+    if( !costmap.toCell( point, cell ) || !costmap.isBlocked( cell.col, cell.row ) )
+    {
+        return true;
+    }
+    const int reach = int( mRover->config().search.obstacleShift / costmap.cellSize() );
+    int bestDistance = reach * reach + 1;
+    CostmapCell best = cell;
+    for( int dRow = -reach; dRow <= reach; ++dRow )
     {
-        Odometry point1 = mSearchPoints.at( i );
-        Odometry point2 = mSearchPoints.at( i + 1 );
-        double distance = estimateNoneuclid( point1, point2 );
-        if ( distance > maxDifference )
+        for( int dCol = -reach; dCol <= reach; ++dCol )
         {
-            int numPoints = int( ceil( distance / maxDifference ) - 1 );
-            double newDifference = distance / ( numPoints + 1 );
-            double bearing = calcBearing( point1, point2 );
-            for ( int j = 0; j < numPoints; ++j )
+            const int col = cell.col + dCol;
+            const int row = cell.row + dRow;
+            const int cellDistance = dCol * dCol + dRow * dRow;
+            if( cellDistance < bestDistance && col >= 0 && row >= 0 &&
+                col < costmap.cells() && row < costmap.cells() && !costmap.isBlocked( col, row ) )
             {
-                Odometry startPoint = mSearchPoints.at( i );
-                Odometry newOdom = createOdom( startPoint, bearing, newDifference, mRover );
-                auto insertPosition = mSearchPoints.begin() + i + 1;
-                mSearchPoints.insert( insertPosition, newOdom );
-                ++i;
+                bestDistance = cellDistance;
+                best = { col, row };
             }
         }
     }
-} // insertIntermediatePoints()
+    if( bestDistance > reach * reach )
+    {
+        return false;
+    }
+    point = costmap.cellCenter( best.col, best.row );
+    return true;
+} // moveOutOfObstacles()
 
-// The search factory allows for the creation of search objects and
-// an ease of transition between search algorithms
-SearchStateMachine* SearchFactory( StateMachine* stateMachine, SearchType type, Rover* rover, const rapidjson::Document& roverConfig )  //TODO
+// Moves on to the next search point.
+void SearchStateMachine::advanceSearchPoint()
 {
-    SearchStateMachine* search = nullptr;
-    switch (type)
+    mHasSearchPoint = mNextPoint < mPlan.points.size();
+    if( mHasSearchPoint )
     {
-        case SearchType::SPIRALOUT:
-            search = new SpiralOut( stateMachine, rover, roverConfig );
-            break;
-
-        case SearchType::LAWNMOWER:
-            search = new LawnMower( stateMachine, rover, roverConfig );
-            break;
-
-        case SearchType::SPIRALIN:
-            search = new SpiralIn( stateMachine, rover, roverConfig );
-            break;
-
-        default:
-            std::cerr << "Unkown Search Type. Defaulting to Spiral\n";
-            search = new SpiralOut( stateMachine, rover, roverConfig );
-            break;
+        mSearchPoint = mPlan.points[ mNextPoint ];
+        ++mNextPoint;
     }
-    return search;
-} // SearchFactory
+} // advanceSearchPoint()
 
 /******************/
 /* TODOS */
@@ -1,20 +1,14 @@
 #ifndef SEARCH_STATE_MACHINE_HPP
 #define SEARCH_STATE_MACHINE_HPP
 
+#include <chrono>
 #include "rover.hpp"
 #include "utilities.hpp"
+#include "targetMemory.hpp"
+#include "searchPlan.hpp"
 
 class StateMachine;
 
-// This class is the representation of different
-// search algorithms
-enum class SearchType
-{
-    SPIRALOUT,
-    LAWNMOWER,
-    SPIRALIN
-};
-
 class SearchStateMachine {
 public:
     /*************************************************************************/
@@ -28,6 +22,12 @@ public:
 
     bool targetReachable( Rover* rover, double distance, double bearing );
 
+    bool hasSearchPoint() const;
+
+    double spinRate() const;
+
+    void reset();
+
     virtual void initializeSearch( Rover* rover, const rapidjson::Document& roverConfig, double pathWidth ) = 0; // TODO
 
 protected:
@@ -35,7 +35,7 @@ protected:
     /* Protected Member Functions */
     /*************************************************************************/
 
-    void insertIntermediatePoints();
+    void startSearch( const SearchType type, const LocalPoint& center, const double distance );
 
     /*************************************************************************/
     /* Protected Member Variables */
@@ -44,12 +44,6 @@ protected:
     // Pointer to rover State Machine to access member functions
     StateMachine* roverStateMachine;
 
-    // Vector of search point multipliers used as a base for the search points.
-    vector< pair<short, short> > mSearchPointMultipliers;
-
-    // Queue of search points.
-    deque<Odometry> mSearchPoints;
-
     // Pointer to rover object
     Rover* mRover;
 
@@ -59,12 +53,16 @@ private:
     /*************************************************************************/
     NavState executeSearchSpin();
 
+    NavState executeContinuousSpin();
+
     NavState executeRoverWait();
 
     NavState executeSearchTurn();
 
     NavState executeSearchDrive();
 
+    NavState executeFollowSearchLeg();
+
     NavState executeTurnToTarget();
 
     NavState executeDriveToTarget();
@@ -75,10 +73,56 @@ private:
 
     void updateTargetDetectionElements( double target_bearing, double rover_bearing );
 
+    bool findTarget( Target& target ) const;
+
+    void popSearchPoint();
+
+    void advanceSearchPoint();
+
+    void skipSearchPoints();
+
+    bool moveOutOfObstacles( LocalPoint& point ) const;
+
     /*************************************************************************/
     /* Private Member Variables */
     /*************************************************************************/
 
+    // Whether mSearchPoint is a point the rover still has to visit.
+    bool mHasSearchPoint;
+
+    // The search point the rover is currently turning or driving to.
+    LocalPoint mSearchPoint;
+
+    // Every point of the search, planned when it starts, and the index
+    // of the one after mSearchPoint.
+    SearchPlan mPlan;
+    size_t mNextPoint;
+
+    // Next bearing to stop at during the spin, 0 to force the rover to
+    // wait initially, and the bearing the spin started at.
+    double mNextStop;
+    double mOriginalSpinAngle;
+
+    // Whether the rover is spinning continuously, and the bearing the
+    // spin started at. The spin turns toward the start plus mSpinSetpoint
+    // degrees, which grows at the spin rate, and is done once the rover
+    // has turned mSpunAngle degrees, measured from the odometry at
+    // mLastSpinBearing and mLastSpinTime.
+    bool mSpinning;
+    double mSpinStartBearing;
+    double mSpinSetpoint;
+    double mSpunAngle;
+    double mLastSpinBearing;
+    std::chrono::steady_clock::time_point mLastSpinTime;
+
+    // Whether the rover is waiting during the spin, and since when.
+    bool mWaitStarted;
+    std::chrono::steady_clock::time_point mWaitStartTime;
+
+    // Where the target was last seen, so the rover keeps going to it
+    // through short gaps in detection.
+    TargetMemory mTargetMemory;
+
     // Last known angle to turn to target.
     double mTargetAngle;
 
@@ -90,9 +134,4 @@ private:
 
 };
 
-// Creates an ObstacleAvoidanceStateMachine object based on the inputted obstacle
-// avoidance algorithm. This allows for an an ease of transition between obstacle
-// avoidance algorithms
-SearchStateMachine* SearchFactory( StateMachine* stateMachine, SearchType type, Rover* rover, const rapidjson::Document& roverConfig );
-
 #endif //SEARCH_STATE_MACHINE_HPP
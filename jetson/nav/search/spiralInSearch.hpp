@@ -14,8 +14,7 @@ public:
 
     ~SpiralIn();
 
-    // Initializes the search ponit multipliers to be the intermost loop
-    // of the search.
+    // Starts the search from its planned points.
     void initializeSearch( Rover* rover, const rapidjson::Document& roverConfig, const double pathWidth );
 };
 
@@ -7,37 +7,9 @@
 
 SpiralOut::~SpiralOut() {}
 
-// Initializes the search ponit multipliers to be the intermost loop
-// of the search.
+// Starts the spiral around the search waypoint.
 void SpiralOut::initializeSearch( Rover* rover, const rapidjson::Document& roverConfig, const double visionDistance )
 {
-    mSearchPoints.clear();
-
-    mSearchPointMultipliers.clear();
-    mSearchPointMultipliers.push_back( pair<short, short> (  0,  1 ) );
-    mSearchPointMultipliers.push_back( pair<short, short> ( -1,  1 ) );
-    mSearchPointMultipliers.push_back( pair<short, short> ( -1, -1 ) );
-    mSearchPointMultipliers.push_back( pair<short, short> (  1, -1 ) );
-
-    while( mSearchPointMultipliers[ 0 ].second * visionDistance < roverConfig[ "search" ][ "bailThresh" ].GetDouble() ) {
-        for( auto& mSearchPointMultiplier : mSearchPointMultipliers )
-        {
-            Odometry nextSearchPoint = rover->roverStatus().path().front().odom;
-            double totalLatitudeMinutes = nextSearchPoint.latitude_min +
-                ( mSearchPointMultiplier.first * visionDistance  * LAT_METER_IN_MINUTES );
-            double totalLongitudeMinutes = nextSearchPoint.longitude_min +
-                ( mSearchPointMultiplier.second * visionDistance * rover->longMeterInMinutes() );
-            nextSearchPoint.latitude_deg += totalLatitudeMinutes / 60;
-            nextSearchPoint.latitude_min = ( totalLatitudeMinutes - ( ( (int) totalLatitudeMinutes ) / 60 ) * 60 );
-            nextSearchPoint.longitude_deg += totalLongitudeMinutes / 60;
-            nextSearchPoint.longitude_min = ( totalLongitudeMinutes - ( ( (int) totalLongitudeMinutes) / 60 ) * 60 );
-
-            mSearchPoints.push_back( nextSearchPoint );
-
-            mSearchPointMultiplier.first < 0 ? --mSearchPointMultiplier.first : ++mSearchPointMultiplier.first;
-            mSearchPointMultiplier.second < 0 ? --mSearchPointMultiplier.second : ++mSearchPointMultiplier.second;
-
-        }
-    }
-    insertIntermediatePoints();
-} // initializeSearch()
\ No newline at end of file
+    startSearch( SearchType::SPIRALOUT, rover->localFrame().toLocal( rover->roverStatus().path().front().odom ),
+                 visionDistance );
+} // initializeSearch()
@@ -11,8 +11,7 @@ public:
 
     ~SpiralOut();
 
-    // Initializes the search ponit multipliers to be the intermost loop
-    // of the search.
+    // Starts the search from its planned points.
     void initializeSearch( Rover* rover, const rapidjson::Document& roverConfig, const double pathWidth );
 };
 
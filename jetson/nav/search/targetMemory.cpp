@@ -0,0 +1,46 @@
+#include "targetMemory.hpp"
+#include "utilities.hpp"
+
+// Constructs a target memory that hasn't seen a target.
+TargetMemory::TargetMemory()
+    : mRemembered( false )
+    , mPosition{ 0, 0 }
+    , mId( -1 )
+{
+} // TargetMemory()
+
+// Remembers target, seen from position with the rover facing the
+// absolute heading.
+void TargetMemory::see( const LocalPoint& position, const double heading, const Target& target,
+                        const std::chrono::steady_clock::time_point now )
+{
+    mPosition = offset( position, heading + target.bearing, target.distance );
+    mId = target.id;
+    mSeenTime = now;
+    mRemembered = true;
+} // see()
+
+// Fills target with where the remembered target is from position with
+// the rover facing the absolute heading. Returns false if no target
+// was seen in the last memoryTime seconds.
+bool TargetMemory::recall( const LocalPoint& position, const double heading,
+                           const std::chrono::steady_clock::time_point now, const double memoryTime,
+                           Target& target ) const
+{
+    if( !mRemembered || std::chrono::duration<double>( now - mSeenTime ).count() > memoryTime )
+    {
+        return false;
+    }
+    double targetBearing = bearing( position, mPosition );
+    throughZero( targetBearing, heading );
+    target.distance = distance( position, mPosition );
+    target.bearing = targetBearing - heading;
+    target.id = mId;
+    return true;
+} // recall()
+
+// Forgets the target, so it can't be recalled until it is seen again.
+void TargetMemory::forget()
+{
+    mRemembered = false;
+} // forget()
@@ -0,0 +1,38 @@
+#ifndef TARGET_MEMORY_HPP
+#define TARGET_MEMORY_HPP
+
+#include <chrono>
+#include "localFrame.hpp"
+#include "rover_msgs/Target.hpp"
+
+using namespace rover_msgs;
+
+// This class remembers where the target was last seen. The position is
+// kept in the rover's local frame, which is fixed to the ground, so
+// odometry accounts for how the rover moved since and the target can
+// still be driven to while perception briefly loses it.
+class TargetMemory
+{
+public:
+    TargetMemory();
+
+    void see( const LocalPoint& position, const double heading, const Target& target,
+              const std::chrono::steady_clock::time_point now );
+
+    bool recall( const LocalPoint& position, const double heading,
+                 const std::chrono::steady_clock::time_point now, const double memoryTime,
+                 Target& target ) const;
+
+    void forget();
+
+private:
+    // Whether a target has been seen since the memory was last cleared.
+    bool mRemembered;
+
+    // Where the target was seen, its id, and when.
+    LocalPoint mPosition;
+    int32_t mId;
+    std::chrono::steady_clock::time_point mSeenTime;
+};
+
+#endif // TARGET_MEMORY_HPP
@@ -0,0 +1,314 @@
+#include "simulatedCourse.hpp"
+#include "simulatedRover.hpp"
+#include "navConfig.hpp"
+#include "rover.hpp"
+#include "stateMachine.hpp"
+#include "utilities.hpp"
+#include "search/searchPlan.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <lcm/lcm-cpp.hpp>
+#include <random>
+#include <vector>
+
+using namespace rover_msgs;
+using namespace std;
+
+namespace
+{
+    // Points the geometry benchmarks cycle through, so the inputs
+    // change from one call to the next like they do while driving.
+    const size_t NUM_POINTS = 1024;
+
+    // Times each microbenchmark is run, the fastest run is reported so
+    // a scheduling hiccup doesn't count.
+    const int REPEATS = 5;
+
+    // Results of the benchmarked calls are added to this, so the
+    // compiler can't drop the calls.
+    volatile double gSink = 0;
+} // namespace
+
+// Sends the joystick commands the state machine publishes to the
+// simulated rover.
+class JoystickHandler
+{
+public:
+    explicit JoystickHandler( SimulatedRover& rover )
+        : mRover( rover )
+    {
+    }
+
+    void joystick(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const Joystick* joystick
+        )
+    {
+        mRover.command( *joystick );
+    }
+
+private:
+    SimulatedRover& mRover;
+};
+
+// Reads the nav config the same way the state machine does.
+bool readConfig( ConfigFile& config )
+{
+    const char* configDirectory = getenv( "MROVER_CONFIG" );
+    return configDirectory && loadNavConfig( string( configDirectory ) + "/config_nav/config.json", config );
+} // readConfig()
+
+// Returns the nanoseconds a call to call( i ) takes, for i counting up
+// from 0, over iterations calls. call returns a value for the sink.
+template <typename Function>
+double nsPerCall( const int iterations, Function call )
+{
+    double best = -1;
+    for( int repeat = 0; repeat < REPEATS; ++repeat )
+    {
+        double sum = 0;
+        const auto start = chrono::steady_clock::now();
+        for( int i = 0; i < iterations; ++i )
+        {
+            sum += call( i );
+        }
+        const double ns = chrono::duration<double, nano>( chrono::steady_clock::now() - start ).count();
+        gSink = gSink + sum;
+        best = best < 0 ? ns : min( best, ns );
+    }
+    return best / iterations;
+} // nsPerCall()
+
+void printRow( const string& name, const double ns )
+{
+    cout << "  " << left << setw( 28 ) << name << right << setw( 12 ) << ns << " ns\n";
+} // printRow()
+
+// Prints the percentiles of the tick times in microseconds.
+void printTicks( vector<double>& ticksUs )
+{
+    sort( ticksUs.begin(), ticksUs.end() );
+    auto percentile = [&ticksUs]( const double p )
+    {
+        return ticksUs[ min( ticksUs.size() - 1, size_t( p * ticksUs.size() ) ) ];
+    };
+    double sum = 0;
+    for( const double tick : ticksUs )
+    {
+        sum += tick;
+    }
+    cout << "  " << ticksUs.size() << " ticks, mean " << sum / ticksUs.size()
+         << " us, p50 " << percentile( 0.50 ) << " p90 " << percentile( 0.90 )
+         << " p99 " << percentile( 0.99 ) << " max " << ticksUs.back() << " us\n";
+} // printTicks()
+
+// Times ticks runs of the state machine driving random courses with the
+// simulated rover, each tick being the odometry and perception updates
+// and one run. The rover's motion and the LCM handling in between
+// aren't timed.
+vector<double> timeTicks( const rapidjson::Document& config, mt19937& random, const int ticks )
+{
+    vector<double> ticksUs;
+    ticksUs.reserve( ticks );
+    const RandomCourseSettings settings = { 3, 10, 15, 40, 5 };
+    for( int number = 0; int( ticksUs.size() ) < ticks; ++number )
+    {
+        const SimulatedCourse course = randomCourse( random, settings, number );
+        lcm::LCM lcmObject( "memq://" );
+        StateMachine stateMachine( lcmObject );
+        SimulatedRover rover( config, course, 1.5 );
+        JoystickHandler handler( rover );
+        lcmObject.subscribe( config[ "lcmChannels" ][ "joystickChannel" ].GetString(),
+                             &JoystickHandler::joystick, &handler );
+
+        LocalFrame frame;
+        frame.anchor( course.origin );
+        AutonState autonState;
+        autonState.is_auton = true;
+        stateMachine.updateRoverStatus( rover.odometry() );
+        stateMachine.updateRoverStatus( toCourseMessage( course, frame ) );
+        stateMachine.updateRoverStatus( autonState );
+
+        const chrono::microseconds controlPeriod = stateMachine.controlPeriod();
+        const double dt = chrono::duration<double>( controlPeriod ).count();
+        chrono::steady_clock::time_point now;
+        // A course the rover gets stuck on still only gives its share
+        for( int tick = 0; tick < ticks / 4 && int( ticksUs.size() ) < ticks && !rover.collided(); ++tick )
+        {
+            const Odometry odometry = rover.odometry();
+            const PerceptionFrame perceptionFrame = rover.perceptionFrame();
+            const auto start = chrono::steady_clock::now();
+            stateMachine.updateRoverStatus( odometry );
+            stateMachine.updateRoverStatus( perceptionFrame );
+            stateMachine.run( now );
+            ticksUs.push_back( chrono::duration<double, micro>( chrono::steady_clock::now() - start ).count() );
+
+            while( lcmObject.handleTimeout( 0 ) > 0 ) {}
+            rover.step( dt );
+            now += controlPeriod;
+        }
+    }
+    return ticksUs;
+} // timeTicks()
+
+// Prints how to run the benchmark.
+void printUsage( const char* program )
+{
+    cout << "Usage: " << program << " [options]\n"
+         << "Times the nav geometry, search planning, rover status copies\n"
+         << "and state machine ticks on synthetic inputs.\n"
+         << "  --iterations N   calls of each microbenchmark (default 1000000)\n"
+         << "  --ticks N        state machine ticks timed (default 20000)\n"
+         << "  --seed S         seed for the inputs and courses (default 1)\n";
+} // printUsage()
+
+// Runs the nav microbenchmarks and prints the time each call takes.
+int main( int argc, char** argv )
+{
+    int iterations = 1000000;
+    int ticks = 20000;
+    unsigned seed = 1;
+    for( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[ i ];
+        const bool hasValue = i + 1 < argc;
+        if( arg == "--iterations" && hasValue )
+        {
+            iterations = max( 1, atoi( argv[ ++i ] ) );
+        }
+        else if( arg == "--ticks" && hasValue )
+        {
+            ticks = max( 1, atoi( argv[ ++i ] ) );
+        }
+        else if( arg == "--seed" && hasValue )
+        {
+            seed = strtoul( argv[ ++i ], nullptr, 10 );
+        }
+        else
+        {
+            printUsage( argv[ 0 ] );
+            return 1;
+        }
+    }
+
+    ConfigFile document;
+    NavConfig config;
+    if( !readConfig( document ) || !readNavConfig( document, config ) )
+    {
+        cerr << "Error: cannot read $MROVER_CONFIG/config_nav/config.json\n";
+        return 1;
+    }
+
+    // The state machine and the rover log to cerr, which would be most
+    // of the time measured.
+    streambuf* cerrBuffer = cerr.rdbuf();
+    cerr.rdbuf( nullptr );
+
+    // Pairs of points up to 500 m apart around a course's origin, where the
+    // rover drives.
+    mt19937 random( seed );
+    uniform_real_distribution<double> meters( -500, 500 );
+    uniform_real_distribution<double> degrees( 0, 360 );
+    const SimulatedCourse origin = randomCourse( random, { 3, 0, 15, 40, 5 }, 0 );
+    LocalFrame frame;
+    frame.anchor( origin.origin );
+    vector<Odometry> starts( NUM_POINTS );
+    vector<Odometry> dests( NUM_POINTS );
+    vector<double> bearings( NUM_POINTS );
+    for( size_t i = 0; i < NUM_POINTS; ++i )
+    {
+        starts[ i ] = frame.toOdometry( { meters( random ), meters( random ) }, origin.origin );
+        dests[ i ] = frame.toOdometry( { meters( random ), meters( random ) }, origin.origin );
+        bearings[ i ] = degrees( random );
+    }
+
+    // A rover that has taken a course, anchoring its local frame, and the
+    // status it was given, to copy.
+    lcm::LCM lcmObject( "memq://" );
+    Rover rover( config, lcmObject );
+    Rover::RoverStatus status;
+    status.autonState().is_auton = true;
+    status.course() = toCourseMessage( origin, frame );
+    status.odometry() = starts[ 0 ];
+    status.tags().resize( 4 );
+    status.resetPath();
+    rover.updateRover( status, AllFields );
+
+    cout << fixed << setprecision( 1 );
+    cout << "Geometry (" << iterations << " calls):\n";
+    printRow( "estimateNoneuclid", nsPerCall( iterations, [&]( const int i )
+    {
+        return estimateNoneuclid( starts[ i % NUM_POINTS ], dests[ i % NUM_POINTS ] );
+    } ) );
+    printRow( "calcBearing", nsPerCall( iterations, [&]( const int i )
+    {
+        return calcBearing( starts[ i % NUM_POINTS ], dests[ i % NUM_POINTS ] );
+    } ) );
+    printRow( "createOdom", nsPerCall( iterations, [&]( const int i )
+    {
+        return createOdom( starts[ i % NUM_POINTS ], bearings[ i % NUM_POINTS ], 10, &rover ).latitude_min;
+    } ) );
+    printRow( "LocalFrame::distance", nsPerCall( iterations, [&]( const int i )
+    {
+        return frame.distance( starts[ i % NUM_POINTS ], dests[ i % NUM_POINTS ] );
+    } ) );
+    printRow( "LocalFrame::bearing", nsPerCall( iterations, [&]( const int i )
+    {
+        return frame.bearing( starts[ i % NUM_POINTS ], dests[ i % NUM_POINTS ] );
+    } ) );
+
+    // Planned like SearchStateMachine::startSearch() does, into one plan
+    // so its points keep their memory like the search's plan does.
+    const int planIterations = max( 1, iterations / 1000 );
+    cout << "Search planning (" << planIterations << " plans):\n";
+    const pair<SearchType, const char*> searchTypes[] = {
+        { SearchType::SPIRALOUT, "planSearch spiral out" },
+        { SearchType::LAWNMOWER, "planSearch lawn mower" },
+        { SearchType::SPIRALIN, "planSearch spiral in" }
+    };
+    SearchPlan plan;
+    for( const pair<SearchType, const char*>& searchType : searchTypes )
+    {
+        plan.type = searchType.first;
+        plan.center = { 0, 0 };
+        plan.distance = config.computerVision.visionDistance;
+        plan.bailThresh = config.search.bailThresh;
+        plan.maxGap = 2 * config.computerVision.visionDistance;
+        printRow( searchType.second, nsPerCall( planIterations, [&]( const int i )
+        {
+            plan.center.east = i % 2;
+            planSearch( plan );
+            return double( plan.points.size() );
+        } ) );
+    }
+    cout << "  " << plan.points.size() << " points in the spiral in\n";
+
+    const int copyIterations = max( 1, iterations / 10 );
+    cout << "Rover status (" << copyIterations << " copies, " << status.course().num_waypoints
+         << " waypoints, " << status.tags().size() << " tags):\n";
+    printRow( "RoverStatus copy", nsPerCall( copyIterations, [&]( const int i )
+    {
+        Rover::RoverStatus copy( status );
+        return double( copy.path().size() );
+    } ) );
+    // Into the same status every time, like the state machine's inputs
+    Rover::RoverStatus assigned;
+    printRow( "RoverStatus assignment", nsPerCall( copyIterations, [&]( const int i )
+    {
+        assigned = rover.roverStatus();
+        return double( assigned.path().size() );
+    } ) );
+
+    cout << "State machine ticks:\n";
+    vector<double> ticksUs = timeTicks( document, random, ticks );
+    printTicks( ticksUs );
+
+    cerr.clear();
+    cerr.rdbuf( cerrBuffer );
+    return 0;
+} // main()
@@ -0,0 +1,287 @@
+#include "simulatedCourse.hpp"
+#include "simulatedRover.hpp"
+#include "navConfig.hpp"
+#include "stateMachine.hpp"
+#include "rover_msgs/NavStatus.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <lcm/lcm-cpp.hpp>
+
+using namespace rover_msgs;
+using namespace std;
+
+// The outcome of driving one course.
+struct CourseResult
+{
+    bool completed;
+    bool collided;
+    double time;
+    double distance;
+    int completedWaypoints;
+    int totalWaypoints;
+};
+
+// Receives the messages the state machine publishes.
+class SimulationHandlers
+{
+public:
+    SimulationHandlers( SimulatedRover& rover )
+        : mRover( rover )
+    {
+        mNavStatus.completed_wps = 0;
+        mNavStatus.total_wps = 0;
+    }
+
+    // Sends the joystick command to the simulated rover.
+    void joystick(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const Joystick* joystick
+        )
+    {
+        mRover.command( *joystick );
+    }
+
+    // Keeps the latest nav status.
+    void navStatus(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const string& channel,
+        const NavStatus* navStatus
+        )
+    {
+        mNavStatus = *navStatus;
+    }
+
+    const NavStatus& lastNavStatus() const
+    {
+        return mNavStatus;
+    }
+
+private:
+    // The rover to send joystick commands to.
+    SimulatedRover& mRover;
+
+    // The last nav status the state machine published.
+    NavStatus mNavStatus;
+};
+
+// Reads the nav config the same way the state machine does.
+bool readConfig( ConfigFile& config )
+{
+    const char* configDirectory = getenv( "MROVER_CONFIG" );
+    return configDirectory && loadNavConfig( string( configDirectory ) + "/config_nav/config.json", config );
+} // readConfig()
+
+// Drives the course with a fresh state machine, stepping the simulated
+// rover and the state machine's clock by the control period every
+// iteration instead of waiting for it.
+CourseResult runCourse( const SimulatedCourse& course, const rapidjson::Document& config,
+                        const double maxSpeed, const double timeLimit, const bool verbose )
+{
+    lcm::LCM lcmObject( "memq://" );
+    StateMachine stateMachine( lcmObject );
+    SimulatedRover rover( config, course, maxSpeed );
+    SimulationHandlers handlers( rover );
+    lcmObject.subscribe( config[ "lcmChannels" ][ "joystickChannel" ].GetString(),
+                         &SimulationHandlers::joystick, &handlers );
+    lcmObject.subscribe( config[ "lcmChannels" ][ "navStatusChannel" ].GetString(),
+                         &SimulationHandlers::navStatus, &handlers );
+
+    LocalFrame frame;
+    frame.anchor( course.origin );
+    AutonState autonState;
+    autonState.is_auton = true;
+    stateMachine.updateRoverStatus( rover.odometry() );
+    stateMachine.updateRoverStatus( toCourseMessage( course, frame ) );
+    stateMachine.updateRoverStatus( autonState );
+
+    const chrono::microseconds controlPeriod = stateMachine.controlPeriod();
+    const double dt = chrono::duration<double>( controlPeriod ).count();
+    chrono::steady_clock::time_point now;
+    CourseResult result = { false, false, 0, 0, 0, int( course.waypoints.size() ) };
+    string lastState = "";
+    while( result.time < timeLimit )
+    {
+        stateMachine.updateRoverStatus( rover.odometry() );
+        stateMachine.updateRoverStatus( rover.perceptionFrame() );
+        stateMachine.run( now );
+        while( lcmObject.handleTimeout( 0 ) > 0 ) {}
+
+        result.completedWaypoints = handlers.lastNavStatus().completed_wps;
+        if( verbose && handlers.lastNavStatus().nav_state_name != lastState )
+        {
+            lastState = handlers.lastNavStatus().nav_state_name;
+            const LocalPoint position = frame.toLocal( rover.odometry() );
+            cout << "  " << result.time << " s: " << lastState << " at ("
+                 << position.east << ", " << position.north << ")\n";
+        }
+        if( handlers.lastNavStatus().nav_state_name == "Done" )
+        {
+            result.completed = true;
+            break;
+        }
+        rover.step( dt );
+        if( rover.collided() )
+        {
+            result.collided = true;
+            break;
+        }
+        now += controlPeriod;
+        result.time += dt;
+    }
+    result.distance = rover.distanceDriven();
+    return result;
+} // runCourse()
+
+// Prints how to run the simulation.
+void printUsage( const char* program )
+{
+    cout << "Usage: " << program << " [options] [course.json ...]\n"
+         << "Drives the nav state machine through courses without LCM or\n"
+         << "real time. Without course files, random courses are driven.\n"
+         << "  --random N       number of random courses (default 100)\n"
+         << "  --seed S         seed for the random courses (default 1)\n"
+         << "  --legs N         legs of each random course (default 3)\n"
+         << "  --obstacles N    obstacles on each random course (default 10)\n"
+         << "  --speed M        rover speed at full power in m/s (default 1.5)\n"
+         << "  --time-limit S   simulated seconds before giving up (default 1800)\n"
+         << "  --verbose        keep the state machine's output and print every state change\n";
+} // printUsage()
+
+// Runs the nav state machine against simulated courses faster than
+// real time and prints how it did.
+int main( int argc, char** argv )
+{
+    int randomCourses = 100;
+    unsigned seed = 1;
+    double maxSpeed = 1.5;
+    double timeLimit = 1800;
+    bool verbose = false;
+    RandomCourseSettings settings = { 3, 10, 15, 40, 5 };
+    vector<string> coursePaths;
+    for( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[ i ];
+        const bool hasValue = i + 1 < argc;
+        if( arg == "--random" && hasValue )
+        {
+            randomCourses = atoi( argv[ ++i ] );
+        }
+        else if( arg == "--seed" && hasValue )
+        {
+            seed = strtoul( argv[ ++i ], nullptr, 10 );
+        }
+        else if( arg == "--legs" && hasValue )
+        {
+            settings.legs = atoi( argv[ ++i ] );
+        }
+        else if( arg == "--obstacles" && hasValue )
+        {
+            settings.obstacles = atoi( argv[ ++i ] );
+        }
+        else if( arg == "--speed" && hasValue )
+        {
+            maxSpeed = atof( argv[ ++i ] );
+        }
+        else if( arg == "--time-limit" && hasValue )
+        {
+            timeLimit = atof( argv[ ++i ] );
+        }
+        else if( arg == "--verbose" )
+        {
+            verbose = true;
+        }
+        else if( arg.size() > 1 && arg[ 0 ] == '-' )
+        {
+            printUsage( argv[ 0 ] );
+            return 1;
+        }
+        else
+        {
+            coursePaths.push_back( arg );
+        }
+    }
+
+    ConfigFile config;
+    if( !readConfig( config ) )
+    {
+        cerr << "Error: cannot read $MROVER_CONFIG/config_nav/config.json\n";
+        return 1;
+    }
+
+    vector<SimulatedCourse> courses;
+    for( const string& path : coursePaths )
+    {
+        SimulatedCourse course;
+        if( !loadCourse( path, course ) )
+        {
+            cerr << "Error: cannot read course " << path << "\n";
+            return 1;
+        }
+        courses.push_back( course );
+    }
+    if( coursePaths.empty() )
+    {
+        mt19937 random( seed );
+        for( int i = 0; i < randomCourses; ++i )
+        {
+            courses.push_back( randomCourse( random, settings, i ) );
+        }
+    }
+
+    // The state machine logs to cerr every iteration, which would be
+    // most of the run time.
+    streambuf* cerrBuffer = cerr.rdbuf();
+    if( !verbose )
+    {
+        cerr.rdbuf( nullptr );
+    }
+
+    const auto wallStart = chrono::steady_clock::now();
+    int completed = 0;
+    int collisions = 0;
+    double completedTime = 0;
+    double simulatedTime = 0;
+    cout << fixed << setprecision( 1 );
+    for( const SimulatedCourse& course : courses )
+    {
+        if( verbose )
+        {
+            cout << course.name << ":\n";
+        }
+        const CourseResult result = runCourse( course, config, maxSpeed, timeLimit, verbose );
+        simulatedTime += result.time;
+        if( result.completed )
+        {
+            ++completed;
+            completedTime += result.time;
+        }
+        if( result.collided )
+        {
+            ++collisions;
+        }
+        if( verbose || !result.completed )
+        {
+            cout << course.name << ": "
+                 << ( result.completed ? "completed" : result.collided ? "collided" : "timed out" )
+                 << " in " << result.time << " s, " << result.distance << " m, "
+                 << result.completedWaypoints << "/" << result.totalWaypoints << " waypoints\n";
+        }
+    }
+    cerr.clear();
+    cerr.rdbuf( cerrBuffer );
+    const double wallTime = chrono::duration<double>( chrono::steady_clock::now() - wallStart ).count();
+
+    cout << completed << "/" << courses.size() << " courses completed, "
+         << collisions << " collisions\n";
+    if( completed > 0 )
+    {
+        cout << "Mean time to complete: " << completedTime / completed << " s\n";
+    }
+    cout << "Simulated " << simulatedTime << " s in " << wallTime << " s ("
+         << ( wallTime > 0 ? simulatedTime / wallTime : 0 ) << "x real time)\n";
+    return completed == int( courses.size() ) ? 0 : 2;
+} // main()
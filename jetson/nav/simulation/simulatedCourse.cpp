@@ -0,0 +1,178 @@
+#include "simulatedCourse.hpp"
+#include "utilities.hpp"
+#include "rapidjson/document.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    // Reads a local point from the east and north members of value.
+    LocalPoint readPoint( const rapidjson::Value& value )
+    {
+        return { value[ "east" ].GetDouble(), value[ "north" ].GetDouble() };
+    }
+
+    // Returns true if point is at least clearance meters from
+    // everything that an obstacle must not be placed on.
+    bool isClear( const SimulatedCourse& course, const LocalPoint& point, const double clearance )
+    {
+        if( distance( point, course.start ) < clearance )
+        {
+            return false;
+        }
+        for( const SimulatedWaypoint& waypoint : course.waypoints )
+        {
+            if( distance( point, waypoint.position ) < clearance )
+            {
+                return false;
+            }
+        }
+        for( const SimulatedPost& post : course.posts )
+        {
+            if( distance( point, post.position ) < clearance )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+// Loads a course from a json file. Returns false if the file can't be
+// read or parsed.
+bool loadCourse( const std::string& path, SimulatedCourse& course )
+{
+    std::ifstream file( path );
+    if( !file )
+    {
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    rapidjson::Document json;
+    json.Parse( contents.str().c_str() );
+    if( json.HasParseError() || !json.IsObject() )
+    {
+        return false;
+    }
+
+    course = SimulatedCourse();
+    course.name = path;
+    const rapidjson::Value& origin = json[ "origin" ];
+    course.origin.latitude_deg = origin[ "latitude_deg" ].GetInt();
+    course.origin.latitude_min = origin[ "latitude_min" ].GetDouble();
+    course.origin.longitude_deg = origin[ "longitude_deg" ].GetInt();
+    course.origin.longitude_min = origin[ "longitude_min" ].GetDouble();
+    course.origin.bearing_deg = 0;
+    course.origin.speed = 0;
+    course.start = readPoint( json[ "start" ] );
+    course.startBearing = json[ "start" ][ "bearing" ].GetDouble();
+    for( const rapidjson::Value& waypoint : json[ "waypoints" ].GetArray() )
+    {
+        course.waypoints.push_back( { readPoint( waypoint ),
+                                      waypoint[ "search" ].GetBool(),
+                                      waypoint[ "gate" ].GetBool(),
+                                      waypoint[ "gate_width" ].GetDouble(),
+                                      waypoint[ "id" ].GetInt() } );
+    }
+    for( const rapidjson::Value& post : json[ "posts" ].GetArray() )
+    {
+        course.posts.push_back( { readPoint( post ), post[ "id" ].GetInt() } );
+    }
+    for( const rapidjson::Value& obstacle : json[ "obstacles" ].GetArray() )
+    {
+        course.obstacles.push_back( { readPoint( obstacle ), obstacle[ "radius" ].GetDouble() } );
+    }
+    return true;
+} // loadCourse()
+
+// Generates a random course. Every leg ends at a waypoint in a random
+// direction from the last one. Legs are plain waypoints, search legs
+// with a post near the waypoint, or gate legs with two posts near it.
+// Obstacles are scattered over the course away from the waypoints,
+// posts, and the start.
+SimulatedCourse randomCourse( std::mt19937& random, const RandomCourseSettings& settings, const int number )
+{
+    std::uniform_real_distribution<double> unit( 0, 1 );
+    auto uniform = [&]( const double low, const double high ) { return low + ( high - low ) * unit( random ); };
+
+    SimulatedCourse course;
+    course.name = "random " + std::to_string( number );
+    course.origin.latitude_deg = 42;
+    course.origin.latitude_min = 17.0;
+    course.origin.longitude_deg = -83;
+    course.origin.longitude_min = -42.0;
+    course.origin.bearing_deg = 0;
+    course.origin.speed = 0;
+    course.start = { 0, 0 };
+    course.startBearing = uniform( 0, 360 );
+
+    LocalPoint last = course.start;
+    int nextId = 0;
+    for( int leg = 0; leg < settings.legs; ++leg )
+    {
+        SimulatedWaypoint waypoint;
+        waypoint.position = offset( last, uniform( 0, 360 ), uniform( settings.minLegLength, settings.maxLegLength ) );
+        const double kind = unit( random );
+        waypoint.search = kind >= 0.25;
+        waypoint.gate = kind >= 0.75;
+        waypoint.gateWidth = waypoint.gate ? uniform( 2, 3 ) : 0;
+        waypoint.id = waypoint.search ? nextId : -1;
+        if( waypoint.search )
+        {
+            const LocalPoint post = offset( waypoint.position, uniform( 0, 360 ), uniform( 0, settings.postSpread ) );
+            course.posts.push_back( { post, nextId++ } );
+            if( waypoint.gate )
+            {
+                course.posts.push_back( { offset( post, uniform( 0, 360 ), waypoint.gateWidth ), nextId++ } );
+            }
+        }
+        course.waypoints.push_back( waypoint );
+        last = waypoint.position;
+    }
+
+    double minEast = 0;
+    double maxEast = 0;
+    double minNorth = 0;
+    double maxNorth = 0;
+    for( const SimulatedWaypoint& waypoint : course.waypoints )
+    {
+        minEast = std::min( minEast, waypoint.position.east );
+        maxEast = std::max( maxEast, waypoint.position.east );
+        minNorth = std::min( minNorth, waypoint.position.north );
+        maxNorth = std::max( maxNorth, waypoint.position.north );
+    }
+    const double margin = 5;
+    for( int attempts = 0; int( course.obstacles.size() ) < settings.obstacles && attempts < 100 * settings.obstacles; ++attempts )
+    {
+        const SimulatedObstacle obstacle = { { uniform( minEast - margin, maxEast + margin ),
+                                               uniform( minNorth - margin, maxNorth + margin ) },
+                                             uniform( 0.3, 1.0 ) };
+        if( isClear( course, obstacle.center, obstacle.radius + 3 ) )
+        {
+            course.obstacles.push_back( obstacle );
+        }
+    }
+    return course;
+} // randomCourse()
+
+// Creates the course message the base station would send for course.
+Course toCourseMessage( const SimulatedCourse& course, const LocalFrame& frame )
+{
+    Course message;
+    message.num_waypoints = course.waypoints.size();
+    message.hash = std::hash<std::string>()( course.name );
+    for( const SimulatedWaypoint& waypoint : course.waypoints )
+    {
+        Waypoint waypointMessage;
+        waypointMessage.search = waypoint.search;
+        waypointMessage.gate = waypoint.gate;
+        waypointMessage.gate_width = waypoint.gateWidth;
+        waypointMessage.id = waypoint.id;
+        waypointMessage.odom = frame.toOdometry( waypoint.position, course.origin );
+        message.waypoints.push_back( waypointMessage );
+    }
+    return message;
+} // toCourseMessage()
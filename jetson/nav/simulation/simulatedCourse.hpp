@@ -0,0 +1,65 @@
+#ifndef SIMULATED_COURSE_HPP
+#define SIMULATED_COURSE_HPP
+
+#include <random>
+#include <string>
+#include <vector>
+#include "../localFrame.hpp"
+#include "rover_msgs/Course.hpp"
+
+using namespace rover_msgs;
+
+// A round obstacle in the simulated world.
+struct SimulatedObstacle
+{
+    LocalPoint center;
+    double radius;
+};
+
+// A post with an AR tag on it in the simulated world.
+struct SimulatedPost
+{
+    LocalPoint position;
+    int id;
+};
+
+// A waypoint of the simulated course.
+struct SimulatedWaypoint
+{
+    LocalPoint position;
+    bool search;
+    bool gate;
+    double gateWidth;
+    int id;
+};
+
+// Everything in the simulated world. Positions are in meters east and
+// north of origin.
+struct SimulatedCourse
+{
+    std::string name;
+    Odometry origin;
+    LocalPoint start;
+    double startBearing;
+    std::vector<SimulatedWaypoint> waypoints;
+    std::vector<SimulatedPost> posts;
+    std::vector<SimulatedObstacle> obstacles;
+};
+
+// Settings for generating random courses.
+struct RandomCourseSettings
+{
+    int legs;
+    int obstacles;
+    double minLegLength;
+    double maxLegLength;
+    double postSpread;
+};
+
+bool loadCourse( const std::string& path, SimulatedCourse& course );
+
+SimulatedCourse randomCourse( std::mt19937& random, const RandomCourseSettings& settings, const int number );
+
+Course toCourseMessage( const SimulatedCourse& course, const LocalFrame& frame );
+
+#endif // SIMULATED_COURSE_HPP
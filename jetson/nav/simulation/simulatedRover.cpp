@@ -0,0 +1,254 @@
+#include "simulatedRover.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Constructs a stopped rover at the start of the course.
+SimulatedRover::SimulatedRover( const rapidjson::Document& roverConfig, const SimulatedCourse& course, const double maxSpeed )
+    : mCourse( course )
+    , mPosition( course.start )
+    , mBearing( course.startBearing )
+    , mSpeed( 0 )
+    , mMaxSpeed( maxSpeed )
+    , mWidth( roverConfig[ "roverMeasurements" ][ "width" ].GetDouble() )
+    , mVisionDistance( roverConfig[ "computerVision" ][ "visionDistance" ].GetDouble() )
+    , mFieldOfView( roverConfig[ "computerVision" ][ "fieldOfViewAngle" ].GetDouble() )
+    , mCollided( false )
+    , mDistanceDriven( 0 )
+{
+    mFrame.anchor( course.origin );
+    mJoystick.forward_back = 0;
+    mJoystick.left_right = 0;
+    mJoystick.dampen = 0;
+    mJoystick.kill = false;
+    mJoystick.restart = false;
+} // SimulatedRover()
+
+// Sets the joystick command the rover drives with until the next one.
+void SimulatedRover::command( const Joystick& joystick )
+{
+    mJoystick = joystick;
+} // command()
+
+// Drives the rover for dt seconds. The joystick is mixed like the
+// teleop arcade drive: each side gets the forward effort plus or minus
+// the turning effort, scaled by the dampen power limit.
+void SimulatedRover::step( const double dt )
+{
+    const double power = mJoystick.kill ? 0 : ( 1 - mJoystick.dampen ) / 2;
+    const double left = max( -1.0, min( 1.0, mJoystick.forward_back + mJoystick.left_right ) ) * power;
+    const double right = max( -1.0, min( 1.0, mJoystick.forward_back - mJoystick.left_right ) ) * power;
+    mSpeed = mMaxSpeed * ( left + right ) / 2;
+    const double turnRate = radianToDegree( mMaxSpeed * ( left - right ) / mWidth );
+
+    // Moves along the arc as if the rover turned at its midpoint.
+    const double midBearing = mBearing + turnRate * dt / 2;
+    mPosition = offset( mPosition, midBearing, mSpeed * dt );
+    mBearing = mod( mBearing + turnRate * dt, 360 );
+    mDistanceDriven += fabs( mSpeed * dt );
+
+    for( const SimulatedObstacle& obstacle : mCourse.obstacles )
+    {
+        if( distance( mPosition, obstacle.center ) < obstacle.radius + mWidth / 2 )
+        {
+            mCollided = true;
+        }
+    }
+} // step()
+
+// Creates the odometry message the filter would send.
+Odometry SimulatedRover::odometry() const
+{
+    Odometry odometry = mFrame.toOdometry( mPosition, mCourse.origin );
+    odometry.bearing_deg = mBearing;
+    odometry.speed = fabs( mSpeed );
+    return odometry;
+} // odometry()
+
+// Creates the target list perception would send. The closest visible
+// post is the first target and the next closest is the second, and
+// every visible post is a tag, leftmost first.
+TargetList SimulatedRover::targetList() const
+{
+    // The simulation runs on its own clock, so its frames have no
+    // capture time to age the targets by.
+    TargetList targetList;
+    targetList.capture_time_us = 0;
+    targetList.frame_seq = -1;
+    targetList.num_tags = 0;
+    for( Target& target : targetList.targetList )
+    {
+        target.distance = -1;
+        target.bearing = 0;
+        target.id = -1;
+    }
+    for( const SimulatedPost& post : mCourse.posts )
+    {
+        if( !isVisible( post.position ) )
+        {
+            continue;
+        }
+        Target target;
+        target.distance = distance( mPosition, post.position );
+        target.bearing = bearing( mPosition, post.position );
+        throughZero( target.bearing, mBearing );
+        target.bearing -= mBearing;
+        target.id = post.id;
+        DetectedTag tag;
+        tag.id = target.id;
+        tag.bearing = target.bearing;
+        tag.distance = target.distance;
+        tag.range_confidence = 1;
+        tag.corner_confidence = 1;
+        tag.missed_frames = 0;
+        targetList.tags.push_back( tag );
+        Target* first = targetList.targetList;
+        if( first[ 0 ].distance < 0 || target.distance < first[ 0 ].distance )
+        {
+            first[ 1 ] = first[ 0 ];
+            first[ 0 ] = target;
+        }
+        else if( first[ 1 ].distance < 0 || target.distance < first[ 1 ].distance )
+        {
+            first[ 1 ] = target;
+        }
+    }
+    sort( targetList.tags.begin(), targetList.tags.end(),
+          []( const DetectedTag& tag1, const DetectedTag& tag2 ) { return tag1.bearing < tag2.bearing; } );
+    targetList.num_tags = targetList.tags.size();
+    return targetList;
+} // targetList()
+
+// Creates the obstacle message perception would send. If the rover's
+// path straight ahead is blocked, the bearings are the closest clear
+// paths to the left and right.
+Obstacle SimulatedRover::obstacle() const
+{
+    Obstacle obstacle;
+    obstacle.capture_time_us = 0;
+    obstacle.frame_seq = -1;
+    obstacle.distance = rayDistance( mBearing, mWidth / 2, mVisionDistance );
+    obstacle.bearing = 0;
+    obstacle.rightBearing = 0;
+    if( obstacle.distance < 0 )
+    {
+        return obstacle;
+    }
+    obstacle.bearing = -mFieldOfView / 2;
+    for( double angle = 0; angle >= -mFieldOfView / 2; --angle )
+    {
+        if( rayDistance( mBearing + angle, mWidth / 2, mVisionDistance ) < 0 )
+        {
+            obstacle.bearing = angle;
+            break;
+        }
+    }
+    obstacle.rightBearing = mFieldOfView / 2;
+    for( double angle = 0; angle <= mFieldOfView / 2; ++angle )
+    {
+        if( rayDistance( mBearing + angle, mWidth / 2, mVisionDistance ) < 0 )
+        {
+            obstacle.rightBearing = angle;
+            break;
+        }
+    }
+    return obstacle;
+} // obstacle()
+
+// Creates the obstacle profile perception would send, with one degree
+// bins across the field of view.
+ObstacleProfile SimulatedRover::obstacleProfile() const
+{
+    ObstacleProfile profile;
+    const int bins = sizeof( profile.ranges ) / sizeof( profile.ranges[ 0 ] );
+    profile.resolution = 1;
+    profile.start_bearing = -( bins / 2 );
+    profile.max_range = mVisionDistance;
+    profile.capture_time_us = 0;
+    profile.frame_seq = -1;
+    for( int i = 0; i < bins; ++i )
+    {
+        const double angle = profile.start_bearing + i * profile.resolution;
+        profile.ranges[ i ] = fabs( angle ) <= mFieldOfView / 2 ?
+            rayDistance( mBearing + angle, 0, mVisionDistance ) : -1;
+    }
+    return profile;
+} // obstacleProfile()
+
+// Creates the perception frame message perception would send, with the
+// targets, obstacle and obstacle profile of the rover's current pose.
+PerceptionFrame SimulatedRover::perceptionFrame() const
+{
+    PerceptionFrame frame;
+    frame.targets = targetList();
+    frame.obstacle = obstacle();
+    frame.profile = obstacleProfile();
+    frame.has_profile = true;
+    frame.capture_time_us = 0;
+    frame.frame_seq = frame.targets.frame_seq;
+    return frame;
+} // perceptionFrame()
+
+// Returns true if the rover has driven into an obstacle, false
+// otherwise.
+bool SimulatedRover::collided() const
+{
+    return mCollided;
+} // collided()
+
+// Gets the total distance the rover has driven.
+double SimulatedRover::distanceDriven() const
+{
+    return mDistanceDriven;
+} // distanceDriven()
+
+// Finds the distance to the first obstacle the camera can see that a
+// rover halfWidth meters wide would hit driving range meters along the
+// absolute bearing. Returns -1 if there is no such obstacle.
+double SimulatedRover::rayDistance( const double bearing, const double halfWidth, const double range ) const
+{
+    const double east = sin( degreeToRadian( bearing ) );
+    const double north = cos( degreeToRadian( bearing ) );
+    double closest = -1;
+    for( const SimulatedObstacle& obstacle : mCourse.obstacles )
+    {
+        const double dEast = obstacle.center.east - mPosition.east;
+        const double dNorth = obstacle.center.north - mPosition.north;
+        const double centerDistance = hypot( dEast, dNorth );
+        double centerAngle = ::bearing( mPosition, obstacle.center );
+        throughZero( centerAngle, mBearing );
+        if( centerDistance - obstacle.radius > mVisionDistance ||
+            fabs( centerAngle - mBearing ) > mFieldOfView / 2 )
+        {
+            continue;
+        }
+        const double forward = dEast * east + dNorth * north;
+        const double lateral = dEast * north - dNorth * east;
+        const double reach = halfWidth + obstacle.radius;
+        if( forward <= 0 || fabs( lateral ) >= reach )
+        {
+            continue;
+        }
+        const double hit = max( 0.0, forward - sqrt( reach * reach - lateral * lateral ) );
+        if( hit <= range && ( closest < 0 || hit < closest ) )
+        {
+            closest = hit;
+        }
+    }
+    return closest;
+} // rayDistance()
+
+// Returns true if the camera can see point, false otherwise.
+bool SimulatedRover::isVisible( const LocalPoint& point ) const
+{
+    const double pointDistance = distance( mPosition, point );
+    double pointBearing = bearing( mPosition, point );
+    throughZero( pointBearing, mBearing );
+    if( pointDistance > mVisionDistance || fabs( pointBearing - mBearing ) > mFieldOfView / 2 )
+    {
+        return false;
+    }
+    const double blocked = rayDistance( pointBearing, 0, pointDistance );
+    return blocked < 0;
+} // isVisible()
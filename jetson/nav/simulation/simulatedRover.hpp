@@ -0,0 +1,79 @@
+#ifndef SIMULATED_ROVER_HPP
+#define SIMULATED_ROVER_HPP
+
+#include "simulatedCourse.hpp"
+#include "rapidjson/document.h"
+#include "rover_msgs/Joystick.hpp"
+#include "rover_msgs/Obstacle.hpp"
+#include "rover_msgs/ObstacleProfile.hpp"
+#include "rover_msgs/Odometry.hpp"
+#include "rover_msgs/PerceptionFrame.hpp"
+#include "rover_msgs/TargetList.hpp"
+
+using namespace rover_msgs;
+
+// This class is a skid steer rover driving around a simulated course.
+// It turns joystick commands into motion and makes the messages that
+// the filter and perception would send from what the rover can see.
+class SimulatedRover
+{
+public:
+    SimulatedRover( const rapidjson::Document& roverConfig, const SimulatedCourse& course, const double maxSpeed );
+
+    void command( const Joystick& joystick );
+
+    void step( const double dt );
+
+    Odometry odometry() const;
+
+    TargetList targetList() const;
+
+    Obstacle obstacle() const;
+
+    ObstacleProfile obstacleProfile() const;
+
+    PerceptionFrame perceptionFrame() const;
+
+    bool collided() const;
+
+    double distanceDriven() const;
+
+private:
+    double rayDistance( const double bearing, const double halfWidth, const double range ) const;
+
+    bool isVisible( const LocalPoint& point ) const;
+
+    /*************************************************************************/
+    /* Private Member Variables */
+    /*************************************************************************/
+
+    // The course the rover is driving on and its local frame.
+    const SimulatedCourse& mCourse;
+    LocalFrame mFrame;
+
+    // The rover's pose and speed.
+    LocalPoint mPosition;
+    double mBearing;
+    double mSpeed;
+
+    // The last joystick command.
+    Joystick mJoystick;
+
+    // Speed of the rover in meters per second with both sides at full
+    // power.
+    const double mMaxSpeed;
+
+    // Size of the rover and what its camera can see, from the nav
+    // config.
+    const double mWidth;
+    const double mVisionDistance;
+    const double mFieldOfView;
+
+    // Whether the rover has driven into an obstacle.
+    bool mCollided;
+
+    // Total distance the rover has driven.
+    double mDistanceDriven;
+};
+
+#endif // SIMULATED_ROVER_HPP
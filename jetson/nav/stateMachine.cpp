@@ -1,5 +1,6 @@
 #include "stateMachine.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -9,55 +10,136 @@
 #include <map>
 
 #include "rover_msgs/NavStatus.hpp"
+#include "rover_msgs/PerceptionRates.hpp"
 #include "utilities.hpp"
+#include "trace.hpp"
 #include "search/spiralOutSearch.hpp"
 #include "search/spiralInSearch.hpp"
 #include "search/lawnMowerSearch.hpp"
 #include "obstacle_avoidance/simpleAvoidance.hpp"
 #include "gate_search/diamondGateSearch.hpp"
 
+namespace
+{
+    // Returns the time of the steady clock in microseconds.
+    int64_t steadyMicroseconds()
+    {
+        return chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now().time_since_epoch() ).count();
+    } // steadyMicroseconds()
+} // namespace
+
 // Constructs a StateMachine object with the input lcm object.
 // Reads the configuartion file and constructs a Rover objet with this
 // and the lcmObject. Sets mStateChanged to true so that on the first
 // iteration of run the rover is updated.
 StateMachine::StateMachine( lcm::LCM& lcmObject )
     : mRover( nullptr )
+    , mLastCourseHash( 0 )
+    , mChangedInputs( AllFields )
+    , mAutonStateVersion( 0 )
+    , mCourseVersion( 0 )
+    , mOdometryVersion( 0 )
+    , mPerceptionFrameVersion( 0 )
+    , mDetectionTimingVersion( 0 )
+    , mVisualPoseVersion( 0 )
+    , mPlannerScaleVersion( 0 )
+    , mHasObstacleProfile( false )
+    , mRunTrigger( TraceInput::None )
+    , mRunTriggerArrivalUs( 0 )
+    , mDetectionTiming( { 0, 0 } )
+    , mDetectionRate( 0 )
+    , mSearchFails( 0 )
+    , mPassedWaypoints( 0 )
+    , mPublishedState( NavState::Unknown )
+    , mPublishedCompletedWaypoints( 0 )
+    , mPublishedTotalWaypoints( 0 )
+    , mPublishedRates( { -2, -2 } )
     , mLcmObject( lcmObject )
+    , mLatencyTest( lcmObject )
     , mTotalWaypoints( 0 )
     , mCompletedWaypoints( 0 )
     , mStateChanged( true )
 {
-    ifstream configFile;
-    string configPath = getenv("MROVER_CONFIG");
-    configPath += "/config_nav/config.json";
-    configFile.open( configPath );
-    string config = "";
-    string setting;
-    while( configFile >> setting )
-    {
-        config += setting;
-    }
-    configFile.close();
-    mRoverConfig.Parse( config.c_str() );
-    mRover = new Rover( mRoverConfig, lcmObject );
-    mSearchStateMachine = SearchFactory( this, SearchType::SPIRALOUT, mRover, mRoverConfig );
-    mGateStateMachine = GateFactory( this, mRover, mRoverConfig );
-    mObstacleAvoidanceStateMachine = ObstacleAvoiderFactory( this, ObstacleAvoidanceAlgorithm::SimpleAvoidance, mRover, mRoverConfig );
+    mConfigPath = getenv("MROVER_CONFIG");
+    mConfigPath += "/config_nav/config.json";
+    if( !loadNavConfig( mConfigPath, mRoverConfig ) || !readNavConfig( mRoverConfig, mConfig ) )
+    {
+        cerr << "Error: cannot read nav config " << mConfigPath << "\n";
+        exit( 1 );
+    }
+    mSearchVisionDistance = mConfig.computerVision.visionDistance;
+    mSearchCandidates.reserve( 2 * mConfig.search.numSearches );
+    for( atomic<int64_t>& arrival : mInputArrivalUs )
+    {
+        arrival = 0;
+    }
+    mTrace.setLength( mRoverConfig[ "trace" ][ "length" ].GetInt() );
+    mTraceFile = mRoverConfig[ "trace" ][ "file" ].GetString();
+    mRover = new Rover( mConfig, lcmObject );
+    const rapidjson::Value& avoidanceConfig = mRoverConfig[ "obstacleAvoidance" ];
+    mCostmap = new LocalCostmap( avoidanceConfig[ "halfWidth" ].GetDouble(),
+                                 avoidanceConfig[ "cellSize" ].GetDouble(),
+                                 mConfig.roverMeasurements.width / 2,
+                                 avoidanceConfig[ "hitValue" ].GetInt(),
+                                 avoidanceConfig[ "missValue" ].GetInt(),
+                                 avoidanceConfig[ "occupiedValue" ].GetInt(),
+                                 avoidanceConfig[ "maxValue" ].GetInt(),
+                                 avoidanceConfig[ "recenterDistance" ].GetDouble() );
+    mSpiralOut.emplace( this, mRover, mRoverConfig );
+    mLawnMower.emplace( this, mRover, mRoverConfig );
+    mSpiralIn.emplace( this, mRover, mRoverConfig );
+    mSearchStateMachine = mSpiralOut.get();
+    mGateStateMachine = mDiamondGateSearch.emplace( this, mRover, mRoverConfig );
+    if( string( avoidanceConfig[ "algorithm" ].GetString() ) == "costmap" )
+    {
+        mObstacleAvoidanceStateMachine = mCostmapAvoidance.emplace( this, mRover, mRoverConfig, *mCostmap );
+    }
+    else if( string( avoidanceConfig[ "algorithm" ].GetString() ) == "dynamicWindow" )
+    {
+        mObstacleAvoidanceStateMachine = mDynamicWindowAvoidance.emplace( this, mRover, mRoverConfig, *mCostmap );
+    }
+    else
+    {
+        mObstacleAvoidanceStateMachine = mSimpleAvoidance.emplace( this, mRover, mRoverConfig );
+    }
 } // StateMachine()
 
 // Destructs the StateMachine object. Deallocates memory for the Rover
 // object.
 StateMachine::~StateMachine( )
 {
+    delete mCostmap;
     delete mRover;
 }
 
-void StateMachine::setSearcher( SearchType type, Rover* rover, const rapidjson::Document& roverConfig )
+// Switches to the search of the given type and starts it over. The
+// searches are made when nav starts, so this doesn't allocate.
+void StateMachine::setSearcher( SearchType type )
 {
-    assert( mSearchStateMachine );
-    delete mSearchStateMachine;
-    mSearchStateMachine = SearchFactory( this, type, rover, roverConfig );
-}
+    switch( type )
+    {
+        case SearchType::LAWNMOWER:
+        {
+            mSearchStateMachine = mLawnMower.get();
+            break;
+        }
+
+        case SearchType::SPIRALIN:
+        {
+            mSearchStateMachine = mSpiralIn.get();
+            break;
+        }
+
+        case SearchType::SPIRALOUT:
+        default:
+        {
+            mSearchStateMachine = mSpiralOut.get();
+            break;
+        }
+    }
+    mSearchStateMachine->reset();
+} // setSearcher()
 
 void StateMachine::updateCompletedPoints( )
 {
@@ -87,210 +169,840 @@ void StateMachine::updateObstacleElements( double bearing, double distance )
     updateObstacleDistance( distance );
 }
 
-// Runs the state machine through one iteration. The state machine will
-// run if the state has changed or if the rover's status has changed.
-// Will call the corresponding function based on the current state.
+// Allows outside objects to set the point the rover was driving to
+// before it had to avoid an obstacle
+void StateMachine::updateAvoidanceGoal( const LocalPoint& goal )
+{
+    mObstacleAvoidanceStateMachine->updateAvoidanceGoal( goal );
+}
+
+// Runs the state machine through one iteration at the current time.
 void StateMachine::run()
 {
+    run( std::chrono::steady_clock::now() );
+} // run()
+
+// Runs the state machine through one iteration with the latest rover
+// status. This is called at a fixed rate by the control thread, so it
+// runs whether or not new messages have arrived, which keeps the PID
+// loops updating at a steady rate. Waits in the state machine are
+// timed from now, so a simulation can run it on its own clock.
+// Will call the handler of the current state from the state handler
+// table.
+void StateMachine::run( std::chrono::steady_clock::time_point now )
+{
+    mNow = now;
+    updateConfigFromInputs();
     publishNavState();
-    if( isRoverReady() )
-    {
-        mStateChanged = false;
-        NavState nextState = NavState::Unknown;
+    publishPerceptionRates();
+    mLatencyTest.update( mConfig, chrono::duration_cast<chrono::microseconds>( now.time_since_epoch() ).count(),
+                         mRover->lastJoystick(), mRover->lastJoystickUs() );
+    updateRoverFromInputs();
+    stampSearchCoverage();
+    preplanNextLeg();
+    mStateChanged = false;
+    NavState nextState = NavState::Unknown;
 
-        if( !mRover->roverStatus().autonState().is_auton )
+    if( !mRover->roverStatus().autonState().is_auton )
+    {
+        const NavState previousState = mRover->roverStatus().currentState();
+        nextState = NavState::Off;
+        mRover->roverStatus().currentState() = executeOff(); // turn off immediately
+        clear( mRover->roverStatus().path() );
+        mGateStateMachine->forgetPosts();
+        if( nextState != mRover->roverStatus().currentState() )
         {
-            nextState = NavState::Off;
-            mRover->roverStatus().currentState() = executeOff(); // turn off immediately
-            clear( mRover->roverStatus().path() );
-            if( nextState != mRover->roverStatus().currentState() )
-            {
-                mRover->roverStatus().currentState() = nextState;
-                mStateChanged = true;
-            }
-            return;
+            mRover->roverStatus().currentState() = nextState;
+            mStateChanged = true;
+            mRover->pathFollower().clear();
         }
-        switch( mRover->roverStatus().currentState() )
+        if( previousState != mRover->roverStatus().currentState() )
         {
-            case NavState::Off:
-            {
-                nextState = executeOff();
-                break;
-            }
+            traceStateChange( previousState, mRover->roverStatus().currentState() );
+        }
+        return;
+    }
+    const size_t state = static_cast<size_t>( mRover->roverStatus().currentState() );
+    nextState = ( this->*stateHandlers()[ state ] )();
 
-            case NavState::Done:
-            {
-                nextState = executeDone();
-                break;
-            }
+    if( nextState != mRover->roverStatus().currentState() )
+    {
+        traceStateChange( mRover->roverStatus().currentState(), nextState );
+        mStateChanged = true;
+        mRover->roverStatus().currentState() = nextState;
+        mRover->distancePid().reset();
+        mRover->bearingPid().reset();
+        mRover->pathFollower().clear();
+    }
+    cerr << flush;
+} // run()
 
-          
-            case NavState::Turn:
-            {
-                nextState = executeTurn();
-                break;
-            }
+// Writes the trace of the last state changes to the trace file and
+// sends it over LCM. Returns false if the file can't be written, the
+// trace is still sent.
+bool StateMachine::dumpTrace()
+{
+    NavTrace message;
+    mTrace.fillMessage( message );
+    mLcmObject.publish( mConfig.lcmChannels.navTraceChannel, &message );
+    if( !mTrace.writeFile( mTraceFile ) )
+    {
+        cerr << "Error: cannot write nav trace " << mTraceFile << "\n";
+        return false;
+    }
+    cerr << "Wrote " << mTrace.size() << " state changes to " << mTraceFile << "\n";
+    return true;
+} // dumpTrace()
 
-          
-            case NavState::Drive:
-            {
-                nextState = executeDrive();
-                break;
-            }
+// Returns the table of the function that runs each nav state. States
+// that aren't in the table run executeUnknown.
+const StateMachine::StateHandlers& StateMachine::stateHandlers()
+{
+    static const StateHandlers handlers = []()
+    {
+        StateHandlers table;
+        table.fill( &StateMachine::executeUnknown );
+        table[ static_cast<size_t>( NavState::Off ) ] = &StateMachine::executeOff;
+        table[ static_cast<size_t>( NavState::Done ) ] = &StateMachine::executeDone;
+        table[ static_cast<size_t>( NavState::Turn ) ] = &StateMachine::executeTurn;
+        table[ static_cast<size_t>( NavState::Drive ) ] = &StateMachine::executeDrive;
+        table[ static_cast<size_t>( NavState::ChangeSearchAlg ) ] = &StateMachine::executeChangeSearchAlg;
+        for( NavState state : { NavState::SearchFaceNorth, NavState::SearchSpin, NavState::SearchSpinWait,
+                                NavState::SearchTurn, NavState::SearchDrive, NavState::TurnToTarget,
+                                NavState::TurnedToTargetWait, NavState::DriveToTarget } )
+        {
+            table[ static_cast<size_t>( state ) ] = &StateMachine::runSearch;
+        }
+        for( NavState state : { NavState::TurnAroundObs, NavState::SearchTurnAroundObs,
+                                NavState::DriveAroundObs, NavState::SearchDriveAroundObs } )
+        {
+            table[ static_cast<size_t>( state ) ] = &StateMachine::runObstacleAvoidance;
+        }
+        for( NavState state : { NavState::GateSpin, NavState::GateSpinWait, NavState::GateTurn,
+                                NavState::GateDrive, NavState::GateTurnToCentPoint,
+                                NavState::GateDriveToCentPoint, NavState::GateFace, NavState::GateShimmy,
+                                NavState::GateDriveThrough, NavState::GateTrajectory } )
+        {
+            table[ static_cast<size_t>( state ) ] = &StateMachine::runGateSearch;
+        }
+        return table;
+    }();
+    return handlers;
+} // stateHandlers()
 
-           
+// Rereads the config file and replaces the settings that are read
+// every iteration. This is called between runs, so a run never sees a
+// mix of old and new settings. Settings only read at startup, like the
+// control rate and the costmap size, still need a restart. Returns
+// false and keeps the old settings if the file can't be read.
+bool StateMachine::reloadConfig()
+{
+    ConfigFile document;
+    if( !loadNavConfig( mConfigPath, document ) || !readNavConfig( document, mConfig ) )
+    {
+        cerr << "Error: cannot reload nav config " << mConfigPath << ", keeping the old settings\n";
+        return false;
+    }
+    mRover->updatePidConfig();
+    cerr << "Reloaded nav config " << mConfigPath << "\n";
+    return true;
+} // reloadConfig()
 
-            case NavState::SearchFaceNorth:
-            case NavState::SearchSpin:
-            case NavState::SearchSpinWait:
-            case NavState::SearchTurn:
-            case NavState::SearchDrive:
-            case NavState::TurnToTarget:
-            case NavState::TurnedToTargetWait:
-            case NavState::DriveToTarget:
-            {
-                nextState = mSearchStateMachine->run();
-                break;
-            }
+// Queues a change to one setting, applied before the next run.
+void StateMachine::updateConfig( NavConfigValue value )
+{
+    mConfigInput.transaction( [&]( vector<NavConfigValue>& pending )
+    {
+        pending.push_back( value );
+        return true;
+    } );
+} // updateConfig( NavConfigValue )
 
-            case NavState::TurnAroundObs:
-            case NavState::SearchTurnAroundObs:
-            case NavState::DriveAroundObs:
-            case NavState::SearchDriveAroundObs:
-            {
-                nextState = mObstacleAvoidanceStateMachine->run();
-                break;
-            }
+// Queues new gains for a pid loop, applied before the next run. Device
+// 0 is the driving pid loop and 1 is the turning pid loop.
+void StateMachine::updateConfig( PIDConstants constants )
+{
+    if( constants.deviceID != 0 && constants.deviceID != 1 )
+    {
+        cerr << "Ignoring pid constants for unknown device " << int( constants.deviceID ) << "\n";
+        return;
+    }
+    const string pid = constants.deviceID == 0 ? "distancePid" : "bearingPid";
+    mConfigInput.transaction( [&]( vector<NavConfigValue>& pending )
+    {
+        NavConfigValue value;
+        value.name = pid + ".kP";
+        value.value = constants.kP;
+        pending.push_back( value );
+        value.name = pid + ".kI";
+        value.value = constants.kI;
+        pending.push_back( value );
+        value.name = pid + ".kD";
+        value.value = constants.kD;
+        pending.push_back( value );
+        return true;
+    } );
+} // updateConfig( PIDConstants )
 
-            case NavState::ChangeSearchAlg:
-            {
-                static int searchFails = 0;
-                static double visionDistance = mRoverConfig[ "computerVision" ][ "visionDistance" ].GetDouble();
-
-                switch( mRoverConfig[ "search" ][ "order" ][ searchFails % mRoverConfig[ "search" ][ "numSearches" ].GetInt() ].GetInt() )
-                {
-                    case 0:
-                    {
-                        setSearcher(SearchType::SPIRALOUT, mRover, mRoverConfig);
-                        break;
-                    }
-                    case 1:
-                    {
-                        setSearcher(SearchType::LAWNMOWER, mRover, mRoverConfig);
-                        break;
-                    }
-                    case 2:
-                    {
-                        setSearcher(SearchType::SPIRALIN, mRover, mRoverConfig);
-                        break;
-                    }
-                    default:
-                    {
-                        setSearcher(SearchType::SPIRALOUT, mRover, mRoverConfig);
-                        break;
-                    }
-                }
-                mSearchStateMachine->initializeSearch( mRover, mRoverConfig, visionDistance );
-                if( searchFails % 2 == 1 && visionDistance > 0.5 )
-                {
-                    visionDistance *= 0.5;
-                }
-                searchFails += 1;
-                nextState = NavState::SearchTurn;
-                break;
-            }
+// Gets the time the current run of the state machine started at.
+std::chrono::steady_clock::time_point StateMachine::now() const
+{
+    return mNow;
+} // now()
 
-            case NavState::GateSpin:
-            case NavState::GateSpinWait:
-            case NavState::GateTurn:
-            case NavState::GateDrive:
-            case NavState::GateTurnToCentPoint:
-            case NavState::GateDriveToCentPoint:
-            case NavState::GateFace:
-            case NavState::GateShimmy:
-            case NavState::GateDriveThrough:
-            {
-                nextState = mGateStateMachine->run();
-                break;
-            }
+// Returns the period the control thread runs the state machine at.
+std::chrono::microseconds StateMachine::controlPeriod() const
+{
+    return std::chrono::microseconds( static_cast<long>( 1e6 / mConfig.control.rateHz ) );
+} // controlPeriod()
 
-            case NavState::Unknown:
-            {
-                cerr << "Entered unknown state.\n";
-                exit(1);
-            }
-        } // switch
+// Sleeps until deadline, or until auton is turned on or off or a new
+// course arrives, so the rover starts, stops or changes course without
+// waiting out the rest of the control period.
+void StateMachine::waitForInput( std::chrono::steady_clock::time_point deadline )
+{
+    Thor::wait_any_until( deadline, [&]()
+    {
+        return mAutonStateInput.get().is_auton != mNewRoverStatus.autonState().is_auton ||
+               mCourseInput.version() != mCourseVersion;
+    }, mAutonStateInput, mCourseInput );
+} // waitForInput()
 
-        if( nextState != mRover->roverStatus().currentState() )
+// Returns the estimated number of frames a second perception looks for
+// AR tags in, or 0 if perception hasn't sent enough latency summaries.
+double StateMachine::detectionRate() const
+{
+    return mDetectionRate;
+} // detectionRate()
+
+// Applies the config changes that arrived since the last run. This runs
+// before anything else in the iteration so all of it uses the same
+// settings.
+void StateMachine::updateConfigFromInputs()
+{
+    vector<NavConfigValue> values;
+    mConfigInput.transaction( [&]( vector<NavConfigValue>& pending )
+    {
+        values.swap( pending );
+        return false;
+    } );
+    if( values.empty() )
+    {
+        return;
+    }
+    for( const NavConfigValue& value : values )
+    {
+        if( setNavConfigValue( mConfig, value.name, value.value ) )
         {
-            mStateChanged = true;
-            mRover->roverStatus().currentState() = nextState;
-            mRover->distancePid().reset();
-            mRover->bearingPid().reset();
+            cerr << "Set " << value.name << " to " << value.value << "\n";
         }
-        cerr << flush;
-    } // if
-} // run()
+        else
+        {
+            cerr << "Cannot set " << value.name << " to " << value.value << "\n";
+        }
+    }
+    mRover->updatePidConfig();
+} // updateConfigFromInputs()
 
 // Updates the auton state (on/off) of the rover's status.
 void StateMachine::updateRoverStatus( AutonState autonState )
 {
-    mNewRoverStatus.autonState() = autonState;
+    mAutonStateInput.set( autonState );
+    setArrival( TraceInput::AutonState );
 } // updateRoverStatus( AutonState )
 
 // Updates the course of the rover's status if it has changed.
 void StateMachine::updateRoverStatus( Course course )
 {
-    if( mNewRoverStatus.course().hash != course.hash )
+    if( mLastCourseHash != course.hash )
     {
-        mNewRoverStatus.course() = course;
+        mLastCourseHash = course.hash;
+        mCourseInput.set( course );
+        setArrival( TraceInput::Course );
     }
 } // updateRoverStatus( Course )
 
-// Updates the obstacle information of the rover's status.
-void StateMachine::updateRoverStatus( Obstacle obstacle )
-{
-    mNewRoverStatus.obstacle() = obstacle;
-} // updateRoverStatus( Obstacle )
-
 // Updates the odometry information of the rover's status.
-void StateMachine::updateRoverStatus( Odometry odometry )
+void StateMachine::updateRoverStatus( const Odometry& odometry )
 {
-    mNewRoverStatus.odometry() = odometry;
+    mOdometryInput.set( odometry );
+    setArrival( TraceInput::Odometry );
 } // updateRoverStatus( Odometry )
 
-// Updates the target information of the rover's status.
-void StateMachine::updateRoverStatus( TargetList targetList )
+// Updates the targets, the obstacle and the obstacle profile of the
+// rover's status together, so a run never sees the targets of one
+// perception update with the obstacle of another.
+void StateMachine::updateRoverStatus( const PerceptionFrame& perceptionFrame )
+{
+    mPerceptionFrameInput.set( perceptionFrame );
+    setArrival( TraceInput::PerceptionFrame );
+} // updateRoverStatus( PerceptionFrame )
+
+// Keeps the frame count and AR tag detection time of the perception
+// latency summary, which is all the detection rate needs, so that
+// the message's stage list isn't copied to the control thread.
+void StateMachine::updateRoverStatus( const PerceptionLatency& perceptionLatency )
 {
-    Target target = targetList.targetList[0];
-    Target target2 = targetList.targetList[1];
-    mNewRoverStatus.target() = target;
-    mNewRoverStatus.target2() = target2;
-} // updateRoverStatus( Target )
+    DetectionTiming timing = { perceptionLatency.frames, 0 };
+    for( const StageLatency& stage : perceptionLatency.stages )
+    {
+        if( stage.stage == "ar_detect" )
+        {
+            timing.arDetectMs = stage.p90_ms;
+        }
+    }
+    mDetectionTimingInput.set( timing );
+} // updateRoverStatus( PerceptionLatency )
 
-// Return true if we want to execute a loop in the state machine, false
-// otherwise.
-bool StateMachine::isRoverReady() const
+// Adds the rover's motion between two camera frames to the visual pose.
+// Every message is added here, on the LCM thread, so none are lost when
+// several arrive between runs.
+void StateMachine::updateRoverStatus( const VisualOdometry& visualOdometry )
 {
-    return mStateChanged || // internal data has changed
-           mRover->updateRover( mNewRoverStatus ) || // external data has changed
-           mRover->roverStatus().currentState() == NavState::SearchSpinWait || // continue even if no data has changed
-           mRover->roverStatus().currentState() == NavState::TurnedToTargetWait || // continue even if no data has changed
-           mRover->roverStatus().currentState() == NavState::GateSpinWait;
+    mVisualOdometryIntegrator.add( visualOdometry );
+    mVisualPoseInput.set( mVisualOdometryIntegrator.pose() );
+} // updateRoverStatus( VisualOdometry )
 
-} // isRoverReady()
+// Updates how much of their budget the planners may use from the
+// workload governor on the Jetson.
+void StateMachine::updateRoverStatus( const WorkloadGovernor& governor )
+{
+    mPlannerScaleInput.set( governor.planner_scale );
+} // updateRoverStatus( WorkloadGovernor )
 
-// Publishes the current navigation state to the nav status lcm channel.
-void StateMachine::publishNavState() const
+// Updates the rover with the latest status received over LCM. Only
+// inputs that received a new message since the last run are copied,
+// and the rover only looks at the fields that were copied.
+void StateMachine::updateRoverFromInputs()
 {
+    if( mAutonStateInput.version() != mAutonStateVersion )
+    {
+        mNewRoverStatus.autonState() = mAutonStateInput.get( &mAutonStateVersion );
+        mChangedInputs |= AutonStateField;
+    }
+    if( mCourseInput.version() != mCourseVersion )
+    {
+        mNewRoverStatus.course() = *mCourseInput.get( &mCourseVersion );
+        mChangedInputs |= CourseField;
+    }
+    if( mOdometryInput.version() != mOdometryVersion )
+    {
+        mNewRoverStatus.odometry() = mOdometryInput.get( &mOdometryVersion );
+        // Odometry isn't stamped, so the rover's pose history goes by
+        // when it arrived, which is close behind when it was measured.
+        mNewRoverStatus.odometryTimeUs() = mInputArrivalUs[ static_cast<size_t>( TraceInput::Odometry ) ];
+        mChangedInputs |= OdometryField;
+        mVisualOdometryFusion.fix( mNewRoverStatus.odometry(), mNewRoverStatus.odometryTimeUs() );
+    }
+    if( mVisualPoseInput.version() != mVisualPoseVersion )
+    {
+        // A fix copied in this run is newer than anything moved on from
+        // the last one.
+        const VisualPose visualPose = mVisualPoseInput.get( &mVisualPoseVersion );
+        if( !( mChangedInputs & OdometryField ) &&
+            mVisualOdometryFusion.fuse( visualPose, mConfig.visualOdometry.maxFixAge, mNewRoverStatus.odometry() ) )
+        {
+            mNewRoverStatus.odometryTimeUs() = visualPose.timeUs;
+            mChangedInputs |= OdometryField;
+        }
+    }
+    if( mPerceptionFrameInput.version() != mPerceptionFrameVersion )
+    {
+        // The frame carries every tracked tag, so it is shared rather
+        // than copied through a sequence lock.
+        const shared_ptr<const PerceptionFrame> frame = mPerceptionFrameInput.get( &mPerceptionFrameVersion );
+        const PerceptionFrame& perceptionFrame = *frame;
+        mNewRoverStatus.obstacle() = perceptionFrame.obstacle;
+        mChangedInputs |= ObstacleField;
+        if( mNewRoverStatus.obstacle().capture_time_us > 0 )
+        {
+            Trace::counter( "obstacle age us", chrono::duration_cast<chrono::microseconds>( mNow.time_since_epoch() ).count() -
+                                               mNewRoverStatus.obstacle().capture_time_us );
+        }
+        if( perceptionFrame.has_profile )
+        {
+            mObstacleProfile = perceptionFrame.profile;
+            mHasObstacleProfile = true;
+            mChangedInputs |= ObstacleProfileField;
+        }
+        const TargetList& targetList = perceptionFrame.targets;
+        pickTargets( targetList );
+        mNewRoverStatus.targetCapture().timeUs = targetList.capture_time_us;
+        mNewRoverStatus.targetCapture().frameSeq = targetList.frame_seq;
+        mChangedInputs |= TargetField;
+    }
+    expireTargets();
+    if( mPlannerScaleInput.version() != mPlannerScaleVersion )
+    {
+        mObstacleAvoidanceStateMachine->setPlannerScale( mPlannerScaleInput.get( &mPlannerScaleVersion ) );
+    }
+    if( mDetectionTimingInput.version() != mDetectionTimingVersion )
+    {
+        updateDetectionRate();
+    }
+
+    // The newest of the copied messages is what a state change in this
+    // run is traced back to.
+    static const pair<unsigned, TraceInput> tracedFields[] = {
+        { AutonStateField, TraceInput::AutonState },
+        { CourseField, TraceInput::Course },
+        { OdometryField, TraceInput::Odometry },
+        { ObstacleField | ObstacleProfileField | TargetField, TraceInput::PerceptionFrame }
+    };
+    mRunTrigger = TraceInput::None;
+    for( const auto& traced : tracedFields )
+    {
+        const int64_t arrival = mInputArrivalUs[ static_cast<size_t>( traced.second ) ];
+        if( ( mChangedInputs & traced.first ) &&
+            ( mRunTrigger == TraceInput::None || arrival > mRunTriggerArrivalUs ) )
+        {
+            mRunTrigger = traced.second;
+            mRunTriggerArrivalUs = arrival;
+        }
+    }
+    mRover->updateRover( mNewRoverStatus, mChangedInputs );
+    if( ( mChangedInputs & TargetField ) && mRover->roverStatus().autonState().is_auton )
+    {
+        mGateStateMachine->observePosts();
+    }
+    if( mChangedInputs & ( ObstacleField | ObstacleProfileField ) )
+    {
+        updateCostmap();
+    }
+    mChangedInputs = 0;
+} // updateRoverFromInputs()
+
+// Sets the two targets the states drive by from every tag perception is
+// tracking. The tag the rover is looking for comes first: the gate's
+// posts while in a gate state, or the search point's tag. The rest are
+// ranked by how recently they were seen and then how near they are.
+// In gate states the two are ordered left to right, the way perception
+// orders them, since the gate states compare their bearings. Perception
+// that only sends the two targets has them used as they are.
+void StateMachine::pickTargets( const TargetList& targetList )
+{
+    mNewRoverStatus.tags().assign( targetList.tags.begin(), targetList.tags.end() );
+    if( targetList.num_tags <= 0 )
+    {
+        mNewRoverStatus.target() = targetList.targetList[ 0 ];
+        mNewRoverStatus.target2() = targetList.targetList[ 1 ];
+        return;
+    }
+
+    Rover::RoverStatus& roverStatus = mRover->roverStatus();
+    const int state = static_cast<int>( roverStatus.currentState() );
+    const bool inGate = state >= static_cast<int>( NavState::GateSpin ) &&
+                        state <= static_cast<int>( NavState::GateTrajectory );
+    vector<int> wanted;
+    if( inGate )
+    {
+        wanted = { mGateStateMachine->lastKnownPost1.id, mGateStateMachine->lastKnownPost2.id };
+    }
+    else if( !roverStatus.path().empty() && roverStatus.path().front().search )
+    {
+        wanted = { roverStatus.path().front().id };
+    }
+    const auto rank = [&wanted]( const DetectedTag& tag )
+    {
+        return static_cast<size_t>( find( wanted.begin(), wanted.end(), tag.id ) - wanted.begin() );
+    };
+
+    // Nav can only drive to tags that were ranged.
+    vector<const DetectedTag*> candidates;
+    for( const DetectedTag& tag : targetList.tags )
+    {
+        if( tag.distance >= 0 )
+        {
+            candidates.push_back( &tag );
+        }
+    }
+    const auto better = [&rank]( const DetectedTag* tag1, const DetectedTag* tag2 )
+    {
+        if( rank( *tag1 ) != rank( *tag2 ) )
+        {
+            return rank( *tag1 ) < rank( *tag2 );
+        }
+        if( tag1->missed_frames != tag2->missed_frames )
+        {
+            return tag1->missed_frames < tag2->missed_frames;
+        }
+        return tag1->distance < tag2->distance;
+    };
+    sort( candidates.begin(), candidates.end(), better );
+    if( candidates.size() > 2 )
+    {
+        candidates.resize( 2 );
+    }
+    if( inGate && candidates.size() == 2 && candidates[ 0 ]->bearing > candidates[ 1 ]->bearing )
+    {
+        swap( candidates[ 0 ], candidates[ 1 ] );
+    }
+
+    Target* targets[ 2 ] = { &mNewRoverStatus.target(), &mNewRoverStatus.target2() };
+    for( size_t i = 0; i < 2; ++i )
+    {
+        if( i < candidates.size() )
+        {
+            targets[ i ]->id = candidates[ i ]->id;
+            targets[ i ]->bearing = candidates[ i ]->bearing;
+            targets[ i ]->distance = candidates[ i ]->distance;
+        }
+        else
+        {
+            targets[ i ]->id = -1;
+            targets[ i ]->bearing = -1;
+            targets[ i ]->distance = -1;
+        }
+    }
+} // pickTargets()
+
+// Drops the targets as not seen once the frame they were seen in is
+// older than computerVision.maxDetectionAge, whether or not a new
+// target list came in. Targets without a capture time never expire.
+void StateMachine::expireTargets()
+{
+    const CaptureStamp& capture = mNewRoverStatus.targetCapture();
+    if( capture.timeUs <= 0 )
+    {
+        return;
+    }
+    const int64_t ageUs = chrono::duration_cast<chrono::microseconds>( mNow.time_since_epoch() ).count() - capture.timeUs;
+    if( mChangedInputs & TargetField )
+    {
+        Trace::counter( "target age us", ageUs );
+    }
+
+    const double maxAge = mConfig.computerVision.maxDetectionAge;
+    if( maxAge <= 0 || ageUs <= maxAge * 1e6 )
+    {
+        return;
+    }
+    for( Target* target : { &mNewRoverStatus.target(), &mNewRoverStatus.target2() } )
+    {
+        if( target->distance >= 0 )
+        {
+            target->distance = -1;
+            mChangedInputs |= TargetField;
+        }
+    }
+    for( DetectedTag& tag : mNewRoverStatus.tags() )
+    {
+        if( tag.distance >= 0 )
+        {
+            tag.distance = -1;
+            mChangedInputs |= TargetField;
+        }
+    }
+} // expireTargets()
+
+// Records that the latest message of input arrived now. Only called by
+// the LCM thread.
+void StateMachine::setArrival( const TraceInput input )
+{
+    mInputArrivalUs[ static_cast<size_t>( input ) ] = steadyMicroseconds();
+} // setArrival()
+
+// Adds a change from previousState to state in the current run to the
+// trace, with how long ago the newest input of the run arrived.
+void StateMachine::traceStateChange( const NavState previousState, const NavState state )
+{
+    TraceEntry entry;
+    entry.timeUs = chrono::duration_cast<chrono::microseconds>( mNow.time_since_epoch() ).count();
+    entry.inputAgeUs = mRunTrigger == TraceInput::None ? -1 : steadyMicroseconds() - mRunTriggerArrivalUs;
+    entry.previousState = previousState;
+    entry.state = state;
+    entry.trigger = mRunTrigger;
+    mTrace.record( entry );
+} // traceStateChange()
+
+// Estimates how many frames a second perception runs AR tag detection
+// on from the newest detection timing. Frames are captured at the
+// rate the frame count grows, and detection can't keep up with more
+// frames than one per slow (90th percentile) detection.
+void StateMachine::updateDetectionRate()
+{
+    const DetectionTiming timing = mDetectionTimingInput.get( &mDetectionTimingVersion );
+    const double elapsed = chrono::duration<double>( mNow - mDetectionTimingTime ).count();
+    if( mDetectionTiming.frames > 0 && timing.frames > mDetectionTiming.frames && elapsed > 0 )
+    {
+        mDetectionRate = ( timing.frames - mDetectionTiming.frames ) / elapsed;
+        if( timing.arDetectMs > 0 )
+        {
+            mDetectionRate = min( mDetectionRate, 1000 / timing.arDetectMs );
+        }
+    }
+    mDetectionTiming = timing;
+    mDetectionTimingTime = mNow;
+} // updateDetectionRate()
+
+// Adds the latest obstacle message to the costmap, as seen from the
+// rover's current position. Once perception has sent an obstacle
+// profile, only profiles are used, since the obstacle message only
+// describes one cone.
+void StateMachine::updateCostmap()
+{
+    if( !mRover->roverStatus().autonState().is_auton )
+    {
+        return;
+    }
+    const Odometry& odometry = mRover->roverStatus().odometry();
+    const double visionDistance = mConfig.computerVision.visionDistance;
+    const double fieldOfView = mConfig.computerVision.fieldOfViewAngle;
+    if( mHasObstacleProfile )
+    {
+        if( mChangedInputs & ObstacleProfileField )
+        {
+            mCostmap->update( mRover->localFrame().toLocal( odometry ),
+                              odometry.bearing_deg,
+                              mObstacleProfile,
+                              visionDistance,
+                              fieldOfView );
+        }
+        return;
+    }
+    mCostmap->update( mRover->localFrame().toLocal( odometry ),
+                      odometry.bearing_deg,
+                      mRover->roverStatus().obstacle(),
+                      visionDistance,
+                      fieldOfView );
+} // updateCostmap()
+
+// Marks the ground in front of the rover's camera as seen in the
+// search coverage grid.
+void StateMachine::stampSearchCoverage()
+{
+    if( !mRover->roverStatus().autonState().is_auton )
+    {
+        return;
+    }
+    const Odometry& odometry = mRover->roverStatus().odometry();
+    mSearchCoverage.stamp( mRover->localFrame().toLocal( odometry ),
+                           odometry.bearing_deg,
+                           mConfig.computerVision.visionDistance,
+                           mConfig.computerVision.fieldOfViewAngle );
+} // stampSearchCoverage()
+
+// Returns the search the next change of search algorithms starts, from
+// the search order.
+SearchType StateMachine::nextSearchType() const
+{
+    return searchTypeAt( mConfig.search.order[ mSearchFails % mConfig.search.numSearches ] );
+} // nextSearchType()
+
+// Returns the search type numbered order in search.order.
+SearchType StateMachine::searchTypeAt( const int order )
+{
+    switch( order )
+    {
+        case 1:
+        {
+            return SearchType::LAWNMOWER;
+        }
+        case 2:
+        {
+            return SearchType::SPIRALIN;
+        }
+        default:
+        {
+            return SearchType::SPIRALOUT;
+        }
+    }
+} // searchTypeAt()
+
+// Picks the search and loop distance that are expected to see new
+// ground around the search waypoint fastest, from every search in the
+// order, starting with the next one, at the current loop distance and
+// at half of it. Sets type and visionDistance to what the order would
+// pick and returns false if none of them would see any new ground.
+bool StateMachine::predictSearch( SearchType& type, double& visionDistance )
+{
+    type = nextSearchType();
+    visionDistance = mSearchVisionDistance;
+    const LocalPoint position = mRover->localFrame().toLocal( mRover->roverStatus().odometry() );
+    const LocalPoint waypoint = mRover->localFrame().toLocal( mRover->roverStatus().path().front().odom );
+    mSearchCandidates.clear();
+    for( int i = 0; i < mConfig.search.numSearches; ++i )
+    {
+        const SearchType candidateType =
+            searchTypeAt( mConfig.search.order[ ( mSearchFails + i ) % mConfig.search.numSearches ] );
+        const bool listed = any_of( mSearchCandidates.begin(), mSearchCandidates.end(),
+                                    [candidateType]( const SearchSelector::Candidate& candidate )
+                                    {
+                                        return candidate.type == candidateType;
+                                    } );
+        if( listed )
+        {
+            continue;
+        }
+        // A lawn mower starts around wherever the rover is.
+        const LocalPoint center = candidateType == SearchType::LAWNMOWER ? position : waypoint;
+        mSearchCandidates.push_back( { candidateType, center, mSearchVisionDistance } );
+        if( mSearchVisionDistance > 0.5 )
+        {
+            mSearchCandidates.push_back( { candidateType, center, mSearchVisionDistance * 0.5 } );
+        }
+    }
+
+    SearchSelector::Model model;
+    model.driveSpeed = mConfig.search.driveSpeed;
+    model.turnRate = mConfig.search.turnRate;
+    if( mConfig.search.continuousSpin )
+    {
+        model.spinTime = 360 / mSearchStateMachine->spinRate();
+    }
+    else
+    {
+        const double stepSize = mConfig.search.searchWaitStepSize;
+        model.spinTime = 360 / stepSize * ( mConfig.search.searchWaitTime + stepSize / mConfig.search.turnRate );
+    }
+    model.visionDistance = mConfig.computerVision.visionDistance;
+    model.fieldOfView = mConfig.computerVision.fieldOfViewAngle;
+    model.coveredFraction = mConfig.search.coveredFraction;
+
+    size_t best = 0;
+    if( !mSearchSelector.select( mSearchCandidates, mSearchCoverage, position,
+                                 mRover->roverStatus().odometry().bearing_deg, mConfig.search.bailThresh,
+                                 model, best ) )
+    {
+        return false;
+    }
+    type = mSearchCandidates[ best ].type;
+    visionDistance = mSearchCandidates[ best ].distance;
+    return true;
+} // predictSearch()
+
+// Returns the coverage grid a search at waypoint starts with, covering
+// everything the search can see.
+LegPlanner::Coverage StateMachine::searchCoverage( const Waypoint& waypoint ) const
+{
+    return { mRover->localFrame().toLocal( waypoint.odom ),
+             2 * mConfig.search.bailThresh + mConfig.computerVision.visionDistance,
+             mConfig.search.coverageCellSize };
+} // searchCoverage()
+
+// Starts the coverage grid of the search at waypoint empty, with the
+// grid the leg planner made for it if there is one.
+void StateMachine::startSearchCoverage( const Waypoint& waypoint )
+{
+    const LegPlanner::Coverage coverage = searchCoverage( waypoint );
+    if( !mLegPlanner.takeCoverage( coverage, mSearchCoverage ) )
+    {
+        mSearchCoverage.reset( coverage.center, coverage.halfWidth, coverage.cellSize );
+    }
+} // startSearchCoverage()
+
+// Asks the leg planner for the next search leg: the first search
+// waypoint of the path the rover isn't already searching at, and the
+// search it will start there with the current search order and loop
+// distance. A lawn mower starts around wherever the rover is when it
+// starts, so only its coverage grid can be planned ahead. Settings that
+// change before the rover gets there are asked for again on the next
+// run, and a plan for old settings is never used.
+void StateMachine::preplanNextLeg()
+{
+    if( !mConfig.search.preplan || !mRover->roverStatus().autonState().is_auton )
+    {
+        return;
+    }
+    const int state = static_cast<int>( mRover->roverStatus().currentState() );
+    const bool atSearch = ( state >= static_cast<int>( NavState::SearchFaceNorth ) &&
+                            state <= static_cast<int>( NavState::DriveToTarget ) ) ||
+                          mRover->roverStatus().currentState() == NavState::SearchTurnAroundObs ||
+                          mRover->roverStatus().currentState() == NavState::SearchDriveAroundObs ||
+                          ( state >= static_cast<int>( NavState::GateSpin ) &&
+                            state <= static_cast<int>( NavState::GateTrajectory ) );
+    const deque<Waypoint>& path = mRover->roverStatus().path();
+    for( size_t i = atSearch ? 1 : 0; i < path.size(); ++i )
+    {
+        if( !path[ i ].search )
+        {
+            continue;
+        }
+        SearchPlan search;
+        search.type = nextSearchType();
+        search.center = mRover->localFrame().toLocal( path[ i ].odom );
+        search.distance = search.type == SearchType::LAWNMOWER ? 0 : mSearchVisionDistance;
+        search.bailThresh = mConfig.search.bailThresh;
+        search.maxGap = 2 * mConfig.computerVision.visionDistance;
+        mLegPlanner.request( search, searchCoverage( path[ i ] ) );
+        return;
+    }
+} // preplanNextLeg()
+
+// Publishes the current navigation state to the nav status lcm channel
+// when it changes, and otherwise only every nav status period so the
+// base station still knows nav is running without flooding the radio
+// at the control rate.
+void StateMachine::publishNavState()
+{
+    const NavState state = mRover->roverStatus().currentState();
+    if( state == mPublishedState &&
+        mCompletedWaypoints == mPublishedCompletedWaypoints &&
+        mTotalWaypoints == mPublishedTotalWaypoints &&
+        std::chrono::duration<double>( mNow - mNavStatusTime ).count() < mConfig.control.navStatusPeriod )
+    {
+        return;
+    }
+    mPublishedState = state;
+    mPublishedCompletedWaypoints = mCompletedWaypoints;
+    mPublishedTotalWaypoints = mTotalWaypoints;
+    mNavStatusTime = mNow;
+
     NavStatus navStatus;
     navStatus.nav_state_name = stringifyNavState();
     navStatus.completed_wps = mCompletedWaypoints;
     navStatus.total_wps = mTotalWaypoints;
-    const string& navStatusChannel = mRoverConfig[ "lcmChannels" ][ "navStatusChannel" ].GetString();
-    mLcmObject.publish( navStatusChannel, &navStatus );
+    mLcmObject.publish( mConfig.lcmChannels.navStatusChannel, &navStatus );
 } // publishNavState()
 
+// Returns the rates perception's workers should run at in state. Off
+// and done leave perception at the rates in its own config.
+NavConfig::PerceptionRates::Rates StateMachine::perceptionRates( const NavState state ) const
+{
+    const int group = static_cast<int>( state );
+    if( group >= 10 && group < 20 )
+    {
+        return mConfig.perceptionRates.drive;
+    }
+    if( group >= 20 && group < 27 )
+    {
+        return mConfig.perceptionRates.search;
+    }
+    if( group >= 30 && group < 40 )
+    {
+        return mConfig.perceptionRates.avoidance;
+    }
+    if( ( group >= 27 && group < 30 ) || ( group >= 40 && group < 50 ) )
+    {
+        return mConfig.perceptionRates.target;
+    }
+    return { -1, -1 };
+} // perceptionRates()
+
+// Asks perception to run its workers at the rates the current state
+// needs, so it spends its time on the tags while searching and on the
+// obstacles while avoiding them. Sent when the rates change and every
+// nav status period otherwise.
+void StateMachine::publishPerceptionRates()
+{
+    const NavConfig::PerceptionRates::Rates rates = perceptionRates( mRover->roverStatus().currentState() );
+    if( rates.arHz == mPublishedRates.arHz &&
+        rates.obstacleHz == mPublishedRates.obstacleHz &&
+        std::chrono::duration<double>( mNow - mPerceptionRatesTime ).count() < mConfig.control.navStatusPeriod )
+    {
+        return;
+    }
+    mPublishedRates = rates;
+    mPerceptionRatesTime = mNow;
+
+    PerceptionRates message;
+    message.ar_hz = rates.arHz;
+    message.obstacle_hz = rates.obstacleHz;
+    // Recording isn't nav's business, it stays at perception's rate.
+    message.record_hz = -1;
+    mLcmObject.publish( mConfig.lcmChannels.perceptionRatesChannel, &message );
+} // publishPerceptionRates()
+
 // Executes the logic for off. If the rover is turned on, it updates
 // the roverStatus. If the course is empty, the rover is done  with
 // the course otherwise it will turn to the first waypoing. Else the
@@ -349,19 +1061,25 @@ NavState StateMachine::executeTurn()
 NavState StateMachine::executeDrive()
 {
     const Waypoint& nextWaypoint = mRover->roverStatus().path().front();
-    double distance = estimateNoneuclid( mRover->roverStatus().odometry(), nextWaypoint.odom );
+    double distance = mRover->localFrame().distance( mRover->roverStatus().odometry(), nextWaypoint.odom );
 
-    if( isObstacleDetected( mRover ) && !isWaypointReachable( distance ) && isObstacleInThreshold( mRover, mRoverConfig ) )
+    if( isObstacleDetected( mRover ) && !isWaypointReachable( distance ) && isObstacleInThreshold( mRover ) )
     {
         mObstacleAvoidanceStateMachine->updateObstacleElements( getOptimalAvoidanceAngle(),
                                                                 getOptimalAvoidanceDistance() );
+        mObstacleAvoidanceStateMachine->updateAvoidanceGoal( mRover->localFrame().toLocal( nextWaypoint.odom ) );
         return NavState::TurnAroundObs;
     }
+    if( mRover->isFollowingPaths() )
+    {
+        return executeFollowCourse();
+    }
     DriveStatus driveStatus = mRover->drive( nextWaypoint.odom );
     if( driveStatus == DriveStatus::Arrived )
     {
         if( nextWaypoint.search )
         {
+            startSearchCoverage( nextWaypoint );
             return NavState::SearchSpin;
         }
         mRover->roverStatus().path().pop_front();
@@ -378,8 +1096,126 @@ NavState StateMachine::executeDrive()
     return NavState::Turn;
 } // executeDrive()
 
-// Gets the string representation of a nav state.
-string StateMachine::stringifyNavState() const
+// Executes the logic for driving the course with pure pursuit. The
+// waypoints up to the next one that starts a search are driven as one
+// path, and waypoints along the way are completed once the rover
+// passes them, so the rover doesn't stop at them.
+NavState StateMachine::executeFollowCourse()
+{
+    PurePursuit& follower = mRover->pathFollower();
+    deque<Waypoint>& path = mRover->roverStatus().path();
+    if( !follower.hasPath() )
+    {
+        vector<LocalPoint> coursePath = { mRover->localFrame().toLocal( mRover->roverStatus().odometry() ) };
+        for( const Waypoint& waypoint : path )
+        {
+            coursePath.push_back( mRover->localFrame().toLocal( waypoint.odom ) );
+            if( waypoint.search || waypoint.gate )
+            {
+                break;
+            }
+        }
+        follower.setPath( coursePath );
+        mPassedWaypoints = 0;
+    }
+
+    DriveStatus driveStatus = mRover->drive( follower );
+
+    // The rover has passed every waypoint before the segment it's on.
+    while( mPassedWaypoints < follower.segment() && path.size() > 1 )
+    {
+        path.pop_front();
+        ++mCompletedWaypoints;
+        ++mPassedWaypoints;
+    }
+
+    if( driveStatus == DriveStatus::Arrived )
+    {
+        const Waypoint& lastWaypoint = path.front();
+        if( lastWaypoint.search )
+        {
+            startSearchCoverage( lastWaypoint );
+            return NavState::SearchSpin;
+        }
+        path.pop_front();
+        ++mCompletedWaypoints;
+        return NavState::Turn;
+    }
+    if( driveStatus == DriveStatus::OffCourse )
+    {
+        mRover->turn( follower.target() );
+    }
+    return NavState::Drive;
+} // executeFollowCourse()
+
+// Executes the logic for changing search algorithms. Starts the next
+// search in the search order around the current search waypoint, with
+// the loops of every other search half as far apart.
+NavState StateMachine::executeChangeSearchAlg()
+{
+    if( mConfig.search.predictSelection )
+    {
+        SearchType type;
+        // Everything every search would see has been seen already, so
+        // forget the coverage and look at it all again.
+        if( !predictSearch( type, mSearchVisionDistance ) )
+        {
+            mSearchCoverage.clear();
+            predictSearch( type, mSearchVisionDistance );
+        }
+        setSearcher( type );
+    }
+    else
+    {
+        setSearcher( nextSearchType() );
+    }
+    mSearchStateMachine->initializeSearch( mRover, mRoverConfig, mSearchVisionDistance );
+    // Everything the search would visit has been seen already,
+    // so forget the coverage and look at it all again.
+    if( !mSearchStateMachine->hasSearchPoint() )
+    {
+        mSearchCoverage.clear();
+        mSearchStateMachine->initializeSearch( mRover, mRoverConfig, mSearchVisionDistance );
+    }
+    // The order halves the loop distance after every other search,
+    // predicting picks it.
+    if( !mConfig.search.predictSelection && mSearchFails % 2 == 1 && mSearchVisionDistance > 0.5 )
+    {
+        mSearchVisionDistance *= 0.5;
+    }
+    mSearchFails += 1;
+    return NavState::SearchTurn;
+} // executeChangeSearchAlg()
+
+// Executes the logic for a state the state machine doesn't know, which
+// can only happen if the state was corrupted, so nav exits.
+NavState StateMachine::executeUnknown()
+{
+    cerr << "Entered unknown state.\n";
+    exit( 1 );
+} // executeUnknown()
+
+// Runs the current search through one iteration.
+NavState StateMachine::runSearch()
+{
+    return mSearchStateMachine->run();
+} // runSearch()
+
+// Runs the gate search through one iteration.
+NavState StateMachine::runGateSearch()
+{
+    return mGateStateMachine->run();
+} // runGateSearch()
+
+// Runs the obstacle avoidance through one iteration.
+NavState StateMachine::runObstacleAvoidance()
+{
+    return mObstacleAvoidanceStateMachine->run();
+} // runObstacleAvoidance()
+
+// Gets the string representation of a nav state. The names are built
+// once and returned by reference.
+const string& StateMachine::stringifyNavState() const
 {
     static const map<NavState, std::string> navStateNames =
         {
@@ -409,6 +1245,7 @@ string StateMachine::stringifyNavState() const
             { NavState::GateFace, "Gate Face" },
             { NavState::GateShimmy, "Gate Shimmy" },
             { NavState::GateDriveThrough, "Gate Drive Through" },
+            { NavState::GateTrajectory, "Gate Trajectory" },
          
             { NavState::Unknown, "Unknown" }
         };
@@ -425,12 +1262,12 @@ double StateMachine::getOptimalAvoidanceAngle() const
 // Returns the optimal angle to avoid the detected obstacle.
 double StateMachine::getOptimalAvoidanceDistance() const
 {
-    return mRover->roverStatus().obstacle().distance + mRoverConfig[ "navThresholds" ][ "waypointDistance" ].GetDouble();
+    return mRover->roverStatus().obstacle().distance + mConfig.navThresholds.waypointDistance;
 } // optimalAvoidanceAngle()
 
 bool StateMachine::isWaypointReachable( double distance )
 {
-    return isLocationReachable( mRover, mRoverConfig, distance, mRoverConfig["navThresholds"]["waypointDistance"].GetDouble());
+    return isLocationReachable( mRover, distance, mConfig.navThresholds.waypointDistance );
 } // isWaypointReachable
 
 
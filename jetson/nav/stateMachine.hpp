@@ -1,12 +1,35 @@
 #ifndef STATE_MACHINE_HPP
 #define STATE_MACHINE_HPP
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <lcm/lcm-cpp.hpp>
 #include "rapidjson/document.h"
+#include "rover_msgs/NavConfigValue.hpp"
+#include "rover_msgs/PerceptionFrame.hpp"
+#include "rover_msgs/PerceptionLatency.hpp"
+#include "rover_msgs/PIDConstants.hpp"
+#include "rover_msgs/VisualOdometry.hpp"
+#include "rover_msgs/WorkloadGovernor.hpp"
+#include "inPlace.hpp"
+#include "latencyTest.hpp"
+#include "legPlanner.hpp"
+#include "navConfig.hpp"
+#include "stateTrace.hpp"
 #include "rover.hpp"
-#include "search/searchStateMachine.hpp"
-#include "gate_search/gateStateMachine.hpp"
+#include "thor.hpp"
+#include "visualOdometry.hpp"
+#include "search/spiralOutSearch.hpp"
+#include "search/lawnMowerSearch.hpp"
+#include "search/spiralInSearch.hpp"
+#include "search/coverageGrid.hpp"
+#include "search/searchSelector.hpp"
+#include "gate_search/diamondGateSearch.hpp"
 #include "obstacle_avoidance/simpleAvoidance.hpp"
+#include "obstacle_avoidance/costmapAvoidance.hpp"
+#include "obstacle_avoidance/dynamicWindowAvoidance.hpp"
+#include "obstacle_avoidance/localCostmap.hpp"
 
 using namespace std;
 using namespace rover_msgs;
@@ -25,17 +48,39 @@ public:
 
     void run( );
 
+    void run( std::chrono::steady_clock::time_point now );
+
+    bool reloadConfig();
+
+    bool dumpTrace();
+
+    void updateConfig( NavConfigValue value );
+
+    void updateConfig( PIDConstants constants );
+
+    std::chrono::steady_clock::time_point now() const;
+
+    std::chrono::microseconds controlPeriod() const;
+
+    void waitForInput( std::chrono::steady_clock::time_point deadline );
+
+    double detectionRate() const;
+
     void updateRoverStatus( AutonState autonState );
 
     void updateRoverStatus( Bearing bearing );
 
     void updateRoverStatus( Course course );
 
-    void updateRoverStatus( Obstacle obstacle );
+    void updateRoverStatus( const Odometry& odometry );
 
-    void updateRoverStatus( Odometry odometry );
+    void updateRoverStatus( const PerceptionFrame& perceptionFrame );
 
-    void updateRoverStatus( TargetList targetList );
+    void updateRoverStatus( const PerceptionLatency& perceptionLatency );
+
+    void updateRoverStatus( const VisualOdometry& visualOdometry );
+
+    void updateRoverStatus( const WorkloadGovernor& governor );
     void updateCompletedPoints( );
 
     void updateObstacleAngle( double bearing );
@@ -44,7 +89,9 @@ public:
 
     void updateObstacleElements( double bearing, double distance );
 
-    void setSearcher(SearchType type, Rover* rover, const rapidjson::Document& roverConfig );
+    void updateAvoidanceGoal( const LocalPoint& goal );
+
+    void setSearcher( SearchType type );
 
     /*************************************************************************/
     /* Public Member Variables */
@@ -52,13 +99,72 @@ public:
     // Gate State Machine instance
     GateStateMachine* mGateStateMachine;
 
+    // Ground the camera has seen around the current search waypoint.
+    // This is kept here so that it lasts across search algorithms.
+    CoverageGrid mSearchCoverage;
+
+    // Plans the next search leg while the rover drives to it.
+    LegPlanner mLegPlanner;
+
+    // Obstacles seen around the rover, used by obstacle avoidance.
+    LocalCostmap* mCostmap;
+
 private:
+    // The parts of a perception latency message that the AR tag detection
+    // rate is estimated from.
+    struct DetectionTiming
+    {
+        int64_t frames;
+        double arDetectMs;
+    };
+
+    // Runs one iteration of the state machine in a nav state and returns
+    // the next nav state.
+    typedef NavState ( StateMachine::*StateHandler )();
+
+    // Handlers indexed by the value of the nav state they run.
+    typedef std::array<StateHandler, static_cast<size_t>( NavState::Unknown ) + 1> StateHandlers;
+
     /*************************************************************************/
     /* Private Member Functions */
     /*************************************************************************/
-    bool isRoverReady() const;
+    void updateRoverFromInputs();
+
+    void updateDetectionRate();
+
+    void pickTargets( const TargetList& targetList );
+
+    void expireTargets();
+
+    void setArrival( const TraceInput input );
+
+    void traceStateChange( const NavState previousState, const NavState state );
 
-    void publishNavState() const;
+    static const StateHandlers& stateHandlers();
+
+    void updateConfigFromInputs();
+
+    void publishNavState();
+
+    NavConfig::PerceptionRates::Rates perceptionRates( const NavState state ) const;
+
+    void publishPerceptionRates();
+
+    void stampSearchCoverage();
+
+    static SearchType searchTypeAt( const int order );
+
+    SearchType nextSearchType() const;
+
+    bool predictSearch( SearchType& type, double& visionDistance );
+
+    LegPlanner::Coverage searchCoverage( const Waypoint& waypoint ) const;
+
+    void startSearchCoverage( const Waypoint& waypoint );
+
+    void preplanNextLeg();
+
+    void updateCostmap();
 
     NavState executeOff();
 
@@ -68,13 +174,25 @@ private:
 
     NavState executeDrive();
 
+    NavState executeFollowCourse();
+
     NavState executeSearch();
 
+    NavState executeChangeSearchAlg();
+
+    NavState executeUnknown();
+
+    NavState runSearch();
+
+    NavState runGateSearch();
+
+    NavState runObstacleAvoidance();
+
     void initializeSearch();
 
     bool addFourPointsToSearch();
 
-    string stringifyNavState() const;
+    const string& stringifyNavState() const;
 
     double getOptimalAvoidanceAngle() const;
 
@@ -88,14 +206,114 @@ private:
     // Rover object to do basic rover operations in the state machine.
     Rover* mRover;
 
-    // RoverStatus object for updating the rover's status.
+    // RoverStatus object for updating the rover's status. Only used by
+    // the control thread, which fills it from the input mailboxes.
     Rover::RoverStatus mNewRoverStatus;
 
+    // Latest message of every input channel. These are written by the
+    // LCM thread and read by the control thread without locking.
+    Thor::SeqLock<AutonState> mAutonStateInput;
+    Thor::Mailbox<Course> mCourseInput;
+    Thor::SeqLock<Odometry> mOdometryInput;
+    Thor::Mailbox<PerceptionFrame> mPerceptionFrameInput;
+    Thor::SeqLock<DetectionTiming> mDetectionTimingInput;
+    Thor::SeqLock<VisualPose> mVisualPoseInput;
+    Thor::SeqLock<double> mPlannerScaleInput;
+
+    // Adds up every visual odometry message into the pose put in
+    // mVisualPoseInput, only used by the LCM thread.
+    VisualOdometryIntegrator mVisualOdometryIntegrator;
+
+    // Moves the rover's odometry on from the last GPS fix by the visual
+    // pose, only used by the control thread.
+    VisualOdometryFusion mVisualOdometryFusion;
+
+    // Config changes sent over LCM since the last run. They are queued
+    // rather than kept latest-only so that none are lost when several
+    // arrive in one period.
+    Thor::Volatile<vector<NavConfigValue>> mConfigInput;
+
+    // Hash of the last course put in the course mailbox, only used by
+    // the LCM thread.
+    int64_t mLastCourseHash;
+
+    // RoverStatusFields of mNewRoverStatus that changed since they were
+    // last given to the rover.
+    unsigned mChangedInputs;
+
+    // Versions of the inputs last copied into mNewRoverStatus.
+    uint64_t mAutonStateVersion;
+    uint64_t mCourseVersion;
+    uint64_t mOdometryVersion;
+    uint64_t mPerceptionFrameVersion;
+    uint64_t mDetectionTimingVersion;
+    uint64_t mVisualPoseVersion;
+    uint64_t mPlannerScaleVersion;
+
+    // Latest obstacle profile, and whether perception has sent one.
+    // The rover doesn't use the profile, so it's kept out of the rover
+    // status.
+    ObstacleProfile mObstacleProfile;
+    bool mHasObstacleProfile;
+
+    // When the latest message of every traced input arrived, in
+    // microseconds of the steady clock. These are written by the LCM
+    // thread.
+    std::array<std::atomic<int64_t>, static_cast<size_t>( TraceInput::Count )> mInputArrivalUs;
+
+    // The newest input message the current run copied into the rover
+    // status, and when it arrived.
+    TraceInput mRunTrigger;
+    int64_t mRunTriggerArrivalUs;
+
+    // The last state changes, and the file they are written to when
+    // the trace is dumped.
+    StateTrace mTrace;
+    string mTraceFile;
+
+    // The last detection timing perception sent and when it arrived, and
+    // the AR tag detection rate in hertz estimated from the last two, 0
+    // until there are two.
+    DetectionTiming mDetectionTiming;
+    std::chrono::steady_clock::time_point mDetectionTimingTime;
+    double mDetectionRate;
+
+    // The time the current run of the state machine started at.
+    std::chrono::steady_clock::time_point mNow;
+
+    // Number of times the search has been changed at the current search
+    // waypoint, and the distance between the search's loops.
+    int mSearchFails;
+    double mSearchVisionDistance;
+
+    // Number of waypoints of the path being followed that the rover has
+    // already passed and removed from its path.
+    size_t mPassedWaypoints;
+
+    // What the last nav status message said and when it was sent, and
+    // how often it is sent when nothing has changed.
+    NavState mPublishedState;
+    unsigned mPublishedCompletedWaypoints;
+    unsigned mPublishedTotalWaypoints;
+    std::chrono::steady_clock::time_point mNavStatusTime;
+
+    // The perception rates last asked for and when, they are sent again
+    // every nav status period in case perception restarted.
+    NavConfig::PerceptionRates::Rates mPublishedRates;
+    std::chrono::steady_clock::time_point mPerceptionRatesTime;
+
     // Lcm object for sending and recieving messages.
     lcm::LCM& mLcmObject;
 
-    // Configuration file for the rover.
-    rapidjson::Document mRoverConfig;
+    // Injects synthetic perception steps and times the responses, when
+    // latencyTest.mode isn't "off".
+    LatencyTest mLatencyTest;
+
+    // Configuration file for the rover, and the settings parsed out of
+    // it that are read every iteration.
+    string mConfigPath;
+    ConfigFile mRoverConfig;
+    NavConfig mConfig;
 
     // Number of waypoints in course.
     unsigned mTotalWaypoints;
@@ -106,9 +324,26 @@ private:
     // Indicates if the state changed on a given iteration of run.
     bool mStateChanged;
 
+    // Every search, gate search, and obstacle avoidance state machine is
+    // made when nav starts, so changing search algorithms picks one of
+    // these instead of allocating a new one during a run. Only the
+    // configured obstacle avoidance algorithm is constructed.
+    InPlace<SpiralOut> mSpiralOut;
+    InPlace<LawnMower> mLawnMower;
+    InPlace<SpiralIn> mSpiralIn;
+    InPlace<DiamondGateSearch> mDiamondGateSearch;
+    InPlace<SimpleAvoidance> mSimpleAvoidance;
+    InPlace<CostmapAvoidance> mCostmapAvoidance;
+    InPlace<DynamicWindowAvoidance> mDynamicWindowAvoidance;
+
     // Search pointer to control search states
     SearchStateMachine* mSearchStateMachine;
 
+    // Picks the next search when search.selection is "predict", and the
+    // searches it picks from, kept so picking doesn't allocate them.
+    SearchSelector mSearchSelector;
+    vector<SearchSelector::Candidate> mSearchCandidates;
+
     // Avoidance pointer to control obstacle avoidance states
     ObstacleAvoidanceStateMachine* mObstacleAvoidanceStateMachine;
 
@@ -0,0 +1,112 @@
+#include "stateTrace.hpp"
+
+#include <fstream>
+
+namespace
+{
+    // Writes value to file in the rover's byte order.
+    template<typename T>
+    void writeValue( std::ofstream& file, const T value )
+    {
+        file.write( reinterpret_cast<const char*>( &value ), sizeof( value ) );
+    } // writeValue()
+} // namespace
+
+// Returns the name of the input in traces.
+const char* traceInputName( const TraceInput input )
+{
+    static const char* names[] = {
+        "none", "auton_state", "course", "obstacle", "obstacle_profile", "odometry", "target_list",
+        "perception_frame"
+    };
+    if( input >= TraceInput::Count )
+    {
+        return "unknown";
+    }
+    return names[ static_cast<int>( input ) ];
+} // traceInputName()
+
+// Constructs an empty trace that keeps the last state change.
+StateTrace::StateTrace()
+    : mEntries( 1 )
+    , mNext( 0 )
+    , mCount( 0 )
+{
+} // StateTrace()
+
+// Drops every entry and keeps the last length state changes from now
+// on. This allocates, so it's only called when nav starts.
+void StateTrace::setLength( const size_t length )
+{
+    mEntries.assign( length > 0 ? length : 1, TraceEntry() );
+    mNext = 0;
+    mCount = 0;
+} // setLength()
+
+// Adds entry to the trace, replacing the oldest entry if it's full.
+void StateTrace::record( const TraceEntry& entry )
+{
+    mEntries[ mNext ] = entry;
+    mNext = ( mNext + 1 ) % mEntries.size();
+    if( mCount < mEntries.size() )
+    {
+        ++mCount;
+    }
+} // record()
+
+// Returns the number of entries in the trace.
+size_t StateTrace::size() const
+{
+    return mCount;
+} // size()
+
+// Returns the entry at index, where 0 is the oldest entry.
+const TraceEntry& StateTrace::entry( const size_t index ) const
+{
+    return mEntries[ ( mNext + mEntries.size() - mCount + index ) % mEntries.size() ];
+} // entry()
+
+// Writes the trace to the file at path, oldest entry first. The file
+// starts with "NAVTRACE", a uint32 format version of 1, and a uint32
+// entry count. Each entry is an int64 time and input age in
+// microseconds, and a uint8 previous state, state, and trigger. The
+// values are in the rover's byte order, which is little endian.
+// Returns false if the file can't be written.
+bool StateTrace::writeFile( const std::string& path ) const
+{
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    if( !file )
+    {
+        return false;
+    }
+    file.write( "NAVTRACE", 8 );
+    writeValue<uint32_t>( file, 1 );
+    writeValue<uint32_t>( file, mCount );
+    for( size_t i = 0; i < mCount; ++i )
+    {
+        const TraceEntry& traced = entry( i );
+        writeValue<int64_t>( file, traced.timeUs );
+        writeValue<int64_t>( file, traced.inputAgeUs );
+        writeValue<uint8_t>( file, static_cast<uint8_t>( traced.previousState ) );
+        writeValue<uint8_t>( file, static_cast<uint8_t>( traced.state ) );
+        writeValue<uint8_t>( file, static_cast<uint8_t>( traced.trigger ) );
+    }
+    return static_cast<bool>( file );
+} // writeFile()
+
+// Fills message with the trace, oldest entry first.
+void StateTrace::fillMessage( rover_msgs::NavTrace& message ) const
+{
+    message.entries.resize( mCount );
+    for( size_t i = 0; i < mCount; ++i )
+    {
+        const TraceEntry& traced = entry( i );
+        rover_msgs::NavTraceEntry& sent = message.entries[ i ];
+        sent.time_us = traced.timeUs;
+        sent.previous_state = static_cast<int16_t>( traced.previousState );
+        sent.state = static_cast<int16_t>( traced.state );
+        sent.trigger = traceInputName( traced.trigger );
+        sent.input_age_us = traced.inputAgeUs;
+    }
+    message.num_entries = mCount;
+} // fillMessage()
@@ -0,0 +1,73 @@
+#ifndef STATE_TRACE_HPP
+#define STATE_TRACE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "rover_msgs/NavTrace.hpp"
+#include "rover.hpp"
+
+// The input messages a state change can be traced back to.
+enum class TraceInput : uint8_t
+{
+    None = 0,
+    AutonState = 1,
+    Course = 2,
+    // Perception now sends these together as a perception frame, their
+    // numbers are kept so older trace files still read the same.
+    Obstacle = 3,
+    ObstacleProfile = 4,
+    Odometry = 5,
+    TargetList = 6,
+    PerceptionFrame = 7,
+    Count = 8
+};
+
+const char* traceInputName( const TraceInput input );
+
+// One state change of the state machine, and the newest input message
+// the run that made it had.
+struct TraceEntry
+{
+    // Time of the run, and how long before the change the trigger
+    // arrived, in microseconds. The age is -1 if the run had no new
+    // input.
+    int64_t timeUs;
+    int64_t inputAgeUs;
+    NavState previousState;
+    NavState state;
+    TraceInput trigger;
+};
+
+// This class keeps the last state changes of the state machine in a
+// fixed size ring, so recording one never allocates and costs a copy.
+// The ring can be written to a binary file or sent over LCM to find out
+// how long the rover took to react to what it saw.
+class StateTrace
+{
+public:
+    StateTrace();
+
+    void setLength( const size_t length );
+
+    void record( const TraceEntry& entry );
+
+    size_t size() const;
+
+    const TraceEntry& entry( const size_t index ) const;
+
+    bool writeFile( const std::string& path ) const;
+
+    void fillMessage( rover_msgs::NavTrace& message ) const;
+
+private:
+    // The entries, with mNext the index the next entry is written to.
+    std::vector<TraceEntry> mEntries;
+    size_t mNext;
+
+    // Number of entries recorded, up to the length of the ring.
+    size_t mCount;
+};
+
+#endif // STATE_TRACE_HPP
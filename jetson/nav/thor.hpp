@@ -1,3 +0,0 @@
-#pragma once
-
-#include "thor_volatile.hpp"
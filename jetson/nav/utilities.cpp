@@ -48,11 +48,7 @@ double estimateNoneuclid( const Odometry& current, const Odometry& dest )
 // Note this uses the absolute bearing not a bearing relative to the rover.
 Odometry createOdom( const Odometry & current, double bearing, const double distance, Rover * rover )
 {
-    bearing = degreeToRadian( bearing );
-    double latChange = distance * cos( bearing ) * LAT_METER_IN_MINUTES;
-    double lonChange = distance * sin( bearing  ) * rover->longMeterInMinutes();
-    Odometry newOdom = addMinToDegrees( current, latChange, lonChange );
-    return newOdom;
+    return rover->localFrame().offset( current, bearing, distance );
 }
 
 // Caclulates the bearing between the current odometry and the
@@ -126,17 +122,17 @@ void clear( deque<Waypoint>& aDeque )
 // Checks to see if target is reachable before hitting obstacle
 // If the x component of the distance to obstacle is greater than
 // half the width of the rover the obstacle if reachable
-bool isTargetReachable( Rover* rover, const rapidjson::Document& roverConfig )
+bool isTargetReachable( Rover* rover )
 {
     double distToTarget = rover->roverStatus().target().distance;
-    double distThresh = roverConfig["navThresholds"]["targetDistance"].GetDouble();
-    return isLocationReachable( rover, roverConfig, distToTarget, distThresh );
+    double distThresh = rover->config().navThresholds.targetDistance;
+    return isLocationReachable( rover, distToTarget, distThresh );
 } // istargetReachable()
 
 // Returns true if the rover can reach the input location without hitting the obstacle.
 // ASSUMPTION: There is an obstacle detected.
 // ASSUMPTION: The rover is driving straight.
-bool isLocationReachable( Rover* rover, const rapidjson::Document& roverConfig, const double locDist, const double distThresh )
+bool isLocationReachable( Rover* rover, const double locDist, const double distThresh )
 {
     double distToObs = rover->roverStatus().obstacle().distance;
     double bearToObs = rover->roverStatus().obstacle().bearing;
@@ -149,7 +145,7 @@ bool isLocationReachable( Rover* rover, const rapidjson::Document& roverConfig,
     isReachable |= distToObs > locDist - distThresh;
 
     // if obstacle is farther away in "x direction" than rover's width, it's reachable
-    isReachable |= xComponentOfDistToObs > roverConfig["roverMeasurements"]["width"].GetDouble() / 2;
+    isReachable |= xComponentOfDistToObs > rover->config().roverMeasurements.width / 2;
 
     return isReachable;
 } // isLocationReachable()
@@ -161,7 +157,7 @@ bool isObstacleDetected( Rover* rover )
 } // isObstacleDetected()
 
 // Returns true if distance from obstacle is within user-configurable threshold
-bool isObstacleInThreshold( Rover* rover, const rapidjson::Document& roverConfig )
+bool isObstacleInThreshold( Rover* rover )
 {
-    return rover->roverStatus().obstacle().distance <= roverConfig["navThresholds"]["obstacleDistanceThreshold"].GetDouble();
+    return rover->roverStatus().obstacle().distance <= rover->config().navThresholds.obstacleDistanceThreshold;
 } // isObstacleInThreshold()
@@ -32,12 +32,12 @@ void throughZero( double& destinationBearing, const double currentBearing );
 
 void clear( deque<Waypoint>& aDeque );
 
-bool isTargetReachable( Rover* rover, const rapidjson::Document& roverConfig );
+bool isTargetReachable( Rover* rover );
 
-bool isLocationReachable( Rover* rover, const rapidjson::Document& roverConfig, const double locDist, const double distThresh );
+bool isLocationReachable( Rover* rover, const double locDist, const double distThresh );
 
 bool isObstacleDetected( Rover* rover );
 
-bool isObstacleInThreshold( Rover* rover, const rapidjson::Document& roverConfig );
+bool isObstacleInThreshold( Rover* rover );
 
 #endif // NAV_UTILITES
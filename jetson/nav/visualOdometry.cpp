@@ -0,0 +1,91 @@
+#include "visualOdometry.hpp"
+#include "utilities.hpp"
+
+#include <cmath>
+
+// Constructs an integrator at the origin of its frame.
+VisualOdometryIntegrator::VisualOdometryIntegrator()
+    : mStarted( false )
+    , mLastSeq( 0 )
+    , mPose{ 0, 0, 0, 0, 0 }
+{
+} // VisualOdometryIntegrator()
+
+// Adds the rover's motion since the last message, which is in the
+// rover's frame at the start of the motion, to the pose.
+void VisualOdometryIntegrator::add( const VisualOdometry& delta )
+{
+    if( mStarted && delta.seq != mLastSeq + 1 )
+    {
+        ++mPose.gaps;
+    }
+    mStarted = true;
+    mLastSeq = delta.seq;
+
+    const double turn = degreeToRadian( mPose.turnDeg );
+    mPose.right += delta.right_m * cos( turn ) + delta.forward_m * sin( turn );
+    mPose.forward += delta.forward_m * cos( turn ) - delta.right_m * sin( turn );
+    mPose.turnDeg = mod( mPose.turnDeg + delta.turn_deg, 360 );
+    mPose.timeUs = delta.end_time_us;
+} // add()
+
+// Returns true if any message has been added.
+bool VisualOdometryIntegrator::started() const
+{
+    return mStarted;
+} // started()
+
+// Gets the pose the messages so far add up to.
+const VisualPose& VisualOdometryIntegrator::pose() const
+{
+    return mPose;
+} // pose()
+
+// Constructs a fusion without a fix.
+VisualOdometryFusion::VisualOdometryFusion()
+    : mHasFix( false )
+    , mHasAnchor( false )
+    , mFixTimeUs( 0 )
+    , mAnchor{ 0, 0, 0, 0, 0 }
+{
+} // VisualOdometryFusion()
+
+// Starts counting from the GPS fix that arrived at timeUs. The visual
+// pose it is counted from is the first one captured after it.
+void VisualOdometryFusion::fix( const Odometry& odometry, const int64_t timeUs )
+{
+    mFix = odometry;
+    mFixTimeUs = timeUs;
+    mFrame.anchor( odometry );
+    mHasFix = true;
+    mHasAnchor = false;
+} // fix()
+
+// Gets the last fix moved on by the visual motion between it and pose.
+// Returns false if there is no fix to move yet, the fix is more than
+// maxFixAge seconds older than pose, or messages were lost in between.
+bool VisualOdometryFusion::fuse( const VisualPose& pose, const double maxFixAge, Odometry& fused )
+{
+    if( !mHasFix || pose.timeUs <= mFixTimeUs || pose.timeUs - mFixTimeUs > maxFixAge * 1e6 )
+    {
+        return false;
+    }
+    if( !mHasAnchor )
+    {
+        mAnchor = pose;
+        mHasAnchor = true;
+    }
+    if( pose.gaps != mAnchor.gaps )
+    {
+        return false;
+    }
+
+    // The motion since the anchor is in the visual frame, which is
+    // turned from the fix's bearing by the visual heading at the anchor.
+    const double right = pose.right - mAnchor.right;
+    const double forward = pose.forward - mAnchor.forward;
+    const double offBearing = radianToDegree( atan2( right, forward ) ) - mAnchor.turnDeg;
+    fused = mFrame.offset( mFix, mod( mFix.bearing_deg + offBearing, 360 ), hypot( right, forward ) );
+    fused.bearing_deg = mod( mFix.bearing_deg + pose.turnDeg - mAnchor.turnDeg, 360 );
+    return true;
+} // fuse()
@@ -0,0 +1,81 @@
+#ifndef VISUAL_ODOMETRY_HPP
+#define VISUAL_ODOMETRY_HPP
+
+#include <cstdint>
+
+#include "localFrame.hpp"
+#include "rover_msgs/Odometry.hpp"
+#include "rover_msgs/VisualOdometry.hpp"
+
+using namespace rover_msgs;
+
+// Where perception's visual odometry has the rover, in meters right and
+// forward of where the rover was at the first message and in degrees
+// turned clockwise since.
+struct VisualPose
+{
+    double right;
+    double forward;
+    double turnDeg;
+
+    // Capture time of the newest frame, in microseconds of the
+    // monotonic clock.
+    int64_t timeUs;
+
+    // Number of gaps in the messages so far. Poses with different counts
+    // can't be compared, the rover moved uncounted between them.
+    int64_t gaps;
+};
+
+// This class adds up the visual odometry messages into a pose. It is
+// used by the LCM thread, which handles every message, since the
+// control thread only sees the newest input.
+class VisualOdometryIntegrator
+{
+public:
+    VisualOdometryIntegrator();
+
+    void add( const VisualOdometry& delta );
+
+    bool started() const;
+
+    const VisualPose& pose() const;
+
+private:
+    // Whether any message has been added.
+    bool mStarted;
+
+    // Sequence number of the last message added.
+    int64_t mLastSeq;
+
+    VisualPose mPose;
+};
+
+// This class moves the rover's odometry on from its last GPS fix by how
+// far visual odometry says the rover went since, so that drive and turn
+// see the rover move between fixes instead of only at GPS rate.
+class VisualOdometryFusion
+{
+public:
+    VisualOdometryFusion();
+
+    void fix( const Odometry& odometry, const int64_t timeUs );
+
+    bool fuse( const VisualPose& pose, const double maxFixAge, Odometry& fused );
+
+private:
+    // Whether there has been a fix, and whether the visual pose it is
+    // counted from is known yet.
+    bool mHasFix;
+    bool mHasAnchor;
+
+    // The last fix, when it arrived and the frame around it.
+    Odometry mFix;
+    int64_t mFixTimeUs;
+    LocalFrame mFrame;
+
+    // The visual pose when the fix arrived.
+    VisualPose mAnchor;
+};
+
+#endif // VISUAL_ODOMETRY_HPP
@@ -0,0 +1,298 @@
+#include "BusScheduler.h"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <thread>
+
+//Queues request on the bus of its transactions, replacing a queued one of the same command to the same address if coalesce is set
+void BusScheduler::push(BusPriority priority, std::unique_ptr<Request> request, bool coalesce)
+{
+    Bus &bus = buses[request->transactions.front().bus];
+    std::unique_lock<std::mutex> lock(bus.queue_mutex);
+    request->queued_time = std::chrono::steady_clock::now();
+    request->arrival_time = request->queued_time;
+
+    if (coalesce)
+    {
+        const I2CTransaction &transaction = request->transactions.front();
+        for (std::unique_ptr<Request> &queued : bus.queues[priority])
+        {
+            const I2CTransaction &queued_transaction = queued->transactions.front();
+            if (queued->replaceable && queued_transaction.addr == transaction.addr && queued_transaction.cmd == transaction.cmd)
+            {
+                //Take the older command's place in line, so latency still counts from when that one was queued
+                request->queued_time = queued->queued_time;
+                queued = std::move(request);
+                ++bus.stats[priority].replaced;
+                return;
+            }
+        }
+    }
+
+    bus.queues[priority].push_back(std::move(request));
+    lock.unlock();
+    bus.queue_cv.notify_one();
+}
+
+//Queues transactions, one request for each bus they are on, and waits for all of them to finish. Throws IOFailure if any of them fails
+void BusScheduler::wait_for(BusPriority priority, const std::vector<I2CTransaction> &transactions)
+{
+    //Keeping their order on each bus
+    std::map<uint8_t, std::vector<I2CTransaction>> bus_transactions;
+    for (const I2CTransaction &transaction : transactions)
+    {
+        bus_transactions[transaction.bus].push_back(transaction);
+    }
+
+    std::vector<std::promise<bool>> done(bus_transactions.size());
+    std::vector<std::future<bool>> successes;
+    size_t i = 0;
+    for (std::pair<const uint8_t, std::vector<I2CTransaction>> &entry : bus_transactions)
+    {
+        successes.push_back(done[i].get_future());
+
+        //The caller waits, so the transactions can read and write its buffers directly
+        std::unique_ptr<Request> request(new Request());
+        request->transactions = std::move(entry.second);
+        std::promise<bool> *bus_done = &done[i];
+        request->callback = [bus_done](bool succeeded, const uint8_t *) { bus_done->set_value(succeeded); };
+
+        push(priority, std::move(request), false);
+        ++i;
+    }
+
+    //Every bus has to be done with the caller's buffers before it hears about a failure
+    bool success = true;
+    for (std::future<bool> &bus_success : successes)
+    {
+        success = bus_success.get() && success;
+    }
+    if (!success)
+    {
+        throw IOFailure();
+    }
+}
+
+//Prints the latency on bus_number of the last BUS_REPORT_PERIOD if any transaction was slow or expired, then starts over
+void BusScheduler::report(int bus_number)
+{
+    static const char *names[NUM_PRIORITIES] = { "commands", "telemetry" };
+
+    Bus &bus = buses[bus_number];
+    bus.queue_mutex.lock();
+    LatencyStats last[NUM_PRIORITIES];
+    for (int i = 0; i < NUM_PRIORITIES; ++i)
+    {
+        last[i] = bus.stats[i];
+        bus.stats[i] = LatencyStats();
+    }
+    bus.queue_mutex.unlock();
+
+    bool slow = false;
+    for (int i = 0; i < NUM_PRIORITIES; ++i)
+    {
+        slow = slow || last[i].max > BUS_SLOW_LATENCY || last[i].expired > 0;
+    }
+    if (!slow)
+    {
+        return;
+    }
+
+    for (int i = 0; i < NUM_PRIORITIES; ++i)
+    {
+        double mean_ms = last[i].count == 0 ? 0.0 :
+            std::chrono::duration<double, std::milli>(last[i].total).count() / last[i].count;
+        double max_ms = std::chrono::duration<double, std::milli>(last[i].max).count();
+        fprintf(stderr, "i2c-%d %s: %zu sent, %zu replaced, %zu expired, mean latency %.2f ms, max %.2f ms\n",
+                bus_number, names[i], last[i].count, last[i].replaced, last[i].expired, mean_ms, max_ms);
+    }
+}
+
+//Takes the next request to send on bus, dropping expired commands, and sets priority to its queue. Returns nullptr if there is none
+std::unique_ptr<BusScheduler::Request> BusScheduler::pop(Bus &bus, int &priority)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    for (priority = 0; priority < NUM_PRIORITIES; ++priority)
+    {
+        while (!bus.queues[priority].empty())
+        {
+            std::unique_ptr<Request> request = std::move(bus.queues[priority].front());
+            bus.queues[priority].pop_front();
+
+            if (request->replaceable && now - request->arrival_time > BUS_COMMAND_DEADLINE)
+            {
+                ++bus.stats[priority].expired;
+                continue;
+            }
+            return request;
+        }
+    }
+
+    return nullptr;
+}
+
+//Sends request, retrying it as BUS_RETRIES allows. Returns whether it succeeded, and sets failures to the attempts that failed
+bool BusScheduler::send(const Request &request, int &failures)
+{
+    std::chrono::microseconds backoff = BUS_RETRY_BACKOFF;
+
+    for (failures = 0; ; ++failures)
+    {
+        try
+        {
+            I2C::transact_batch(request.transactions);
+            return true;
+        }
+        catch (IOFailure &e)
+        {
+            if (failures == BUS_RETRIES)
+            {
+                ++failures;
+                return false;
+            }
+        }
+
+        std::this_thread::sleep_for(backoff);
+        backoff *= 2;
+    }
+}
+
+//Counts a finished request towards each address it went to
+void BusScheduler::record(const Request &request, bool success, int failures, std::chrono::steady_clock::duration latency)
+{
+    float latency_ms = std::chrono::duration<float, std::milli>(latency).count();
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    for (const I2CTransaction &transaction : request.transactions)
+    {
+        AddressStats &address = address_stats[transaction.addr];
+        ++address.transactions;
+        address.bytes += transaction.write_num + 1 + transaction.read_num;
+
+        //A failed ioctl doesn't say which of its transactions failed, so every attempt that failed counts for each of them
+        address.errors += failures;
+        address.retries += success ? failures : failures - 1;
+
+        if (address.latencies_ms.size() < BUS_LATENCY_SAMPLES)
+        {
+            address.latencies_ms.push_back(latency_ms);
+        }
+        else
+        {
+            address.latencies_ms[address.next_latency] = latency_ms;
+            address.next_latency = (address.next_latency + 1) % BUS_LATENCY_SAMPLES;
+        }
+    }
+}
+
+//Returns the health of the bus to every i2c address it has been used with, ordered by address
+std::vector<BusAddressStats> BusScheduler::get_address_stats()
+{
+    std::vector<BusAddressStats> all_stats;
+    std::vector<float> latencies;
+
+    stats_mutex.lock();
+    for (const std::pair<const uint8_t, AddressStats> &entry : address_stats)
+    {
+        const AddressStats &address = entry.second;
+        all_stats.push_back({ entry.first, address.transactions, address.bytes, address.errors, address.retries, 0.0, 0.0 });
+
+        if (!address.latencies_ms.empty())
+        {
+            latencies = address.latencies_ms;
+
+            std::vector<float>::iterator p50 = latencies.begin() + latencies.size() / 2;
+            std::nth_element(latencies.begin(), p50, latencies.end());
+            all_stats.back().p50_ms = *p50;
+
+            std::vector<float>::iterator p99 = latencies.begin() + latencies.size() * 99 / 100;
+            std::nth_element(latencies.begin(), p99, latencies.end());
+            all_stats.back().p99_ms = *p99;
+        }
+    }
+    stats_mutex.unlock();
+
+    std::sort(all_stats.begin(), all_stats.end(), [](const BusAddressStats &a, const BusAddressStats &b)
+    {
+        return a.address < b.address;
+    });
+    return all_stats;
+}
+
+//Runs the thread of /dev/i2c-<bus_number>, sending its queued requests forever
+void BusScheduler::run(int bus_number)
+{
+    Bus &bus = buses[bus_number];
+    std::chrono::steady_clock::time_point next_report = std::chrono::steady_clock::now() + BUS_REPORT_PERIOD;
+
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(bus.queue_mutex);
+        bus.queue_cv.wait_until(lock, next_report, [&bus]()
+        {
+            return !bus.queues[COMMAND].empty() || !bus.queues[TELEMETRY].empty();
+        });
+
+        int priority;
+        std::unique_ptr<Request> request = pop(bus, priority);
+        lock.unlock();
+
+        if (request)
+        {
+            Trace::Span span(priority == COMMAND ? "i2c command" : "i2c telemetry");
+            int failures;
+            bool success = send(*request, failures);
+
+            std::chrono::steady_clock::duration latency = std::chrono::steady_clock::now() - request->queued_time;
+
+            bus.queue_mutex.lock();
+            ++bus.stats[priority].count;
+            bus.stats[priority].total += latency;
+            bus.stats[priority].max = std::max(bus.stats[priority].max, latency);
+            bus.queue_mutex.unlock();
+            record(*request, success, failures, latency);
+
+            request->callback(success, request->read_buf.data());
+        }
+
+        if (std::chrono::steady_clock::now() >= next_report)
+        {
+            report(bus_number);
+            next_report += BUS_REPORT_PERIOD;
+        }
+    }
+}
+
+//Queues transaction and waits for it to finish. Throws IOFailure if it fails
+void BusScheduler::transact(BusPriority priority, const I2CTransaction &transaction)
+{
+    wait_for(priority, std::vector<I2CTransaction>(1, transaction));
+}
+
+//Queues transactions to be sent in as few bus transactions as possible and waits for them. Throws IOFailure if any of them fails
+void BusScheduler::transact_batch(BusPriority priority, const std::vector<I2CTransaction> &transactions)
+{
+    if (transactions.empty())
+    {
+        return;
+    }
+    wait_for(priority, transactions);
+}
+
+//Queues a command without waiting for it
+void BusScheduler::command(const I2CTransaction &transaction, BusCallback callback)
+{
+    std::unique_ptr<Request> request(new Request());
+
+    memcpy(request->write_buf.data(), transaction.write_buf, transaction.write_num);
+    request->transactions.push_back(transaction);
+    request->transactions.front().write_buf = request->write_buf.data();
+    request->transactions.front().read_buf = request->read_buf.data();
+    request->callback = callback;
+    request->replaceable = true;
+
+    push(COMMAND, std::move(request), true);
+}
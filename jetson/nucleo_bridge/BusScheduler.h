@@ -0,0 +1,155 @@
+#ifndef BUS_SCHEDULER_H
+#define BUS_SCHEDULER_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "I2C.h"
+
+//Latency from being queued to being done above which a transaction is reported as slow
+#define BUS_SLOW_LATENCY std::chrono::milliseconds(20)
+
+//How often the bus thread checks the latency of the last transactions
+#define BUS_REPORT_PERIOD std::chrono::seconds(10)
+
+//Times a failed request is sent again before it fails, waiting BUS_RETRY_BACKOFF before the first retry and twice as long before each next one.
+//The bus stays busy while a request is retried, so these are kept short
+#define BUS_RETRIES 2
+#define BUS_RETRY_BACKOFF std::chrono::microseconds(500)
+
+//Age past which a queued command is stale and dropped instead of sent, a newer one will follow if it's still wanted
+#define BUS_COMMAND_DEADLINE std::chrono::milliseconds(100)
+
+//Order the bus thread serves queued requests in, lowest first
+enum BusPriority
+{
+    COMMAND,
+    TELEMETRY,
+    NUM_PRIORITIES
+};
+
+//Latencies kept for each i2c address, its percentiles are over the latest this many transactions
+#define BUS_LATENCY_SAMPLES 256
+
+//Health of the bus to one i2c address. Counts are since startup
+struct BusAddressStats
+{
+    uint8_t address;
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t retries;
+    double p50_ms;
+    double p99_ms;
+};
+
+//Called on the bus thread once a request is done. success is false if it failed, and read_buf holds what a queued command read
+typedef std::function<void(bool success, const uint8_t *read_buf)> BusCallback;
+
+/*
+BusScheduler owns the i2c buses. Each bus has a thread, started by main.cpp, which is the only one that calls on I2C for it, so transactions from the incoming and outgoing threads never interleave.
+Buses don't wait on each other, so transactions on different buses go out in parallel.
+Requests wait in one queue per priority and bus, so closed loop and open loop commands always go out ahead of telemetry polls.
+A queued command replaces an older one of the same command to the same address that hasn't been sent yet, since only the newest one matters, and commands older than BUS_COMMAND_DEADLINE are dropped.
+Queuing never waits on the bus, so the LCM receive thread stays responsive while the bus is congested.
+*/
+class BusScheduler
+{
+private:
+    struct Request
+    {
+        std::vector<I2CTransaction> transactions;
+
+        //Copies of the bytes written and read by a queued command, since its caller doesn't wait for it
+        std::array<uint8_t, 32> write_buf;
+        std::array<uint8_t, 32> read_buf;
+
+        BusCallback callback;
+
+        //When the request got its place in line, and when the command in it arrived, which differ once a command replaces another
+        std::chrono::steady_clock::time_point queued_time;
+        std::chrono::steady_clock::time_point arrival_time;
+
+        //Only queued commands can be replaced, a caller waiting on a request always gets its answer
+        bool replaceable = false;
+    };
+
+    //Value initialized to all zero
+    struct LatencyStats
+    {
+        size_t count;
+        size_t replaced;
+        size_t expired;
+        std::chrono::steady_clock::duration total;
+        std::chrono::steady_clock::duration max;
+    };
+
+    //The requests waiting for one bus and its latencies, queue_mutex guards the rest
+    struct Bus
+    {
+        std::deque<std::unique_ptr<Request>> queues[NUM_PRIORITIES];
+        std::mutex queue_mutex;
+        std::condition_variable queue_cv;
+        LatencyStats stats[NUM_PRIORITIES];
+    };
+
+    //Indexed by bus number
+    inline static Bus buses[I2C_MAX_BUSES];
+
+    //Counts and the latest latencies of one i2c address
+    struct AddressStats
+    {
+        uint64_t transactions = 0;
+        uint64_t bytes = 0;
+        uint64_t errors = 0;
+        uint64_t retries = 0;
+        std::vector<float> latencies_ms;
+        size_t next_latency = 0;
+    };
+
+    //Guarded by stats_mutex, since every bus thread records to it
+    inline static std::unordered_map<uint8_t, AddressStats> address_stats;
+    inline static std::mutex stats_mutex;
+
+    //Sends request, retrying it as BUS_RETRIES allows. Returns whether it succeeded, and sets failures to the attempts that failed
+    static bool send(const Request &request, int &failures);
+
+    //Counts a finished request towards each address it went to
+    static void record(const Request &request, bool success, int failures, std::chrono::steady_clock::duration latency);
+
+    //Queues request on the bus of its transactions, which all share one, replacing a queued one of the same command to the same address if coalesce is set
+    static void push(BusPriority priority, std::unique_ptr<Request> request, bool coalesce);
+
+    //Takes the next request to send on bus, dropping expired commands, and sets priority to its queue. Returns nullptr if there is none. Needs the bus's queue_mutex
+    static std::unique_ptr<Request> pop(Bus &bus, int &priority);
+
+    //Queues transactions, one request for each bus they are on, and waits for all of them to finish. Throws IOFailure if any of them fails
+    static void wait_for(BusPriority priority, const std::vector<I2CTransaction> &transactions);
+
+    //Prints the latency on bus_number of the last BUS_REPORT_PERIOD if any transaction was slow, then starts over
+    static void report(int bus_number);
+
+public:
+    //Runs the thread of /dev/i2c-<bus_number>, sending its queued requests forever
+    static void run(int bus_number);
+
+    //Queues transaction and waits for it to finish. Throws IOFailure if it fails
+    static void transact(BusPriority priority, const I2CTransaction &transaction);
+
+    //Queues transactions to be sent in as few bus transactions as possible and waits for them. Throws IOFailure if any of them fails
+    static void transact_batch(BusPriority priority, const std::vector<I2CTransaction> &transactions);
+
+    //Returns the health of the bus to every i2c address it has been used with, ordered by address
+    static std::vector<BusAddressStats> get_address_stats();
+
+    //Queues a command without waiting for it. callback is called on the bus thread once the command is done, unless a newer command replaces it or it expires first
+    static void command(const I2CTransaction &transaction, BusCallback callback);
+};
+
+#endif
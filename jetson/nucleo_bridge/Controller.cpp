@@ -1,55 +1,98 @@
 #include "Controller.h"
 
-//Wrapper for I2C transact, autofilling the i2c address of the Controller by using ControllerMap::get_i2c_address()
-void Controller::transact(uint8_t cmd, uint8_t write_num, uint8_t read_num, uint8_t *write_buf, uint8_t *read_buf)
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+//Queues transaction for command()
+void Controller::queue_command(const char *description, const I2CTransaction &transaction)
 {
-    I2C::transact(ControllerMap::get_i2c_address(name), cmd, write_num, read_num, write_buf, read_buf);
+    BusScheduler::command(transaction, [this, description](bool success, const uint8_t *read_buf)
+    {
+        if (!success)
+        {
+            printf("%s failed on %s\n", description, name.c_str());
+            return;
+        }
+
+        Protocol::WithLimitFlags<Protocol::AnglePayload> reading;
+        memcpy(&reading, read_buf, sizeof(reading));
+        record_angle(reading.payload.quad);
+        last_feedback_time = std::chrono::steady_clock::now();
+#ifdef NUCLEO_LIMIT_FLAGS
+        record_limits(reading.limits);
+#endif
+    });
 }
 
-//If this Controller is not live, make it live by configuring the real controller
-void Controller::make_live()
+//Configures the real controller. Throws IOFailure if any of it fails
+void Controller::configure()
 {
-    if (ControllerMap::check_if_live(name))
+    // turn on 
+    transact<Protocol::On>(nullptr, nullptr);
+
+    //sends max percentage speed  
+    Protocol::ConfigPwmPayload pwm = { hardware.speed_max };
+    transact<Protocol::ConfigPwm>(&pwm, nullptr);
+
+    // config kp, ki, pd
+    Protocol::KPayload k = { kP, kI, kD };
+    transact<Protocol::ConfigK>(&k, nullptr);
+
+    // get absolute encoder correction #
+    // not needed for joint F
+
+    Protocol::AnglePayload abs_raw_angle;
+    if (name != "RA_5")
     {
-        return;
+        transact<Protocol::AbsEnc>(nullptr, &abs_raw_angle);
     }
-
-    try
+    else 
     {
-        // turn on 
-        transact(ON, nullptr, nullptr);
-
-        uint8_t buffer[32];
-        //buffer sends max percentage speed  
-        memcpy(buffer, UINT8_POINTER_T(&(hardware.speed_max)), sizeof(hardware.speed_max));
-        transact(CONFIG_PWM, buffer, nullptr);
+        abs_raw_angle.abs = M_PI;
+    }
 
-        // config kp, ki, pd
-        memcpy(buffer, UINT8_POINTER_T(&(kP)), sizeof(kP));
-        memcpy(buffer + 4, UINT8_POINTER_T(&(kI)), sizeof(kI));
-        memcpy(buffer + 8, UINT8_POINTER_T(&(kD)), sizeof(kD));
-        transact(CONFIG_K, buffer, nullptr);
 
-        // get absolute encoder correction #
-        // not needed for joint F
+    // get value in quad counts adjust quadrature encoder 
+    Protocol::AdjustPayload adjusted_quad = { static_cast<int32_t>((abs_raw_angle.abs / (2 * M_PI)) * quad_cpr) };
+    transact<Protocol::Adjust>(&adjusted_quad, nullptr);
 
-        float abs_raw_angle = 0;
-        if (name != "RA_5")
-        {
-            transact(ABS_ENC, nullptr, UINT8_POINTER_T(&(abs_raw_angle)));
-        }
-        else 
-        {
-            abs_raw_angle = M_PI;
-        }
+    negotiate_compact();
+}
 
+//Asks the real controller to take ClosedCompact commands, and sets compact to whether it will
+void Controller::negotiate_compact()
+{
+#ifdef NUCLEO_COMPACT
+    //joint B's angles are radians, the others' quadrature counts
+    float units_per_turn = name == "RA_1" ? 2 * M_PI : quad_cpr;
+    Protocol::CompactConfigPayload scales = { units_per_turn / COMPACT_ANGLE_UNITS, COMPACT_TORQUE_RESOLUTION };
+    Protocol::CompactAckPayload ack = { 0 };
+    try
+    {
+        transact<Protocol::ConfigCompact>(&scales, &ack);
+    }
+    catch (IOFailure &e)
+    {
+        //firmware without compact commands
+        ack.supported = 0;
+    }
+    compact = ack.supported == 1;
+#endif
+}
 
-        // get value in quad counts adjust quadrature encoder 
-        int32_t adjusted_quad = (abs_raw_angle / (2 * M_PI)) * quad_cpr;
-        memcpy(buffer, UINT8_POINTER_T(&(adjusted_quad)), sizeof(adjusted_quad));
-        transact(ADJUST,buffer, nullptr);
+//If this Controller is not live, make it live by configuring the real controller
+void Controller::make_live()
+{
+    if (ControllerMap::check_if_live(this))
+    {
+        return;
+    }
 
-        ControllerMap::make_live(name);
+    try
+    {
+        configure();
+        ControllerMap::make_live(this);
     }
     catch (IOFailure &e)
     {
@@ -61,6 +104,7 @@ void Controller::make_live()
 //Helper function to convert raw angle to radians. Also checks if new angle is close to old angle <depreciated>
 void Controller::record_angle(int32_t raw_angle)
 {
+    last_good_time = std::chrono::steady_clock::now();
     if (name == "RA_1")
     {
         float abs_raw_angle = 0;
@@ -74,6 +118,23 @@ void Controller::record_angle(int32_t raw_angle)
     } 
 }
 
+//Converts an angle read back by ClosedCompact to radians
+void Controller::record_compact_angle(uint16_t raw_angle)
+{
+    last_good_time = std::chrono::steady_clock::now();
+    current_angle = ((raw_angle / COMPACT_ANGLE_UNITS) * 2 * M_PI) - M_PI;
+}
+
+//Records this Controller's limit switch from the limit flags of its nucleo, calling on_limit_change if it changed
+void Controller::record_limits(Protocol::LimitFlagsPayload limits)
+{
+    bool pressed = (limits.pressed >> (i2c_address & 0x0F)) & 1;
+    if (limit_pressed.exchange(pressed) != pressed && on_limit_change)
+    {
+        on_limit_change(this, pressed);
+    }
+}
+
 //Initialize the Controller. Need to know which nucleo and which channel on the nucleo to use
 Controller::Controller(std::string name, std::string type) : name(name), hardware(Hardware(type)){}
 
@@ -84,17 +145,10 @@ void Controller::open_loop(float input)
     {
         make_live();
 
-        uint8_t buffer[4];
-        float speed = hardware.throttle(input);
-        memcpy(buffer, UINT8_POINTER_T(&speed), sizeof(speed));
+        Protocol::OpenPlusPayload speed = { hardware.throttle(input) };
     
-        int32_t raw_angle;
-        transact(OPEN_PLUS, buffer, UINT8_POINTER_T(&raw_angle));
-
-        // handles if joint B 
-        //printf("%s quad angle: %i\n", name.c_str(), raw_angle);
-
-        record_angle(raw_angle);       
+        // the angle it reads back is recorded once the bus thread sends it
+        command<Protocol::OpenPlus>("open loop", &speed);
     }
     catch (IOFailure &e)
     {
@@ -109,27 +163,22 @@ void Controller::closed_loop(float torque, float target)
     {
         make_live();
 
-        float feed_forward = 0; //torque * torque_scale;
-        uint8_t buffer[32];
-        int32_t angle;
-        memcpy(buffer, UINT8_POINTER_T(&feed_forward), sizeof(feed_forward));
+        Protocol::ClosedPayload closed;
+        closed.feed_forward = torque * torque_scale;
 
         // we read values from 0 - 2pi, teleop sends in -pi to pi
         target += M_PI;
         if (name == "RA_1")
         {
-            memcpy(buffer + 4, UINT8_POINTER_T(&target), sizeof(target));
+            closed.setpoint.abs = target;
         }
         else
         {
-            int32_t closed_setpoint = static_cast<int32_t>((target / (2.0 * M_PI)) * quad_cpr);
-            memcpy(buffer + 4, UINT8_POINTER_T(&closed_setpoint), sizeof(closed_setpoint));
+            closed.setpoint.quad = static_cast<int32_t>((target / (2.0 * M_PI)) * quad_cpr);
         }
 
-        transact(CLOSED_PLUS, buffer, UINT8_POINTER_T(&angle));
-
-        // handles if is joint B
-        record_angle(angle);
+        // the angle it reads back is recorded once the bus thread sends it
+        command<Protocol::ClosedPlus>("closed loop", &closed);
     }
     catch (IOFailure &e)
     {
@@ -137,6 +186,42 @@ void Controller::closed_loop(float torque, float target)
     }
 }
 
+//Sends the next num_knots knots of a trajectory, each reached time seconds from now at angle radians moving at velocity radians per second
+void Controller::trajectory(int num_knots, const float *time, const float *angle, const float *velocity)
+{
+    try
+    {
+        make_live();
+
+        Protocol::TrajectoryPayload payload;
+        payload.num_knots = std::max(0, std::min(num_knots, TRAJECTORY_KNOTS));
+        for (int i = 0; i < payload.num_knots; ++i)
+        {
+            Protocol::TrajectoryKnot &knot = payload.knots[i];
+            knot.time_ms = static_cast<uint16_t>(std::min(time[i] * 1000.0f, 65535.0f));
+
+            //Same units as closed_loop(), radians from 0 - 2pi for joint B and quadrature counts for the rest
+            float target = angle[i] + M_PI;
+            if (name == "RA_1")
+            {
+                knot.target.abs = target;
+                knot.velocity = velocity[i];
+            }
+            else
+            {
+                knot.target.quad = static_cast<int32_t>((target / (2.0 * M_PI)) * quad_cpr);
+                knot.velocity = (velocity[i] / (2.0 * M_PI)) * quad_cpr;
+            }
+        }
+
+        command<Protocol::Trajectory>("trajectory", &payload);
+    }
+    catch (IOFailure &e)
+    {
+        printf("trajectory failed on %s\n", name.c_str());
+    }
+}
+
 //Sends a config command with PID inputs
 void Controller::config(float KP, float KI, float KD)
 {
@@ -146,11 +231,8 @@ void Controller::config(float KP, float KI, float KD)
         {
             make_live();
 
-            uint8_t buffer[32];
-            memcpy(buffer, UINT8_POINTER_T(&KP), sizeof(KP));
-            memcpy(buffer + 4, UINT8_POINTER_T(&KI), sizeof(KI));
-            memcpy(buffer + 8, UINT8_POINTER_T(&KD), sizeof(KD));
-            transact(CONFIG_K, buffer, nullptr);
+            Protocol::KPayload k = { KP, KI, KD };
+            transact<Protocol::ConfigK>(&k, nullptr);
         }
         catch (IOFailure &e)
         {
@@ -168,8 +250,8 @@ void Controller::zero()
         {
             make_live();
 
-            int32_t zero = 0;
-            transact(ADJUST, UINT8_POINTER_T(&zero), nullptr);
+            Protocol::AdjustPayload zero = { 0 };
+            transact<Protocol::Adjust>(&zero, nullptr);
         }
         catch (IOFailure &e)
         {
@@ -178,31 +260,272 @@ void Controller::zero()
     }
 }
 
+//Returns the get angle transaction of this Controller, reading the raw angle and the limit flags into reading
+I2CTransaction Controller::angle_transaction(Protocol::WithLimitFlags<Protocol::AnglePayload> *reading)
+{
+    if (name == "RA_1")
+    {
+        return Protocol::with_limit_flags(make_transaction<Protocol::AbsEnc>(nullptr, &reading->payload));
+    }
+    return Protocol::with_limit_flags(make_transaction<Protocol::Quad>(nullptr, &reading->payload));
+}
+
 //Sends a get angle command
 void Controller::angle()
 {
-    if (!ControllerMap::check_if_live(name))
+    if (!ControllerMap::check_if_live(this))
     {
         return;
     }
 
     try
     {
-        int32_t angle;
-        if (name == "RA_1")
+        Protocol::WithLimitFlags<Protocol::AnglePayload> reading;
+        BusScheduler::transact(TELEMETRY, angle_transaction(&reading));
+        
+        // handles if joint B
+        record_angle(reading.payload.quad);
+#ifdef NUCLEO_LIMIT_FLAGS
+        record_limits(reading.limits);
+#endif
+    }
+    catch (IOFailure &e)
+    {
+        printf("angle failed on %s\n", name.c_str());
+    }
+}
+
+//Returns whether this Controller is live and no command has read back its angle in the last FEEDBACK_FRESH_TIME
+bool Controller::needs_poll() const
+{
+    return ControllerMap::check_if_live(this) && std::chrono::steady_clock::now() - last_feedback_time.load() > FEEDBACK_FRESH_TIME;
+}
+
+//Returns whether this Controller is live and its angle hasn't been read in the last STALE_ANGLE_TIME, so current_angle is the last good one
+bool Controller::is_stale() const
+{
+    return ControllerMap::check_if_live(this) && std::chrono::steady_clock::now() - last_good_time.load() > STALE_ANGLE_TIME;
+}
+
+//Sends get angle commands to every Controller in controllers that needs_poll() in a single bus transaction
+void Controller::batch_angle(const std::vector<Controller *> &controllers)
+{
+    std::vector<Controller *> polled;
+    for (Controller *controller : controllers)
+    {
+        if (controller->needs_poll())
         {
-            transact(ABS_ENC, nullptr, UINT8_POINTER_T(&angle));
+            polled.push_back(controller);
         }
-        else 
+    }
+
+    //Each polled Controller has room for a QuadAll read of a whole nucleo, and the limit flags after either read
+    union Reading
+    {
+        Protocol::WithLimitFlags<Protocol::AnglePayload> angle;
+        Protocol::WithLimitFlags<Protocol::QuadAllPayload> all;
+    };
+    std::vector<Reading> readings(polled.size());
+    std::vector<int32_t *> results(polled.size());
+    std::vector<Protocol::LimitFlagsPayload *> limits(polled.size());
+    std::vector<I2CTransaction> transactions;
+
+    //Readings of the nucleos already being read with QuadAll, by bus and i2c address of channel 0
+    std::unordered_map<uint16_t, Protocol::WithLimitFlags<Protocol::QuadAllPayload> *> nucleo_readings;
+
+    for (size_t i = 0; i < polled.size(); ++i)
+    {
+
+#ifdef NUCLEO_READ_ALL
+        //joint B reads its absolute encoder, not quadrature
+        if (polled[i]->name != "RA_1")
         {
-            transact(QUAD, nullptr, UINT8_POINTER_T(&angle));
+            uint8_t address = polled[i]->i2c_address;
+            uint8_t nucleo_address = address & 0xF0;
+            uint16_t nucleo = polled[i]->bus_address(nucleo_address);
+
+            if (nucleo_readings.find(nucleo) == nucleo_readings.end())
+            {
+                nucleo_readings[nucleo] = &readings[i].all;
+                transactions.push_back(Protocol::with_limit_flags(Protocol::transaction<Protocol::QuadAll>(nucleo_address, nullptr, &readings[i].all.payload)));
+                transactions.back().bus = polled[i]->i2c_bus;
+            }
+
+            results[i] = nucleo_readings[nucleo]->payload.quad + (address & 0x0F);
+            limits[i] = &nucleo_readings[nucleo]->limits;
+            continue;
         }
-        
-        // handles if joint B
-        record_angle(angle);
+#endif
+
+        transactions.push_back(polled[i]->angle_transaction(&readings[i].angle));
+        results[i] = &readings[i].angle.payload.quad;
+        limits[i] = &readings[i].angle.limits;
+    }
+
+    if (transactions.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        BusScheduler::transact_batch(TELEMETRY, transactions);
     }
     catch (IOFailure &e)
     {
-        printf("angle failed on %s\n", name.c_str());
+        for (Controller *controller : polled)
+        {
+            controller->angle();
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < polled.size(); ++i)
+    {
+        polled[i]->record_angle(*results[i]);
+#ifdef NUCLEO_LIMIT_FLAGS
+        polled[i]->record_limits(*limits[i]);
+#endif
+    }
+}
+
+//Configures every Controller in controllers and makes it live, in two bus transactions
+void Controller::batch_make_live(const std::vector<Controller *> &controllers)
+{
+    size_t num_controllers = controllers.size();
+    std::vector<Protocol::ConfigPwmPayload> pwm(num_controllers);
+    std::vector<Protocol::KPayload> k(num_controllers);
+    std::vector<Protocol::AnglePayload> abs_raw_angle(num_controllers);
+    std::vector<Protocol::AdjustPayload> adjusted_quad(num_controllers);
+    std::vector<I2CTransaction> transactions;
+
+    try
+    {
+        //Everything configure() sends up to the absolute encoder reads, which the adjustments need back first
+        for (size_t i = 0; i < num_controllers; ++i)
+        {
+            Controller *controller = controllers[i];
+
+            pwm[i] = { controller->hardware.speed_max };
+            k[i] = { controller->kP, controller->kI, controller->kD };
+            transactions.push_back(controller->make_transaction<Protocol::On>(nullptr, nullptr));
+            transactions.push_back(controller->make_transaction<Protocol::ConfigPwm>(&pwm[i], nullptr));
+            transactions.push_back(controller->make_transaction<Protocol::ConfigK>(&k[i], nullptr));
+
+            // not needed for joint F
+            if (controller->name != "RA_5")
+            {
+                transactions.push_back(controller->make_transaction<Protocol::AbsEnc>(nullptr, &abs_raw_angle[i]));
+            }
+            else
+            {
+                abs_raw_angle[i].abs = M_PI;
+            }
+        }
+        BusScheduler::transact_batch(COMMAND, transactions);
+
+        transactions.clear();
+        for (size_t i = 0; i < num_controllers; ++i)
+        {
+            adjusted_quad[i] = { static_cast<int32_t>((abs_raw_angle[i].abs / (2 * M_PI)) * controllers[i]->quad_cpr) };
+            transactions.push_back(controllers[i]->make_transaction<Protocol::Adjust>(&adjusted_quad[i], nullptr));
+        }
+        BusScheduler::transact_batch(COMMAND, transactions);
+    }
+    catch (IOFailure &e)
+    {
+        for (Controller *controller : controllers)
+        {
+            try
+            {
+                controller->configure();
+                ControllerMap::make_live(controller);
+            }
+            catch (IOFailure &e)
+            {
+                printf("warm up failed on %s\n", controller->name.c_str());
+            }
+        }
+        return;
+    }
+
+    //Firmware without compact commands fails them, so each Controller asks on its own
+    for (Controller *controller : controllers)
+    {
+        controller->negotiate_compact();
+        ControllerMap::make_live(controller);
+    }
+}
+
+//Sends closed loop commands to every Controller in controllers, packing the compact ones on each nucleo into one command
+void Controller::batch_closed_loop(const std::vector<Controller *> &controllers, const float *torque, const float *angle)
+{
+    //The compact Controllers of each nucleo, by bus and i2c address of channel 0, in channel order
+    std::map<uint16_t, std::vector<size_t>> nucleos;
+    for (size_t i = 0; i < controllers.size(); ++i)
+    {
+        Controller *controller = controllers[i];
+        if (controller->compact && ControllerMap::check_if_live(controller))
+        {
+            nucleos[controller->bus_address(controller->i2c_address & 0xF0)].push_back(i);
+        }
+        else
+        {
+            controller->closed_loop(torque[i], angle[i]);
+        }
+    }
+
+    for (std::pair<const uint16_t, std::vector<size_t>> &nucleo : nucleos)
+    {
+        std::vector<size_t> &indices = nucleo.second;
+        std::sort(indices.begin(), indices.end(), [&controllers](size_t a, size_t b)
+        {
+            return controllers[a]->i2c_address < controllers[b]->i2c_address;
+        });
+
+        Protocol::ClosedCompactPayload payload;
+        payload.channels = 0;
+        std::vector<Controller *> group;
+        for (size_t n = 0; n < indices.size(); ++n)
+        {
+            size_t i = indices[n];
+            Controller *controller = controllers[i];
+            payload.channels |= 1 << (controller->i2c_address & 0x0F);
+
+            // we read values from 0 - 2pi, teleop sends in -pi to pi
+            float turns = (angle[i] + M_PI) / (2 * M_PI);
+            float feed_forward = torque[i] * controller->torque_scale / COMPACT_TORQUE_RESOLUTION;
+            payload.setpoints[n].setpoint = static_cast<uint16_t>(std::max(0.0f, std::min(turns * COMPACT_ANGLE_UNITS, COMPACT_ANGLE_UNITS - 1)));
+            payload.setpoints[n].feed_forward = static_cast<int16_t>(std::max(-32768.0f, std::min(std::round(feed_forward), 32767.0f)));
+            group.push_back(controller);
+        }
+
+        I2CTransaction transaction = Protocol::with_limit_flags(Protocol::compact_transaction(nucleo.first & 0xFF, &payload, nullptr, group.size()));
+        transaction.bus = nucleo.first >> 8;
+        BusScheduler::command(transaction, [group](bool success, const uint8_t *read_buf)
+        {
+            if (!success)
+            {
+                for (Controller *controller : group)
+                {
+                    printf("compact closed loop failed on %s\n", controller->name.c_str());
+                }
+                return;
+            }
+
+            Protocol::CompactAnglesPayload angles;
+            memcpy(&angles, read_buf, group.size() * sizeof(uint16_t));
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            for (size_t n = 0; n < group.size(); ++n)
+            {
+                group[n]->record_compact_angle(angles.angle[n]);
+                group[n]->last_feedback_time = now;
+#ifdef NUCLEO_LIMIT_FLAGS
+                //The flags follow the angles read back
+                Protocol::LimitFlagsPayload limits = { read_buf[group.size() * sizeof(uint16_t)] };
+                group[n]->record_limits(limits);
+#endif
+            }
+        });
     }
-}
\ No newline at end of file
+}
@@ -6,24 +6,21 @@
 #include <cmath>
 #include <mutex>
 #include <limits>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <functional>
 #include "Hardware.h"
 #include "I2C.h"
+#include "BusScheduler.h"
 #include "ControllerMap.h"
+#include "Protocol.h"
 
-#define OFF         0x00,   0,  0
-#define ON          0x0F,   0,  0
-#define OPEN        0x10,   2,  0
-#define OPEN_PLUS   0x1F,   4,  4
-#define CLOSED      0x20,   8,  0
-#define CLOSED_PLUS 0x2F,   8,  4
-#define CONFIG_PWM  0x30,   2,  0
-#define CONFIG_K    0x3F,   12, 0
-#define QUAD        0x40,   0,  4
-#define ADJUST      0x4F,   4,  0
-#define ABS_ENC     0x50,   0,  4
-#define LIMIT       0x60,   0,  1
-
-#define UINT8_POINTER_T reinterpret_cast<uint8_t *>
+//How long the angle read back by an open or closed loop command stays fresh, telemetry doesn't poll a Controller until then
+#define FEEDBACK_FRESH_TIME std::chrono::milliseconds(200)
+
+//How long a Controller can go without a good angle before current_angle is reported as stale, a few telemetry periods so one failed poll doesn't count
+#define STALE_ANGLE_TIME std::chrono::milliseconds(500)
 
 /*
 Virtual Controllers store information about various controller-specific parameters (such as encoder cpr)
@@ -36,27 +33,100 @@ class Controller
 {
 public:
     float start_angle = 0.0;
+    //Feed forward units per Nm, from "torqueScale" in the controller config
     float torque_scale = 1.0;
     float quad_cpr = std::numeric_limits<float>::infinity();
-    float current_angle = 0.0;
+    //Set by the bus thread when a command answers, and by the outgoing thread when telemetry does
+    std::atomic<float> current_angle{0.0};
     float kP = 0.01;
     float kI = 0.0; 
     float kD = 0.0;
 
     std::string name;
 
+    //Cached by ControllerMap::init() so transactions don't look up the name
+    uint8_t i2c_address = 0;
+
+    //Bus the real controller is on, from "bus" in the controller config. Controllers on different buses can share an i2c address
+    uint8_t i2c_bus = I2C_DEFAULT_BUS;
+
+    //Set by "warmUp" in the controller config. ControllerMap::warm_up() configures the real controller at startup instead of on its first command
+    bool warm_up = false;
+
+    //Whether the real controller agreed to ClosedCompact commands when it was configured. Only ever set when built with -Dcompact=true
+    std::atomic<bool> compact{false};
+
+    //When an open or closed loop command last read back the angle, set by the bus thread
+    std::atomic<std::chrono::steady_clock::time_point> last_feedback_time{std::chrono::steady_clock::time_point()};
+
+    //When any transaction last read back the angle, current_angle keeps that good angle while reads fail
+    std::atomic<std::chrono::steady_clock::time_point> last_good_time{std::chrono::steady_clock::time_point()};
+
     //Helper function to convert raw angle to radians. Also checks if new angle is close to old angle
     void record_angle(int32_t angle);
 
+    //Converts an angle read back by ClosedCompact, in 1/COMPACT_ANGLE_UNITS of a turn, to radians
+    void record_compact_angle(uint16_t angle);
+
+    //Whether the limit switch is pressed, from the limit flags the bus thread and telemetry read back. Only ever set when built with -Dlimit_flags=true
+    std::atomic<bool> limit_pressed{false};
+
+    //Records this Controller's limit switch from the limit flags of its nucleo, calling on_limit_change if it changed
+    void record_limits(Protocol::LimitFlagsPayload limits);
+
+    //Called with a Controller and whether its limit switch is pressed as soon as a transaction reads back that it changed, on whichever thread read it.
+    //Set by LCMHandler::init() before the buses start
+    inline static std::function<void(Controller *, bool)> on_limit_change;
+
 private:
     Hardware hardware;
 
-    //Wrapper for I2C transact, autofilling the i2c address of the Controller by using ControllerMap::get_i2c_address()
-    void transact(uint8_t cmd, uint8_t write_num, uint8_t read_num, uint8_t *writeBuf, uint8_t *read_buf);
+    //Returns the transaction sending Command to this Controller, on its bus
+    template <typename Command>
+    I2CTransaction make_transaction(typename Command::WritePayload *write, typename Command::ReadPayload *read) const
+    {
+        I2CTransaction transaction = Protocol::transaction<Command>(i2c_address, write, read);
+        transaction.bus = i2c_bus;
+        return transaction;
+    }
+
+    //Returns i2c_bus and address together, identifying a real controller (or with a channel 0 address a nucleo) across buses
+    uint16_t bus_address(uint8_t address) const
+    {
+        return (i2c_bus << 8) | address;
+    }
+
+    //Wrapper for BusScheduler transact, autofilling the cached i2c address and bus of the Controller
+    template <typename Command>
+    void transact(typename Command::WritePayload *write, typename Command::ReadPayload *read)
+    {
+        BusScheduler::transact(COMMAND, make_transaction<Command>(write, read));
+    }
+
+    //Queues a Command that reads back the raw angle without waiting for it, replacing the same command to this Controller if it is still queued. description names it in errors.
+    //Open and closed loop command handlers only queue this, so they don't wait on the bus (except the first time, while make_live() configures the controller)
+    template <typename Command>
+    void command(const char *description, typename Command::WritePayload *write)
+    {
+        static_assert(std::is_same<typename Command::ReadPayload, Protocol::AnglePayload>::value, "a command has to read back the angle");
+        queue_command(description, Protocol::with_limit_flags(make_transaction<Command>(write, nullptr)));
+    }
+
+    //Queues transaction for command()
+    void queue_command(const char *description, const I2CTransaction &transaction);
+
+    //Configures the real controller: turns it on, sends its PWM limit and PID gains, and adjusts its quadrature encoder to the absolute encoder. Throws IOFailure if any of it fails
+    void configure();
+
+    //Asks the real controller to take ClosedCompact commands with this Controller's scales, and sets compact to whether it will
+    void negotiate_compact();
 
     //If this Controller is not live, make it live by configuring the real controller
     void make_live();
 
+    //Returns the get angle transaction of this Controller, reading the raw angle and the limit flags into reading
+    I2CTransaction angle_transaction(Protocol::WithLimitFlags<Protocol::AnglePayload> *reading);
+
 public:
     //Initialize the Controller. Need to know which type of hardware to use
     Controller(std::string name, std::string type);
@@ -67,6 +137,10 @@ public:
     //Sends a closed loop command with target angle in radians and optional precalculated torque in Nm
     void closed_loop(float torque, float angle);
 
+    //Sends the next num_knots knots of a trajectory, each reached time seconds from now at angle radians moving at velocity radians per second.
+    //The nucleo interpolates between them, so one command covers several closed loop targets. Needs firmware that answers Trajectory
+    void trajectory(int num_knots, const float *time, const float *angle, const float *velocity);
+
     //Sends a config command with PID inputs
     void config(float KP, float KI, float KD);
 
@@ -75,6 +149,25 @@ public:
 
     //Sends a get angle command
     void angle();
+
+    //Returns whether this Controller is live and no command has read back its angle in the last FEEDBACK_FRESH_TIME
+    bool needs_poll() const;
+
+    //Returns whether this Controller is live and its angle hasn't been read in the last STALE_ANGLE_TIME, so current_angle is the last good one
+    bool is_stale() const;
+
+    //Sends get angle commands to every Controller in controllers that needs_poll() in a single bus transaction.
+    //Built with -Dread_all_channels=true, one QuadAll command reads every quadrature channel of a nucleo instead.
+    //If the bus transaction fails, falls back to angle() on each Controller so one unresponsive nucleo doesn't stop the rest
+    static void batch_angle(const std::vector<Controller *> &controllers);
+
+    //Configures every Controller in controllers and makes it live, in two bus transactions instead of five for each Controller in turn.
+    //If a bus transaction fails, falls back to configuring each Controller on its own so one unresponsive nucleo doesn't stop the rest
+    static void batch_make_live(const std::vector<Controller *> &controllers);
+
+    //Sends closed loop commands to every Controller in controllers, like closed_loop() with torque[i] and angle[i] for controllers[i].
+    //The compact ones on the same nucleo share one ClosedCompact command, which takes 4 bytes a joint instead of 13
+    static void batch_closed_loop(const std::vector<Controller *> &controllers, const float *torque, const float *angle);
 };
 
 #endif
@@ -8,28 +8,19 @@ uint8_t ControllerMap::calculate_i2c_address(uint8_t nucleo, uint8_t channel)
 }
 
 //Helper function to get the path of the config file
-std::string ControllerMap::get_config()
+std::string ControllerMap::get_config_path()
 {
     std::string configPath = getenv("MROVER_CONFIG");
     configPath += "/config_nucleo_bridge/controller_config.json";
-    std::ifstream configFile;
-    configFile.open(configPath);
-    
-    std::string config = "";
-    std::string line;
-    while (configFile >> line)
-    {
-        config += line;
-    }
-
-    return config;
+    return configPath;
 }
 
 //Initialization function
 void ControllerMap::init()
 {
-    rapidjson::Document document;
-    document.Parse(get_config().c_str());
+    ConfigFile document;
+    //A config that can't be read or parsed loads as null, which fails the check below
+    document.load(get_config_path());
 
     rapidjson::Value& root = document;
     assert(root.IsArray());
@@ -50,6 +41,13 @@ void ControllerMap::init()
 
         controllers[name] = new Controller(name, type);
         name_map[name] = calculate_i2c_address(nucleo, channel);
+        controllers[name]->i2c_address = name_map[name];
+
+        if (root[i].HasMember("bus") && root[i]["bus"].IsInt())
+        {
+            assert(root[i]["bus"].GetInt() >= 0 && root[i]["bus"].GetInt() < I2C_MAX_BUSES);
+            controllers[name]->i2c_bus = root[i]["bus"].GetInt();
+        }
 
         if (root[i].HasMember("quadCPR") && root[i]["quadCPR"].IsFloat())
         {
@@ -67,7 +65,15 @@ void ControllerMap::init()
         {
             controllers[name]->kD = root[i]["kD"].GetFloat();
         }
-        printf("Virtual Controller %s of type %s on Nucleo %i channel %i \n", name.c_str(), type.c_str(), nucleo, channel);
+        if (root[i].HasMember("torqueScale") && root[i]["torqueScale"].IsFloat())
+        {
+            controllers[name]->torque_scale = root[i]["torqueScale"].GetFloat();
+        }
+        if (root[i].HasMember("warmUp") && root[i]["warmUp"].IsBool())
+        {
+            controllers[name]->warm_up = root[i]["warmUp"].GetBool();
+        }
+        printf("Virtual Controller %s of type %s on Nucleo %i channel %i bus %i \n", name.c_str(), type.c_str(), nucleo, channel, controllers[name]->i2c_bus);
     }
 }
 
@@ -77,14 +83,65 @@ uint8_t ControllerMap::get_i2c_address(std::string name)
     return name_map[name];
 }
 
+//Returns every bus a virtual controller is on, in order
+std::vector<uint8_t> ControllerMap::get_buses()
+{
+    bool used[I2C_MAX_BUSES] = {};
+    for (const std::pair<const std::string, Controller *> &entry : controllers)
+    {
+        used[entry.second->i2c_bus] = true;
+    }
+
+    std::vector<uint8_t> buses;
+    for (int bus = 0; bus < I2C_MAX_BUSES; ++bus)
+    {
+        if (used[bus])
+        {
+            buses.push_back(bus);
+        }
+    }
+    return buses;
+}
+
 //Returns whether virtual controller name is in the "live" virtual controller to i2c address map
 bool ControllerMap::check_if_live(std::string name)
 {
-    return (name == live_map[get_i2c_address(name)]);
+    return check_if_live(controllers[name]);
 }
 
 //Forces this virtual controller into the i2c address to "live" virtual controller map, replacing any virtual controller already at that i2c address
 void ControllerMap::make_live(std::string name)
 {
-    live_map[get_i2c_address(name)] = name;
+    make_live(controllers[name]);
+}
+
+//Returns whether controller is the "live" virtual controller at its i2c address, without any name lookups
+bool ControllerMap::check_if_live(const Controller *controller)
+{
+    return live_table[controller->i2c_bus][controller->i2c_address] == controller;
+}
+
+//Makes controller the "live" virtual controller at its i2c address, without any name lookups
+void ControllerMap::make_live(Controller *controller)
+{
+    live_table[controller->i2c_bus][controller->i2c_address] = controller;
+}
+
+//Makes every virtual controller with "warmUp" set live, configuring again any that went stale
+void ControllerMap::warm_up()
+{
+    std::vector<Controller *> cold;
+    for (const std::pair<const std::string, Controller *> &entry : controllers)
+    {
+        Controller *controller = entry.second;
+        if (controller->warm_up && (!check_if_live(controller) || controller->is_stale()))
+        {
+            cold.push_back(controller);
+        }
+    }
+
+    if (!cold.empty())
+    {
+        Controller::batch_make_live(cold);
+    }
 }
@@ -4,7 +4,10 @@
 #include <fstream>
 #include <string>
 #include <unordered_map>
-#include "rapidjson/document.h"
+#include <atomic>
+#include <vector>
+#include "config_loader.hpp"
+#include "I2C.h"
 
 //Forward declaration of Controller class for compilation
 class Controller;
@@ -15,14 +18,14 @@ The ControllerMap class creates a hash table of virtual Controller objects from
 class ControllerMap
 {
 private:
-    //Map of i2c_addresses to "live" virtual controllers
-    inline static std::unordered_map<uint8_t, std::string> live_map = std::unordered_map<uint8_t, std::string>();
+    //The "live" virtual controller at each i2c address of each bus, or nullptr. Indexed directly by bus and i2c address, so hot paths don't hash names
+    inline static std::atomic<Controller *> live_table[I2C_MAX_BUSES][256] = {};
     
     //Map of virtual controllers to supposed i2c addresses
     inline static std::unordered_map<std::string, uint8_t> name_map = std::unordered_map<std::string, uint8_t>();
     
     //Helper function to get the path of the config file
-    static std::string get_config();
+    static std::string get_config_path();
 
     //Helper function to calculate an i2c address based off of nucleo # and channel #
     static uint8_t calculate_i2c_address(uint8_t nucleo, uint8_t channel);
@@ -37,11 +40,24 @@ public:
     //Returns supposed i2c address based off of virtual controller name
     static uint8_t get_i2c_address(std::string name);
 
+    //Returns every bus a virtual controller is on, in order
+    static std::vector<uint8_t> get_buses();
+
     //Returns whether virtual controller name is in the i2c address to "live" virtual controller map
     static bool check_if_live(std::string name);
 
     //Forces this virtual controller into the i2c address to "live" virtual controller map, replacing any virtual controller already at that i2c address
     static void make_live(std::string name);
+
+    //Returns whether controller is the "live" virtual controller at its i2c address, without any name lookups
+    static bool check_if_live(const Controller *controller);
+
+    //Makes controller the "live" virtual controller at its i2c address, without any name lookups
+    static void make_live(Controller *controller);
+
+    //Makes every virtual controller with "warmUp" set live, configuring them together so no first command waits on it.
+    //One that is live but went stale is configured again, since its nucleo may have reset. Called at startup and then periodically by LCMHandler
+    static void warm_up();
 };
 
 #endif
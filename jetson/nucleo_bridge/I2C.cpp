@@ -1,51 +1,142 @@
 #include "I2C.h"
 
 #include <cerrno>
+#include <string>
 
-//Abstraction for I2C/Hardware related functions
-void I2C::init()
+LinuxI2C::LinuxI2C()
 {
-    file = open("/dev/i2c-1", O_RDWR);
-    if (file == -1)
+    for (int bus = 0; bus < I2C_MAX_BUSES; ++bus)
     {
-        printf("failed to open i2c bus\n");
-        exit(1);
+        files[bus] = -1;
     }
 }
 
-//Performs an i2c transaction
-void I2C::transact(uint8_t addr, uint8_t cmd, uint8_t writeNum, uint8_t readNum, uint8_t *writeBuf, uint8_t *readBuf)
+bool LinuxI2C::open_bus(uint8_t bus)
+{
+    std::string path = "/dev/i2c-" + std::to_string(bus);
+    files[bus] = open(path.c_str(), O_RDWR);
+    if (files[bus] == -1)
+    {
+        printf("failed to open i2c bus %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LinuxI2C::transfer(uint8_t bus, struct i2c_msg *messages, int num_messages)
 {
-    if (file == -1)
+    if (files[bus] == -1)
     {
         printf("I2C Port never opened");
-        throw IOFailure();
+        return false;
     }
-    uint8_t buffer[32];
 
-    buffer[0] = cmd;
-    memcpy(buffer + 1, writeBuf, writeNum);
+    struct i2c_rdwr_ioctl_data data;
+    data.msgs = messages;
+    data.nmsgs = num_messages;
 
-    ioctl(file, I2C_SLAVE, addr);
+    if (ioctl(files[bus], I2C_RDWR, &data) != num_messages)
+    {
+        fprintf(stderr, "transaction error %d\n", errno);
+        return false;
+    }
+    return true;
+}
 
-    if (writeNum + 1 != 0)
+//Sends every transaction to backend from now on instead of the linux i2c driver. Call before init()
+void I2C::set_backend(I2CBackend *new_backend)
+{
+    backend = new_backend;
+}
+
+//Abstraction for I2C/Hardware related functions, opens I2C_DEFAULT_BUS
+bool I2C::init()
+{
+    return init(std::vector<uint8_t>(1, I2C_DEFAULT_BUS));
+}
+
+//Opens every bus in buses, returns false if one couldn't be opened
+bool I2C::init(const std::vector<uint8_t> &buses)
+{
+    for (uint8_t bus : buses)
     {
-        // errno = 0;
-        if (write(file, buffer, writeNum + 1) != writeNum + 1)
+        if (bus >= I2C_MAX_BUSES || !backend->open_bus(bus))
         {
-            fprintf(stderr, "write error %d\n", errno);
-            throw IOFailure();
+            return false;
         }
     }
-    if (readNum != 0)
+    return true;
+}
+
+//Fills in the messages of transaction, copying cmd and the written bytes into buffer. Returns how many messages it took
+int I2C::fill_messages(const I2CTransaction &transaction, uint8_t *buffer, struct i2c_msg *messages)
+{
+    buffer[0] = transaction.cmd;
+    memcpy(buffer + 1, transaction.write_buf, transaction.write_num);
+
+    messages[0].addr = transaction.addr;
+    messages[0].flags = 0;
+    messages[0].len = transaction.write_num + 1;
+    messages[0].buf = buffer;
+
+    if (transaction.read_num == 0)
     {
-        //errno = 0;
-        if (read(file, buffer, readNum) != readNum)
+        return 1;
+    }
+
+    //The read follows the write with a repeated start, so no other master can get in between
+    messages[1].addr = transaction.addr;
+    messages[1].flags = I2C_M_RD;
+    messages[1].len = transaction.read_num;
+    messages[1].buf = transaction.read_buf;
+    return 2;
+}
+
+//Sends num_messages messages on bus in one transfer of the backend, throws IOFailure if it fails
+void I2C::send_messages(uint8_t bus, struct i2c_msg *messages, int num_messages)
+{
+    if (bus >= I2C_MAX_BUSES || !backend->transfer(bus, messages, num_messages))
+    {
+        throw IOFailure();
+    }
+}
+
+//Performs an i2c transaction
+void I2C::transact(uint8_t addr, uint8_t cmd, uint8_t writeNum, uint8_t readNum, uint8_t *writeBuf, uint8_t *readBuf)
+{
+    I2CTransaction transaction = { addr, cmd, writeNum, readNum, writeBuf, readBuf };
+    transact(transaction);
+}
+
+//Performs an i2c transaction, usually made by Protocol::transaction
+void I2C::transact(const I2CTransaction &transaction)
+{
+    uint8_t buffer[32];
+    struct i2c_msg messages[2];
+
+    send_messages(transaction.bus, messages, fill_messages(transaction, buffer, messages));
+}
+
+//Performs every transaction in as few bus transactions as the driver allows. Throws IOFailure if any of them fails
+void I2C::transact_batch(const std::vector<I2CTransaction> &transactions)
+{
+    //The driver takes at most I2C_RDWR_IOCTL_MAX_MSGS messages at once, and each transaction is up to two
+    const size_t max_transactions = I2C_RDWR_IOCTL_MAX_MSGS / 2;
+    uint8_t buffers[max_transactions][32];
+    struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+
+    size_t start = 0;
+    while (start < transactions.size())
+    {
+        uint8_t bus = transactions[start].bus;
+        int num_messages = 0;
+        size_t end = start;
+        for (; end < transactions.size() && end < start + max_transactions && transactions[end].bus == bus; ++end)
         {
-            fprintf(stderr, "read error %d\n", errno);
-            throw IOFailure();
+            num_messages += fill_messages(transactions[end], buffers[end - start], messages + num_messages);
         }
-    }
 
-    memcpy(readBuf, buffer, readNum);
+        send_messages(bus, messages, num_messages);
+        start = end;
+    }
 }
@@ -3,6 +3,7 @@
 
 #include <sys/ioctl.h>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 #include <fcntl.h>
 #include <exception>
 #include <string.h>
@@ -11,19 +12,89 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <vector>
+
+//Bus of controllers that don't set "bus" in the controller config, /dev/i2c-1
+#define I2C_DEFAULT_BUS 1
+
+//Buses can be /dev/i2c-0 up to one less than this
+#define I2C_MAX_BUSES 8
+
 struct IOFailure : public std::exception {};
 
+//One transaction of a batch. Writes cmd followed by write_num bytes of write_buf, then reads read_num bytes into read_buf after a repeated start, on /dev/i2c-<bus>
+struct I2CTransaction
+{
+    uint8_t addr;
+    uint8_t cmd;
+    uint8_t write_num;
+    uint8_t read_num;
+    uint8_t *write_buf;
+    uint8_t *read_buf;
+    uint8_t bus = I2C_DEFAULT_BUS;
+};
+
+//Where I2C sends its messages. The default is LinuxI2C, SimulatedBus emulates the nucleos for testing without hardware.
+//Called from every bus thread at once, each with its own bus
+class I2CBackend
+{
+public:
+    virtual ~I2CBackend() {}
+
+    //Opens bus, returns false if it can't be used
+    virtual bool open_bus(uint8_t bus) = 0;
+
+    //Sends num_messages messages on bus as one transfer, with repeated starts between them. Returns false if it failed
+    virtual bool transfer(uint8_t bus, struct i2c_msg *messages, int num_messages) = 0;
+};
+
+//Sends messages to /dev/i2c-<bus> with the I2C_RDWR ioctl
+class LinuxI2C : public I2CBackend
+{
+private:
+    //File of each bus, -1 if it isn't open
+    int files[I2C_MAX_BUSES];
+
+public:
+    LinuxI2C();
+
+    bool open_bus(uint8_t bus) override;
+
+    bool transfer(uint8_t bus, struct i2c_msg *messages, int num_messages) override;
+};
+
 class I2C
 {
 private:
-    inline static int file = -1;
+    inline static LinuxI2C linux_i2c;
+
+    //Backend every transaction goes to
+    inline static I2CBackend *backend = &linux_i2c;
+
+    //Fills in the messages of transaction, copying cmd and the written bytes into buffer. Returns how many messages it took
+    static int fill_messages(const I2CTransaction &transaction, uint8_t *buffer, struct i2c_msg *messages);
+
+    //Sends num_messages messages on bus in one transfer of the backend, throws IOFailure if it fails
+    static void send_messages(uint8_t bus, struct i2c_msg *messages, int num_messages);
 
 public:
-    //Abstraction for I2C/Hardware related functions
-    static void init();
+    //Sends every transaction to backend from now on instead of the linux i2c driver. Call before init()
+    static void set_backend(I2CBackend *new_backend);
+
+    //Abstraction for I2C/Hardware related functions, opens I2C_DEFAULT_BUS
+    static bool init();
+
+    //Opens every bus in buses, returns false if one couldn't be opened
+    static bool init(const std::vector<uint8_t> &buses);
 
     //Performs an i2c transaction
     static void transact(uint8_t addr, uint8_t cmd, uint8_t writeNum, uint8_t readNum, uint8_t *writeBuf, uint8_t *readBuf);
+
+    //Performs an i2c transaction, usually made by Protocol::transaction
+    static void transact(const I2CTransaction &transaction);
+
+    //Performs every transaction in as few bus transactions as the driver allows, one ioctl covering only transactions on the same bus. Throws IOFailure if any of them fails
+    static void transact_batch(const std::vector<I2CTransaction> &transactions);
 };
 
 #endif
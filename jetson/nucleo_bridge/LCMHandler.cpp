@@ -1,4 +1,8 @@
 #include "LCMHandler.h"
+#include "config_loader.hpp"
+#include "trace.hpp"
+
+#include <cmath>
 
 //Initialize the lcm bus and subscribe to relevant channels with message handlers defined below
 void LCMHandler::init()
@@ -14,15 +18,49 @@ void LCMHandler::init()
     }
     
     internal_object = new InternalHandler();
+
+    //Look up every Controller the handlers use once
+    for (int i = 0; i < 6; ++i)
+    {
+        ra_joints[i] = ControllerMap::controllers["RA_" + std::to_string(i)];
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        sa_joints[i] = ControllerMap::controllers["SA_" + std::to_string(i)];
+    }
+    hand_finger = ControllerMap::controllers["HAND_FINGER"];
+    hand_grip = ControllerMap::controllers["HAND_GRIP"];
+    foot_claw = ControllerMap::controllers["FOOT_CLAW"];
+    foot_sensor = ControllerMap::controllers["FOOT_SENSOR"];
+    gimbal_pitch = ControllerMap::controllers["GIMBAL_PITCH_0"];
+    gimbal_yaw = ControllerMap::controllers["GIMBAL_YAW_0"];
+    zed_gimbal_yaw = ControllerMap::controllers["ZED_GIMBAL_YAW"];
+
+    //Without a telemetry config every stream keeps its default change filter
+    ConfigFile telemetry_config;
+    if (telemetry_config.load(get_telemetry_config_path()) && telemetry_config.IsObject())
+    {
+        configure_filter(telemetry_config, "ra", ra_filter);
+        configure_filter(telemetry_config, "sa", sa_filter);
+        configure_filter(telemetry_config, "zedGimbal", zed_gimbal_filter);
+    }
+    //Limit events go out from the thread that read them, not on a telemetry schedule
+    Controller::on_limit_change = &LCMHandler::limit_switch_data;
+
+    printf("Position telemetry deadbands RA %f SA %f ZED gimbal %f rad\n", ra_filter.deadband, sa_filter.deadband, zed_gimbal_filter.deadband);
     
     //Subscription to lcm channels 
     lcm_bus->subscribe("/ik_ra_control",        &LCMHandler::InternalHandler::ra_closed_loop_cmd,   internal_object);
+    lcm_bus->subscribe("/ra_closedloop_cmd",    &LCMHandler::InternalHandler::ra_closed_loop_torque_cmd,    internal_object);
     lcm_bus->subscribe("/sa_closedloop_cmd",    &LCMHandler::InternalHandler::sa_closed_loop_cmd,   internal_object);
     lcm_bus->subscribe("/ra_openloop_cmd",      &LCMHandler::InternalHandler::ra_open_loop_cmd,     internal_object);
     lcm_bus->subscribe("/sa_openloop_cmd",      &LCMHandler::InternalHandler::sa_open_loop_cmd,     internal_object);
     lcm_bus->subscribe("/gimbal_openloop_cmd",  &LCMHandler::InternalHandler::gimbal_cmd,           internal_object);
     lcm_bus->subscribe("/hand_openloop_cmd",    &LCMHandler::InternalHandler::hand_openloop_cmd,    internal_object);
     lcm_bus->subscribe("/foot_openloop_cmd",    &LCMHandler::InternalHandler::foot_openloop_cmd,    internal_object);
+#ifdef NUCLEO_TRAJECTORY
+    lcm_bus->subscribe("/ra_trajectory_cmd",    &LCMHandler::InternalHandler::ra_trajectory_cmd,    internal_object);
+#endif
     /*
     The following functions may be reimplemented when IK is tested
     lcmBus->subscribe("/ra_config_cmd",         &LCMHandler::InternalHandler::ra_config_cmd,        internal_object);
@@ -31,6 +69,85 @@ void LCMHandler::init()
     lcm_bus.subscribe("/sa_zero_trigger",       &LCMHandler::InternalHandler::sa_zero_trigger,      internal_object);
     */
     printf("LCM Bus channels subscribed\n");
+
+#ifdef ARM_LINK
+    arm_link = ArmLink::create();
+    if (arm_link)
+    {
+        printf("Arm link created\n");
+    }
+    else
+    {
+        printf("Arm link not created, RA closed loop commands only come over LCM\n");
+    }
+#endif
+}
+
+//Returns the RA joints in order, for the batched Controller functions
+const std::vector<Controller *> &LCMHandler::ra_joint_list()
+{
+    static const std::vector<Controller *> joints(ra_joints, ra_joints + 6);
+    return joints;
+}
+
+//Publishes that controller's limit switch was pressed or released
+void LCMHandler::limit_switch_data(Controller *controller, bool pressed)
+{
+    LimitSwitch msg;
+    msg.name = controller->name;
+    msg.pressed = pressed;
+    lcm_bus->publish("/limit_switch", &msg);
+}
+
+//Helper function to get the path of the telemetry config file
+std::string LCMHandler::get_telemetry_config_path()
+{
+    std::string configPath = getenv("MROVER_CONFIG");
+    configPath += "/config_nucleo_bridge/telemetry_config.json";
+    return configPath;
+}
+
+//Sets filter from the "deadband" and "keepaliveMs" of config's member stream, keeping the defaults it doesn't set
+void LCMHandler::configure_filter(const rapidjson::Value &config, const char *stream, ChangeFilter &filter)
+{
+    if (!config.HasMember(stream) || !config[stream].IsObject())
+    {
+        return;
+    }
+
+    const rapidjson::Value &settings = config[stream];
+    if (settings.HasMember("deadband") && settings["deadband"].IsNumber())
+    {
+        filter.deadband = settings["deadband"].GetFloat();
+    }
+    if (settings.HasMember("keepaliveMs") && settings["keepaliveMs"].IsInt())
+    {
+        filter.keepalive = std::chrono::milliseconds(settings["keepaliveMs"].GetInt());
+    }
+}
+
+//Returns whether to send num_values angles and flags, recording them as the last sent if so
+bool LCMHandler::ChangeFilter::should_send(const float *values, int num_values, int32_t flags)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    //Nothing has been sent yet the first time
+    bool changed = deadband < 0 || last_sent == std::chrono::steady_clock::time_point() || flags != last_flags;
+    for (int i = 0; i < num_values && !changed; ++i)
+    {
+        changed = std::fabs(values[i] - last[i]) > deadband;
+    }
+
+    bool send = changed || moving || now - last_sent >= keepalive;
+    moving = changed;
+    if (send)
+    {
+        std::copy(values, values + num_values, last);
+        last_flags = flags;
+        last_sent = now;
+    }
+    return send;
 }
 
 //Handles a single incoming lcm message    
@@ -39,55 +156,136 @@ void LCMHandler::handle_incoming()
     lcm_bus->handle();
 }
 
-//Decide whether outgoing messages need to be sent, and if so, send them
+//Sleeps until the next telemetry stream is due, then sends every stream that is due
 void LCMHandler::handle_outgoing()
 {
-    //If the last time arm position messages were outputted was over 20 ms ago, get new data from Controllers to be sent
-    std::chrono::duration deadTime = std::chrono::milliseconds(200);
-    if (NOW - last_output_time > deadTime)
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_deadline = std::chrono::steady_clock::time_point::max();
+
+    for (TelemetryStream &stream : streams)
+    {
+        //The first time through, start every stream now
+        if (stream.deadline == std::chrono::steady_clock::time_point())
+        {
+            stream.deadline = now;
+        }
+        next_deadline = std::min(next_deadline, stream.deadline);
+    }
+
+    std::this_thread::sleep_until(next_deadline);
+    now = std::chrono::steady_clock::now();
+
+    //The streams due together go out together, with one send for all their messages
+    lcm::PublishBatch batch(*lcm_bus);
+    for (TelemetryStream &stream : streams)
+    {
+        if (stream.deadline > now)
+        {
+            continue;
+        }
+
+        (internal_object->*stream.send)();
+
+        //Keep to the schedule, unless the stream fell more than a period behind
+        stream.deadline += stream.period;
+        if (stream.deadline < now)
+        {
+            stream.deadline = now + stream.period;
+        }
+    }
+}
+
+#ifdef ARM_LINK
+//Waits up to ARM_LINK_WAIT for a setpoint from the arm link and sends it like a "/ra_closedloop_cmd" message
+bool LCMHandler::handle_arm_link()
+{
+    if (!arm_link)
     {
-        internal_object->refreshAngles();
-        internal_object->sa_pos_data();
+        return false;
+    }
+
+    ArmLinkSetpoint setpoint;
+    if (arm_link->read_setpoint(setpoint, ARM_LINK_WAIT))
+    {
+        Controller::batch_closed_loop(ra_joint_list(), setpoint.torque, setpoint.angle);
         internal_object->ra_pos_data();
     }
+    return true;
 }
+#endif
 
 //The following functions are handlers for the corresponding lcm messages
 void LCMHandler::InternalHandler::ra_closed_loop_cmd(LCM_INPUT, const ArmPosition *msg)
 {
-    ControllerMap::controllers["RA_0"]->closed_loop(0, msg->joint_a);
-    ControllerMap::controllers["RA_1"]->closed_loop(0, msg->joint_b);
-    ControllerMap::controllers["RA_2"]->closed_loop(0, msg->joint_c);
-    ControllerMap::controllers["RA_3"]->closed_loop(0, msg->joint_d);
-    ControllerMap::controllers["RA_4"]->closed_loop(0, msg->joint_e);
-    ControllerMap::controllers["RA_5"]->closed_loop(0, msg->joint_f);
+    float torque[6] = {};
+    float angle[6] = { static_cast<float>(msg->joint_a), static_cast<float>(msg->joint_b), static_cast<float>(msg->joint_c),
+                       static_cast<float>(msg->joint_d), static_cast<float>(msg->joint_e), static_cast<float>(msg->joint_f) };
+    Controller::batch_closed_loop(ra_joint_list(), torque, angle);
+    ra_pos_data();
+}
+
+void LCMHandler::InternalHandler::ra_closed_loop_torque_cmd(LCM_INPUT, const RAClosedLoopCmd *msg)
+{
+    //Ends the trace flow from ra_kinematics, which published this
+    Trace::Span span("ra closed loop cmd");
+    Trace::flowIn(Trace::messageId(receiveBuffer->data, receiveBuffer->data_size));
+    float torque[6];
+    float angle[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        torque[i] = msg->torque[i];
+        angle[i] = msg->angle[i];
+    }
+    Controller::batch_closed_loop(ra_joint_list(), torque, angle);
+    ra_pos_data();
+}
+
+//Each joint's knots go to its nucleo channel in one Trajectory command
+void LCMHandler::InternalHandler::ra_trajectory_cmd(LCM_INPUT, const RATrajectoryCmd *msg)
+{
+    Trace::Span span("ra trajectory cmd");
+    Trace::flowIn(Trace::messageId(receiveBuffer->data, receiveBuffer->data_size));
+    float time[TRAJECTORY_KNOTS];
+    float angle[TRAJECTORY_KNOTS];
+    float velocity[TRAJECTORY_KNOTS];
+    int num_knots = std::max(0, std::min(msg->num_knots, TRAJECTORY_KNOTS));
+    for (int joint = 0; joint < 6; ++joint)
+    {
+        for (int i = 0; i < num_knots; ++i)
+        {
+            time[i] = msg->time[i];
+            angle[i] = msg->angle[joint][i];
+            velocity[i] = msg->velocity[joint][i];
+        }
+        ra_joints[joint]->trajectory(num_knots, time, angle, velocity);
+    }
     ra_pos_data();
 }
 
 void LCMHandler::InternalHandler::sa_closed_loop_cmd(LCM_INPUT, const SAClosedLoopCmd *msg)
 {
-    ControllerMap::controllers["SA_0"]->closed_loop(msg->torque[0], msg->angle[0]);
-    ControllerMap::controllers["SA_1"]->closed_loop(msg->torque[1], msg->angle[1]);
-    ControllerMap::controllers["SA_2"]->closed_loop(msg->torque[2], msg->angle[2]);
+    sa_joints[0]->closed_loop(msg->torque[0], msg->angle[0]);
+    sa_joints[1]->closed_loop(msg->torque[1], msg->angle[1]);
+    sa_joints[2]->closed_loop(msg->torque[2], msg->angle[2]);
     sa_pos_data();
 }
 
 void LCMHandler::InternalHandler::ra_open_loop_cmd(LCM_INPUT, const RAOpenLoopCmd *msg)
 {
-    ControllerMap::controllers["RA_0"]->open_loop(msg->throttle[0]);
-    ControllerMap::controllers["RA_1"]->open_loop(msg->throttle[1]);
-    ControllerMap::controllers["RA_2"]->open_loop(msg->throttle[2]);
-    ControllerMap::controllers["RA_3"]->open_loop(msg->throttle[3]);
-    ControllerMap::controllers["RA_4"]->open_loop(msg->throttle[4]);
-    ControllerMap::controllers["RA_5"]->open_loop(msg->throttle[5]);
+    ra_joints[0]->open_loop(msg->throttle[0]);
+    ra_joints[1]->open_loop(msg->throttle[1]);
+    ra_joints[2]->open_loop(msg->throttle[2]);
+    ra_joints[3]->open_loop(msg->throttle[3]);
+    ra_joints[4]->open_loop(msg->throttle[4]);
+    ra_joints[5]->open_loop(msg->throttle[5]);
     ra_pos_data();
 }
 
 void LCMHandler::InternalHandler::sa_open_loop_cmd(LCM_INPUT, const SAOpenLoopCmd *msg)
 {
-    ControllerMap::controllers["SA_0"]->open_loop(msg->throttle[0]);
-    ControllerMap::controllers["SA_1"]->open_loop(msg->throttle[1]);
-    ControllerMap::controllers["SA_2"]->open_loop(msg->throttle[2]);
+    sa_joints[0]->open_loop(msg->throttle[0]);
+    sa_joints[1]->open_loop(msg->throttle[1]);
+    sa_joints[2]->open_loop(msg->throttle[2]);
     sa_pos_data();
 }
 
@@ -95,94 +293,182 @@ void LCMHandler::InternalHandler::sa_open_loop_cmd(LCM_INPUT, const SAOpenLoopCm
 The following functions may be reimplemented when IK is tested
 void LCMHandler::InternalHandler::ra_config_cmd(LCM_INPUT, const RAConfigCmd *msg)
 {
-    ControllerMap::controllers["RA_0"]->config(msg->Kp[0], msg->Ki[0], msg->Kd[0]);
-    ControllerMap::controllers["RA_1"]->config(msg->Kp[1], msg->Ki[1], msg->Kd[1]);
-    ControllerMap::controllers["RA_2"]->config(msg->Kp[2], msg->Ki[2], msg->Kd[2]);
-    ControllerMap::controllers["RA_3"]->config(msg->Kp[3], msg->Ki[3], msg->Kd[3]);
-    ControllerMap::controllers["RA_4"]->config(msg->Kp[4], msg->Ki[4], msg->Kd[4]);
-    ControllerMap::controllers["RA_5"]->config(msg->Kp[5], msg->Ki[5], msg->Kd[5]);
+    ra_joints[0]->config(msg->Kp[0], msg->Ki[0], msg->Kd[0]);
+    ra_joints[1]->config(msg->Kp[1], msg->Ki[1], msg->Kd[1]);
+    ra_joints[2]->config(msg->Kp[2], msg->Ki[2], msg->Kd[2]);
+    ra_joints[3]->config(msg->Kp[3], msg->Ki[3], msg->Kd[3]);
+    ra_joints[4]->config(msg->Kp[4], msg->Ki[4], msg->Kd[4]);
+    ra_joints[5]->config(msg->Kp[5], msg->Ki[5], msg->Kd[5]);
 }
 
 void LCMHandler::InternalHandler::sa_config_cmd(LCM_INPUT, const SAConfigCmd *msg)
 {
-    ControllerMap::controllers["SA_0"]->config(msg->Kp[0], msg->Ki[0], msg->Kd[0]);
-    ControllerMap::controllers["SA_1"]->config(msg->Kp[1], msg->Ki[1], msg->Kd[1]);
-    ControllerMap::controllers["SA_2"]->config(msg->Kp[2], msg->Ki[2], msg->Kd[2]);
+    sa_joints[0]->config(msg->Kp[0], msg->Ki[0], msg->Kd[0]);
+    sa_joints[1]->config(msg->Kp[1], msg->Ki[1], msg->Kd[1]);
+    sa_joints[2]->config(msg->Kp[2], msg->Ki[2], msg->Kd[2]);
 }
 */
 
 void LCMHandler::InternalHandler::hand_openloop_cmd(LCM_INPUT, const HandCmd *msg)
 {
-    ControllerMap::controllers["HAND_FINGER"]->open_loop(msg->finger);
-    ControllerMap::controllers["HAND_GRIP"]->open_loop(msg->grip);
+    hand_finger->open_loop(msg->finger);
+    hand_grip->open_loop(msg->grip);
 }
 
 void LCMHandler::InternalHandler::gimbal_cmd(LCM_INPUT, const GimbalCmd *msg)
 {
-    ControllerMap::controllers["GIMBAL_PITCH_0"]->open_loop(msg->pitch[0]);
-    ControllerMap::controllers["GIMBAL_YAW_0"]->open_loop(msg->yaw[0]);
+    gimbal_pitch->open_loop(msg->pitch[0]);
+    gimbal_yaw->open_loop(msg->yaw[0]);
+}
+
+void LCMHandler::InternalHandler::ra_telemetry()
+{
+    Controller::batch_angle(ra_joint_list());
+    ra_pos_data();
+}
+
+void LCMHandler::InternalHandler::sa_telemetry()
+{
+    Controller::batch_angle({
+        sa_joints[0],
+        sa_joints[1],
+        sa_joints[2]
+    });
+    sa_pos_data();
+}
+
+void LCMHandler::InternalHandler::zed_gimbal_telemetry()
+{
+    //Nothing to send until the gimbal has been commanded
+    if (!ControllerMap::check_if_live(zed_gimbal_yaw))
+    {
+        return;
+    }
+
+    //Recent commands already read back the angle
+    if (zed_gimbal_yaw->needs_poll())
+    {
+        zed_gimbal_yaw->angle();
+    }
+    zed_gimbal_data();
+}
+
+void LCMHandler::InternalHandler::bus_stats_telemetry()
+{
+    NucleoBusStats msg;
+    for (const BusAddressStats &stats : BusScheduler::get_address_stats())
+    {
+        I2CAddressStats address;
+        address.address = stats.address;
+        address.transactions = stats.transactions;
+        address.bytes = stats.bytes;
+        address.errors = stats.errors;
+        address.retries = stats.retries;
+        address.p50_ms = stats.p50_ms;
+        address.p99_ms = stats.p99_ms;
+        msg.addresses.push_back(address);
+    }
+    msg.num_addresses = msg.addresses.size();
+    lcm_bus->publish("/nucleo_bus_stats", &msg);
 }
 
-void LCMHandler::InternalHandler::refreshAngles()
+void LCMHandler::InternalHandler::warm_up()
 {
-    ControllerMap::controllers["RA_0"]->angle();
-    ControllerMap::controllers["RA_1"]->angle();
-    ControllerMap::controllers["RA_2"]->angle();
-    ControllerMap::controllers["RA_3"]->angle();
-    ControllerMap::controllers["RA_4"]->angle();
-    ControllerMap::controllers["RA_5"]->angle();
-    ControllerMap::controllers["SA_0"]->angle();
-    ControllerMap::controllers["SA_1"]->angle();
-    ControllerMap::controllers["SA_2"]->angle();
+    ControllerMap::warm_up();
 }
 
 void LCMHandler::InternalHandler::ra_pos_data()
 {
+    //Each angle is read once, so the filter sees what is sent
+    float angles[6];
     ArmPosition msg;
-    msg.joint_a = ControllerMap::controllers["RA_0"]->current_angle;
-    msg.joint_b = ControllerMap::controllers["RA_1"]->current_angle;
-    msg.joint_c = ControllerMap::controllers["RA_2"]->current_angle;
-    msg.joint_d = ControllerMap::controllers["RA_3"]->current_angle;
-    msg.joint_e = ControllerMap::controllers["RA_4"]->current_angle;
-    msg.joint_f = ControllerMap::controllers["RA_5"]->current_angle;
-    lcm_bus->publish("/arm_position", &msg);
+    msg.stale_joints = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        angles[i] = ra_joints[i]->current_angle;
+        if (ra_joints[i]->is_stale())
+        {
+            msg.stale_joints |= 1 << i;
+        }
+    }
+    msg.joint_a = angles[0];
+    msg.joint_b = angles[1];
+    msg.joint_c = angles[2];
+    msg.joint_d = angles[3];
+    msg.joint_e = angles[4];
+    msg.joint_f = angles[5];
+    if (ra_filter.should_send(angles, 6, msg.stale_joints))
+    {
+        lcm_bus->publish("/arm_position", &msg);
+    }
 
-    last_output_time = NOW;
+#ifdef ARM_LINK
+    //Also the link's heartbeat, ra_telemetry() sends this every RA_POS_PERIOD. It costs no radio traffic, so it isn't filtered
+    if (arm_link)
+    {
+        ArmLinkFeedback feedback;
+        feedback.angle[0] = msg.joint_a;
+        feedback.angle[1] = msg.joint_b;
+        feedback.angle[2] = msg.joint_c;
+        feedback.angle[3] = msg.joint_d;
+        feedback.angle[4] = msg.joint_e;
+        feedback.angle[5] = msg.joint_f;
+        feedback.stale_joints = msg.stale_joints;
+        std::lock_guard<std::mutex> lock(arm_link_feedback_mutex);
+        arm_link->write_feedback(feedback);
+    }
+#endif
 }
 
 void LCMHandler::InternalHandler::sa_pos_data()
 {
-    SAPosData msg;
-    msg.angle[0] = ControllerMap::controllers["SA_0"]->current_angle;
-    msg.angle[1] = ControllerMap::controllers["SA_1"]->current_angle;
-    msg.angle[2] = ControllerMap::controllers["SA_2"]->current_angle;
-    lcm_bus->publish("/sa_pos_data", &msg);
+    float angles[3] = { sa_joints[0]->current_angle, sa_joints[1]->current_angle, sa_joints[2]->current_angle };
+    if (sa_filter.should_send(angles, 3, 0))
+    {
+        SAPosData msg;
+        msg.angle[0] = angles[0];
+        msg.angle[1] = angles[1];
+        msg.angle[2] = angles[2];
+        lcm_bus->publish("/sa_pos_data", &msg);
+    }
+}
+
+void LCMHandler::InternalHandler::zed_gimbal_data()
+{
+    //current_angle is in radians, the message is in degrees
+    float angle = zed_gimbal_yaw->current_angle;
+    if (!zed_gimbal_filter.should_send(&angle, 1, 0))
+    {
+        return;
+    }
 
-    last_output_time = NOW;
+    ZedGimbalPosition msg;
+    msg.angle = angle * 180.0 / M_PI;
+    lcm_bus->publish("/zed_gimbal_data", &msg);
 }
 
 /*
 The following functions may be reimplemented when IK is tested
 void LCMHandler::InternalHandler::sa_zero_trigger(LCM_INPUT, const SAZeroTrigger *msg)
 {
-    ControllerMap::controllers["SA_0"]->zero();
-    ControllerMap::controllers["SA_1"]->zero();
-    ControllerMap::controllers["SA_2"]->zero();
+    sa_joints[0]->zero();
+    sa_joints[1]->zero();
+    sa_joints[2]->zero();
 }
 
 void LCMHandler::ra_zero_trigger(LCM_INPUT, const RAZeroTrigger *msg)
 {
-    ControllerMap::controllers["RA_0"]->zero();
-    ControllerMap::controllers["RA_1"]->zero();
- 	ControllerMap::controllers["RA_2"]->zero();
- 	ControllerMap::controllers["RA_3"]->zero();
- 	ControllerMap::controllers["RA_4"]->zero();
- 	ControllerMap::controllers["RA_5"]->zero();
+    ra_joints[0]->zero();
+    ra_joints[1]->zero();
+ 	ra_joints[2]->zero();
+ 	ra_joints[3]->zero();
+ 	ra_joints[4]->zero();
+ 	ra_joints[5]->zero();
 }
 */
 
 void LCMHandler::InternalHandler::foot_openloop_cmd(LCM_INPUT, const FootCmd *msg)
 {
-    ControllerMap::controllers["FOOT_CLAW"]->open_loop(msg->claw);
-    ControllerMap::controllers["FOOT_SENSOR"]->open_loop(msg->sensor);
+    foot_claw->open_loop(msg->claw);
+    foot_sensor->open_loop(msg->sensor);
 }
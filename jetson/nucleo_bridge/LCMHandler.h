@@ -9,11 +9,14 @@
 #include <lcm/lcm-cpp.hpp>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include "rapidjson/document.h"
 
 #include <rover_msgs/RAOpenLoopCmd.hpp>
 #include <rover_msgs/SAOpenLoopCmd.hpp>
 #include <rover_msgs/ArmPosition.hpp>
 #include <rover_msgs/SAClosedLoopCmd.hpp>
+#include <rover_msgs/RAClosedLoopCmd.hpp>
 #include <rover_msgs/RAConfigCmd.hpp>
 #include <rover_msgs/SAConfigCmd.hpp>
 #include <rover_msgs/HandCmd.hpp>
@@ -24,21 +27,47 @@
 #include <rover_msgs/FootCmd.hpp>
 #include <rover_msgs/ArmPosition.hpp>
 #include <rover_msgs/ZedGimbalPosition.hpp>
+#include <rover_msgs/NucleoBusStats.hpp>
+#include <rover_msgs/RATrajectoryCmd.hpp>
+#include <rover_msgs/LimitSwitch.hpp>
+
+#ifdef ARM_LINK
+#include <memory>
+#include "arm_link.hpp"
+#endif
 
 #define LCM_INPUT const lcm::ReceiveBuffer *receiveBuffer, const std::string &channel
 #define NOW std::chrono::high_resolution_clock::now()
+
+//Time between telemetry messages of each stream
+#define RA_POS_PERIOD       std::chrono::milliseconds(200)
+#define SA_POS_PERIOD       std::chrono::milliseconds(200)
+#define ZED_GIMBAL_PERIOD   std::chrono::milliseconds(200)
+#define BUS_STATS_PERIOD    std::chrono::milliseconds(1000)
+#define WARM_UP_PERIOD      std::chrono::milliseconds(1000)
+
+//Default change filters of the position messages, which telemetry_config.json can override: the change in
+//radians of any angle that sends a message, and the longest time between messages while nothing changes.
+//RA positions keep coming faster than ra_kinematics' JOINT_ESTIMATOR_MAX_GAP, so its estimates stay fresh
+#define RA_POS_DEADBAND         0.001f
+#define RA_POS_KEEPALIVE        std::chrono::milliseconds(400)
+#define SA_POS_DEADBAND         0.001f
+#define SA_POS_KEEPALIVE        std::chrono::milliseconds(1000)
+#define ZED_GIMBAL_DEADBAND     0.002f
+#define ZED_GIMBAL_KEEPALIVE    std::chrono::milliseconds(1000)
+
+//Longest handle_arm_link() waits for a setpoint
+#define ARM_LINK_WAIT       std::chrono::milliseconds(100)
 using namespace rover_msgs;
 
 /*
 LCMHandler.h is responsible for handling incoming and outgoing lcm messages.
 Incoming lcm messages will trigger functions which call the functions on the appropriate virtual Controllers. 
-Outgoing lcm messages are triggered by a clock, which query the functions on the appropriate virtual Controllers for data.
+Outgoing lcm messages are sent by telemetry streams, each on its own fixed schedule, which query the functions on the appropriate virtual Controllers for data.
 */
 class LCMHandler
 {
 private:
-    inline static std::chrono::high_resolution_clock::time_point last_output_time = NOW;
-
     inline static lcm::LCM *lcm_bus = nullptr;
 
     
@@ -49,6 +78,10 @@ private:
     	//The following functions are handlers for the corresponding lcm messages
         void ra_closed_loop_cmd(LCM_INPUT, const ArmPosition *msg);
 
+        void ra_closed_loop_torque_cmd(LCM_INPUT, const RAClosedLoopCmd *msg);
+
+        void ra_trajectory_cmd(LCM_INPUT, const RATrajectoryCmd *msg);
+
         void sa_closed_loop_cmd(LCM_INPUT, const SAClosedLoopCmd *msg);
 
         void ra_open_loop_cmd(LCM_INPUT, const RAOpenLoopCmd *msg);
@@ -65,15 +98,97 @@ private:
 
         void zed_gimbal_data();
 
-        void refreshAngles();
-
         void ra_pos_data();
 
         void sa_pos_data();
+
+        //The following functions refresh the angles of a telemetry stream's Controllers and send them
+        void ra_telemetry();
+
+        void sa_telemetry();
+
+        void zed_gimbal_telemetry();
+
+        //Publishes the health of the i2c bus to each address
+        void bus_stats_telemetry();
+
+        //Configures the warm up Controllers that aren't live, or went stale and may have lost their config
+        void warm_up();
     };
 
     inline static InternalHandler *internal_object = nullptr;
 
+#ifdef ARM_LINK
+    //Shared memory path from ra_kinematics on the same machine, nullptr if it couldn't be created
+    inline static std::unique_ptr<ArmLink> arm_link;
+
+    //The link takes one writer, and RA positions are sent from the incoming, outgoing and arm link threads
+    inline static std::mutex arm_link_feedback_mutex;
+#endif
+
+    //Handles to the Controllers the handlers use, looked up once by init() so no handler hashes a name
+    inline static Controller *ra_joints[6] = {};
+    inline static Controller *sa_joints[3] = {};
+    inline static Controller *hand_finger = nullptr;
+    inline static Controller *hand_grip = nullptr;
+    inline static Controller *foot_claw = nullptr;
+    inline static Controller *foot_sensor = nullptr;
+    inline static Controller *gimbal_pitch = nullptr;
+    inline static Controller *gimbal_yaw = nullptr;
+    inline static Controller *zed_gimbal_yaw = nullptr;
+
+    //Returns the RA joints in order, for the batched Controller functions. Only called after init() looked them up
+    static const std::vector<Controller *> &ra_joint_list();
+
+    //Decides which of a position message's sends go out: a send where an angle moved more than deadband or the
+    //stale flags changed since the last one sent, the first send after that, so the last message is where the
+    //angles stopped, and a send once keepalive has passed. A negative deadband sends everything
+    struct ChangeFilter
+    {
+        float deadband;
+        std::chrono::steady_clock::duration keepalive;
+
+        //Messages go out from the incoming, outgoing and arm link threads
+        std::mutex mutex;
+        float last[6];
+        int32_t last_flags;
+        bool moving;
+        std::chrono::steady_clock::time_point last_sent;
+
+        //Returns whether to send num_values angles and flags, recording them as the last sent if so
+        bool should_send(const float *values, int num_values, int32_t flags);
+    };
+
+    inline static ChangeFilter ra_filter = { RA_POS_DEADBAND, RA_POS_KEEPALIVE };
+    inline static ChangeFilter sa_filter = { SA_POS_DEADBAND, SA_POS_KEEPALIVE };
+    inline static ChangeFilter zed_gimbal_filter = { ZED_GIMBAL_DEADBAND, ZED_GIMBAL_KEEPALIVE };
+
+    //Publishes that controller's limit switch was pressed or released, as soon as a transaction reads it back. Set as Controller::on_limit_change
+    static void limit_switch_data(Controller *controller, bool pressed);
+
+    //Helper function to get the path of the telemetry config file
+    static std::string get_telemetry_config_path();
+
+    //Sets filter from the "deadband" and "keepaliveMs" of config's member stream, keeping the defaults it doesn't set
+    static void configure_filter(const rapidjson::Value &config, const char *stream, ChangeFilter &filter);
+
+    //A kind of telemetry sent every period, on a fixed schedule
+    struct TelemetryStream
+    {
+        std::chrono::steady_clock::duration period;
+        void (InternalHandler::*send)();
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    inline static TelemetryStream streams[] = {
+        { RA_POS_PERIOD,        &InternalHandler::ra_telemetry },
+        { SA_POS_PERIOD,        &InternalHandler::sa_telemetry },
+        { ZED_GIMBAL_PERIOD,    &InternalHandler::zed_gimbal_telemetry },
+        { BUS_STATS_PERIOD,     &InternalHandler::bus_stats_telemetry },
+        //After the telemetry streams, which have just polled the live Controllers, so only ones that didn't answer look stale
+        { WARM_UP_PERIOD,       &InternalHandler::warm_up }
+    };
+
 public:
     //Initialize the lcm bus and subscribe to relevant channels with message handlers defined below
     static void init();
@@ -81,8 +196,13 @@ public:
     //Handles a single incoming lcm message
     static void handle_incoming();
 
-    //Decide whether outgoing messages need to be sent, and if so, send them
+    //Sleeps until the next telemetry stream is due, then sends every stream that is due
     static void handle_outgoing();
+
+#ifdef ARM_LINK
+    //Waits up to ARM_LINK_WAIT for a setpoint from the arm link and sends it like a "/ra_closedloop_cmd" message. Returns false if there is no link
+    static bool handle_arm_link();
+#endif
 };
 
 #endif
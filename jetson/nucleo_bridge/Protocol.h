@@ -0,0 +1,251 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include "I2C.h"
+
+//Channels on each nucleo, QuadAll reads the quadrature counts of all of them
+#define NUCLEO_CHANNELS 6
+
+//Most knots a Trajectory command carries, as many as fit in one i2c transaction
+#define TRAJECTORY_KNOTS 3
+
+//Compact angles are in 1/65536 of a turn from 0 to 2pi, and compact feed forward in 1/256 of the feed forward units
+#define COMPACT_ANGLE_UNITS 65536.0f
+#define COMPACT_TORQUE_RESOLUTION (1.0f / 256)
+
+/*
+Protocol.h describes every command the nucleo firmware answers: its command id, the payload written after it and the payload read back.
+Payloads are packed structs laid out like the firmware's buffers, so packing a command is filling in a struct instead of copying to hand counted offsets,
+and passing the wrong payload to a command doesn't compile. Shared by the bridge, test.cpp and benchmark.cpp.
+*/
+namespace Protocol
+{
+#pragma pack(push, 1)
+    //Angle read back by every command that reads one. Quadrature counts, except the absolute encoder angle in radians for ABS_ENC (and joint B, which only has one)
+    union AnglePayload
+    {
+        int32_t quad;
+        float abs;
+    };
+
+    //Not sent by the bridge, OpenPlus took its place
+    struct OpenPayload
+    {
+        int16_t speed;
+    };
+
+    //Throttle in [-1.0, 1.0], already scaled to the PWM limits
+    struct OpenPlusPayload
+    {
+        float speed;
+    };
+
+    //Feed forward torque and target angle, in quadrature counts or for joint B in radians
+    struct ClosedPayload
+    {
+        float feed_forward;
+        AnglePayload setpoint;
+    };
+
+    //Max PWM percentage, out of 100 to avoid sending floats
+    struct ConfigPwmPayload
+    {
+        uint16_t max_speed;
+    };
+
+    struct KPayload
+    {
+        float kp;
+        float ki;
+        float kd;
+    };
+
+    //Quadrature count the encoder is set to
+    struct AdjustPayload
+    {
+        int32_t quad;
+    };
+
+    struct LimitPayload
+    {
+        uint8_t limit;
+    };
+
+    //Built with -Dlimit_flags=true, the nucleo follows what every command that reads back angles reads with this, bit c set while
+    //the limit switch of its channel c is pressed. The bridge reads it by reading one byte more, see with_limit_flags()
+    struct LimitFlagsPayload
+    {
+        uint8_t pressed;
+    };
+
+    //A payload and the limit flags that follow it
+    template <typename Payload>
+    struct WithLimitFlags
+    {
+        Payload payload;
+        LimitFlagsPayload limits;
+    };
+
+    //Quadrature counts of every channel of a nucleo
+    struct QuadAllPayload
+    {
+        int32_t quad[NUCLEO_CHANNELS];
+    };
+
+    //A point of a trajectory, reached time_ms after the command arrives at target, in the units of ClosedPayload, moving at velocity of those units per second
+    struct TrajectoryKnot
+    {
+        uint16_t time_ms;
+        AnglePayload target;
+        float velocity;
+    };
+
+    //The next stretch of a joint's trajectory, replacing whatever is left of the last one. The firmware interpolates a cubic Hermite spline from where the joint is
+    //through the first num_knots knots and closes the loop on it, then holds the last knot
+    struct TrajectoryPayload
+    {
+        uint8_t num_knots;
+        TrajectoryKnot knots[TRAJECTORY_KNOTS];
+    };
+
+    //How the nucleo converts a channel's compact values: the quadrature counts (or for joint B radians) in one compact angle unit,
+    //and the feed forward units in one compact feed forward unit
+    struct CompactConfigPayload
+    {
+        float angle_scale;
+        float torque_scale;
+    };
+
+    //1 if the channel takes compact commands from now on, firmware without them doesn't answer ConfigCompact at all
+    struct CompactAckPayload
+    {
+        uint8_t supported;
+    };
+
+    //A channel's feed forward and target angle in compact units
+    struct CompactSetpoint
+    {
+        int16_t feed_forward;
+        uint16_t setpoint;
+    };
+
+    //Closed loop targets for the channels of a nucleo set in channels, bit 0 for channel 0, packed in channel order.
+    //Only the setpoints of those channels are sent, see compact_transaction()
+    struct ClosedCompactPayload
+    {
+        uint8_t channels;
+        CompactSetpoint setpoints[NUCLEO_CHANNELS];
+    };
+
+    //Angles of the channels the ClosedCompact command set, in compact units and the same order
+    struct CompactAnglesPayload
+    {
+        uint16_t angle[NUCLEO_CHANNELS];
+    };
+#pragma pack(pop)
+
+    //Size of a payload on the bus, void for a command that writes or reads nothing
+    template <typename Payload>
+    struct PayloadSize
+    {
+        static constexpr uint8_t value = sizeof(Payload);
+    };
+
+    template <>
+    struct PayloadSize<void>
+    {
+        static constexpr uint8_t value = 0;
+    };
+
+    //A command the nucleo answers, writing a Write after the command id and reading back a Read
+    template <uint8_t Id, typename Write, typename Read>
+    struct Command
+    {
+        typedef Write WritePayload;
+        typedef Read ReadPayload;
+
+        static constexpr uint8_t cmd = Id;
+        static constexpr uint8_t write_num = PayloadSize<Write>::value;
+        static constexpr uint8_t read_num = PayloadSize<Read>::value;
+
+        //I2C sends the command id and what it writes from one 32 byte buffer
+        static_assert(write_num < 32 && read_num <= 32, "payload too big for one i2c transaction");
+    };
+
+    typedef Command<0x00, void, void> Off;
+    typedef Command<0x0F, void, void> On;
+    typedef Command<0x10, OpenPayload, void> Open;
+    typedef Command<0x1F, OpenPlusPayload, AnglePayload> OpenPlus;
+    typedef Command<0x20, ClosedPayload, void> Closed;
+    typedef Command<0x2F, ClosedPayload, AnglePayload> ClosedPlus;
+    typedef Command<0x2E, TrajectoryPayload, AnglePayload> Trajectory;
+    typedef Command<0x2D, ClosedCompactPayload, CompactAnglesPayload> ClosedCompact;
+    typedef Command<0x2C, CompactConfigPayload, CompactAckPayload> ConfigCompact;
+    typedef Command<0x30, ConfigPwmPayload, void> ConfigPwm;
+    typedef Command<0x3F, KPayload, void> ConfigK;
+    typedef Command<0x40, void, AnglePayload> Quad;
+    typedef Command<0x41, void, QuadAllPayload> QuadAll;
+    typedef Command<0x4F, AdjustPayload, void> Adjust;
+    typedef Command<0x50, void, AnglePayload> AbsEnc;
+    typedef Command<0x5F, void, KPayload> GetK;
+    typedef Command<0x60, void, LimitPayload> Limit;
+
+    //Sizes the firmware expects, so a payload that changes size by accident doesn't compile
+    template <typename C, uint8_t WriteNum, uint8_t ReadNum>
+    constexpr bool sizes_are = C::write_num == WriteNum && C::read_num == ReadNum;
+
+    static_assert(sizes_are<Off, 0, 0>, "Off");
+    static_assert(sizes_are<On, 0, 0>, "On");
+    static_assert(sizes_are<Open, 2, 0>, "Open");
+    static_assert(sizes_are<OpenPlus, 4, 4>, "OpenPlus");
+    static_assert(sizes_are<Closed, 8, 0>, "Closed");
+    static_assert(sizes_are<ClosedPlus, 8, 4>, "ClosedPlus");
+    static_assert(sizes_are<Trajectory, 31, 4>, "Trajectory");
+    static_assert(sizes_are<ClosedCompact, 25, 12>, "ClosedCompact");
+    static_assert(sizes_are<ConfigCompact, 8, 1>, "ConfigCompact");
+    static_assert(sizes_are<ConfigPwm, 2, 0>, "ConfigPwm");
+    static_assert(sizes_are<ConfigK, 12, 0>, "ConfigK");
+    static_assert(sizes_are<Quad, 0, 4>, "Quad");
+    static_assert(sizes_are<QuadAll, 0, 24>, "QuadAll");
+    static_assert(sizes_are<Adjust, 4, 0>, "Adjust");
+    static_assert(sizes_are<AbsEnc, 0, 4>, "AbsEnc");
+    static_assert(sizes_are<GetK, 0, 12>, "GetK");
+    static_assert(sizes_are<Limit, 0, 1>, "Limit");
+
+    //Returns the transaction sending C to addr, writing write and reading into read. Either is nullptr (or void) if C doesn't use it
+    template <typename C>
+    I2CTransaction transaction(uint8_t addr, typename C::WritePayload *write, typename C::ReadPayload *read)
+    {
+        return { addr, C::cmd, C::write_num, C::read_num,
+                 static_cast<uint8_t *>(static_cast<void *>(write)), static_cast<uint8_t *>(static_cast<void *>(read)) };
+    }
+
+#ifdef NUCLEO_LIMIT_FLAGS
+    constexpr uint8_t limit_flags_num = sizeof(LimitFlagsPayload);
+#else
+    constexpr uint8_t limit_flags_num = 0;
+#endif
+
+    //Returns transaction also reading the limit flags that follow what it reads, into the byte after it, when built with -Dlimit_flags=true.
+    //Only for commands that read back angles, any others don't send them
+    inline I2CTransaction with_limit_flags(I2CTransaction transaction)
+    {
+        transaction.read_num += limit_flags_num;
+        return transaction;
+    }
+
+    //The reads with the most to read still fit in one i2c transaction with the flags
+    static_assert(QuadAll::read_num + limit_flags_num <= 32 && ClosedCompact::read_num + limit_flags_num <= 32, "limit flags don't fit");
+
+    //Returns the ClosedCompact transaction to the nucleo at addr for the first num_channels setpoints of write, sending and reading back only those
+    inline I2CTransaction compact_transaction(uint8_t addr, ClosedCompactPayload *write, CompactAnglesPayload *read, uint8_t num_channels)
+    {
+        I2CTransaction compact = transaction<ClosedCompact>(addr, write, read);
+        compact.write_num = 1 + num_channels * sizeof(CompactSetpoint);
+        compact.read_num = num_channels * sizeof(uint16_t);
+        return compact;
+    }
+}
+
+#endif
@@ -0,0 +1,385 @@
+#include "SimulatedBus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+//A bus with the default model
+SimulatedBus::SimulatedBus() :
+    SimulatedBus(Model())
+{
+}
+
+SimulatedBus::SimulatedBus(const Model &model) :
+    model(model),
+    random(model.seed)
+{
+}
+
+//Emulates a channel at addr on bus, counts_per_turn of its angle units in a turn, SIM_COUNTS_PER_TURN if that isn't finite.
+//Reads the angle as a float in radians if float_angle
+void SimulatedBus::add_channel(uint8_t bus, uint8_t addr, float counts_per_turn, bool float_angle)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    Channel &channel = channels[key(bus, addr)];
+    channel.counts_per_turn = float_angle ? 2 * M_PI : std::isfinite(counts_per_turn) ? counts_per_turn : SIM_COUNTS_PER_TURN;
+    channel.float_angle = float_angle;
+
+    //Start halfway around, where the bridge reads an angle of 0
+    channel.position = channel.counts_per_turn / 2;
+}
+
+//Sets whether the limit switch of the channel at addr on bus is pressed
+void SimulatedBus::set_limit(uint8_t bus, uint8_t addr, bool pressed)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    Channel *channel = find(bus, addr);
+    if (channel)
+    {
+        channel->limit = pressed;
+    }
+}
+
+uint64_t SimulatedBus::get_transfers() const
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return transfers;
+}
+
+uint64_t SimulatedBus::get_errors() const
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return errors;
+}
+
+double SimulatedBus::get_busy_s() const
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return busy_s;
+}
+
+bool SimulatedBus::open_bus(uint8_t bus)
+{
+    open[bus] = true;
+    return true;
+}
+
+bool SimulatedBus::transfer(uint8_t bus, struct i2c_msg *messages, int num_messages)
+{
+    if (!open[bus])
+    {
+        printf("I2C Port never opened");
+        return false;
+    }
+
+    //Every message starts, or starts again, and sends the address byte, then the transfer stops. Every byte takes 9 clocks with its ack
+    double clocks = 1;
+    for (int i = 0; i < num_messages; ++i)
+    {
+        clocks += 1 + 9 + 9 * messages[i].len;
+    }
+
+    double stretch_us = 0;
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (int i = 0; i < num_messages; ++i)
+        {
+            if ((messages[i].flags & I2C_M_RD) && uniform(random) < model.stretch_probability)
+            {
+                stretch_us += uniform(random) * model.max_stretch_us;
+            }
+        }
+        failed = uniform(random) < model.error_rate;
+
+        //Each write carries a command, answered by the read right after it if there is one
+        for (int i = 0; i < num_messages && !failed; ++i)
+        {
+            if (messages[i].flags & I2C_M_RD)
+            {
+                continue;
+            }
+
+            bool has_read = i + 1 < num_messages && (messages[i + 1].flags & I2C_M_RD);
+            uint8_t *read = has_read ? messages[i + 1].buf : nullptr;
+            uint16_t read_len = has_read ? messages[i + 1].len : 0;
+            failed = !answer(bus, messages[i].addr, messages[i].buf, messages[i].len, read, read_len);
+        }
+
+        ++transfers;
+        errors += failed;
+        busy_s += (model.transfer_overhead_us + stretch_us) / 1e6 + clocks / model.clock_hz;
+    }
+
+    //Hold the bus for as long as the transfer takes, after any transfer still on it
+    std::lock_guard<std::mutex> bus_lock(bus_mutex[bus]);
+    std::chrono::duration<double> duration((model.transfer_overhead_us + stretch_us) / 1e6 + clocks / model.clock_hz);
+    busy_until[bus] = std::max(busy_until[bus], std::chrono::steady_clock::now()) +
+                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration);
+    std::this_thread::sleep_until(busy_until[bus]);
+
+    return !failed;
+}
+
+uint16_t SimulatedBus::key(uint8_t bus, uint8_t addr)
+{
+    return (bus << 8) | addr;
+}
+
+//Returns the channel at addr on bus, nullptr if there isn't one
+SimulatedBus::Channel *SimulatedBus::find(uint8_t bus, uint8_t addr)
+{
+    std::unordered_map<uint16_t, Channel>::iterator it = channels.find(key(bus, addr));
+    return it == channels.end() ? nullptr : &it->second;
+}
+
+//Moves channel to where it is at now
+void SimulatedBus::update(Channel &channel, std::chrono::steady_clock::time_point now)
+{
+    double max_step = SIM_MAX_TURNS_PER_S * channel.counts_per_turn * std::chrono::duration<double>(now - channel.updated).count();
+    channel.updated = now;
+
+    if (channel.mode == Channel::OPEN)
+    {
+        channel.position += std::max(-1.0f, std::min(channel.throttle, 1.0f)) * max_step;
+    }
+    else if (channel.mode == Channel::CLOSED)
+    {
+        channel.position += std::max(-max_step, std::min(channel.target - channel.position, max_step));
+    }
+}
+
+//Returns the angle of channel read by commands that read one
+Protocol::AnglePayload SimulatedBus::angle(const Channel &channel)
+{
+    Protocol::AnglePayload angle;
+    if (channel.float_angle)
+    {
+        angle.abs = channel.position;
+    }
+    else
+    {
+        angle.quad = static_cast<int32_t>(std::lround(channel.position));
+    }
+    return angle;
+}
+
+//Sets channel's target from an angle written by a command
+void SimulatedBus::set_target(Channel &channel, const Protocol::AnglePayload &target)
+{
+    channel.mode = Channel::CLOSED;
+    channel.target = channel.float_angle ? target.abs : target.quad;
+}
+
+//Answers the command in write, writing what it reads into read. Returns false if no channel is at addr
+bool SimulatedBus::answer(uint8_t bus, uint8_t addr, const uint8_t *write, uint16_t write_len, uint8_t *read, uint16_t read_len)
+{
+    if (write_len == 0)
+    {
+        return false;
+    }
+
+    uint8_t cmd = write[0];
+    const uint8_t *payload = write + 1;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (read)
+    {
+        memset(read, 0, read_len);
+    }
+
+    //Commands to a whole nucleo go to channel 0's address
+    if (cmd == Protocol::QuadAll::cmd || cmd == Protocol::ClosedCompact::cmd)
+    {
+        Channel *nucleo[NUCLEO_CHANNELS];
+        bool any = false;
+        for (int c = 0; c < NUCLEO_CHANNELS; ++c)
+        {
+            nucleo[c] = find(bus, (addr & 0xF0) | c);
+            if (nucleo[c])
+            {
+                update(*nucleo[c], now);
+                any = true;
+            }
+        }
+        if (!any)
+        {
+            return false;
+        }
+
+        if (cmd == Protocol::QuadAll::cmd)
+        {
+            Protocol::QuadAllPayload all = {};
+            for (int c = 0; c < NUCLEO_CHANNELS; ++c)
+            {
+                all.quad[c] = nucleo[c] ? angle(*nucleo[c]).quad : 0;
+            }
+            memcpy(read, &all, std::min<size_t>(read_len, sizeof(all)));
+            append_limit_flags(bus, addr, read, read_len, sizeof(all));
+            return true;
+        }
+
+        //Only the channels set in the mask are sent, in channel order, and their angles read back in the same order
+        Protocol::ClosedCompactPayload compact = {};
+        memcpy(&compact, payload, std::min<size_t>(write_len - 1, sizeof(compact)));
+        Protocol::CompactAnglesPayload angles = {};
+        int n = 0;
+        for (int c = 0; c < NUCLEO_CHANNELS; ++c)
+        {
+            if (!(compact.channels & (1 << c)))
+            {
+                continue;
+            }
+            Channel *channel = nucleo[c];
+            if (channel && channel->compact.angle_scale > 0)
+            {
+                channel->mode = Channel::CLOSED;
+                channel->target = compact.setpoints[n].setpoint * channel->compact.angle_scale;
+                double units = std::fmod(channel->position / channel->compact.angle_scale, COMPACT_ANGLE_UNITS);
+                angles.angle[n] = static_cast<uint16_t>(units < 0 ? units + COMPACT_ANGLE_UNITS : units);
+            }
+            ++n;
+        }
+        memcpy(read, &angles, std::min<size_t>(read_len, sizeof(angles)));
+        append_limit_flags(bus, addr, read, read_len, n * sizeof(uint16_t));
+        return true;
+    }
+
+    Channel *channel = find(bus, addr);
+    if (!channel)
+    {
+        return false;
+    }
+    update(*channel, now);
+
+    //What the command reads back, if anything
+    Protocol::AnglePayload read_angle = angle(*channel);
+    const void *reply = nullptr;
+    size_t reply_len = 0;
+
+    switch (cmd)
+    {
+    case Protocol::Off::cmd:
+        channel->mode = Channel::IDLE;
+        break;
+    case Protocol::Open::cmd:
+    {
+        Protocol::OpenPayload open = {};
+        memcpy(&open, payload, std::min<size_t>(write_len - 1, sizeof(open)));
+        channel->mode = Channel::OPEN;
+        channel->throttle = open.speed / 32767.0f;
+        break;
+    }
+    case Protocol::OpenPlus::cmd:
+    {
+        Protocol::OpenPlusPayload open = {};
+        memcpy(&open, payload, std::min<size_t>(write_len - 1, sizeof(open)));
+        channel->mode = Channel::OPEN;
+        channel->throttle = open.speed;
+        reply = &read_angle;
+        reply_len = sizeof(read_angle);
+        break;
+    }
+    case Protocol::Closed::cmd:
+    case Protocol::ClosedPlus::cmd:
+    {
+        Protocol::ClosedPayload closed = {};
+        memcpy(&closed, payload, std::min<size_t>(write_len - 1, sizeof(closed)));
+        set_target(*channel, closed.setpoint);
+        reply = &read_angle;
+        reply_len = cmd == Protocol::ClosedPlus::cmd ? sizeof(read_angle) : 0;
+        break;
+    }
+    case Protocol::Trajectory::cmd:
+    {
+        //Heads straight for the last knot
+        Protocol::TrajectoryPayload trajectory = {};
+        memcpy(&trajectory, payload, std::min<size_t>(write_len - 1, sizeof(trajectory)));
+        if (trajectory.num_knots > 0 && trajectory.num_knots <= TRAJECTORY_KNOTS)
+        {
+            set_target(*channel, trajectory.knots[trajectory.num_knots - 1].target);
+        }
+        reply = &read_angle;
+        reply_len = sizeof(read_angle);
+        break;
+    }
+    case Protocol::ConfigCompact::cmd:
+    {
+        static const Protocol::CompactAckPayload supported = { 1 };
+        memcpy(&channel->compact, payload, std::min<size_t>(write_len - 1, sizeof(channel->compact)));
+        reply = &supported;
+        reply_len = sizeof(supported);
+        break;
+    }
+    case Protocol::ConfigK::cmd:
+        memcpy(&channel->k, payload, std::min<size_t>(write_len - 1, sizeof(channel->k)));
+        break;
+    case Protocol::GetK::cmd:
+        reply = &channel->k;
+        reply_len = sizeof(channel->k);
+        break;
+    case Protocol::Quad::cmd:
+        reply = &read_angle;
+        reply_len = sizeof(read_angle);
+        break;
+    case Protocol::Adjust::cmd:
+    {
+        Protocol::AdjustPayload adjust = {};
+        memcpy(&adjust, payload, std::min<size_t>(write_len - 1, sizeof(adjust)));
+        channel->position = adjust.quad;
+        channel->mode = Channel::IDLE;
+        break;
+    }
+    case Protocol::AbsEnc::cmd:
+    {
+        double turns = channel->position / channel->counts_per_turn;
+        read_angle.abs = (turns - std::floor(turns)) * 2 * M_PI;
+        reply = &read_angle;
+        reply_len = sizeof(read_angle);
+        break;
+    }
+    case Protocol::Limit::cmd:
+    {
+        static const Protocol::LimitPayload pressed = { 1 };
+        static const Protocol::LimitPayload released = { 0 };
+        reply = channel->limit ? &pressed : &released;
+        reply_len = sizeof(pressed);
+        break;
+    }
+    default:
+        //On, ConfigPwm and commands the emulation doesn't know change nothing it models
+        break;
+    }
+
+    if (read && reply)
+    {
+        memcpy(read, reply, std::min<size_t>(read_len, reply_len));
+    }
+    if (reply == &read_angle && reply_len > 0)
+    {
+        append_limit_flags(bus, addr, read, read_len, reply_len);
+    }
+    return true;
+}
+
+//Writes the limit flags of the nucleo addr is on after the reply_len bytes of an angle reply in read, if the bridge reads that far
+void SimulatedBus::append_limit_flags(uint8_t bus, uint8_t addr, uint8_t *read, uint16_t read_len, size_t reply_len)
+{
+#ifdef NUCLEO_LIMIT_FLAGS
+    if (!read || read_len <= reply_len)
+    {
+        return;
+    }
+
+    Protocol::LimitFlagsPayload limits = { 0 };
+    for (int c = 0; c < NUCLEO_CHANNELS; ++c)
+    {
+        Channel *channel = find(bus, (addr & 0xF0) | c);
+        if (channel && channel->limit)
+        {
+            limits.pressed |= 1 << c;
+        }
+    }
+    read[reply_len] = limits.pressed;
+#endif
+}
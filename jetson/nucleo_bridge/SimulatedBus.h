@@ -0,0 +1,135 @@
+#ifndef SIMULATED_BUS_H
+#define SIMULATED_BUS_H
+
+#include "I2C.h"
+#include "Protocol.h"
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+//Defaults of SimulatedBus::Model, a standard mode bus behind the linux driver
+#define SIM_CLOCK_HZ                100000
+#define SIM_TRANSFER_OVERHEAD_US    40
+#define SIM_STRETCH_PROBABILITY     0.05
+#define SIM_MAX_STRETCH_US          200
+#define SIM_ERROR_RATE              0.0
+
+//Angle units in a turn of a channel whose controller doesn't know its counts per turn
+#define SIM_COUNTS_PER_TURN         4096
+
+//Turns a second a channel moves at full throttle, and toward a closed loop target
+#define SIM_MAX_TURNS_PER_S         0.25
+
+/*
+SimulatedBus is an I2CBackend that emulates the nucleos, so the bridge, its scheduling and benchmark.cpp run at realistic bus speeds without hardware.
+Each transfer takes as long as its bits do at the model's clock, plus the driver's overhead and any clock stretching by the nucleos, and holds its bus for
+that long like the real one. Transfers fail at the model's error rate, and to addresses no channel was added at, like a NACK.
+The emulated channels answer every command in Protocol.h: open loop throttle and closed loop and trajectory targets move their angle over time,
+and reads return it in the channel's units, quadrature counts, or radians for a channel with float angles like joint B.
+Built with -Dlimit_flags=true, reads of angles are followed by the limit flags of the nucleo, from set_limit().
+*/
+class SimulatedBus : public I2CBackend
+{
+public:
+    //How the bus and the nucleos behave
+    struct Model
+    {
+        double clock_hz = SIM_CLOCK_HZ;
+
+        //Per transfer, for the ioctl and the driver setting up the controller
+        double transfer_overhead_us = SIM_TRANSFER_OVERHEAD_US;
+
+        //Chance a read is stretched by the nucleo, for up to max_stretch_us
+        double stretch_probability = SIM_STRETCH_PROBABILITY;
+        double max_stretch_us = SIM_MAX_STRETCH_US;
+
+        //Chance a transfer fails
+        double error_rate = SIM_ERROR_RATE;
+
+        //Seeds the stretching and the errors, so runs are repeatable
+        unsigned seed = 0;
+    };
+
+    //A bus with the default model
+    SimulatedBus();
+
+    explicit SimulatedBus(const Model &model);
+
+    //Emulates a channel at addr on bus, counts_per_turn of its angle units in a turn, SIM_COUNTS_PER_TURN if that isn't finite.
+    //Reads the angle as a float in radians if float_angle
+    void add_channel(uint8_t bus, uint8_t addr, float counts_per_turn, bool float_angle = false);
+
+    //Sets whether the limit switch of the channel at addr on bus is pressed
+    void set_limit(uint8_t bus, uint8_t addr, bool pressed);
+
+    //Returns how many transfers were sent and failed, and the time the buses were busy
+    uint64_t get_transfers() const;
+
+    uint64_t get_errors() const;
+
+    double get_busy_s() const;
+
+    bool open_bus(uint8_t bus) override;
+
+    bool transfer(uint8_t bus, struct i2c_msg *messages, int num_messages) override;
+
+private:
+    struct Channel
+    {
+        float counts_per_turn;
+        bool float_angle;
+        bool limit = false;
+
+        //Angle in the channel's units, and what moves it
+        double position = 0;
+        enum { IDLE, OPEN, CLOSED } mode = IDLE;
+        float throttle = 0;
+        double target = 0;
+        std::chrono::steady_clock::time_point updated = std::chrono::steady_clock::now();
+
+        Protocol::KPayload k = {};
+        Protocol::CompactConfigPayload compact = {};
+    };
+
+    Model model;
+
+    //Each bus sends one transfer at a time, until busy_until
+    std::mutex bus_mutex[I2C_MAX_BUSES];
+    std::chrono::steady_clock::time_point busy_until[I2C_MAX_BUSES];
+    bool open[I2C_MAX_BUSES] = {};
+
+    //Guards everything below, which the bus threads share. Only held while a transfer is answered, not while it takes its time
+    mutable std::mutex state_mutex;
+
+    //Channels by bus and address
+    std::unordered_map<uint16_t, Channel> channels;
+
+    std::mt19937 random;
+    uint64_t transfers = 0;
+    uint64_t errors = 0;
+    double busy_s = 0;
+
+    static uint16_t key(uint8_t bus, uint8_t addr);
+
+    //Returns the channel at addr on bus, nullptr if there isn't one
+    Channel *find(uint8_t bus, uint8_t addr);
+
+    //Moves channel to where it is at now
+    static void update(Channel &channel, std::chrono::steady_clock::time_point now);
+
+    //Answers the command in write, writing what it reads into read. Returns false if no channel is at addr
+    bool answer(uint8_t bus, uint8_t addr, const uint8_t *write, uint16_t write_len, uint8_t *read, uint16_t read_len);
+
+    //Returns the angle of channel read by commands that read one
+    static Protocol::AnglePayload angle(const Channel &channel);
+
+    //Sets channel's target from an angle written by a command
+    static void set_target(Channel &channel, const Protocol::AnglePayload &target);
+
+    //Writes the limit flags of the nucleo addr is on after the reply_len bytes of an angle reply in read, if the bridge reads that far
+    void append_limit_flags(uint8_t bus, uint8_t addr, uint8_t *read, uint16_t read_len, size_t reply_len);
+};
+
+#endif
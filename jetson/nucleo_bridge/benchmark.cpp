@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "I2C.h"
+#include "BusScheduler.h"
+#include "Protocol.h"
+#include "SimulatedBus.h"
+
+/*
+Hardware in the loop benchmark of the i2c bus. Built with -Dbenchmark=true, run on the rover with the nucleos connected.
+Every command is an open loop command with 0 throttle, so nothing moves, and reads back the angle like open and closed loop commands do.
+Prints the latency from sending a command to having its feedback and the sustained command rate:
+    per controller, one transaction at a time
+    per whole arm update, one transaction per joint
+    per whole arm update, all joints in one batch
+    per whole arm update, all joints in one batch queued through BusScheduler like nucleo_bridge does
+Usage: jetson_nucleo_bridge [iterations], 1000 by default
+With MROVER_I2C_SIM set, runs against SimulatedBus instead, which emulates the arm's nucleos at a standard mode bus's speed, so scheduling and batching
+changes can be compared without hardware
+*/
+
+//Joints of the RA, two channels on each of the first three nucleos like test.cpp
+#define ARM_JOINTS 6
+
+//Results of one benchmark
+struct BenchmarkResult
+{
+    const char *name;
+    int transactions_per_iteration;
+    int failures;
+    std::vector<double> latencies_ms;
+    double elapsed_s;
+};
+
+std::vector<uint8_t> arm_address;
+
+int get_addr(int nucleo, int channel = 0)
+{
+    return (nucleo << 4) | channel;
+}
+
+//Returns an open loop command with 0 throttle to addr, reading the angle into angle
+I2CTransaction zero_throttle_command(uint8_t addr, Protocol::OpenPlusPayload *speed, Protocol::AnglePayload *angle)
+{
+    speed->speed = 0.0;
+    return Protocol::transaction<Protocol::OpenPlus>(addr, speed, angle);
+}
+
+//Returns the latency that fraction of the iterations were at or under
+double percentile(std::vector<double> latencies_ms, double fraction)
+{
+    if (latencies_ms.empty())
+    {
+        return 0.0;
+    }
+    std::vector<double>::iterator p = latencies_ms.begin() + static_cast<size_t>((latencies_ms.size() - 1) * fraction);
+    std::nth_element(latencies_ms.begin(), p, latencies_ms.end());
+    return *p;
+}
+
+void print_result(const BenchmarkResult &result)
+{
+    double max_ms = result.latencies_ms.empty() ? 0.0 : *std::max_element(result.latencies_ms.begin(), result.latencies_ms.end());
+    double rate = (result.latencies_ms.size() * result.transactions_per_iteration) / result.elapsed_s;
+
+    printf("%-36s p50 %7.3f ms  p99 %7.3f ms  max %7.3f ms  %8.0f commands/s  %d failed\n",
+           result.name, percentile(result.latencies_ms, 0.5), percentile(result.latencies_ms, 0.99), max_ms, rate, result.failures);
+}
+
+//Runs iterations of send back to back, timing each one. send throws IOFailure if it fails
+template <typename Send>
+BenchmarkResult run(const char *name, int transactions_per_iteration, int iterations, Send send)
+{
+    BenchmarkResult result = { name, transactions_per_iteration, 0, {}, 0.0 };
+    result.latencies_ms.reserve(iterations);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+        try
+        {
+            send();
+            result.latencies_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+        }
+        catch (IOFailure &e)
+        {
+            ++result.failures;
+        }
+    }
+    result.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+
+    for (int i = 1; i <= 3; ++i)
+    {
+        arm_address.push_back(get_addr(i, 0));
+        arm_address.push_back(get_addr(i, 1));
+    }
+    SimulatedBus sim;
+    bool simulated = getenv("MROVER_I2C_SIM") != nullptr;
+    if (simulated)
+    {
+        for (uint8_t addr : arm_address)
+        {
+            sim.add_channel(I2C_DEFAULT_BUS, addr, SIM_COUNTS_PER_TURN);
+        }
+        I2C::set_backend(&sim);
+        printf("Simulated bus at %d Hz\n", SIM_CLOCK_HZ);
+    }
+
+    if (!I2C::init())
+    {
+        return 1;
+    }
+
+    Protocol::OpenPlusPayload speeds[ARM_JOINTS];
+    Protocol::AnglePayload angles[ARM_JOINTS];
+    std::vector<I2CTransaction> arm_commands;
+    for (int i = 0; i < ARM_JOINTS; ++i)
+    {
+        arm_commands.push_back(zero_throttle_command(arm_address[i], &speeds[i], &angles[i]));
+    }
+
+    printf("%d iterations of each benchmark\n\n", iterations);
+
+    std::vector<BenchmarkResult> arm_results;
+
+    for (int i = 0; i < ARM_JOINTS; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "controller %i", arm_address[i]);
+        print_result(run(name, 1, iterations, [&]()
+        {
+            I2C::transact(arm_commands[i]);
+        }));
+    }
+    printf("\n");
+
+    arm_results.push_back(run("arm, one transaction per joint", ARM_JOINTS, iterations, [&]()
+    {
+        for (const I2CTransaction &command : arm_commands)
+        {
+            I2C::transact(command);
+        }
+    }));
+
+    arm_results.push_back(run("arm, batched", ARM_JOINTS, iterations, [&]()
+    {
+        I2C::transact_batch(arm_commands);
+    }));
+
+    std::thread busThread(&BusScheduler::run, I2C_DEFAULT_BUS);
+    busThread.detach();
+
+    arm_results.push_back(run("arm, batched through BusScheduler", ARM_JOINTS, iterations, [&]()
+    {
+        BusScheduler::transact_batch(COMMAND, arm_commands);
+    }));
+
+    for (const BenchmarkResult &result : arm_results)
+    {
+        print_result(result);
+    }
+
+    //The arm sends one whole arm update every SPLINE_WAIT_TIME, which has to leave room for telemetry on the same bus
+    printf("\nSPLINE_WAIT_TIME in ra_kinematics should stay well above the p99 of the arm update it uses, %.3f ms batched through BusScheduler\n",
+           percentile(arm_results.back().latencies_ms, 0.99));
+
+    if (simulated)
+    {
+        printf("Simulated bus sent %llu transfers, %llu failed, busy for %.3f s\n", static_cast<unsigned long long>(sim.get_transfers()),
+               static_cast<unsigned long long>(sim.get_errors()), sim.get_busy_s());
+    }
+
+    return 0;
+}
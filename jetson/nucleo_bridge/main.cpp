@@ -3,22 +3,29 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <vector>
 
 #include "lcm/lcm-cpp.hpp"
 #include "Controller.h"
 #include "Hardware.h"
 #include "LCMHandler.h"
 #include "I2C.h"
+#include "BusScheduler.h"
+#include "SimulatedBus.h"
+#include "rover_runtime.hpp"
+#include "readiness.hpp"
+#include "memory_report.hpp"
+#include "trace.hpp"
 
 //Handles instantiation of Controller objects, FrontEnd, and BackEnd classes
+//Only the bus threads talk to the i2c buses, the other two queue their transactions with BusScheduler
 
-//The outgoing function calls on the LCMHandler's handle_outgoing() function every millisecond
+//The outgoing function calls on the LCMHandler's handle_outgoing() function continuously, which sleeps until telemetry is due
 void outgoing()
 {
     while (true)
     {
         LCMHandler::handle_outgoing();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 }
 
@@ -31,23 +38,85 @@ void incoming()
     }
 }
 
+#ifdef ARM_LINK
+//The arm link function calls on the LCMHandler's handle_arm_link() function continuously, which waits for setpoints from ra_kinematics
+void arm_link()
+{
+    while (LCMHandler::handle_arm_link())
+    {
+    }
+}
+#endif
+
 int main()
 {
+    //With MROVER_TRACE_DIR set, LCM commands and bus transactions are traced
+    Trace::start("nucleo_bridge");
+
+    //Priorities and cores of the threads come from config/threads
+    ThreadConfig threads("nucleo_bridge");
+
+    //Sent on /heartbeat/nucleo_bridge, ready once the controllers the first commands go to are warm
+    Readiness readiness(threads, "nucleo_bridge");
+
+    //Sent on /memory/nucleo_bridge every second
+    MemoryReport memoryReport(threads, "nucleo_bridge");
+
     printf("Initializing virtual controllers\n");
     ControllerMap::init();
 
     printf("Initializing LCM bus\n");
     LCMHandler::init();
 
-    printf("Initializing I2C bus\n");
-    I2C::init();
+    //With MROVER_I2C_SIM set, the buses are simulated, with an emulated nucleo channel for every virtual controller
+    SimulatedBus sim;
+    if (getenv("MROVER_I2C_SIM"))
+    {
+        for (const std::pair<const std::string, Controller *> &controller : ControllerMap::controllers)
+        {
+            //Joint B only has its absolute encoder, in radians
+            sim.add_channel(controller.second->i2c_bus, controller.second->i2c_address, controller.second->quad_cpr, controller.first == "RA_1");
+        }
+        I2C::set_backend(&sim);
+        printf("Simulating the I2C buses\n");
+    }
+
+    printf("Initializing I2C buses\n");
+    std::vector<uint8_t> buses = ControllerMap::get_buses();
+    if (!I2C::init(buses))
+    {
+        readiness.failed();
+        return 1;
+    }
+
+    //One thread for each bus, so the buses send their transactions in parallel
+    std::vector<std::thread> busThreads;
+    for (uint8_t bus : buses)
+    {
+        busThreads.push_back(threads.spawn("bus", [bus]() { BusScheduler::run(bus); }));
+    }
+
+    //Configure the controllers the first commands go to before they come in
+    printf("Warming up controllers\n");
+    ControllerMap::warm_up();
 
     printf("Initialization Done. Looping. Reduced output for program speed.\n");
-    std::thread outThread(&outgoing);
-    std::thread inThread(&incoming);
+    std::thread outThread = threads.spawn("outgoing", &outgoing);
+    std::thread inThread = threads.spawn("incoming", &incoming);
+#ifdef ARM_LINK
+    std::thread armLinkThread = threads.spawn("arm_link", &arm_link);
+#endif
+    readiness.ready();
 
+    for (std::thread &busThread : busThreads)
+    {
+        busThread.join();
+    }
     outThread.join();
     inThread.join();
+#ifdef ARM_LINK
+    armLinkThread.join();
+#endif
 
     return 0;
 }
@@ -1,26 +1,11 @@
 #include <iostream>
 #include "I2C.h"
+#include "Protocol.h"
 #include <vector>
 #include <thread>
 
 # define M_PI           3.14159265358979323846  /* pi */
 
-#define OFF         0x00,   0,  0
-#define ON          0x0F,   0,  0
-#define OPEN        0x10,   2,  0
-#define OPEN_PLUS   0x1F,   4,  4
-#define CLOSED      0x20,   8,  0
-#define CLOSED_PLUS 0x2F,   8,  4
-#define CONFIG_PWM  0x30,   2,  0
-#define CONFIG_K    0x3F,   12, 0 // maybe rename to CONFIG_KPID since its all 3
-#define GET_K       0x5F,   0,  12
-#define QUAD        0x40,   0,  4
-#define ADJUST      0x4F,   4,  0
-#define ABS_ENC     0x50,   0,  4
-#define LIMIT       0x60,   0,  1
-
-#define UINT8_POINTER_T reinterpret_cast<uint8_t *>
-
 #define PRINT_TEST_START printf("Running Test #%2d, %s\n", ++num_tests_ran, __FUNCTION__);
 #define PRINT_TEST_END printf("Finished Test #%2d, %s\n\n", num_tests_ran, __FUNCTION__);
 
@@ -55,7 +40,7 @@ void off(int addr)
 {
     try
     {
-        I2C::transact(addr, OFF, nullptr, nullptr);
+        I2C::transact(Protocol::transaction<Protocol::Off>(addr, nullptr, nullptr));
         printf("test off transaction successful on slave %i \n", addr);
     }
     catch (IOFailure &e)
@@ -68,7 +53,7 @@ void on(int addr)
 {
     try
     {
-        I2C::transact(addr, ON, nullptr, nullptr);
+        I2C::transact(Protocol::transaction<Protocol::On>(addr, nullptr, nullptr));
         printf("test on transaction successful on slave %i \n", addr);
     }
     catch (IOFailure &e)
@@ -81,11 +66,11 @@ float openPlus(int addr, float speed)
 {
     try
     {
-        uint8_t buffer[4];
-        memcpy(buffer, UINT8_POINTER_T(&speed), sizeof(speed));
-        int32_t raw_angle;
+        Protocol::OpenPlusPayload open = { speed };
+        Protocol::AnglePayload angle;
 
-        I2C::transact(addr, OPEN_PLUS, buffer, UINT8_POINTER_T(&raw_angle));
+        I2C::transact(Protocol::transaction<Protocol::OpenPlus>(addr, &open, &angle));
+        int32_t raw_angle = angle.quad;
 
         int joint = (addr & 0b1) + (((addr >> 4) - 1) * 2); 
         float rad_angle = (raw_angle / cpr[joint]) * 2 * M_PI;
@@ -106,10 +91,8 @@ float closedPlus(int addr, float angle) // -pi to pi
     try
     {
         //printf("test closed plus on slave %i sending target angle %f\n", addr, angle);
-        uint8_t buffer[12];
-
-        float ff = 0;
-        memcpy(buffer, UINT8_POINTER_T(&ff), sizeof(ff));
+        Protocol::ClosedPayload closed;
+        closed.feed_forward = 0;
         
         int32_t raw_angle;
 
@@ -125,9 +108,11 @@ float closedPlus(int addr, float angle) // -pi to pi
         }
 
         printf("test closed plus on slave %i sending target angle %f, raw angle %i\n", addr, angle, raw_angle);
-        memcpy(buffer + 4, UINT8_POINTER_T(&raw_angle), sizeof(raw_angle));
+        closed.setpoint.quad = raw_angle;
         
-        I2C::transact(addr, CLOSED_PLUS, buffer, UINT8_POINTER_T(&raw_angle));
+        Protocol::AnglePayload read_angle;
+        I2C::transact(Protocol::transaction<Protocol::ClosedPlus>(addr, &closed, &read_angle));
+        raw_angle = read_angle.quad;
         float deg_angle = (raw_angle / cpr[joint]) * 360; 
         float rad_angle = (raw_angle / cpr[joint]) * 2 * M_PI; 
 
@@ -149,9 +134,8 @@ void configPWM(int addr, int max_speed)
 {
     try
     {
-        uint8_t buffer[2];
-        memcpy(buffer, UINT8_POINTER_T(&(max_speed)), sizeof(max_speed));
-        I2C::transact(addr, CONFIG_PWM, buffer, nullptr);
+        Protocol::ConfigPwmPayload pwm = { static_cast<uint16_t>(max_speed) };
+        I2C::transact(Protocol::transaction<Protocol::ConfigPwm>(addr, &pwm, nullptr));
         printf("test config pwm transaction successful on slave %i \n", addr);
     }
     catch (IOFailure &e)
@@ -164,11 +148,8 @@ void setKPID(int addr, float p, float i, float d)
 {
     try
     {
-        uint8_t buffer[12];
-        memcpy(buffer + 0, UINT8_POINTER_T(&p), sizeof(p));
-        memcpy(buffer + 4, UINT8_POINTER_T(&i), sizeof(i));
-        memcpy(buffer + 8, UINT8_POINTER_T(&d), sizeof(d));
-        I2C::transact(addr, CONFIG_K, buffer, nullptr);
+        Protocol::KPayload k = { p, i, d };
+        I2C::transact(Protocol::transaction<Protocol::ConfigK>(addr, &k, nullptr));
         printf("test set kpid transaction successful on slave %i \n", addr);
     }
     catch (IOFailure &e)
@@ -181,13 +162,9 @@ void getKPID(int addr)
 {
     try
     {
-        uint8_t buffer[12];
-        I2C::transact(addr, GET_K, nullptr, buffer);
-        int p, i, d;
-        memcpy(UINT8_POINTER_T(&p), buffer + 0, sizeof(p));
-        memcpy(UINT8_POINTER_T(&i), buffer + 4, sizeof(i));
-        memcpy(UINT8_POINTER_T(&d), buffer + 8, sizeof(d));
-        printf("test get kpid transaction successful on slave %i %d %d %d \n", addr, p, i, d);
+        Protocol::KPayload k;
+        I2C::transact(Protocol::transaction<Protocol::GetK>(addr, nullptr, &k));
+        printf("test get kpid transaction successful on slave %i %f %f %f \n", addr, k.kp, k.ki, k.kd);
     }
     catch (IOFailure &e)
     {
@@ -199,8 +176,9 @@ float quadEnc(int addr)
 {
     try
     {
-        int32_t raw_angle;
-        I2C::transact(addr, QUAD, nullptr, UINT8_POINTER_T(&(raw_angle)));
+        Protocol::AnglePayload angle;
+        I2C::transact(Protocol::transaction<Protocol::Quad>(addr, nullptr, &angle));
+        int32_t raw_angle = angle.quad;
 
         int joint = (addr & 0b1) + (((addr >> 4) - 1) * 2); 
         float rad_angle = (raw_angle / cpr[joint]) * 2 * M_PI;
@@ -220,8 +198,9 @@ float absEnc(int addr)
 {
     try
     {
-        float abs_raw_angle = 0;;
-        I2C::transact(addr, ABS_ENC, nullptr, UINT8_POINTER_T(&(abs_raw_angle)));
+        Protocol::AnglePayload angle;
+        I2C::transact(Protocol::transaction<Protocol::AbsEnc>(addr, nullptr, &angle));
+        float abs_raw_angle = angle.abs;
         printf("test abs transaction successful on slave %i, %f \n", addr, abs_raw_angle * (180/M_PI));
         return abs_raw_angle; // in radians 
     }
@@ -249,12 +228,10 @@ void adjust(int addr, int joint)
 
         int joint = (addr & 0b1) + (((addr >> 4) - 1) * 2); 
 
-        int32_t adjusted_quad = (abs_angle / (2 * M_PI)) * cpr[joint];
+        Protocol::AdjustPayload adjusted_quad = { static_cast<int32_t>((abs_angle / (2 * M_PI)) * cpr[joint]) };
 
         // adjust transaction 
-        uint8_t buffer[4];
-        memcpy(buffer, UINT8_POINTER_T(&(adjusted_quad)), sizeof(adjusted_quad));
-        I2C::transact(addr, ADJUST, buffer, nullptr);
+        I2C::transact(Protocol::transaction<Protocol::Adjust>(addr, &adjusted_quad, nullptr));
 
         // checks values after
         quad_angle = quadEnc(addr);
@@ -634,7 +611,10 @@ int main()
         i2c_address.push_back(get_addr(i, 1));
         sleep(20);
     }
-    I2C::init();
+    if (!I2C::init())
+    {
+        return 1;
+    }
     testOn();
     testConfigPWM();
     testAdjust();
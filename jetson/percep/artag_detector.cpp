@@ -1,4 +1,7 @@
 #include "perception.hpp"
+#include "thor_pool.hpp"
+#include <array>
+#include <cfloat>
 
 static Mat HSV;
 static Mat DEPTH;
@@ -15,6 +18,13 @@ void onMouse(int event, int x, int y, int flags, void *userdata) {
     }
 }
 
+static TagRangeSource tagRangeSource(const std::string &source) {
+    if (source == "corners") return TagRangeSource::Corners;
+    if (source == "auto") return TagRangeSource::Auto;
+    if (source != "depth") std::cerr << "unknown ar_tag.pose.range_source " << source << ", ranging from depth\n";
+    return TagRangeSource::Depth;
+}
+
 //initializes detector object with pre-generated dictionary of tags 
 TagDetector::TagDetector(const rapidjson::Document &mRoverConfig) :  
 
@@ -24,7 +34,26 @@ TagDetector::TagDetector(const rapidjson::Document &mRoverConfig) :
    DO_CORNER_REFINEMENT{!!mRoverConfig["alvar_params"]["do_corner_refinement"].GetInt()},
    POLYGONAL_APPROX_ACCURACY_RATE{mRoverConfig["alvar_params"]["polygonal_approx_accuracy_rate"].GetDouble()},
    MM_PER_M{mRoverConfig["mm_per_m"].GetInt()},
-   DEFAULT_TAG_VAL{mRoverConfig["ar_tag"]["default_tag_val"].GetInt()} {
+   DEFAULT_TAG_VAL{mRoverConfig["ar_tag"]["default_tag_val"].GetInt()},
+   RANGE_PATCH_SIZE{std::min((int)MAX_RANGE_PATCH_SIZE, std::max(1, mRoverConfig["ar_tag"]["range_patch_size"].GetInt()))},
+   MIN_RANGE_CONFIDENCE{mRoverConfig["ar_tag"]["min_range_confidence"].GetDouble()},
+   ROI_TRACKING{!!mRoverConfig["ar_tag"]["roi_tracking"].GetInt()},
+   ROI_PADDING{mRoverConfig["ar_tag"]["roi_padding"].GetDouble()},
+   REACQUIRE_INTERVAL{mRoverConfig["ar_tag"]["reacquire_interval"].GetInt()},
+   PYRAMID_LEVELS{std::max(1, mRoverConfig["ar_tag"]["pyramid_levels"].GetInt())},
+   TILE_COLS{std::max(1, mRoverConfig["ar_tag"]["tiles"]["cols"].GetInt())},
+   TILE_ROWS{std::max(1, mRoverConfig["ar_tag"]["tiles"]["rows"].GetInt())},
+   TILE_OVERLAP{mRoverConfig["ar_tag"]["tiles"]["overlap"].GetInt()},
+   RANGE_SOURCE{tagRangeSource(mRoverConfig["ar_tag"]["pose"]["range_source"].GetString())},
+   TAG_SIZE_M{mRoverConfig["ar_tag"]["pose"]["tag_size"].GetDouble()},
+   HORIZONTAL_FOV{mRoverConfig["zed_specs"]["horizontal_fov"].GetDouble()},
+   VERTICAL_FOV{mRoverConfig["zed_specs"]["vertical_fov"].GetDouble()},
+   tracker{BUFFER_ITERATIONS, DEFAULT_TAG_VAL,
+           mRoverConfig["ar_tag"]["tracker"]["bearing_process_noise"].GetDouble(),
+           mRoverConfig["ar_tag"]["tracker"]["bearing_measurement_noise"].GetDouble(),
+           mRoverConfig["ar_tag"]["tracker"]["distance_process_noise"].GetDouble(),
+           mRoverConfig["ar_tag"]["tracker"]["distance_measurement_noise"].GetDouble()},
+   tracking{false}, framesSinceFullFrame{0}, calibrated{false} {
 
     cv::FileStorage fsr("jetson/percep/alvar_dict.yml", cv::FileStorage::READ);
     if (!fsr.isOpened()) {  //throw error if dictionary file does not exist
@@ -46,9 +75,24 @@ TagDetector::TagDetector(const rapidjson::Document &mRoverConfig) :
     alvarParams->markerBorderBits = MARKER_BORDER_BITS;
     alvarParams->doCornerRefinement = DO_CORNER_REFINEMENT;
     alvarParams->polygonalApproxAccuracyRate = POLYGONAL_APPROX_ACCURACY_RATE;
+
+    pyramid.resize(PYRAMID_LEVELS);
+
+    // corners go clockwise from the top left, seen from the camera, x right and y down
+    const float half = TAG_SIZE_M / 2;
+    tagObjectPoints = {Point3f(-half, -half, 0), Point3f(half, -half, 0), Point3f(half, half, 0), Point3f(-half, half, 0)};
+
+    #if AR_GPU
+    GPUTagThresholdParams gpuParams;
+    gpuParams.minWindow = alvarParams->adaptiveThreshWinSizeMin;
+    gpuParams.maxWindow = alvarParams->adaptiveThreshWinSizeMax;
+    gpuParams.windowStep = alvarParams->adaptiveThreshWinSizeStep;
+    gpuParams.constant = alvarParams->adaptiveThreshConstant;
+    gpuThreshold.reset(new GPUTagThreshold(gpuParams));
+    #endif
 }
 
-Point2f TagDetector::getAverageTagCoordinateFromCorners(const vector<Point2f> &corners) {  //gets coordinate of center of tag
+Point2f TagDetector::getAverageTagCoordinateFromCorners(const vector<Point2f> &corners) const {  //gets coordinate of center of tag
     // RETURN:
     // Point2f object containing the average location of the 4 corners
     // of the passed-in tag
@@ -62,18 +106,41 @@ Point2f TagDetector::getAverageTagCoordinateFromCorners(const vector<Point2f> &c
     return avgCoord;
 }
 
-pair<Tag, Tag> TagDetector::findARTags(Mat &src, Mat &depth_src, Mat &rgb) {  //detects AR tags in source Mat and outputs Tag objects for use in LCM
+const std::vector<Tag> &TagDetector::findARTags(Mat &gray, Mat &src, Mat &depth_src, Mat &rgb) {  //detects AR tags in source Mat and outputs Tag objects for use in LCM
     // RETURN:
-    // pair of target objects- each object has an x and y for the center,
-    // and the tag ID number return them such that the "leftmost" (x
-    // coordinate) tag is at index 0
+    // every tag found- each has an x and y for the center, its corners,
+    // and the tag ID number, ordered so that the "leftmost" (x coordinate)
+    // tag is at index 0. Nav picks the ones it needs, so gates and posts
+    // seen together are all reported
+    // Detection runs directly on the grayscale frame from the camera, the color
+    // frame is only converted when something is going to draw on it
+    #if AR_RECORD || PERCEPTION_DEBUG
     cvtColor(src, rgb, COLOR_RGBA2RGB);
+    #endif
     // clear ids and corners vectors for each detection
     ids.clear();
     corners.clear();
 
-    // Find tags
-    cv::aruco::detectMarkers(rgb, alvarDict, corners, ids, alvarParams);
+    // Find tags, only searching around last frame's tags while they are being tracked
+    // and falling back to the full frame when they are lost or periodically to pick up new tags
+    bool fullFrame = !ROI_TRACKING || !tracking || framesSinceFullFrame >= REACQUIRE_INTERVAL;
+    if (!fullFrame) {
+        cv::Rect roi = predictROI(gray.size());
+        cv::aruco::detectMarkers(gray(roi), alvarDict, corners, ids, alvarParams);
+        for (auto &tagCorners : corners) {
+            for (auto &corner : tagCorners) {
+                corner.x += roi.x;
+                corner.y += roi.y;
+            }
+        }
+        ++framesSinceFullFrame;
+        fullFrame = ids.empty();
+    }
+    if (fullFrame) {
+        detectPyramid(gray);
+        framesSinceFullFrame = 0;
+    }
+    updateTrack();
     #if AR_RECORD
     cv::aruco::drawDetectedMarkers(rgb, corners, ids);
     #endif
@@ -90,91 +157,397 @@ pair<Tag, Tag> TagDetector::findARTags(Mat &src, Mat &depth_src, Mat &rgb) {  //
     #endif
 
     // create Tag objects for the detected tags and return them
-    pair<Tag, Tag> discoveredTags;
-    if (ids.size() == 0) {
-        // no tags found, return invalid objects with tag set to -1
-        discoveredTags.first.id = DEFAULT_TAG_VAL;
-        discoveredTags.first.loc = Point2f();
-        discoveredTags.second.id = DEFAULT_TAG_VAL;
-        discoveredTags.second.loc = Point2f();
-
-    } else if (ids.size() == 1) {  // exactly one tag found
-        discoveredTags.first.id = ids[0];
-        discoveredTags.first.loc = getAverageTagCoordinateFromCorners(corners[0]);
-        // set second tag to invalid object with tag as -1
-        discoveredTags.second.id = DEFAULT_TAG_VAL;
-        discoveredTags.second.loc = Point2f();
-    } else if (ids.size() == 2) {  // exactly two tags found
-        Tag t0, t1;
-        t0.id = ids[0];
-        t0.loc = getAverageTagCoordinateFromCorners(corners[0]);
-        t1.id = ids[1];
-        t1.loc = getAverageTagCoordinateFromCorners(corners[1]);
-        if (t0.loc.x < t1.loc.x) {  //if tag 0 is left of tag 1, put t0 first
-            discoveredTags.first = t0;
-            discoveredTags.second = t1;
-        } else {  //tag 1 is left of tag 0, put t1 first
-            discoveredTags.first = t1;
-            discoveredTags.second = t0;
+    discoveredTags.clear();
+    for (size_t i = 0; i < ids.size(); ++i) discoveredTags.push_back(makeTag(i));
+    std::sort(discoveredTags.begin(), discoveredTags.end(), [](const Tag &a, const Tag &b) {
+        return a.loc.x < b.loc.x;
+    });
+    return discoveredTags;
+}
+
+void TagDetector::detectPyramid(const Mat &img) {
+    // Searches from the coarsest level down to native resolution. Large (close) tags
+    // are found cheaply on the small images and confirmed at full resolution only in
+    // their neighborhood, small (far) tags are still caught by the finer levels.
+    // Once both gate tags are confirmed the finer levels are skipped.
+    ids.clear();
+    corners.clear();
+
+    std::vector<int> levelIds;
+    std::vector<std::vector<Point2f> > levelCorners;
+    for (int level = PYRAMID_LEVELS - 1; level >= 0; --level) {
+        levelIds.clear();
+        levelCorners.clear();
+
+        #if AR_GPU
+        if (level == 0) {
+            detectGPU(img);
+            return;
+        }
+        #endif
+        if (level == 0 && TILE_COLS * TILE_ROWS > 1) {
+            detectTiled(img);
+            return;
+        }
+        if (level == 0) {
+            cv::aruco::detectMarkers(img, alvarDict, levelCorners, levelIds, alvarParams);
+            for (size_t i = 0; i < levelIds.size(); ++i) {
+                addTag(levelIds[i], levelCorners[i]);
+            }
+            return;
         }
-    } else {  // detected >=3 tags
-        // return leftmost and rightsmost detected tags to account for potentially seeing 2 of each tag on a post
-        Tag t0, t1;
-        t0.id = ids[0];
-        t0.loc = getAverageTagCoordinateFromCorners(corners[0]);
-        t1.id = ids[ids.size() - 1];
-        t1.loc = getAverageTagCoordinateFromCorners(corners[ids.size() - 1]);
-        if (t0.loc.x < t1.loc.x) {  //if tag 0 is left of tag 1, put t0 first
-            discoveredTags.first = t0;
-            discoveredTags.second = t1;
-        } else {  //tag 1 is left of tag 0, put t1 first
-            discoveredTags.first = t1;
-            discoveredTags.second = t0;
+
+        double scale = 1.0 / (1 << level);
+        cv::resize(img, pyramid[level], Size(), scale, scale, INTER_AREA);
+        cv::aruco::detectMarkers(pyramid[level], alvarDict, levelCorners, levelIds, alvarParams);
+
+        for (auto &candidate : levelCorners) {
+            for (auto &corner : candidate) {
+                corner /= scale;
+            }
+            refineCandidate(img, candidate);
+            if (ids.size() >= 2) return;
+        }
+    }
+}
+
+void TagDetector::detectTiled(const Mat &img) {
+    // Tiles overlap by TILE_OVERLAP pixels, so a tag up to that size on a seam is whole in at
+    // least one tile. Larger tags are the close ones the coarser pyramid levels already found.
+    // A tag seen whole by two tiles is dropped the second time by addTag.
+    if (tiles.empty() || tileFrameSize != img.size()) {
+        tileFrameSize = img.size();
+        tiles.clear();
+        for (int r = 0; r < TILE_ROWS; ++r) {
+            for (int c = 0; c < TILE_COLS; ++c) {
+                cv::Rect tile(c * img.cols / TILE_COLS - TILE_OVERLAP / 2, r * img.rows / TILE_ROWS - TILE_OVERLAP / 2,
+                              img.cols / TILE_COLS + TILE_OVERLAP, img.rows / TILE_ROWS + TILE_OVERLAP);
+                tile &= cv::Rect(0, 0, img.cols, img.rows);
+                tiles.push_back(tile);
+            }
+        }
+        tileIds.resize(tiles.size());
+        tileCorners.resize(tiles.size());
+    }
+
+    Thor::parallel_for(0, tiles.size(), 1, [&](size_t i) {
+        tileIds[i].clear();
+        tileCorners[i].clear();
+        cv::aruco::detectMarkers(img(tiles[i]), alvarDict, tileCorners[i], tileIds[i], alvarParams);
+    });
+
+    // merged in tile order, so the result doesn't depend on which tile finished first
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        for (size_t j = 0; j < tileIds[i].size(); ++j) {
+            for (auto &corner : tileCorners[i][j]) {
+                corner.x += tiles[i].x;
+                corner.y += tiles[i].y;
+            }
+            addTag(tileIds[i][j], tileCorners[i][j]);
         }
     }
-    return discoveredTags;
+}
+
+#if AR_GPU
+/* --- GPU Candidates --- */
+//Keeps the convex quads of one threshold mask that pass cv::aruco's contour filters, in
+//clockwise order like cv::aruco puts them. Quads whose corners all lie close to a quad that
+//was already kept, such as the same tag in another window's mask, are only kept once
+static void findQuads(Mat &mask, const cv::aruco::DetectorParameters &params,
+                      std::vector<std::vector<Point> > &contours, std::vector<std::vector<Point2f> > &quads) {
+    const int maxSize = std::max(mask.cols, mask.rows);
+    const size_t minPerimeter = params.minMarkerPerimeterRate * maxSize;
+    const size_t maxPerimeter = params.maxMarkerPerimeterRate * maxSize;
+    const int border = params.minDistanceToBorder;
+
+    //the mask is remade every frame, so findContours may write over it
+    contours.clear();
+    cv::findContours(mask, contours, RETR_LIST, CHAIN_APPROX_NONE);
+
+    std::vector<Point> approx;
+    for (auto &contour : contours) {
+        if (contour.size() < minPerimeter || contour.size() > maxPerimeter) continue;
+        cv::approxPolyDP(contour, approx, contour.size() * params.polygonalApproxAccuracyRate, true);
+        if (approx.size() != 4 || !cv::isContourConvex(approx)) continue;
+
+        double minSideSq = DBL_MAX;
+        bool nearBorder = false;
+        for (int j = 0; j < 4; ++j) {
+            Point side = approx[j] - approx[(j + 1) % 4];
+            minSideSq = std::min(minSideSq, (double)side.dot(side));
+            nearBorder = nearBorder || approx[j].x < border || approx[j].y < border ||
+                         approx[j].x > mask.cols - 1 - border || approx[j].y > mask.rows - 1 - border;
+        }
+        double minSide = contour.size() * params.minCornerDistanceRate;
+        if (minSideSq < minSide * minSide || nearBorder) continue;
+
+        std::vector<Point2f> quad(approx.begin(), approx.end());
+        Point2f v1 = quad[1] - quad[0], v2 = quad[2] - quad[0];
+        if (v1.x * v2.y - v1.y * v2.x < 0) std::swap(quad[1], quad[3]);
+
+        double minDistance = params.minMarkerDistanceRate * contour.size();
+        bool duplicate = false;
+        for (auto &kept : quads) {
+            double distSq = 0;
+            for (int j = 0; j < 4; ++j) {
+                Point2f d = kept[j] - quad[j];
+                distSq += d.dot(d);
+            }
+            duplicate = duplicate || distSq / 4 < minDistance * minDistance;
+        }
+        if (!duplicate) quads.push_back(quad);
+    }
+}
+
+void TagDetector::detectGPU(const Mat &img) {
+    gpuThreshold->run(img.ptr(), img.step, img.rows, img.cols, gpuMasks);
+
+    gpuQuads.clear();
+    for (auto &maskBytes : gpuMasks) {
+        Mat mask(img.rows, img.cols, CV_8UC1, maskBytes.data());
+        findQuads(mask, *alvarParams, gpuContours, gpuQuads);
+    }
+
+    int id;
+    for (auto &quad : gpuQuads) {
+        if (decodeQuad(img, quad, id)) addTag(id, quad);
+    }
+}
+
+bool TagDetector::decodeQuad(const Mat &img, std::vector<Point2f> &quad, int &id) {
+    // Same steps as cv::aruco's marker identification: the quad is warped to a square of
+    // cells, split with Otsu, and each cell is a 1 if most of its center is white
+    const int markerSize = alvarDict->markerSize;
+    const int borderBits = alvarParams->markerBorderBits;
+    const int cells = markerSize + 2 * borderBits;
+    const int cellPixels = alvarParams->perspectiveRemovePixelPerCell;
+    const int side = cells * cellPixels;
+
+    Point2f square[4] = {Point2f(0, 0), Point2f(side - 1, 0), Point2f(side - 1, side - 1), Point2f(0, side - 1)};
+    Mat transform = cv::getPerspectiveTransform(quad.data(), square);
+    cv::warpPerspective(img, warpedQuad, transform, Size(side, side), INTER_NEAREST);
+
+    // a quad of one shade has nothing for Otsu to split
+    Scalar mean, stddev;
+    cv::meanStdDev(warpedQuad, mean, stddev);
+    if (stddev[0] < alvarParams->minOtsuStdDev) return false;
+    cv::threshold(warpedQuad, warpedQuad, 125, 255, THRESH_BINARY | THRESH_OTSU);
+
+    const int margin = cellPixels * alvarParams->perspectiveRemoveIgnoredMarginPerCell;
+    Mat bits(cells, cells, CV_8UC1);
+    int borderErrors = 0;
+    for (int y = 0; y < cells; ++y) {
+        for (int x = 0; x < cells; ++x) {
+            Mat cell = warpedQuad(Rect(x * cellPixels + margin, y * cellPixels + margin,
+                                       cellPixels - 2 * margin, cellPixels - 2 * margin));
+            bits.at<uchar>(y, x) = cv::countNonZero(cell) > (int)cell.total() / 2;
+            bool inBorder = y < borderBits || y >= cells - borderBits || x < borderBits || x >= cells - borderBits;
+            borderErrors += inBorder && bits.at<uchar>(y, x);
+        }
+    }
+    if (borderErrors > (int)(markerSize * markerSize * alvarParams->maxErroneousBitsInBorderRate)) return false;
+
+    int rotation;
+    Mat onlyBits = bits(Rect(borderBits, borderBits, markerSize, markerSize)).clone();
+    if (!alvarDict->identify(onlyBits, id, rotation, alvarParams->errorCorrectionRate)) return false;
+    std::rotate(quad.begin(), quad.begin() + 4 - rotation, quad.end());
+
+    if (DO_CORNER_REFINEMENT) {
+        cv::cornerSubPix(img, quad, Size(alvarParams->cornerRefinementWinSize, alvarParams->cornerRefinementWinSize),
+                         Size(-1, -1), TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
+                                                    alvarParams->cornerRefinementMaxIterations,
+                                                    alvarParams->cornerRefinementMinAccuracy));
+    }
+    return true;
+}
+#endif
+
+void TagDetector::refineCandidate(const Mat &img, const std::vector<Point2f> &candidate) {
+    cv::Rect box = cv::boundingRect(candidate);
+    int pad = std::max(box.width, box.height) / 2 + 1;
+    cv::Rect roi(box.x - pad, box.y - pad, box.width + 2 * pad, box.height + 2 * pad);
+    roi &= cv::Rect(0, 0, img.cols, img.rows);
+    if (roi.area() == 0) return;
+
+    std::vector<int> refinedIds;
+    std::vector<std::vector<Point2f> > refinedCorners;
+    cv::aruco::detectMarkers(img(roi), alvarDict, refinedCorners, refinedIds, alvarParams);
+    for (size_t i = 0; i < refinedIds.size(); ++i) {
+        for (auto &corner : refinedCorners[i]) {
+            corner.x += roi.x;
+            corner.y += roi.y;
+        }
+        addTag(refinedIds[i], refinedCorners[i]);
+    }
+}
+
+void TagDetector::addTag(int id, const std::vector<Point2f> &tagCorners) {
+    // the same tag can be confirmed from two candidates or two levels
+    Point2f center = getAverageTagCoordinateFromCorners(tagCorners);
+    float size = cv::norm(tagCorners[0] - tagCorners[2]);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] == id && cv::norm(getAverageTagCoordinateFromCorners(corners[i]) - center) < size / 2) {
+            return;
+        }
+    }
+    ids.push_back(id);
+    corners.push_back(tagCorners);
+}
+
+cv::Rect TagDetector::predictROI(const cv::Size &frameSize) const {
+    // RETURN:
+    // last frame's bounding box of all tags, moved by how far it moved last frame
+    // and padded by ROI_PADDING tag sizes on every side
+    cv::Rect2f predicted = lastTagBox + tagBoxVelocity;
+    float pad = ROI_PADDING * std::max(predicted.width, predicted.height);
+    predicted.x -= pad;
+    predicted.y -= pad;
+    predicted.width += 2 * pad;
+    predicted.height += 2 * pad;
+
+    cv::Rect roi(cvFloor(predicted.x), cvFloor(predicted.y), cvCeil(predicted.width), cvCeil(predicted.height));
+    roi &= cv::Rect(0, 0, frameSize.width, frameSize.height);
+    if (roi.area() == 0) {
+        return cv::Rect(0, 0, frameSize.width, frameSize.height);
+    }
+    return roi;
+}
+
+void TagDetector::updateTrack() {
+    if (ids.empty()) {
+        tracking = false;
+        tagBoxVelocity = Point2f();
+        return;
+    }
+
+    // bounding box around the corners of every detected tag
+    cv::Rect2f box = cv::boundingRect(corners[0]);
+    for (size_t i = 1; i < corners.size(); ++i) {
+        box |= cv::Rect2f(cv::boundingRect(corners[i]));
+    }
+
+    // only trust a velocity between two consecutive tracked frames
+    Point2f center(box.x + box.width / 2, box.y + box.height / 2);
+    Point2f lastCenter(lastTagBox.x + lastTagBox.width / 2, lastTagBox.y + lastTagBox.height / 2);
+    tagBoxVelocity = tracking ? center - lastCenter : Point2f();
+    lastTagBox = box;
+    tracking = true;
+}
+
+void TagDetector::setIntrinsics(const cv::Matx33d &intrinsics) {
+    // an all zero matrix is a camera without calibration
+    calibrated = intrinsics(0, 0) > 0 && intrinsics(1, 1) > 0;
+    if (calibrated) cameraMatrix = intrinsics;
+    intrinsicsSize = Size();
+}
+
+bool TagDetector::needsDepth() const {
+    return RANGE_SOURCE != TagRangeSource::Corners;
+}
+
+void TagDetector::prepareIntrinsics(const Size &frameSize) {
+    if (calibrated || frameSize == intrinsicsSize) return;
+    intrinsicsSize = frameSize;
+    double fx = (frameSize.width / 2.0) / tan(HORIZONTAL_FOV / 2 * PI / 180);
+    double fy = (frameSize.height / 2.0) / tan(VERTICAL_FOV / 2 * PI / 180);
+    cameraMatrix = cv::Matx33d(fx, 0, frameSize.width / 2.0, 0, fy, frameSize.height / 2.0, 0, 0, 1);
 }
 
 double TagDetector::getAngle(float xPixel, float wPixel){
-    double fieldofView = 110 * PI/180;
-    return atan((xPixel - wPixel/2)/(wPixel/2)* tan(fieldofView/2))* 180.0 /PI;
-}
-
-void TagDetector::updateDetectedTagInfo(rover_msgs::Target *arTags, pair<Tag, Tag> &tagPair, Mat &depth_img, Mat &src){
-    struct tagPairs {
-        vector<int> id;
-        vector<int> locx;
-        vector<int> locy;
-        vector<int> buffer;
-    }; 
-    tagPairs tags;
-
-    tags.id.push_back(tagPair.first.id);
-    tags.locx.push_back(tagPair.first.loc.x);
-    tags.locy.push_back(tagPair.first.loc.y);
-    tags.id.push_back(tagPair.second.id);
-    tags.locx.push_back(tagPair.second.loc.x);
-    tags.locy.push_back(tagPair.second.loc.y);
-    tags.buffer.push_back(0);
-    tags.buffer.push_back(0);
-
-  for (uint i=0; i<2; i++) {
-    if(tags.id[i] == DEFAULT_TAG_VAL){ //no tag found
-        if(tags.buffer[i] <= BUFFER_ITERATIONS){ //send buffered tag until tag is found
-            ++tags.buffer[i];
-        } else { //if still no tag found, set all stats to -1
-            arTags[i].distance = DEFAULT_TAG_VAL;
-            arTags[i].bearing = DEFAULT_TAG_VAL;
-            arTags[i].id = DEFAULT_TAG_VAL;
+    (void)wPixel;
+    return atan((xPixel - cameraMatrix(0, 2)) / cameraMatrix(0, 0)) * 180.0 / PI;
+}
+
+TagRange TagDetector::estimateTagPose(const Tag &tag) const {
+    // RETURN:
+    // depth of the tag's center along the optical axis, the same thing the depth image
+    // measures, from the pose that maps the tag's known corners onto the detected ones
+    TagRange range;
+    range.distance = DEFAULT_TAG_VAL;
+    range.confidence = 0;
+
+    std::vector<Point2f> imagePoints(tag.corners, tag.corners + 4);
+    Mat rvec, tvec;
+    if (!cv::solvePnP(tagObjectPoints, imagePoints, Mat(cameraMatrix), noArray(), rvec, tvec,
+                      false, SOLVEPNP_ITERATIVE)) {
+        return range;
+    }
+    double z = tvec.at<double>(2);
+    if (!std::isfinite(z) || z <= 0) return range;
+    range.distance = z;
+    range.confidence = 1;
+    return range;
+}
+
+TagRange TagDetector::estimateTagRange(const Tag &tag, const Mat &depth_img) const {
+    // RETURN:
+    // median depth over a RANGE_PATCH_SIZE x RANGE_PATCH_SIZE grid of samples spread
+    // over the inner half of the tag quad, and the fraction of samples that were valid
+    // Sampling inside the quad keeps samples off the background around the tag edges
+    std::array<float, MAX_RANGE_SAMPLES> samples;
+    int numValid = 0;
+    const int patch = RANGE_PATCH_SIZE;
+    for (int row = 0; row < patch; ++row) {
+        float v = patch == 1 ? 0.5f : 0.25f + 0.5f * row / (patch - 1);
+        for (int col = 0; col < patch; ++col) {
+            float u = patch == 1 ? 0.5f : 0.25f + 0.5f * col / (patch - 1);
+            // bilinear interpolation between the four corners of the quad
+            Point2f top = tag.corners[0] + u * (tag.corners[1] - tag.corners[0]);
+            Point2f bottom = tag.corners[3] + u * (tag.corners[2] - tag.corners[3]);
+            Point2f pt = top + v * (bottom - top);
+
+            int x = cvRound(pt.x), y = cvRound(pt.y);
+            if (x < 0 || y < 0 || x >= depth_img.cols || y >= depth_img.rows) continue;
+            float d = depth_img.at<float>(y, x);
+            if (std::isfinite(d) && d > 0) {
+                samples[numValid++] = d;
+            }
+        }
+    }
+
+    TagRange range;
+    range.confidence = (double)numValid / (patch * patch);
+    range.distance = DEFAULT_TAG_VAL;
+    if (numValid > 0) {
+        std::nth_element(samples.begin(), samples.begin() + numValid / 2, samples.begin() + numValid);
+        range.distance = samples[numValid / 2] / MM_PER_M;
+    }
+    return range;
+}
+
+void TagDetector::updateDetectedTagInfo(rover_msgs::TargetList &arTags, const std::vector<Tag> &tags, Mat &depth_img, Mat &src){
+    prepareIntrinsics(src.size());
+    tracker.beginFrame();
+    for (const Tag &tag : tags) {
+        // only trust the range when enough of the tag has valid depth, the corners
+        // stand in for depth that is missing when ranging from both
+        TagRange range;
+        range.confidence = 0;
+        if (needsDepth() && !depth_img.empty()) range = estimateTagRange(tag, depth_img);
+        if (RANGE_SOURCE == TagRangeSource::Corners ||
+            (RANGE_SOURCE == TagRangeSource::Auto && range.confidence < MIN_RANGE_CONFIDENCE)) {
+            range = estimateTagPose(tag);
         }
-     } else { //tag found
-    if(!isnan(depth_img.at<float>(tags.locy.at(i), tags.locx.at(i)))) {
-        arTags[i].distance = depth_img.at<float>(tags.locy.at(i), tags.locx.at(i)) / MM_PER_M;
+        tracker.observe(tag.id, getAngle(tag.loc.x, src.cols),
+                        range.confidence >= MIN_RANGE_CONFIDENCE, range.distance,
+                        range.confidence, tag.cornerConfidence);
     }
-        arTags[i].bearing = getAngle((int)tags.locx.at(i), src.cols);
-        arTags[i].id = tags.id.at(i);
-        tags.buffer[i] = 0;
-   }
-  }
+    // smoothed tags, including ones that are coasting since they were last seen
+    tracker.endFrame(arTags.targetList, arTags.tags);
+    arTags.num_tags = arTags.tags.size();
 }
 
+Tag TagDetector::makeTag(size_t i) const {
+    Tag tag;
+    tag.id = ids[i];
+    tag.loc = getAverageTagCoordinateFromCorners(corners[i]);
+    std::copy(corners[i].begin(), corners[i].begin() + 4, tag.corners);
+    double shortest = DBL_MAX, longest = 0;
+    for (int corner = 0; corner < 4; ++corner) {
+        const double side = cv::norm(tag.corners[corner] - tag.corners[(corner + 1) % 4]);
+        shortest = std::min(shortest, side);
+        longest = std::max(longest, side);
+    }
+    tag.cornerConfidence = longest > 0 ? shortest / longest : 0;
+    return tag;
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include "perception.hpp"
-#include "rover_msgs/Target.hpp"
+#include "artag_gpu.hpp"
+#include "rover_msgs/TargetList.hpp"
+#include "tag_tracker.hpp"
 
 using namespace std;
 using namespace cv;
@@ -10,8 +13,21 @@ using namespace cv;
 struct Tag {
     Point2f loc;
     int id;
+    Point2f corners[4];
+    //shortest over longest side of the corners
+    double cornerConfidence;
 };
 
+//Distance to a tag and the fraction of depth samples it was estimated from
+struct TagRange {
+    double distance;
+    double confidence;
+};
+
+//Where tag ranges come from: the depth image, the tag's corners with the tag size and the
+//camera matrix alone, or depth and the corners wherever depth had too few samples
+enum class TagRangeSource { Depth, Corners, Auto };
+
 class TagDetector {
    private:
     Ptr<cv::aruco::Dictionary> alvarDict;
@@ -19,6 +35,61 @@ class TagDetector {
     std::vector<int> ids;
     std::vector<std::vector<cv::Point2f> > corners;
     cv::Mat rgb;
+
+    //Region of interest tracking state
+    bool tracking;
+    int framesSinceFullFrame;
+    cv::Rect2f lastTagBox;
+    cv::Point2f tagBoxVelocity;
+
+    //predicts where the tags from last frame are now, padded and clipped to the frame
+    cv::Rect predictROI(const cv::Size &frameSize) const;
+    //updates the tracking state from the tags detected this frame
+    void updateTrack();
+
+    //Downscaled copies of the frame reused by the coarse to fine search
+    std::vector<cv::Mat> pyramid;
+
+    //coarse to fine detection over the whole frame, stops once two tags are confirmed
+    void detectPyramid(const cv::Mat &img);
+    //full resolution detection split into overlapping tiles run across the Thor pool
+    void detectTiled(const cv::Mat &img);
+    //Tile grid of the last frame, with each tile's detections kept between frames
+    cv::Size tileFrameSize;
+    std::vector<cv::Rect> tiles;
+    std::vector<std::vector<int> > tileIds;
+    std::vector<std::vector<std::vector<cv::Point2f> > > tileCorners;
+    #if AR_GPU
+    //full resolution detection with the thresholds made on the GPU, the quads are fit
+    //to their contours and decoded with the dictionary on the CPU
+    void detectGPU(const cv::Mat &img);
+    //reads a quad's cells and looks them up in the dictionary, rotating the quad to the tag's
+    //first corner. Returns false if it isn't a tag
+    bool decodeQuad(const cv::Mat &img, std::vector<cv::Point2f> &quad, int &id);
+    std::unique_ptr<GPUTagThreshold> gpuThreshold;
+    std::vector<std::vector<unsigned char> > gpuMasks;
+    std::vector<std::vector<cv::Point> > gpuContours;
+    std::vector<std::vector<cv::Point2f> > gpuQuads;
+    cv::Mat warpedQuad;
+    #endif
+    //confirms a candidate by detecting again at full resolution around its corners
+    void refineCandidate(const cv::Mat &img, const std::vector<cv::Point2f> &candidate);
+    //adds a tag to ids and corners unless the same tag was already found
+    void addTag(int id, const std::vector<cv::Point2f> &tagCorners);
+
+    //Camera matrix, from setIntrinsics or else made from the field of view for the frame size
+    cv::Matx33d cameraMatrix;
+    bool calibrated;
+    cv::Size intrinsicsSize;
+    //Tag corners in the tag's frame, in the order cv::aruco gives them
+    std::vector<cv::Point3f> tagObjectPoints;
+    //makes the camera matrix for a frame size unless a calibrated one was set
+    void prepareIntrinsics(const cv::Size &frameSize);
+
+    //builds the Tag for the i-th detection
+    Tag makeTag(size_t i) const;
+    //Tags of the frame, reused so detecting doesn't allocate
+    std::vector<Tag> discoveredTags;
     
    public:
    //Constants:
@@ -28,16 +99,44 @@ class TagDetector {
    double POLYGONAL_APPROX_ACCURACY_RATE;
    int MM_PER_M;
    int DEFAULT_TAG_VAL;
+   enum { MAX_RANGE_PATCH_SIZE = 7, MAX_RANGE_SAMPLES = MAX_RANGE_PATCH_SIZE * MAX_RANGE_PATCH_SIZE };
+   int RANGE_PATCH_SIZE;
+   double MIN_RANGE_CONFIDENCE;
+   bool ROI_TRACKING;
+   double ROI_PADDING;
+   int REACQUIRE_INTERVAL;
+   int PYRAMID_LEVELS;
+   int TILE_COLS;
+   int TILE_ROWS;
+   int TILE_OVERLAP;
+   TagRangeSource RANGE_SOURCE;
+   double TAG_SIZE_M;
+   double HORIZONTAL_FOV;
+   double VERTICAL_FOV;
+
+   //smooths tags across frames and coasts them for BUFFER_ITERATIONS frames
+   TagTracker tracker;
 
     //constructor loads alvar dictionary data from file that defines tag bit configurations
     TagDetector(const rapidjson::Document &mRoverConfig);    
     //takes detected AR tag and finds center coordinate for use with ZED                                                                 
-    Point2f getAverageTagCoordinateFromCorners(const vector<Point2f> &corners);
-    //detects AR tags in a given Mat     
-    pair<Tag, Tag> findARTags(Mat &src, Mat &depth_src, Mat &rgb);    
-    //finds the angle from center given pixel coordinates              
+    Point2f getAverageTagCoordinateFromCorners(const vector<Point2f> &corners) const;
+    //detects AR tags in a given grayscale Mat, src is only used to draw debug and recording output into rgb.
+    //Returns every tag found, leftmost first
+    const std::vector<Tag> &findARTags(Mat &gray, Mat &src, Mat &depth_src, Mat &rgb);
+    //uses a calibrated camera matrix for the frames' resolution instead of the field of view
+    void setIntrinsics(const cv::Matx33d &intrinsics);
+    //whether ranging the tags needs the depth image
+    bool needsDepth() const;
+    //finds the angle from center given pixel coordinates, the camera matrix must be prepared
     double getAngle(float xPixel, float wPixel);     
-    //if AR tag found, updates distance, bearing, and id                              
-    void updateDetectedTagInfo(rover_msgs::Target *arTags, pair<Tag, Tag> &tagPair, Mat &depth_img, Mat &src); 
+    //estimates the distance to a tag from a patch of depth samples inside it
+    TagRange estimateTagRange(const Tag &tag, const Mat &depth_img) const;
+    //estimates the distance to a tag from its corners and the tag size, confidence is 0
+    //if the pose couldn't be solved for
+    TagRange estimateTagPose(const Tag &tag) const;
+    //ranges the tags found and updates the tracked tags in arTags, the two most recently
+    //seen in its two target slots and all of them in its tags
+    void updateDetectedTagInfo(rover_msgs::TargetList &arTags, const std::vector<Tag> &tags, Mat &depth_img, Mat &src);
     
 };
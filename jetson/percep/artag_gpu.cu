@@ -0,0 +1,140 @@
+#include "artag_gpu.hpp"
+
+#if AR_GPU
+
+#include <cuda_runtime.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+//Threads of a block, one pixel each
+const int BLOCK_X = 32;
+const int BLOCK_Y = 8;
+
+inline dim3 gridFor(int rows, int cols) {
+    return dim3((cols + BLOCK_X - 1) / BLOCK_X, (rows + BLOCK_Y - 1) / BLOCK_Y);
+}
+
+//Window sizes the way cv::aruco makes them, always odd
+inline int windowSize(const GPUTagThresholdParams &p, int i) {
+    int size = p.minWindow + i * p.windowStep;
+    return size % 2 == 0 ? size + 1 : size;
+}
+
+/* --- Box Filter Rows --- */
+//Sums each pixel's row neighborhood, replicating the edge pixels like BORDER_REPLICATE
+__global__ void rowSumKernel(const unsigned char *gray, int step, int rows, int cols,
+                             int radius, int *sums) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= cols || y >= rows) return;
+
+    const unsigned char *row = gray + (size_t)y * step;
+    int sum = 0;
+    for (int k = -radius; k <= radius; ++k) {
+        sum += row[min(max(x + k, 0), cols - 1)];
+    }
+    sums[(size_t)y * cols + x] = sum;
+}
+
+/* --- Box Filter Columns + Threshold --- */
+//Finishes the window sum down the columns, rounds it to a mean like the 8 bit box filter
+//does, and marks pixels darker than the mean by the floored constant like THRESH_BINARY_INV
+__global__ void thresholdKernel(const unsigned char *gray, int step, const int *sums,
+                                int rows, int cols, int radius, int delta, unsigned char *mask) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= cols || y >= rows) return;
+
+    int sum = 0;
+    for (int k = -radius; k <= radius; ++k) {
+        sum += sums[(size_t)min(max(y + k, 0), rows - 1) * cols + x];
+    }
+    int size = 2 * radius + 1;
+    int mean = __float2int_rn((float)sum / (size * size));
+    int diff = (int)gray[(size_t)y * step + x] - mean;
+    mask[(size_t)y * cols + x] = diff <= -delta ? 255 : 0;
+}
+
+} // namespace
+
+struct GPUTagThreshold::Impl {
+    GPUTagThresholdParams params;
+    int windows;
+
+    //Device buffers grow to the largest frame seen and are reused every frame
+    size_t capacity;
+    unsigned char *gray;
+    int *sums;
+    unsigned char *masks;
+
+    explicit Impl(const GPUTagThresholdParams &p) :
+        params(p), windows(std::max(1, (p.maxWindow - p.minWindow) / std::max(1, p.windowStep) + 1)),
+        capacity(0), gray(nullptr), sums(nullptr), masks(nullptr) {}
+
+    ~Impl() {
+        release();
+    }
+
+    void release() {
+        cudaFree(gray);
+        cudaFree(sums);
+        cudaFree(masks);
+        gray = nullptr;
+        sums = nullptr;
+        masks = nullptr;
+        capacity = 0;
+    }
+
+    void reserve(size_t pixels) {
+        if (pixels <= capacity) return;
+        release();
+        cudaMalloc(&gray, pixels);
+        cudaMalloc(&sums, pixels * sizeof(int));
+        cudaMalloc(&masks, pixels * windows);
+        capacity = pixels;
+    }
+};
+
+GPUTagThreshold::GPUTagThreshold(const GPUTagThresholdParams &params) :
+    impl_{new Impl(params)} {}
+
+GPUTagThreshold::~GPUTagThreshold() {
+    delete impl_;
+}
+
+int GPUTagThreshold::windows() const {
+    return impl_->windows;
+}
+
+void GPUTagThreshold::run(const unsigned char *gray, size_t step, int rows, int cols,
+                          std::vector<std::vector<unsigned char>> &masks) {
+    Impl &d = *impl_;
+    masks.resize(d.windows);
+    if (rows <= 0 || cols <= 0) return;
+
+    const size_t pixels = (size_t)rows * cols;
+    d.reserve(pixels);
+
+    //Upload the frame once, packed, every window below works in device memory
+    cudaMemcpy2D(d.gray, cols, gray, step, cols, rows, cudaMemcpyHostToDevice);
+
+    const int delta = (int)std::floor(d.params.constant);
+    const dim3 block(BLOCK_X, BLOCK_Y);
+    const dim3 grid = gridFor(rows, cols);
+    for (int i = 0; i < d.windows; ++i) {
+        const int radius = windowSize(d.params, i) / 2;
+        rowSumKernel<<<grid, block>>>(d.gray, cols, rows, cols, radius, d.sums);
+        thresholdKernel<<<grid, block>>>(d.gray, cols, d.sums, rows, cols, radius, delta,
+                                         d.masks + i * pixels);
+    }
+
+    //The copies wait for the kernels, the masks keep their capacity between frames
+    for (int i = 0; i < d.windows; ++i) {
+        masks[i].resize(pixels);
+        cudaMemcpy(masks[i].data(), d.masks + i * pixels, pixels, cudaMemcpyDeviceToHost);
+    }
+}
+
+#endif
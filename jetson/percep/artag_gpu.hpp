@@ -0,0 +1,45 @@
+#pragma once
+
+#include "config.h"
+
+#if AR_GPU
+
+#include <cstddef>
+#include <vector>
+
+//This header is shared between artag_detector.cpp and artag_gpu.cu, so it must not
+//pull in OpenCV which nvcc cannot compile
+
+/* --- GPU Tag Threshold Parameters --- */
+//Mirrors the adaptive threshold settings of cv::aruco::DetectorParameters
+struct GPUTagThresholdParams {
+    int minWindow;
+    int maxWindow;
+    int windowStep;
+    double constant;
+};
+
+/* --- GPU Tag Threshold --- */
+//Runs ArUco's adaptive thresholds for every window size on the GPU. The frame is uploaded
+//once and each window's mask is made with a separable box filter in device memory, the
+//same mask cv::adaptiveThreshold gives with ADAPTIVE_THRESH_MEAN_C and THRESH_BINARY_INV
+class GPUTagThreshold {
+public:
+    explicit GPUTagThreshold(const GPUTagThresholdParams &params);
+    ~GPUTagThreshold();
+
+    //Number of window sizes, and so of masks run makes
+    int windows() const;
+
+    //gray: rows * cols bytes, each row step bytes apart
+    //masks: resized to windows() masks of rows * cols bytes, 255 where the pixel is darker
+    //than its window's mean by more than the constant
+    void run(const unsigned char *gray, size_t step, int rows, int cols,
+             std::vector<std::vector<unsigned char>> &masks);
+
+private:
+    struct Impl;
+    Impl *impl_;
+};
+
+#endif
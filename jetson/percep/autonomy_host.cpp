@@ -0,0 +1,49 @@
+#include "perception_component.hpp"
+#include "navComponent.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+/* --- Perception To Nav --- */
+//Hands perception's results straight to the state machine, whose inputs are
+//safe to update from another thread, instead of over LCM
+class NavListener : public PerceptionListener {
+public:
+    explicit NavListener(StateMachine &stateMachine) : stateMachine_(stateMachine) {}
+
+    void perceptionFrame(const rover_msgs::PerceptionFrame &perceptionFrame) override {
+        stateMachine_.updateRoverStatus(perceptionFrame);
+    }
+
+    void perceptionLatency(const rover_msgs::PerceptionLatency &perceptionLatency) override {
+        stateMachine_.updateRoverStatus(perceptionLatency);
+    }
+
+private:
+    StateMachine &stateMachine_;
+};
+
+//Runs perception and nav in one process on one LCM object, nav on its own
+//thread and perception on this one, until perception runs out of frames
+int main() {
+    Trace::start("autonomy");
+    lcm::LCM lcm;
+    if (!lcm.good()) {
+        cerr << "Error: cannot create LCM\n";
+        return 1;
+    }
+
+    NavComponent nav(lcm, true);
+    atomic<bool> running(true);
+    thread navThread([&]() { nav.run(running); });
+
+    NavListener listener(nav.stateMachine());
+    int status = runPerception(lcm, &listener);
+
+    running = false;
+    navThread.join();
+    return status;
+}
@@ -0,0 +1,201 @@
+#include "perception.hpp"
+#include "config_loader.hpp"
+#include "frame_log.hpp"
+#include "stage_timer.hpp"
+#include "trace.hpp"
+#include "rover_msgs/TargetList.hpp"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+//Runs the AR and obstacle pipelines over a recorded frame log and prints
+//throughput, per stage latency and allocation counts as JSON on stdout
+//usage: percep_benchmark <frames.mrlog> [iterations] [warmup]
+
+/* --- Allocation Counting --- */
+//Every heap allocation of the process goes through here, the array and
+//sized forms forward to these by default
+static atomic<long> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+/* --- Benchmark Frame --- */
+//One frame of the dataset, decoded up front so the run only measures the pipelines
+struct BenchmarkFrame {
+    #if AR_DETECTION
+    Mat gray;
+    Mat src;
+    Mat depth;
+    #endif
+    #if OBSTACLE_DETECTION
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+    #endif
+};
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <frames.mrlog> [iterations] [warmup]\n";
+        return 1;
+    }
+    const string datasetPath = argv[1];
+    const long iterations = argc > 2 ? atol(argv[2]) : 500;
+    const long warmup = argc > 3 ? atol(argv[3]) : 50;
+    //With MROVER_TRACE_DIR set, every stage of every iteration is traced as well
+    Trace::start("percep_benchmark");
+
+    /* --- Reading in Config File --- */
+    ConfigFile mRoverConfig;
+    const char *configRoot = getenv("MROVER_CONFIG");
+    string configPath = configRoot ? string(configRoot) + "/config_percep/config.json" : "config/percep/config.json";
+    if (!mRoverConfig.load(configPath)) {
+        cerr << "could not read config " << configPath << "\n";
+        return 1;
+    }
+
+    /* --- Dataset --- */
+    FrameLogReader log;
+    if (!log.open(datasetPath) || log.size() == 0) {
+        cerr << "no frames in " << datasetPath << "\n";
+        return 1;
+    }
+
+    vector<BenchmarkFrame> frames(log.size());
+    for (size_t i = 0; i < log.size(); ++i) {
+        FrameLogView view = log.frame(i);
+        BenchmarkFrame &frame = frames[i];
+
+        #if AR_DETECTION
+        //same conversion the ZED does before handing out LEFT_GRAY
+        frame.src = view.rgb;
+        frame.depth = view.depth;
+        if (view.rgb.channels() == 1) frame.gray = view.rgb;
+        else cvtColor(view.rgb, frame.gray, view.rgb.channels() == 4 ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+        #endif
+
+        #if OBSTACLE_DETECTION
+        frame.cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>(view.cloudWidth, view.cloudHeight));
+        for (size_t p = 0; p < frame.cloud->points.size(); ++p) {
+            pcl::PointXYZRGB &point = frame.cloud->points[p];
+            point.x = view.points[p].x;
+            point.y = view.points[p].y;
+            point.z = view.points[p].z;
+            point.rgba = view.points[p].rgba;
+        }
+        #endif
+    }
+
+    /* --- Pipelines --- */
+    #if AR_DETECTION
+    TagDetector detector(mRoverConfig);
+    rover_msgs::TargetList arTagsMessage;
+    long arAllocations = 0;
+    #endif
+
+    #if OBSTACLE_DETECTION
+    PCL pointcloud(mRoverConfig);
+    long obstacleAllocations = 0;
+    #endif
+
+    auto runFrame = [&](const BenchmarkFrame &frame) {
+        #if AR_DETECTION
+        {
+            Mat rgb;
+            Mat gray = frame.gray;
+            Mat src = frame.src;
+            Mat depth_img = frame.depth;
+            long before = allocations.load(memory_order_relaxed);
+            {
+                ScopedStageTimer timer(Stage::ARDetect);
+                const std::vector<Tag> &tags = detector.findARTags(gray, src, depth_img, rgb);
+                detector.updateDetectedTagInfo(arTagsMessage, tags, depth_img, gray);
+            }
+            arAllocations += allocations.load(memory_order_relaxed) - before;
+        }
+        #endif
+
+        #if OBSTACLE_DETECTION
+        {
+            //same copy into the arena the obstacle worker does
+            toObstacleCloud(*frame.cloud, *pointcloud.pt_cloud_ptr);
+            long before = allocations.load(memory_order_relaxed);
+            pointcloud.pcl_obstacle_detection();
+            obstacleAllocations += allocations.load(memory_order_relaxed) - before;
+        }
+        #endif
+    };
+
+    /* --- Run --- */
+    //warmup lets buffers reach their steady state capacity before anything is counted
+    for (long i = 0; i < warmup; ++i) runFrame(frames[i % frames.size()]);
+
+    stageTimers().reset(iterations);
+    #if AR_DETECTION
+    arAllocations = 0;
+    #endif
+    #if OBSTACLE_DETECTION
+    obstacleAllocations = 0;
+    #endif
+
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        runFrame(frames[i % frames.size()]);
+        stageTimers().countFrame();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    /* --- Report --- */
+    rover_msgs::PerceptionLatency latency;
+    stageTimers().summarize(latency);
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.Key("dataset"); writer.String(datasetPath.c_str());
+    writer.Key("dataset_frames"); writer.Uint64(frames.size());
+    writer.Key("iterations"); writer.Int64(iterations);
+    writer.Key("warmup"); writer.Int64(warmup);
+    writer.Key("seconds"); writer.Double(elapsed.count());
+    writer.Key("fps"); writer.Double(elapsed.count() > 0 ? iterations / elapsed.count() : 0);
+
+    writer.Key("allocations_per_frame");
+    writer.StartObject();
+    #if AR_DETECTION
+    writer.Key("ar_detect"); writer.Double(iterations ? (double)arAllocations / iterations : 0);
+    #endif
+    #if OBSTACLE_DETECTION
+    writer.Key("obstacle"); writer.Double(iterations ? (double)obstacleAllocations / iterations : 0);
+    #endif
+    writer.EndObject();
+
+    writer.Key("stages");
+    writer.StartArray();
+    for (const rover_msgs::StageLatency &stage : latency.stages) {
+        writer.StartObject();
+        writer.Key("stage"); writer.String(stage.stage.c_str());
+        writer.Key("samples"); writer.Int(stage.samples);
+        writer.Key("p50_ms"); writer.Double(stage.p50_ms);
+        writer.Key("p90_ms"); writer.Double(stage.p90_ms);
+        writer.Key("p99_ms"); writer.Double(stage.p99_ms);
+        writer.Key("max_ms"); writer.Double(stage.max_ms);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    cout << buffer.GetString() << endl;
+    return 0;
+}
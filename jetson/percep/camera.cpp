@@ -5,12 +5,70 @@
     #include <pcl/common/common_headers.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+//Microseconds of the monotonic clock, which every process on the Jetson shares
+static int64_t monotonicMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if OBSTACLE_DETECTION
+//Band of image rows that become cloud points, see pt_cloud.roi
+//The rows above it are mostly sky and terrain too far to matter, so they are dropped
+//before any filtering. With pitch compensation the band moves with the horizon as the
+//rover pitches, the band itself is set for level ground
+class CloudRows {
+public:
+    explicit CloudRows(const rapidjson::Document &config) :
+        TOP_ROW{config["pt_cloud"]["roi"]["top_row"].GetDouble()},
+        BOTTOM_ROW{config["pt_cloud"]["roi"]["bottom_row"].GetDouble()},
+        PITCH_COMPENSATION{!!config["pt_cloud"]["roi"]["pitch_compensation"].GetInt()},
+        HALF_TAN_VERTICAL_FOV{std::tan(config["zed_specs"]["vertical_fov"].GetDouble() / 2 * PI / 180)},
+        pitch{0} {}
+
+    //Nose up is positive, as the IMU gives it. Called from the odometry listener
+    void setPitch(double pitch_rad) {
+        pitch.store(pitch_rad, std::memory_order_relaxed);
+    }
+
+    //First kept row and number of kept rows of an organized cloud of the given height
+    void band(size_t rows, size_t &first, size_t &count) const {
+        double shift = 0;
+        if (PITCH_COMPENSATION) {
+            shift = rows / 2.0 * std::tan(pitch.load(std::memory_order_relaxed)) / HALF_TAN_VERTICAL_FOV;
+        }
+        const double top = std::max(0.0, std::min(rows - 1.0, TOP_ROW * rows + shift));
+        const double bottom = std::max(top + 1, std::min((double)rows, BOTTOM_ROW * rows + shift));
+        first = (size_t)top;
+        count = std::max<size_t>(1, (size_t)bottom - first);
+    }
+
+private:
+    double TOP_ROW;
+    double BOTTOM_ROW;
+    bool PITCH_COMPENSATION;
+    double HALF_TAN_VERTICAL_FOV;
+    std::atomic<double> pitch;
+};
+#endif
+
 #if ZED_SDK_PRESENT
 
 #pragma GCC diagnostic ignored "-Wreorder" //Turns off warning checking for sl lib files
 
 #include <sl/Camera.hpp>
+#include "rover_runtime.hpp"
+#include "trace.hpp"
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 #pragma GCC diagnostic pop
 //Class created to implement all Camera class' functions
@@ -18,35 +76,103 @@
 //so we can just use a simple custom one
 //Also allows us to not be restricted to using the ZED for testing,
 //but can use sample images for testing
+//With camera.async_grab a thread of its own grabs continuously and retrieves every
+//frame into a ring of slots, so grab() hands over the newest complete frame without
+//waiting on exposure or the depth computation. Every measure of a slot comes from the
+//same grab. Without it grab() and the retrievals run on the calling thread.
 class Camera::Impl {
 public:
     Impl(const rapidjson::Document &config);
     ~Impl();
+	bool open();
 	bool grab();
+	int64_t captureTimeUs();
+	void setMeasures(const Camera::Measures &measures);
+	Camera::Measures retrieved();
+	cv::Matx33d intrinsics() const { return this->intrinsics_; }
+	bool pose(int minConfidence, cv::Vec3d &translation, cv::Matx33d &rotation);
 
 	cv::Mat image();
 	cv::Mat depth();
+	cv::Mat gray();
     
     //constants
     int THRESHOLD_CONFIDENCE;
+    bool ASYNC_GRAB;
+    bool TRACKING;
 
     #if OBSTACLE_DETECTION
     void dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
+    CloudRows cloud_rows;
     #endif
   
 private:
+    //One grabbed frame and the buffers its measures are retrieved into
+    struct Slot {
+        sl::Mat image_zed;
+        sl::Mat depth_zed;
+        sl::Mat gray_zed;
+        sl::Mat cloud_zed; //persistent XYZRGBA retrieval buffer, reallocated only on resolution change
+        sl::Resolution cloud_res;
+        cv::Mat image;
+        cv::Mat depth;
+        cv::Mat gray;
+        int64_t capture_time_us;
+        Camera::Measures measures;
+        //positional tracking's pose of the frame, if tracking had one
+        sl::Pose pose;
+        bool pose_ok;
+    };
+
+    //One slot being written, the newest complete one and the one grab() handed out
+    static const int SLOTS = 3;
+
+    void allocSlot(Slot &slot);
+    void freeSlot(Slot &slot);
+    void retrieveImage(Slot &slot);
+    void retrieveDepth(Slot &slot);
+    void retrieveGray(Slot &slot);
+    void retrieveCloud(Slot &slot, sl::Resolution cloud_res);
+    //Stamp of the frame the ZED grabbed last
+    int64_t grabbedTimeUs();
+    //Reads the pose of the frame the ZED grabbed last into slot
+    void retrievePose(Slot &slot);
+    //grabs and retrieves into the ring until stopped or a grab fails
+    void grabLoop();
+
 	sl::RuntimeParameters runtime_params_;
 	sl::Resolution image_size_;
+	//left camera matrix at image_size_, read once since the grab thread owns zed_ afterwards
+	cv::Matx33d intrinsics_;
 	sl::Camera zed_;
 
-	sl::Mat image_zed_;
-	sl::Mat depth_zed_;
-
-	cv::Mat image_;
-	cv::Mat depth_;
+    Slot slots_[SLOTS];
+    //slot grab() handed out, always 0 without the grab thread
+    int held_;
+    //newest complete slot, -1 before the first
+    int newest_;
+    uint64_t newest_seq_;
+    uint64_t taken_seq_;
+    bool grab_failed_;
+    bool grab_stop_;
+    Camera::Measures measures_;
+    //resolution dataCloud was last asked for, the grab thread retrieves the next clouds at it
+    sl::Resolution cloud_request_;
+    std::mutex slot_mut_;
+    std::condition_variable slot_cv_;
+    std::thread grabber_;
 };
 
-Camera::Impl::Impl(const rapidjson::Document &config) : THRESHOLD_CONFIDENCE(config["camera"]["threshold_confidence"].GetDouble()) {
+Camera::Impl::Impl(const rapidjson::Document &config) : THRESHOLD_CONFIDENCE(config["camera"]["threshold_confidence"].GetDouble()),
+    ASYNC_GRAB(!!config["camera"]["async_grab"].GetInt()),
+    TRACKING(!!config["visual_odometry"]["enabled"].GetInt()),
+    #if OBSTACLE_DETECTION
+    cloud_rows(config),
+    #endif
+    held_(0), newest_(-1), newest_seq_(0), taken_seq_(0), grab_failed_(false), grab_stop_(false),
+    cloud_request_(config["pt_cloud"]["pt_cloud_width"].GetInt(), config["pt_cloud"]["pt_cloud_height"].GetInt()) {}
+
+bool Camera::Impl::open() {
 	sl::InitParameters init_params;
 	init_params.camera_resolution = sl::RESOLUTION::HD720; // default: 720p
 	init_params.depth_mode = sl::DEPTH_MODE::PERFORMANCE;
@@ -54,7 +180,12 @@ Camera::Impl::Impl(const rapidjson::Document &config) : THRESHOLD_CONFIDENCE(con
 	init_params.camera_fps = 15;
 	// TODO change this below?
 
-	assert(this->zed_.open() == sl::ERROR_CODE::SUCCESS);
+	//Not in an assert, which would skip opening the camera when NDEBUG is set
+	const sl::ERROR_CODE opened = this->zed_.open();
+	if (opened != sl::ERROR_CODE::SUCCESS) {
+		std::cerr << "could not open the ZED: " << opened << "\n";
+		return false;
+	}
   
     //Parameters for Positional Tracking
     init_params.coordinate_system = sl::COORDINATE_SYSTEM::RIGHT_HANDED_Y_UP; // Use a right-handed Y-up coordinate system
@@ -69,71 +200,271 @@ Camera::Impl::Impl(const rapidjson::Document &config) : THRESHOLD_CONFIDENCE(con
     this->runtime_params_.sensing_mode = sl::SENSING_MODE::STANDARD;
 
 	this->image_size_ = this->zed_.getCameraInformation().camera_resolution;
-	this->image_zed_.alloc(this->image_size_.width, this->image_size_.height,
-						   sl::MAT_TYPE::U8_C4);
-	this->image_ = cv::Mat(
+	const sl::CameraParameters left = this->zed_.getCameraInformation().calibration_parameters.left_cam;
+	this->intrinsics_ = cv::Matx33d(left.fx, 0, left.cx, 0, left.fy, left.cy, 0, 0, 1);
+    for (int i = 0; i < (ASYNC_GRAB ? SLOTS : 1); ++i) allocSlot(this->slots_[i]);
+
+    //Tracking follows the camera from every grab on, in the frame it had when enabled
+    if (TRACKING) {
+        const sl::ERROR_CODE tracking = this->zed_.enablePositionalTracking(sl::PositionalTrackingParameters());
+        if (tracking != sl::ERROR_CODE::SUCCESS) {
+            std::cerr << "could not enable positional tracking, no visual odometry: " << tracking << "\n";
+            TRACKING = false;
+        }
+    }
+
+    if (ASYNC_GRAB) {
+        //Percep's thread layout in config/threads places it
+        this->grabber_ = ThreadConfig("percep").spawn("zed_grab", [this]() { grabLoop(); });
+    }
+    return true;
+}
+
+void Camera::Impl::allocSlot(Slot &slot) {
+	slot.image_zed.alloc(this->image_size_.width, this->image_size_.height,
+						 sl::MAT_TYPE::U8_C4);
+	slot.image = cv::Mat(
 		this->image_size_.height, this->image_size_.width, CV_8UC4,
-		this->image_zed_.getPtr<sl::uchar1>(sl::MEM::CPU));
-	this->depth_zed_.alloc(this->image_size_.width, this->image_size_.height,
-		                   sl::MAT_TYPE::F32_C1);
-	this->depth_ = cv::Mat(
+		slot.image_zed.getPtr<sl::uchar1>(sl::MEM::CPU));
+	slot.depth_zed.alloc(this->image_size_.width, this->image_size_.height,
+		                 sl::MAT_TYPE::F32_C1);
+	slot.depth = cv::Mat(
 		this->image_size_.height, this->image_size_.width, CV_32FC1,
-		this->depth_zed_.getPtr<sl::uchar1>(sl::MEM::CPU));
+		slot.depth_zed.getPtr<sl::uchar1>(sl::MEM::CPU));
+	//The ZED computes the grayscale left view itself, so there's no conversion on our side
+	slot.gray_zed.alloc(this->image_size_.width, this->image_size_.height,
+		                sl::MAT_TYPE::U8_C1);
+	slot.gray = cv::Mat(
+		this->image_size_.height, this->image_size_.width, CV_8UC1,
+		slot.gray_zed.getPtr<sl::uchar1>(sl::MEM::CPU), slot.gray_zed.getStepBytes(sl::MEM::CPU));
+    slot.capture_time_us = 0;
+}
+
+void Camera::Impl::freeSlot(Slot &slot) {
+    if (slot.cloud_zed.isInit()) slot.cloud_zed.free(sl::MEM::CPU);
+    if (slot.gray_zed.isInit()) slot.gray_zed.free(sl::MEM::CPU);
+    if (slot.depth_zed.isInit()) slot.depth_zed.free(sl::MEM::CPU);
+    if (slot.image_zed.isInit()) slot.image_zed.free(sl::MEM::CPU);
+}
+
+void Camera::Impl::grabLoop() {
+    while (true) {
+        Camera::Measures measures;
+        sl::Resolution cloud_res;
+        {
+            std::unique_lock<std::mutex> lock(slot_mut_);
+            if (grab_stop_) return;
+            measures = measures_;
+            cloud_res = cloud_request_;
+        }
+
+        if (this->zed_.grab() != sl::ERROR_CODE::SUCCESS) {
+            std::unique_lock<std::mutex> lock(slot_mut_);
+            grab_failed_ = true;
+            slot_cv_.notify_all();
+            return;
+        }
+
+        //Neither the newest slot nor the one being read is touched, one of three is always free
+        int writing = 0;
+        {
+            std::unique_lock<std::mutex> lock(slot_mut_);
+            while (writing == newest_ || writing == held_) ++writing;
+        }
+
+        Trace::Span span("zed retrieve");
+        Slot &slot = this->slots_[writing];
+        slot.capture_time_us = grabbedTimeUs();
+        slot.measures = measures;
+        retrievePose(slot);
+        if (measures.image) retrieveImage(slot);
+        if (measures.gray) retrieveGray(slot);
+        if (measures.depth) retrieveDepth(slot);
+        #if OBSTACLE_DETECTION
+        if (measures.cloud) retrieveCloud(slot, cloud_res);
+        #endif
+
+        std::unique_lock<std::mutex> lock(slot_mut_);
+        //the previous frame was never handed out
+        if (newest_seq_ > taken_seq_) Trace::instant("zed frame dropped");
+        newest_ = writing;
+        ++newest_seq_;
+        slot_cv_.notify_all();
+    }
 }
 
 bool Camera::Impl::grab() {
-    return this->zed_.grab() == sl::ERROR_CODE::SUCCESS;
+    if (!ASYNC_GRAB) {
+        if (this->zed_.grab() != sl::ERROR_CODE::SUCCESS) return false;
+        this->slots_[0].capture_time_us = grabbedTimeUs();
+        retrievePose(this->slots_[0]);
+        return true;
+    }
+
+    //Waits for a frame newer than the last one handed out, the slot of that one is
+    //released right away since its data is only valid until the next grab
+    std::unique_lock<std::mutex> lock(slot_mut_);
+    held_ = -1;
+    slot_cv_.wait(lock, [this]() { return grab_failed_ || newest_seq_ > taken_seq_; });
+    if (newest_seq_ <= taken_seq_) {
+        held_ = 0;
+        return false;
+    }
+    held_ = newest_;
+    taken_seq_ = newest_seq_;
+    return true;
 }
 
-cv::Mat Camera::Impl::image() {
-	this->zed_.retrieveImage(this->image_zed_, sl::VIEW::LEFT, sl::MEM::CPU,
+//The ZED stamps images on the system clock, so the stamp is moved onto the monotonic clock
+int64_t Camera::Impl::grabbedTimeUs() {
+    const int64_t imageUs = this->zed_.getTimestamp(sl::TIME_REFERENCE::IMAGE).getMicroseconds();
+    const int64_t systemUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return monotonicMicroseconds() - (systemUs - imageUs);
+}
+
+int64_t Camera::Impl::captureTimeUs() {
+    return this->slots_[held_].capture_time_us;
+}
+
+void Camera::Impl::retrievePose(Slot &slot) {
+    slot.pose_ok = TRACKING &&
+        this->zed_.getPosition(slot.pose, sl::REFERENCE_FRAME::WORLD) == sl::POSITIONAL_TRACKING_STATE::OK;
+}
+
+bool Camera::Impl::pose(int minConfidence, cv::Vec3d &translation, cv::Matx33d &rotation) {
+    const Slot &slot = this->slots_[held_];
+    if (!slot.pose_ok || slot.pose.pose_confidence < minConfidence) return false;
+    const sl::Translation t = slot.pose.getTranslation();
+    translation = cv::Vec3d(t.x, t.y, t.z);
+    const sl::Rotation r = slot.pose.getRotationMatrix();
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) rotation(i, j) = r(i, j);
+    }
+    return true;
+}
+
+void Camera::Impl::setMeasures(const Camera::Measures &measures) {
+    std::unique_lock<std::mutex> lock(slot_mut_);
+    measures_ = measures;
+}
+
+Camera::Measures Camera::Impl::retrieved() {
+    if (ASYNC_GRAB) return this->slots_[held_].measures;
+    std::unique_lock<std::mutex> lock(slot_mut_);
+    return measures_;
+}
+
+void Camera::Impl::retrieveImage(Slot &slot) {
+	this->zed_.retrieveImage(slot.image_zed, sl::VIEW::LEFT, sl::MEM::CPU,
 							 this->image_size_);
-	return this->image_;
+}
+
+void Camera::Impl::retrieveDepth(Slot &slot) {
+    this->zed_.retrieveMeasure(slot.depth_zed, sl::MEASURE::DEPTH,  sl::MEM::CPU,  this->image_size_);
+}
+
+void Camera::Impl::retrieveGray(Slot &slot) {
+	this->zed_.retrieveImage(slot.gray_zed, sl::VIEW::LEFT_GRAY, sl::MEM::CPU,
+							 this->image_size_);
+}
+
+cv::Mat Camera::Impl::image() {
+    Slot &slot = this->slots_[held_];
+    if (!ASYNC_GRAB) retrieveImage(slot);
+	return slot.image;
 }
 
 cv::Mat Camera::Impl::depth() {
-    this->zed_.retrieveMeasure(this->depth_zed_, sl::MEASURE::DEPTH,  sl::MEM::CPU,  this->image_size_);
-	return this->depth_;
+    Slot &slot = this->slots_[held_];
+    if (!ASYNC_GRAB) retrieveDepth(slot);
+	return slot.depth;
 }
 
-//This function convert a RGBA color packed into a packed RGBA PCL compatible format
-inline float convertColor(float colorIn) {
-    uint32_t color_uint = *(uint32_t *) & colorIn;
-    unsigned char *color_uchar = (unsigned char *) &color_uint;
-    color_uint = ((uint32_t) color_uchar[0] << 16 | (uint32_t) color_uchar[1] << 8 | (uint32_t) color_uchar[2]);
-    return *reinterpret_cast<float *> (&color_uint);
+cv::Mat Camera::Impl::gray() {
+    Slot &slot = this->slots_[held_];
+    if (!ASYNC_GRAB) retrieveGray(slot);
+	return slot.gray;
 }
 
+#if OBSTACLE_DETECTION
+//Converts one row of ZED XYZRGBA points into PCL points
+//The loop is branch free so the compiler can vectorize it: invalid measures
+//are masked to zero with selects instead of per point branching, and the
+//RGBA -> PCL rgb byte swizzle is done on integers rather than through float punning
+static inline void ingestCloudRow(const float *p_src, pcl::PointXYZRGB *p_dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const float *p = p_src + 4 * i;
+        uint32_t color;
+        std::memcpy(&color, p + 3, sizeof(color));
+
+        const bool valid = std::isfinite(p[0]);
+        p_dst[i].x = valid ? p[0] : 0.0f;
+        p_dst[i].y = valid ? p[1] : 0.0f;
+        p_dst[i].z = valid ? p[2] : 0.0f;
+        p_dst[i].rgba = valid ? ((color & 0xFFu) << 16 | (color & 0xFF00u) | ((color >> 16) & 0xFFu)) : 0u;
+    }
+}
+#endif
+
 Camera::Impl::~Impl() {
-    this->depth_zed_.free(sl::MEM::CPU);
-    this->image_zed_.free(sl::MEM::CPU);
+    if (this->grabber_.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(slot_mut_);
+            grab_stop_ = true;
+        }
+        this->grabber_.join();
+    }
+    for (Slot &slot : this->slots_) freeSlot(slot);
 	this->zed_.close();
 }
 
 #if OBSTACLE_DETECTION
+void Camera::Impl::retrieveCloud(Slot &slot, sl::Resolution cloud_res) {
+    //Only reallocate the retrieval buffer when the requested resolution changes
+    if (!slot.cloud_zed.isInit() || cloud_res.width != slot.cloud_res.width ||
+        cloud_res.height != slot.cloud_res.height) {
+        if (slot.cloud_zed.isInit()) slot.cloud_zed.free(sl::MEM::CPU);
+        slot.cloud_zed.alloc(cloud_res, sl::MAT_TYPE::F32_C4, sl::MEM::CPU);
+        slot.cloud_res = cloud_res;
+    }
+
+    //Grab ZED Point Cloud directly into the persistent buffer
+    this->zed_.retrieveMeasure(slot.cloud_zed, sl::MEASURE::XYZRGBA, sl::MEM::CPU, cloud_res);
+}
+
 void Camera::Impl::dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & p_pcl_point_cloud) {
-    //Might need an overloaded assignment operator
-  
-    //Grab ZED Depth Image
     sl::Resolution cloud_res(p_pcl_point_cloud->width, p_pcl_point_cloud->height);
-    sl::Mat data_cloud;
-    this->zed_.retrieveMeasure(data_cloud, sl::MEASURE::XYZRGBA, sl::MEM::CPU, cloud_res);
-  
-    //Populate Point Cloud
-    float *p_data_cloud = data_cloud.getPtr<float>();
-    int index = 0;
-    for (auto &it : p_pcl_point_cloud->points) {
-        float X = p_data_cloud[index];
-        if (!isValidMeasure(X)) // Checking if it's a valid point
-            it.x = it.y = it.z = it.rgb = 0;
-        else {
-            it.x = X;
-            it.y = p_data_cloud[index + 1];
-            it.z = p_data_cloud[index + 2];
-            it.rgb = convertColor(p_data_cloud[index + 3]); // Convert a 32bits float into a pcl .rgb format
+    Slot &slot = this->slots_[held_];
+    if (ASYNC_GRAB) {
+        //This frame was retrieved at the resolution asked for before, so a new one
+        //takes effect a frame later and the cloud is sized as it was retrieved
+        {
+            std::unique_lock<std::mutex> lock(slot_mut_);
+            cloud_request_ = cloud_res;
         }
-    index += 4;
-  }
+        if (!slot.cloud_zed.isInit()) return;
+        cloud_res = slot.cloud_res;
+        p_pcl_point_cloud->width = cloud_res.width;
+        p_pcl_point_cloud->height = cloud_res.height;
+    }
+    else {
+        retrieveCloud(slot, cloud_res);
+    }
+
+    //Populate Point Cloud row by row, ZED rows may be padded so use the step
+    //The SDK only retrieves whole measures, the rows outside the band are never ingested
+    size_t first_row, rows;
+    cloud_rows.band(cloud_res.height, first_row, rows);
+    p_pcl_point_cloud->height = rows;
+    p_pcl_point_cloud->points.resize(cloud_res.width * rows);
+    const uint8_t *p_data_cloud = slot.cloud_zed.getPtr<sl::uchar1>(sl::MEM::CPU);
+    const size_t step = slot.cloud_zed.getStepBytes(sl::MEM::CPU);
+    pcl::PointXYZRGB *p_points = p_pcl_point_cloud->points.data();
+    for (size_t row = 0; row < rows; ++row) {
+        ingestCloudRow(reinterpret_cast<const float *>(p_data_cloud + (first_row + row) * step),
+                       p_points + row * cloud_res.width, cloud_res.width);
+    }
 }
 #endif
 
@@ -143,21 +474,42 @@ void Camera::Impl::dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & p_pcl_poin
 #include <string>
 #include <errno.h>
 #include <vector>
+#include <limits>
 #include <unordered_set>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "frame_log.hpp"
 class Camera::Impl {
 public:
     Impl(const rapidjson::Document &config);
     ~Impl();
+    //The recording was opened with the folder it was asked for
+    bool open() { return true; }
     bool grab();
+    int64_t captureTimeUs();
+    //Recordings hold every measure already, skipping the ones nobody asked for
+    //still lets offline runs see what the workers do without them
+    void setMeasures(const Camera::Measures &measures) { measures_ = measures; }
+    Camera::Measures retrieved() { return measures_; }
+    //Recordings carry no calibration
+    cv::Matx33d intrinsics() const { return cv::Matx33d::zeros(); }
+    //or poses
+    bool pose(int, cv::Vec3d &, cv::Matx33d &) { return false; }
 
     #if AR_DETECTION
     cv::Mat image();
+    cv::Mat gray();
+    #endif
+    #if AR_DETECTION || OBSTACLE_DETECTION
     cv::Mat depth();
     #endif
 
     #if OBSTACLE_DETECTION
     void dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
     void pcl_write(const cv::String &filename, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
+    CloudRows cloud_rows;
 
     #endif
 
@@ -165,6 +517,45 @@ public:
     void write_curr_frame_to_disk(cv::Mat rgb, cv::Mat depth, int counter);
 
 private:
+    //recorded frames are stamped when they are grabbed, as if captured then
+    int64_t capture_time_us;
+    Camera::Measures measures_;
+
+    //replaying a frame log instead of reading a directory
+    bool replaying;
+    bool REPLAY_LOOP;
+    FrameLogReader replay;
+    size_t idx_replay;
+    size_t idx_replay_next;
+    cv::Mat replay_image;
+    cv::Mat replay_gray;
+
+    //Frames decoded ahead of time by the prefetch thread
+    struct Prefetched {
+        #if AR_DETECTION
+        cv::Mat gray;
+        #endif
+        #if AR_DETECTION || OBSTACLE_DETECTION
+        cv::Mat depth; //only read alongside the rgb images, empty without AR detection
+        #endif
+        #if OBSTACLE_DETECTION
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+        #endif
+    };
+    size_t PREFETCH_FRAMES;
+    Prefetched current;
+    std::deque<Prefetched> prefetched;
+    bool prefetch_done;
+    bool prefetch_stop;
+    std::mutex prefetch_mut;
+    std::condition_variable prefetch_cv;
+    std::thread prefetcher;
+
+    //whether frame k of the directory exists for every enabled stream
+    bool hasFrame(size_t k) const;
+    //decodes frames 1, 2, ... into the prefetch ring, blocking while it is full
+    void prefetchLoop();
+
     std::vector<std::string> img_names;
     std::vector<std::string> pcd_names;
 
@@ -181,15 +572,42 @@ private:
 };
 
 Camera::Impl::~Impl() {
-    closedir(rgb_dir);
-    closedir(depth_dir);
-    closedir(pcd_dir);
+    if (prefetcher.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(prefetch_mut);
+            prefetch_stop = true;
+        }
+        prefetch_cv.notify_all();
+        prefetcher.join();
+    }
+    if (rgb_dir) closedir(rgb_dir);
+    if (depth_dir) closedir(depth_dir);
+    if (pcd_dir) closedir(pcd_dir);
 }
 
-Camera::Impl::Impl(const rapidjson::Document &config) {
+Camera::Impl::Impl(const rapidjson::Document &config) :
+    #if OBSTACLE_DETECTION
+    cloud_rows{config},
+    #endif
+    capture_time_us{0}, replaying{false}, REPLAY_LOOP{!!config["camera"]["replay_loop"].GetInt()},
+    idx_replay{0}, idx_replay_next{0},
+    PREFETCH_FRAMES{(size_t)std::max(1, config["camera"]["prefetch_frames"].GetInt())},
+    prefetch_done{false}, prefetch_stop{false}, idx_curr_img{0}, idx_curr_pcd_img{0},
+    rgb_dir{NULL}, depth_dir{NULL}, pcd_dir{NULL} {
   
-    std::cout<<"Please input the folder path (there should be a rgb and depth existing in this folder): ";
+    std::cout<<"Please input the folder path (there should be a rgb and depth existing in this folder), or a .mrlog frame log: ";
     std::cin>>path;
+
+    //A frame log holds every stream in one file, no directories to scan
+    const std::string log_tail = ".mrlog";
+    if (path.size() > log_tail.size() && path.compare(path.size() - log_tail.size(), log_tail.size(), log_tail) == 0) {
+        if (!replay.open(path) || replay.size() == 0) {
+            std::cerr<<"Frame log "<<path<<" has no frames\n";
+            exit(1);
+        }
+        replaying = true;
+        return;
+    }
     #if AR_DETECTION
     rgb_path = path + "/rgb";
     depth_path = path + "/depth";
@@ -211,7 +629,7 @@ Camera::Impl::Impl(const rapidjson::Document &config) {
   #endif
   
 
-    // get the vector of image names, jpg/png for rgb files, .exr for depth files
+    // get the vector of image names, jpg/png for rgb files, .png or .exr for depth files
     // we only read the rgb folder, and assume that the depth folder's images have the same name
     struct dirent *dp = NULL;
     #if AR_DETECTION
@@ -273,35 +691,133 @@ do{
     idx_curr_pcd_img = 0;
     
 #endif
+
+    //Decoding happens ahead of the pipeline so offline runs aren't bound by disk reads
+    prefetcher = std::thread(&Camera::Impl::prefetchLoop, this);
+}
+
+bool Camera::Impl::hasFrame(size_t k) const {
+    #if AR_DETECTION
+    if (k >= img_names.size()) return false;
+    #endif
+    #if OBSTACLE_DETECTION
+    //the last two clouds of a recording are skipped
+    if (k + 2 >= pcd_names.size()) return false;
+    #endif
+    return true;
+}
+
+void Camera::Impl::prefetchLoop() {
+    for (size_t k = 1; hasFrame(k); ++k) {
+        Prefetched frame;
+
+        #if AR_DETECTION
+        //Decodes straight to grayscale, which is cheaper than decoding color and converting
+        std::string rgb_name = img_names[k];
+        std::string full_path = rgb_path + std::string("/") + rgb_name;
+        frame.gray = cv::imread(full_path.c_str(), cv::IMREAD_GRAYSCALE);
+        if (!frame.gray.data){
+            std::cerr<<"Load image "<<full_path<< " error\n";
+        }
+
+        //The recorder writes depth as 16 bit png, older recordings used float exr
+        full_path = depth_path + std::string("/") + rgb_name.substr(0, rgb_name.size()-4);
+        cv::Mat depth_mm = cv::imread(full_path + ".png", cv::IMREAD_ANYDEPTH);
+        if (depth_mm.type() == CV_16U) {
+            depth_mm.convertTo(frame.depth, CV_32F);
+            frame.depth.setTo(std::numeric_limits<float>::quiet_NaN(), depth_mm == 0);
+        } else {
+            full_path += ".exr";
+            frame.depth = cv::imread(full_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+        }
+        if (!frame.depth.data){
+            std::cerr<<"Load image "<<full_path<< " error\n";
+        }
+        #endif
+
+        #if OBSTACLE_DETECTION
+        frame.cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+        std::string pcd_full_path = pcd_path + std::string("/") + pcd_names[k];
+        if (pcl::io::loadPCDFile<pcl::PointXYZRGB> (pcd_full_path, *frame.cloud) == -1){ //* load the file 
+            PCL_ERROR ("Couldn't read file %s \n", pcd_full_path.c_str()); 
+        }
+        //Unorganized recordings have no rows to cut
+        if (frame.cloud->isOrganized()) {
+            size_t first_row, rows;
+            cloud_rows.band(frame.cloud->height, first_row, rows);
+            auto &points = frame.cloud->points;
+            points.erase(points.begin() + (first_row + rows) * frame.cloud->width, points.end());
+            points.erase(points.begin(), points.begin() + first_row * frame.cloud->width);
+            frame.cloud->height = rows;
+        }
+        #endif
+
+        std::unique_lock<std::mutex> lock(prefetch_mut);
+        prefetch_cv.wait(lock, [this]() { return prefetch_stop || prefetched.size() < PREFETCH_FRAMES; });
+        if (prefetch_stop) return;
+        prefetched.push_back(std::move(frame));
+        prefetch_cv.notify_all();
+    }
+
+    std::unique_lock<std::mutex> lock(prefetch_mut);
+    prefetch_done = true;
+    prefetch_cv.notify_all();
 }
 
 bool Camera::Impl::grab() {
+    capture_time_us = monotonicMicroseconds();
+
+    if (replaying) {
+        if (idx_replay_next >= replay.size()) {
+            if (!REPLAY_LOOP) {
+                std::cout<<"Ran out of frames\n";
+                return false;
+            }
+            idx_replay_next = 0;
+        }
+        idx_replay = idx_replay_next++;
+        return true;
+    }
+
+    //folders couldn't be opened, there is nothing to read
+    if (!prefetcher.joinable()) return false;
 
-    bool end = true;
+    //Next decoded frame from the read ahead ring
+    {
+        std::unique_lock<std::mutex> lock(prefetch_mut);
+        prefetch_cv.wait(lock, [this]() { return prefetch_done || !prefetched.empty(); });
+        if (prefetched.empty()) {
+            std::cout<<"Ran out of images\n";
+            return false;
+        }
+        current = std::move(prefetched.front());
+        prefetched.pop_front();
+    }
+    prefetch_cv.notify_all();
 
     #if AR_DETECTION
     idx_curr_img++;
-    if (idx_curr_img >= img_names.size()) {
-        std::cout<<"Ran out of images\n";
-        end = false;
-    }
     #endif
 
     #if OBSTACLE_DETECTION
     idx_curr_pcd_img++;
-    if (idx_curr_pcd_img >= pcd_names.size()-2) {
-        std::cout<<"Ran out of images\n";
-        end = false;  
-    }
     #endif
-    if(!end){
-        exit(1);
-    }
-    return end;
+    return true;
+}
+
+int64_t Camera::Impl::captureTimeUs() {
+    return capture_time_us;
 }
 
 #if AR_DETECTION
 cv::Mat Camera::Impl::image() {
+    if (replaying) {
+        //ZED frames are logged as BGRA, the directory backend hands out BGR
+        cv::Mat img = replay.frame(idx_replay).rgb;
+        if (img.channels() != 4) return img;
+        cv::cvtColor(img, replay_image, cv::COLOR_BGRA2BGR);
+        return replay_image;
+    }
     std::string full_path = rgb_path + std::string("/") + (img_names[idx_curr_img]);
     #if PERCEPTION_DEBUG
         cout << img_names[idx_curr_img] << "\n";
@@ -314,54 +830,21 @@ cv::Mat Camera::Impl::image() {
     return img;
 }
 
-cv::Mat Camera::Impl::depth() {
-    std::string rgb_name = img_names[idx_curr_img];
-    std::string full_path = depth_path + std::string("/") +
-                            rgb_name.substr(0, rgb_name.size()-4) + std::string(".exr");
-    #if PERCEPTION_DEBUG
-        std::cout<<full_path<<std::endl;
-    #endif
-    cv::Mat img = cv::imread(full_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
-    if (!img.data){
-        std::cerr<<"Load image "<<full_path<< " error\n";
-    }
-    return img;
-}
-
-void Camera::record_ar_init() {
-  //initializing ar tag videostream object
-  std::pair<Tag, Tag> tp;
-  TagDetector d1(mRoverConfig);
-
-
-    Mat depth_img = depth();
-    Mat rgb;
-    Mat src = image();
-
-    tp = d1.findARTags(src, depth_img, rgb);
-    Size fsize = rgb.size();
-
-    time_t now = time(0);
-    char* ltm = ctime(&now);
-    string timeStamp(ltm);
-
-    string s = "artag_number_" + timeStamp + ".avi";
-
-    vidWrite =  VideoWriter(s, VideoWriter::fourcc('M','J','P','G'),10,fsize,true);
-
-    if(vidWrite.isOpened() == false)
-    {
-        cerr << "ar record didn't open\n";
-        exit(1);
+cv::Mat Camera::Impl::gray() {
+    if (replaying) {
+        cv::Mat img = replay.frame(idx_replay).rgb;
+        if (img.channels() == 1) return img;
+        cv::cvtColor(img, replay_gray, img.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        return replay_gray;
     }
+    return current.gray;
 }
+#endif
 
-void Camera::record_ar(Mat rgb) {
-    vidWrite.write(rgb);
-}
-
-void Camera::record_ar_finish() {
-    vidWrite.release();
+#if AR_DETECTION || OBSTACLE_DETECTION
+cv::Mat Camera::Impl::depth() {
+    if (replaying) return replay.frame(idx_replay).depth;
+    return current.depth;
 }
 #endif
 
@@ -369,36 +852,79 @@ void Camera::record_ar_finish() {
 //Reads the point data cloud p_pcl_point_cloud
 #if OBSTACLE_DETECTION
 void Camera::Impl::dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud){
+
+ if (replaying) {
+    FrameLogView view = replay.frame(idx_replay);
+    size_t first_row, rows;
+    cloud_rows.band(view.cloudHeight, first_row, rows);
+    p_pcl_point_cloud->width = view.cloudWidth;
+    p_pcl_point_cloud->height = rows;
+    p_pcl_point_cloud->points.resize((size_t)view.cloudWidth * rows);
+    const size_t first = first_row * view.cloudWidth;
+    for (size_t i = 0; i < p_pcl_point_cloud->points.size(); ++i) {
+        pcl::PointXYZRGB &p = p_pcl_point_cloud->points[i];
+        p.x = view.points[first + i].x;
+        p.y = view.points[first + i].y;
+        p.z = view.points[first + i].z;
+        p.rgba = view.points[first + i].rgba;
+    }
+    return;
+ }
  
- //Read in image names
- std::string pcd_name = pcd_names[idx_curr_pcd_img];
- std::string full_path = pcd_path + std::string("/") + pcd_name;
-  //Load in the file  
-  if (pcl::io::loadPCDFile<pcl::PointXYZRGB> (full_path, *p_pcl_point_cloud) == -1){ //* load the file 
-    PCL_ERROR ("Couldn't read file test_pcd.pcd \n"); 
-  }
+ //The prefetch thread already loaded it, hand over the cloud instead of copying
+ p_pcl_point_cloud = current.cloud;
 }
 #endif
 
 #endif
 
 Camera::Camera(const rapidjson::Document &config) : 
-    impl_{new Camera::Impl(config)}, rgb_foldername{""}, depth_foldername{""}, pcl_foldername{""} , mRoverConfig( config ),
+    impl_{new Camera::Impl(config)}, rgb_foldername{""}, depth_foldername{""}, pcl_foldername{""}, recorder{config}, mRoverConfig( config ),
             FRAME_WRITE_INTERVAL{mRoverConfig["camera"]["frame_write_interval"].GetInt()} {}
 
 Camera::~Camera() {
 	delete this->impl_;
 }
 
+bool Camera::open() {
+	return this->impl_->open();
+}
+
 bool Camera::grab() {
 	return this->impl_->grab();
 }
 
+int64_t Camera::captureTimeUs() {
+	return this->impl_->captureTimeUs();
+}
+
+void Camera::setMeasures(const Measures &measures) {
+	this->impl_->setMeasures(measures);
+}
+
+Camera::Measures Camera::retrieved() {
+	return this->impl_->retrieved();
+}
+
+cv::Matx33d Camera::intrinsics() const {
+	return this->impl_->intrinsics();
+}
+
+bool Camera::pose(int minConfidence, cv::Vec3d &translation, cv::Matx33d &rotation) {
+	return this->impl_->pose(minConfidence, translation, rotation);
+}
+
 #if AR_DETECTION
 cv::Mat Camera::image() {
 	return this->impl_->image();
 }
 
+cv::Mat Camera::gray() {
+	return this->impl_->gray();
+}
+#endif
+
+#if AR_DETECTION || OBSTACLE_DETECTION
 cv::Mat Camera::depth() {
 	return this->impl_->depth();
 }
@@ -408,12 +934,24 @@ cv::Mat Camera::depth() {
 void Camera::getDataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud) {
     this->impl_->dataCloud(p_pcl_point_cloud);
 }
+
+void Camera::setPitch(double pitch_rad) {
+    this->impl_->cloud_rows.setPitch(pitch_rad);
+}
 #endif
 
 #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
 
 // creates and opens folder to write to
 void Camera::disk_record_init() {
+    //a frame log keeps every stream in one file that the offline camera can replay
+    if (std::string(mRoverConfig["recorder"]["format"].GetString()) == "log") {
+        string mkdir_data = std::string("mkdir -p ") + DEFAULT_ONLINE_DATA_FOLDER;
+        if (-1 == system(mkdir_data.c_str())) exit(1);
+        recorder.openLog(DEFAULT_ONLINE_DATA_FOLDER "frames.mrlog");
+        return;
+    }
+
     //defining directories to write to
     rgb_foldername = DEFAULT_ONLINE_DATA_FOLDER "rgb/";
     depth_foldername = DEFAULT_ONLINE_DATA_FOLDER "depth/";
@@ -427,19 +965,7 @@ void Camera::disk_record_init() {
     {
         exit(1);
     }
-}
-
-//writes the Mat to a file
-
-//Writes point cloud data to data folder specified in build tag 
-void pcl_write(const cv::String &filename, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud){
-    #if PERCEPTION_DEBUG
-        std::cout << "name of path is: " << filename << endl;
-    #endif
-    try{ pcl::io::savePCDFileASCII (filename, *p_pcl_point_cloud); }
-    catch (pcl::IOException &e){
-        cout << e.what();
-    }
+    recorder.openFrames(rgb_foldername, depth_foldername, pcl_foldername);
 }
 
 void Camera::write_curr_frame_to_disk(cv::Mat rgb, cv::Mat depth, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud, int counter){
@@ -448,9 +974,27 @@ void Camera::write_curr_frame_to_disk(cv::Mat rgb, cv::Mat depth, pcl::PointClou
         fileName = '0'+fileName;
     }
 
-    pcl_write(pcl_foldername + fileName + std::string(".pcd"), p_pcl_point_cloud);
-    cv::imwrite(rgb_foldername +  fileName + std::string(".jpg"), rgb );
-    cv::imwrite(depth_foldername +  fileName + std::string(".exr"), depth );
+    //copied into the recorder's ring and written on its thread
+    recorder.recordFrame(rgb, depth, *p_pcl_point_cloud, fileName);
+}
+
+#endif
+
+#if AR_DETECTION
+void Camera::record_ar_init() {
+    //initializing ar tag videostream object, it opens once the first frame arrives
+    time_t now = time(0);
+    char timeStamp[32];
+    strftime(timeStamp, sizeof(timeStamp), "%Y-%m-%d_%H-%M-%S", localtime(&now));
+
+    recorder.openVideo(std::string("artag_number_") + timeStamp);
+}
+
+void Camera::record_ar(Mat rgb) {
+    recorder.recordVideo(rgb);
 }
 
+void Camera::record_ar_finish() {
+    recorder.close();
+}
 #endif
@@ -1,6 +1,7 @@
 #pragma once
 #include "perception.hpp"
 #include "rapidjson/document.h"
+#include "recorder.hpp"
 
 #if OBSTACLE_DETECTION
 	#include <pcl/common/common_headers.h>
@@ -13,7 +14,8 @@ private:
 	std::string rgb_foldername;
 	std::string depth_foldername;
 	std::string pcl_foldername;
-	cv::VideoWriter vidWrite;
+	//writes recordings off the perception threads
+	Recorder recorder;
 
     //reference to config file
     const rapidjson::Document& mRoverConfig;
@@ -24,14 +26,47 @@ public:
 
 	Camera(const rapidjson::Document &config);
 	~Camera();
+	//Opens the ZED, which takes seconds, so it is left out of the constructor for the
+	//workers to set up meanwhile. Nothing but setMeasures and setPitch may be called
+	//before it returns true
+	bool open();
+
+	//Measures retrieved with every frame by the ZED's grab thread, which can't go back
+	//for one once it moved on to the next frame. Set before any grab to skip the ones
+	//nobody reads, without the grab thread they are retrieved when asked for
+	struct Measures {
+		bool image = true;
+		bool gray = true;
+		bool depth = true;
+		bool cloud = true;
+	};
 
 	bool grab();
+	//When the grabbed frame was captured, in microseconds of the monotonic clock
+	int64_t captureTimeUs();
+	void setMeasures(const Measures &measures);
+	//Measures the grabbed frame has, the grab thread may have retrieved it before the
+	//last setMeasures
+	Measures retrieved();
+	//Calibrated camera matrix of the left image at the resolution image() and gray() have,
+	//all zeros if the camera has no calibration, such as when replaying recordings
+	cv::Matx33d intrinsics() const;
+	//Where the ZED's positional tracking had the camera when the grabbed frame was captured,
+	//relative to where tracking started in its x right, y down, z forward frame and in
+	//millimeters. False unless visual_odometry.enabled is set and tracking is at least
+	//minConfidence sure, so always false replaying recordings
+	bool pose(int minConfidence, cv::Vec3d &translation, cv::Matx33d &rotation);
 
 	cv::Mat image();
 	cv::Mat depth();
+	//detector ready single channel view of the left image, valid until the next grab
+	cv::Mat gray();
 	
 	#if OBSTACLE_DETECTION
+	//Only the rows of pt_cloud.roi are kept, so the cloud may be shorter than asked for
 	void getDataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
+	//Rover pitch in radians from the IMU, which the kept rows follow
+	void setPitch(double pitch_rad);
 	#endif
 
 	#if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
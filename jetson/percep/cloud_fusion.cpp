@@ -0,0 +1,113 @@
+#include "cloud_fusion.hpp"
+#include "perception.hpp"
+#include "stage_timer.hpp"
+
+#if OBSTACLE_DETECTION
+#include <cmath>
+
+namespace {
+    //Mean earth radius, the rover never goes far enough for the flat earth error to matter
+    const double EARTH_RADIUS_MM = 6371000000.0;
+
+    //Voxel indices are offset so they are non negative and packed as 21 bits per axis
+    const int64_t KEY_OFFSET = 1 << 20;
+    const uint64_t KEY_MASK = (1 << 21) - 1;
+
+    uint64_t voxelKey(float east, float down, float north, float inverseLeaf) {
+        uint64_t ie = (uint64_t)((int64_t)std::floor(east * inverseLeaf) + KEY_OFFSET) & KEY_MASK;
+        uint64_t id = (uint64_t)((int64_t)std::floor(down * inverseLeaf) + KEY_OFFSET) & KEY_MASK;
+        uint64_t in = (uint64_t)((int64_t)std::floor(north * inverseLeaf) + KEY_OFFSET) & KEY_MASK;
+        return (ie << 42) | (id << 21) | in;
+    }
+}
+
+CloudFusion::CloudFusion(const rapidjson::Document &mRoverConfig) :
+    ENABLED{!!mRoverConfig["pt_cloud"]["fusion"]["enabled"].GetInt()},
+    MAX_AGE{(uint32_t)mRoverConfig["pt_cloud"]["fusion"]["max_age"].GetInt()},
+    LEAF_SIZE{mRoverConfig["pt_cloud"]["fusion"]["leaf_size"].GetFloat()},
+    UP_BD_Z{mRoverConfig["pt_cloud"]["pass_through"]["upper_bd_z"].GetDouble()},
+    UP_BD_Y{mRoverConfig["pt_cloud"]["pass_through"]["upper_bd_y"].GetDouble()},
+    LOW_BD{mRoverConfig["pt_cloud"]["pass_through"]["lower_bd"].GetDouble()},
+    CAMERA_PITCH{mRoverConfig["rover_specs"]["angle_offset"].GetDouble()},
+    frameCount{0}, hasFix{false}, originLatitude{0}, originLongitude{0}, pose{0, 0, 0} {}
+
+void CloudFusion::setOdometry(const rover_msgs::Odometry &odometry) {
+    const double latitude = odometry.latitude_deg + odometry.latitude_min / 60;
+    const double longitude = odometry.longitude_deg + odometry.longitude_min / 60;
+    std::unique_lock<std::mutex> lock(poseMut);
+    if (!hasFix) {
+        originLatitude = latitude;
+        originLongitude = longitude;
+        hasFix = true;
+    }
+    pose.north = (latitude - originLatitude) * PI / 180 * EARTH_RADIUS_MM;
+    pose.east = (longitude - originLongitude) * PI / 180 * EARTH_RADIUS_MM * std::cos(originLatitude * PI / 180);
+    pose.heading = odometry.bearing_deg * PI / 180;
+}
+
+//The camera frame has x right, y down and z forward, pitched down by CAMERA_PITCH
+//Points are levelled first and then turned by the heading, so the map is east, down, north
+void CloudFusion::fuse(const pcl::PointCloud<pcl::PointXYZRGB> &frame, ObstacleCloud &fused) {
+    ScopedStageTimer timer(Stage::Fusion);
+
+    Pose current;
+    {
+        std::unique_lock<std::mutex> lock(poseMut);
+        current = pose;
+    }
+    const float cosPitch = std::cos(CAMERA_PITCH), sinPitch = std::sin(CAMERA_PITCH);
+    const float cosHeading = std::cos(current.heading), sinHeading = std::sin(current.heading);
+    const float inverseLeaf = 1.0f / LEAF_SIZE;
+    ++frameCount;
+
+    /* --- Add The Frame --- */
+    for (const auto &pt : frame.points) {
+        if (!(pt.z >= LOW_BD && pt.z <= UP_BD_Z && pt.y >= LOW_BD && pt.y <= UP_BD_Y) || !std::isfinite(pt.x)) {
+            continue;
+        }
+        const float forward = pt.z * cosPitch - pt.y * sinPitch;
+        const float down = pt.y * cosPitch + pt.z * sinPitch;
+        const float east = current.east + pt.x * cosHeading + forward * sinHeading;
+        const float north = current.north - pt.x * sinHeading + forward * cosHeading;
+
+        FusedVoxel &voxel = voxels[voxelKey(east, down, north, inverseLeaf)];
+        //A voxel seen again only keeps this frame's points
+        if (voxel.frame != frameCount) {
+            voxel = FusedVoxel{0, 0, 0, 0, frameCount};
+        }
+        voxel.east += east;
+        voxel.down += down;
+        voxel.north += north;
+        ++voxel.count;
+    }
+
+    /* --- Decay And Write Out --- */
+    fused.points.clear();
+    for (auto it = voxels.begin(); it != voxels.end();) {
+        const FusedVoxel &voxel = it->second;
+        if (frameCount - voxel.frame >= MAX_AGE) {
+            it = voxels.erase(it);
+            continue;
+        }
+        ++it;
+
+        //Back under the camera, the inverse of the transform above
+        const float dEast = voxel.east / voxel.count - current.east;
+        const float dNorth = voxel.north / voxel.count - current.north;
+        const float down = voxel.down / voxel.count;
+        const float x = dEast * cosHeading - dNorth * sinHeading;
+        const float forward = dEast * sinHeading + dNorth * cosHeading;
+        ObstaclePoint pt;
+        pt.x = x;
+        pt.y = down * cosPitch - forward * sinPitch;
+        pt.z = forward * cosPitch + down * sinPitch;
+        //Voxels the rover drove past or turned away from
+        if (!(pt.z >= LOW_BD && pt.z <= UP_BD_Z)) continue;
+        fused.points.push_back(pt);
+    }
+    fused.width = fused.points.size();
+    fused.height = 1;
+    fused.is_dense = true;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+#include "config.h"
+
+#if OBSTACLE_DETECTION
+
+#include "obstacle_point.hpp"
+#include "rover_msgs/Odometry.hpp"
+#include "rapidjson/document.h"
+#include <pcl/common/common_headers.h>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+/* --- Cloud Fusion --- */
+//Accumulates the last few frames' clouds into one voxel map, so a lower resolution
+//cloud per frame still sees small rocks once a few frames have covered them
+//Voxels are kept in the world frame from /odometry, the rover heading and position
+//move them back under the camera every frame. A voxel holds the points of the last
+//frame that saw it and is dropped once max_age frames have gone by without one.
+//The motion is taken as level, only the heading and position are compensated.
+class CloudFusion {
+public:
+    explicit CloudFusion(const rapidjson::Document &mRoverConfig);
+
+    bool enabled() const {
+        return ENABLED;
+    }
+
+    //Latest rover pose, called from the odometry listener
+    void setOdometry(const rover_msgs::Odometry &odometry);
+
+    //Adds a frame's cloud to the map and writes out the whole map in the current camera
+    //frame, as an unorganized cloud. Points outside the pass through bounds are skipped
+    void fuse(const pcl::PointCloud<pcl::PointXYZRGB> &frame, ObstacleCloud &fused);
+
+private:
+    //Rover position in mm east and north of the first fix, heading in radians from north
+    struct Pose {
+        double east;
+        double north;
+        double heading;
+    };
+
+    //Sums of the points that fell in a voxel in the last frame that saw it
+    struct FusedVoxel {
+        float east, down, north;
+        uint32_t count;
+        uint32_t frame;
+    };
+
+    bool ENABLED;
+    uint32_t MAX_AGE;
+    float LEAF_SIZE;
+    double UP_BD_Z;
+    double UP_BD_Y;
+    double LOW_BD;
+    double CAMERA_PITCH;
+
+    std::unordered_map<uint64_t, FusedVoxel> voxels;
+    uint32_t frameCount;
+
+    bool hasFix;
+    double originLatitude;
+    double originLongitude;
+    Pose pose;
+    std::mutex poseMut;
+};
+
+#endif
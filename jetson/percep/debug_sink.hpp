@@ -0,0 +1,59 @@
+#pragma once
+
+#include "perception.hpp"
+
+/* --- Debug Sinks --- */
+//Where the workers hand their intermediate results to be looked at. The worker loops are
+//templated on the sink, so NoDebugSink's empty calls compile out of the loop entirely and
+//production builds, which only have NoDebugSink, run without a single debug branch
+struct NoDebugSink {
+    void arStart() {}
+    void arFrame(const cv::Mat &) {}
+    #if OBSTACLE_DETECTION
+    void obstacleInput(PCL &) {}
+    void obstacleOutput(PCL &, bool, const obstacle_return &) {}
+    #endif
+};
+
+#if PERCEPTION_DEBUG
+//Shows the AR frames in a window and the clouds in PCL's viewers, and prints what was sent
+struct ViewerDebugSink {
+    void arStart() {
+        cv::namedWindow("depth", 2);
+    }
+
+    void arFrame(const cv::Mat &src) {
+        cv::imshow("depth", src);
+        cv::waitKey(1);
+    }
+
+    #if OBSTACLE_DETECTION
+    //Before detection modifies the cloud
+    void obstacleInput(PCL &pointcloud) {
+        pointcloud.updateViewer(true);
+        std::cout<<"Original W: " <<pointcloud.pt_cloud_ptr->width<<" Original H: "<<pointcloud.pt_cloud_ptr->height<<std::endl;
+    }
+
+    void obstacleOutput(PCL &pointcloud, bool ranPcl, const obstacle_return &sent) {
+        std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!Path Sent: " << sent.leftBearing << "\n";
+        std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!Distance Sent: " << sent.distance << "\n";
+        if (ranPcl) pointcloud.updateViewer(false);
+        std::cout<<"Downsampled W: " <<pointcloud.pt_cloud_ptr->width<<" Downsampled H: "<<pointcloud.pt_cloud_ptr->height<<std::endl;
+    }
+    #endif
+};
+#endif
+
+//Runs loop with the sink picked at startup. Debug builds have both sinks built, so the same
+//binary can be timed with and without the viewers, other builds only have NoDebugSink
+template <typename Loop>
+void withDebugSink(bool viewers, Loop loop) {
+    #if PERCEPTION_DEBUG
+    if (viewers) {
+        loop(ViewerDebugSink());
+        return;
+    }
+    #endif
+    (void)viewers;
+    loop(NoDebugSink());
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/python3
+# Shows what the obstacle worker sees, from the /obstacle_debug stream that
+# perception sends with debug_stream.enabled set in config/percep/config.json.
+# Runs on any machine on the rover's LCM network, so perception keeps its
+# production timing while it is watched.
+#
+#     python3 debug_viewer.py
+#
+# The top down view has the decimated cloud in grey, the interest points in
+# red and the rover's path along the left and right bearings in green.
+import math
+import select
+
+import lcm
+import matplotlib.pyplot as plt
+from rover_msgs import ObstacleDebugCloud
+
+# Half the rover's width in centimeters, as pt_cloud.half_rover
+HALF_ROVER_CM = 58.4
+PATH_LENGTH_CM = 700
+
+
+def draw_path(axes, bearing_deg, color):
+    bearing = math.radians(bearing_deg)
+    for offset in (-HALF_ROVER_CM, HALF_ROVER_CM):
+        axes.plot([offset, offset + PATH_LENGTH_CM * math.sin(bearing)],
+                  [0, PATH_LENGTH_CM * math.cos(bearing)], color=color)
+
+
+def draw(axes, msg):
+    axes.clear()
+    plain = [i for i in range(msg.num_points) if not msg.interest[i]]
+    interest = [i for i in range(msg.num_points) if msg.interest[i]]
+    axes.scatter([msg.x[i] for i in plain], [msg.z[i] for i in plain], s=1, color='0.6')
+    axes.scatter([msg.x[i] for i in interest], [msg.z[i] for i in interest], s=8, color='red')
+    draw_path(axes, msg.left_bearing, 'green')
+    if msg.right_bearing != msg.left_bearing:
+        draw_path(axes, msg.right_bearing, 'green')
+    axes.set_xlim(-PATH_LENGTH_CM, PATH_LENGTH_CM)
+    axes.set_ylim(0, PATH_LENGTH_CM)
+    axes.set_aspect('equal')
+    axes.set_xlabel('right (cm)')
+    axes.set_ylabel('forward (cm)')
+    axes.set_title('frame {}: bearings {:.1f} / {:.1f}, distance {:.2f} m'.format(
+        msg.frame_seq, msg.left_bearing, msg.right_bearing, msg.distance))
+
+
+def main():
+    latest = {}
+
+    def on_cloud(channel, data):
+        latest['msg'] = ObstacleDebugCloud.decode(data)
+
+    lc = lcm.LCM()
+    lc.subscribe('/obstacle_debug', on_cloud)
+
+    plt.ion()
+    _, axes = plt.subplots()
+    while plt.fignum_exists(axes.figure.number):
+        # only the newest cloud is drawn, older ones still queued are skipped
+        while select.select([lc.fileno()], [], [], 0.05)[0]:
+            lc.handle()
+        if 'msg' in latest:
+            draw(axes, latest.pop('msg'))
+        plt.pause(0.01)
+
+
+if __name__ == '__main__':
+    main()
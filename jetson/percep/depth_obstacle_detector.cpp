@@ -0,0 +1,158 @@
+#include "depth_obstacle_detector.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    const double DEG_TO_RAD = 3.14159265 / 180;
+}
+
+DepthObstacleDetector::DepthObstacleDetector(const rapidjson::Document &mRoverConfig) :
+    leftBearing{0}, rightBearing{0}, distance{-1},
+    MAX_FIELD_OF_VIEW_ANGLE{mRoverConfig["pt_cloud"]["max_field_of_view_angle"].GetInt()},
+    CLEAR_PATH_RESOLUTION{mRoverConfig["pt_cloud"]["clear_path_resolution"].GetDouble()},
+    MM_PER_M{mRoverConfig["mm_per_m"].GetDouble()},
+    HALF_ROVER_M{mRoverConfig["pt_cloud"]["half_rover"].GetInt() / MM_PER_M},
+    MAX_RANGE_M{mRoverConfig["pt_cloud"]["pass_through"]["upper_bd_z"].GetDouble() / MM_PER_M},
+    HORIZONTAL_FOV{mRoverConfig["zed_specs"]["horizontal_fov"].GetDouble()},
+    VERTICAL_FOV{mRoverConfig["zed_specs"]["vertical_fov"].GetDouble()},
+    CAMERA_HEIGHT_M{mRoverConfig["rover_specs"]["zed_height"].GetDouble()},
+    CAMERA_PITCH{mRoverConfig["rover_specs"]["angle_offset"].GetDouble()},
+    GROUND_MARGIN{mRoverConfig["depth_obstacle"]["ground_margin"].GetDouble()},
+    TOP_ROW{mRoverConfig["depth_obstacle"]["top_row"].GetDouble()},
+    BOTTOM_ROW{mRoverConfig["depth_obstacle"]["bottom_row"].GetDouble()},
+    preparedRows{0}, preparedCols{0} {
+
+    const int numBins = 2 * (int)std::round(MAX_FIELD_OF_VIEW_ANGLE / CLEAR_PATH_RESOLUTION) + 1;
+    rangeProfile.assign(numBins, -1);
+    occupancy.assign(numBins, 0);
+}
+
+//Flat ground seen camera_height below a camera pitched down by angle_offset is at
+//depth h cos(a) / sin(a + pitch) on a row a radians below the optical axis, and the
+//same depth across the whole row. Rows at or above the horizon never see ground.
+void DepthObstacleDetector::prepare(int rows, int cols) {
+    preparedRows = rows;
+    preparedCols = cols;
+
+    const double fy = (rows / 2.0) / std::tan(VERTICAL_FOV / 2 * DEG_TO_RAD);
+    rowThreshold.resize(rows);
+    for (int row = 0; row < rows; ++row) {
+        const double below = std::atan((row + 0.5 - rows / 2.0) / fy);
+        double threshold = MAX_RANGE_M;
+        if (below + CAMERA_PITCH > 0) {
+            const double ground = CAMERA_HEIGHT_M * std::cos(below) / std::sin(below + CAMERA_PITCH);
+            threshold = std::min(threshold, ground * (1 - GROUND_MARGIN));
+        }
+        rowThreshold[row] = (float)(threshold * MM_PER_M);
+    }
+
+    const double fx = (cols / 2.0) / std::tan(HORIZONTAL_FOV / 2 * DEG_TO_RAD);
+    columnTan.resize(cols);
+    for (int col = 0; col < cols; ++col) {
+        columnTan[col] = (float)((col + 0.5 - cols / 2.0) / fx);
+    }
+    columnDepth.resize(cols);
+}
+
+void DepthObstacleDetector::detect(const cv::Mat &depth) {
+    //Image folders recorded without depth have nothing to look at
+    if (depth.empty()) {
+        leftBearing = rightBearing = 0;
+        distance = -1;
+        std::fill(rangeProfile.begin(), rangeProfile.end(), -1.0f);
+        return;
+    }
+    CV_Assert(depth.type() == CV_32FC1);
+    if (depth.rows != preparedRows || depth.cols != preparedCols) prepare(depth.rows, depth.cols);
+
+    /* --- Nearest Obstacle Per Column --- */
+    const float far = std::numeric_limits<float>::infinity();
+    const int cols = depth.cols;
+    float *nearest = columnDepth.data();
+    std::fill(columnDepth.begin(), columnDepth.end(), far);
+    const int firstRow = std::max(0, (int)(TOP_ROW * depth.rows));
+    const int lastRow = std::min(depth.rows, (int)(BOTTOM_ROW * depth.rows));
+    for (int row = firstRow; row < lastRow; ++row) {
+        const float *values = depth.ptr<float>(row);
+        const float threshold = rowThreshold[row];
+        //A compare, blend and min four columns at a time, with OpenCV's intrinsics so it
+        //is NEON on the Jetson and SSE elsewhere whatever the optimization level. NaN and
+        //inf where the ZED has no depth fail the compare and are skipped
+        int col = 0;
+        #if CV_SIMD128
+        const cv::v_float32x4 thresholds = cv::v_setall_f32(threshold);
+        const cv::v_float32x4 fars = cv::v_setall_f32(far);
+        for (; col + 4 <= cols; col += 4) {
+            const cv::v_float32x4 value = cv::v_load(values + col);
+            const cv::v_float32x4 candidate = cv::v_select(value < thresholds, value, fars);
+            cv::v_store(nearest + col, cv::v_min(candidate, cv::v_load(nearest + col)));
+        }
+        #endif
+        for (; col < cols; ++col) {
+            const float value = values[col];
+            const float candidate = value < threshold ? value : far;
+            nearest[col] = candidate < nearest[col] ? candidate : nearest[col];
+        }
+    }
+
+    /* --- Occupancy Histogram --- */
+    //Same binning as PCL::BuildOccupancyHistogram, a column's obstacle blocks every
+    //bearing the rover would hit it on
+    const int numBins = occupancy.size();
+    std::fill(occupancy.begin(), occupancy.end(), 0);
+    std::fill(rangeProfile.begin(), rangeProfile.end(), -1.0f);
+    distance = -1;
+    for (int col = 0; col < cols; ++col) {
+        const float z = nearest[col] / MM_PER_M;
+        if (!(z < far) || z <= 0) continue;
+        const double x = columnTan[col] * z;
+
+        const double angle = std::atan(columnTan[col]) / DEG_TO_RAD;
+        const int bin = (int)std::floor((angle + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION + 0.5);
+        const float range = (float)std::sqrt(x * x + z * z);
+        if (bin >= 0 && bin < numBins && (rangeProfile[bin] < 0 || range < rangeProfile[bin])) {
+            rangeProfile[bin] = range;
+        }
+
+        const double low = std::atan((x - HALF_ROVER_M) / z) / DEG_TO_RAD;
+        const double high = std::atan((x + HALF_ROVER_M) / z) / DEG_TO_RAD;
+        const int lowBin = std::max(0, (int)std::ceil((low + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION));
+        const int highBin = std::min(numBins - 1, (int)std::floor((high + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION));
+        if (lowBin <= highBin) {
+            ++occupancy[lowBin];
+            if (highBin + 1 < numBins) --occupancy[highBin + 1];
+        }
+
+        //Nearest obstacle in the rover's path straight ahead
+        if (std::abs(x) <= HALF_ROVER_M && (distance < 0 || z < distance)) distance = z;
+    }
+    for (int i = 1; i < numBins; ++i) {
+        occupancy[i] += occupancy[i - 1];
+    }
+
+    /* --- Clear Path --- */
+    //Same as PCL::FindClearPath, scanning outward from the center bin each way
+    const int centerBin = numBins / 2;
+    if (occupancy[centerBin] == 0) {
+        leftBearing = 0;
+        rightBearing = 0;
+        distance = -1;
+        return;
+    }
+    leftBearing = -MAX_FIELD_OF_VIEW_ANGLE;
+    for (int bin = centerBin; bin >= 0; --bin) {
+        if (occupancy[bin] == 0) {
+            leftBearing = bin * CLEAR_PATH_RESOLUTION - MAX_FIELD_OF_VIEW_ANGLE;
+            break;
+        }
+    }
+    rightBearing = MAX_FIELD_OF_VIEW_ANGLE;
+    for (int bin = centerBin; bin < numBins; ++bin) {
+        if (occupancy[bin] == 0) {
+            rightBearing = bin * CLEAR_PATH_RESOLUTION - MAX_FIELD_OF_VIEW_ANGLE;
+            break;
+        }
+    }
+}
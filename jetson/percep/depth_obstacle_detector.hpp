@@ -0,0 +1,61 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+#include "rapidjson/document.h"
+
+/* --- Depth Obstacle Detector --- */
+//Finds obstacles straight from the depth image, without a point cloud
+//Every row below the horizon has the depth flat ground would have there, so a pixel
+//noticeably closer than that sticks up out of the ground. The nearest such pixel of
+//every column is found in one vectorized pass over the image. The columns are
+//then binned by bearing into the same occupancy histogram and range profile the PCL
+//class makes, so both give the same obstacle_return and profile.
+//Less precise than clustering the cloud, a slope reads as an obstacle, but cheap
+//enough to run on every frame.
+class DepthObstacleDetector {
+public:
+    explicit DepthObstacleDetector(const rapidjson::Document &mRoverConfig);
+
+    //Runs on a CV_32FC1 depth image in millimeters, as the ZED and frame logs give it
+    void detect(const cv::Mat &depth);
+
+    //Same meaning as the PCL class's, bearings in degrees and distance in meters,
+    //-1 if the center path is clear
+    double leftBearing;
+    double rightBearing;
+    double distance;
+
+    //Distance in meters to the nearest obstacle in each bearing bin, -1 if clear
+    std::vector<float> rangeProfile;
+
+private:
+    //Recomputes the per row thresholds and per column bearings for an image size
+    void prepare(int rows, int cols);
+
+    int MAX_FIELD_OF_VIEW_ANGLE;
+    double CLEAR_PATH_RESOLUTION;
+    double MM_PER_M;
+    double HALF_ROVER_M;
+    double MAX_RANGE_M;
+    double HORIZONTAL_FOV;
+    double VERTICAL_FOV;
+    double CAMERA_HEIGHT_M;
+    double CAMERA_PITCH;
+    //A pixel is an obstacle once it is this much closer than the ground, as a fraction
+    double GROUND_MARGIN;
+    //Rows of the image that are looked at, as fractions from the top
+    double TOP_ROW;
+    double BOTTOM_ROW;
+
+    int preparedRows;
+    int preparedCols;
+    //Depth in millimeters, as the ZED measures it, below which a pixel of each row is an obstacle
+    std::vector<float> rowThreshold;
+    //Tangent of each column's bearing, x over z
+    std::vector<float> columnTan;
+    //Nearest obstacle depth of each column, reused across frames
+    std::vector<float> columnDepth;
+    //Number of columns blocking each bearing bin, widened by half the rover
+    std::vector<int> occupancy;
+};
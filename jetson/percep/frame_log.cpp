@@ -0,0 +1,154 @@
+#include "frame_log.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t padded(size_t bytes) {
+    return (bytes + FRAME_LOG_ALIGNMENT - 1) / FRAME_LOG_ALIGNMENT * FRAME_LOG_ALIGNMENT;
+}
+
+/* --- Frame Log Writer --- */
+FrameLogWriter::FrameLogWriter() : file{nullptr} {}
+
+FrameLogWriter::~FrameLogWriter() {
+    close();
+}
+
+bool FrameLogWriter::open(const std::string &filename) {
+    close();
+    file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "could not open frame log " << filename << "\n";
+        return false;
+    }
+
+    //header is padded too so every record starts aligned
+    FrameLogHeader header{FRAME_LOG_MAGIC, FRAME_LOG_VERSION};
+    writePadded(&header, sizeof(header));
+    return true;
+}
+
+bool FrameLogWriter::isOpen() const {
+    return file != nullptr;
+}
+
+void FrameLogWriter::writePadded(const void *bytes, size_t count) {
+    static const uint8_t zeros[FRAME_LOG_ALIGNMENT] = {};
+    fwrite(bytes, 1, count, file);
+    fwrite(zeros, 1, padded(count) - count, file);
+}
+
+void FrameLogWriter::append(int64_t timestampNs, const cv::Mat &rgb, const cv::Mat &depth,
+                            const FrameLogPoint *points, uint32_t cloudWidth, uint32_t cloudHeight) {
+    if (!file) return;
+
+    //rows are written back to back, so non continuous Mats go through a copy
+    cv::Mat rgbData = rgb.isContinuous() ? rgb : rgb.clone();
+    cv::Mat depthData = depth.isContinuous() ? depth : depth.clone();
+
+    FrameLogRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.magic = FRAME_LOG_RECORD_MAGIC;
+    record.timestampNs = timestampNs;
+    record.rgbRows = rgbData.rows;
+    record.rgbCols = rgbData.cols;
+    record.rgbType = rgbData.type();
+    record.depthRows = depthData.rows;
+    record.depthCols = depthData.cols;
+    record.depthType = depthData.type();
+    record.cloudWidth = points ? cloudWidth : 0;
+    record.cloudHeight = points ? cloudHeight : 0;
+    record.rgbBytes = rgbData.total() * rgbData.elemSize();
+    record.depthBytes = depthData.total() * depthData.elemSize();
+    record.cloudBytes = (uint64_t)record.cloudWidth * record.cloudHeight * sizeof(FrameLogPoint);
+
+    writePadded(&record, sizeof(record));
+    writePadded(rgbData.data, record.rgbBytes);
+    writePadded(depthData.data, record.depthBytes);
+    writePadded(points, record.cloudBytes);
+}
+
+void FrameLogWriter::close() {
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+/* --- Frame Log Reader --- */
+FrameLogReader::FrameLogReader() : data{nullptr}, length{0} {}
+
+FrameLogReader::~FrameLogReader() {
+    close();
+}
+
+bool FrameLogReader::open(const std::string &filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "could not open frame log " << filename << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrameLogHeader)) {
+        ::close(fd);
+        std::cerr << "frame log " << filename << " is empty\n";
+        return false;
+    }
+
+    //private mapping, so anyone drawing on a replayed frame only touches their own pages
+    length = st.st_size;
+    void *mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        length = 0;
+        std::cerr << "could not map frame log " << filename << "\n";
+        return false;
+    }
+    data = static_cast<uint8_t *>(mapping);
+
+    const FrameLogHeader *header = reinterpret_cast<const FrameLogHeader *>(data);
+    if (header->magic != FRAME_LOG_MAGIC || header->version != FRAME_LOG_VERSION) {
+        std::cerr << filename << " is not a version " << FRAME_LOG_VERSION << " frame log\n";
+        close();
+        return false;
+    }
+
+    //Index every complete record, a partially written last record is skipped
+    size_t offset = padded(sizeof(FrameLogHeader));
+    while (offset + sizeof(FrameLogRecord) <= length) {
+        const FrameLogRecord *record = reinterpret_cast<const FrameLogRecord *>(data + offset);
+        if (record->magic != FRAME_LOG_RECORD_MAGIC) break;
+        size_t end = offset + padded(sizeof(FrameLogRecord)) + padded(record->rgbBytes) +
+                     padded(record->depthBytes) + padded(record->cloudBytes);
+        if (end > length) break;
+        offsets.push_back(offset);
+        offset = end;
+    }
+    return true;
+}
+
+void FrameLogReader::close() {
+    if (data) munmap(data, length);
+    data = nullptr;
+    length = 0;
+    offsets.clear();
+}
+
+FrameLogView FrameLogReader::frame(size_t i) const {
+    const FrameLogRecord *record = reinterpret_cast<const FrameLogRecord *>(data + offsets[i]);
+    uint8_t *rgb = data + offsets[i] + padded(sizeof(FrameLogRecord));
+    uint8_t *depth = rgb + padded(record->rgbBytes);
+    uint8_t *cloud = depth + padded(record->depthBytes);
+
+    FrameLogView view;
+    view.timestampNs = record->timestampNs;
+    if (record->rgbBytes) view.rgb = cv::Mat(record->rgbRows, record->rgbCols, record->rgbType, rgb);
+    if (record->depthBytes) view.depth = cv::Mat(record->depthRows, record->depthCols, record->depthType, depth);
+    view.points = record->cloudBytes ? reinterpret_cast<const FrameLogPoint *>(cloud) : nullptr;
+    view.cloudWidth = record->cloudWidth;
+    view.cloudHeight = record->cloudHeight;
+    return view;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* --- Frame Log Format --- */
+//A frame log is a FrameLogHeader followed by records back to back. Every record
+//is a FrameLogRecord followed by the raw rgb, depth and cloud bytes, each padded
+//to FRAME_LOG_ALIGNMENT so the reader can point Mats straight into the mapping.
+//There is no trailing index: the reader walks the record headers when it opens
+//the log, which also means a log cut short by a crash is still readable
+const uint32_t FRAME_LOG_MAGIC = 0x4c46524d; //"MRFL"
+const uint32_t FRAME_LOG_RECORD_MAGIC = 0x4345524d; //"MREC"
+const uint32_t FRAME_LOG_VERSION = 1;
+const size_t FRAME_LOG_ALIGNMENT = 16;
+
+struct FrameLogHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct FrameLogRecord {
+    uint32_t magic;
+    uint32_t reserved;
+    int64_t timestampNs;
+    int32_t rgbRows, rgbCols, rgbType;
+    int32_t depthRows, depthCols, depthType;
+    uint32_t cloudWidth, cloudHeight;
+    uint64_t rgbBytes, depthBytes, cloudBytes;
+};
+
+//Point as stored in the log, independent of the PCL point layout
+struct FrameLogPoint {
+    float x, y, z;
+    uint32_t rgba;
+};
+
+/* --- Frame Log Writer --- */
+//Appends frames to a log, not thread safe
+class FrameLogWriter {
+public:
+    FrameLogWriter();
+    ~FrameLogWriter();
+
+    bool open(const std::string &filename);
+    bool isOpen() const;
+    //Writes one frame, any of the parts may be empty
+    void append(int64_t timestampNs, const cv::Mat &rgb, const cv::Mat &depth,
+                const FrameLogPoint *points, uint32_t cloudWidth, uint32_t cloudHeight);
+    void close();
+
+private:
+    void writePadded(const void *data, size_t bytes);
+
+    FILE *file;
+};
+
+/* --- Frame Log View --- */
+//One frame of a log, the Mats and points alias the memory mapped file
+struct FrameLogView {
+    int64_t timestampNs;
+    cv::Mat rgb;
+    cv::Mat depth;
+    const FrameLogPoint *points;
+    uint32_t cloudWidth, cloudHeight;
+};
+
+/* --- Frame Log Reader --- */
+//Memory maps a log and gives random access to its frames
+class FrameLogReader {
+public:
+    FrameLogReader();
+    ~FrameLogReader();
+
+    bool open(const std::string &filename);
+    void close();
+
+    size_t size() const { return offsets.size(); }
+    //Views stay valid until the reader is closed
+    FrameLogView frame(size_t i) const;
+
+private:
+    uint8_t *data;
+    size_t length;
+    std::vector<size_t> offsets;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include "config.h"
+
+#if OBSTACLE_DETECTION
+
+#include <cstddef>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/* --- Obstacle Points --- */
+//The points the obstacle pipeline works on, x y z in mm and nothing else
+//pcl::PointXYZ is half the size of the camera's pcl::PointXYZRGB, so the filters, RANSAC
+//and clustering move half the memory. Color only goes back on for the debug viewer
+typedef pcl::PointXYZ ObstaclePoint;
+typedef pcl::PointCloud<ObstaclePoint> ObstacleCloud;
+
+//Copies the coordinates of a camera cloud into an obstacle cloud, keeping it organized
+//dst keeps its capacity, so this only allocates when the camera cloud grows
+inline void toObstacleCloud(const pcl::PointCloud<pcl::PointXYZRGB> &src, ObstacleCloud &dst) {
+    dst.points.resize(src.points.size());
+    for (size_t i = 0; i < src.points.size(); ++i) {
+        dst.points[i].x = src.points[i].x;
+        dst.points[i].y = src.points[i].y;
+        dst.points[i].z = src.points[i].z;
+    }
+    dst.width = src.width;
+    dst.height = src.height;
+    dst.is_dense = src.is_dense;
+}
+
+#endif
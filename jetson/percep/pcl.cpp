@@ -1,5 +1,6 @@
 #include "pcl.hpp"
 #include "perception.hpp"
+#include "stage_timer.hpp"
 
 #if OBSTACLE_DETECTION
 
@@ -22,16 +23,66 @@
         CLUSTER_TOLERANCE{mRoverConfig["pt_cloud"]["euclidean_cluster"]["cluster_tolerance"].GetInt()},
         MIN_CLUSTER_SIZE{mRoverConfig["pt_cloud"]["euclidean_cluster"]["min_cluster_size"].GetInt()},
         MAX_CLUSTER_SIZE{mRoverConfig["pt_cloud"]["euclidean_cluster"]["max_cluster_size"].GetInt()},
+        ORGANIZED_CLUSTERING{std::string(mRoverConfig["pt_cloud"]["euclidean_cluster"]["method"].GetString()) == "organized"},
+        CLEAR_PATH_RESOLUTION{mRoverConfig["pt_cloud"]["clear_path_resolution"].GetDouble()},
+        PLANE_TRACK_MIN_INLIER_RATIO{mRoverConfig["pt_cloud"]["ransac"]["track_min_inlier_ratio"].GetDouble()},
+        PLANE_TRACK_DEGRADE_RATIO{mRoverConfig["pt_cloud"]["ransac"]["track_degrade_ratio"].GetDouble()},
+        ELEVATION_GRID{!!mRoverConfig["pt_cloud"]["elevation_grid"]["enabled"].GetInt()},
+        GRID_CELL_SIZE{mRoverConfig["pt_cloud"]["elevation_grid"]["cell_size"].GetDouble()},
+        GRID_STEP_HEIGHT{mRoverConfig["pt_cloud"]["elevation_grid"]["step_height"].GetDouble()},
+        GRID_MAX_SLOPE{mRoverConfig["pt_cloud"]["elevation_grid"]["max_slope"].GetDouble()},
+        GRID_MIN_POINTS{mRoverConfig["pt_cloud"]["elevation_grid"]["min_points"].GetInt()},
+        CAMERA_PITCH{mRoverConfig["rover_specs"]["angle_offset"].GetDouble()},
         
         //Other Values
         leftBearing{0}, rightBearing{0}, distance{0}, detected{false},
-        pt_cloud_ptr{new pcl::PointCloud<pcl::PointXYZRGB>} {
+        pt_cloud_ptr{new ObstacleCloud},
+        filtered_cloud_ptr{new ObstacleCloud},
+        organized_cloud_ptr{new ObstacleCloud},
+        groundPlane{new pcl::ModelCoefficients()}, groundPlaneTracked{false}, groundPlaneInlierRatio{0} {
 
         #if PERCEPTION_DEBUG
+        viewerCloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
         viewer = createRGBVisualizer(); //This is a smart pointer so no need to worry ab deleteing it
         viewer_original = createRGBVisualizer();
         #endif
 
+        #if OBSTACLE_GPU
+        GPUObstacleParams params;
+        params.upperBoundZ = UP_BD_Z;
+        params.upperBoundY = UP_BD_Y;
+        params.lowerBound = LOW_BD;
+        params.leafSize = LEAF_SIZE;
+        params.maxIterations = MAX_ITERATIONS;
+        params.distanceThreshold = DISTANCE_THRESHOLD;
+        params.epsAngleRad = pcl::deg2rad(SEGMENTATION_EPSLION);
+        params.clusterTolerance = CLUSTER_TOLERANCE;
+        params.minClusterSize = MIN_CLUSTER_SIZE;
+        params.maxClusterSize = MAX_CLUSTER_SIZE;
+        gpuPipeline.reset(new GPUObstaclePipeline(params, PT_CLOUD_WIDTH*PT_CLOUD_HEIGHT));
+        #endif
+
+        //One bearing bin per CLEAR_PATH_RESOLUTION degrees, with a bin exactly at center
+        occupancy.assign(2 * (int)std::round(MAX_FIELD_OF_VIEW_ANGLE / CLEAR_PATH_RESOLUTION) + 1, 0);
+        rangeProfile.assign(occupancy.size(), -1);
+
+        //Interest point buckets cover every x the field of view can reach at the far pass through bound
+        bucketWidth = ROVER_W_MM / 10;
+        bucketOriginX = UP_BD_Z * std::tan(MAX_FIELD_OF_VIEW_ANGLE * PI / 180);
+        bucketIndex.assign((int)std::ceil(2 * bucketOriginX / bucketWidth) + 1, -1);
+        bucketMaxX.assign(bucketIndex.size(), 0);
+
+        //The grid reaches as far as the pass through bound and as wide as the ZED sees there
+        const double gridHalfWidth = UP_BD_Z * std::tan(mRoverConfig["zed_specs"]["horizontal_fov"].GetDouble() / 2 * PI / 180);
+        gridCols = 2 * (int)std::ceil(gridHalfWidth / GRID_CELL_SIZE);
+        gridRows = (int)std::ceil(UP_BD_Z / GRID_CELL_SIZE);
+        if (ELEVATION_GRID) {
+            gridMinHeight.resize(gridCols * gridRows);
+            gridMaxHeight.resize(gridCols * gridRows);
+            gridCount.resize(gridCols * gridRows);
+            gridTop.resize(gridCols * gridRows);
+        }
+
         #if ZED_SDK_PRESENT
            sl::Resolution cloud_res = sl::Resolution(PT_CLOUD_WIDTH, PT_CLOUD_HEIGHT);
            cloudArea = cloud_res.area();
@@ -39,6 +90,12 @@
             cloudArea = PT_CLOUD_WIDTH*PT_CLOUD_HEIGHT;
         #endif
 
+        //Reserve every buffer of the cloud arena up front, filters only ever shrink clouds
+        pt_cloud_ptr->points.reserve(cloudArea);
+        filtered_cloud_ptr->points.reserve(cloudArea);
+        organized_cloud_ptr->points.reserve(cloudArea);
+        groundMask.reserve(cloudArea);
+
     };
 
 /* --- Pass Through Filter --- */
@@ -51,7 +108,7 @@ void PCL::PassThroughFilter(const std::string axis, const double upperLimit) {
         pcl::ScopeTime t("PassThroughFilter");
     #endif
 
-    pcl::PassThrough<pcl::PointXYZRGB> pass;
+    pcl::PassThrough<ObstaclePoint> pass;
     pass.setInputCloud(pt_cloud_ptr);
 
     pass.setFilterFieldName(axis);
@@ -69,12 +126,60 @@ void PCL::DownsampleVoxelFilter() {
         pcl::ScopeTime t("VoxelFilter");
     #endif
 
-    pcl::VoxelGrid<pcl::PointXYZRGB> sor;
+    pcl::VoxelGrid<ObstaclePoint> sor;
     sor.setInputCloud (pt_cloud_ptr);
     sor.setLeafSize(LEAF_SIZE, LEAF_SIZE, LEAF_SIZE);
     sor.filter (*pt_cloud_ptr);
 }
 
+/* --- Pass Through Voxel Filter --- */
+//Fused version of PassThroughFilter("z"), PassThroughFilter("y") and DownsampleVoxelFilter
+//Every point is bounds checked on both axes and added to its voxel's running sum
+//in one traversal of the cloud, then each occupied voxel is written back as its centroid
+//Produces the same cloud as the three filters without rewriting the cloud in between
+void PCL::PassThroughVoxelFilter() {
+    #if PERCEPTION_DEBUG
+        pcl::ScopeTime t("PassThroughVoxelFilter");
+    #endif
+    ScopedStageTimer timer(Stage::PassThroughVoxel);
+
+    //Voxel indices are offset so they are non negative and packed as 21 bits per axis
+    const int64_t KEY_OFFSET = 1 << 20;
+    const uint64_t KEY_MASK = (1 << 21) - 1;
+    const float inverseLeaf = 1.0f / LEAF_SIZE;
+
+    voxelGrid.clear();
+    for (const auto &pt : pt_cloud_ptr->points) {
+        if (!(pt.z >= LOW_BD && pt.z <= UP_BD_Z && pt.y >= LOW_BD && pt.y <= UP_BD_Y) || !std::isfinite(pt.x)) {
+            continue;
+        }
+
+        uint64_t ix = (uint64_t)((int64_t)std::floor(pt.x * inverseLeaf) + KEY_OFFSET) & KEY_MASK;
+        uint64_t iy = (uint64_t)((int64_t)std::floor(pt.y * inverseLeaf) + KEY_OFFSET) & KEY_MASK;
+        uint64_t iz = (uint64_t)((int64_t)std::floor(pt.z * inverseLeaf) + KEY_OFFSET) & KEY_MASK;
+
+        VoxelAccumulator &voxel = voxelGrid[(ix << 42) | (iy << 21) | iz];
+        voxel.x += pt.x;
+        voxel.y += pt.y;
+        voxel.z += pt.z;
+        ++voxel.count;
+    }
+
+    //Write centroids back in place, the cloud's capacity is kept for the next frame
+    pt_cloud_ptr->points.resize(voxelGrid.size());
+    size_t i = 0;
+    for (const auto &entry : voxelGrid) {
+        const VoxelAccumulator &voxel = entry.second;
+        ObstaclePoint &pt = pt_cloud_ptr->points[i++];
+        pt.x = voxel.x / voxel.count;
+        pt.y = voxel.y / voxel.count;
+        pt.z = voxel.z / voxel.count;
+    }
+    pt_cloud_ptr->width = pt_cloud_ptr->points.size();
+    pt_cloud_ptr->height = 1;
+    pt_cloud_ptr->is_dense = true;
+}
+
 /* --- RANSAC Plane Segmentation Blue --- */
 //Picks three random points in point cloud
 //Counts how many points lie on or near the plane made by these three
@@ -87,41 +192,95 @@ void PCL::RANSACSegmentation(string type) {
     #if PERCEPTION_DEBUG
         pcl::ScopeTime t("RANSACSegmentation");
     #endif
-
-    //Creates instance of RANSAC Algorithm
-    pcl::SACSegmentation<pcl::PointXYZRGB> seg;
-    seg.setOptimizeCoefficients(true);
-    seg.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(MAX_ITERATIONS);
-    seg.setDistanceThreshold(DISTANCE_THRESHOLD); //Distance in mm away from actual plane a point can be
-    // to be considered an inlier
-    seg.setAxis(Eigen::Vector3f(0, 1, 0)); //Looks for a plane along the Z axis
-    //Max degree the normal of plane can be from Z axis
-    seg.setEpsAngle(pcl::deg2rad(SEGMENTATION_EPSLION));
+    ScopedStageTimer timer(Stage::Ransac);
 
     //Objects where segmented plane is stored
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients());
     pcl::PointIndices::Ptr inliers(new pcl::PointIndices());
 
-    seg.setInputCloud(pt_cloud_ptr);
-    seg.segment(*inliers, *coefficients);
+    //Try the plane from last frame first, the ground barely moves between frames
+    if(!TrackGroundPlane(*inliers)) {
+        //Creates instance of RANSAC Algorithm
+        pcl::SACSegmentation<ObstaclePoint> seg;
+        seg.setOptimizeCoefficients(true);
+        seg.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
+        seg.setMethodType(pcl::SAC_RANSAC);
+        seg.setMaxIterations(MAX_ITERATIONS);
+        seg.setDistanceThreshold(DISTANCE_THRESHOLD); //Distance in mm away from actual plane a point can be
+        // to be considered an inlier
+        seg.setAxis(Eigen::Vector3f(0, 1, 0)); //Looks for a plane along the Z axis
+        //Max degree the normal of plane can be from Z axis
+        seg.setEpsAngle(pcl::deg2rad(SEGMENTATION_EPSLION));
+
+        seg.setInputCloud(pt_cloud_ptr);
+        seg.segment(*inliers, *groundPlane);
+
+        //Remember how well a full fit explains the cloud so tracking knows when it has degraded
+        groundPlaneTracked = groundPlane->values.size() == 4 && !pt_cloud_ptr->points.empty();
+        if(groundPlaneTracked) {
+            groundPlaneInlierRatio = (double)inliers->indices.size() / pt_cloud_ptr->points.size();
+        }
+    }
 
     if(type == "blue") {
+        #if PERCEPTION_DEBUG
         for (int i = 0; i < (int)inliers->indices.size(); i++) {
-            pt_cloud_ptr->points[inliers->indices[i]].r = 255;
-            pt_cloud_ptr->points[inliers->indices[i]].g = 255;
-            pt_cloud_ptr->points[inliers->indices[i]].b = 0;
+            PaintPoint(inliers->indices[i], 255, 255, 0);
         }
+        #endif
     }
     else {
-        //Creates object that filters out identified points
-        pcl::ExtractIndices<pcl::PointXYZRGB> extract;
-        extract.setInputCloud(pt_cloud_ptr);
-        extract.setIndices(inliers);
-        extract.setNegative(true); //Controls whether chosen indices are retained or removed
-        extract.filter(*pt_cloud_ptr);
+        //Copies every point that is not on the plane into the second buffer of the
+        //arena and swaps the buffers, so neither one has to be reallocated
+        groundMask.assign(pt_cloud_ptr->points.size(), 0);
+        for (int index : inliers->indices) {
+            groundMask[index] = 1;
+        }
+
+        filtered_cloud_ptr->points.resize(pt_cloud_ptr->points.size() - inliers->indices.size());
+        size_t kept = 0;
+        for (size_t i = 0; i < pt_cloud_ptr->points.size(); ++i) {
+            if (!groundMask[i]) filtered_cloud_ptr->points[kept++] = pt_cloud_ptr->points[i];
+        }
+        filtered_cloud_ptr->points.resize(kept);
+        filtered_cloud_ptr->width = kept;
+        filtered_cloud_ptr->height = 1;
+        filtered_cloud_ptr->is_dense = pt_cloud_ptr->is_dense;
+        pt_cloud_ptr.swap(filtered_cloud_ptr);
+    }
+}
+
+/* --- Track Ground Plane --- */
+//Tests the ground plane from the previous frame against the current cloud
+//If enough points still lie on it, the plane is refined with a least squares fit
+//over those inliers and no RANSAC iterations are spent
+//Returns false when the fit degrades so the caller falls back to full RANSAC
+bool PCL::TrackGroundPlane(pcl::PointIndices &inliers) {
+    if(!groundPlaneTracked || pt_cloud_ptr->points.empty()) return false;
+
+    pcl::SampleConsensusModelPlane<ObstaclePoint> model(pt_cloud_ptr);
+    Eigen::VectorXf coefficients = Eigen::Map<Eigen::VectorXf>(groundPlane->values.data(), 4);
+
+    model.selectWithinDistance(coefficients, DISTANCE_THRESHOLD, inliers.indices);
+    double ratio = (double)inliers.indices.size() / pt_cloud_ptr->points.size();
+    if(ratio < PLANE_TRACK_MIN_INLIER_RATIO || ratio < groundPlaneInlierRatio * PLANE_TRACK_DEGRADE_RATIO) {
+        #if PERCEPTION_DEBUG
+            std::cout << "Ground plane lost, inlier ratio " << ratio << std::endl;
+        #endif
+        groundPlaneTracked = false;
+        return false;
+    }
+
+    //Refine the plane so it follows slow changes in rover pitch and terrain
+    Eigen::VectorXf refined;
+    model.optimizeModelCoefficients(inliers.indices, coefficients, refined);
+
+    //Keep the refined plane only if it still satisfies the perpendicular axis constraint
+    Eigen::Vector3f normal = refined.head<3>().normalized();
+    if(std::acos(std::min(1.0f, std::abs(normal.y()))) <= pcl::deg2rad(SEGMENTATION_EPSLION)) {
+        std::copy(refined.data(), refined.data() + 4, groundPlane->values.begin());
+        model.selectWithinDistance(refined, DISTANCE_THRESHOLD, inliers.indices);
     }
+    return true;
 }
 
 /* --- Euclidian Cluster Extraction --- */
@@ -133,13 +292,14 @@ void PCL::CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_
     #if PERCEPTION_DEBUG
         pcl::ScopeTime t("CPU Cluster Extraction");
     #endif
+    ScopedStageTimer timer(Stage::Cluster);
 
     // Creating the KdTree object for the search method of the extraction
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
+    pcl::search::KdTree<ObstaclePoint>::Ptr tree(new pcl::search::KdTree<ObstaclePoint>);
     tree->setInputCloud(pt_cloud_ptr);
 
     //Extracts clusters using nearet neighbors search
-    pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ec;
+    pcl::EuclideanClusterExtraction<ObstaclePoint> ec;
     ec.setClusterTolerance (CLUSTER_TOLERANCE); // 60 mm radius per point
     ec.setMinClusterSize (MIN_CLUSTER_SIZE);
     ec.setMaxClusterSize (MAX_CLUSTER_SIZE);
@@ -155,19 +315,13 @@ void PCL::CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_
         for(std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin(); it != cluster_indices.end(); ++it) {
             for(std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); ++pit) {
                 if(j % 3) {
-                    pt_cloud_ptr->points[*pit].r = 100 + j * 15;
-                    pt_cloud_ptr->points[*pit].g = 0;
-                    pt_cloud_ptr->points[*pit].b = 0;
+                    PaintPoint(*pit, 100 + j * 15, 0, 0);
                 }
                 else if(j % 2) {
-                    pt_cloud_ptr->points[*pit].r = 0;
-                    pt_cloud_ptr->points[*pit].g = 100 + j * 15;
-                    pt_cloud_ptr->points[*pit].b = 0;
+                    PaintPoint(*pit, 0, 100 + j * 15, 0);
                 }
                 else {
-                    pt_cloud_ptr->points[*pit].r = 0;
-                    pt_cloud_ptr->points[*pit].g = 0;
-                    pt_cloud_ptr->points[*pit].b = 100 + j * 15;
+                    PaintPoint(*pit, 0, 0, 100 + j * 15);
                 }
             }
             j++;
@@ -175,125 +329,381 @@ void PCL::CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_
     #endif
 }
 
+#if OBSTACLE_GPU
+/* --- GPU Euclidian Cluster Extraction --- */
+//Uploads the raw cloud once and runs passthrough, voxel downsampling,
+//RANSAC ground removal and clustering without leaving the GPU
+//Only the clustered obstacle points are copied back into pt_cloud_ptr
+void PCL::GPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices) {
+    #if PERCEPTION_DEBUG
+        pcl::ScopeTime t("GPU Obstacle Pipeline");
+    #endif
+    ScopedStageTimer timer(Stage::Cluster);
+
+    gpuPipeline->run(reinterpret_cast<const float *>(pt_cloud_ptr->points.data()),
+                     sizeof(ObstaclePoint) / sizeof(float), pt_cloud_ptr->points.size(),
+                     gpuPoints, gpuClusters);
+
+    size_t numPoints = gpuPoints.size() / 3;
+    pt_cloud_ptr->points.resize(numPoints);
+    pt_cloud_ptr->width = numPoints;
+    pt_cloud_ptr->height = 1;
+    for (size_t i = 0; i < numPoints; ++i) {
+        ObstaclePoint &pt = pt_cloud_ptr->points[i];
+        pt.x = gpuPoints[3 * i];
+        pt.y = gpuPoints[3 * i + 1];
+        pt.z = gpuPoints[3 * i + 2];
+    }
+
+    cluster_indices.resize(gpuClusters.size());
+    for (size_t i = 0; i < gpuClusters.size(); ++i) {
+        cluster_indices[i].indices.swap(gpuClusters[i]);
+    }
+
+    #if PERCEPTION_DEBUG
+        std::cout << "Number of clusters: " << cluster_indices.size() << std::endl;
+    #endif
+}
+#endif
+
+/* --- Organized Cluster Extraction --- */
+//Clusters the organized WIDTH x HEIGHT cloud straight from the image grid
+//A pixel takes part if it passes the pass through bounds and is not on the ground plane
+//Neighboring pixels (left, up-left, up, up-right) are joined with union-find when their
+//3D distance is within CLUSTER_TOLERANCE, so no KdTree has to be built
+//Produces indices into the organized cloud in the same form as CPUEuclidianClusterExtraction
+void PCL::OrganizedClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices) {
+    #if PERCEPTION_DEBUG
+        pcl::ScopeTime t("Organized Cluster Extraction");
+    #endif
+    ScopedStageTimer timer(Stage::Cluster);
+
+    const int width = pt_cloud_ptr->width;
+    const int height = pt_cloud_ptr->height;
+    const int numPoints = width * height;
+    //Clouds below pt_cloud_width from the resolution ladder have sparser pixels,
+    //so neighbors are further apart and obstacles cover fewer of them
+    const float scale = std::min(1.0f, (float)width / PT_CLOUD_WIDTH);
+    const float tolerance = CLUSTER_TOLERANCE / scale;
+    const float tolerance2 = tolerance * tolerance;
+    const int minClusterSize = std::max(1, (int)(MIN_CLUSTER_SIZE * scale * scale));
+    const int maxClusterSize = (int)(MAX_CLUSTER_SIZE * scale * scale);
+    const auto &points = pt_cloud_ptr->points;
+
+    //Plane from RANSACSegmentation, if there is none every in bounds point is kept
+    const bool hasPlane = groundPlane->values.size() == 4;
+    const float a = hasPlane ? groundPlane->values[0] : 0;
+    const float b = hasPlane ? groundPlane->values[1] : 0;
+    const float c = hasPlane ? groundPlane->values[2] : 0;
+    const float d = hasPlane ? groundPlane->values[3] : 0;
+
+    //-1 marks pixels that are not part of any obstacle
+    clusterParents.assign(numPoints, -1);
+    for (int i = 0; i < numPoints; ++i) {
+        const auto &pt = points[i];
+        bool inBounds = pt.z >= LOW_BD && pt.z <= UP_BD_Z && pt.y >= LOW_BD && pt.y <= UP_BD_Y &&
+                        std::isfinite(pt.x) && !(pt.x == 0 && pt.y == 0 && pt.z == 0);
+        bool onGround = hasPlane && std::abs(a * pt.x + b * pt.y + c * pt.z + d) <= DISTANCE_THRESHOLD;
+        if(inBounds && !onGround) clusterParents[i] = i;
+    }
+
+    //Union-find with path halving
+    auto find = [this](int i) {
+        while(clusterParents[i] != i) {
+            clusterParents[i] = clusterParents[clusterParents[i]];
+            i = clusterParents[i];
+        }
+        return i;
+    };
+    auto join = [&](int i, int j) {
+        if(clusterParents[j] < 0) return;
+        const auto &p = points[i], &q = points[j];
+        float dx = p.x - q.x, dy = p.y - q.y, dz = p.z - q.z;
+        if(dx * dx + dy * dy + dz * dz > tolerance2) return;
+        int ri = find(i), rj = find(j);
+        if(ri != rj) clusterParents[std::max(ri, rj)] = std::min(ri, rj);
+    };
+
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            int i = row * width + col;
+            if(clusterParents[i] < 0) continue;
+            if(col > 0) join(i, i - 1);
+            if(row > 0) {
+                if(col > 0) join(i, i - width - 1);
+                join(i, i - width);
+                if(col < width - 1) join(i, i - width + 1);
+            }
+        }
+    }
+
+    //Gather pixels by root, roots are always the smallest index of their component
+    clusterIds.assign(numPoints, -1);
+    cluster_indices.clear();
+    for (int i = 0; i < numPoints; ++i) {
+        if(clusterParents[i] < 0) continue;
+        int root = find(i);
+        if(clusterIds[root] < 0) {
+            clusterIds[root] = cluster_indices.size();
+            cluster_indices.emplace_back();
+        }
+        cluster_indices[clusterIds[root]].indices.push_back(i);
+    }
+
+    //Apply the same size limits as Euclidean cluster extraction
+    cluster_indices.erase(std::remove_if(cluster_indices.begin(), cluster_indices.end(),
+        [minClusterSize, maxClusterSize](const pcl::PointIndices &cluster) {
+            return (int)cluster.indices.size() < minClusterSize || (int)cluster.indices.size() > maxClusterSize;
+        }), cluster_indices.end());
+
+    #if PERCEPTION_DEBUG
+        std::cout << "Number of clusters: " << cluster_indices.size() << std::endl;
+    #endif
+}
+
+/* --- Elevation Grid --- */
+void PCL::ElevationGridObstacles(std::vector<std::vector<int>> &interest_points) {
+    #if PERCEPTION_DEBUG
+        pcl::ScopeTime t("Elevation Grid");
+    #endif
+    ScopedStageTimer timer(Stage::ElevationGrid);
+
+    std::fill(gridCount.begin(), gridCount.end(), 0);
+
+    //The ZED's y points down and the camera is pitched down by CAMERA_PITCH, so heights
+    //and forward distances are taken in the level frame under the camera
+    const float cosPitch = std::cos(CAMERA_PITCH);
+    const float sinPitch = std::sin(CAMERA_PITCH);
+    const float inverseCell = 1.0f / GRID_CELL_SIZE;
+    const int halfCols = gridCols / 2;
+    const auto &points = pt_cloud_ptr->points;
+    for (int i = 0; i < (int)points.size(); ++i) {
+        const auto &pt = points[i];
+        if (!(pt.z >= LOW_BD && pt.z <= UP_BD_Z && pt.y <= UP_BD_Y) || !std::isfinite(pt.x)) continue;
+
+        const float forward = pt.z * cosPitch - pt.y * sinPitch;
+        const float height = -(pt.y * cosPitch + pt.z * sinPitch);
+        const int row = (int)std::floor(forward * inverseCell);
+        const int col = (int)std::floor(pt.x * inverseCell) + halfCols;
+        if (row < 0 || row >= gridRows || col < 0 || col >= gridCols) continue;
+
+        const int cell = row * gridCols + col;
+        if (gridCount[cell]++ == 0) {
+            gridMinHeight[cell] = height;
+            gridMaxHeight[cell] = height;
+            gridTop[cell] = i;
+        }
+        else {
+            gridMinHeight[cell] = std::min(gridMinHeight[cell], height);
+            if (height > gridMaxHeight[cell]) {
+                gridMaxHeight[cell] = height;
+                gridTop[cell] = i;
+            }
+        }
+    }
+
+    //A neighbor's lowest point can be up to two cells across from this cell's highest
+    const float cellRise = GRID_STEP_HEIGHT + GRID_MAX_SLOPE * GRID_CELL_SIZE;
+    const float neighborRise = GRID_STEP_HEIGHT + 2 * GRID_MAX_SLOPE * GRID_CELL_SIZE;
+    const int neighbors[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    size_t numObstacles = 0;
+    for (int row = 0; row < gridRows; ++row) {
+        for (int col = 0; col < gridCols; ++col) {
+            const int cell = row * gridCols + col;
+            if (gridCount[cell] < GRID_MIN_POINTS) continue;
+
+            bool obstacle = gridMaxHeight[cell] - gridMinHeight[cell] > cellRise;
+            for (int n = 0; n < 4 && !obstacle; ++n) {
+                const int r = row + neighbors[n][0];
+                const int c = col + neighbors[n][1];
+                if (r < 0 || r >= gridRows || c < 0 || c >= gridCols) continue;
+                const int other = r * gridCols + c;
+                obstacle = gridCount[other] >= GRID_MIN_POINTS && gridMaxHeight[cell] - gridMinHeight[other] > neighborRise;
+            }
+            if (!obstacle) continue;
+
+            //Inner vectors keep their capacity from previous frames
+            if (numObstacles == interest_points.size()) interest_points.emplace_back();
+            interest_points[numObstacles].assign(1, gridTop[cell]);
+            ++numObstacles;
+
+            #if PERCEPTION_DEBUG
+                PaintPoint(gridTop[cell], 255, 255, 255);
+            #endif
+        }
+    }
+    interest_points.resize(numObstacles);
+}
+
 /* --- Find Interest Points --- */
 //Finds the edges of each cluster by comparing x and y
 //values of all points in the cluster to find desired ones
 //Interest points are a collection of points that allow us
 //to define the edges of an obsacle
+//Everything is found in a single pass over each cluster: alongside the extremes,
+//each point is dropped into a fixed-width x bucket (a tenth of a rover width)
+//that remembers its rightmost point. Buckets are a flat array reused across frames
 void PCL::FindInterestPoints(std::vector<pcl::PointIndices> &cluster_indices,
                              std::vector<std::vector<int>> &interest_points) {
 
     #if PERCEPTION_DEBUG
         pcl::ScopeTime t("Find Interest Points");
     #endif
+    ScopedStageTimer timer(Stage::InterestPoints);
+
+    const auto &points = pt_cloud_ptr->points;
+    const int numBuckets = bucketIndex.size();
 
     for (int i = 0; i < (int)cluster_indices.size(); ++i)
     {
         std::vector<int>* curr_cluster = &interest_points[i];
-        
-        //Initialize interest points
-        std::fill(curr_cluster->begin(), curr_cluster->end(), cluster_indices[i].indices[0]);
+        const std::vector<int> &indices = cluster_indices[i].indices;
 
         //Interest Points: 0=Leftmost Point 1=Rightmost Point 2=Lowest Point 3=Highest Point 4=Closest Point 5=Furthest Point.
-        for (auto index : cluster_indices[i].indices)
+        int extremes[6];
+        std::fill(extremes, extremes + 6, indices[0]);
+        float minX = points[indices[0]].x, maxX = minX;
+        float minY = points[indices[0]].y, maxY = minY;
+        float minZ = points[indices[0]].z, maxZ = minZ;
+        int lowBucket = numBuckets, highBucket = -1;
+
+        for (auto index : indices)
         {
-            auto curr_point = pt_cloud_ptr->points[index];
-            
-            if(curr_point.x < pt_cloud_ptr->points[curr_cluster->at(0)].x){
-                curr_cluster->at(0) = index;
-            }
-            if(curr_point.x > pt_cloud_ptr->points[curr_cluster->at(1)].x){
-                curr_cluster->at(1) = index;
-            }
-            if(curr_point.y < pt_cloud_ptr->points[curr_cluster->at(2)].y){
-                curr_cluster->at(2) = index;
-            }
-            if(curr_point.y > pt_cloud_ptr->points[curr_cluster->at(3)].y){
-                curr_cluster->at(3) = index;
-            }
-            if(curr_point.z < pt_cloud_ptr->points[curr_cluster->at(4)].z){
-                curr_cluster->at(4) = index;
-            }
-            if(curr_point.z > pt_cloud_ptr->points[curr_cluster->at(5)].z){
-                curr_cluster->at(5) = index;
+            const auto &curr_point = points[index];
+
+            if(curr_point.x < minX) { minX = curr_point.x; extremes[0] = index; }
+            if(curr_point.x > maxX) { maxX = curr_point.x; extremes[1] = index; }
+            if(curr_point.y < minY) { minY = curr_point.y; extremes[2] = index; }
+            if(curr_point.y > maxY) { maxY = curr_point.y; extremes[3] = index; }
+            if(curr_point.z < minZ) { minZ = curr_point.z; extremes[4] = index; }
+            if(curr_point.z > maxZ) { maxZ = curr_point.z; extremes[5] = index; }
+
+            //Rightmost point of every rover width increment
+            int bucket = std::min(numBuckets - 1, std::max(0, (int)((curr_point.x + bucketOriginX) / bucketWidth)));
+            if(bucketIndex[bucket] < 0 || curr_point.x > bucketMaxX[bucket]) {
+                bucketMaxX[bucket] = curr_point.x;
+                bucketIndex[bucket] = index;
             }
+            lowBucket = std::min(lowBucket, bucket);
+            highBucket = std::max(highBucket, bucket);
         }
 
+        curr_cluster->assign(extremes, extremes + 6);
+
         //Calulates the width of the obstacle based on the difference between the leftmost and rightmost interest point.
-        double width = std::abs(pt_cloud_ptr->points[curr_cluster->at(1)].x - pt_cloud_ptr->points[curr_cluster->at(0)].x);
+        double width = std::abs(maxX - minX);
         //Calculates the number of rover widths that fit within the obstacle. The x10 multiplier adds more width increments.
         int roverWidths = ((int) width/ROVER_W_MM) * 10;
 
-        //Only want to add interest points if the obstacle's width > rover's Width.
-        if(roverWidths > 0) {
-            //Create a map data structure where the Key is an int from 0  to roverWidths-1.
-            //Each key index represents the a percentile increment.
-            //Example: if roverWidths = 40, then index 0 would represent leftmost + 0.025 * obstacle width,
-            //index 1 would represent leftmost + 0.05 * obstacle width and so on.
-            std::map<int, double> increments;
-            for(size_t i = 0; i < (size_t) roverWidths; ++i) {
-                //The defualt value stored in each key is the value of the leftmost interest point.
-                increments[i] = pt_cloud_ptr->points[curr_cluster->at(0)].x;
-                //Creates a new interest point and sets it equal to the index of the leftmost point.
-                curr_cluster->push_back(curr_cluster->at(0));
-            }
-            
-            //Using the x value of the current point, calculate the percentile that the current point would fall under, 
-            //and then compare that x value to the one of the point that is currently representing that percentile.
-            for (auto index : cluster_indices[i].indices) {
-                auto curr_point = pt_cloud_ptr->points[index];
-                if(curr_point.x > pt_cloud_ptr->points[curr_cluster->at(0)].x && curr_point.x < pt_cloud_ptr->points[curr_cluster->at(1)].x) {
-                    //If roverWidths = 40 and if your x value falls between leftmost + 0.025 * obstacle width and leftmost + 0.05 * obstacle width,
-                    //then the value of i would be 1 which represents the index of increment map the we want to check.
-                    int j = ((double)(std::abs(curr_point.x - pt_cloud_ptr->points[curr_cluster->at(0)].x)/width)/((double) 1/roverWidths));
-                    //If the x value of the current point is greater than the value representing that percentile, 
-                    //we set the value represnting the percentile equal to the x value of the current point.
-                    if(increments[j] < curr_point.x) {
-                        increments[j] = curr_point.x;
-                        curr_cluster->at(6 + j) = index;
-                    }
-                }
+        for (int bucket = lowBucket; bucket <= highBucket; ++bucket) {
+            //Only want to add interest points if the obstacle's width > rover's Width.
+            //Points on the leftmost or rightmost edge are already interest points
+            if(roverWidths > 0 && bucketIndex[bucket] >= 0 &&
+               bucketMaxX[bucket] > minX && bucketMaxX[bucket] < maxX) {
+                curr_cluster->push_back(bucketIndex[bucket]);
             }
+            //Reset only the buckets this cluster touched
+            bucketIndex[bucket] = -1;
         }
-        
+
         #if PERCEPTION_DEBUG
             for(auto interest_point : *curr_cluster)
             {
-                pt_cloud_ptr->points[interest_point].r = 255;
-                pt_cloud_ptr->points[interest_point].g = 255;
-                pt_cloud_ptr->points[interest_point].b = 255;
+                PaintPoint(interest_point, 255, 255, 255);
             }
         #endif
     }
 }
 
-/* --- Get Angle Off Center--- */
-//This function finds the angle off center the
-//line that passes through both these points is
-//Direction of 0 is left and 1 is right
-double PCL::getAngleOffCenter(int buffer, int direction, const std::vector<std::vector<int>> &interest_points,
-                              std::vector<int> &obstacles) {
-    double newAngle = 0;
-    //If Center Path is blocked check the left or right path depending on direction parameter
-    while (newAngle > -MAX_FIELD_OF_VIEW_ANGLE && newAngle < MAX_FIELD_OF_VIEW_ANGLE) {
+/* --- Build Occupancy Histogram --- */
+//The rover can drive along bearing angle a if for every interest point (x, z)
+//|x - z * tan(a)| > HALF_ROVER, so each interest point blocks the bearings
+//between atan((x - HALF_ROVER) / z) and atan((x + HALF_ROVER) / z)
+//Every interest point marks its blocked range once in a difference array over
+//bearing bins, so finding clear paths afterwards is a linear scan over the bins
+//Also finds the distance to the closest obstacle in the center path, and the
+//range profile from the bearings each cluster actually covers
+void PCL::BuildOccupancyHistogram(const std::vector<std::vector<int>> &interest_points) {
+    const int numBins = occupancy.size();
+    std::fill(occupancy.begin(), occupancy.end(), 0);
+    std::fill(rangeProfile.begin(), rangeProfile.end(), -1);
+
+    //if there are no interest points, the distance from the last obstacle should be -1
+    distance = -1;
+
+    for(const auto &cluster : interest_points) {
+        double sizeOfCluster = 0;
+        double currentDistance = 0;
+        double minAngle = DBL_MAX, maxAngle = -DBL_MAX, nearest = DBL_MAX;
+        for(auto index : cluster) {
+            const auto &pt = pt_cloud_ptr->points[index];
+            if(pt.z <= 0) continue;
+
+            double angle = atan(pt.x / pt.z) * 180 / PI;
+            minAngle = std::min(minAngle, angle);
+            maxAngle = std::max(maxAngle, angle);
+            nearest = std::min(nearest, (double)std::sqrt(pt.x * pt.x + pt.z * pt.z));
+
+            double low = atan((pt.x - HALF_ROVER) / pt.z) * 180 / PI;
+            double high = atan((pt.x + HALF_ROVER) / pt.z) * 180 / PI;
+            int lowBin = std::max(0, (int)std::ceil((low + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION));
+            int highBin = std::min(numBins - 1, (int)std::floor((high + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION));
+            if(lowBin <= highBin) {
+                ++occupancy[lowBin];
+                if(highBin + 1 < numBins) --occupancy[highBin + 1];
+            }
+
+            //Point is in the center path
+            if(std::abs(pt.x) <= HALF_ROVER) {
+                #if PERCEPTION_DEBUG
+                    //Make interest points orange if they are within rover path
+                    PaintPoint(index, 255, 69, 0);
+                #endif
+                currentDistance += pt.z;
+                sizeOfCluster++;
+            }
+        }
 
-        //Finding angle off center
-        double oppSideRTri = pt_cloud_ptr->points[obstacles.at(direction)].x;
-        double adjSideRTri = pt_cloud_ptr->points[obstacles.at(0)].z;            //Length of adjacent side of right triangle
-        oppSideRTri += direction ? buffer + HALF_ROVER : -(buffer + HALF_ROVER); //Calculate length of opposite side of right triangle
-        newAngle = atan(oppSideRTri / adjSideRTri) * 180 / PI;                   //arctan(opposite/adjacent)
+        //The cluster blocks every bearing between its outermost interest points
+        if(nearest != DBL_MAX) {
+            int lowBin = std::max(0, (int)std::floor((minAngle + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION + 0.5));
+            int highBin = std::min(numBins - 1, (int)std::floor((maxAngle + MAX_FIELD_OF_VIEW_ANGLE) / CLEAR_PATH_RESOLUTION + 0.5));
+            float range = nearest / 1000.0;
+            for(int bin = lowBin; bin <= highBin; ++bin) {
+                if(rangeProfile[bin] < 0 || range < rangeProfile[bin]) rangeProfile[bin] = range;
+            }
+        }
 
-        //Create compareLine Functors
-        compareLine leftLine(newAngle, -HALF_ROVER);
-        compareLine rightLine(newAngle, HALF_ROVER);
+        //to find the distance from an obstacle detected, add up all the z values from a given cluster of points
+        //then divide by the number of points in the cluster, and keep the closest cluster
+        if(sizeOfCluster != 0) {
+            currentDistance /= sizeOfCluster;
+            if(distance == -1 || currentDistance < distance) {
+                distance = currentDistance;
+            }
+        }
+    }
 
-        obstacles.clear();
+    //Prefix sum turns the difference array into the number of points blocking each bin
+    for(int i = 1; i < numBins; ++i) {
+        occupancy[i] += occupancy[i - 1];
+    }
+}
 
-        if(CheckPath(interest_points, obstacles, leftLine, rightLine)) {
+/* --- Find Clear Bearing --- */
+//Scans the occupancy histogram outward from the center bin
+//Direction of 0 is left and 1 is right
+double PCL::FindClearBearing(int direction) {
+    const int numBins = occupancy.size();
+    const int centerBin = numBins / 2;
+    const int step = direction ? 1 : -1;
+    for(int bin = centerBin; bin >= 0 && bin < numBins; bin += step) {
+        if(occupancy[bin] == 0) {
+            double angle = bin * CLEAR_PATH_RESOLUTION - MAX_FIELD_OF_VIEW_ANGLE;
             #if PERCEPTION_DEBUG
-                std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!FOUND NEW PATH AT: " << newAngle << std::endl;
+                std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!FOUND NEW PATH AT: " << angle << std::endl;
             #endif
-            return newAngle;
+            return angle;
         }
     }
     return direction ? MAX_FIELD_OF_VIEW_ANGLE : -MAX_FIELD_OF_VIEW_ANGLE; //If couldn't find clear path
@@ -305,166 +715,145 @@ void PCL::FindClearPath(const std::vector<std::vector<int>> &interest_points) {
     #if PERCEPTION_DEBUG
         pcl::ScopeTime t("Find Clear Path");
     #endif
+    ScopedStageTimer timer(Stage::ClearPath);
 
-    std::vector<int> obstacles; //index of the leftmost and rightmost obstacles in path
+    BuildOccupancyHistogram(interest_points);
 
     //Check Center Path
-    if(CheckPath(interest_points, obstacles, compareLine(0,-HALF_ROVER), compareLine(0,HALF_ROVER))) {
+    if(occupancy[occupancy.size() / 2] == 0) {
       leftBearing = 0; // When no obstacles detected, reset bearings
       rightBearing = 0;
+      distance = -1;
       #if PERCEPTION_DEBUG
             std::cout << "CENTER PATH IS CLEAR!!!" << std::endl;
       #endif
     }
-    
-    else {
-
-        //Values that store the distances of the last obstacle from a given CheckPath. Center value gets its distance from previous loop of CheckPath
-        double centerDistance = distance, leftDistance, rightDistance;
 
-        //Initialize base cases outside of scope
-        vector<int> centerObstacles = {obstacles.at(0), obstacles.at(1)};
-
-        //Find clear left path, set left bearing
-        leftBearing = getAngleOffCenter(10, 0, interest_points, obstacles);
-        leftDistance = distance; 
-
-        //Reset global variables
-        obstacles = {0, 0};
-        obstacles.at(0) = centerObstacles.at(0);
-        obstacles.at(1) = centerObstacles.at(1);
-
-        //Find clear right path, set right bearing
-        rightBearing = getAngleOffCenter(10, 1, interest_points, obstacles);
-        rightDistance = distance;
+    else {
+        //Find clear left and right paths
+        leftBearing = FindClearBearing(0);
+        rightBearing = FindClearBearing(1);
 
-        //return smallest distance of an obstacle from all the paths
-        if(rightDistance < leftDistance && rightDistance < centerDistance) distance = rightDistance/1000.0;
-        else if(leftDistance < rightDistance && leftDistance < centerDistance) distance = leftDistance/1000.0;
-        else distance = centerDistance/1000.0;
+        //Report the distance of the obstacle blocking the center path in meters
+        distance = distance/1000.0;
     }
-}
 
-/* --- Check Path --- */
-//Returns T or F based on whether or not the input path is obstructed
-//If it is obstructed returns false
-//The path is constructed using the left x value and right x value of
-//the furthest points on the path
-bool PCL::CheckPath(const std::vector<std::vector<int>> &interest_points,
-                    std::vector<int> &obstacles, compareLine leftLine, compareLine rightLine) {
     #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("Check Path");
+        DrawPath(0, leftBearing == 0 && rightBearing == 0);
+        DrawPath(leftBearing, true, "l");
+        DrawPath(rightBearing, true, "r");
     #endif
+}
 
-    bool end = true; 
-    double previousDistance = -1;
-
-    //if there are no interest points, the distance from the last obstacle should be -1
-    distance = previousDistance;
-    
-    //Iterate through interest points
-    for(auto cluster : interest_points) {
-        double sizeOfCluster = 0;
-        double currentDistance = 0;
-        for (auto index : cluster) {
-            //Check if the obstacle interest point is to the right of the left projected path of the rover 
-            //and to the left of the right projected path of the rover
-            if(leftLine(pt_cloud_ptr->points[index].x, pt_cloud_ptr->points[index].z) >= 0 &&
-                rightLine(pt_cloud_ptr->points[index].x, pt_cloud_ptr->points[index].z) <= 0) {
-                end = false;
-
-                //Check if obstacles is initialized
-                if(obstacles.size() == 0) {
-                    obstacles.push_back(index);
-                    obstacles.push_back(index);
-                }
-                //Check if leftmost interest point in rover path
-                else if(pt_cloud_ptr->points[index].x < pt_cloud_ptr->points[obstacles.at(0)].x) {
-                    obstacles.at(0) = index;
-                }
-                //Check if rightmost interest point in rover path
-                else if(pt_cloud_ptr->points[index].x > pt_cloud_ptr->points[obstacles.at(1)].x) {
-                    obstacles.at(1) = index;
-                }
-
-                #if PERCEPTION_DEBUG
-                    //Make interest points orange if they are within rover path
-                    pt_cloud_ptr->points[index].r = 255;
-                    pt_cloud_ptr->points[index].g = 69;
-                    pt_cloud_ptr->points[index].b = 0;
-                #endif
-
-                //adds distance from a point in a cluster to currentDistance, and keeps track of the cluster size
-                currentDistance += pt_cloud_ptr->points[index].z;
-                sizeOfCluster++; 
-            }
-        }
-        //to find the distance from an obstacle detected, add up all the z values from a given cluster of points
-        //then divide by the number of points in the cluster
-        currentDistance = 1.0 * currentDistance / sizeOfCluster;
-
-        //if the last obstacle distance from a CheckPath loop was smaller, keep the smaller value, otherwise keep the current distance value
-        if(currentDistance < previousDistance || (previousDistance == -1 && sizeOfCluster != 0)) {
-            previousDistance = currentDistance;
-            distance = previousDistance;
-        }
+/* --- Draw Path --- */
+//Projects the rover's path along the given bearing in the viewer
+//Green if the path is clear, red otherwise
+void PCL::DrawPath(double angle, bool clear, const std::string &name) {
+    compareLine leftLine(angle, -HALF_ROVER);
+    compareLine rightLine(angle, HALF_ROVER);
+
+    pcl::PointXYZRGB pt1;
+    pt1.x = leftLine.xIntercept;
+    pt1.y = 0;
+    pt1.z = 0;
+    pcl::PointXYZRGB pt2;
+    pt2.x = rightLine.xIntercept;
+    pt2.y = 0;
+    pt2.z = 0;
+    pcl::PointXYZRGB pt3(pt1);
+    pt3.z = 7000;
+    pt3.x = leftLine.xIntercept;
+
+    if(leftLine.slope != 0) { //Don't want to divide by 0
+        pt3.x = pt3.z / leftLine.slope + leftLine.xIntercept;
     }
 
-    #if PERCEPTION_DEBUG
-        //Project path in viewer
-        pcl::PointXYZRGB pt1;
-        pt1.x = leftLine.xIntercept;
-        pt1.y = 0;
-        pt1.z = 0;
-        pcl::PointXYZRGB pt2;
-        pt2.x = rightLine.xIntercept;
-        pt2.y = 0;
-        pt2.z = 0;
-        pcl::PointXYZRGB pt3(pt1);
-        pt3.z = 7000;
-        pt3.x = leftLine.xIntercept;
-
-        if(leftLine.slope != 0) { //Don't want to divide by 0
-            pt3.x = pt3.z / leftLine.slope + leftLine.xIntercept;
-        }
+    pcl::PointXYZRGB pt4(pt2);
+    pt4.z = 7000;
+    pt4.x = rightLine.xIntercept;
 
-        pcl::PointXYZRGB pt4(pt2);
-        pt4.z = 7000;
-        pt4.x = rightLine.xIntercept;
+    if(rightLine.slope != 0) { //Don't want to divide by 0
+        pt4.x = pt4.z / rightLine.slope + rightLine.xIntercept;
+    }
 
-        if(rightLine.slope != 0) { //Don't want to divide by 0
-            pt4.x = pt4.z / rightLine.slope + rightLine.xIntercept;
-        }
+    int red = clear ? 0 : 255;
+    int green = clear ? 255 : 0;
+    viewer->removeShape(name + "1");
+    viewer->removeShape(name + "2");
+    viewer->addLine(pt1, pt3, red, green, 0, name + "1");
+    viewer->addLine(pt2, pt4, red, green, 0, name + "2");
+}
 
-        if(end) {
-            viewer->removeShape("l1");
-            viewer->removeShape("l2");
-            viewer->addLine(pt1, pt3, 0, 255, 0, "l1");
-            viewer->addLine(pt2, pt4, 0, 255, 0, "l2");
-        }
-        else {
-            viewer->removeShape("l1");
-            viewer->removeShape("l2");
-            viewer->addLine(pt1, pt3, 255, 0, 0, "l1");
-            viewer->addLine(pt2, pt4, 255, 0, 0, "l2");
-        }
-    #endif
 
-    return end;
+#if PERCEPTION_DEBUG
+/* --- Paint Point --- */
+//Colors left over from the last frame or from before a filter changed the cloud are dropped
+void PCL::PaintPoint(int index, uint8_t r, uint8_t g, uint8_t b) {
+    if(debugColors.size() != pt_cloud_ptr->points.size()) {
+        debugColors.assign(pt_cloud_ptr->points.size(), 0);
+    }
+    debugColors[index] = (uint32_t)r << 16 | (uint32_t)g << 8 | b;
 }
+#endif
 
-
+//Unpainted points are gray, the obstacle points carry no camera color
 void PCL::updateViewer(bool is_original) {
+    #if PERCEPTION_DEBUG
+    const uint32_t GRAY = 0x808080;
+    const bool painted = !is_original && debugColors.size() == pt_cloud_ptr->points.size();
+    viewerCloud->points.resize(pt_cloud_ptr->points.size());
+    for(size_t i = 0; i < pt_cloud_ptr->points.size(); ++i) {
+        pcl::PointXYZRGB &pt = viewerCloud->points[i];
+        pt.x = pt_cloud_ptr->points[i].x;
+        pt.y = pt_cloud_ptr->points[i].y;
+        pt.z = pt_cloud_ptr->points[i].z;
+        pt.rgba = painted && debugColors[i] ? debugColors[i] : GRAY;
+    }
+    viewerCloud->width = pt_cloud_ptr->width;
+    viewerCloud->height = pt_cloud_ptr->height;
+
     if(is_original) {
-        viewer_original->updatePointCloud(pt_cloud_ptr);
+        viewer_original->updatePointCloud(viewerCloud);
         viewer_original->spinOnce(10);
     }
 
     else {
-        viewer->updatePointCloud(pt_cloud_ptr);
+        viewer->updatePointCloud(viewerCloud);
         viewer->spinOnce(20);
     }
+    #endif
+}
+/* --- Debug Cloud --- */
+//Points are sent in centimeters as 16 bit integers, plenty within the pass through bounds
+void PCL::fillDebugCloud(rover_msgs::ObstacleDebugCloud &msg, int maxPoints) const {
+    msg.left_bearing = leftBearing;
+    msg.right_bearing = rightBearing;
+    msg.distance = distance;
+    msg.x.clear();
+    msg.y.clear();
+    msg.z.clear();
+    msg.interest.clear();
+
+    auto add = [&msg](const ObstaclePoint &pt, int8_t interest) {
+        if(!std::isfinite(pt.x) || pt.z <= 0) return;
+        msg.x.push_back((int16_t)std::max(-32768.0f, std::min(32767.0f, pt.x / 10)));
+        msg.y.push_back((int16_t)std::max(-32768.0f, std::min(32767.0f, pt.y / 10)));
+        msg.z.push_back((int16_t)std::min(32767.0f, pt.z / 10));
+        msg.interest.push_back(interest);
+    };
+    const auto &points = pt_cloud_ptr->points;
+    const size_t stride = std::max<size_t>(1, points.size() / std::max(1, maxPoints));
+    for(size_t i = 0; i < points.size(); i += stride) {
+        add(points[i], 0);
+    }
+    for(const auto &cluster : interest_points) {
+        for(int index : cluster) {
+            add(points[index], 1);
+        }
+    }
+    msg.num_points = msg.x.size();
 }
+
 /* --- Create Visualizer --- */
 //Creates a point cloud visualizer
 shared_ptr<pcl::visualization::PCLVisualizer> PCL::createRGBVisualizer() {
@@ -474,8 +863,8 @@ shared_ptr<pcl::visualization::PCLVisualizer> PCL::createRGBVisualizer() {
     shared_ptr<pcl::visualization::PCLVisualizer> viewer(new pcl::visualization::PCLVisualizer("PCL ZED 3D Viewer", PERCEPTION_DEBUG));
 
     viewer->setBackgroundColor(0.12, 0.12, 0.12);
-    pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGB> rgb(pt_cloud_ptr);
-    viewer->addPointCloud<pcl::PointXYZRGB>(pt_cloud_ptr, rgb);
+    pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGB> rgb(viewerCloud);
+    viewer->addPointCloud<pcl::PointXYZRGB>(viewerCloud, rgb);
     viewer->setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 1.5);
     viewer->addCoordinateSystem(1.0);
     viewer->initCameraParameters();
@@ -491,14 +880,38 @@ shared_ptr<pcl::visualization::PCLVisualizer> PCL::createRGBVisualizer() {
 //3000 mm (3m) for "x" is a placeholder, we will chnage this value based on further testing.
 //This function is called in main.cpp
 void PCL::pcl_obstacle_detection() {
+    #if PERCEPTION_DEBUG
+        debugColors.clear();
+    #endif
+
+    //Replaces the ground plane and clustering altogether
+    if(ELEVATION_GRID) {
+        ElevationGridObstacles(interest_points);
+        FindClearPath(interest_points);
+        return;
+    }
+
     obstacle_return result;
-    PassThroughFilter("z", UP_BD_Z);
-    PassThroughFilter("y", UP_BD_Y);
-    DownsampleVoxelFilter();
-    RANSACSegmentation("remove");
     std::vector<pcl::PointIndices> cluster_indices;
-    CPUEuclidianClusterExtraction(cluster_indices);
-    std::vector<std::vector<int>> interest_points(cluster_indices.size(), vector<int> (6));
+    #if OBSTACLE_GPU
+    GPUEuclidianClusterExtraction(cluster_indices);
+    #else
+    if(ORGANIZED_CLUSTERING && pt_cloud_ptr->isOrganized()) {
+        //Fit the ground plane on the downsampled cloud, then cluster the raw grid
+        *organized_cloud_ptr = *pt_cloud_ptr;
+        PassThroughVoxelFilter();
+        RANSACSegmentation("remove");
+        pt_cloud_ptr.swap(organized_cloud_ptr);
+        OrganizedClusterExtraction(cluster_indices);
+    }
+    else {
+        PassThroughVoxelFilter();
+        RANSACSegmentation("remove");
+        CPUEuclidianClusterExtraction(cluster_indices);
+    }
+    #endif
+    //Inner vectors keep their capacity from previous frames
+    interest_points.resize(cluster_indices.size());
     FindInterestPoints(cluster_indices, interest_points);
     FindClearPath(interest_points); 
 }
@@ -507,6 +920,8 @@ void PCL::pcl_obstacle_detection() {
 
 /* --- Update --- */
 //Cleares and resizes cloud for new data
+//pt_cloud_ptr may be either buffer of the arena after last frame's swaps,
+//both keep their capacity so this never reallocates
 void PCL::update() {
     pt_cloud_ptr->clear();
     pt_cloud_ptr->points.resize(cloudArea);
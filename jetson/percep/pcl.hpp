@@ -2,8 +2,14 @@
 #pragma once
 
 #include "perception.hpp"
+#include "pcl_gpu.hpp"
+#include "obstacle_point.hpp"
+#include "rover_msgs/ObstacleDebugCloud.hpp"
 #include <pcl/common/common_headers.h>
 #include <float.h>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
 
 /* --- Compare Line Class --- */
 /**
@@ -72,13 +78,36 @@ class PCL {
         int CLUSTER_TOLERANCE;
         int MIN_CLUSTER_SIZE;
         int MAX_CLUSTER_SIZE;
+        bool ORGANIZED_CLUSTERING;
+
+        //Clear path constants
+        double CLEAR_PATH_RESOLUTION;
+
+        //Ground plane tracking constants
+        double PLANE_TRACK_MIN_INLIER_RATIO;
+        double PLANE_TRACK_DEGRADE_RATIO;
+
+        //Elevation grid constants, lengths in mm
+        bool ELEVATION_GRID;
+        double GRID_CELL_SIZE;
+        double GRID_STEP_HEIGHT;
+        double GRID_MAX_SLOPE;
+        int GRID_MIN_POINTS;
+        double CAMERA_PITCH;
         
         //member variables
         double leftBearing;
         double rightBearing;
         double distance;
         bool detected;
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr pt_cloud_ptr;
+        //Distance in meters to the nearest obstacle in each bearing bin of occupancy, -1 if clear
+        //Unlike occupancy, this is not widened by the rover's width
+        std::vector<float> rangeProfile;
+        ObstacleCloud::Ptr pt_cloud_ptr;
+        //Cloud arena: pt_cloud_ptr and filtered_cloud_ptr are swapped by filters that can't work
+        //in place, all buffers are preallocated to cloudArea and keep their capacity across frames
+        ObstacleCloud::Ptr filtered_cloud_ptr;
+        ObstacleCloud::Ptr organized_cloud_ptr; //raw grid kept for organized clustering
         int cloudArea;
 
         //Constructor
@@ -99,29 +128,110 @@ class PCL {
         
         //Clusters nearby points to reduce total number of points
         void DownsampleVoxelFilter();
+
+        //Does the z and y pass through filters and the voxel downsample in a single pass
+        void PassThroughVoxelFilter();
+
+        //Running sums of the points that fall in one voxel
+        struct VoxelAccumulator {
+            float x, y, z;
+            uint32_t count;
+        };
+
+        //Hashed voxel grid reused across frames so its buckets are only allocated once
+        std::unordered_map<uint64_t, VoxelAccumulator> voxelGrid;
         
         //Finds the ground plane
         void RANSACSegmentation(string type);
+
+        //Reuses last frame's ground plane if it still fits, returns false if a full RANSAC is needed
+        bool TrackGroundPlane(pcl::PointIndices &inliers);
+
+        //Marks ground plane inliers when they are removed from the cloud
+        std::vector<uint8_t> groundMask;
+
+        //Ground plane from the previous frame and how well it fit when RANSAC found it
+        pcl::ModelCoefficients::Ptr groundPlane;
+        bool groundPlaneTracked;
+        double groundPlaneInlierRatio;
         
         //Clusters nearby points into large obstacles
         void CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices);
+
+        //Clusters the organized cloud with union-find over image grid neighbors
+        void OrganizedClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices);
+
+        //Union-find parents and root to cluster mapping, reused across frames
+        std::vector<int> clusterParents;
+        std::vector<int> clusterIds;
+
+        #if OBSTACLE_GPU
+        //Runs the filters, ground plane removal and clustering on the GPU
+        //Replaces pt_cloud_ptr with the clustered obstacle points
+        void GPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices);
+
+        std::unique_ptr<GPUObstaclePipeline> gpuPipeline;
+        std::vector<float> gpuPoints;
+        std::vector<std::vector<int>> gpuClusters;
+        #endif
         
+        /**
+        \brief Bins the cloud into a rover centric grid of the lowest and highest point of
+        every cell, in one pass and without a ground plane
+        A cell is an obstacle if its points or the step up from a neighboring cell rise
+        more than GRID_STEP_HEIGHT above what a GRID_MAX_SLOPE slope would, so slopes
+        the rover can climb are ground. The highest point of every obstacle cell becomes
+        an interest point of its own
+        */
+        void ElevationGridObstacles(std::vector<std::vector<int>> &interest_points);
+
+        //Lowest and highest point of every cell, row major from the nearest row, reused across frames
+        int gridCols;
+        int gridRows;
+        std::vector<float> gridMinHeight;
+        std::vector<float> gridMaxHeight;
+        std::vector<int> gridCount;
+        std::vector<int> gridTop;
+
         //Finds the four corners of the clustered obstacles
         void FindInterestPoints(std::vector<pcl::PointIndices> &cluster_indices, std::vector<std::vector<int>> &interest_points);
+
+        //Interest points of every cluster, reused across frames
+        std::vector<std::vector<int>> interest_points;
+
+        //Rover width increment buckets used by FindInterestPoints
+        double bucketWidth;
+        double bucketOriginX;
+        std::vector<int> bucketIndex;
+        std::vector<float> bucketMaxX;
         
         //Finds a clear path given the obstacle corners
         void FindClearPath(const std::vector<std::vector<int>> &interest_points);
 
-        //Determines whether the input path is obstructed
-        bool CheckPath(const std::vector<std::vector<int>> &interest_points,
-               std::vector<int> &obstacles, compareLine leftLine, compareLine rightLine);
-        
+        //Marks the bearings blocked by each interest point widened by HALF_ROVER
+        void BuildOccupancyHistogram(const std::vector<std::vector<int>> &interest_points);
+
         /**
-        \brief Determines angle off center a clear path can be found
+        \brief Finds the clear bearing closest to center in the occupancy histogram
         \param direction: given 0 finds left clear path given 1 find right clear path
         */
-        double getAngleOffCenter(int buffer, int direction, const std::vector<std::vector<int>> &interest_points,
-                    std::vector<int> &obstacles);
+        double FindClearBearing(int direction);
+
+        //Draws the rover path along a bearing in the viewer
+        void DrawPath(double angle, bool clear, const std::string &name = "c");
+
+        #if PERCEPTION_DEBUG
+        //Colors a point of pt_cloud_ptr in the viewer, the points themselves have no color
+        void PaintPoint(int index, uint8_t r, uint8_t g, uint8_t b);
+
+        //Colors painted this frame, packed like pcl::PointXYZRGB's rgba, and the colored
+        //copy of pt_cloud_ptr the viewers show
+        std::vector<uint32_t> debugColors;
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr viewerCloud;
+        #endif
+
+        //Number of interest points blocking each bearing bin, from -MAX_FIELD_OF_VIEW_ANGLE to MAX_FIELD_OF_VIEW_ANGLE
+        std::vector<int> occupancy;
 
     public:
         //Main function that runs the above 
@@ -130,6 +240,10 @@ class PCL {
         //Updates point cloud in the visualizer
         //Note: if bool is_original is true, we are using the original viewer
         void updateViewer(bool is_original);
+
+        //Copies at most maxPoints of the last processed cloud, every interest point and
+        //the chosen paths into a message for a remote viewer
+        void fillDebugCloud(rover_msgs::ObstacleDebugCloud &msg, int maxPoints) const;
         
         //Creates a point cloud visualizer
         shared_ptr<pcl::visualization::PCLVisualizer> createRGBVisualizer();
@@ -0,0 +1,320 @@
+#include "pcl_gpu.hpp"
+
+#if OBSTACLE_GPU
+
+#include <cuda_runtime.h>
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+#include <thrust/sort.h>
+#include <thrust/reduce.h>
+#include <thrust/copy.h>
+#include <thrust/extrema.h>
+#include <thrust/functional.h>
+#include <thrust/execution_policy.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+
+namespace {
+
+const int THREADS = 256;
+const unsigned long long INVALID_KEY = ~0ull;
+//Voxel indices are packed as three 21 bit fields into a 64 bit key
+const int KEY_BITS = 21;
+const int KEY_OFFSET = 1 << (KEY_BITS - 1);
+
+inline int blocksFor(size_t n) {
+    return (int)((n + THREADS - 1) / THREADS);
+}
+
+struct Float4Plus {
+    __host__ __device__ float4 operator()(const float4 &a, const float4 &b) const {
+        return make_float4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+    }
+};
+
+/* --- Passthrough + Voxel Key --- */
+//Bounds checks each point on both axes and computes the voxel it falls in
+//Points outside the bounds get INVALID_KEY so they sort to the end and are dropped
+//Exact zero points are invalid ZED measures (see Camera::Impl::dataCloud)
+__global__ void voxelKeyKernel(const float *points, int stride, int n, GPUObstacleParams p,
+                               unsigned long long *keys, float4 *xyzw) {
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i >= n) return;
+
+    const float *pt = points + (size_t)i * stride;
+    float x = pt[0], y = pt[1], z = pt[2];
+    bool inside = isfinite(x) && isfinite(y) && isfinite(z) &&
+                  !(x == 0.0f && y == 0.0f && z == 0.0f) &&
+                  z >= p.lowerBound && z <= p.upperBoundZ &&
+                  y >= p.lowerBound && y <= p.upperBoundY;
+
+    xyzw[i] = make_float4(x, y, z, 1.0f);
+    if (!inside) {
+        keys[i] = INVALID_KEY;
+        return;
+    }
+
+    const unsigned long long mask = (1ull << KEY_BITS) - 1;
+    unsigned long long ix = (unsigned long long)((long long)floorf(x / p.leafSize) + KEY_OFFSET) & mask;
+    unsigned long long iy = (unsigned long long)((long long)floorf(y / p.leafSize) + KEY_OFFSET) & mask;
+    unsigned long long iz = (unsigned long long)((long long)floorf(z / p.leafSize) + KEY_OFFSET) & mask;
+    keys[i] = (ix << (2 * KEY_BITS)) | (iy << KEY_BITS) | iz;
+}
+
+//Turns the per voxel sums into centroids
+__global__ void centroidKernel(float4 *sums, int n) {
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i >= n) return;
+    float4 s = sums[i];
+    sums[i] = make_float4(s.x / s.w, s.y / s.w, s.z / s.w, 1.0f);
+}
+
+/* --- RANSAC --- */
+//One block per plane hypothesis. Builds the plane through three sampled points,
+//rejects it if its normal is further than epsAngle from the y axis and otherwise
+//counts inliers with a block wide reduction
+__global__ void ransacScoreKernel(const float4 *pts, int n, const int3 *samples, GPUObstacleParams p,
+                                  float4 *planes, int *scores) {
+    __shared__ int partial[THREADS];
+    __shared__ float4 plane;
+    __shared__ bool valid;
+
+    int h = blockIdx.x;
+    if (threadIdx.x == 0) {
+        float4 a = pts[samples[h].x], b = pts[samples[h].y], c = pts[samples[h].z];
+        float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+        float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+        float nx = uy * vz - uz * vy;
+        float ny = uz * vx - ux * vz;
+        float nz = ux * vy - uy * vx;
+        float len = sqrtf(nx * nx + ny * ny + nz * nz);
+        valid = len > 1e-6f;
+        if (valid) {
+            nx /= len; ny /= len; nz /= len;
+            //Angle between the normal and the y axis, direction of the normal does not matter
+            valid = acosf(fminf(fabsf(ny), 1.0f)) <= p.epsAngleRad;
+        }
+        plane = make_float4(nx, ny, nz, -(nx * a.x + ny * a.y + nz * a.z));
+    }
+    __syncthreads();
+
+    int count = 0;
+    if (valid) {
+        for (int i = threadIdx.x; i < n; i += blockDim.x) {
+            float4 q = pts[i];
+            float d = fabsf(plane.x * q.x + plane.y * q.y + plane.z * q.z + plane.w);
+            count += d <= p.distanceThreshold;
+        }
+    }
+    partial[threadIdx.x] = count;
+    __syncthreads();
+
+    for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+        if (threadIdx.x < s) partial[threadIdx.x] += partial[threadIdx.x + s];
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0) {
+        planes[h] = plane;
+        scores[h] = valid ? partial[0] : -1;
+    }
+}
+
+struct NotOnPlane {
+    float4 plane;
+    float threshold;
+    __host__ __device__ bool operator()(const float4 &q) const {
+        return fabsf(plane.x * q.x + plane.y * q.y + plane.z * q.z + plane.w) > threshold;
+    }
+};
+
+/* --- Clustering --- */
+//Label propagation: every point takes the smallest label of any point within the
+//cluster tolerance, followed by pointer jumping. Repeated until nothing changes,
+//which yields the same connected components as Euclidean cluster extraction
+__global__ void propagateLabelsKernel(const float4 *pts, int n, float tolerance2, int *labels, int *changed) {
+    __shared__ float4 tile[THREADS];
+    __shared__ int tileLabels[THREADS];
+
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    float4 q = i < n ? pts[i] : make_float4(0, 0, 0, 0);
+    int best = i < n ? labels[i] : 0;
+
+    for (int base = 0; base < n; base += THREADS) {
+        int j = base + threadIdx.x;
+        if (j < n) {
+            tile[threadIdx.x] = pts[j];
+            tileLabels[threadIdx.x] = labels[j];
+        }
+        __syncthreads();
+
+        int limit = min(THREADS, n - base);
+        for (int k = 0; k < limit && i < n; ++k) {
+            float dx = q.x - tile[k].x, dy = q.y - tile[k].y, dz = q.z - tile[k].z;
+            if (dx * dx + dy * dy + dz * dz <= tolerance2 && tileLabels[k] < best) {
+                best = tileLabels[k];
+            }
+        }
+        __syncthreads();
+    }
+
+    if (i < n && best < labels[i]) {
+        atomicMin(&labels[i], best);
+        *changed = 1;
+    }
+}
+
+__global__ void jumpLabelsKernel(int n, int *labels) {
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i >= n) return;
+    int l = labels[i];
+    while (labels[l] != l) l = labels[l];
+    labels[i] = l;
+}
+
+__global__ void iotaKernel(int n, int *labels) {
+    int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i < n) labels[i] = i;
+}
+
+} // namespace
+
+struct GPUObstaclePipeline::Impl {
+    GPUObstacleParams params;
+    std::mt19937 rng;
+
+    //Device buffers are sized once and reused every frame
+    thrust::device_vector<float> rawPoints;
+    thrust::device_vector<unsigned long long> keys;
+    thrust::device_vector<float4> xyzw;
+    thrust::device_vector<unsigned long long> voxelKeys;
+    thrust::device_vector<float4> voxels;
+    thrust::device_vector<float4> obstacles;
+    thrust::device_vector<int3> samples;
+    thrust::device_vector<float4> planes;
+    thrust::device_vector<int> scores;
+    thrust::device_vector<int> labels;
+    thrust::device_vector<int> changed;
+
+    Impl(const GPUObstacleParams &p, size_t maxPoints) :
+        params(p), rng(std::random_device{}()),
+        keys(maxPoints), xyzw(maxPoints), voxelKeys(maxPoints), voxels(maxPoints),
+        obstacles(maxPoints), samples(p.maxIterations), planes(p.maxIterations),
+        scores(p.maxIterations), labels(maxPoints), changed(1) {}
+};
+
+GPUObstaclePipeline::GPUObstaclePipeline(const GPUObstacleParams &params, size_t maxPoints) :
+    impl_{new Impl(params, maxPoints)} {}
+
+GPUObstaclePipeline::~GPUObstaclePipeline() {
+    delete impl_;
+}
+
+void GPUObstaclePipeline::run(const float *points, size_t stride, size_t count,
+                              std::vector<float> &outXYZ, std::vector<std::vector<int>> &clusters) {
+    Impl &d = *impl_;
+    outXYZ.clear();
+    clusters.clear();
+    if (count == 0) return;
+
+    if (count > d.keys.size()) {
+        d.keys.resize(count);
+        d.xyzw.resize(count);
+        d.voxelKeys.resize(count);
+        d.voxels.resize(count);
+        d.obstacles.resize(count);
+        d.labels.resize(count);
+    }
+
+    //Upload the cloud once, every stage below works in device memory
+    d.rawPoints.resize(count * stride);
+    cudaMemcpy(thrust::raw_pointer_cast(d.rawPoints.data()), points,
+               count * stride * sizeof(float), cudaMemcpyHostToDevice);
+
+    /* --- Passthrough + Voxel Downsample --- */
+    voxelKeyKernel<<<blocksFor(count), THREADS>>>(thrust::raw_pointer_cast(d.rawPoints.data()),
+        (int)stride, (int)count, d.params,
+        thrust::raw_pointer_cast(d.keys.data()), thrust::raw_pointer_cast(d.xyzw.data()));
+
+    thrust::sort_by_key(d.keys.begin(), d.keys.begin() + count, d.xyzw.begin());
+    auto ends = thrust::reduce_by_key(d.keys.begin(), d.keys.begin() + count, d.xyzw.begin(),
+                                      d.voxelKeys.begin(), d.voxels.begin(),
+                                      thrust::equal_to<unsigned long long>(), Float4Plus());
+    int numVoxels = (int)(ends.first - d.voxelKeys.begin());
+    //Out of bounds points all share INVALID_KEY which sorts last
+    if (numVoxels > 0 && d.voxelKeys[numVoxels - 1] == INVALID_KEY) --numVoxels;
+    if (numVoxels < 3) return;
+    centroidKernel<<<blocksFor(numVoxels), THREADS>>>(thrust::raw_pointer_cast(d.voxels.data()), numVoxels);
+
+    /* --- RANSAC Ground Plane Removal --- */
+    thrust::host_vector<int3> hostSamples(d.params.maxIterations);
+    std::uniform_int_distribution<int> pick(0, numVoxels - 1);
+    for (auto &s : hostSamples) {
+        s = make_int3(pick(d.rng), pick(d.rng), pick(d.rng));
+    }
+    d.samples = hostSamples;
+
+    ransacScoreKernel<<<d.params.maxIterations, THREADS>>>(thrust::raw_pointer_cast(d.voxels.data()), numVoxels,
+        thrust::raw_pointer_cast(d.samples.data()), d.params,
+        thrust::raw_pointer_cast(d.planes.data()), thrust::raw_pointer_cast(d.scores.data()));
+
+    auto best = thrust::max_element(d.scores.begin(), d.scores.end());
+    int numObstacles = numVoxels;
+    if (*best > 0) {
+        float4 plane = d.planes[best - d.scores.begin()];
+        NotOnPlane notOnPlane{plane, d.params.distanceThreshold};
+        auto last = thrust::copy_if(d.voxels.begin(), d.voxels.begin() + numVoxels,
+                                    d.obstacles.begin(), notOnPlane);
+        numObstacles = (int)(last - d.obstacles.begin());
+    }
+    else {
+        thrust::copy(d.voxels.begin(), d.voxels.begin() + numVoxels, d.obstacles.begin());
+    }
+    if (numObstacles == 0) return;
+
+    /* --- Clustering --- */
+    int *labels = thrust::raw_pointer_cast(d.labels.data());
+    int *changed = thrust::raw_pointer_cast(d.changed.data());
+    iotaKernel<<<blocksFor(numObstacles), THREADS>>>(numObstacles, labels);
+    float tolerance2 = d.params.clusterTolerance * d.params.clusterTolerance;
+    for (int iter = 0; iter < numObstacles; ++iter) {
+        d.changed[0] = 0;
+        propagateLabelsKernel<<<blocksFor(numObstacles), THREADS>>>(
+            thrust::raw_pointer_cast(d.obstacles.data()), numObstacles, tolerance2, labels, changed);
+        jumpLabelsKernel<<<blocksFor(numObstacles), THREADS>>>(numObstacles, labels);
+        if (d.changed[0] == 0) break;
+    }
+
+    /* --- Return Clustered Points --- */
+    thrust::host_vector<float4> hostPts(d.obstacles.begin(), d.obstacles.begin() + numObstacles);
+    thrust::host_vector<int> hostLabels(d.labels.begin(), d.labels.begin() + numObstacles);
+
+    std::unordered_map<int, std::vector<int>> byLabel;
+    for (int i = 0; i < numObstacles; ++i) {
+        byLabel[hostLabels[i]].push_back(i);
+    }
+
+    for (auto &entry : byLabel) {
+        int size = (int)entry.second.size();
+        if (size < d.params.minClusterSize || size > d.params.maxClusterSize) continue;
+
+        std::vector<int> indices;
+        indices.reserve(size);
+        for (int i : entry.second) {
+            indices.push_back((int)(outXYZ.size() / 3));
+            outXYZ.push_back(hostPts[i].x);
+            outXYZ.push_back(hostPts[i].y);
+            outXYZ.push_back(hostPts[i].z);
+        }
+        clusters.push_back(std::move(indices));
+    }
+
+    cudaError_t err = cudaGetLastError();
+    if (err != cudaSuccess) {
+        std::cerr << "GPU obstacle pipeline error: " << cudaGetErrorString(err) << "\n";
+    }
+}
+
+#endif
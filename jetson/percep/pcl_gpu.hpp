@@ -0,0 +1,48 @@
+#pragma once
+
+#include "config.h"
+
+#if OBSTACLE_GPU
+
+#include <cstddef>
+#include <vector>
+
+//This header is shared between pcl.cpp and pcl_gpu.cu, so it must not
+//pull in PCL or OpenCV which nvcc cannot compile
+
+/* --- GPU Obstacle Parameters --- */
+//Mirrors the constants the CPU path reads from config_percep
+struct GPUObstacleParams {
+    float upperBoundZ;
+    float upperBoundY;
+    float lowerBound;
+    float leafSize;
+    int maxIterations;
+    float distanceThreshold;
+    float epsAngleRad;
+    float clusterTolerance;
+    int minClusterSize;
+    int maxClusterSize;
+};
+
+/* --- GPU Obstacle Pipeline --- */
+//Runs passthrough, voxel downsampling, ground plane removal and
+//clustering on the GPU. The cloud stays in device memory between
+//stages and only the clustered obstacle points come back to the host
+class GPUObstaclePipeline {
+public:
+    GPUObstaclePipeline(const GPUObstacleParams &params, size_t maxPoints);
+    ~GPUObstaclePipeline();
+
+    //points: array of count points, each point stride floats apart with x y z first
+    //outXYZ: filled with x y z triples of every point that belongs to a cluster
+    //clusters: filled with indices into outXYZ (in points, not floats) for each cluster
+    void run(const float *points, size_t stride, size_t count,
+             std::vector<float> &outXYZ, std::vector<std::vector<int>> &clusters);
+
+private:
+    struct Impl;
+    Impl *impl_;
+};
+
+#endif
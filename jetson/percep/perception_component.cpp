@@ -0,0 +1,729 @@
+#include "perception_component.hpp"
+#include "perception.hpp"
+#include "config_loader.hpp"
+#include "pipeline.hpp"
+#include "stage_scheduler.hpp"
+#include "stage_timer.hpp"
+#include "resolution_ladder.hpp"
+#include "cloud_fusion.hpp"
+#include "debug_sink.hpp"
+#include "depth_obstacle_detector.hpp"
+#include "temporal_filter.hpp"
+#include "visual_odometry.hpp"
+#include "workload_governor.hpp"
+#include "video_stream.hpp"
+#include "thor.hpp"
+#include "rover_runtime.hpp"
+#include "readiness.hpp"
+#include "memory_report.hpp"
+#include "trace.hpp"
+#include "rover_msgs/IMUData.hpp"
+#include "rover_msgs/ObstacleDebugCloud.hpp"
+#include "rover_msgs/ObstacleProfile.hpp"
+#include "rover_msgs/Odometry.hpp"
+#include "rover_msgs/PerceptionFrame.hpp"
+#include "rover_msgs/PerceptionRates.hpp"
+#include "rover_msgs/Target.hpp"
+#include "rover_msgs/TargetList.hpp"
+#include "rover_msgs/VisualOdometry.hpp"
+#include "rover_msgs/WorkloadGovernor.hpp"
+#include <unistd.h>
+#include <atomic>
+#include <future>
+#include <memory>
+
+using namespace cv;
+using namespace std;
+using namespace std::chrono_literals;
+
+/* --- Pipeline Types --- */
+//A single capture from the camera, shared between the AR and obstacle workers
+//Frames are recycled through a pool, so their images and cloud keep their buffers
+struct Frame {
+    int id;
+    int64_t captureTimeUs; //monotonic clock, stamped on every message made from the frame
+    #if AR_DETECTION
+    Mat gray; //what the detector runs on
+    Mat src; //color image, only captured when it is drawn, shown or written
+    #endif
+    #if AR_DETECTION || OBSTACLE_DETECTION
+    Mat depth; //only captured when a worker uses it
+    bool hasDepth;
+    #endif
+    #if OBSTACLE_DETECTION
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+    bool hasCloud;
+    #endif
+};
+
+typedef shared_ptr<const Frame> FramePtr;
+
+//Trace flow of a frame from the capture to each worker, one id per worker since a flow has one end
+enum class FrameFlow { AR = 1, Obstacle = 2 };
+
+uint64_t frameFlow(int frameId, FrameFlow worker) {
+    return (static_cast<uint64_t>(worker) << 32) | static_cast<uint32_t>(frameId);
+}
+
+//Most recent output of every worker, merged by the publisher
+struct PerceptionResults {
+    rover_msgs::TargetList arTagsMessage;
+    rover_msgs::Obstacle obstacleMessage;
+    #if OBSTACLE_DETECTION
+    rover_msgs::ObstacleProfile obstacleProfileMessage;
+    #endif
+};
+
+//Forwards the worker rates nav asks for on /perception_rates to the scheduler
+class RatesHandler {
+public:
+    explicit RatesHandler(StageScheduler &scheduler) : scheduler_(scheduler) {}
+
+    void rates(const lcm::ReceiveBuffer *, const string &, const rover_msgs::PerceptionRates *rates) {
+        scheduler_.setRates(rates->ar_hz, rates->obstacle_hz, rates->record_hz);
+    }
+
+private:
+    StageScheduler &scheduler_;
+};
+
+#if OBSTACLE_DETECTION
+//Which detector the obstacle worker runs, see depth_obstacle in the config
+enum class ObstacleMode { PCL, Depth, Auto };
+
+ObstacleMode obstacleMode(const string &mode) {
+    if (mode == "depth") return ObstacleMode::Depth;
+    if (mode == "auto") return ObstacleMode::Auto;
+    return ObstacleMode::PCL;
+}
+
+//Forwards the rover speed from /odometry to the resolution ladder, and its pose to the cloud fusion
+class OdometryHandler {
+public:
+    OdometryHandler(ResolutionLadder &ladder, CloudFusion &fusion) : ladder_(ladder), fusion_(fusion) {}
+
+    void odometry(const lcm::ReceiveBuffer *, const string &, const rover_msgs::Odometry *odometry) {
+        ladder_.setSpeed(odometry->speed);
+        fusion_.setOdometry(*odometry);
+    }
+
+private:
+    ResolutionLadder &ladder_;
+    CloudFusion &fusion_;
+};
+
+//Forwards the rover pitch from /imu_data to the camera's cloud rows
+class ImuHandler {
+public:
+    explicit ImuHandler(Camera &cam) : cam_(cam) {}
+
+    void imu(const lcm::ReceiveBuffer *, const string &, const rover_msgs::IMUData *imu) {
+        cam_.setPitch(imu->pitch_rad);
+    }
+
+private:
+    Camera &cam_;
+};
+#endif
+
+int runPerception(lcm::LCM &lcm, PerceptionListener *listener) {
+
+ /* --- Reading in Config File --- */
+  ConfigFile mRoverConfig;
+  string configPath = getenv("MROVER_CONFIG");
+  configPath += "/config_percep/config.json";
+  if (!mRoverConfig.load(configPath)) {
+    cerr << "could not read config " << configPath << "\n";
+    return 1;
+  }
+  //Priorities and cores of the threads come from config/threads
+  ThreadConfig threads("percep");
+
+  /* --- Startup --- */
+  //Sent on /heartbeat/percep, ready once the camera is open and every worker is set up
+  Readiness readiness(threads, "percep");
+  //Sent on /memory/percep every second
+  MemoryReport memoryReport(threads, "percep");
+  //The ZED takes seconds to open, so it is opened after the workers are started and
+  //they set up their detectors and viewers meanwhile
+  promise<bool> cameraOpened;
+  shared_future<bool> cameraReady = cameraOpened.get_future().share();
+  vector<future<void>> workersStarted;
+
+  /* --- Camera Initializations --- */
+    Camera cam(mRoverConfig);
+    int iterations = 0;
+    //Only written from the video_stream thread, the AR worker hands it the frames it drew on
+    VideoStream videoStream(mRoverConfig);
+    //The camera only retrieves what the capture stage below copies out. These are the
+    //measures every frame needs, depth and the cloud are otherwise retrieved while a
+    //worker asks for them
+    Camera::Measures measures;
+    measures.image = AR_DETECTION && (AR_RECORD || PERCEPTION_DEBUG || WRITE_CURR_FRAME_TO_DISK || videoStream.enabled());
+    measures.gray = AR_DETECTION;
+    measures.depth = WRITE_CURR_FRAME_TO_DISK;
+    measures.cloud = WRITE_CURR_FRAME_TO_DISK;
+    #if OBSTACLE_DETECTION
+    const ObstacleMode OBSTACLE_MODE = obstacleMode(mRoverConfig["depth_obstacle"]["mode"].GetString());
+    measures.depth = measures.depth || OBSTACLE_MODE != ObstacleMode::PCL;
+    measures.cloud = measures.cloud || OBSTACLE_MODE == ObstacleMode::PCL;
+    #endif
+    //The AR worker wants depth while tags are in view to range them, and the obstacle
+    //worker wants the cloud in auto mode while it runs PCL
+    atomic<bool> arWantsDepth{true};
+    atomic<bool> obstacleWantsCloud{true};
+    auto wantedMeasures = [&]() {
+        Camera::Measures wanted = measures;
+        wanted.depth = wanted.depth || (AR_DETECTION && arWantsDepth);
+        #if OBSTACLE_DETECTION
+        wanted.cloud = wanted.cloud || (OBSTACLE_MODE == ObstacleMode::Auto && obstacleWantsCloud);
+        #endif
+        return wanted;
+    };
+    cam.setMeasures(wantedMeasures());
+
+    #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
+        cam.disk_record_init();
+    #endif
+
+    /* -- Pipeline Initializations -- */
+    const size_t QUEUE_DEPTH = mRoverConfig["pipeline"]["queue_depth"].GetInt();
+    const int DEFAULT_TAG_VAL = mRoverConfig["ar_tag"]["default_tag_val"].GetInt();
+    //Debug builds can turn the viewers off to be timed like a production build
+    const bool DEBUG_VIEWERS = !!mRoverConfig["perception_debug"]["viewers"].GetInt();
+
+    LatestValue<PerceptionResults> results;
+    results.update([&](PerceptionResults &res) {
+        res.arTagsMessage.targetList[0].distance = DEFAULT_TAG_VAL;
+        res.arTagsMessage.targetList[1].distance = DEFAULT_TAG_VAL;
+        res.arTagsMessage.num_tags = 0;
+        //Nothing has been captured yet
+        res.arTagsMessage.capture_time_us = 0;
+        res.arTagsMessage.frame_seq = -1;
+        res.obstacleMessage.capture_time_us = 0;
+        res.obstacleMessage.frame_seq = -1;
+        #if OBSTACLE_DETECTION
+        res.obstacleProfileMessage.capture_time_us = 0;
+        res.obstacleProfileMessage.frame_seq = -1;
+        res.obstacleProfileMessage.start_bearing = 0;
+        res.obstacleProfileMessage.resolution = 0;
+        res.obstacleProfileMessage.max_range = 0;
+        fill(begin(res.obstacleProfileMessage.ranges), end(res.obstacleProfileMessage.ranges), -1.0f);
+        #endif
+    });
+
+    /* --- Stage Scheduling --- */
+    //which workers each frame goes to, nav can change their rates over /perception_rates
+    StageScheduler scheduler(mRoverConfig);
+    atomic<bool> capturing{true};
+    thread ratesListener;
+    if (mRoverConfig["scheduler"]["nav_rates"].GetInt()) {
+        ratesListener = threads.spawn("rates", [&]() {
+            lcm::LCM lcm_;
+            RatesHandler handler(scheduler);
+            lcm_.subscribe("/perception_rates", &RatesHandler::rates, &handler);
+            while (capturing) lcm_.handleTimeout(100);
+        });
+    }
+
+    /* --- Point Cloud Resolution --- */
+    #if OBSTACLE_DETECTION
+    //steps the retrieval resolution with obstacle latency and rover speed
+    ResolutionLadder ladder(mRoverConfig);
+    //fuses the last few clouds with the rover's motion, only the obstacle worker uses it
+    CloudFusion fusion(mRoverConfig);
+    const bool PITCH_COMPENSATION = !!mRoverConfig["pt_cloud"]["roi"]["pitch_compensation"].GetInt();
+    thread odometryListener;
+    if (ladder.enabled() || fusion.enabled() || OBSTACLE_MODE == ObstacleMode::Auto || PITCH_COMPENSATION) {
+        odometryListener = threads.spawn("odometry", [&]() {
+            lcm::LCM lcm_;
+            OdometryHandler handler(ladder, fusion);
+            lcm_.subscribe("/odometry", &OdometryHandler::odometry, &handler);
+            ImuHandler imuHandler(cam);
+            if (PITCH_COMPENSATION) lcm_.subscribe("/imu_data", &ImuHandler::imu, &imuHandler);
+            while (capturing) lcm_.handleTimeout(100);
+        });
+    }
+    #endif
+
+    /* --- Workload Governor --- */
+    //Scales the worker rates and the cloud resolution down while the Jetson is close to
+    //throttling and reports every reading on /workload_governor, nav scales its planners
+    //with it
+    WorkloadGovernor governor(mRoverConfig);
+    thread governorThread;
+    if (governor.enabled()) {
+        governorThread = threads.spawn("governor", [&]() {
+            lcm::LCM lcm_;
+            rover_msgs::WorkloadGovernor msg;
+            const auto PERIOD = chrono::milliseconds(governor.periodMs());
+            while (capturing) {
+                if (governor.sample(msg)) {
+                    scheduler.throttle(msg.rate_scale, governor.everyFrameHz());
+                    #if OBSTACLE_DETECTION
+                    ladder.setCeiling(msg.resolution_scale);
+                    #endif
+                    cerr << "workload governor at level " << msg.level << " of " << msg.max_level
+                         << ", " << msg.max_temp_c << " C " << msg.power_w << " W\n";
+                }
+                lcm_.publish("/workload_governor", &msg);
+                //Short sleeps so stopping doesn't wait out a whole period
+                const auto next = chrono::steady_clock::now() + PERIOD;
+                while (capturing && chrono::steady_clock::now() < next) this_thread::sleep_for(min(PERIOD, 100ms));
+            }
+        });
+    }
+
+    /* --- AR Recording Initializations and Implementation--- */
+
+    time_t now = time(0);
+    char* ltm = ctime(&now);
+    string timeStamp(ltm);
+
+    #if AR_RECORD
+    //initializing ar tag videostream object
+    cam.record_ar_init();
+    #endif
+
+    /* --- AR Tag Worker --- */
+    #if AR_DETECTION
+    /* --- Video Stream --- */
+    //The frames the AR worker drew its detections on go to the base station, at most once
+    //per interval. The worker draws every frame into a new Mat, so only the header is handed
+    //over, and the newest one is encoded, so a slow encoder or radio drops frames instead
+    //of holding up detection
+    const auto STREAM_INTERVAL = chrono::milliseconds(videoStream.intervalMs());
+    LatestValue<Mat> streamFrame;
+    thread videoStreamer;
+    if (videoStream.enabled()) {
+        videoStreamer = threads.spawn("video_stream", [&]() {
+            Mat rgb;
+            while (streamFrame.waitForUpdate(rgb)) videoStream.write(rgb);
+            videoStream.close();
+        });
+    }
+
+    FrameQueue<FramePtr> arQueue(QUEUE_DEPTH);
+    promise<void> arStarted;
+    workersStarted.push_back(arStarted.get_future());
+    thread arWorker = threads.spawn("ar_worker", [&]() {
+        withDebugSink(DEBUG_VIEWERS, [&](auto debug) {
+            TagDetector detector(mRoverConfig);
+            //Depth is retrieved until this many frames in a row had no tag, a tag that comes
+            //into view after that is ranged from the frames following the one it showed up in
+            const int DEPTH_HOLD_FRAMES = mRoverConfig["ar_tag"]["depth_hold_frames"].GetInt();
+            int framesWithoutTag = 0;
+            rover_msgs::TargetList arTagsMessage;
+            auto lastStreamFrame = chrono::steady_clock::now() - STREAM_INTERVAL;
+
+            debug.arStart();
+
+            arStarted.set_value();
+            if (cameraReady.get()) detector.setIntrinsics(cam.intrinsics());
+
+            FramePtr frame;
+            while (arQueue.pop(frame)) {
+                Trace::Span span("ar frame");
+                Trace::flowIn(frameFlow(frame->id, FrameFlow::AR));
+                //Mats are shared with the obstacle worker, so work on our own header
+                Mat rgb;
+                Mat gray = frame->gray;
+                Mat src = frame->src;
+                //Without depth every range sample is missed and only bearings are tracked
+                Mat depth_img = frame->hasDepth ? frame->depth : Mat();
+
+                bool tagSeen;
+                {
+                    ScopedStageTimer timer(Stage::ARDetect);
+                    const std::vector<Tag> &tags = detector.findARTags(gray, src, depth_img, rgb);
+                    detector.updateDetectedTagInfo(arTagsMessage, tags, depth_img, gray);
+                    tagSeen = !tags.empty();
+                }
+                framesWithoutTag = tagSeen ? 0 : framesWithoutTag + 1;
+                arWantsDepth = detector.needsDepth() && framesWithoutTag <= DEPTH_HOLD_FRAMES;
+                #if AR_RECORD
+                    cam.record_ar(rgb);
+                #endif
+                if (videoStream.enabled() && chrono::steady_clock::now() - lastStreamFrame >= STREAM_INTERVAL) {
+                    lastStreamFrame = chrono::steady_clock::now();
+                    streamFrame.update([&](Mat &out) { out = rgb; });
+                }
+
+                debug.arFrame(src);
+
+                results.update([&](PerceptionResults &res) {
+                    res.arTagsMessage = arTagsMessage;
+                    res.arTagsMessage.capture_time_us = frame->captureTimeUs;
+                    res.arTagsMessage.frame_seq = frame->id;
+                });
+            }
+        });
+    });
+    #endif
+
+    /* --- Obstacle Worker --- */
+    #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
+    FrameQueue<FramePtr> obsQueue(QUEUE_DEPTH);
+    promise<void> obstacleStarted;
+    workersStarted.push_back(obstacleStarted.get_future());
+
+    /* --- Debug Stream --- */
+    //A decimated copy of what PCL saw goes out on /obstacle_debug for debug_viewer.py,
+    //at most once per interval and from a thread of its own, so unlike PERCEPTION_DEBUG's
+    //viewers it leaves the obstacle worker's timing as it is
+    const rapidjson::Value &debugConfig = mRoverConfig["debug_stream"];
+    const bool DEBUG_STREAM = !!debugConfig["enabled"].GetInt();
+    const int DEBUG_MAX_POINTS = debugConfig["max_points"].GetInt();
+    const auto DEBUG_INTERVAL = chrono::milliseconds(debugConfig["interval_ms"].GetInt());
+    LatestValue<rover_msgs::ObstacleDebugCloud> debugCloud;
+    thread debugStreamer;
+    if (DEBUG_STREAM) {
+        debugStreamer = threads.spawn("debug_stream", [&]() {
+            lcm::LCM lcm_;
+            rover_msgs::ObstacleDebugCloud msg;
+            while (debugCloud.waitForUpdate(msg)) lcm_.publish("/obstacle_debug", &msg);
+        });
+    }
+    thread obsWorker = threads.spawn("obstacle_worker", [&]() {
+        withDebugSink(DEBUG_VIEWERS, [&](auto debug) {
+            //Constructed on this thread so the visualizers are owned by the thread rendering them
+            PCL pointcloud(mRoverConfig);
+            /* --- Outlier Detection --- */
+            //An obstacle is reported once on_count of the last window frames see one, and
+            //cleared once off_count of them don't, otherwise the last output is held
+            const rapidjson::Value &filterConfig = mRoverConfig["obstacle_filter"];
+            TemporalFilter obstacleFilter(filterConfig["window"].GetInt(), filterConfig["on_count"].GetInt(),
+                                          filterConfig["off_count"].GetInt());
+            obstacle_return lastObstacle;
+            //Frame the last agreeing output came from
+            int64_t lastObstacleCaptureUs = 0;
+            int64_t lastObstacleSeq = -1;
+
+            /* --- Depth Obstacle Detection --- */
+            //In auto mode the depth detector stands in for PCL while the rover drives too fast
+            //to wait for it or PCL took longer than its deadline, and PCL is tried again every
+            //pcl_retry_frames frames to see whether it has caught up
+            DepthObstacleDetector depthDetector(mRoverConfig);
+            const rapidjson::Value &depthConfig = mRoverConfig["depth_obstacle"];
+            const double PCL_DEADLINE_MS = depthConfig["pcl_deadline_ms"].GetDouble();
+            const double FAST_SPEED = depthConfig["fast_speed"].GetDouble();
+            const int PCL_RETRY_FRAMES = depthConfig["pcl_retry_frames"].GetInt();
+            bool pclBehind = false;
+            int framesSincePcl = 0;
+            auto lastDebugCloud = chrono::steady_clock::now() - DEBUG_INTERVAL;
+
+            obstacleStarted.set_value();
+
+            FramePtr frame;
+            while (obsQueue.pop(frame)) {
+                Trace::Span span("obstacle frame");
+                Trace::flowIn(frameFlow(frame->id, FrameFlow::Obstacle));
+
+                bool runPcl = OBSTACLE_MODE == ObstacleMode::PCL;
+                if (OBSTACLE_MODE == ObstacleMode::Auto) {
+                    runPcl = frame->hasCloud && ladder.roverSpeed() < FAST_SPEED &&
+                             (!pclBehind || framesSincePcl >= PCL_RETRY_FRAMES);
+                }
+
+                obstacle_return obstacleOutput;
+                const vector<float> *rangeProfile;
+                if (runPcl) {
+                    //The filters modify the cloud in place, so take a private copy of the frame's points
+                    //into the arena buffer, which already has the capacity for it
+                    //Fused clouds are unorganized, so they are clustered without the image grid
+                    if (fusion.enabled()) {
+                        fusion.fuse(*frame->cloud, *pointcloud.pt_cloud_ptr);
+                    }
+                    else {
+                        toObstacleCloud(*frame->cloud, *pointcloud.pt_cloud_ptr);
+                    }
+
+                    debug.obstacleInput(pointcloud);
+
+                    //Run Obstacle Detection
+                    auto obstacleStart = chrono::steady_clock::now();
+                    pointcloud.pcl_obstacle_detection();
+                    chrono::duration<double, milli> obstacleTime = chrono::steady_clock::now() - obstacleStart;
+                    ladder.report(frame->cloud->width, obstacleTime.count());
+                    pclBehind = obstacleTime.count() > PCL_DEADLINE_MS;
+                    framesSincePcl = 0;
+                    obstacle_return pclOutput(pointcloud.leftBearing, pointcloud.rightBearing, pointcloud.distance);
+                    obstacleOutput = pclOutput;
+                    rangeProfile = &pointcloud.rangeProfile;
+
+                    if (DEBUG_STREAM && chrono::steady_clock::now() - lastDebugCloud >= DEBUG_INTERVAL) {
+                        debugCloud.update([&](rover_msgs::ObstacleDebugCloud &msg) {
+                            pointcloud.fillDebugCloud(msg, DEBUG_MAX_POINTS);
+                            msg.capture_time_us = frame->captureTimeUs;
+                            msg.frame_seq = frame->id;
+                        });
+                        lastDebugCloud = chrono::steady_clock::now();
+                    }
+                }
+                else {
+                    {
+                        ScopedStageTimer timer(Stage::DepthObstacle);
+                        depthDetector.detect(frame->depth);
+                    }
+                    ++framesSincePcl;
+                    obstacle_return depthOutput(depthDetector.leftBearing, depthDetector.rightBearing, depthDetector.distance);
+                    obstacleOutput = depthOutput;
+                    rangeProfile = &depthDetector.rangeProfile;
+                }
+                //Whether the next frame runs PCL, the capture skips its cloud otherwise
+                obstacleWantsCloud = ladder.roverSpeed() < FAST_SPEED && (!pclBehind || framesSincePcl >= PCL_RETRY_FRAMES);
+
+                //Outlier Detection Processing
+                //An obstacle is in front if the path had to turn away from straight ahead
+                //The frame is only sent if it agrees with the filtered output, so an outlier
+                //frame leaves the last agreeing frame in place
+                const bool obstacleSeen = obstacleOutput.leftBearing > 0.05 || obstacleOutput.leftBearing < -0.05;
+                if(obstacleFilter.update(obstacleSeen) == obstacleSeen) {
+                    lastObstacle = obstacleOutput;
+                    lastObstacleCaptureUs = frame->captureTimeUs;
+                    lastObstacleSeq = frame->id;
+                }
+
+                //Update LCM
+                results.update([&](PerceptionResults &res) {
+                    res.obstacleMessage.bearing = lastObstacle.leftBearing; // Update LCM bearing field
+                    res.obstacleMessage.rightBearing = lastObstacle.rightBearing;
+                    res.obstacleMessage.distance = lastObstacle.distance; // Update LCM distance field
+                    res.obstacleMessage.capture_time_us = lastObstacleCaptureUs;
+                    res.obstacleMessage.frame_seq = lastObstacleSeq;
+
+                    //The profile skips outlier detection, every frame's profile is sent as is
+                    //If the histogram has more bins than the message, the center bins are sent
+                    //Both detectors bin the same way, so the bin layout is the PCL class's
+                    rover_msgs::ObstacleProfile &profile = res.obstacleProfileMessage;
+                    const int profileBins = sizeof(profile.ranges) / sizeof(profile.ranges[0]);
+                    const int bins = min((int)rangeProfile->size(), profileBins);
+                    const int firstBin = ((int)rangeProfile->size() - bins) / 2;
+                    profile.resolution = pointcloud.CLEAR_PATH_RESOLUTION;
+                    profile.start_bearing = (firstBin - (int)rangeProfile->size() / 2) * pointcloud.CLEAR_PATH_RESOLUTION;
+                    profile.max_range = pointcloud.UP_BD_Z / 1000.0;
+                    profile.capture_time_us = frame->captureTimeUs;
+                    profile.frame_seq = frame->id;
+                    for (int i = 0; i < profileBins; ++i) {
+                        profile.ranges[i] = i < bins ? (*rangeProfile)[firstBin + i] : -1;
+                    }
+                });
+                debug.obstacleOutput(pointcloud, runPcl, lastObstacle);
+            }
+        });
+    });
+    #endif
+
+    /* --- Publisher --- */
+    //Publishes both workers' results together on /perception_frame whenever either produces
+    //a new one, so nav never pairs targets and an obstacle from different updates
+    //Stage latency summaries go out at a much lower rate on /perception_latency
+    const auto LATENCY_PUBLISH_INTERVAL = chrono::milliseconds(mRoverConfig["timing"]["publish_interval_ms"].GetInt());
+    //The GUI and other tools still read the separate messages, production can turn them off
+    const bool SPLIT_MESSAGES = !!mRoverConfig["publisher"]["split_messages"].GetInt();
+    //An in-process listener gets the frame message too
+    thread publisher = threads.spawn("publisher", [&]() {
+        PerceptionResults latest;
+        rover_msgs::PerceptionFrame frameMessage;
+        rover_msgs::PerceptionLatency latencyMessage;
+        auto lastLatencyPublish = chrono::steady_clock::now();
+        while (results.waitForUpdate(latest)) {
+            {
+                ScopedStageTimer timer(Stage::Publish);
+                frameMessage.targets = latest.arTagsMessage;
+                frameMessage.obstacle = latest.obstacleMessage;
+                #if OBSTACLE_DETECTION
+                frameMessage.profile = latest.obstacleProfileMessage;
+                #endif
+                frameMessage.has_profile = OBSTACLE_DETECTION;
+                //Stamped like the newer of the two results
+                const bool arNewer = latest.arTagsMessage.capture_time_us >= latest.obstacleMessage.capture_time_us;
+                frameMessage.capture_time_us = arNewer ? latest.arTagsMessage.capture_time_us : latest.obstacleMessage.capture_time_us;
+                frameMessage.frame_seq = arNewer ? latest.arTagsMessage.frame_seq : latest.obstacleMessage.frame_seq;
+                lcm.publish("/perception_frame", &frameMessage);
+                Trace::flowOut(Trace::messageId(frameMessage));
+
+                if (SPLIT_MESSAGES) {
+                    lcm.publish("/target_list", &latest.arTagsMessage);
+                    lcm.publish("/obstacle", &latest.obstacleMessage);
+                    #if OBSTACLE_DETECTION
+                    lcm.publish("/obstacle_profile", &latest.obstacleProfileMessage);
+                    #endif
+                }
+            }
+            if (listener) listener->perceptionFrame(frameMessage);
+
+            if (chrono::steady_clock::now() - lastLatencyPublish >= LATENCY_PUBLISH_INTERVAL) {
+                stageTimers().summarize(latencyMessage);
+                lcm.publish("/perception_latency", &latencyMessage);
+                if (listener) listener->perceptionLatency(latencyMessage);
+                lastLatencyPublish = chrono::steady_clock::now();
+            }
+        }
+    });
+
+  /* --- Open Camera --- */
+  const bool CAMERA_OPEN = cam.open();
+  cameraOpened.set_value(CAMERA_OPEN);
+  if (CAMERA_OPEN) cam.grab();
+  for (future<void> &started : workersStarted) started.wait();
+  if (CAMERA_OPEN) readiness.ready();
+  else readiness.failed();
+
+  /* --- Capture Stage --- */
+  //Offline playback pacing, 0 replays as fast as the pipeline runs
+  const auto OFFLINE_FRAME_INTERVAL = chrono::milliseconds(mRoverConfig["camera"]["offline_frame_interval_ms"].GetInt());
+  //Enough free frames for both queues, both workers and the capture in flight
+  Thor::ObjectPool<Frame> framePool(2 * QUEUE_DEPTH + 3);
+  //The workers are running by now, so they don't start out with the capture policy
+  threads.apply("capture");
+  bool feed[StageScheduler::CONSUMERS];
+
+  /* --- Visual Odometry --- */
+  //The rover's motion between every two grabbed frames goes out on /visual_odometry,
+  //whichever workers the frames go to
+  VisualOdometry visualOdometry(mRoverConfig);
+  rover_msgs::VisualOdometry visualOdometryMessage;
+  unique_ptr<lcm::LCM> visualOdometryLcm;
+  if (visualOdometry.enabled()) visualOdometryLcm.reset(new lcm::LCM);
+
+  while (CAMERA_OPEN) {
+        //Check to see if we were able to grab the frame
+        {
+            ScopedStageTimer timer(Stage::Grab);
+            cam.setMeasures(wantedMeasures());
+            if (!cam.grab()) break;
+
+            if (visualOdometry.enabled()) {
+                Vec3d translation;
+                Matx33d rotation;
+                if (!cam.pose(visualOdometry.minConfidence(), translation, rotation)) {
+                    visualOdometry.lost();
+                }
+                else if (visualOdometry.update(translation, rotation, cam.captureTimeUs(), visualOdometryMessage)) {
+                    visualOdometryLcm->publish("/visual_odometry", &visualOdometryMessage);
+                }
+            }
+
+            //A worker that hasn't started on its last frame is behind
+            bool behind[StageScheduler::CONSUMERS] = {false, false, false};
+            #if AR_DETECTION
+            behind[StageScheduler::AR] = arQueue.size() > 0;
+            #endif
+            #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
+            behind[StageScheduler::Obstacle] = obsQueue.size() > 0;
+            #endif
+            scheduler.schedule(cam.captureTimeUs(), behind, feed);
+
+            #if AR_DETECTION
+            if (feed[StageScheduler::AR]) Trace::flowOut(frameFlow(iterations, FrameFlow::AR));
+            #endif
+            #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
+            if (feed[StageScheduler::Obstacle]) Trace::flowOut(frameFlow(iterations, FrameFlow::Obstacle));
+            #endif
+        }
+        //Only what a worker this frame goes to will use is copied out of the camera
+        const bool forAR = AR_DETECTION && feed[StageScheduler::AR];
+        const bool forObstacle = OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK && feed[StageScheduler::Obstacle];
+        const bool forRecord = WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION &&
+                               feed[StageScheduler::Record] && iterations % cam.FRAME_WRITE_INTERVAL == 0;
+        (void)forObstacle; (void)forRecord;
+        stageTimers().countFrame();
+
+        shared_ptr<Frame> frame = framePool.acquire();
+        frame->id = iterations;
+        frame->captureTimeUs = cam.captureTimeUs();
+        const Camera::Measures retrieved = cam.retrieved();
+
+        #if AR_DETECTION
+        //The camera reuses its retrieval buffers, so workers get their own copy
+        //copyTo only allocates when a recycled frame's Mat is a different size
+        if (forAR || forRecord) {
+            ScopedStageTimer timer(Stage::Image);
+            cam.gray().copyTo(frame->gray);
+            #if AR_RECORD || PERCEPTION_DEBUG || WRITE_CURR_FRAME_TO_DISK
+            cam.image().copyTo(frame->src);
+            #endif
+        }
+        #endif
+
+        #if AR_DETECTION || OBSTACLE_DETECTION
+        frame->hasDepth = retrieved.depth && (forAR || forObstacle || forRecord);
+        if (frame->hasDepth) {
+            ScopedStageTimer timer(Stage::Depth);
+            cam.depth().copyTo(frame->depth);
+        }
+        #endif
+
+        #if OBSTACLE_DETECTION
+        //The depth detector alone has no use for the cloud
+        frame->hasCloud = retrieved.cloud && (forObstacle || forRecord);
+        if (frame->hasCloud) {
+            ScopedStageTimer timer(Stage::Cloud);
+            ResolutionLadder::Level resolution = ladder.current();
+            //Offline the camera hands over its own cloud, which may still be in use
+            if (!frame->cloud || frame->cloud.use_count() > 1) {
+                frame->cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+            }
+            frame->cloud->width = resolution.width;
+            frame->cloud->height = resolution.height;
+            cam.getDataCloud(frame->cloud);
+        }
+        #endif
+
+        #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
+            if (forRecord) {
+                #if PERCEPTION_DEBUG
+                    cout << "Copied correctly" << endl;
+                #endif
+                cam.write_curr_frame_to_disk(frame->src, frame->depth, frame->cloud, iterations);
+        }
+        #endif
+
+        #if AR_DETECTION
+        if (forAR) arQueue.push(frame);
+        #endif
+
+        #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
+        if (forObstacle) obsQueue.push(frame);
+        #endif
+
+        #if !ZED_SDK_PRESENT
+            std::this_thread::sleep_for(OFFLINE_FRAME_INTERVAL); // Iteration speed control not needed when using camera
+        #endif
+
+        ++iterations;
+  }
+
+
+    /* --- Wrap Things Up --- */
+    capturing = false;
+    if (ratesListener.joinable()) ratesListener.join();
+    if (governorThread.joinable()) governorThread.join();
+    #if OBSTACLE_DETECTION
+        if (odometryListener.joinable()) odometryListener.join();
+    #endif
+
+    #if AR_DETECTION
+        arQueue.close();
+        arWorker.join();
+        streamFrame.close();
+        if (videoStreamer.joinable()) videoStreamer.join();
+    #endif
+
+    #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
+        obsQueue.close();
+        obsWorker.join();
+        debugCloud.close();
+        if (debugStreamer.joinable()) debugStreamer.join();
+    #endif
+
+    results.close();
+    publisher.join();
+
+    #if AR_RECORD
+        cam.record_ar_finish();
+    #endif
+
+    return CAMERA_OPEN ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <lcm/lcm-cpp.hpp>
+#include "rover_msgs/PerceptionFrame.hpp"
+#include "rover_msgs/PerceptionLatency.hpp"
+
+/* --- In-Process Outputs --- */
+//Receives every message perception publishes, on the publisher thread, for
+//components sharing the process that would otherwise subscribe to them
+class PerceptionListener {
+public:
+    virtual ~PerceptionListener() {}
+
+    virtual void perceptionFrame(const rover_msgs::PerceptionFrame &perceptionFrame) = 0;
+    virtual void perceptionLatency(const rover_msgs::PerceptionLatency &perceptionLatency) = 0;
+};
+
+//Runs the camera and detection pipelines until the camera runs out of frames,
+//publishing the results on lcm and handing them to listener if it isn't null
+int runPerception(lcm::LCM &lcm, PerceptionListener *listener);
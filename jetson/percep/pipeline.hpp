@@ -0,0 +1,117 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstddef>
+
+/* --- Frame Queue --- */
+//Bounded queue that connects two stages of the perception pipeline
+//When the queue is full the oldest entry is dropped, so a slow consumer
+//always works on the freshest frame instead of falling further behind
+template <typename T>
+class FrameQueue {
+public:
+    explicit FrameQueue(size_t capacity) : capacity_{capacity}, closed_{false}, dropped_{0} {}
+
+    //Adds an item to the back of the queue, evicting the oldest item if full
+    void push(T item) {
+        {
+            std::unique_lock<std::mutex> lock(mut_);
+            if (closed_) return;
+            if (items_.size() >= capacity_) {
+                items_.pop_front();
+                ++dropped_;
+            }
+            items_.push_back(std::move(item));
+        }
+        cv_.notify_one();
+    }
+
+    //Blocks until an item is available and moves it into out
+    //Returns false once the queue has been closed and drained
+    bool pop(T &out) {
+        std::unique_lock<std::mutex> lock(mut_);
+        cv_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        out = std::move(items_.front());
+        items_.pop_front();
+        return true;
+    }
+
+    //Wakes up all consumers, no more items are accepted after this
+    void close() {
+        {
+            std::unique_lock<std::mutex> lock(mut_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    //Number of items waiting for the consumer
+    size_t size() const {
+        std::unique_lock<std::mutex> lock(mut_);
+        return items_.size();
+    }
+
+    //Number of frames that were evicted because the consumer was behind
+    size_t dropped() const {
+        std::unique_lock<std::mutex> lock(mut_);
+        return dropped_;
+    }
+
+private:
+    size_t capacity_;
+    bool closed_;
+    size_t dropped_;
+    std::deque<T> items_;
+    mutable std::mutex mut_;
+    std::condition_variable cv_;
+};
+
+/* --- Latest Value --- */
+//Holds the most recent result of the pipeline stages
+//Producers modify the value in place through update, and the consumer
+//blocks until anything has changed since it last looked
+template <typename T>
+class LatestValue {
+public:
+    LatestValue() : changed_{false}, closed_{false} {}
+
+    //Runs func on the stored value while holding the lock and wakes the consumer
+    template <typename Function>
+    void update(Function func) {
+        {
+            std::unique_lock<std::mutex> lock(mut_);
+            func(val_);
+            changed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    //Blocks until the value changes and copies it into out
+    //Returns false once closed with no pending change
+    bool waitForUpdate(T &out) {
+        std::unique_lock<std::mutex> lock(mut_);
+        cv_.wait(lock, [this]() { return closed_ || changed_; });
+        if (!changed_) return false;
+        out = val_;
+        changed_ = false;
+        return true;
+    }
+
+    void close() {
+        {
+            std::unique_lock<std::mutex> lock(mut_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    T val_;
+    bool changed_;
+    bool closed_;
+    std::mutex mut_;
+    std::condition_variable cv_;
+};
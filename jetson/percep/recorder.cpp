@@ -0,0 +1,234 @@
+#include "recorder.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#if OBSTACLE_DETECTION
+    #include <pcl/io/pcd_io.h>
+#endif
+
+using namespace std;
+
+Recorder::Recorder(const rapidjson::Document &config) :
+    SLOTS{std::max(4, config["recorder"]["slots"].GetInt())},
+    VIDEO_FPS{config["recorder"]["video_fps"].GetInt()},
+    VIDEO_ENCODER{config["recorder"]["video_encoder"].GetString()},
+    DEPTH_PNG_COMPRESSION{config["recorder"]["depth_png_compression"].GetInt()},
+    slots(SLOTS), droppedFrames{0}, running{false}, closing{false},
+    pngParams{cv::IMWRITE_PNG_COMPRESSION, DEPTH_PNG_COMPRESSION} {
+
+    freeSlots.reserve(SLOTS);
+    for (int i = SLOTS - 1; i >= 0; --i) freeSlots.push_back(i);
+}
+
+Recorder::~Recorder() {
+    close();
+}
+
+void Recorder::openVideo(const string &filename) {
+    {
+        unique_lock<mutex> lock(mut);
+        videoFilename = filename;
+    }
+    start();
+}
+
+void Recorder::openFrames(const string &rgb, const string &depth, const string &pcl) {
+    {
+        unique_lock<mutex> lock(mut);
+        rgbFolder = rgb;
+        depthFolder = depth;
+        pclFolder = pcl;
+    }
+    start();
+}
+
+void Recorder::openLog(const string &filename) {
+    {
+        unique_lock<mutex> lock(mut);
+        logFilename = filename;
+    }
+    start();
+}
+
+void Recorder::start() {
+    unique_lock<mutex> lock(mut);
+    if (running) return;
+    running = true;
+    closing = false;
+    writer = thread(&Recorder::writerLoop, this);
+}
+
+void Recorder::close() {
+    {
+        unique_lock<mutex> lock(mut);
+        if (!running) return;
+        closing = true;
+    }
+    cv.notify_all();
+    writer.join();
+
+    unique_lock<mutex> lock(mut);
+    running = false;
+    if (droppedFrames) cerr << "recorder dropped " << droppedFrames << " frames\n";
+}
+
+size_t Recorder::dropped() const {
+    unique_lock<mutex> lock(mut);
+    return droppedFrames;
+}
+
+int Recorder::acquire() {
+    unique_lock<mutex> lock(mut);
+    if (!running || closing) return -1;
+
+    if (!freeSlots.empty()) {
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    //Writer is behind, give up the oldest frame that hasn't been written yet
+    ++droppedFrames;
+    if (pendingSlots.empty()) return -1;
+    int slot = pendingSlots.front();
+    pendingSlots.pop_front();
+    return slot;
+}
+
+void Recorder::submit(int slot) {
+    {
+        unique_lock<mutex> lock(mut);
+        pendingSlots.push_back(slot);
+    }
+    cv.notify_one();
+}
+
+void Recorder::recordVideo(const cv::Mat &rgb) {
+    int slot = acquire();
+    if (slot < 0) return;
+
+    //copyTo only allocates when the slot has never held a frame of this size
+    slots[slot].kind = SlotKind::Video;
+    rgb.copyTo(slots[slot].rgb);
+    submit(slot);
+}
+
+#if OBSTACLE_DETECTION
+void Recorder::recordFrame(const cv::Mat &rgb, const cv::Mat &depth,
+                           const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const string &name) {
+    int slot = acquire();
+    if (slot < 0) return;
+
+    Slot &s = slots[slot];
+    s.kind = SlotKind::Frame;
+    rgb.copyTo(s.rgb);
+    depth.copyTo(s.depth);
+    s.cloud.points.assign(cloud.points.begin(), cloud.points.end());
+    s.cloud.width = cloud.width;
+    s.cloud.height = cloud.height;
+    s.cloud.is_dense = cloud.is_dense;
+    s.name = name;
+    s.timestampNs = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    submit(slot);
+}
+#endif
+
+void Recorder::writerLoop() {
+    while (true) {
+        int slot;
+        {
+            unique_lock<mutex> lock(mut);
+            cv.wait(lock, [this]() { return closing || !pendingSlots.empty(); });
+            if (pendingSlots.empty()) break;
+            slot = pendingSlots.front();
+            pendingSlots.pop_front();
+        }
+
+        write(slots[slot]);
+
+        unique_lock<mutex> lock(mut);
+        freeSlots.push_back(slot);
+    }
+
+    video.release();
+    log.close();
+}
+
+void Recorder::write(Slot &slot) {
+    if (slot.kind == SlotKind::Video) {
+        if (!video.isOpened()) openVideoWriter(slot.rgb.size());
+        if (video.isOpened()) video.write(slot.rgb);
+        return;
+    }
+
+    string rgb, depth, pcl, logName;
+    {
+        unique_lock<mutex> lock(mut);
+        rgb = rgbFolder;
+        depth = depthFolder;
+        pcl = pclFolder;
+        logName = logFilename;
+    }
+
+    #if OBSTACLE_DETECTION
+    if (!logName.empty()) {
+        if (!log.isOpen() && !log.open(logName)) return;
+
+        //PCL pads its points, the log stores them packed
+        logPoints.resize(slot.cloud.points.size());
+        for (size_t i = 0; i < logPoints.size(); ++i) {
+            const pcl::PointXYZRGB &p = slot.cloud.points[i];
+            logPoints[i].x = p.x;
+            logPoints[i].y = p.y;
+            logPoints[i].z = p.z;
+            logPoints[i].rgba = p.rgba;
+        }
+        log.append(slot.timestampNs, slot.rgb, slot.depth, logPoints.data(),
+                   slot.cloud.width, slot.cloud.height);
+        return;
+    }
+
+    try { pcl::io::savePCDFileBinaryCompressed(pcl + slot.name + ".pcd", slot.cloud); }
+    catch (pcl::IOException &e) {
+        cerr << e.what();
+    }
+    #endif
+    cv::imwrite(rgb + slot.name + ".jpg", slot.rgb);
+
+    //ZED depth is float millimeters, which fit in 16 bits out to 65 m, and png encodes
+    //them far faster and smaller than exr. Missing depth is stored as 0
+    if (slot.depth.type() == CV_32F) {
+        cv::patchNaNs(slot.depth, 0);
+        slot.depth.convertTo(depthMm, CV_16U);
+        cv::imwrite(depth + slot.name + ".png", depthMm, pngParams);
+    } else {
+        cv::imwrite(depth + slot.name + ".png", slot.depth, pngParams);
+    }
+}
+
+//Encodes in hardware through GStreamer when an encoder is configured,
+//falls back to MJPG in software if the pipeline can't be opened
+void Recorder::openVideoWriter(const cv::Size &size) {
+    string filename;
+    {
+        unique_lock<mutex> lock(mut);
+        filename = videoFilename;
+    }
+
+    if (!VIDEO_ENCODER.empty()) {
+        string pipeline = "appsrc ! videoconvert ! ";
+        //the Jetson v4l2 encoders only take frames in NVMM memory
+        if (VIDEO_ENCODER.compare(0, 6, "nvv4l2") == 0) {
+            pipeline += "video/x-raw,format=BGRx ! nvvidconv ! video/x-raw(memory:NVMM),format=NV12 ! ";
+        }
+        pipeline += VIDEO_ENCODER + " ! h264parse ! matroskamux ! filesink location=" + filename + ".mkv";
+
+        video.open(pipeline, cv::CAP_GSTREAMER, 0, VIDEO_FPS, size, true);
+        if (video.isOpened()) return;
+        cerr << "could not open " << VIDEO_ENCODER << " pipeline, recording MJPG instead\n";
+    }
+
+    video.open(filename + ".avi", cv::VideoWriter::fourcc('M','J','P','G'), VIDEO_FPS, size, true);
+    if (!video.isOpened()) cerr << "ar record didn't open\n";
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "frame_log.hpp"
+#include "rapidjson/document.h"
+
+#if OBSTACLE_DETECTION
+    #include <pcl/point_types.h>
+    #include <pcl/point_cloud.h>
+#endif
+
+/* --- Recorder --- */
+//Writes AR video and disk frames on a background thread so recording never
+//stalls detection. Frames are copied into a fixed ring of slots whose buffers
+//are reused once they have been allocated for the first frame. When the writer
+//falls behind the oldest pending frame is dropped instead of blocking the caller
+class Recorder {
+public:
+    Recorder(const rapidjson::Document &config);
+    ~Recorder();
+
+    //Starts recording AR video to filename, the writer opens once the first frame size is known
+    void openVideo(const std::string &filename);
+
+    //Starts writing frames into the rgb, depth and pcl folders
+    void openFrames(const std::string &rgbFolder, const std::string &depthFolder, const std::string &pclFolder);
+
+    //Starts writing frames into a single frame log instead of separate files
+    void openLog(const std::string &filename);
+
+    //Queues one frame of AR video, never blocks on encoding
+    void recordVideo(const cv::Mat &rgb);
+
+    #if OBSTACLE_DETECTION
+    //Queues one set of frames to be written as name.jpg, a 16 bit millimeter name.png
+    //and a binary compressed name.pcd,
+    //or appended to the frame log if one is open
+    void recordFrame(const cv::Mat &rgb, const cv::Mat &depth,
+                     const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::string &name);
+    #endif
+
+    //Writes every pending frame and stops the writer
+    void close();
+
+    //Number of frames that were dropped because the writer was behind
+    size_t dropped() const;
+
+private:
+    enum class SlotKind { Video, Frame };
+
+    //One preallocated frame, Mats keep their buffers between uses
+    struct Slot {
+        SlotKind kind;
+        cv::Mat rgb;
+        cv::Mat depth;
+        #if OBSTACLE_DETECTION
+        pcl::PointCloud<pcl::PointXYZRGB> cloud;
+        #endif
+        std::string name;
+        int64_t timestampNs;
+    };
+
+    //Takes a slot to fill, reclaiming the oldest pending one if none are free
+    //Returns -1 if every slot is in use by the writer or another producer
+    int acquire();
+    //Hands a filled slot to the writer
+    void submit(int slot);
+    void start();
+    void writerLoop();
+    void write(Slot &slot);
+    void openVideoWriter(const cv::Size &size);
+
+    //Constants
+    int SLOTS;
+    int VIDEO_FPS;
+    std::string VIDEO_ENCODER;
+    int DEPTH_PNG_COMPRESSION;
+
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;
+    std::deque<int> pendingSlots;
+    size_t droppedFrames;
+    bool running;
+    bool closing;
+
+    mutable std::mutex mut;
+    std::condition_variable cv;
+    std::thread writer;
+
+    //only touched on the writer thread
+    std::string videoFilename;
+    cv::VideoWriter video;
+    std::string rgbFolder;
+    std::string depthFolder;
+    std::string pclFolder;
+    std::string logFilename;
+    FrameLogWriter log;
+    std::vector<FrameLogPoint> logPoints;
+    cv::Mat depthMm;
+    std::vector<int> pngParams;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "rapidjson/document.h"
+
+/* --- Resolution Ladder --- */
+//Picks the point cloud retrieval resolution from a set of preset levels
+//The obstacle worker reports how long each cloud took, and the ladder steps down
+//when the smoothed latency is over budget and back up when there is headroom.
+//The budget shrinks as the rover drives faster than the reference speed, since
+//a fast rover needs obstacle updates sooner
+class ResolutionLadder {
+public:
+    struct Level {
+        int width;
+        int height;
+    };
+
+    explicit ResolutionLadder(const rapidjson::Document &mRoverConfig) :
+        ENABLED{!!mRoverConfig["pt_cloud"]["resolution_ladder"]["enabled"].GetInt()},
+        LATENCY_BUDGET_MS{mRoverConfig["pt_cloud"]["resolution_ladder"]["latency_budget_ms"].GetDouble()},
+        STEP_UP_RATIO{mRoverConfig["pt_cloud"]["resolution_ladder"]["step_up_ratio"].GetDouble()},
+        HOLD_FRAMES{mRoverConfig["pt_cloud"]["resolution_ladder"]["hold_frames"].GetInt()},
+        SMOOTHING{mRoverConfig["pt_cloud"]["resolution_ladder"]["smoothing"].GetDouble()},
+        REFERENCE_SPEED{mRoverConfig["pt_cloud"]["resolution_ladder"]["reference_speed"].GetDouble()},
+        speed{0}, smoothedMs{0}, framesAtLevel{0} {
+
+        //Levels are scales of pt_cloud_width/height, which PCL sizes its buffers for,
+        //so no level may be larger than that
+        const int width = mRoverConfig["pt_cloud"]["pt_cloud_width"].GetInt();
+        const int height = mRoverConfig["pt_cloud"]["pt_cloud_height"].GetInt();
+        const rapidjson::Value &scales = mRoverConfig["pt_cloud"]["resolution_ladder"]["scales"];
+        for (rapidjson::SizeType i = 0; i < scales.Size(); ++i) {
+            double scale = std::min(1.0, std::max(0.0, scales[i].GetDouble()));
+            levels.push_back({std::max(1, (int)(width * scale)), std::max(1, (int)(height * scale))});
+        }
+        std::sort(levels.begin(), levels.end(), [](const Level &a, const Level &b) {
+            return a.width * a.height < b.width * b.height;
+        });
+        if (!ENABLED || levels.empty()) levels.assign(1, {width, height});
+
+        //start at full resolution and only back off once latency demands it
+        level = levels.size() - 1;
+        ceiling = level;
+    }
+
+    bool enabled() const {
+        return ENABLED;
+    }
+
+    //Resolution to retrieve the next cloud at
+    Level current() const {
+        std::unique_lock<std::mutex> lock(mut);
+        return levels[level];
+    }
+
+    //Latest rover speed from /odometry
+    void setSpeed(double rover_speed) {
+        std::unique_lock<std::mutex> lock(mut);
+        speed = rover_speed;
+    }
+
+    double roverSpeed() const {
+        std::unique_lock<std::mutex> lock(mut);
+        return speed;
+    }
+
+    //Keeps the resolution at or below scale of the full one for the workload governor,
+    //the lowest level is always allowed. A scale of 1 lets the ladder use every level
+    void setCeiling(double scale) {
+        std::unique_lock<std::mutex> lock(mut);
+        const int fullWidth = levels.back().width;
+        ceiling = 0;
+        for (size_t i = 1; i < levels.size(); ++i) {
+            if (levels[i].width <= fullWidth * scale + 0.5) ceiling = i;
+        }
+        if (level > ceiling) {
+            level = ceiling;
+            framesAtLevel = 0;
+        }
+    }
+
+    //Obstacle stage latency of one cloud of the given width, clouds retrieved
+    //before the last level change are ignored
+    void report(int width, double ms) {
+        std::unique_lock<std::mutex> lock(mut);
+        if (!ENABLED || width != levels[level].width) return;
+
+        smoothedMs = framesAtLevel == 0 ? ms : SMOOTHING * ms + (1 - SMOOTHING) * smoothedMs;
+        if (++framesAtLevel < HOLD_FRAMES) return;
+
+        double budget = LATENCY_BUDGET_MS;
+        if (REFERENCE_SPEED > 0 && speed > REFERENCE_SPEED) budget *= REFERENCE_SPEED / speed;
+
+        if (smoothedMs > budget && level > 0) {
+            --level;
+            framesAtLevel = 0;
+        }
+        else if (smoothedMs < budget * STEP_UP_RATIO && level < ceiling) {
+            ++level;
+            framesAtLevel = 0;
+        }
+    }
+
+private:
+    bool ENABLED;
+    double LATENCY_BUDGET_MS;
+    double STEP_UP_RATIO;
+    int HOLD_FRAMES;
+    double SMOOTHING;
+    double REFERENCE_SPEED;
+
+    std::vector<Level> levels;
+    size_t level;
+    //highest level the workload governor allows
+    size_t ceiling;
+    double speed;
+    double smoothedMs;
+    int framesAtLevel;
+    mutable std::mutex mut;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "rapidjson/document.h"
+
+/* --- Stage Scheduler --- */
+//Decides which consumers each captured frame goes to. Every consumer has a target rate
+//and a priority from the scheduler section of the config, and nav can change the rates
+//over /perception_rates as its state changes. A consumer gets a frame once its period
+//is up, and while a higher priority consumer still has frames waiting the lower ones are
+//passed over, so the compute goes to what the mission needs right now
+class StageScheduler {
+public:
+    enum Consumer { AR, Obstacle, Record, CONSUMERS };
+
+    explicit StageScheduler(const rapidjson::Document &mRoverConfig) {
+        const char *names[CONSUMERS] = {"ar", "obstacle", "record"};
+        for (int i = 0; i < CONSUMERS; ++i) {
+            const rapidjson::Value &consumer = mRoverConfig["scheduler"][names[i]];
+            CONFIGURED_HZ[i] = consumer["rate_hz"].GetDouble();
+            PRIORITY[i] = consumer["priority"].GetInt();
+            rateHz[i] = CONFIGURED_HZ[i];
+            nextUs[i] = 0;
+        }
+        scale = 1;
+        everyFrameHz = 0;
+    }
+
+    //Rates nav asked for, 0 for every frame and negative for the configured rate
+    void setRates(double arHz, double obstacleHz, double recordHz) {
+        const double rates[CONSUMERS] = {arHz, obstacleHz, recordHz};
+        for (int i = 0; i < CONSUMERS; ++i) {
+            rateHz[i] = rates[i] < 0 ? CONFIGURED_HZ[i] : rates[i];
+        }
+    }
+
+    //Scales every rate down for the workload governor, consumers given every frame are
+    //taken to run at everyFrameHz. A scale of 1 leaves the rates as they are
+    void throttle(double rateScale, double frameHz) {
+        everyFrameHz = frameHz;
+        scale = rateScale;
+    }
+
+    //Fills feed with the consumers that get the frame captured at captureUs, behind says
+    //which consumers haven't started on the last frame they were given
+    //Only called from the capture thread
+    void schedule(int64_t captureUs, const bool behind[CONSUMERS], bool feed[CONSUMERS]) {
+        for (int i = 0; i < CONSUMERS; ++i) {
+            bool outranked = false;
+            for (int j = 0; j < CONSUMERS; ++j) {
+                outranked = outranked || (behind[j] && PRIORITY[j] > PRIORITY[i]);
+            }
+            feed[i] = !outranked && captureUs >= nextUs[i];
+            if (!feed[i]) continue;
+
+            //Periods are counted from when the last one was due, so frames that don't land
+            //on the period still average out to the rate, but after a pause they restart
+            //from this frame instead of catching up on the ones that were missed
+            double hz = rateHz[i];
+            const double rateScale = scale;
+            if (rateScale < 1) hz = (hz > 0 ? hz : everyFrameHz.load()) * rateScale;
+            const int64_t periodUs = hz > 0 ? (int64_t)(1e6 / hz) : 0;
+            nextUs[i] = nextUs[i] + periodUs < captureUs ? captureUs + periodUs : nextUs[i] + periodUs;
+        }
+    }
+
+private:
+    double CONFIGURED_HZ[CONSUMERS];
+    int PRIORITY[CONSUMERS];
+
+    std::atomic<double> rateHz[CONSUMERS];
+    std::atomic<double> scale;
+    std::atomic<double> everyFrameHz;
+    int64_t nextUs[CONSUMERS];
+};
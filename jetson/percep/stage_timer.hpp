@@ -0,0 +1,141 @@
+#pragma once
+
+#include "rover_msgs/PerceptionLatency.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/* --- Perception Stages --- */
+//Every stage of the pipeline that is timed, in publishing order
+enum class Stage {
+    Grab,
+    Image,
+    Depth,
+    Cloud,
+    Fusion,
+    ARDetect,
+    PassThroughVoxel,
+    Ransac,
+    Cluster,
+    InterestPoints,
+    ElevationGrid,
+    ClearPath,
+    DepthObstacle,
+    Publish,
+    Count
+};
+
+inline const char *stageName(Stage stage) {
+    static const char *names[] = {
+        "grab", "image", "depth", "cloud", "fusion", "ar_detect", "pass_through_voxel",
+        "ransac", "cluster", "interest_points", "elevation_grid", "clear_path", "depth_obstacle", "publish"
+    };
+    return names[static_cast<int>(stage)];
+}
+
+/* --- Stage Timers --- */
+//Always on latency bookkeeping for the perception pipeline
+//Each stage keeps a fixed size ring of its most recent durations, so recording is
+//a lock and a store, and percentiles are only computed when a summary is requested
+class StageTimers {
+public:
+    static const size_t WINDOW = 256;
+
+    StageTimers() {
+        reset(WINDOW);
+    }
+
+    //Drops every sample and frame count and keeps the last window samples per stage from now on
+    //Offline runs such as the benchmark use a window as large as the run to get exact percentiles
+    void reset(size_t window) {
+        std::unique_lock<std::mutex> lock(mut_);
+        frames_ = 0;
+        for (auto &ring : rings_) {
+            ring.samples.assign(std::max<size_t>(1, window), 0.0);
+            ring.count = 0;
+            ring.next = 0;
+        }
+    }
+
+    void record(Stage stage, double ms) {
+        std::unique_lock<std::mutex> lock(mut_);
+        Ring &ring = rings_[static_cast<int>(stage)];
+        ring.samples[ring.next] = ms;
+        ring.next = (ring.next + 1) % ring.samples.size();
+        if (ring.count < ring.samples.size()) ++ring.count;
+    }
+
+    void countFrame() {
+        std::unique_lock<std::mutex> lock(mut_);
+        ++frames_;
+    }
+
+    //Fills msg with percentiles over the rolling window of every stage that has samples
+    void summarize(rover_msgs::PerceptionLatency &msg) {
+        std::unique_lock<std::mutex> lock(mut_);
+        msg.frames = frames_;
+        msg.stages.clear();
+        for (int i = 0; i < static_cast<int>(Stage::Count); ++i) {
+            const Ring &ring = rings_[i];
+            if (ring.count == 0) continue;
+
+            scratch_.assign(ring.samples.begin(), ring.samples.begin() + ring.count);
+            std::sort(scratch_.begin(), scratch_.end());
+
+            rover_msgs::StageLatency stage;
+            stage.stage = stageName(static_cast<Stage>(i));
+            stage.samples = ring.count;
+            stage.p50_ms = percentile(0.50);
+            stage.p90_ms = percentile(0.90);
+            stage.p99_ms = percentile(0.99);
+            stage.max_ms = scratch_.back();
+            msg.stages.push_back(stage);
+        }
+        msg.num_stages = msg.stages.size();
+    }
+
+private:
+    struct Ring {
+        std::vector<double> samples;
+        size_t count;
+        size_t next;
+    };
+
+    double percentile(double p) const {
+        size_t idx = std::min(scratch_.size() - 1, static_cast<size_t>(p * scratch_.size()));
+        return scratch_[idx];
+    }
+
+    std::array<Ring, static_cast<int>(Stage::Count)> rings_;
+    std::vector<double> scratch_;
+    long frames_;
+    std::mutex mut_;
+};
+
+//Timers shared by every thread of the perception process
+inline StageTimers &stageTimers() {
+    static StageTimers timers;
+    return timers;
+}
+
+/* --- Scoped Stage Timer --- */
+//Records the time between construction and destruction against a stage
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(Stage stage) :
+        stage_{stage}, span_{stageName(stage)}, start_{std::chrono::steady_clock::now()} {}
+
+    ~ScopedStageTimer() {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_;
+        stageTimers().record(stage_, elapsed.count());
+    }
+
+private:
+    Stage stage_;
+    //Shows the stage in the trace too, when tracing
+    Trace::Span span_;
+    std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,250 @@
+#include "perception.hpp"
+#include "config_loader.hpp"
+#include "frame_log.hpp"
+#include "rapidjson/pointer.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+//Runs obstacle detection over a labeled frame log once for every combination of the
+//swept config values and prints each one's accuracy against the labels, its per frame
+//latency and the combinations on the accuracy/latency Pareto frontier as JSON on stdout
+//usage: percep_sweep <frames.mrlog> <labels.json> <sweep.json>
+//
+//labels.json gives the nearest obstacle in the rover's path for the frames that were
+//labeled, in meters and -1 where the path was clear:
+//  {"frames": [{"frame": 0, "distance": 2.4}, {"frame": 1, "distance": -1}]}
+//sweep.json gives the values to try for each config key, as a JSON pointer into
+//config/percep/config.json:
+//  {"/pt_cloud/downsample_voxel_filter": [10, 20, 40],
+//   "/pt_cloud/ransac/max_iterations": [100, 400]}
+
+#if OBSTACLE_DETECTION
+
+/* --- Sweep Parameter --- */
+//A config value being swept, set in place in the loaded config for every combination
+struct SweepParameter {
+    string key;
+    rapidjson::Value *value;
+    vector<double> candidates;
+};
+
+/* --- Sweep Result --- */
+struct SweepResult {
+    vector<double> values;
+    double accuracy;
+    double meanDistanceError;
+    double p50Ms;
+    double p90Ms;
+    double maxMs;
+};
+
+//Nearest rank percentile of sorted samples
+static double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        cerr << "usage: " << argv[0] << " <frames.mrlog> <labels.json> <sweep.json>\n";
+        return 1;
+    }
+    const string datasetPath = argv[1];
+
+    /* --- Reading in Config File --- */
+    ConfigFile mRoverConfig;
+    const char *configRoot = getenv("MROVER_CONFIG");
+    string configPath = configRoot ? string(configRoot) + "/config_percep/config.json" : "config/percep/config.json";
+    if (!mRoverConfig.load(configPath)) {
+        cerr << "could not read config " << configPath << "\n";
+        return 1;
+    }
+
+    ConfigFile labels;
+    if (!labels.load(argv[2]) || !labels.IsObject() || !labels.HasMember("frames")) {
+        cerr << "could not read labels " << argv[2] << "\n";
+        return 1;
+    }
+
+    ConfigFile sweep;
+    if (!sweep.load(argv[3]) || !sweep.IsObject()) {
+        cerr << "could not read sweep " << argv[3] << "\n";
+        return 1;
+    }
+
+    /* --- Parameters --- */
+    vector<SweepParameter> parameters;
+    for (auto it = sweep.MemberBegin(); it != sweep.MemberEnd(); ++it) {
+        SweepParameter parameter;
+        parameter.key = it->name.GetString();
+        parameter.value = rapidjson::Pointer(parameter.key.c_str()).Get(mRoverConfig);
+        if (!parameter.value || !parameter.value->IsNumber()) {
+            cerr << parameter.key << " is not a number in " << configPath << "\n";
+            return 1;
+        }
+        for (const rapidjson::Value &candidate : it->value.GetArray()) {
+            parameter.candidates.push_back(candidate.GetDouble());
+        }
+        if (parameter.candidates.empty()) {
+            cerr << parameter.key << " has no values to sweep\n";
+            return 1;
+        }
+        parameters.push_back(parameter);
+    }
+
+    /* --- Dataset --- */
+    FrameLogReader log;
+    if (!log.open(datasetPath) || log.size() == 0) {
+        cerr << "no frames in " << datasetPath << "\n";
+        return 1;
+    }
+
+    //Every frame is run so ground plane tracking sees the log as the rover did, but only
+    //the labeled ones are scored
+    vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> clouds(log.size());
+    vector<double> truth(log.size(), 0);
+    vector<bool> labeled(log.size(), false);
+    for (size_t i = 0; i < log.size(); ++i) {
+        FrameLogView view = log.frame(i);
+        clouds[i].reset(new pcl::PointCloud<pcl::PointXYZRGB>(view.cloudWidth, view.cloudHeight));
+        for (size_t p = 0; p < clouds[i]->points.size(); ++p) {
+            pcl::PointXYZRGB &point = clouds[i]->points[p];
+            point.x = view.points[p].x;
+            point.y = view.points[p].y;
+            point.z = view.points[p].z;
+            point.rgba = view.points[p].rgba;
+        }
+    }
+    for (const rapidjson::Value &label : labels["frames"].GetArray()) {
+        size_t frame = label["frame"].GetUint();
+        if (frame >= log.size()) continue;
+        labeled[frame] = true;
+        truth[frame] = label["distance"].GetDouble();
+    }
+
+    /* --- Sweep --- */
+    vector<SweepResult> results;
+    vector<size_t> choice(parameters.size(), 0);
+    bool done = false;
+    while (!done) {
+        SweepResult result;
+        for (size_t k = 0; k < parameters.size(); ++k) {
+            double v = parameters[k].candidates[choice[k]];
+            //Keep the value's type, integer settings are read with GetInt
+            if (parameters[k].value->IsDouble()) parameters[k].value->SetDouble(v);
+            else parameters[k].value->SetInt((int)lround(v));
+            result.values.push_back(v);
+        }
+
+        //A fresh PCL every combination, so nothing tracked carries over from the last one
+        PCL pointcloud(mRoverConfig);
+        vector<double> latencies;
+        latencies.reserve(clouds.size());
+        int scored = 0, correct = 0, ranged = 0;
+        double distanceError = 0;
+        for (size_t i = 0; i < clouds.size(); ++i) {
+            toObstacleCloud(*clouds[i], *pointcloud.pt_cloud_ptr);
+            auto start = chrono::steady_clock::now();
+            pointcloud.pcl_obstacle_detection();
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            latencies.push_back(elapsed.count());
+
+            if (!labeled[i]) continue;
+            //A frame is right when it agrees with the label on whether the path is blocked
+            bool blocked = pointcloud.distance >= 0;
+            ++scored;
+            if (blocked != (truth[i] >= 0)) continue;
+            ++correct;
+            if (blocked) {
+                distanceError += fabs(pointcloud.distance - truth[i]);
+                ++ranged;
+            }
+        }
+
+        sort(latencies.begin(), latencies.end());
+        result.accuracy = scored ? (double)correct / scored : 0;
+        result.meanDistanceError = ranged ? distanceError / ranged : 0;
+        result.p50Ms = percentile(latencies, 0.5);
+        result.p90Ms = percentile(latencies, 0.9);
+        result.maxMs = latencies.empty() ? 0 : latencies.back();
+        results.push_back(result);
+
+        //Next combination, counting through the candidates like an odometer
+        done = true;
+        for (size_t k = 0; k < parameters.size(); ++k) {
+            if (++choice[k] < parameters[k].candidates.size()) {
+                done = false;
+                break;
+            }
+            choice[k] = 0;
+        }
+    }
+
+    /* --- Pareto Frontier --- */
+    //Going from fastest to slowest p90, a combination is on the frontier if it is more
+    //accurate than everything faster than it, ties on latency go to the more accurate one
+    vector<size_t> order(results.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (results[a].p90Ms != results[b].p90Ms) return results[a].p90Ms < results[b].p90Ms;
+        return results[a].accuracy > results[b].accuracy;
+    });
+    vector<size_t> frontier;
+    for (size_t i : order) {
+        if (frontier.empty() || results[i].accuracy > results[frontier.back()].accuracy) {
+            frontier.push_back(i);
+        }
+    }
+
+    /* --- Report --- */
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    auto writeResult = [&](size_t i) {
+        const SweepResult &result = results[i];
+        writer.StartObject();
+        writer.Key("index"); writer.Uint64(i);
+        writer.Key("parameters");
+        writer.StartObject();
+        for (size_t k = 0; k < parameters.size(); ++k) {
+            writer.Key(parameters[k].key.c_str()); writer.Double(result.values[k]);
+        }
+        writer.EndObject();
+        writer.Key("accuracy"); writer.Double(result.accuracy);
+        writer.Key("mean_distance_error_m"); writer.Double(result.meanDistanceError);
+        writer.Key("p50_ms"); writer.Double(result.p50Ms);
+        writer.Key("p90_ms"); writer.Double(result.p90Ms);
+        writer.Key("max_ms"); writer.Double(result.maxMs);
+        writer.EndObject();
+    };
+
+    writer.StartObject();
+    writer.Key("dataset"); writer.String(datasetPath.c_str());
+    writer.Key("dataset_frames"); writer.Uint64(clouds.size());
+    writer.Key("labeled_frames"); writer.Uint64(count(labeled.begin(), labeled.end(), true));
+    writer.Key("results");
+    writer.StartArray();
+    for (size_t i = 0; i < results.size(); ++i) writeResult(i);
+    writer.EndArray();
+    writer.Key("pareto");
+    writer.StartArray();
+    for (size_t i : frontier) writeResult(i);
+    writer.EndArray();
+    writer.EndObject();
+
+    cout << buffer.GetString() << endl;
+    return 0;
+}
+
+#else
+
+int main(int, char **argv) {
+    cerr << argv[0] << " needs a build with obs_detection=true\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include "tag_tracker.hpp"
+#include <algorithm>
+#include <vector>
+
+void ConstantVelocityFilter::reset(double measurement, double measurementNoise) {
+    value = measurement;
+    rate = 0;
+    p00 = measurementNoise;
+    p01 = 0;
+    //rate is unknown after a single measurement
+    p11 = 1e3;
+}
+
+void ConstantVelocityFilter::predict(double dt, double q) {
+    value += rate * dt;
+
+    //P = F P F^T + Q with F = [1 dt; 0 1] and Q from white acceleration noise
+    double dt2 = dt * dt;
+    double n00 = p00 + 2 * dt * p01 + dt2 * p11 + q * dt2 * dt2 / 4;
+    double n01 = p01 + dt * p11 + q * dt2 * dt / 2;
+    double n11 = p11 + q * dt2;
+    p00 = n00;
+    p01 = n01;
+    p11 = n11;
+}
+
+void ConstantVelocityFilter::update(double measurement, double r) {
+    double innovation = measurement - value;
+    double s = p00 + r;
+    double k0 = p00 / s;
+    double k1 = p01 / s;
+
+    value += k0 * innovation;
+    rate += k1 * innovation;
+
+    double n00 = (1 - k0) * p00;
+    double n01 = (1 - k0) * p01;
+    double n11 = p11 - k1 * p01;
+    p00 = n00;
+    p01 = n01;
+    p11 = n11;
+}
+
+TagTracker::TagTracker(int bufferIterations, int defaultTagVal,
+                       double bearingProcessNoise, double bearingMeasurementNoise,
+                       double distanceProcessNoise, double distanceMeasurementNoise) :
+    BUFFER_ITERATIONS{bufferIterations}, DEFAULT_TAG_VAL{defaultTagVal},
+    BEARING_PROCESS_NOISE{bearingProcessNoise}, BEARING_MEASUREMENT_NOISE{bearingMeasurementNoise},
+    DISTANCE_PROCESS_NOISE{distanceProcessNoise}, DISTANCE_MEASUREMENT_NOISE{distanceMeasurementNoise},
+    frameTime{std::chrono::steady_clock::now()} {}
+
+void TagTracker::beginFrame() {
+    frameTime = std::chrono::steady_clock::now();
+    for (auto &entry : tracks) {
+        TagTrack &track = entry.second;
+        double dt = std::chrono::duration<double>(frameTime - track.lastUpdate).count();
+        track.bearing.predict(dt, BEARING_PROCESS_NOISE);
+        if (track.hasDistance) track.distance.predict(dt, DISTANCE_PROCESS_NOISE);
+        track.lastUpdate = frameTime;
+        ++track.missedFrames;
+    }
+}
+
+void TagTracker::observe(int id, double bearing, bool hasDistance, double distance,
+                         double rangeConfidence, double cornerConfidence) {
+    auto it = tracks.find(id);
+    if (it == tracks.end()) {
+        TagTrack track;
+        track.id = id;
+        track.bearing.reset(bearing, BEARING_MEASUREMENT_NOISE);
+        track.hasDistance = hasDistance;
+        if (hasDistance) track.distance.reset(distance, DISTANCE_MEASUREMENT_NOISE);
+        track.rangeConfidence = rangeConfidence;
+        track.cornerConfidence = cornerConfidence;
+        track.missedFrames = 0;
+        track.lastUpdate = frameTime;
+        tracks[id] = track;
+        return;
+    }
+
+    TagTrack &track = it->second;
+    track.bearing.update(bearing, BEARING_MEASUREMENT_NOISE);
+    if (hasDistance) {
+        if (track.hasDistance) track.distance.update(distance, DISTANCE_MEASUREMENT_NOISE);
+        else track.distance.reset(distance, DISTANCE_MEASUREMENT_NOISE);
+        track.hasDistance = true;
+    }
+    track.rangeConfidence = rangeConfidence;
+    track.cornerConfidence = cornerConfidence;
+    track.missedFrames = 0;
+}
+
+void TagTracker::endFrame(rover_msgs::Target *arTags, std::vector<rover_msgs::DetectedTag> &tags) {
+    //Tracks coast for BUFFER_ITERATIONS frames before they are dropped
+    std::vector<const TagTrack *> live;
+    for (auto it = tracks.begin(); it != tracks.end();) {
+        if (it->second.missedFrames > BUFFER_ITERATIONS) {
+            it = tracks.erase(it);
+        }
+        else {
+            live.push_back(&it->second);
+            ++it;
+        }
+    }
+
+    //Report every tag, leftmost first
+    auto leftToRight = [](const TagTrack *a, const TagTrack *b) {
+        return a->bearing.value < b->bearing.value;
+    };
+    std::sort(live.begin(), live.end(), leftToRight);
+    tags.resize(live.size());
+    for (size_t i = 0; i < live.size(); ++i) {
+        tags[i].id = live[i]->id;
+        tags[i].bearing = live[i]->bearing.value;
+        tags[i].distance = live[i]->hasDistance ? live[i]->distance.value : DEFAULT_TAG_VAL;
+        tags[i].range_confidence = live[i]->hasDistance ? live[i]->rangeConfidence : 0;
+        tags[i].corner_confidence = live[i]->cornerConfidence;
+        tags[i].missed_frames = live[i]->missedFrames;
+    }
+
+    //and the two most recently seen ones, leftmost first
+    std::stable_sort(live.begin(), live.end(), [](const TagTrack *a, const TagTrack *b) {
+        return a->missedFrames < b->missedFrames;
+    });
+    if (live.size() > 2) live.resize(2);
+    std::sort(live.begin(), live.end(), leftToRight);
+
+    for (size_t i = 0; i < 2; ++i) {
+        if (i < live.size()) {
+            arTags[i].id = live[i]->id;
+            arTags[i].bearing = live[i]->bearing.value;
+            arTags[i].distance = live[i]->hasDistance ? live[i]->distance.value : DEFAULT_TAG_VAL;
+        }
+        else {
+            arTags[i].id = DEFAULT_TAG_VAL;
+            arTags[i].bearing = DEFAULT_TAG_VAL;
+            arTags[i].distance = DEFAULT_TAG_VAL;
+        }
+    }
+}
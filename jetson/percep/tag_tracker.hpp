@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <vector>
+#include "rover_msgs/DetectedTag.hpp"
+#include "rover_msgs/Target.hpp"
+
+/* --- Constant Velocity Filter --- */
+//One dimensional Kalman filter with a [value, rate] state
+struct ConstantVelocityFilter {
+    double value;
+    double rate;
+    //covariance of the state
+    double p00, p01, p11;
+
+    void reset(double measurement, double measurementNoise);
+    //propagates the state dt seconds forward with white acceleration noise q
+    void predict(double dt, double q);
+    //fuses a measurement with variance r
+    void update(double measurement, double r);
+};
+
+/* --- Tag Track --- */
+//Everything known about one tag id across frames
+struct TagTrack {
+    int id;
+    ConstantVelocityFilter bearing;
+    ConstantVelocityFilter distance;
+    bool hasDistance;
+    //of the tag's last detection
+    double rangeConfidence;
+    double cornerConfidence;
+    int missedFrames;
+    std::chrono::steady_clock::time_point lastUpdate;
+};
+
+/* --- Tag Tracker --- */
+//Smooths detections with a constant velocity filter per tag id and keeps
+//reporting a tag for BUFFER_ITERATIONS frames after it was last seen,
+//so nav keeps a target even when detection misses frames or runs slowly
+class TagTracker {
+public:
+    TagTracker(int bufferIterations, int defaultTagVal,
+               double bearingProcessNoise, double bearingMeasurementNoise,
+               double distanceProcessNoise, double distanceMeasurementNoise);
+
+    //Starts a new frame, every track is predicted to now
+    void beginFrame();
+
+    //Adds a detection of a tag to its track, distance is only fused if hasDistance
+    void observe(int id, double bearing, bool hasDistance, double distance,
+                 double rangeConfidence, double cornerConfidence);
+
+    //Ends the frame, dropping tracks that weren't seen for too long, and writes
+    //the two most recently seen tracks into arTags and every track into tags,
+    //both ordered left to right
+    void endFrame(rover_msgs::Target *arTags, std::vector<rover_msgs::DetectedTag> &tags);
+
+private:
+    int BUFFER_ITERATIONS;
+    int DEFAULT_TAG_VAL;
+    double BEARING_PROCESS_NOISE;
+    double BEARING_MEASUREMENT_NOISE;
+    double DISTANCE_PROCESS_NOISE;
+    double DISTANCE_MEASUREMENT_NOISE;
+
+    std::map<int, TagTrack> tracks;
+    std::chrono::steady_clock::time_point frameTime;
+};
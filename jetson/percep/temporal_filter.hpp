@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+// Debounces a boolean that is sampled once per message, like whether an
+// obstacle is in view, with N-of-M rules and hysteresis. The output
+// turns on once at least onCount of the last window samples are true,
+// and turns off once at least offCount of them are false. In between it
+// keeps its last value, so a single noisy sample can't flip it.
+//
+// The history is one bit per sample in a single word, so updating is a
+// shift and a popcount and never allocates.
+//
+// The same header is used by jetson/nav and jetson/percep, keep the two
+// copies the same.
+class TemporalFilter {
+    public:
+        static const int MAX_WINDOW = 64;
+
+        TemporalFilter(int window = 1, int onCount = 1, int offCount = 1, bool initial = false) {
+            this->configure(window, onCount, offCount);
+            this->reset(initial);
+        }
+
+        // Changes the rules, keeping the samples and the output.
+        void configure(int window, int onCount, int offCount) {
+            assert(window >= 1 && window <= MAX_WINDOW);
+            assert(onCount >= 1 && onCount <= window);
+            assert(offCount >= 1 && offCount <= window);
+            this->window_ = window;
+            this->on_count_ = onCount;
+            this->off_count_ = offCount;
+            this->mask_ = window == MAX_WINDOW ? ~uint64_t(0) : (uint64_t(1) << window) - 1;
+        }
+
+        // Forgets every sample and sets the output to state.
+        void reset(bool state) {
+            this->history_ = 0;
+            this->samples_ = 0;
+            this->state_ = state;
+        }
+
+        // Adds a sample and returns the filtered output. Until the window
+        // is full, the rules count the samples seen so far.
+        bool update(bool sample) {
+            this->history_ = ((this->history_ << 1) | (sample ? 1 : 0)) & this->mask_;
+            if (this->samples_ < this->window_) {
+                ++this->samples_;
+            }
+            const int trues = __builtin_popcountll(this->history_);
+            const int falses = this->samples_ - trues;
+            if (!this->state_ && trues >= this->on_count_) {
+                this->state_ = true;
+            } else if (this->state_ && falses >= this->off_count_) {
+                this->state_ = false;
+            }
+            return this->state_;
+        }
+
+        bool state() const {
+            return this->state_;
+        }
+
+    private:
+        uint64_t history_;
+        uint64_t mask_;
+        int samples_;
+        int window_;
+        int on_count_;
+        int off_count_;
+        bool state_;
+};
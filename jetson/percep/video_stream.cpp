@@ -0,0 +1,66 @@
+#include "video_stream.hpp"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+VideoStream::VideoStream(const rapidjson::Document &config) :
+    ENABLED{!!config["video_stream"]["enabled"].GetInt()},
+    ENCODER{config["video_stream"]["encoder"].GetString()},
+    BITRATE_KBPS{config["video_stream"]["bitrate_kbps"].GetInt()},
+    FPS{std::max(1, config["video_stream"]["fps"].GetInt())},
+    KEYFRAME_INTERVAL{config["video_stream"]["keyframe_interval"].GetInt()},
+    HOST{config["video_stream"]["host"].GetString()},
+    PORT{config["video_stream"]["port"].GetInt()},
+    failed{false} {}
+
+VideoStream::~VideoStream() {
+    close();
+}
+
+void VideoStream::write(const cv::Mat &rgb) {
+    if (rgb.empty()) return;
+    if (!video.isOpened() && !failed) open(rgb.size());
+    if (video.isOpened()) video.write(rgb);
+}
+
+void VideoStream::close() {
+    video.release();
+}
+
+string VideoStream::pipeline(const string &encoder) const {
+    const bool h265 = encoder.find("265") != string::npos;
+    const string keyframes = to_string(KEYFRAME_INTERVAL);
+
+    string pipeline = "appsrc ! videoconvert ! ";
+    if (encoder.compare(0, 6, "nvv4l2") == 0) {
+        //the Jetson v4l2 encoders only take frames in NVMM memory, and take bits per second
+        pipeline += "video/x-raw,format=BGRx ! nvvidconv ! video/x-raw(memory:NVMM),format=NV12 ! ";
+        pipeline += encoder + " control-rate=1 bitrate=" + to_string(BITRATE_KBPS * 1000) +
+                    " iframeinterval=" + keyframes + " idrinterval=" + keyframes + " insert-sps-pps=true";
+    } else {
+        pipeline += encoder + " tune=zerolatency speed-preset=ultrafast bitrate=" + to_string(BITRATE_KBPS) +
+                    " key-int-max=" + keyframes;
+    }
+    //the parameter sets go out with every keyframe so the base station can join at any time
+    pipeline += h265 ? " ! h265parse ! rtph265pay" : " ! h264parse ! rtph264pay";
+    pipeline += " config-interval=1 pt=96 ! udpsink host=" + HOST + " port=" + to_string(PORT) + " sync=false";
+    return pipeline;
+}
+
+//Encodes in hardware when an nvv4l2 encoder is configured,
+//falls back to encoding the same codec in software if the pipeline can't be opened
+void VideoStream::open(const cv::Size &size) {
+    video.open(pipeline(ENCODER), cv::CAP_GSTREAMER, 0, FPS, size, true);
+    if (video.isOpened()) return;
+
+    const string software = ENCODER.find("265") != string::npos ? "x265enc" : "x264enc";
+    if (ENCODER != software) {
+        cerr << "could not open " << ENCODER << " pipeline, streaming with " << software << " instead\n";
+        video.open(pipeline(software), cv::CAP_GSTREAMER, 0, FPS, size, true);
+        if (video.isOpened()) return;
+    }
+
+    cerr << "video stream didn't open\n";
+    failed = true;
+}
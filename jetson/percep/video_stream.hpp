@@ -0,0 +1,43 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "rapidjson/document.h"
+
+/* --- Video Stream --- */
+//Encodes the frames the AR worker drew on to H.264 or H.265 and sends them to the base
+//station over RTP, so operators see what autonomy sees. On the Jetson the nvv4l2 encoders
+//do the encoding on NVENC through GStreamer at a constant bitrate, so the stream fits the
+//radio and leaves the CPU to detection. Only used from the thread that streams
+class VideoStream {
+public:
+    VideoStream(const rapidjson::Document &config);
+    ~VideoStream();
+
+    //Frames are only handed over once their interval is up
+    bool enabled() const { return ENABLED; }
+    int intervalMs() const { return 1000 / FPS; }
+
+    //Sends one frame, the pipeline opens once the first frame size is known
+    void write(const cv::Mat &rgb);
+
+    void close();
+
+private:
+    //GStreamer pipeline from appsrc to the base station for encoder
+    std::string pipeline(const std::string &encoder) const;
+    void open(const cv::Size &size);
+
+    //Constants
+    bool ENABLED;
+    std::string ENCODER;
+    int BITRATE_KBPS;
+    int FPS;
+    int KEYFRAME_INTERVAL;
+    std::string HOST;
+    int PORT;
+
+    cv::VideoWriter video;
+    //Set once opening failed, so a missing encoder isn't tried again every frame
+    bool failed;
+};
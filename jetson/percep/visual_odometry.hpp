@@ -0,0 +1,72 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cmath>
+#include <cstdint>
+#include "rapidjson/document.h"
+#include "rover_msgs/VisualOdometry.hpp"
+
+/* --- Visual Odometry --- */
+//Turns the poses of the ZED's positional tracking into how the rover moved between
+//frames, which nav adds to its GPS odometry until the next fix. Tracking poses are in
+//the camera frame of when tracking started: x right, y down and z forward, pitched down
+//by the camera's angle_offset, in millimeters. They are levelled the same way the
+//fused clouds are, so the rover is taken to drive on level ground
+class VisualOdometry {
+public:
+    explicit VisualOdometry(const rapidjson::Document &mRoverConfig) :
+        ENABLED{!!mRoverConfig["visual_odometry"]["enabled"].GetInt()},
+        MIN_CONFIDENCE{mRoverConfig["visual_odometry"]["min_confidence"].GetInt()},
+        CAMERA_PITCH{mRoverConfig["rover_specs"]["angle_offset"].GetDouble()},
+        hasLast{false}, lastRight{0}, lastForward{0}, lastHeading{0}, lastTimeUs{0}, seq{0} {}
+
+    bool enabled() const { return ENABLED; }
+    int minConfidence() const { return MIN_CONFIDENCE; }
+
+    //Gives the motion since the last tracked frame, returns false for the first tracked
+    //frame and the first one after tracking was lost, which start over from there
+    bool update(const cv::Vec3d &translation, const cv::Matx33d &rotation, int64_t captureTimeUs,
+                rover_msgs::VisualOdometry &msg) {
+        const double cosPitch = std::cos(CAMERA_PITCH), sinPitch = std::sin(CAMERA_PITCH);
+        //Levelled position, and heading from where the camera's z axis points now
+        const double right = translation[0];
+        const double forward = translation[2] * cosPitch - translation[1] * sinPitch;
+        const double heading = std::atan2(rotation(0, 2), rotation(2, 2) * cosPitch - rotation(1, 2) * sinPitch);
+
+        const bool moved = hasLast;
+        if (moved) {
+            //Into the rover's frame at the last frame
+            const double dRight = right - lastRight, dForward = forward - lastForward;
+            const double cosHeading = std::cos(lastHeading), sinHeading = std::sin(lastHeading);
+            msg.forward_m = (dRight * sinHeading + dForward * cosHeading) / 1000;
+            msg.right_m = (dRight * cosHeading - dForward * sinHeading) / 1000;
+            msg.turn_deg = std::remainder(heading - lastHeading, 2 * M_PI) * 180 / M_PI;
+            msg.start_time_us = lastTimeUs;
+            msg.end_time_us = captureTimeUs;
+            msg.seq = seq++;
+        }
+        hasLast = true;
+        lastRight = right;
+        lastForward = forward;
+        lastHeading = heading;
+        lastTimeUs = captureTimeUs;
+        return moved;
+    }
+
+    //Tracking lost the camera, the next tracked frame starts over
+    void lost() {
+        //Counted as a lost message, so nav knows the rover moved uncounted meanwhile
+        if (hasLast) ++seq;
+        hasLast = false;
+    }
+
+private:
+    const bool ENABLED;
+    const int MIN_CONFIDENCE;
+    const double CAMERA_PITCH;
+
+    bool hasLast;
+    double lastRight, lastForward, lastHeading;
+    int64_t lastTimeUs;
+    int64_t seq;
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glob.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "rapidjson/document.h"
+#include "rover_msgs/WorkloadGovernor.hpp"
+
+/* --- Workload Governor --- */
+//Keeps the Jetson below the temperature and power it throttles at, so throughput stays
+//where it is for a whole mission instead of collapsing once the clocks are pulled down.
+//Each level in the governor section of the config scales the perception worker rates,
+//the point cloud resolution and nav's planner budgets. The governor steps up a level
+//while the hottest thermal zone or the power rails are over their limits, and back down
+//once both are under their resume values, holding every level for hold_samples first
+//so the last step has shown in the readings
+class WorkloadGovernor {
+public:
+    struct Level {
+        double rateScale;
+        double resolutionScale;
+        double plannerScale;
+    };
+
+    explicit WorkloadGovernor(const rapidjson::Document &mRoverConfig) :
+        ENABLED{!!mRoverConfig["governor"]["enabled"].GetInt()},
+        PERIOD_MS{mRoverConfig["governor"]["period_ms"].GetInt()},
+        THERMAL_ZONES{mRoverConfig["governor"]["thermal_zones"].GetString()},
+        POWER_RAILS{mRoverConfig["governor"]["power_rails"].GetString()},
+        TEMP_LIMIT_C{mRoverConfig["governor"]["temp_limit_c"].GetDouble()},
+        TEMP_RESUME_C{mRoverConfig["governor"]["temp_resume_c"].GetDouble()},
+        POWER_LIMIT_W{mRoverConfig["governor"]["power_limit_w"].GetDouble()},
+        POWER_RESUME_W{mRoverConfig["governor"]["power_resume_w"].GetDouble()},
+        HOLD_SAMPLES{mRoverConfig["governor"]["hold_samples"].GetInt()},
+        EVERY_FRAME_HZ{mRoverConfig["governor"]["every_frame_hz"].GetDouble()},
+        level{0}, reason{rover_msgs::WorkloadGovernor::NOMINAL} {
+
+        const rapidjson::Value &levelsConfig = mRoverConfig["governor"]["levels"];
+        for (rapidjson::SizeType i = 0; i < levelsConfig.Size(); ++i) {
+            levels.push_back({levelsConfig[i]["rate_scale"].GetDouble(),
+                              levelsConfig[i]["resolution_scale"].GetDouble(),
+                              levelsConfig[i]["planner_scale"].GetDouble()});
+        }
+        if (levels.empty()) levels.push_back({1, 1, 1});
+        const rapidjson::Value &skipped = mRoverConfig["governor"]["skip_zone_types"];
+        for (rapidjson::SizeType i = 0; i < skipped.Size(); ++i) SKIP_ZONE_TYPES.push_back(skipped[i].GetString());
+        //the first level is never held back, so the first step isn't either
+        samplesAtLevel = HOLD_SAMPLES;
+    }
+
+    bool enabled() const { return ENABLED; }
+    int periodMs() const { return PERIOD_MS; }
+    //Rate the workers given every frame are taken to run at when their rate is scaled
+    double everyFrameHz() const { return EVERY_FRAME_HZ; }
+
+    Level current() const { return levels[level]; }
+
+    //Reads the sensors and picks the level, returns true if it changed
+    bool sample(rover_msgs::WorkloadGovernor &msg) {
+        //Thermal zones are in millidegrees and power rails in milliwatts
+        const double tempC = maxReading(readings(THERMAL_ZONES, 1e-3, SKIP_ZONE_TYPES));
+        const double powerW = sumReading(readings(POWER_RAILS, 1e-3, {}));
+        const bool changed = step(tempC, powerW);
+
+        const Level &current = levels[level];
+        msg.level = (int32_t)level;
+        msg.max_level = (int32_t)levels.size() - 1;
+        msg.reason = reason;
+        msg.max_temp_c = tempC;
+        msg.power_w = powerW;
+        msg.rate_scale = current.rateScale;
+        msg.resolution_scale = current.resolutionScale;
+        msg.planner_scale = current.plannerScale;
+        return changed;
+    }
+
+    //Picks the level for one reading, negative readings are missing and a limit of 0 is off
+    bool step(double tempC, double powerW) {
+        const bool hot = TEMP_LIMIT_C > 0 && tempC >= TEMP_LIMIT_C;
+        const bool drawing = POWER_LIMIT_W > 0 && powerW >= POWER_LIMIT_W;
+        const bool cool = (TEMP_LIMIT_C <= 0 || tempC < TEMP_RESUME_C) &&
+                          (POWER_LIMIT_W <= 0 || powerW < POWER_RESUME_W);
+
+        if (++samplesAtLevel < HOLD_SAMPLES) return false;
+        if ((hot || drawing) && level + 1 < levels.size()) {
+            ++level;
+            reason = hot ? rover_msgs::WorkloadGovernor::TEMPERATURE : rover_msgs::WorkloadGovernor::POWER;
+            samplesAtLevel = 0;
+            return true;
+        }
+        if (cool && level > 0) {
+            --level;
+            if (level == 0) reason = rover_msgs::WorkloadGovernor::NOMINAL;
+            samplesAtLevel = 0;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    //Values in the files matching pattern, scaled, files that can't be read are skipped and
+    //so are the ones next to a type file naming one of skipTypes
+    static std::vector<double> readings(const std::string &pattern, double scale,
+                                        const std::vector<std::string> &skipTypes) {
+        std::vector<double> values;
+        glob_t matches;
+        if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                const std::string path = matches.gl_pathv[i];
+                if (!skipTypes.empty()) {
+                    std::ifstream typeFile(path.substr(0, path.find_last_of('/') + 1) + "type");
+                    std::string type;
+                    if (typeFile >> type && std::find(skipTypes.begin(), skipTypes.end(), type) != skipTypes.end()) continue;
+                }
+                std::ifstream file(path);
+                double value;
+                if (file >> value) values.push_back(value * scale);
+            }
+        }
+        globfree(&matches);
+        return values;
+    }
+
+    //Hottest thermal zone, -1 if none could be read
+    static double maxReading(const std::vector<double> &values) {
+        return values.empty() ? -1 : *std::max_element(values.begin(), values.end());
+    }
+
+    //Power of all the rails, -1 if none could be read
+    static double sumReading(const std::vector<double> &values) {
+        double sum = 0;
+        for (double value : values) sum += value;
+        return values.empty() ? -1 : sum;
+    }
+
+    const bool ENABLED;
+    const int PERIOD_MS;
+    const std::string THERMAL_ZONES;
+    const std::string POWER_RAILS;
+    const double TEMP_LIMIT_C;
+    const double TEMP_RESUME_C;
+    const double POWER_LIMIT_W;
+    const double POWER_RESUME_W;
+    const int HOLD_SAMPLES;
+    const double EVERY_FRAME_HZ;
+    //Zones that don't measure anything the load heats, like the PMIC's fixed reading
+    std::vector<std::string> SKIP_ZONE_TYPES;
+
+    std::vector<Level> levels;
+    size_t level;
+    int8_t reason;
+    int samplesAtLevel;
+};
@@ -0,0 +1,174 @@
+#include "arm_model.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+using namespace Eigen;
+using namespace nlohmann;
+
+namespace {
+
+    JointModel read_joint_model(const std::string &name, const json &joint_geom) {
+        JointModel joint;
+
+        joint.pos_local << joint_geom["origin"]["xyz"][0], joint_geom["origin"]["xyz"][1], joint_geom["origin"]["xyz"][2];
+        joint.local_center_of_mass << joint_geom["mass_data"]["com"]["x"], joint_geom["mass_data"]["com"]["y"], joint_geom["mass_data"]["com"]["z"];
+        joint.mass = joint_geom["mass_data"].value("mass", 0.0);
+        joint.rot_axis << joint_geom["axis"][0], joint_geom["axis"][1], joint_geom["axis"][2];
+
+        joint.limits[0] = joint_geom["limit"]["lower"];
+        joint.limits[1] = joint_geom["limit"]["upper"];
+
+        joint.max_speed = joint_geom["max_speed"];
+        joint.max_acceleration = joint_geom["max_acceleration"];
+        joint.encoder_offset = joint_geom["encoder_offset"];
+        joint.encoder_multiplier = joint_geom["encoder_multiplier"];
+
+        // joints b and c start bent, the rest start at 0
+        if (name == "joint_b") {
+            joint.initial_angle = 1.0;
+        }
+        else if (name == "joint_c") {
+            joint.initial_angle = 0.5;
+        }
+        else {
+            joint.initial_angle = 0;
+        }
+
+        joint.continuous_range = (joint.limits[0] < -3.1399 && joint.limits[1] > 3.1399);
+
+        return joint;
+    }
+
+    AvoidanceLinkModel read_avoidance_link_model(size_t joint_origin, const json &link_json,
+                                                 const std::vector<size_t> &collisions) {
+        AvoidanceLinkModel link;
+        link.joint_origin = joint_origin;
+        link.collisions = collisions;
+        link.radius = link_json["radius"];
+        link.link_num = link_json["link_num"];
+        link.points[0] = Vector3d::Zero();
+        link.points[1] = Vector3d::Zero();
+
+        std::string type = link_json["type"];
+        if (type == "sphere") {
+            link.type = ShapeType::SPHERE;
+            link.points[0] = Vector3d(link_json["center"]["x1"], link_json["center"]["x1"], link_json["center"]["x1"]);
+            link.points[1] = link.points[0];
+        }
+        else if (type == "capsule") {
+            link.type = ShapeType::CAPSULE;
+            link.points[0] = Vector3d(link_json["point_1"]["x1"], link_json["point_1"]["y1"], link_json["point_1"]["z1"]);
+            link.points[1] = Vector3d(link_json["point_2"]["x2"], link_json["point_2"]["y2"], link_json["point_2"]["z2"]);
+        }
+        else {
+            throw std::invalid_argument("unknown avoidance link type: " + type);
+        }
+
+        link.bound_center = (link.points[0] + link.points[1]) / 2;
+        link.bound_radius = (link.points[1] - link.points[0]).norm() / 2 + link.radius;
+
+        return link;
+    }
+
+} // namespace
+
+ArmModel read_arm_model(const json &geom) {
+    ArmModel model;
+
+    const json &ef_xyz = geom["endeffector"]["origin"]["xyz"];
+    model.ef_xyz << ef_xyz[0], ef_xyz[1], ef_xyz[2];
+
+    // json objects iterate in key order, so joints come out joint_a to joint_f
+    const json &joints_json = geom["joints"];
+    if (joints_json.size() != NUM_JOINTS) {
+        throw std::invalid_argument("arm geometry must have " + std::to_string(NUM_JOINTS) + " joints");
+    }
+
+    size_t joint_index = 0;
+    for (json::const_iterator it = joints_json.begin(); it != joints_json.end(); ++it, ++joint_index) {
+        model.joints[joint_index] = read_joint_model(it.key(), it.value());
+        model.joint_names[joint_index] = it.key();
+        model.child_links[joint_index] = it.value()["child"];
+    }
+
+    // Create all avoidance links (for collision avoidance)
+    const json &links_json = geom["links"];
+    for (json::const_iterator it = links_json.begin(); it != links_json.end(); ++it) {
+        model.link_names.push_back(it.key());
+
+        size_t joint_origin = it.value()["visual"]["origin"]["joint_origin"];
+        std::vector<size_t> collisions = it.value()["collisions"];
+
+        // the link's mass moves with the joint whose frame it is in
+        if (it.value().count("mass_data") && joint_origin < NUM_JOINTS) {
+            const json &mass_data = it.value()["mass_data"];
+            JointModel &joint = model.joints[joint_origin];
+            double link_mass = mass_data.value("mass", 0.0);
+            // the center of mass is given from the link's visual origin
+            const json &visual_xyz = it.value()["visual"]["origin"]["xyz"];
+            Vector3d link_com(mass_data["com"]["x"], mass_data["com"]["y"], mass_data["com"]["z"]);
+            link_com += Vector3d(visual_xyz[0], visual_xyz[1], visual_xyz[2]);
+
+            if (joint.mass + link_mass > 0.0) {
+                joint.local_center_of_mass = (joint.mass * joint.local_center_of_mass + link_mass * link_com) /
+                                             (joint.mass + link_mass);
+            }
+            joint.mass += link_mass;
+        }
+
+        const json &link_shapes = it.value()["link_shapes"];
+        for (json::const_iterator jt = link_shapes.begin(); jt != link_shapes.end(); ++jt) {
+            try {
+                model.avoidance_links.push_back(read_avoidance_link_model(joint_origin, jt.value(), collisions));
+            }
+            catch (json::exception &e) {
+                std::cout << "Error creating avoidance link: " << e.what() << "\n"
+                     << "exception id: " << e.id << "\n";
+            }
+        }
+    }
+
+    // Sort links by link_num, since they may not be in order from the json
+    std::sort(model.avoidance_links.begin(), model.avoidance_links.end(),
+              [](const AvoidanceLinkModel &a, const AvoidanceLinkModel &b) { return a.link_num < b.link_num; });
+
+    // A joint's distance to the segment is at most the joint offsets after it plus the
+    // segment's furthest end from joint_origin
+    for (AvoidanceLinkModel &link : model.avoidance_links) {
+        link.reach.fill(0);
+        link.reach[link.joint_origin] = std::max(link.points[0].norm(), link.points[1].norm());
+        for (size_t i = link.joint_origin; i > 0; --i) {
+            link.reach[i - 1] = link.reach[i] + model.joints[i].pos_local.norm();
+        }
+    }
+
+    // Only the collision lists of links 1 and up are checked, link 0's list isn't used
+    for (size_t i = 1; i < model.avoidance_links.size(); ++i) {
+        for (size_t possible_collision : model.avoidance_links[i].collisions) {
+            model.collision_pairs.push_back({{i, possible_collision}});
+        }
+    }
+
+    // Initialize preset positions
+    const json &presets = geom["presets"];
+    for (json::const_iterator it = presets.begin(); it != presets.end(); ++it) {
+        std::vector<double> &preset = model.preset_positions[it.key()];
+        preset.resize(NUM_JOINTS);
+
+        for (size_t i = 0; i < NUM_JOINTS; ++i) {
+            preset[i] = it.value()[i];
+        }
+    }
+
+    return model;
+}
+
+double get_max_reach(const ArmModel &model) {
+    double reach = model.ef_xyz.norm();
+    for (size_t i = 1; i < NUM_JOINTS; ++i) {
+        reach += model.joints[i].pos_local.norm();
+    }
+    return reach;
+}
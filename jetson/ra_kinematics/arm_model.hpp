@@ -0,0 +1,99 @@
+#ifndef ARM_MODEL_H
+#define ARM_MODEL_H
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <eigen3/Eigen/Dense>
+
+using namespace Eigen;
+using namespace nlohmann;
+
+// MRover's arm always has 6 joints, so per joint data can live in fixed size arrays
+static constexpr size_t NUM_JOINTS = 6;
+
+enum class ShapeType {
+    SPHERE,
+    CAPSULE
+};
+
+/**
+ * Geometry of one joint
+ * */
+struct JointModel {
+    Vector3d pos_local;             // position relative to the previous joint
+    Vector3d rot_axis;
+    Vector3d local_center_of_mass;  // of the joint and the links moving with it, in its frame
+    double mass;                    // kg, of the joint and the links moving with it
+    std::array<double, 2> limits;   // lower and upper limit in radians
+    double max_speed;               // radians/s
+    double max_acceleration;        // radians/s^2
+    double encoder_offset;
+    double encoder_multiplier;
+    double initial_angle;
+    bool continuous_range;          // true if the joint can reach all 2pi options
+};
+
+/**
+ * A shape used for collision avoidance, attached to a joint
+ * */
+struct AvoidanceLinkModel {
+    int link_num;
+    size_t joint_origin;
+    ShapeType type;
+    double radius;
+
+    // both ends of a capsule, or the center of a sphere twice, in the frame of joint_origin
+    std::array<Vector3d, 2> points;
+
+    // sphere around the whole shape, for quickly ruling out collisions
+    Vector3d bound_center;
+    double bound_radius;
+
+    // furthest the segment can be from each joint, whatever the angles, and
+    // 0 for joints after joint_origin. Turning joint i by d moves it at most reach[i] * |d|
+    std::array<double, NUM_JOINTS> reach;
+
+    // indices of the avoidance links this one can collide with
+    std::vector<size_t> collisions;
+};
+
+/**
+ * The arm geometry, read once from the geometry json. The parts FK and
+ * collision checks use are fixed size and free of strings, the names
+ * are only kept for printing and lookups.
+ * */
+struct ArmModel {
+    std::array<JointModel, NUM_JOINTS> joints;
+
+    // sorted by link_num
+    std::vector<AvoidanceLinkModel> avoidance_links;
+
+    // pairs of avoidance link indices to check for collisions
+    std::vector< std::array<size_t, 2> > collision_pairs;
+
+    // end effector position in the frame of the last joint
+    Vector3d ef_xyz;
+
+    std::array<std::string, NUM_JOINTS> joint_names;
+    std::array<std::string, NUM_JOINTS> child_links;
+    std::vector<std::string> link_names;
+    std::map<std::string, std::vector<double>> preset_positions;
+};
+
+/**
+ * Reads the arm model from the standard mrover config file for RA.
+ * Throws std::invalid_argument if the geometry doesn't have NUM_JOINTS joints.
+ * */
+ArmModel read_arm_model(const json &geom);
+
+/**
+ * @return how far the end effector could possibly be from joint a, with
+ * every joint offset after it laid end to end
+ * */
+double get_max_reach(const ArmModel &model);
+
+#endif
@@ -1,105 +1,123 @@
 #include "arm_state.hpp"
 #include "utils.hpp"
+#include "collision.hpp"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <cmath>
+#include <limits>
 
 using namespace Eigen;
 using namespace nlohmann;
 
 // Tested in joint creation test
-ArmState::ArmState(json &geom) : ef_pos_world(Vector3d::Zero()), ef_xform(Matrix4d::Identity()) {
-
-    joints.reserve(6);
-    links.reserve(7);
-    
-    // Create all Joint instances from mrover_arm json
-    set_ef_xyz(geom["endeffector"]["origin"]["xyz"]);
-
-    json joints_json = geom["joints"];
-    for (json::iterator it = joints_json.begin(); it != joints_json.end(); ++it) {
-        add_joint(it.key(), it.value());
+ArmState::ArmState(json &geom) : ArmState(read_arm_model(geom)) { }
+
+ArmState::ArmState(const ArmModel &model_in) :
+    model(std::make_shared<const ArmModel>(model_in)),
+    avoidance_points(model_in.avoidance_links.size()),
+    avoidance_centers(model_in.avoidance_links.size()),
+    ef_xform(Matrix4d::Identity())
+{
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        joints[i].angle = model->joints[i].initial_angle;
+        joints[i].encoder_offset = model->joints[i].encoder_offset;
     }
 
-    // Create all Avoidance_Link instances from mrover_arm json (for collision avoidance)
-    json links_json = geom["links"];
-    for (json::iterator it = links_json.begin(); it != links_json.end(); ++it) {
-        // Create the link object:
-        Link link = {it.key(), Matrix4d::Identity()};
-        links.push_back(link);
-
-        size_t joint_origin = it.value()["visual"]["origin"]["joint_origin"];
-        std::vector<size_t> collisions = it.value()["collisions"];
-        
-        json link_shapes = it.value()["link_shapes"];
-        for (json::iterator jt = link_shapes.begin(); jt != link_shapes.end(); ++jt) {
-            try {
-                collision_avoidance_links.emplace_back(joint_origin, jt.value(), collisions);
-            }
-            catch (json::exception &e) {
-                std::cout << "Error creating avoidance link: " << e.what() << "\n"
-                     << "exception id: " << e.id << "\n";
-            }
-        }
+    for (size_t i = 0; i < avoidance_points.size(); ++i) {
+        avoidance_points[i] = model->avoidance_links[i].points;
+        avoidance_centers[i] = model->avoidance_links[i].bound_center;
     }
 
-    // Initialize preset positions
-    json presets = geom["presets"];
-    for (json::iterator it = presets.begin(); it != presets.end(); ++it) {
-        preset_positions[it.key()] = {};
-        preset_positions[it.key()].resize(num_joints());
+    init_chain();
+}
 
-        for (int i = 0; i < num_joints(); ++i) {
-            preset_positions[it.key()][i] = it.value()[i];
-        }
+void ArmState::init_chain() {
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        const Vector3d &axis = model->joints[i].rot_axis;
+
+        Matrix3d axis_cross;
+        axis_cross <<        0, -axis(2),  axis(1),
+                       axis(2),        0, -axis(0),
+                      -axis(1),  axis(0),        0;
+
+        chain.offset[i] = model->joints[i].pos_local;
+        chain.axis[i] = axis;
+        chain.axis_cross[i] = axis_cross;
+        chain.axis_cross_sq[i] = axis_cross * axis_cross;
+
+        chain.angle[i] = 0;
+        chain.rotation[i] = Matrix3d::Identity();
+        chain.position[i] = Vector3d::Zero();
+        chain.axis_world[i] = axis;
     }
 
-    // Sort links by link_num, since they may not be in order from the json
-    Link_Comp comparator;
-    sort(collision_avoidance_links.begin(), collision_avoidance_links.end(), comparator);
+    // Nothing has been computed yet
+    chain.num_valid = 0;
 }
 
-bool ArmState::Link_Comp::operator()(const Avoidance_Link &a, const Avoidance_Link &b) {
-    return a.link_num < b.link_num;
-}
+void ArmState::update_transforms() {
+    // Find the first joint whose angle changed
+    size_t first = 0;
+    while (first < chain.num_valid && chain.angle[first] == joints[first].angle) {
+        ++first;
+    }
+
+    for (size_t i = first; i < 6; ++i) {
+        double theta = joints[i].angle;
 
-// Tested in joint_creation_test
-void ArmState::add_joint(std::string name, json &joint_geom) {
-    // Add joint with given configuration to vector of joints - used during initialization
-    joints.emplace_back(name, joint_geom);
-    joint_names.push_back(name);
+        // Rodrigues' formula for the rotation about the joint's axis
+        Matrix3d rot_theta = Matrix3d::Identity() + sin(theta) * chain.axis_cross[i]
+                             + (1 - cos(theta)) * chain.axis_cross_sq[i];
+
+        // Move to the joint in the previous joint's frame, then rotate about it
+        if (i == 0) {
+            chain.position[i] = chain.offset[i];
+            chain.rotation[i] = rot_theta;
+        }
+        else {
+            chain.position[i] = chain.position[i - 1] + chain.rotation[i - 1] * chain.offset[i];
+            chain.rotation[i] = chain.rotation[i - 1] * rot_theta;
+        }
+
+        // The joint's own rotation doesn't move its axis
+        chain.axis_world[i] = chain.rotation[i] * chain.axis[i];
+        chain.angle[i] = theta;
+    }
+
+    if (first < 6) {
+        // Get end effector position in frame of joint f
+        ef_xform.block(0,0,3,3) = chain.rotation[5];
+        ef_xform.block(0,3,3,1) = chain.position[5] + chain.rotation[5] * model->ef_xyz;
+    }
+    chain.num_valid = 6;
 }
 
 Vector3d ArmState::get_joint_pos_local(size_t joint_index) const {
     // Return joint position relatice to local frame (position relative to previous joint)
 
     // TODO write function to handle possible exceptions with call to at()
-    return joints[joint_index].pos_local;
+    return model->joints[joint_index].pos_local;
 }
 
 Vector3d ArmState::get_joint_axis(size_t joint_index) const {
     // Return local axis of rotation
-    return joints[joint_index].rot_axis;
+    return model->joints[joint_index].rot_axis;
 }
 
 Vector3d ArmState::get_joint_com(size_t joint_index) const {
     // Return center of mass of specific link relative to the joint origin
-    Matrix4d transform = get_joint_transform(joint_index);
-    Matrix4d translation = Matrix4d::Identity();
-    translation.block(0,3,3,1) = joints[joint_index].local_center_of_mass;
-    Matrix4d output = transform*translation;
-    Vector3d out_vec(output(0,3), output(1,3), output(2,3));
-    return out_vec;
+    return chain.position[joint_index] + chain.rotation[joint_index] * model->joints[joint_index].local_center_of_mass;
 }
 
 double ArmState::get_joint_mass(size_t joint_index) const {
-    // TODO: Consider adding mass to the joint struct?
-    return joints[joint_index].mass;
+    return model->joints[joint_index].mass;
 }
 
-std::vector<double> ArmState::get_joint_limits(size_t joint_index) const {
-    // Returns a vector of the joint rotation limits in radians.
-    // Vector should have a "lower" value (index 0) and "upper" value (index 1).
-    return joints[joint_index].joint_limits;
+const std::array<double, 2> &ArmState::get_joint_limits(size_t joint_index) const {
+    // Returns the joint rotation limits in radians.
+    // The "lower" value is index 0 and the "upper" value is index 1.
+    return model->joints[joint_index].limits;
 }
 // Tested in set_joint_angles_test
 void ArmState::set_joint_angles(const std::vector<double> &angles) {
@@ -107,44 +125,67 @@ void ArmState::set_joint_angles(const std::vector<double> &angles) {
 
     // Iterate through all angles and joints adding the angles to each corresponding joint.
     // angles vector should be same size as internal joints vector.
-    for (size_t i = 0; i < 6; ++i) {
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
         joints[i].angle = angles[i];
     }
 }
 
-std::vector<std::string> ArmState::get_all_joints() const {
-    // Return a vector containing all of the joint names
-    return joint_names;
+Vector6d ArmState::get_joint_angles_6d() const {
+    Vector6d angles;
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        angles(i) = joints[i].angle;
+    }
+    return angles;
 }
 
-Vector3d ArmState::get_joint_axis_world(size_t joint_index) const {
-    return joints[joint_index].joint_axis_world;
+void ArmState::set_joint_angles_6d(const Vector6d &angles) {
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        joints[i].angle = angles(i);
+    }
 }
 
-Matrix4d ArmState::get_joint_transform(size_t joint_index) const {
-    return joints[joint_index].global_transform;
+std::vector<std::string> ArmState::get_all_joints() const {
+    // Return a vector containing all of the joint names
+    return std::vector<std::string>(model->joint_names.begin(), model->joint_names.end());
 }
 
-void ArmState::set_joint_transform(size_t joint_index, const Matrix4d &xform) {
-    joints[joint_index].global_transform = xform;
+Vector3d ArmState::get_joint_axis_world(size_t joint_index) const {
+    return chain.axis_world[joint_index];
 }
 
-void ArmState::set_link_transform(size_t link_index, const Matrix4d &xform) {
-    links[link_index].global_transform = xform;
+Matrix4d ArmState::get_joint_transform(size_t joint_index) const {
+    Matrix4d xform = Matrix4d::Identity();
+    xform.block(0,0,3,3) = chain.rotation[joint_index];
+    xform.block(0,3,3,1) = chain.position[joint_index];
+    return xform;
+}
+
+Vector6d ArmState::update_gravity_torques() {
+    const Vector3d gravity(0, 0, -GRAVITY);
+    Vector6d axis_torques;
+
+    // mass of the joints from i on, and their first moment about the world origin
+    double mass = 0.0;
+    Vector3d moment = Vector3d::Zero();
+    for (size_t i = NUM_JOINTS; i-- > 0; ) {
+        mass += get_joint_mass(i);
+        moment += get_joint_mass(i) * get_joint_com(i);
+
+        // gravity acts at the center of mass of everything after the joint,
+        // which the joint has to cancel out
+        Vector3d lever = moment - mass * chain.position[i];
+        joints[i].torque = -lever.cross(gravity);
+        axis_torques(i) = joints[i].torque.dot(chain.axis_world[i]);
+    }
+    return axis_torques;
 }
 
 Matrix4d ArmState::get_ef_transform() const {
     return ef_xform;
 }
 
-void ArmState::set_ef_transform(const Matrix4d &xform) {
-    ef_xform = xform;
-}
-
 Vector3d ArmState::get_joint_pos_world(size_t joint_index) const {
-    Matrix4d joint_xform = get_joint_transform(joint_index);
-    Vector3d joint_pos(joint_xform(0,3), joint_xform(1,3), joint_xform(2,3));
-    return joint_pos;
+    return chain.position[joint_index];
 }
 
 Vector3d ArmState::get_ef_pos_world() const {
@@ -175,66 +216,113 @@ std::vector<double> ArmState::get_ef_pos_and_euler_angles() const {
 // Tested in set_joint_angles_test
 std::vector<double> ArmState::get_joint_angles() const {
     std::vector<double> angles;
-    angles.reserve(6);
-    for (size_t i = 0; i < 6; ++i) {
+    angles.reserve(NUM_JOINTS);
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
         angles.push_back(joints[i].angle);
     }
     return angles;
 }
 
 void ArmState::transform_avoidance_links() {
-    for (size_t i = 0; i < collision_avoidance_links.size(); ++i) {
-        Avoidance_Link &link = collision_avoidance_links.at(i);
+    for (size_t i = 0; i < avoidance_points.size(); ++i) {
+        const AvoidanceLinkModel &link = model->avoidance_links[i];
 
-        const Matrix4d &joint_xform = get_joint_transform(link.joint_origin);
-        
-        for (size_t j = 0; j < link.points.size(); ++j) {
-            link.points[j] = apply_transformation(joint_xform, link.points[j]);
-        }
+        const Matrix3d &rotation = chain.rotation[link.joint_origin];
+        const Vector3d &position = chain.position[link.joint_origin];
+
+        // Always start from the local points, so repeated calls don't stack transforms
+        avoidance_points[i][0] = position + rotation * link.points[0];
+        avoidance_points[i][1] = position + rotation * link.points[1];
+        avoidance_centers[i] = position + rotation * link.bound_center;
     }
 }
 
 // Tested in link_link_check_test
 bool ArmState::link_link_check(size_t index_1, size_t index_2) const {
+    return link_link_gap(index_1, index_2) < 0;
+}
+
+double ArmState::link_link_gap(size_t index_1, size_t index_2) const {
     double closest_dist;
-    const Avoidance_Link &link_1 = collision_avoidance_links.at(index_1);
-    const Avoidance_Link &link_2 = collision_avoidance_links.at(index_2);
-
-    if (link_1.type == "capsule" && link_2.type == "capsule") {
-        const Vector3d &b1 = link_1.points[0];
-        const Vector3d &b2 = link_2.points[0];
-        const Vector3d &e1 = link_1.points[1];
-        const Vector3d &e2 = link_2.points[1];
-        closest_dist = closest_dist_bet_lines(b1, e1, b2, e2);
+    const AvoidanceLinkModel &link_1 = model->avoidance_links.at(index_1);
+    const AvoidanceLinkModel &link_2 = model->avoidance_links.at(index_2);
+    const std::array<Vector3d, 2> &points_1 = avoidance_points[index_1];
+    const std::array<Vector3d, 2> &points_2 = avoidance_points[index_2];
+
+    bool capsule_1 = link_1.type == ShapeType::CAPSULE;
+    bool capsule_2 = link_2.type == ShapeType::CAPSULE;
+
+    if (capsule_1 && capsule_2) {
+        closest_dist = closest_dist_bet_lines(points_1[0], points_1[1], points_2[0], points_2[1]);
     }
-    else if (link_1.type == "capsule") {
-        const Vector3d &b1 = link_1.points[0];
-        const Vector3d &e1 = link_1.points[1];
-        const Vector3d &center = link_2.points[0];
-        closest_dist = point_line_distance(b1, e1, center);
+    else if (capsule_1) {
+        closest_dist = point_line_distance(points_1[0], points_1[1], points_2[0]);
     }
-    else if (link_2.type == "capsule") {
-        const Vector3d &b2 = link_2.points[0];
-        const Vector3d &e2 = link_2.points[1];
-        const Vector3d &center = link_1.points[0];
-        closest_dist = point_line_distance(b2, e2, center);
+    else if (capsule_2) {
+        closest_dist = point_line_distance(points_2[0], points_2[1], points_1[0]);
     }
     else {
-        closest_dist = (link_1.points[0] - link_2.points[0]).norm();
+        closest_dist = (points_1[0] - points_2[0]).norm();
     }
 
-    return closest_dist < (link_1.radius + link_2.radius);
+    return closest_dist - (link_1.radius + link_2.radius);
 }
 
 // Tested in link_link_check_test
 bool ArmState::obstacle_free() {
     transform_avoidance_links();
-    
-    for (size_t i = 1; i < collision_avoidance_links.size(); ++i) {
-        for (size_t possible_collision : collision_avoidance_links[i].collisions) {
-            if (link_link_check(i, possible_collision)) {
-                std::cout << "obstacle free i: " << i << "\n";
-                std::cout << "obstacle free possible_collision: " << possible_collision << "\n";
+
+    // One batch per thread, so checks don't allocate and copies of the arm stay small
+    static thread_local SegmentPairs candidates;
+    candidates.reserve(model->collision_pairs.size());
+    candidates.clear();
+
+    // Broad phase: links can only collide if their bounding spheres overlap
+    auto add_candidate = [this](const std::array<size_t, 2> &pair) {
+        const AvoidanceLinkModel &link_1 = model->avoidance_links[pair[0]];
+        const AvoidanceLinkModel &link_2 = model->avoidance_links[pair[1]];
+
+        double reach = link_1.bound_radius + link_2.bound_radius;
+        if ((avoidance_centers[pair[0]] - avoidance_centers[pair[1]]).squaredNorm() < reach * reach) {
+            const std::array<Vector3d, 2> &points_1 = avoidance_points[pair[0]];
+            const std::array<Vector3d, 2> &points_2 = avoidance_points[pair[1]];
+            candidates.add(points_1[0], points_1[1], points_2[0], points_2[1], link_1.radius + link_2.radius);
+        }
+    };
+
+    if (collision_map) {
+        // The map settles the pairs it covers, except the ones near their boundary
+        uint32_t cell = collision_map->lookup(chain.angle);
+        if (cell & COLLISION_MAP_COLLIDING) {
+            return false;
+        }
+
+        const std::vector< std::array<size_t, 2> > &mapped_pairs = collision_map->get_mapped_pairs();
+        for (size_t i = 0; i < mapped_pairs.size(); ++i) {
+            if (cell & (1u << i)) {
+                add_candidate(mapped_pairs[i]);
+            }
+        }
+
+        for (const std::array<size_t, 2> &pair : collision_map->get_unmapped_pairs()) {
+            add_candidate(pair);
+        }
+    }
+    else {
+        for (const std::array<size_t, 2> &pair : model->collision_pairs) {
+            add_candidate(pair);
+        }
+    }
+
+    // Narrow phase: exact distances for all the remaining pairs at once
+    if (candidates.any_within()) {
+        return false;
+    }
+
+    if (environment) {
+        for (size_t i = 0; i < avoidance_points.size(); ++i) {
+            if (environment->capsule_gap(avoidance_points[i][0], avoidance_points[i][1],
+                                         model->avoidance_links[i].radius, 0) < 0) {
                 return false;
             }
         }
@@ -242,13 +330,116 @@ bool ArmState::obstacle_free() {
     return true;
 }
 
+double ArmState::free_motion_fraction(const Vector6d &motion) {
+    transform_avoidance_links();
+
+    static thread_local SegmentPairs candidates;
+    static thread_local std::vector<double> closing_speeds;
+    candidates.reserve(model->collision_pairs.size());
+    candidates.clear();
+    closing_speeds.clear();
+
+    for (const std::array<size_t, 2> &pair : model->collision_pairs) {
+        const AvoidanceLinkModel &link_1 = model->avoidance_links[pair[0]];
+        const AvoidanceLinkModel &link_2 = model->avoidance_links[pair[1]];
+
+        // Upper bound on how much the gap can shrink over the whole motion. The
+        // joints before both links turn them together, which doesn't change the gap
+        double closing_speed = 0;
+        for (size_t i = std::min(link_1.joint_origin, link_2.joint_origin) + 1; i < NUM_JOINTS; ++i) {
+            closing_speed += (link_1.reach[i] + link_2.reach[i]) * std::abs(motion(i));
+        }
+
+        // Pairs whose bounding spheres stay apart for the whole motion are safe
+        double bound_gap = (avoidance_centers[pair[0]] - avoidance_centers[pair[1]]).norm()
+                           - link_1.bound_radius - link_2.bound_radius;
+        if (bound_gap > closing_speed) {
+            continue;
+        }
+
+        const std::array<Vector3d, 2> &points_1 = avoidance_points[pair[0]];
+        const std::array<Vector3d, 2> &points_2 = avoidance_points[pair[1]];
+        candidates.add(points_1[0], points_1[1], points_2[0], points_2[1], link_1.radius + link_2.radius);
+        closing_speeds.push_back(closing_speed);
+    }
+
+    if (candidates.any_within()) {
+        return 0;
+    }
+
+    double fraction = 1;
+    for (size_t i = 0; i < closing_speeds.size(); ++i) {
+        double gap = std::sqrt(candidates.get_dists_squared()(i)) - candidates.get_radius_sum()(i);
+        if (gap < fraction * closing_speeds[i]) {
+            fraction = gap / closing_speeds[i];
+        }
+    }
+
+    if (environment) {
+        for (size_t i = 0; i < avoidance_points.size(); ++i) {
+            // The environment stays put, so every joint up to the link moves it towards it
+            const AvoidanceLinkModel &link = model->avoidance_links[i];
+            double closing_speed = 0;
+            for (size_t j = 0; j <= link.joint_origin; ++j) {
+                closing_speed += link.reach[j] * std::abs(motion(j));
+            }
+
+            // gaps past what the rest of the motion could close don't need finding exactly
+            double gap = environment->capsule_gap(avoidance_points[i][0], avoidance_points[i][1], link.radius,
+                                                  fraction * closing_speed);
+            if (gap < 0) {
+                return 0;
+            }
+            if (gap < fraction * closing_speed) {
+                fraction = gap / closing_speed;
+            }
+        }
+    }
+    return fraction;
+}
+
+void ArmState::set_collision_map(std::shared_ptr<const CollisionMap> map) {
+    collision_map = map;
+}
+
+void ArmState::set_environment(std::shared_ptr<const EnvironmentMap> environment_in) {
+    environment = environment_in;
+}
+
+double ArmState::get_point_gap(const Vector3d &point) const {
+    double gap = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < avoidance_points.size(); ++i) {
+        Vector3d a = avoidance_points[i][0];
+        Vector3d ab = avoidance_points[i][1] - a;
+        double t = ab.squaredNorm() > 0 ? std::min(std::max((point - a).dot(ab) / ab.squaredNorm(), 0.0), 1.0) : 0;
+        gap = std::min(gap, (a + t * ab - point).norm() - model->avoidance_links[i].radius);
+    }
+    return gap;
+}
+
+const ArmModel &ArmState::get_model() const {
+    return *model;
+}
+
+const std::shared_ptr<const ArmModel> &ArmState::get_model_ptr() const {
+    return model;
+}
+
+const std::shared_ptr<const CollisionMap> &ArmState::get_collision_map() const {
+    return collision_map;
+}
+
+const std::shared_ptr<const EnvironmentMap> &ArmState::get_environment() const {
+    return environment;
+}
+
 // Used for testing ArmState functions
 int ArmState::num_joints() const {
-    return joints.size();
+    return NUM_JOINTS;
 }
 
 std::string ArmState::get_child_link(size_t joint_index) const {
-    return joints[joint_index].child_link;
+    return model->child_links[joint_index];
 }
 
 Vector3d ArmState::get_joint_torque(size_t joint_index) const {
@@ -259,30 +450,32 @@ void ArmState::set_joint_torque(size_t joint_index, const Vector3d &torque) {
     joints[joint_index].torque = torque;
 }
 
+// Link 0 is the base, and every other link starts at the joint before it
 Vector3d ArmState::get_link_point_world(size_t link_index) {
-    Vector3d link_point_world;
-    link_point_world(0) = links[link_index].global_transform(0,3);
-    link_point_world(1) = links[link_index].global_transform(1,3);
-    link_point_world(2) = links[link_index].global_transform(2,3);
-    return link_point_world;
+    if (link_index == 0) {
+        return Vector3d::Zero();
+    }
+    return chain.position[link_index - 1];
 }
 
 Matrix4d ArmState::get_link_xform(size_t link_index) {
-    return links[link_index].global_transform;
+    if (link_index == 0) {
+        return Matrix4d::Identity();
+    }
+    return get_joint_transform(link_index - 1);
 }
 
 Vector3d ArmState::get_ef_xyz() const {
-    return ef_xyz;
+    return model->ef_xyz;
 }
 
-void ArmState::set_ef_xyz(std::vector<double> ef_xyz_vec){
-    ef_xyz(0) = ef_xyz_vec[0];
-    ef_xyz(1) = ef_xyz_vec[1];
-    ef_xyz(2) = ef_xyz_vec[2];
-}
 
 double ArmState::get_joint_max_speed(size_t joint_index) const {
-    return joints[joint_index].max_speed;
+    return model->joints[joint_index].max_speed;
+}
+
+double ArmState::get_joint_max_acceleration(size_t joint_index) const {
+    return model->joints[joint_index].max_acceleration;
 }
 
 double ArmState::get_joint_encoder_offset(size_t joint_index) const {
@@ -294,7 +487,7 @@ void ArmState::set_joint_encoder_offset(size_t joint_index, double offset) {
 }
 
 double ArmState::get_joint_encoder_multiplier(size_t joint_index) const {
-    return joints[joint_index].encoder_multiplier;
+    return model->joints[joint_index].encoder_multiplier;
 }
 
 bool ArmState::get_joint_locked(size_t joint_index) const {
@@ -314,10 +507,10 @@ void ArmState::set_joint_angle(size_t joint_index, double angle) {
     joints[joint_index].angle = angle;
 }
 
-bool ArmState::is_continuous(size_t joint_index) {
-    return joints[joint_index].continuous_range;
+bool ArmState::is_continuous(size_t joint_index) const {
+    return model->joints[joint_index].continuous_range;
 }
 
-std::vector<double> ArmState::get_preset_position(const std::string &pos) { 
-    return preset_positions.at(pos);
+std::vector<double> ArmState::get_preset_position(const std::string &pos) const {
+    return model->preset_positions.at(pos);
 }
@@ -5,143 +5,97 @@
 #include <vector>
 #include <iostream>
 #include <map>
+#include <array>
+#include <memory>
 
 #include <nlohmann/json.hpp>
 #include <eigen3/Eigen/Dense>
 
+#include "arm_model.hpp"
+#include "collision_map.hpp"
+#include "environment_map.hpp"
+
 using namespace Eigen;
 using namespace nlohmann;
 
 typedef Matrix<double, 6, 1> Vector6d;
 
+// m/s^2, pulling along -z of the world frame
+static constexpr double GRAVITY = 9.807;
+
 /**
  * Represent MRover's 6 DOF arm
  * */
 class ArmState{
 private:
 
-    struct Link {
-        std::string name;
-        Matrix4d global_transform;
+    /**
+     * The kinematic chain FK works on, kept as arrays so FK only touches
+     * the data it needs. The offsets and axis matrices come from the
+     * geometry and never change, the rest is the result of the last FK
+     * */
+    struct Chain {
+        // position of each joint in the frame of the previous joint
+        std::array<Vector3d, NUM_JOINTS> offset;
+
+        // cross product matrix K of each rotation axis and K * K, so the
+        // rotation by theta is I + sin(theta) K + (1 - cos(theta)) K * K
+        std::array<Matrix3d, NUM_JOINTS> axis_cross;
+        std::array<Matrix3d, NUM_JOINTS> axis_cross_sq;
+
+        std::array<Vector3d, NUM_JOINTS> axis;
+
+        // angles the transforms were last computed with
+        std::array<double, NUM_JOINTS> angle;
+
+        // rotation and position of each joint in the world frame
+        std::array<Matrix3d, NUM_JOINTS> rotation;
+        std::array<Vector3d, NUM_JOINTS> position;
+        std::array<Vector3d, NUM_JOINTS> axis_world;
+
+        // transforms of joints before num_valid match angle
+        size_t num_valid;
     };
 
+    /**
+     * The parts of a joint that change while the arm runs, the rest is in model
+     * */
     struct Joint {
-        
-        /**
-         * Construct joint from json input
-         * */
-        Joint(std::string name_in, const json &joint_geom)
-            : name(name_in), angle(0), pos_world(Vector3d::Zero(3)), 
-              global_transform(Matrix4d::Identity()), torque(Vector3d::Zero(3)) 
-        {
-            pos_local << joint_geom["origin"]["xyz"][0], joint_geom["origin"]["xyz"][1], joint_geom["origin"]["xyz"][2];
-            local_center_of_mass << joint_geom["mass_data"]["com"]["x"], joint_geom["mass_data"]["com"]["y"], joint_geom["mass_data"]["com"]["z"];
-
-            rot_axis << joint_geom["axis"][0], joint_geom["axis"][1], joint_geom["axis"][2];
-
-            joint_limits.push_back(joint_geom["limit"]["lower"]);
-            joint_limits.push_back(joint_geom["limit"]["upper"]);
-
-            child_link = joint_geom["child"];
-
-            max_speed = joint_geom["max_speed"];
-            encoder_offset = joint_geom["encoder_offset"];
-            encoder_multiplier = joint_geom["encoder_multiplier"];
-
-            // TODO check if mass is necessary. If so, initialize here
-
-            // joints b and c get an angle of 0, the rest should get 0   
-            if (name_in == "joint_b") {
-                angle = 1.0;
-            }
-            else if (name_in == "joint_c") {
-                angle = 0.5;
-            }
-            else {
-                angle = 0;
-            }
-
-            continuous_range = (joint_limits[0] < -3.1399 && joint_limits[1] > 3.1399);
-
-            locked = false;
-        }
-
-        std::string name;
+        Joint() : angle(0), torque(Vector3d::Zero()), encoder_offset(0), locked(false) { }
+
         double angle;
-        double mass;
-        Vector3d pos_world;
-        Matrix4d global_transform;
-        std::string child_link;
+
+        // torque the joint holds the arm after it up with, as of the last update_gravity_torques()
         Vector3d torque;
-        Vector3d pos_local;
-        Vector3d local_center_of_mass;
-        Vector3d rot_axis;
-        Vector3d joint_axis_world;
-        std::vector<double> joint_limits;
-        double max_speed; // radians/s
         double encoder_offset;
-        double encoder_multiplier;
         bool locked;
-        bool continuous_range;
     };
 
-    struct Avoidance_Link {
-
-        Avoidance_Link(size_t joint_origin_index, json &link_json, std::vector<size_t> collisions) : 
-                           joint_origin(joint_origin_index), collisions(collisions) {
-
-            type = link_json["type"];
-            radius = link_json["radius"];
-            link_num = link_json["link_num"];
-
-            if (type == "sphere") {
-                Vector3d p1(link_json["center"]["x1"], link_json["center"]["x1"], link_json["center"]["x1"]);
-                points.push_back(p1);
-            }
-            else if (type == "capsule") {
-                Vector3d p1(link_json["point_1"]["x1"], link_json["point_1"]["y1"], link_json["point_1"]["z1"]);
-                Vector3d p2(link_json["point_2"]["x2"], link_json["point_2"]["y2"], link_json["point_2"]["z2"]);
-                points.push_back(p1);
-                points.push_back(p2);
-            }
-        }
-
-        int link_num;
-        size_t joint_origin;
-        std::string type;
-        std::vector<Vector3d> points;
-        double radius;
-        std::vector<size_t> collisions;
-    };
+    // Shared between copies, since copies of an arm have the same geometry
+    std::shared_ptr<const ArmModel> model;
 
-    std::vector<std::string> joint_names;
-    std::vector<std::string> link_names;
-    std::map<std::string, std::vector<double>> preset_positions;
+    // Optional, shared between copies like model
+    std::shared_ptr<const CollisionMap> collision_map;
+    std::shared_ptr<const EnvironmentMap> environment;
 
-    std::vector<Joint> joints;
-    std::vector<Link> links;
-
-    std::vector<Avoidance_Link> collision_avoidance_links; // could make this an array
-    // TODO: Change num_collision_parts value as necessary
-    static const int num_collision_parts = 23;
-    Vector3d ef_pos_world;
-    Matrix4d ef_xform;
-    Vector3d ef_xyz;
+    std::array<Joint, NUM_JOINTS> joints;
 
+    Chain chain;
 
-    void add_joint(std::string joint, json &joint_geom);
+    // avoidance link points and bounding sphere centers in the world frame as of
+    // the last transform_avoidance_links(), indexed like model->avoidance_links
+    std::vector< std::array<Vector3d, 2> > avoidance_points;
+    std::vector<Vector3d> avoidance_centers;
 
-    void transform_parts();
-
-    struct Link_Comp {
-        bool operator()(const Avoidance_Link &a, const Avoidance_Link &b);
-    };
+    Matrix4d ef_xform;
 
-    void set_ef_xyz(std::vector<double> ef_xyz_vec);
+    void init_chain();
 
 public:
     ArmState(json &geom);
 
+    ArmState(const ArmModel &model_in);
+
     std::vector<std::string> get_all_joints() const;
 
     Vector3d get_joint_com(size_t joint_index) const;
@@ -152,18 +106,29 @@ public:
 
     Vector3d get_joint_axis_world(size_t joint_index) const;
 
-    std::vector<double> get_joint_limits(size_t joint_index) const;
+    const std::array<double, 2> &get_joint_limits(size_t joint_index) const;
 
     Matrix4d get_joint_transform(size_t joint_index) const;
 
-    void set_joint_transform(size_t joint_index, const Matrix4d &xform);
+    /**
+     * Updates the joint and end effector transforms for the current joint
+     * angles. Only joints from the first one whose angle changed since the
+     * last update are recomputed, the joints before it can't have moved
+     * */
+    void update_transforms();
 
-    void set_link_transform(size_t link_index, const Matrix4d &xform);
+    /**
+     * Computes the torque each joint needs to hold the arm after it still
+     * against gravity, for the transforms of the last update_transforms().
+     * This is the backward pass of recursive Newton-Euler for an arm at rest,
+     * summing each joint's mass and first moment from the end effector in.
+     * Sets every joint's torque vector, see get_joint_torque()
+     * @return each joint's torque about its own axis, in N*m
+     * */
+    Vector6d update_gravity_torques();
 
     Matrix4d get_ef_transform() const;
 
-    void set_ef_transform(const Matrix4d &xform);
-
     Vector3d get_joint_pos_world(size_t joint_index) const;
 
     Vector3d get_joint_pos_local(size_t joint_index) const;
@@ -178,18 +143,79 @@ public:
 
     void set_joint_angles(const std::vector<double> &angles);
 
+    /**
+     * Same as get_joint_angles() and set_joint_angles(), without allocating,
+     * for the inner loops of IK and motion checks
+     * */
+    Vector6d get_joint_angles_6d() const;
+
+    void set_joint_angles_6d(const Vector6d &angles);
+
     void transform_avoidance_links();
 
     /**
-     * @param index1 index for collision_avoidance_links
-     * @param index2 index for collision_avoidance_links
+     * @param index1 index for the avoidance links
+     * @param index2 index for the avoidance links
      * 
      * Returns true if there is a collision between the links
      * */
     bool link_link_check(size_t index_1, size_t index_2) const;
 
+    /**
+     * @return the distance between the surfaces of the links, negative if they overlap
+     * */
+    double link_link_gap(size_t index_1, size_t index_2) const;
+
+    /**
+     * Checks every pair of avoidance links that can collide. Pairs whose
+     * bounding spheres are apart are skipped, then the exact distances of
+     * the rest are checked together. With a collision map, the pairs it
+     * covers are only checked when the arm is near their boundary. With an
+     * environment, every link is also checked against it.
+     * @return true if no pair collides and no link touches the environment
+     * */
     bool obstacle_free();
 
+    /**
+     * Conservative advancement step for moving every joint by motion from the
+     * current angles, as of the last update_transforms(). Each pair's gap is
+     * divided by how fast the motion could possibly close it, and so is each
+     * link's gap to the environment.
+     * @return the fraction of motion, in [0, 1], that is certainly collision
+     * free, 0 if a pair already collides
+     * */
+    double free_motion_fraction(const Vector6d &motion);
+
+    /**
+     * Use map in obstacle_free(), or stop using one if map is null. The map
+     * must have been generated or loaded for this arm's geometry
+     * */
+    void set_collision_map(std::shared_ptr<const CollisionMap> map);
+
+    /**
+     * Check the links against environment in obstacle_free() and
+     * free_motion_fraction(), or stop if environment is null
+     * */
+    void set_environment(std::shared_ptr<const EnvironmentMap> environment_in);
+
+    /**
+     * @return the smallest distance from point to the surface of an avoidance
+     * link, as of the last transform_avoidance_links(), negative inside one
+     * */
+    double get_point_gap(const Vector3d &point) const;
+
+    const ArmModel &get_model() const;
+
+    /**
+     * The geometry, collision map and environment, shared with copies of this
+     * arm. The collision map and environment are null when not set
+     * */
+    const std::shared_ptr<const ArmModel> &get_model_ptr() const;
+
+    const std::shared_ptr<const CollisionMap> &get_collision_map() const;
+
+    const std::shared_ptr<const EnvironmentMap> &get_environment() const;
+
     int num_joints() const;
 
     std::string get_child_link(size_t joint_index) const;
@@ -206,6 +232,8 @@ public:
 
     double get_joint_max_speed(size_t joint_index) const;
 
+    double get_joint_max_acceleration(size_t joint_index) const;
+
     double get_joint_encoder_offset(size_t joint_index) const;
 
     void set_joint_encoder_offset(size_t joint_index, double offset);
@@ -220,9 +248,9 @@ public:
 
     void set_joint_angle(size_t joint_index, double angle);
 
-    bool is_continuous(size_t joint_index);
+    bool is_continuous(size_t joint_index) const;
 
-    std::vector<double> get_preset_position(const std::string &pos);
+    std::vector<double> get_preset_position(const std::string &pos) const;
 };
 
 #endif
@@ -0,0 +1,100 @@
+#include "collision.hpp"
+
+using namespace Eigen;
+
+SegmentPairs::SegmentPairs() : count(0) { }
+
+void SegmentPairs::reserve(Index capacity) {
+    if (radius_sum.size() >= capacity) {
+        return;
+    }
+
+    for (size_t k = 0; k < 3; ++k) {
+        a0[k].conservativeResize(capacity);
+        a1[k].conservativeResize(capacity);
+        b0[k].conservativeResize(capacity);
+        b1[k].conservativeResize(capacity);
+        d1[k].resize(capacity);
+        d2[k].resize(capacity);
+        r[k].resize(capacity);
+    }
+    radius_sum.conservativeResize(capacity);
+
+    for (ArrayXd *scratch : {&a, &b, &c, &e, &f, &denom, &s, &t, &t_unclamped, &dist_squared}) {
+        scratch->resize(capacity);
+    }
+}
+
+void SegmentPairs::clear() {
+    count = 0;
+}
+
+Index SegmentPairs::size() const {
+    return count;
+}
+
+void SegmentPairs::add(const Vector3d &a0_in, const Vector3d &a1_in, const Vector3d &b0_in, const Vector3d &b1_in,
+                       double radius_sum_in) {
+    for (size_t k = 0; k < 3; ++k) {
+        a0[k](count) = a0_in(k);
+        a1[k](count) = a1_in(k);
+        b0[k](count) = b0_in(k);
+        b1[k](count) = b1_in(k);
+    }
+    radius_sum(count) = radius_sum_in;
+    ++count;
+}
+
+bool SegmentPairs::any_within() {
+    const double SMALL_NUM = 0.00000001;
+    const Index n = count;
+
+    if (n == 0) {
+        return false;
+    }
+
+    // Closest points of segments, see Ericson, Real-Time Collision Detection, 5.1.9.
+    // Segment 1 is a0 + s * d1 and segment 2 is b0 + t * d2, with s and t in [0, 1].
+    for (size_t k = 0; k < 3; ++k) {
+        d1[k].head(n) = a1[k].head(n) - a0[k].head(n);
+        d2[k].head(n) = b1[k].head(n) - b0[k].head(n);
+        r[k].head(n) = a0[k].head(n) - b0[k].head(n);
+    }
+
+    a.head(n) = d1[0].head(n).square() + d1[1].head(n).square() + d1[2].head(n).square();
+    e.head(n) = d2[0].head(n).square() + d2[1].head(n).square() + d2[2].head(n).square();
+    b.head(n) = d1[0].head(n) * d2[0].head(n) + d1[1].head(n) * d2[1].head(n) + d1[2].head(n) * d2[2].head(n);
+    c.head(n) = d1[0].head(n) * r[0].head(n) + d1[1].head(n) * r[1].head(n) + d1[2].head(n) * r[2].head(n);
+    f.head(n) = d2[0].head(n) * r[0].head(n) + d2[1].head(n) * r[1].head(n) + d2[2].head(n) * r[2].head(n);
+
+    // s for the closest points of the infinite lines, or 0 if they are parallel
+    denom.head(n) = a.head(n) * e.head(n) - b.head(n).square();
+    s.head(n) = (denom.head(n) > SMALL_NUM).select(
+        ((b.head(n) * f.head(n) - c.head(n) * e.head(n)) / denom.head(n).max(SMALL_NUM)).max(0.0).min(1.0), 0.0);
+
+    // If segment 2 is a point, segment 1's closest point is the projection of that point
+    s.head(n) = (e.head(n) > SMALL_NUM).select(s.head(n),
+        (-c.head(n) / a.head(n).max(SMALL_NUM)).max(0.0).min(1.0));
+
+    // Closest point on segment 2 to segment 1's point, and if that had to be
+    // clamped to an end, the closest point on segment 1 to that end
+    t_unclamped.head(n) = (b.head(n) * s.head(n) + f.head(n)) / e.head(n).max(SMALL_NUM);
+    t.head(n) = t_unclamped.head(n).max(0.0).min(1.0);
+    s.head(n) = (t_unclamped.head(n) == t.head(n)).select(s.head(n),
+        ((b.head(n) * t.head(n) - c.head(n)) / a.head(n).max(SMALL_NUM)).max(0.0).min(1.0));
+
+    dist_squared.head(n).setZero();
+    for (size_t k = 0; k < 3; ++k) {
+        dist_squared.head(n) += (r[k].head(n) + d1[k].head(n) * s.head(n) - d2[k].head(n) * t.head(n)).square();
+    }
+
+    return (dist_squared.head(n) < radius_sum.head(n).square()).any();
+}
+
+const ArrayXd &SegmentPairs::get_dists_squared() const {
+    return dist_squared;
+}
+
+const ArrayXd &SegmentPairs::get_radius_sum() const {
+    return radius_sum;
+}
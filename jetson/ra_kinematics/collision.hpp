@@ -0,0 +1,61 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <array>
+#include <eigen3/Eigen/Dense>
+
+using namespace Eigen;
+
+/**
+ * A batch of segment pairs to check for collisions, stored with one array
+ * per coordinate so the distances of every pair are computed together
+ * with vector instructions and without branches. Zero length segments
+ * work as points, so spheres are segments with both ends at the center.
+ * */
+class SegmentPairs {
+private:
+
+    Index count;
+
+    std::array<ArrayXd, 3> a0, a1, b0, b1;
+    ArrayXd radius_sum;
+
+    // Scratch space for any_within(), kept so checks don't allocate
+    std::array<ArrayXd, 3> d1, d2, r;
+    ArrayXd a, b, c, e, f, denom, s, t, t_unclamped, dist_squared;
+
+public:
+
+    SegmentPairs();
+
+    /**
+     * Makes room for capacity pairs, only allocates if there isn't room already
+     * */
+    void reserve(Index capacity);
+
+    void clear();
+
+    Index size() const;
+
+    /**
+     * Add the pair of segment a0 to a1 and segment b0 to b1, which collide
+     * if they come closer than radius_sum. Needs room from reserve()
+     * */
+    void add(const Vector3d &a0_in, const Vector3d &a1_in, const Vector3d &b0_in, const Vector3d &b1_in,
+             double radius_sum_in);
+
+    /**
+     * @return true if any pair comes closer than its radius_sum
+     * */
+    bool any_within();
+
+    /**
+     * @return squared distance between the closest points of each pair in the
+     * first size() entries, as of the last any_within()
+     * */
+    const ArrayXd &get_dists_squared() const;
+
+    const ArrayXd &get_radius_sum() const;
+};
+
+#endif
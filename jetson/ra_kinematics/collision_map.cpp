@@ -0,0 +1,222 @@
+#include "collision_map.hpp"
+#include "arm_state.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CollisionMap::CollisionMap() :
+    cells(0), states(nullptr), outside(0), mapping(nullptr), mapping_length(0), fingerprint(0) { }
+
+CollisionMap::~CollisionMap() {
+    unmap();
+}
+
+void CollisionMap::unmap() {
+    if (mapping) {
+        munmap(mapping, mapping_length);
+        mapping = nullptr;
+        mapping_length = 0;
+    }
+}
+
+void CollisionMap::init(const ArmModel &model, size_t num_cells) {
+    cells = num_cells;
+
+    // Everything the mapped pairs' collisions depend on, so a map is only
+    // ever used with the geometry and grid it was generated for
+    fingerprint = FINGERPRINT_BASIS;
+    fingerprint_add(fingerprint, static_cast<uint64_t>(num_cells));
+
+    for (size_t i = 0; i < COLLISION_MAP_DIMS; ++i) {
+        const JointModel &joint = model.joints[COLLISION_MAP_FIRST_JOINT + i];
+        lower[i] = joint.limits[0];
+        width[i] = (joint.limits[1] - joint.limits[0]) / num_cells;
+    }
+
+    for (const JointModel &joint : model.joints) {
+        fingerprint_add(fingerprint, joint.pos_local);
+        fingerprint_add(fingerprint, joint.rot_axis);
+        fingerprint_add(fingerprint, joint.limits[0]);
+        fingerprint_add(fingerprint, joint.limits[1]);
+    }
+
+    for (const AvoidanceLinkModel &link : model.avoidance_links) {
+        fingerprint_add(fingerprint, static_cast<uint64_t>(link.joint_origin));
+        fingerprint_add(fingerprint, static_cast<uint32_t>(link.type));
+        fingerprint_add(fingerprint, link.radius);
+        fingerprint_add(fingerprint, link.points[0]);
+        fingerprint_add(fingerprint, link.points[1]);
+    }
+
+    mapped_pairs.clear();
+    unmapped_pairs.clear();
+    for (const std::array<size_t, 2> &pair : model.collision_pairs) {
+        fingerprint_add(fingerprint, static_cast<uint64_t>(pair[0]));
+        fingerprint_add(fingerprint, static_cast<uint64_t>(pair[1]));
+
+        size_t furthest = std::max(model.avoidance_links[pair[0]].joint_origin,
+                                   model.avoidance_links[pair[1]].joint_origin);
+        if (furthest <= COLLISION_MAP_LAST_JOINT && mapped_pairs.size() < COLLISION_MAP_MAX_PAIRS) {
+            mapped_pairs.push_back(pair);
+        }
+        else {
+            unmapped_pairs.push_back(pair);
+        }
+    }
+
+    outside = (1u << mapped_pairs.size()) - 1;
+}
+
+void CollisionMap::generate(ArmState &robot, size_t num_cells) {
+    unmap();
+
+    const ArmModel &model = robot.get_model();
+    init(model, num_cells);
+
+    // Moving from a cell's center to anywhere in it changes a pair's gap by
+    // at most the reach of both links times half the cell's width, summed over
+    // the joints between them, the same bound as free_motion_fraction()
+    std::vector<double> change;
+    for (const std::array<size_t, 2> &pair : mapped_pairs) {
+        const AvoidanceLinkModel &link_1 = model.avoidance_links[pair[0]];
+        const AvoidanceLinkModel &link_2 = model.avoidance_links[pair[1]];
+
+        double bound = 0;
+        for (size_t i = std::min(link_1.joint_origin, link_2.joint_origin) + 1; i <= COLLISION_MAP_LAST_JOINT; ++i) {
+            bound += (link_1.reach[i] + link_2.reach[i]) * width[i - COLLISION_MAP_FIRST_JOINT] / 2;
+        }
+        change.push_back(bound);
+    }
+
+    generated.assign(cells * cells * cells, outside);
+    states = generated.data();
+
+    size_t index = 0;
+    for (size_t b = 0; b < cells; ++b) {
+        robot.set_joint_angle(COLLISION_MAP_FIRST_JOINT, lower[0] + (b + 0.5) * width[0]);
+
+        for (size_t c = 0; c < cells; ++c) {
+            robot.set_joint_angle(COLLISION_MAP_FIRST_JOINT + 1, lower[1] + (c + 0.5) * width[1]);
+
+            for (size_t d = 0; d < cells; ++d, ++index) {
+                robot.set_joint_angle(COLLISION_MAP_FIRST_JOINT + 2, lower[2] + (d + 0.5) * width[2]);
+                robot.update_transforms();
+                robot.transform_avoidance_links();
+
+                uint32_t cell = 0;
+                for (size_t i = 0; i < mapped_pairs.size(); ++i) {
+                    double gap = robot.link_link_gap(mapped_pairs[i][0], mapped_pairs[i][1]);
+                    if (gap < -change[i]) {
+                        cell = COLLISION_MAP_COLLIDING;
+                        break;
+                    }
+                    if (gap <= change[i]) {
+                        cell |= 1u << i;
+                    }
+                }
+
+                generated[index] = cell;
+            }
+        }
+    }
+}
+
+bool CollisionMap::save(const std::string &filepath) const {
+    if (empty()) {
+        return false;
+    }
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        std::cout << "Could not write collision map " << filepath << "\n";
+        return false;
+    }
+
+    Header header = { COLLISION_MAP_MAGIC, COLLISION_MAP_VERSION, fingerprint, static_cast<uint32_t>(cells), 0 };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(states), cells * cells * cells * sizeof(uint32_t));
+
+    return static_cast<bool>(file);
+}
+
+bool CollisionMap::load(const std::string &filepath, const ArmModel &model) {
+    unmap();
+    generated.clear();
+    states = nullptr;
+
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = st.st_size;
+    void *data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+
+    bool valid = header.magic == COLLISION_MAP_MAGIC && header.version == COLLISION_MAP_VERSION &&
+                 header.cells > 0 && length == sizeof(Header) + sizeof(uint32_t) * header.cells * header.cells * header.cells;
+    if (valid) {
+        init(model, header.cells);
+        valid = header.fingerprint == fingerprint;
+    }
+
+    if (!valid) {
+        std::cout << "Collision map " << filepath << " is not for this arm geometry, regenerate it\n";
+        munmap(data, length);
+        cells = 0;
+        return false;
+    }
+
+    mapping = data;
+    mapping_length = length;
+    states = reinterpret_cast<const uint32_t *>(static_cast<const char *>(data) + sizeof(Header));
+    return true;
+}
+
+bool CollisionMap::empty() const {
+    return states == nullptr;
+}
+
+uint32_t CollisionMap::lookup(const std::array<double, NUM_JOINTS> &angles) const {
+    size_t index = 0;
+    for (size_t i = 0; i < COLLISION_MAP_DIMS; ++i) {
+        double cell = std::floor((angles[COLLISION_MAP_FIRST_JOINT + i] - lower[i]) / width[i]);
+        if (!(cell >= 0 && cell <= cells)) {
+            return outside;
+        }
+
+        // the upper limit itself belongs to the last cell
+        index = index * cells + std::min(static_cast<size_t>(cell), cells - 1);
+    }
+
+    return states[index];
+}
+
+const std::vector< std::array<size_t, 2> > &CollisionMap::get_unmapped_pairs() const {
+    return unmapped_pairs;
+}
+
+const std::vector< std::array<size_t, 2> > &CollisionMap::get_mapped_pairs() const {
+    return mapped_pairs;
+}
@@ -0,0 +1,133 @@
+#ifndef COLLISION_MAP_H
+#define COLLISION_MAP_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "arm_model.hpp"
+
+class ArmState;
+
+// Joints the map covers. Pairs of links no further out than the last joint
+// only move relative to each other when these joints turn, joint a turns them together
+static constexpr size_t COLLISION_MAP_FIRST_JOINT = 1;
+static constexpr size_t COLLISION_MAP_LAST_JOINT = 3;
+static constexpr size_t COLLISION_MAP_DIMS = COLLISION_MAP_LAST_JOINT - COLLISION_MAP_FIRST_JOINT + 1;
+
+// Cells the range of each mapped joint is split into
+static constexpr size_t COLLISION_MAP_CELLS = 128;
+
+// Identifies a collision map file, and its layout version
+static constexpr uint32_t COLLISION_MAP_MAGIC = 0x6d61726d;
+static constexpr uint32_t COLLISION_MAP_VERSION = 1;
+
+// Cells the map finds some pair colliding everywhere in have this bit set,
+// the bits below it mark the mapped pairs that need an exact check
+static constexpr uint32_t COLLISION_MAP_COLLIDING = 1u << 31;
+
+// Pairs a cell can mark, more pairs than this are always checked exactly
+static constexpr size_t COLLISION_MAP_MAX_PAIRS = 31;
+
+/**
+ * Precomputed self-collision map over joints b, c and d.
+ *
+ * Each cell of the grid records which of the pairs of links that only
+ * depend on those joints could touch somewhere in the cell, or that one of
+ * them collides everywhere in it. ArmState::obstacle_free() then rejects
+ * colliding cells outright and otherwise only checks the pairs involving
+ * links past joint d and the pairs the cell marks as near their boundary.
+ *
+ * The map is generated once for a geometry with `$ make collision_map` and
+ * memory-mapped from the file, which also records a fingerprint of the
+ * geometry so a stale map is never used.
+ * */
+class CollisionMap {
+private:
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fingerprint;
+        uint32_t cells;
+        uint32_t padding;
+    };
+
+    // lower limit and cell width of each mapped joint
+    std::array<double, COLLISION_MAP_DIMS> lower;
+    std::array<double, COLLISION_MAP_DIMS> width;
+    size_t cells;
+
+    // the mapped pairs, which bits of a cell stand for, and the rest of model.collision_pairs
+    std::vector< std::array<size_t, 2> > mapped_pairs;
+    std::vector< std::array<size_t, 2> > unmapped_pairs;
+
+    // cells^3 cells, joint d changing fastest. Points into mapping for a
+    // loaded map or into generated for one generated in memory
+    const uint32_t *states;
+    std::vector<uint32_t> generated;
+
+    // the cell of angles outside the limits of a mapped joint
+    uint32_t outside;
+
+    void *mapping;
+    size_t mapping_length;
+
+    uint64_t fingerprint;
+
+    /**
+     * Sets up the grid and the pair split for model
+     * */
+    void init(const ArmModel &model, size_t num_cells);
+
+    void unmap();
+
+public:
+
+    CollisionMap();
+
+    ~CollisionMap();
+
+    CollisionMap(const CollisionMap &) = delete;
+    CollisionMap &operator=(const CollisionMap &) = delete;
+
+    /**
+     * Fills in every cell for robot's geometry. Each cell is checked at its
+     * center, and the mapped pairs' gaps there are compared with how far the
+     * link reaches let them change anywhere else in the cell.
+     * @param robot set to the center of each cell in turn
+     * */
+    void generate(ArmState &robot, size_t num_cells = COLLISION_MAP_CELLS);
+
+    /**
+     * Writes a generated map to filepath
+     * @return true if the file was written
+     * */
+    bool save(const std::string &filepath) const;
+
+    /**
+     * Memory-maps a map written by save() for model's geometry
+     * @return false if the file can't be read or is for a different geometry
+     * */
+    bool load(const std::string &filepath, const ArmModel &model);
+
+    bool empty() const;
+
+    /**
+     * @param angles angles of all the joints, only the mapped ones are used
+     * @return the cell angles falls in, with COLLISION_MAP_COLLIDING set if
+     * the arm certainly collides, and otherwise bit i set if mapped pair i
+     * may collide. Outside the limits of a mapped joint every pair is marked
+     * */
+    uint32_t lookup(const std::array<double, NUM_JOINTS> &angles) const;
+
+    /**
+     * @return the collision pairs cells don't cover, which are checked even in free cells
+     * */
+    const std::vector< std::array<size_t, 2> > &get_unmapped_pairs() const;
+
+    const std::vector< std::array<size_t, 2> > &get_mapped_pairs() const;
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "environment_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+    // squared distance of a cell no point is in, before the distance transform
+    constexpr double FAR_SQUARED = 1e20;
+
+    double segment_point_distance(const Vector3d &a, const Vector3d &b, const Vector3d &point) {
+        Vector3d ab = b - a;
+        double length_squared = ab.squaredNorm();
+        double t = 0;
+        if (length_squared > 0) {
+            t = std::min(std::max((point - a).dot(ab) / length_squared, 0.0), 1.0);
+        }
+        return (a + t * ab - point).norm();
+    }
+
+    /**
+     * One dimension of the squared euclidean distance transform of Felzenszwalb
+     * and Huttenlocher: out[q] = min over p of (q - p)^2 + in[p]
+     * */
+    void distance_transform(const std::vector<double> &in, std::vector<double> &out,
+                            std::vector<size_t> &parabolas, std::vector<double> &bounds) {
+        size_t n = in.size();
+        parabolas.resize(n);
+        bounds.resize(n + 1);
+
+        // the lower envelope of the parabolas rooted at each cell, which
+        // parabolas[k] is lowest in from bounds[k] to bounds[k + 1]
+        size_t k = 0;
+        parabolas[0] = 0;
+        bounds[0] = -std::numeric_limits<double>::infinity();
+        bounds[1] = std::numeric_limits<double>::infinity();
+        for (size_t q = 1; q < n; ++q) {
+            auto intersection = [&in, &parabolas, q](size_t j) {
+                double p = parabolas[j];
+                return ((in[q] + q * q) - (in[parabolas[j]] + p * p)) / (2 * (q - p));
+            };
+
+            double s = intersection(k);
+            while (s <= bounds[k]) {
+                --k;
+                s = intersection(k);
+            }
+            ++k;
+            parabolas[k] = q;
+            bounds[k] = s;
+            bounds[k + 1] = std::numeric_limits<double>::infinity();
+        }
+
+        out.resize(n);
+        k = 0;
+        for (size_t q = 0; q < n; ++q) {
+            while (bounds[k + 1] < q) {
+                ++k;
+            }
+            double dist = static_cast<double>(q) - static_cast<double>(parabolas[k]);
+            out[q] = dist * dist + in[parabolas[k]];
+        }
+    }
+
+}
+
+EnvironmentMap::EnvironmentMap(const std::vector<Vector3d> &points_in) :
+    points(points_in), field_resolution(ENVIRONMENT_FIELD_RESOLUTION), field_cells({{ 0, 0, 0 }})
+{
+    if (points.empty()) {
+        return;
+    }
+
+    points_lower = points[0];
+    points_upper = points[0];
+    for (const Vector3d &point : points) {
+        points_lower = points_lower.cwiseMin(point);
+        points_upper = points_upper.cwiseMax(point);
+    }
+
+    Node root;
+    root.center = (points_lower + points_upper) / 2;
+    root.half_size = (points_upper - points_lower).maxCoeff() / 2;
+    root.begin = 0;
+    root.end = points.size();
+    root.children = 0;
+    root.num_children = 0;
+    nodes.push_back(root);
+    build_node(0, 0);
+
+    build_field();
+}
+
+void EnvironmentMap::build_node(uint32_t node_index, int depth) {
+    // copied, since adding the children can move nodes
+    Node node = nodes[node_index];
+    if (node.end - node.begin <= ENVIRONMENT_OCTREE_LEAF_SIZE || depth >= ENVIRONMENT_OCTREE_MAX_DEPTH) {
+        return;
+    }
+
+    auto octant = [&node](const Vector3d &point) {
+        return (point(0) > node.center(0) ? 4 : 0) + (point(1) > node.center(1) ? 2 : 0) +
+               (point(2) > node.center(2) ? 1 : 0);
+    };
+    std::sort(points.begin() + node.begin, points.begin() + node.end,
+              [&octant](const Vector3d &p1, const Vector3d &p2) { return octant(p1) < octant(p2); });
+
+    // only the octants with points get a child
+    uint32_t children = nodes.size();
+    uint32_t begin = node.begin;
+    while (begin < node.end) {
+        int child_octant = octant(points[begin]);
+        uint32_t end = begin;
+        while (end < node.end && octant(points[end]) == child_octant) {
+            ++end;
+        }
+
+        Node child;
+        child.half_size = node.half_size / 2;
+        for (int i = 0; i < 3; ++i) {
+            bool upper = child_octant & (4 >> i);
+            child.center(i) = node.center(i) + (upper ? child.half_size : -child.half_size);
+        }
+        child.begin = begin;
+        child.end = end;
+        child.children = 0;
+        child.num_children = 0;
+        nodes.push_back(child);
+
+        begin = end;
+    }
+
+    nodes[node_index].children = children;
+    nodes[node_index].num_children = nodes.size() - children;
+    for (uint32_t i = children; i < children + nodes[node_index].num_children; ++i) {
+        build_node(i, depth + 1);
+    }
+}
+
+void EnvironmentMap::build_field() {
+    // One cell of margin around the points, so the field reaches a little past them
+    Vector3d extent = points_upper - points_lower;
+    field_resolution = std::max(ENVIRONMENT_FIELD_RESOLUTION, extent.maxCoeff() / (ENVIRONMENT_FIELD_MAX_CELLS - 3));
+    field_lower = points_lower - Vector3d::Constant(field_resolution);
+    for (int i = 0; i < 3; ++i) {
+        field_cells[i] = static_cast<size_t>(std::floor(extent(i) / field_resolution)) + 3;
+    }
+
+    std::vector<double> squared(field_cells[0] * field_cells[1] * field_cells[2], FAR_SQUARED);
+    for (const Vector3d &point : points) {
+        size_t index = 0;
+        for (int i = 0; i < 3; ++i) {
+            size_t cell = static_cast<size_t>((point(i) - field_lower(i)) / field_resolution);
+            index = index * field_cells[i] + std::min(cell, field_cells[i] - 1);
+        }
+        squared[index] = 0;
+    }
+
+    // The transform separates into one pass along each axis
+    std::vector<double> in;
+    std::vector<double> out;
+    std::vector<size_t> parabolas;
+    std::vector<double> bounds;
+    std::array<size_t, 3> stride = {{ field_cells[1] * field_cells[2], field_cells[2], 1 }};
+    for (int axis = 0; axis < 3; ++axis) {
+        int axis_1 = (axis + 1) % 3;
+        int axis_2 = (axis + 2) % 3;
+        in.resize(field_cells[axis]);
+
+        for (size_t i = 0; i < field_cells[axis_1]; ++i) {
+            for (size_t j = 0; j < field_cells[axis_2]; ++j) {
+                size_t start = i * stride[axis_1] + j * stride[axis_2];
+                for (size_t k = 0; k < field_cells[axis]; ++k) {
+                    in[k] = squared[start + k * stride[axis]];
+                }
+                distance_transform(in, out, parabolas, bounds);
+                for (size_t k = 0; k < field_cells[axis]; ++k) {
+                    squared[start + k * stride[axis]] = out[k];
+                }
+            }
+        }
+    }
+
+    // The distance is between cell centers. A point and whatever is looked up
+    // can each be half a cell diagonal away from theirs
+    field.resize(squared.size());
+    for (size_t i = 0; i < squared.size(); ++i) {
+        field[i] = static_cast<float>((std::sqrt(squared[i]) - std::sqrt(3.0)) * field_resolution);
+    }
+}
+
+double EnvironmentMap::field_distance(const Vector3d &point) const {
+    size_t index = 0;
+    for (int i = 0; i < 3; ++i) {
+        double cell = std::floor((point(i) - field_lower(i)) / field_resolution);
+        if (!(cell >= 0 && cell < field_cells[i])) {
+            // all the points are in their bounding box
+            Vector3d clamped = point.cwiseMax(points_lower).cwiseMin(points_upper);
+            return (point - clamped).norm();
+        }
+        index = index * field_cells[i] + static_cast<size_t>(cell);
+    }
+    return field[index];
+}
+
+double EnvironmentMap::segment_distance(const Vector3d &a, const Vector3d &b, double limit) const {
+    static thread_local std::vector<uint32_t> stack;
+    stack.clear();
+    stack.push_back(0);
+
+    double best = limit;
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+
+        // nothing in the node is closer than its bounding sphere
+        if (segment_point_distance(a, b, node.center) - node.half_size * std::sqrt(3.0) >= best) {
+            continue;
+        }
+
+        if (node.num_children == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                best = std::min(best, segment_point_distance(a, b, points[i]));
+            }
+        }
+        else {
+            for (uint32_t i = node.children; i < node.children + node.num_children; ++i) {
+                stack.push_back(i);
+            }
+        }
+    }
+    return best;
+}
+
+size_t EnvironmentMap::size() const {
+    return points.size();
+}
+
+double EnvironmentMap::capsule_gap(const Vector3d &a, const Vector3d &b, double radius, double min_gap) const {
+    if (points.empty()) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    // Look up points along the segment at most a field cell apart. Every
+    // point of the segment is within half of that spacing of one of them
+    double length = (b - a).norm();
+    size_t num_samples = static_cast<size_t>(std::ceil(length / field_resolution)) + 1;
+    double spacing = num_samples > 1 ? length / (num_samples - 1) : 0;
+
+    double bound = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < num_samples; ++i) {
+        double t = num_samples > 1 ? static_cast<double>(i) / (num_samples - 1) : 0;
+        bound = std::min(bound, field_distance(a + t * (b - a)));
+    }
+
+    double gap_bound = bound - spacing / 2 - radius;
+    if (gap_bound >= min_gap) {
+        return gap_bound;
+    }
+
+    // Close enough that the field can't tell, so check the points near the capsule
+    return segment_distance(a, b, radius + min_gap) - radius;
+}
@@ -0,0 +1,97 @@
+#ifndef ENVIRONMENT_MAP_H
+#define ENVIRONMENT_MAP_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+using namespace Eigen;
+
+// Side of the distance field's cells, made larger if the points spread further than
+// ENVIRONMENT_FIELD_MAX_CELLS of these on any axis
+static constexpr double ENVIRONMENT_FIELD_RESOLUTION = 0.05;
+static constexpr size_t ENVIRONMENT_FIELD_MAX_CELLS = 64;
+
+// Most points in an octree leaf, unless it is ENVIRONMENT_OCTREE_MAX_DEPTH deep
+static constexpr size_t ENVIRONMENT_OCTREE_LEAF_SIZE = 8;
+static constexpr int ENVIRONMENT_OCTREE_MAX_DEPTH = 12;
+
+/**
+ * Occupied points around the arm, such as the ground and rocks perception
+ * sees, for checking the arm's capsules against.
+ *
+ * Checks first look the capsule up in a coarse distance field over the
+ * points, which gives a lower bound on how far away the nearest point is.
+ * Capsules the bound can't clear are checked exactly against the points
+ * near them, found with an octree.
+ * */
+class EnvironmentMap {
+private:
+
+    struct Node {
+        Vector3d center;
+        double half_size;
+
+        // the node's points are points[begin, end)
+        uint32_t begin;
+        uint32_t end;
+
+        // index of the first of the children, which are stored together, or 0 for a leaf
+        uint32_t children;
+        uint32_t num_children;
+    };
+
+    std::vector<Vector3d> points;
+    std::vector<Node> nodes;
+
+    // the bounding box of the points
+    Vector3d points_lower;
+    Vector3d points_upper;
+
+    // the distance field, x changing slowest. Each cell holds a lower bound
+    // on the distance from anywhere in it to the nearest point
+    Vector3d field_lower;
+    double field_resolution;
+    std::array<size_t, 3> field_cells;
+    std::vector<float> field;
+
+    /**
+     * Splits node into octants until it is small enough
+     * */
+    void build_node(uint32_t node_index, int depth);
+
+    void build_field();
+
+    /**
+     * @return a lower bound on the distance from point to the nearest point of the map
+     * */
+    double field_distance(const Vector3d &point) const;
+
+    /**
+     * @return the distance from the segment from a to b to the nearest point,
+     * or limit if every point is further than that
+     * */
+    double segment_distance(const Vector3d &a, const Vector3d &b, double limit) const;
+
+public:
+
+    /**
+     * Builds the octree and distance field over points, in the arm's base frame
+     * */
+    EnvironmentMap(const std::vector<Vector3d> &points_in);
+
+    size_t size() const;
+
+    /**
+     * @param a one end of the capsule's segment
+     * @param b other end
+     * @return the distance from the capsule's surface to the nearest point,
+     * negative if a point is inside the capsule, or at least min_gap if every
+     * point is further than that, without finding how far
+     * */
+    double capsule_gap(const Vector3d &a, const Vector3d &b, double radius, double min_gap) const;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "joint_estimator.hpp"
+
+#include <algorithm>
+
+JointEstimator::JointEstimator() {
+    reset();
+}
+
+void JointEstimator::reset() {
+    newest = 0;
+    num_readings = 0;
+    initialized = false;
+    time = 0;
+    position = 0;
+    velocity = 0;
+}
+
+void JointEstimator::update(double reading_time, double angle, bool trusted) {
+    newest = (newest + 1) % JOINT_ESTIMATOR_HISTORY;
+    history[newest] = { reading_time, angle };
+    num_readings = std::min(num_readings + 1, JOINT_ESTIMATOR_HISTORY);
+
+    if (!trusted) {
+        return;
+    }
+
+    double dt = reading_time - time;
+    if (!initialized || dt > JOINT_ESTIMATOR_MAX_GAP) {
+        initialized = true;
+        time = reading_time;
+        position = angle;
+        velocity = 0;
+        return;
+    }
+
+    // readings at the same time only say where the joint is
+    if (dt <= 0) {
+        position += JOINT_ESTIMATOR_ALPHA * (angle - position);
+        return;
+    }
+
+    double predicted = position + velocity * dt;
+    double residual = angle - predicted;
+    position = predicted + JOINT_ESTIMATOR_ALPHA * residual;
+    velocity += JOINT_ESTIMATOR_BETA * residual / dt;
+    time = reading_time;
+}
+
+size_t JointEstimator::size() const {
+    return num_readings;
+}
+
+double JointEstimator::get_reading(size_t age) const {
+    return history[(newest + JOINT_ESTIMATOR_HISTORY - age) % JOINT_ESTIMATOR_HISTORY].angle;
+}
+
+bool JointEstimator::is_fresh(double now) const {
+    return initialized && now - time <= JOINT_ESTIMATOR_MAX_GAP;
+}
+
+double JointEstimator::get_position(double now) const {
+    return position + velocity * std::min(std::max(now - time, 0.0), JOINT_ESTIMATOR_MAX_GAP);
+}
+
+double JointEstimator::get_velocity() const {
+    return velocity;
+}
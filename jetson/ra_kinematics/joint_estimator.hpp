@@ -0,0 +1,90 @@
+#ifndef JOINT_ESTIMATOR_H
+#define JOINT_ESTIMATOR_H
+
+#include <array>
+#include <cstddef>
+
+// Readings of one joint kept for checking new ones against
+static constexpr size_t JOINT_ESTIMATOR_HISTORY = 8;
+
+// Gains of the alpha-beta filter: the fraction of the difference between a
+// reading and the prediction taken into the position, and into the velocity
+// per second between readings
+static constexpr double JOINT_ESTIMATOR_ALPHA = 0.5;
+static constexpr double JOINT_ESTIMATOR_BETA = 0.2;
+
+// in s, readings further apart than this start the estimate over, since the
+// velocity from before says nothing about the joint now
+static constexpr double JOINT_ESTIMATOR_MAX_GAP = 0.5;
+
+/**
+ * Estimates the position and velocity of one joint from timestamped encoder
+ * readings with an alpha-beta filter, which predicts each reading from the
+ * last estimate and corrects both by how far off the prediction was.
+ *
+ * The last JOINT_ESTIMATOR_HISTORY readings are kept in a ring, including
+ * untrusted ones, so readings can still be compared with the ones before.
+ * */
+class JointEstimator {
+private:
+
+    struct Reading {
+        double time;
+        double angle;
+    };
+
+    std::array<Reading, JOINT_ESTIMATOR_HISTORY> history;
+
+    // where the newest reading is in history, and how many there are
+    size_t newest;
+    size_t num_readings;
+
+    // estimate as of time, which is the time of the newest trusted reading
+    bool initialized;
+    double time;
+    double position;
+    double velocity;
+
+public:
+
+    JointEstimator();
+
+    void reset();
+
+    /**
+     * Adds a reading
+     * @param reading_time in s, increasing between calls
+     * @param trusted false to keep the reading in the history without
+     * filtering it, like a reading that jumped too far to be real
+     * */
+    void update(double reading_time, double angle, bool trusted = true);
+
+    /**
+     * @return how many readings are in the history, at most JOINT_ESTIMATOR_HISTORY
+     * */
+    size_t size() const;
+
+    /**
+     * @param age 0 for the newest reading, 1 for the one before it and so on
+     * @return the angle read
+     * */
+    double get_reading(size_t age) const;
+
+    /**
+     * @return false before the first trusted reading, or once the last one
+     * is older than JOINT_ESTIMATOR_MAX_GAP at now
+     * */
+    bool is_fresh(double now) const;
+
+    /**
+     * @return the filtered position, predicted forward to now at the estimated velocity
+     * */
+    double get_position(double now) const;
+
+    /**
+     * @return the filtered velocity in radians/s, 0 before the second trusted reading
+     * */
+    double get_velocity() const;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "joint_sampler.hpp"
+
+#include <cmath>
+
+namespace {
+
+    // a different prime base for each joint keeps the dimensions of the sequence independent
+    const unsigned HALTON_BASES[6] = { 2, 3, 5, 7, 11, 13 };
+
+    /**
+     * @return index with its digits in base mirrored around the decimal point, in [0, 1)
+     * */
+    double radical_inverse(unsigned long index, unsigned base) {
+        double result = 0;
+        double digit_scale = 1.0 / base;
+
+        while (index > 0) {
+            result += (index % base) * digit_scale;
+            index /= base;
+            digit_scale /= base;
+        }
+
+        return result;
+    }
+
+}
+
+JointSampler::JointSampler() :
+    mode(SamplingMode::UNIFORM), halton_index(HALTON_SKIP), halton_offset(Vector6d::Zero()) { }
+
+void JointSampler::seed(std::default_random_engine::result_type seed, unsigned long index) {
+    // the shift comes from seed alone, so samplers that only differ in index share one sequence
+    eng.seed(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (size_t i = 0; i < 6; ++i) {
+        halton_offset(i) = unit(eng);
+    }
+    halton_index = HALTON_SKIP + index;
+
+    eng.seed(seed + index);
+}
+
+void JointSampler::set_mode(SamplingMode mode_in) {
+    mode = mode_in;
+}
+
+SamplingMode JointSampler::get_mode() const {
+    return mode;
+}
+
+Vector6d JointSampler::sample(const ArmState &robot, const Vector6d &current) {
+    Vector6d angles;
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    for (size_t i = 0; i < 6; ++i) {
+        double fraction;
+        if (mode == SamplingMode::HALTON) {
+            double shifted = radical_inverse(halton_index, HALTON_BASES[i]) + halton_offset(i);
+            fraction = shifted - std::floor(shifted);
+        }
+        else {
+            fraction = unit(eng);
+        }
+
+        // locked joints stay put, but still use up their draw so the others
+        // don't change with which joints are locked
+        const std::array<double, 2> &limits = robot.get_joint_limits(i);
+        angles(i) = robot.get_joint_locked(i) ? current(i) : limits[0] + fraction * (limits[1] - limits[0]);
+    }
+
+    ++halton_index;
+    return angles;
+}
@@ -0,0 +1,65 @@
+#ifndef JOINT_SAMPLER_H
+#define JOINT_SAMPLER_H
+
+#include <random>
+
+#include <eigen3/Eigen/Dense>
+
+#include "arm_state.hpp"
+
+using namespace Eigen;
+
+typedef Matrix<double, 6, 1> Vector6d;
+
+// Halton sequence points skipped after seeding, the first few are highly
+// correlated between dimensions
+static constexpr unsigned long HALTON_SKIP = 20;
+
+enum class SamplingMode {
+    UNIFORM,    // independent uniform angles
+    HALTON      // a randomly shifted Halton sequence, which covers the joint space more evenly
+};
+
+/**
+ * Draws joint angles within the joint limits of an arm, leaving locked
+ * joints where they are. Shared by the RRT planner and the random restarts
+ * of IK, so neither wastes samples that limit_check() would reject.
+ * */
+class JointSampler {
+private:
+
+    SamplingMode mode;
+
+    std::default_random_engine eng;
+
+    // position in the Halton sequence of the next sample
+    unsigned long halton_index;
+
+    // shift of each dimension of the Halton sequence, so samplers seeded
+    // differently don't draw the same points
+    Vector6d halton_offset;
+
+public:
+
+    JointSampler();
+
+    /**
+     * Restarts the sampler
+     * @param index how many samples of the sequence for seed to skip, so
+     * several samplers seeded the same way can each take a different part of
+     * one Halton sequence. Uniform samplers are seeded with seed + index
+     * */
+    void seed(std::default_random_engine::result_type seed, unsigned long index = 0);
+
+    void set_mode(SamplingMode mode_in);
+
+    SamplingMode get_mode() const;
+
+    /**
+     * @param current angles kept for the joints of robot that are locked
+     * @return angles between the joint limits of robot
+     * */
+    Vector6d sample(const ArmState &robot, const Vector6d &current);
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "joint_spline.hpp"
+
+#include <algorithm>
+
+JointSpline::JointSpline() : step(1.0) { }
+
+void JointSpline::fit(const std::vector<Vector6d> &points) {
+    segments.clear();
+    if (points.empty()) {
+        return;
+    }
+
+    // a single point stays put for the whole spline
+    if (points.size() == 1) {
+        step = 1.0;
+        segments.push_back({ points[0], Vector6d::Zero(), Vector6d::Zero(), Vector6d::Zero() });
+        return;
+    }
+
+    size_t n = points.size() - 1;
+    step = 1.0 / n;
+
+    // The second derivatives m at the knots satisfy
+    // m[i - 1] + 4 m[i] + m[i + 1] = 6 (p[i - 1] - 2 p[i] + p[i + 1]) / step^2,
+    // with m zero at both ends. Solve the tridiagonal system by forward
+    // elimination and back substitution.
+    curvatures.assign(n + 1, Vector6d::Zero());
+    scales.assign(n + 1, 0.0);
+
+    double rhs_scale = 6.0 / (step * step);
+    for (size_t i = 1; i < n; ++i) {
+        double pivot = 4.0 - scales[i - 1];
+        scales[i] = 1.0 / pivot;
+        curvatures[i] = (rhs_scale * (points[i - 1] - 2.0 * points[i] + points[i + 1]) - curvatures[i - 1]) / pivot;
+    }
+    for (size_t i = n - 1; i > 0; --i) {
+        curvatures[i] -= scales[i] * curvatures[i + 1];
+    }
+
+    segments.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        Segment &segment = segments[i];
+        segment.a = points[i];
+        segment.b = (points[i + 1] - points[i]) / step - step * (2.0 * curvatures[i] + curvatures[i + 1]) / 6.0;
+        segment.c = curvatures[i] / 2.0;
+        segment.d = (curvatures[i + 1] - curvatures[i]) / (6.0 * step);
+    }
+}
+
+void JointSpline::clear() {
+    segments.clear();
+}
+
+bool JointSpline::empty() const {
+    return segments.empty();
+}
+
+size_t JointSpline::locate(double &spline_t) const {
+    spline_t = std::min(std::max(spline_t, 0.0), 1.0);
+
+    size_t index = std::min(static_cast<size_t>(spline_t / step), segments.size() - 1);
+    spline_t -= index * step;
+
+    return index;
+}
+
+void JointSpline::get_pos(double spline_t, Vector6d &angles) const {
+    const Segment &segment = segments[locate(spline_t)];
+    angles = segment.a + spline_t * (segment.b + spline_t * (segment.c + spline_t * segment.d));
+}
+
+void JointSpline::get_deriv(double spline_t, int order, Vector6d &derivs) const {
+    const Segment &segment = segments[locate(spline_t)];
+    if (order == 1) {
+        derivs = segment.b + spline_t * (2.0 * segment.c + 3.0 * spline_t * segment.d);
+    }
+    else {
+        derivs = 2.0 * segment.c + 6.0 * spline_t * segment.d;
+    }
+}
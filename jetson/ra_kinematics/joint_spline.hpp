@@ -0,0 +1,78 @@
+#ifndef JOINT_SPLINE_H
+#define JOINT_SPLINE_H
+
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+using namespace Eigen;
+
+typedef Matrix<double, 6, 1> Vector6d;
+
+/**
+ * A natural cubic spline through joint configurations spaced evenly over
+ * spline_t from 0 to 1, the same curve as fitting a tk::spline to each joint.
+ *
+ * All six joints share their knots, so they are fit together with one pass
+ * of the Thomas algorithm over the tridiagonal system, rather than six
+ * tk::splines each solving a general band matrix. The coefficients of each
+ * segment are kept together and every joint is evaluated at once. Since the
+ * knots are evenly spaced, a segment is found by dividing instead of searching.
+ * */
+class JointSpline {
+private:
+
+    /**
+     * Angles at a distance h past the start of the segment are a + b*h + c*h^2 + d*h^3
+     * */
+    struct Segment {
+        Vector6d a;
+        Vector6d b;
+        Vector6d c;
+        Vector6d d;
+    };
+
+    std::vector<Segment> segments;
+
+    // spline_t covered by each segment
+    double step;
+
+    // scratch space for fit(), kept so refitting a spline of the same size
+    // or smaller, like while fit_path() refines a path, doesn't allocate
+    std::vector<Vector6d> curvatures;
+    std::vector<double> scales;
+
+    /**
+     * @return the index of the segment spline_t falls in, with spline_t
+     * changed to the distance past its start
+     * */
+    size_t locate(double &spline_t) const;
+
+public:
+
+    JointSpline();
+
+    /**
+     * Fits the spline through points, placing points[i] at spline_t i / (points.size() - 1)
+     * */
+    void fit(const std::vector<Vector6d> &points);
+
+    void clear();
+
+    bool empty() const;
+
+    /**
+     * The spline must not be empty
+     * @param spline_t a time between 0 and 1, times outside it are clamped to it
+     * @param angles set to the angles of each joint at spline_t
+     * */
+    void get_pos(double spline_t, Vector6d &angles) const;
+
+    /**
+     * @param order 1 or 2
+     * @param derivs set to the order-th derivative of each joint's angle at spline_t
+     * */
+    void get_deriv(double spline_t, int order, Vector6d &derivs) const;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include "kd_tree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void KDTree::clear() {
+    nodes.clear();
+    points.clear();
+    ids.clear();
+}
+
+size_t KDTree::size() const {
+    return points.size();
+}
+
+void KDTree::insert(const Vector6d &point, size_t id) {
+    if (nodes.empty()) {
+        nodes.emplace_back();
+    }
+
+    // walk down to the leaf point belongs in
+    int node_index = 0;
+    while (nodes[node_index].axis != -1) {
+        const Node &node = nodes[node_index];
+        node_index = node.children[point(node.axis) < node.split ? 0 : 1];
+    }
+
+    int point_index = static_cast<int>(points.size());
+    points.push_back(point);
+    ids.push_back(id);
+
+    // a copy of a point in the tree would never be nearer than the
+    // original, so it doesn't need a place in a leaf
+    for (int i = 0; i < nodes[node_index].count; ++i) {
+        if (points[nodes[node_index].bucket[i]] == point) {
+            return;
+        }
+    }
+
+    if (nodes[node_index].count == KD_TREE_BUCKET_SIZE) {
+        split_leaf(node_index, point);
+        const Node &node = nodes[node_index];
+        node_index = node.children[point(node.axis) < node.split ? 0 : 1];
+    }
+
+    Node &leaf = nodes[node_index];
+    leaf.bucket[leaf.count++] = point_index;
+}
+
+void KDTree::split_leaf(int node_index, const Vector6d &point) {
+    const std::array<int, KD_TREE_BUCKET_SIZE> bucket = nodes[node_index].bucket;
+
+    // split along the joint the points are most spread out on
+    Vector6d low = point;
+    Vector6d high = point;
+    for (int point_index : bucket) {
+        low = low.cwiseMin(points[point_index]);
+        high = high.cwiseMax(points[point_index]);
+    }
+
+    int axis;
+    (high - low).maxCoeff(&axis);
+
+    std::array<double, KD_TREE_BUCKET_SIZE + 1> values;
+    for (int i = 0; i < KD_TREE_BUCKET_SIZE; ++i) {
+        values[i] = points[bucket[i]](axis);
+    }
+    values[KD_TREE_BUCKET_SIZE] = point(axis);
+    std::sort(values.begin(), values.end());
+
+    // split at the value closest to the median that has a smaller value
+    // before it, so neither side gets every point
+    int split_index = 0;
+    for (int i = 1; i < static_cast<int>(values.size()); ++i) {
+        if (values[i] > values[i - 1]
+            && (split_index == 0 || std::abs(2 * i - KD_TREE_BUCKET_SIZE) < std::abs(2 * split_index - KD_TREE_BUCKET_SIZE))) {
+            split_index = i;
+        }
+    }
+
+    int below = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+
+    Node &node = nodes[node_index];
+    node.axis = axis;
+    node.split = values[split_index];
+    node.children = {{below, below + 1}};
+    node.count = 0;
+
+    for (int point_index : bucket) {
+        Node &child = nodes[node.children[points[point_index](axis) < node.split ? 0 : 1]];
+        child.bucket[child.count++] = point_index;
+    }
+}
+
+size_t KDTree::nearest(const Vector6d &target) const {
+    Vector6d offsets = Vector6d::Zero();
+    int best_point = -1;
+    double best_dist_squared = std::numeric_limits<double>::max();
+    nearest_helper(0, target, offsets, 0, best_point, best_dist_squared);
+    return ids[best_point];
+}
+
+void KDTree::nearest_helper(int node_index, const Vector6d &target, Vector6d &offsets,
+                            double region_dist_squared, int &best_point, double &best_dist_squared) const {
+    const Node &node = nodes[node_index];
+
+    if (node.axis == -1) {
+        for (int i = 0; i < node.count; ++i) {
+            double dist_squared = (points[node.bucket[i]] - target).squaredNorm();
+            if (dist_squared < best_dist_squared) {
+                best_dist_squared = dist_squared;
+                best_point = node.bucket[i];
+            }
+        }
+        return;
+    }
+
+    // search the side target is on first, then the other side only if its
+    // region is closer than the best point so far
+    double split_dist = target(node.axis) - node.split;
+    int near_side = split_dist < 0 ? 0 : 1;
+
+    nearest_helper(node.children[near_side], target, offsets, region_dist_squared, best_point, best_dist_squared);
+
+    double old_offset = offsets(node.axis);
+    double far_dist_squared = region_dist_squared - old_offset * old_offset + split_dist * split_dist;
+    if (far_dist_squared < best_dist_squared) {
+        offsets(node.axis) = split_dist;
+        nearest_helper(node.children[1 - near_side], target, offsets, far_dist_squared, best_point, best_dist_squared);
+        offsets(node.axis) = old_offset;
+    }
+}
+
+void KDTree::within(const Vector6d &target, double radius, std::vector<size_t> &found) const {
+    found.clear();
+    if (nodes.empty()) {
+        return;
+    }
+
+    Vector6d offsets = Vector6d::Zero();
+    within_helper(0, target, offsets, 0, radius * radius, found);
+}
+
+void KDTree::within_helper(int node_index, const Vector6d &target, Vector6d &offsets, double region_dist_squared,
+                           double radius_squared, std::vector<size_t> &found) const {
+    const Node &node = nodes[node_index];
+
+    if (node.axis == -1) {
+        for (int i = 0; i < node.count; ++i) {
+            if ((points[node.bucket[i]] - target).squaredNorm() < radius_squared) {
+                found.push_back(ids[node.bucket[i]]);
+            }
+        }
+        return;
+    }
+
+    double split_dist = target(node.axis) - node.split;
+    int near_side = split_dist < 0 ? 0 : 1;
+
+    within_helper(node.children[near_side], target, offsets, region_dist_squared, radius_squared, found);
+
+    double old_offset = offsets(node.axis);
+    double far_dist_squared = region_dist_squared - old_offset * old_offset + split_dist * split_dist;
+    if (far_dist_squared < radius_squared) {
+        offsets(node.axis) = split_dist;
+        within_helper(node.children[1 - near_side], target, offsets, far_dist_squared, radius_squared, found);
+        offsets(node.axis) = old_offset;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include <array>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "arm_state.hpp"
+
+using namespace Eigen;
+
+// Points a leaf of KDTree holds before it splits
+static constexpr int KD_TREE_BUCKET_SIZE = 8;
+
+/**
+ * A KD-tree of joint configurations for nearest neighbor lookups, built
+ * by inserting one point at a time. Points are kept in leaf buckets, and
+ * a full leaf splits at the median of the joint its points are most
+ * spread along, so the tree stays balanced without rebuilding and locked
+ * joints are never split on.
+ *
+ * Distances are the plain euclidean distance between angles, the same
+ * metric MotionPlanner::steer() moves along. Continuous joints are not
+ * wrapped around, since the planner never crosses from one end of a
+ * joint's limits to the other.
+ * */
+class KDTree {
+private:
+
+    /**
+     * A leaf if axis is -1, otherwise a split into the points below split on
+     * axis and the rest
+     * */
+    struct Node {
+        Node() : axis(-1), split(0), children{{-1, -1}}, count(0) { }
+
+        int axis;
+        double split;
+        std::array<int, 2> children;
+
+        // indices in points of a leaf's points
+        std::array<int, KD_TREE_BUCKET_SIZE> bucket;
+        int count;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Vector6d> points;
+    std::vector<size_t> ids;
+
+    /**
+     * Splits a full leaf so both halves have room, counting the point about
+     * to be added, which must differ from at least one point in the leaf
+     * */
+    void split_leaf(int node_index, const Vector6d &point);
+
+    /**
+     * @param offsets distance from target to the region of node_index along each
+     * joint, with region_dist_squared their squared sum
+     * */
+    void nearest_helper(int node_index, const Vector6d &target, Vector6d &offsets,
+                        double region_dist_squared, int &best_point, double &best_dist_squared) const;
+
+    void within_helper(int node_index, const Vector6d &target, Vector6d &offsets, double region_dist_squared,
+                       double radius_squared, std::vector<size_t> &found) const;
+
+public:
+
+    void clear();
+
+    size_t size() const;
+
+    /**
+     * Adds point to the tree, to be found by its id
+     * */
+    void insert(const Vector6d &point, size_t id);
+
+    /**
+     * @return id of the point closest to target, the tree must not be empty
+     * */
+    size_t nearest(const Vector6d &target) const;
+
+    /**
+     * Replaces found with the ids of every point closer to target than radius.
+     * A point inserted again at the same place is only found by its first id
+     * */
+    void within(const Vector6d &target, double radius, std::vector<size_t> &found) const;
+};
+
+#endif
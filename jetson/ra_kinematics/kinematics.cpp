@@ -1,4 +1,5 @@
 #include "kinematics.hpp"
+#include "thor.hpp"
 #include "utils.hpp"
 #include "arm_state.hpp"
 #include <cmath>
@@ -6,76 +7,175 @@
 #include <iostream>
 #include <vector>
 #include <iomanip>
-
-typedef Eigen::Matrix<double, -1, -1> MatrixXd;
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 using namespace Eigen;
 
+// Every matrix in the solver is sized for the 6 joints at compile time, so
+// solving allocates nothing and Eigen can unroll the small products
+typedef Matrix<double, 6, 6> Matrix6d;
+
+// Locked joints get no column in the jacobians IK and servoing solve with,
+// so locking joints makes the systems smaller instead of only zeroing them.
+// The sizes are at most 6, so these don't allocate either
+typedef Matrix<double, 6, Dynamic, 0, 6, 6> ReducedJacobian;
+typedef Matrix<double, Dynamic, 6, 0, 6, 6> ReducedInverse;
+typedef Matrix<double, Dynamic, Dynamic, 0, 6, 6> ReducedSquare;
+typedef Matrix<double, Dynamic, 1, 0, 6, 1> ReducedVector;
+
+namespace {
+
+    /**
+     * Sets the first entries of joints to the indices of robot_state's unlocked joints, in order
+     * @return how many joints are unlocked
+     * */
+    int unlocked_joints(const ArmState &robot_state, std::array<int, 6> &joints) {
+        int num_unlocked = 0;
+        for (int i = 0; i < 6; ++i) {
+            if (!robot_state.get_joint_locked(i)) {
+                joints[num_unlocked++] = i;
+            }
+        }
+        return num_unlocked;
+    }
 
-void KinematicsSolver::FK(ArmState &robot_state) {
-    Matrix4d global_transf = Matrix4d::Identity();
+    /**
+     * @return the columns of jacobian of the first num_unlocked joints
+     * */
+    ReducedJacobian reduce_jacobian(const Matrix6d &jacobian, const std::array<int, 6> &joints, int num_unlocked) {
+        ReducedJacobian reduced(6, num_unlocked);
+        for (int k = 0; k < num_unlocked; ++k) {
+            reduced.col(k) = jacobian.col(joints[k]);
+        }
+        return reduced;
+    }
 
-    // TODO: Edit name of base ("chassis-a") as necessary:
-    robot_state.set_link_transform(0, Matrix4d::Identity());
-    for (size_t i = 0; i < 6; ++i) {
-        Matrix4d rot_theta = get_joint_xform(robot_state, i, robot_state.get_joint_angle(i));
+    /**
+     * Damped least squares over the unlocked joints only. (J^T J + damping^2 I)^-1 J^T error
+     * is the same step as J^T (J J^T + damping^2 I)^-1 error, but solves a system
+     * with one row per unlocked joint instead of one per row of error
+     * @return the step of every joint, 0 for the locked ones
+     * */
+    Vector6d damped_step(const ReducedJacobian &jacobian, const std::array<int, 6> &joints, int num_unlocked,
+                         const Vector6d &error, double damping) {
+        ReducedSquare damped = jacobian.transpose() * jacobian;
+        damped.diagonal().array() += damping * damping;
+        ReducedVector reduced_step = damped.ldlt().solve(jacobian.transpose() * error);
+
+        Vector6d step = Vector6d::Zero();
+        for (int k = 0; k < num_unlocked; ++k) {
+            step(joints[k]) = reduced_step(k);
+        }
+        return step;
+    }
 
-        // Set up transformation matrix based on position of joint with respect to previous joint.
-        Matrix4d local_transf = Matrix4d::Identity();
-        local_transf.block(0,3,3,1) = robot_state.get_joint_pos_local(i);
+}
 
-        // Find transformation of current joint in global frame, using transformation from previous joint.
-        global_transf = global_transf * (local_transf * rot_theta);
 
-        robot_state.set_joint_transform(i, global_transf);
-        robot_state.set_link_transform(i+1, global_transf);
-    }
+KinematicsSolver::KinematicsSolver() :
+    e_locked(false), num_iterations(0), ik_mode(IKMode::FIXED_STEP), print_results(true), has_warm_start(false)
+{
+    // Evenly spread starts reach more targets than uniform ones within the same restarts
+    sampler.set_mode(SamplingMode::HALTON);
+}
 
-    // Get end effector position in frame of joint f
-    Matrix4d T = Matrix4d::Identity();
+void KinematicsSolver::FK(ArmState &robot_state) {
+    // ArmState keeps the transforms from the last call and only redoes the joints that moved
+    robot_state.update_transforms();
+}
 
-    // set 4th row (index 3) as ef_xyz
-    T.block(0,3,3,1) = robot_state.get_ef_xyz();
+void KinematicsSolver::FK_batch(const ArmState &robot_state, const std::vector<Vector6d> &configs,
+                                FKBatch &batch) const {
+    const ArmModel &model = robot_state.get_model();
+    const Index n = configs.size();
+    batch.size = configs.size();
 
-    robot_state.set_ef_transform(global_transf * T);
-}
-Matrix4d KinematicsSolver::get_joint_xform(const ArmState& robot_state, size_t joint_index, double theta) {
-    // Get rotation axis of current joint.
-    Vector3d rot_axis_child = robot_state.get_joint_axis(joint_index);
+    ArrayXd angles(n);
+    ArrayXd sin_theta(n);
+    ArrayXd one_minus_cos(n);
 
-    double cos_theta = cos(theta);
-    double sin_theta = sin(theta);
+    // rotation about the current joint, then the joint's rotation, row by row
+    std::array<ArrayXd, 9> rot_theta;
+    for (ArrayXd &entry : rot_theta) {
+        entry.resize(n);
+    }
 
-    Matrix4d rot_theta = Matrix4d::Identity();
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        for (Index k = 0; k < n; ++k) {
+            angles(k) = configs[k](i);
+        }
+        sin_theta = angles.sin();
+        one_minus_cos = 1 - angles.cos();
+
+        // Rodrigues' formula, the same as ArmState::update_transforms()
+        const Vector3d &axis = model.joints[i].rot_axis;
+        Matrix3d axis_cross;
+        axis_cross <<        0, -axis(2),  axis(1),
+                       axis(2),        0, -axis(0),
+                      -axis(1),  axis(0),        0;
+        Matrix3d axis_cross_sq = axis_cross * axis_cross;
+
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                rot_theta[3 * r + c] = (r == c ? 1.0 : 0.0) + sin_theta * axis_cross(r, c)
+                                       + one_minus_cos * axis_cross_sq(r, c);
+            }
+        }
 
-    // Make rotation about rot axis by theta:
+        std::array<ArrayXd, 3> &position = batch.joint_position[i];
+        std::array<ArrayXd, 9> &rotation = batch.joint_rotation[i];
+        const Vector3d &offset = model.joints[i].pos_local;
 
-    // if rotating about x-axis (x-axis points right)
-    // joints b, c, and e
-    if (rot_axis_child(0) == 1) {
-        rot_theta(1,1) = cos_theta;
-        rot_theta(2,1) = sin_theta;
-        rot_theta(1,2) = -1*sin_theta;
-        rot_theta(2,2) = cos_theta;
+        if (i == 0) {
+            for (int r = 0; r < 3; ++r) {
+                position[r].setConstant(n, offset(r));
+            }
+            rotation = rot_theta;
+            continue;
+        }
+
+        // Move to the joint in the previous joint's frame, then rotate about it
+        const std::array<ArrayXd, 3> &prev_position = batch.joint_position[i - 1];
+        const std::array<ArrayXd, 9> &prev_rotation = batch.joint_rotation[i - 1];
+
+        for (int r = 0; r < 3; ++r) {
+            position[r] = prev_position[r] + prev_rotation[3 * r] * offset(0)
+                          + prev_rotation[3 * r + 1] * offset(1) + prev_rotation[3 * r + 2] * offset(2);
+
+            for (int c = 0; c < 3; ++c) {
+                rotation[3 * r + c] = prev_rotation[3 * r] * rot_theta[c] + prev_rotation[3 * r + 1] * rot_theta[3 + c]
+                                      + prev_rotation[3 * r + 2] * rot_theta[6 + c];
+            }
+        }
     }
-    // if rotating about y-axis (y-axis points forward)
-    // joints d, f
-    else if(rot_axis_child(1) == 1) {
-        rot_theta(0,0) = cos_theta;
-        rot_theta(2,0) = -1*sin_theta;
-        rot_theta(0,2) = sin_theta;
-        rot_theta(2,2) = cos_theta;
+
+    const std::array<ArrayXd, 3> &last_position = batch.joint_position[NUM_JOINTS - 1];
+    const std::array<ArrayXd, 9> &last_rotation = batch.joint_rotation[NUM_JOINTS - 1];
+    for (int r = 0; r < 3; ++r) {
+        batch.ef_position[r] = last_position[r] + last_rotation[3 * r] * model.ef_xyz(0)
+                               + last_rotation[3 * r + 1] * model.ef_xyz(1) + last_rotation[3 * r + 2] * model.ef_xyz(2);
     }
-    // if rotating about z-axis (z-axis points up)
-    // joint a
-    else if(rot_axis_child(2) == 1) {
-        rot_theta(0,0) = cos_theta;
-        rot_theta(1,0) = sin_theta;
-        rot_theta(0,1) = -1*sin_theta;
-        rot_theta(1,1) = cos_theta;
+}
+
+Matrix4d FKBatch::get_joint_transform(size_t config, size_t joint_index) const {
+    Matrix4d xform = Matrix4d::Identity();
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            xform(r, c) = joint_rotation[joint_index][3 * r + c](config);
+        }
+        xform(r, 3) = joint_position[joint_index][r](config);
     }
+    return xform;
+}
 
-    return rot_theta;
+Matrix4d FKBatch::get_ef_transform(size_t config) const {
+    Matrix4d xform = get_joint_transform(config, NUM_JOINTS - 1);
+    for (int r = 0; r < 3; ++r) {
+        xform(r, 3) = ef_position[r](config);
+    }
+    return xform;
 }
 
 Matrix4d KinematicsSolver::apply_joint_xform(const ArmState& robot_state, size_t joint_index, double theta) {
@@ -127,9 +227,6 @@ Matrix4d KinematicsSolver::apply_joint_xform(const ArmState& robot_state, size_t
 }
 
 std::pair<Vector6d, bool> KinematicsSolver::IK(ArmState &robot_state, const Vector6d& target_point, bool set_random_angles, bool use_euler_angles) {
-    // Print inital joint angles:
-    std::vector<double> init_joint_angs = robot_state.get_joint_angles();
-
     /*
         Inverse kinematics for MRover arm using cyclic
         coordinate descent (CCD)
@@ -157,59 +254,8 @@ std::pair<Vector6d, bool> KinematicsSolver::IK(ArmState &robot_state, const Vect
     // backup current angles
     perform_backup(robot_state);
 
-    std::vector<std::string> joints_vec = robot_state.get_all_joints();
     if (set_random_angles) {
-        std::vector<double> rand_angs;
-        rand_angs.resize(6);
-
-        // ((double) rand() / (RAND_MAX)) yields random number [0,1)
-        // RAND_MAX is defined in a library
-
-        // TODO: make this actually depend on joint limits, and test whether using full range of values is best
-
-        if (robot_state.get_joint_locked(0)) {
-            rand_angs[0] = robot_state.get_joint_angle(0);
-        }
-        else {
-            rand_angs[0] = ((double) rand() / (RAND_MAX) - 0.5) * 6;  // -3 ... 3
-        }
-
-        if (robot_state.get_joint_locked(1)) {
-            rand_angs[1] = robot_state.get_joint_angle(1);
-        }
-        else {
-            rand_angs[1] = ((double) rand() / (RAND_MAX)) + 0.05;     // 0.05 ... 1.05
-        }
-
-        if (robot_state.get_joint_locked(2)) {
-            rand_angs[2] = robot_state.get_joint_angle(2);
-        }
-        else {
-            rand_angs[2] = ((double) rand() / (RAND_MAX) - 0.5) * 5;  // -2.5 ... 2.5
-        }
-
-        if (robot_state.get_joint_locked(3)) {
-            rand_angs[3] = robot_state.get_joint_angle(3);
-        }
-        else {
-            rand_angs[3] = ((double) rand() / (RAND_MAX) - 0.5) * 6;  // -3   ... 3
-        }
-
-        if (robot_state.get_joint_locked(4)) {
-            rand_angs[4] = robot_state.get_joint_angle(4);
-        }
-        else {
-            rand_angs[4] = ((double) rand() / (RAND_MAX) - 0.5) * 5;  // -2.5 ... 2.5
-        }
-
-        if (robot_state.get_joint_locked(5)) {
-            rand_angs[5] = robot_state.get_joint_angle(5);
-        }
-        else {
-            rand_angs[5] = ((double) rand() / (RAND_MAX) - 0.5) * 6;  // -3   ... 3
-        }
-
-        robot_state.set_joint_angles(rand_angs);
+        randomize_angles(robot_state);
     }
 
     // Update transforms using FK
@@ -231,19 +277,32 @@ std::pair<Vector6d, bool> KinematicsSolver::IK(ArmState &robot_state, const Vect
 
     Vector6d d_ef;
 
+    if (ik_mode == IKMode::DAMPED_LEAST_SQUARES && !IK_damped(robot_state, target_point, use_euler_angles, dist, angle_dist)) {
+        if (print_results) {
+            std::cout << "FAILURE --- damped least squares stopped in " << num_iterations << " iterations --- dist: " << dist << "\t";
+            std::cout << "angle dist: " << angle_dist << "\n";
+        }
+
+        Vector6d joint_angles = robot_state.get_joint_angles_6d();
+
+        // restore previous robot_state angles
+        recover_from_backup(robot_state);
+
+        return std::pair<Vector6d, bool> (joint_angles, false);
+    }
+
     // While distance is bad or angle is bad
-    while (dist > POS_THRESHOLD || (angle_dist > ANGLE_THRESHOLD && use_euler_angles)) {
+    while (ik_mode == IKMode::FIXED_STEP && (dist > POS_THRESHOLD || (angle_dist > ANGLE_THRESHOLD && use_euler_angles))) {
 
         // If we need to break out of loop
         if (num_iterations_low_movement > MAX_ITERATIONS_LOW_MOVEMENT || num_iterations > MAX_ITERATIONS) {
-            std::cout << "FAILURE --- broke out of loop in " << num_iterations << " iterations --- dist: " << dist << "\t";
-            std::cout << "angle dist: " << angle_dist << "\n";
-
-            Vector6d joint_angles;
-            for (int i = 0; i < 6; ++i) {
-                joint_angles(i) = robot_state.get_joint_angle(i);
+            if (print_results) {
+                std::cout << "FAILURE --- broke out of loop in " << num_iterations << " iterations --- dist: " << dist << "\t";
+                std::cout << "angle dist: " << angle_dist << "\n";
             }
 
+            Vector6d joint_angles = robot_state.get_joint_angles_6d();
+
             // restore previous robot_state angles
             recover_from_backup(robot_state);
 
@@ -315,33 +374,188 @@ std::pair<Vector6d, bool> KinematicsSolver::IK(ArmState &robot_state, const Vect
         ++num_iterations;
     }
 
-    std::vector<double> angles_vec = robot_state.get_joint_angles();
+    Vector6d joint_angles = robot_state.get_joint_angles_6d();
 
     // Check for collisions
-    if (!is_safe(robot_state, angles_vec)) {
-        std::cout << "UNSAFE IK solution!\n";
+    if (!is_safe(robot_state)) {
+        if (print_results) {
+            std::cout << "UNSAFE IK solution!\n";
+        }
 
         recover_from_backup(robot_state);
-        return std::pair<Vector6d, bool> (vecTo6d(angles_vec), false);
+        return std::pair<Vector6d, bool> (joint_angles, false);
     }
 
-    std::cout << "SUCCESS in " << num_iterations << " iterations --- dist: " << dist << "\t";
-    std::cout << "angle dist: " << angle_dist << "\n";
+    if (print_results) {
+        std::cout << "SUCCESS in " << num_iterations << " iterations --- dist: " << dist << "\t";
+        std::cout << "angle dist: " << angle_dist << "\n";
+    }
 
     // restore robot_state to previous values
     recover_from_backup(robot_state);
-    return std::pair<Vector6d, bool> (vecTo6d(angles_vec), true);
+    return std::pair<Vector6d, bool> (joint_angles, true);
+}
+
+std::pair<Vector6d, bool> KinematicsSolver::IK_multi_start(const ArmState &robot_state, const Vector6d &target_point,
+                                                           bool use_euler_angles, int num_starts, bool closest,
+                                                           const std::function<bool()> &canceled) {
+    Vector6d start_angles = robot_state.get_joint_angles_6d();
+
+    std::mutex result_mtx;
+    bool found = false;
+    Vector6d best_angles = start_angles;
+    double best_distance = 0;
+
+    std::atomic<int> next_start(0);
+    std::atomic<int> total_iterations(0);
+    std::atomic<int> starts_run(0);
+    std::atomic<bool> done(false);
+
+    // Each start gets its own seed, so a start's result doesn't depend on
+    // which thread happens to run it
+    std::default_random_engine::result_type base_seed = eng();
+
+    auto worker = [&]() {
+        // Solves mutate the solver and state, so each thread works on copies
+        KinematicsSolver thread_solver = *this;
+        thread_solver.print_results = false;
+        ArmState thread_state = robot_state;
+
+        while (!done) {
+            int start = next_start++;
+            if (start >= num_starts || (canceled && canceled())) {
+                break;
+            }
+
+            // Start 0 is the current position, the rest are random. Start i takes
+            // sample i of one sequence, so Halton starts are spread evenly
+            thread_solver.sampler.seed(base_seed, start);
+            std::pair<Vector6d, bool> result = thread_solver.IK(thread_state, target_point, start != 0, use_euler_angles);
+            total_iterations += thread_solver.num_iterations;
+            ++starts_run;
+
+            if (!result.second) {
+                continue;
+            }
+
+            double distance = (result.first - start_angles).norm();
+
+            std::lock_guard<std::mutex> lock(result_mtx);
+            if (!found || distance < best_distance) {
+                found = true;
+                best_angles = result.first;
+                best_distance = distance;
+            }
+            if (!closest) {
+                done = true;
+            }
+        }
+    };
+
+    // one worker per core of the shared pool, this thread being one of them
+    int num_workers = std::max(1, std::min(num_starts, (int) Thor::Pool::shared().size() + 1));
+    Thor::TaskGroup group;
+    for (int i = 1; i < num_workers; ++i) {
+        group.run(worker);
+    }
+    worker();
+    group.wait();
+
+    num_iterations = total_iterations;
+
+    if (print_results) {
+        if (found) {
+            std::cout << "SUCCESS in " << num_iterations << " iterations across " << starts_run << " starts --- joint distance: " << best_distance << "\n";
+        }
+        else {
+            std::cout << "FAILURE --- no safe solution in " << num_iterations << " iterations across " << starts_run << " starts\n";
+        }
+    }
+
+    return std::pair<Vector6d, bool> (best_angles, found);
+}
+
+std::pair<Vector6d, bool> KinematicsSolver::IK_warm_start(ArmState &robot_state, const Vector6d &target_point,
+                                                          bool use_euler_angles) {
+    num_iterations = 0;
+    if (!has_warm_start || (target_point.head(3) - warm_start_target.head(3)).norm() > MAX_WARM_START_TARGET_DIST) {
+        return std::pair<Vector6d, bool> (robot_state.get_joint_angles_6d(), false);
+    }
+
+    perform_backup(robot_state);
+
+    // Locked joints stay where they are now, not where the last solution had them
+    Vector6d seed = robot_state.get_joint_angles_6d();
+    for (size_t i = 0; i < 6; ++i) {
+        if (!robot_state.get_joint_locked(i)) {
+            seed(i) = warm_start_solution(i);
+        }
+    }
+    robot_state.set_joint_angles_6d(seed);
+    FK(robot_state);
+
+    // The target moved by about as much as the end effector would with
+    // this change of angles, so start there instead of at the last solution
+    Vector6d target_delta;
+    target_delta.head(3) = target_point.head(3) - warm_start_target.head(3);
+    AngleAxisd rotation_delta(compute_rotation_matrix(target_point.tail(3)) *
+                              compute_rotation_matrix(warm_start_target.tail(3)).transpose());
+    target_delta.tail(3) = rotation_delta.angle() * rotation_delta.axis();
+
+    seed += get_joint_velocities(robot_state, target_delta, use_euler_angles);
+    for (size_t i = 0; i < 6; ++i) {
+        seed(i) = clip_to_limits(robot_state, i, seed(i));
+    }
+    robot_state.set_joint_angles_6d(seed);
+    FK(robot_state);
+
+    double dist;
+    double angle_dist;
+    bool reached = IK_damped(robot_state, target_point, use_euler_angles, dist, angle_dist);
+    Vector6d joint_angles = robot_state.get_joint_angles_6d();
+
+    // Damped steps keep close to where they started, but a target past a
+    // joint limit can still send the arm another way, which isn't continuous
+    double jump = (joint_angles - warm_start_solution).cwiseAbs().maxCoeff();
+    bool found = reached && jump <= MAX_WARM_START_JOINT_JUMP && is_safe(robot_state);
+
+    if (print_results) {
+        std::cout << (found ? "SUCCESS" : "FAILURE") << " --- warm start in " << num_iterations
+                  << " iterations --- dist: " << dist << "\tangle dist: " << angle_dist
+                  << "\tjoint jump: " << jump << "\n";
+    }
+
+    recover_from_backup(robot_state);
+    return std::pair<Vector6d, bool> (joint_angles, found);
+}
+
+void KinematicsSolver::remember_solution(const Vector6d &target_point, const Vector6d &solution) {
+    has_warm_start = true;
+    warm_start_target = target_point;
+    warm_start_solution = solution;
+}
+
+void KinematicsSolver::forget_solution() {
+    has_warm_start = false;
+}
+
+void KinematicsSolver::randomize_angles(ArmState &robot_state) {
+    Vector6d angles = sampler.sample(robot_state, robot_state.get_joint_angles_6d());
+    robot_state.set_joint_angles_6d(angles);
 }
 
 void KinematicsSolver::IK_step(ArmState& robot_state, const Vector6d& d_ef, bool use_euler_angles) {
     Vector3d ef_pos_world = robot_state.get_ef_pos_world();
     Vector3d ef_euler_world = robot_state.get_ef_ang_world();
 
-    MatrixXd jacobian(6, 6);
-    jacobian.setZero();
+    // only the unlocked joints get a column, the locked ones don't move
+    std::array<int, 6> joints;
+    int num_unlocked = unlocked_joints(robot_state, joints);
 
-    // 6-D matrix
-    for (size_t i = 0; i < 6; ++i) {
+    ReducedJacobian jacobian(6, num_unlocked);
+
+    for (int k = 0; k < num_unlocked; ++k) {
+        size_t i = joints[k];
 
         // calculate vector from joint i to end effector
         Vector3d joint_pos_world = robot_state.get_link_point_world(i+1);
@@ -379,15 +593,13 @@ void KinematicsSolver::IK_step(ArmState& robot_state, const Vector6d& d_ef, bool
             joint_col.tail(3) = Vector3d(0, 0, 0);
         }
 
-        // write column i of the jacobian
-        for (size_t j = 0; j < 6; ++j) {
-            jacobian(j, i) = joint_col[j];
-        }
+        // write column k of the jacobian
+        jacobian.col(k) = joint_col;
     }
 
     FK(robot_state);
 
-    MatrixXd jacobian_inverse;
+    ReducedInverse jacobian_inverse;
     // if using pseudo inverse (usually corresponds to using euler angles)
     if (use_euler_angles) {
         jacobian_inverse = jacobian.completeOrthogonalDecomposition().pseudoInverse();
@@ -397,47 +609,220 @@ void KinematicsSolver::IK_step(ArmState& robot_state, const Vector6d& d_ef, bool
         jacobian_inverse = jacobian.transpose();
     }
 
-    Vector6d d_theta = jacobian_inverse * d_ef;
+    ReducedVector reduced_d_theta = jacobian_inverse * d_ef;
+    Vector6d d_theta = Vector6d::Zero();
+    for (int k = 0; k < num_unlocked; ++k) {
+        d_theta[joints[k]] = reduced_d_theta(k);
+    }
 
     // find the angle of each joint
-    std::vector<double> angle_vec;
+    Vector6d angles;
     for (size_t i = 0; i < 6; ++i) {
+        angles(i) = clip_to_limits(robot_state, i, robot_state.get_joint_angle(i) + d_theta[i]);
+    }
+
+    // run forward kinematics
+    robot_state.set_joint_angles_6d(angles);
+    FK(robot_state);
+}
+
+bool KinematicsSolver::IK_damped(ArmState &robot_state, const Vector6d &target_point, bool use_euler_angles,
+                                  double &dist, double &angle_dist) {
+    // Without orientation only the position rows of the jacobian matter.
+    // The other rows are zeroed rather than dropped, to keep the matrices fixed
+    // size, which gives the same steps since their error is never used
+    const int rows = use_euler_angles ? 6 : 3;
+
+    double damping = DAMPING_INITIAL;
+
+    std::array<int, 6> joints;
+    int num_unlocked = unlocked_joints(robot_state, joints);
+
+    Vector6d error = get_ef_error(robot_state, target_point);
+    double cost = error.head(rows).squaredNorm();
+    dist = error.head(3).norm();
+    angle_dist = error.tail(3).squaredNorm();
 
-        // don't move joint i if it's locked
-        if (robot_state.get_joint_locked(i)) {
-            d_theta[i] = 0;
+    while (dist > POS_THRESHOLD || (angle_dist > ANGLE_THRESHOLD && use_euler_angles)) {
+
+        // Give up once steps stop helping even with heavy damping, or if nothing can move
+        if (num_iterations >= MAX_ITERATIONS_DAMPED || damping > DAMPING_MAX || num_unlocked == 0) {
+            return false;
         }
+        ++num_iterations;
 
-        std::vector<double> limits = robot_state.get_joint_limits(i);
+        Matrix6d jacobian = get_jacobian(robot_state);
+        jacobian.bottomRows(6 - rows).setZero();
 
-        double angle = robot_state.get_joint_angle(i) + d_theta[i];
+        Vector6d used_error = error;
+        used_error.tail(6 - rows).setZero();
 
-        // clip angle to within joint limits
-        if (angle < limits[0]) {
-            // If joint can reach all 2pi options
-            if (robot_state.is_continuous(i)) {
-                angle = limits[1];
-            }
-            else {
-                angle = limits[0];   
-            }
+        // d_theta = J^T (J J^T + damping^2 I)^-1 error, which acts like the
+        // pseudo inverse far from singularities and shrinks the step near them.
+        // Locked joints get no column, so they stay where they are
+        Vector6d d_theta = damped_step(reduce_jacobian(jacobian, joints, num_unlocked), joints, num_unlocked,
+                                       used_error, damping);
+
+        double max_step = d_theta.cwiseAbs().maxCoeff();
+        if (max_step > MAX_DAMPED_JOINT_STEP) {
+            d_theta *= MAX_DAMPED_JOINT_STEP / max_step;
         }
-        else if (angle > limits[1]) {
-            // If joint can reach all 2pi options
-            if (robot_state.is_continuous(i)) {
-                angle = limits[0];
-            }
-            else {
-                angle = limits[1];   
-            }
+
+        Vector6d prev_angles = robot_state.get_joint_angles_6d();
+        Vector6d angles;
+        for (size_t i = 0; i < 6; ++i) {
+            angles(i) = clip_to_limits(robot_state, i, prev_angles(i) + d_theta(i));
         }
 
-        angle_vec.push_back(angle);
+        robot_state.set_joint_angles_6d(angles);
+        FK(robot_state);
+
+        Vector6d new_error = get_ef_error(robot_state, target_point);
+        double new_cost = new_error.head(rows).squaredNorm();
+
+        // Keep steps that get closer and trust the jacobian more,
+        // otherwise undo the step and take a more damped one
+        if (new_cost < cost) {
+            error = new_error;
+            cost = new_cost;
+            dist = error.head(3).norm();
+            angle_dist = error.tail(3).squaredNorm();
+            damping = std::max(damping / 2, DAMPING_MIN);
+        }
+        else {
+            robot_state.set_joint_angles_6d(prev_angles);
+            FK(robot_state);
+            damping *= 4;
+        }
     }
 
-    // run forward kinematics
-    robot_state.set_joint_angles(angle_vec);
+    return true;
+}
+
+Vector6d KinematicsSolver::get_ef_error(const ArmState &robot_state, const Vector6d &target_point) {
+    Vector6d error;
+    error.head(3) = target_point.head(3) - robot_state.get_ef_pos_world();
+
+    // Rotation that takes the end effector to the target orientation, in the world frame
+    Matrix3d ef_rotation = robot_state.get_ef_transform().block(0, 0, 3, 3);
+    AngleAxisd rotation_error(compute_rotation_matrix(target_point.tail(3)) * ef_rotation.transpose());
+    error.tail(3) = rotation_error.angle() * rotation_error.axis();
+
+    return error;
+}
+
+Matrix<double, 6, 6> KinematicsSolver::get_jacobian(const ArmState &robot_state) {
+    Matrix<double, 6, 6> jacobian;
+    Vector3d ef_pos_world = robot_state.get_ef_pos_world();
+
+    for (size_t i = 0; i < 6; ++i) {
+        Vector3d rot_axis_world = robot_state.get_joint_axis_world(i);
+        Vector3d joint_to_ef_vec_world = ef_pos_world - robot_state.get_joint_pos_world(i);
+
+        // Turning about the axis moves the end effector perpendicular to
+        // both the axis and the vector from the joint to the end effector
+        jacobian.block(0, i, 3, 1) = rot_axis_world.cross(joint_to_ef_vec_world);
+        jacobian.block(3, i, 3, 1) = rot_axis_world;
+    }
+
+    return jacobian;
+}
+
+Vector6d KinematicsSolver::get_joint_velocities(const ArmState &robot_state, const Vector6d &ef_velocity,
+                                                bool use_orientation) {
+    const int rows = use_orientation ? 6 : 3;
+
+    std::array<int, 6> joints;
+    int num_unlocked = unlocked_joints(robot_state, joints);
+    if (num_unlocked == 0) {
+        return Vector6d::Zero();
+    }
+
+    Matrix6d jacobian = get_jacobian(robot_state);
+    jacobian.bottomRows(6 - rows).setZero();
+
+    Vector6d used_velocity = ef_velocity;
+    used_velocity.tail(6 - rows).setZero();
+
+    // Same damped pseudo inverse as IK_damped(), with fixed damping
+    return damped_step(reduce_jacobian(jacobian, joints, num_unlocked), joints, num_unlocked,
+                       used_velocity, SERVO_DAMPING);
+}
+
+ServoResult KinematicsSolver::servo_step(ArmState &robot_state, const Vector6d &target_point, bool use_orientation,
+                                         double dt) {
+    FK(robot_state);
+
+    Vector6d error = get_ef_error(robot_state, target_point);
+    if (!use_orientation) {
+        error.tail(3).setZero();
+    }
+
+    double linear_dist = error.head(3).norm();
+    double angular_dist = error.tail(3).norm();
+    if (linear_dist < SERVO_POS_TOLERANCE && angular_dist < SERVO_ANGLE_TOLERANCE) {
+        return ServoResult::REACHED;
+    }
+
+    // Head for the target as fast as allowed, slowing down to land on it in the last step
+    Vector6d ef_velocity = error / dt;
+    if (linear_dist > SERVO_MAX_LINEAR_SPEED * dt) {
+        ef_velocity.head(3) *= SERVO_MAX_LINEAR_SPEED * dt / linear_dist;
+    }
+    if (angular_dist > SERVO_MAX_ANGULAR_SPEED * dt) {
+        ef_velocity.tail(3) *= SERVO_MAX_ANGULAR_SPEED * dt / angular_dist;
+    }
+
+    Vector6d joint_velocities = get_joint_velocities(robot_state, ef_velocity, use_orientation);
+    if (joint_velocities.isZero()) {
+        return ServoResult::BLOCKED;
+    }
+
+    // Slow every joint down together, so the end effector keeps its direction
+    double scale = 1;
+    for (size_t i = 0; i < 6; ++i) {
+        double max_speed = robot_state.get_joint_max_speed(i);
+        if (std::abs(joint_velocities(i)) * scale > max_speed) {
+            scale = max_speed / std::abs(joint_velocities(i));
+        }
+    }
+
+    Vector6d start = robot_state.get_joint_angles_6d();
+    Vector6d end = start + joint_velocities * scale * dt;
+
+    if (!is_safe_motion(robot_state, start, end)) {
+        return ServoResult::BLOCKED;
+    }
+
+    robot_state.set_joint_angles_6d(end);
     FK(robot_state);
+    return ServoResult::MOVING;
+}
+
+double KinematicsSolver::clip_to_limits(ArmState &robot_state, size_t joint_index, double angle) {
+    const std::array<double, 2> &limits = robot_state.get_joint_limits(joint_index);
+
+    // clip angle to within joint limits
+    if (angle < limits[0]) {
+        // If joint can reach all 2pi options
+        if (robot_state.is_continuous(joint_index)) {
+            angle = limits[1];
+        }
+        else {
+            angle = limits[0];
+        }
+    }
+    else if (angle > limits[1]) {
+        // If joint can reach all 2pi options
+        if (robot_state.is_continuous(joint_index)) {
+            angle = limits[0];
+        }
+        else {
+            angle = limits[1];
+        }
+    }
+
+    return angle;
 }
 
 bool KinematicsSolver::is_safe(ArmState &robot_state, const std::vector<double> &angles) {
@@ -452,23 +837,64 @@ bool KinematicsSolver::is_safe(ArmState &robot_state, const std::vector<double>
 
 bool KinematicsSolver::is_safe(ArmState &robot_state) {
     // if any angles are outside bounds
-    if (!limit_check(robot_state, robot_state.get_joint_angles())) {
+    if (!limit_check(robot_state, robot_state.get_joint_angles_6d())) {
         return false;
     }
 
-    // run FK algorithm to ensure update state
-    FK(robot_state);
+    return obstacle_free(robot_state);
+}
+
+bool KinematicsSolver::is_safe_motion(ArmState &robot_state, const Vector6d &start, const Vector6d &end) {
+    // The limits are a box, so the line from start to an end within them only
+    // leaves them where start does. start is where the arm already is or a
+    // checked node, and the arm may sit slightly past a limit, so it isn't held to them
+    if (!limit_check(robot_state, end)) {
+        return false;
+    }
+
+    perform_backup(robot_state);
 
-    return robot_state.obstacle_free();
+    // Advancing towards a contact takes many small steps, so first reject
+    // motions that collide at the end or at a few points along the way
+    for (int i = MOTION_PRECHECK_POINTS + 1; i > 0; --i) {
+        double t = static_cast<double>(i) / (MOTION_PRECHECK_POINTS + 1);
+        robot_state.set_joint_angles_6d(start + t * (end - start));
+
+        if (!obstacle_free(robot_state)) {
+            recover_from_backup(robot_state);
+            return false;
+        }
+    }
+
+    bool safe = false;
+    double t = 0;
+    for (int step = 0; step < MAX_MOTION_STEPS; ++step) {
+        robot_state.set_joint_angles_6d(start + t * (end - start));
+        FK(robot_state);
+
+        double fraction = robot_state.free_motion_fraction((1 - t) * (end - start));
+        if (fraction >= 1) {
+            safe = true;
+            break;
+        }
+        if (fraction < MIN_MOTION_STEP) {
+            break;
+        }
+
+        t += fraction * (1 - t);
+    }
+
+    recover_from_backup(robot_state);
+    return safe;
 }
 
-bool KinematicsSolver::limit_check(ArmState &robot_state, const std::vector<double> &angles) {
+bool KinematicsSolver::limit_check(ArmState &robot_state, const Vector6d &angles) {
     for (size_t i = 0; i < 6; ++i) {
-        std::vector<double> limits = robot_state.get_joint_limits(i);
+        const std::array<double, 2> &limits = robot_state.get_joint_limits(i);
         
         // if any angle is outside of bounds
-        if (!(limits[0] - LIMIT_CHECK_MARGIN <= angles[i]
-              && angles[i] < limits[1] + LIMIT_CHECK_MARGIN)) {
+        if (!(limits[0] - LIMIT_CHECK_MARGIN <= angles(i)
+              && angles(i) < limits[1] + LIMIT_CHECK_MARGIN)) {
             return false;
         }
     }
@@ -478,10 +904,8 @@ bool KinematicsSolver::limit_check(ArmState &robot_state, const std::vector<doub
 }
 
 void KinematicsSolver::perform_backup(ArmState &robot_state) {
-    std::vector<double> backup = robot_state.get_joint_angles();
-
     // save all angles to stack
-    arm_state_backup.push(backup);
+    arm_state_backup.push(robot_state.get_joint_angles_6d());
 }
 
 void KinematicsSolver::recover_from_backup(ArmState &robot_state) {
@@ -490,7 +914,7 @@ void KinematicsSolver::recover_from_backup(ArmState &robot_state) {
     }
     else {
         // pop angles from stack
-        robot_state.set_joint_angles(arm_state_backup.top());
+        robot_state.set_joint_angles_6d(arm_state_backup.top());
         arm_state_backup.pop();
 
         // update state based on new angles
@@ -498,6 +922,35 @@ void KinematicsSolver::recover_from_backup(ArmState &robot_state) {
     }
 }
 
+bool KinematicsSolver::obstacle_free(ArmState &robot_state) {
+    Vector6d angles = robot_state.get_joint_angles_6d();
+    bool safe;
+    if (safety_cache.find(robot_state, angles, safe)) {
+        return safe;
+    }
+
+    FK(robot_state);
+    safe = robot_state.obstacle_free();
+    safety_cache.store(robot_state, angles, safe);
+    return safe;
+}
+
+const SafetyCache &KinematicsSolver::get_safety_cache() const {
+    return safety_cache;
+}
+
 int KinematicsSolver::get_num_iterations() {
     return num_iterations;
 }
+
+void KinematicsSolver::set_IK_mode(IKMode mode) {
+    ik_mode = mode;
+}
+
+IKMode KinematicsSolver::get_IK_mode() const {
+    return ik_mode;
+}
+
+void KinematicsSolver::set_sampling_mode(SamplingMode mode) {
+    sampler.set_mode(mode);
+}
@@ -3,7 +3,12 @@
 
 #include <eigen3/Eigen/Dense>
 #include "arm_state.hpp"
+#include "joint_sampler.hpp"
+#include "safety_cache.hpp"
 #include <stack>
+#include <vector>
+#include <functional>
+#include <random>
 
 using namespace Eigen;
 
@@ -28,6 +33,81 @@ static constexpr double EPSILON_ANGLE_DIST = 0.01;
 
 static constexpr double LIMIT_CHECK_MARGIN = 0.0001;
 
+static constexpr int MAX_ITERATIONS_DAMPED = 50;
+
+// The starting damping factor for damped least squares, and the range it
+// is kept within as it adapts to how well the steps are working
+static constexpr double DAMPING_INITIAL = 0.01;
+static constexpr double DAMPING_MIN = 0.00001;
+static constexpr double DAMPING_MAX = 10;
+
+// Damped least squares steps are scaled down so no joint moves further
+// than this, since the jacobian is only accurate close to the current angles
+static constexpr double MAX_DAMPED_JOINT_STEP = 0.3;
+
+// is_safe_motion() gives up and reports a collision when conservative advancement
+// takes more steps than this, or a step smaller than MIN_MOTION_STEP of the motion
+// left, which only happens when links pass very close to each other
+static constexpr int MAX_MOTION_STEPS = 100;
+static constexpr double MIN_MOTION_STEP = 0.001;
+
+// Evenly spaced points inside a motion that is_safe_motion() checks directly before advancing
+static constexpr int MOTION_PRECHECK_POINTS = 3;
+
+// Cartesian servoing moves the end effector at most this fast, in m/s and rad/s
+static constexpr double SERVO_MAX_LINEAR_SPEED = 0.05;
+static constexpr double SERVO_MAX_ANGULAR_SPEED = 0.3;
+
+// Damping of the joint velocities servoing asks for, which keeps them small near singularities
+static constexpr double SERVO_DAMPING = 0.02;
+
+// Servoing is done this close to its target, in meters and radians
+static constexpr double SERVO_POS_TOLERANCE = 0.001;
+static constexpr double SERVO_ANGLE_TOLERANCE = 0.005;
+
+// IK_warm_start() only starts from the last solution when its target was
+// this close, and only keeps a solution that turned no joint further than
+// MAX_WARM_START_JOINT_JUMP from it, so nearby targets get nearby angles
+static constexpr double MAX_WARM_START_TARGET_DIST = 0.1;
+static constexpr double MAX_WARM_START_JOINT_JUMP = 0.5;
+
+enum class ServoResult {
+    MOVING,     // took a step towards the target
+    REACHED,    // already at the target, didn't move
+    BLOCKED     // the next step would collide or leave the joint limits, didn't move
+};
+
+enum class IKMode {
+    FIXED_STEP,             // step a fixed fraction of the way to the target using a numerical jacobian
+    DAMPED_LEAST_SQUARES    // Levenberg-Marquardt steps using the analytic jacobian
+};
+
+/**
+ * Joint and end effector transforms of many configurations, in the world
+ * frame, laid out as a structure of arrays: entry k of every array belongs
+ * to configuration k, so each step of FK_batch() works on all of them at once.
+ * */
+struct FKBatch {
+    size_t size;
+
+    // x, y and z of each joint's position
+    std::array<std::array<ArrayXd, 3>, NUM_JOINTS> joint_position;
+
+    // each joint's rotation matrix, row by row
+    std::array<std::array<ArrayXd, 9>, NUM_JOINTS> joint_rotation;
+
+    // x, y and z of the end effector, which is rotated like the last joint
+    std::array<ArrayXd, 3> ef_position;
+
+    /**
+     * @return the transform of joint_index in configuration config, the same
+     * as ArmState::get_joint_transform() after FK at that configuration
+     * */
+    Matrix4d get_joint_transform(size_t config, size_t joint_index) const;
+
+    Matrix4d get_ef_transform(size_t config) const;
+};
+
 class KinematicsSolver {
 
 private:
@@ -35,7 +115,28 @@ private:
     bool e_locked;
     int num_iterations;
 
-    std::stack< std::vector<double> > arm_state_backup;
+    IKMode ik_mode;
+
+    // false to keep IK() quiet, for solves running on several threads at once
+    bool print_results;
+
+    // random engine for the seeds of IK_multi_start()
+    std::default_random_engine eng;
+
+    // draws the random starting angles of IK()
+    JointSampler sampler;
+
+    // the target and solution last given to remember_solution(), which IK_warm_start() starts from
+    bool has_warm_start;
+    Vector6d warm_start_target;
+    Vector6d warm_start_solution;
+
+    // whether configurations checked by is_safe() and is_safe_motion() were obstacle free
+    SafetyCache safety_cache;
+
+    // a vector underneath instead of a deque, so a solver that has backed up once
+    // doesn't allocate again, with Eigen's allocator for the fixed size vectors
+    std::stack< Vector6d, std::vector< Vector6d, aligned_allocator<Vector6d> > > arm_state_backup;
 
     /**
      * Push the angles of robot_state into the arm_state_backup stack
@@ -48,24 +149,126 @@ private:
      * */
     void recover_from_backup(ArmState &robot_state);
 
+    /**
+     * Same as FK() then robot_state.obstacle_free(), but looks the current angles
+     * up in safety_cache first. The transforms aren't updated when they're found
+     * @return true if robot_state at its current angles collides with nothing
+     * */
+    bool obstacle_free(ArmState &robot_state);
+
     Matrix4d apply_joint_xform(const ArmState &robot_state, size_t joint_index, double theta);
-    Matrix4d get_joint_xform(const ArmState &robot_state, size_t joint_index, double theta);
+
+    /**
+     * Set the angles of robot_state to random angles within the joint limits, except for locked joints
+     * */
+    void randomize_angles(ArmState &robot_state);
 
     void IK_step(ArmState &robot_state, const Vector6d &d_ef, bool use_euler_angles);
 
+    /**
+     * Move robot_state towards target_point with damped least squares steps,
+     * starting from its current angles
+     * @param dist set to the final distance to the target position
+     * @param angle_dist set to the square of the final angle to the target orientation
+     * @return true if the target was reached within POS_THRESHOLD and ANGLE_THRESHOLD
+     * */
+    bool IK_damped(ArmState &robot_state, const Vector6d &target_point, bool use_euler_angles,
+                   double &dist, double &angle_dist);
+
+    /**
+     * @return angle moved into the limits of joint_index the same way IK steps do
+     * */
+    double clip_to_limits(ArmState &robot_state, size_t joint_index, double angle);
+
     /**
      * called by is_safe to check that angles are within bounds
      * @param angles the set of angles for a theoretical arm position
      * @return true if all angles are within bounds
      * */
-    bool limit_check(ArmState &robot_state, const std::vector<double> &angles);
+    bool limit_check(ArmState &robot_state, const Vector6d &angles);
 
 public:
 
+    KinematicsSolver();
+
     void FK(ArmState &robot_state);
 
+    /**
+     * FK of every configuration in configs for robot_state's geometry,
+     * without touching robot_state or the solver
+     * @param batch set to the transforms of each configuration, keeping its
+     * storage between calls of the same size
+     * */
+    void FK_batch(const ArmState &robot_state, const std::vector<Vector6d> &configs, FKBatch &batch) const;
+
+    /**
+     * Computes the jacobian of the end effector from the joint axes and
+     * positions found by the last FK() call on robot_state
+     * @return 6x6 matrix where column i is the velocity of the end effector
+     * when joint i turns at 1 rad/s, with the linear velocity first and then
+     * the angular velocity
+     * */
+    Matrix<double, 6, 6> get_jacobian(const ArmState &robot_state);
+
+    /**
+     * @return the error from the end effector of robot_state to target_point, with
+     * the position error first and then the orientation error as a rotation vector
+     * */
+    Vector6d get_ef_error(const ArmState &robot_state, const Vector6d &target_point);
+
+    /**
+     * Damped least squares on the jacobian of the last FK() call on robot_state
+     * @param ef_velocity linear and then angular velocity for the end effector
+     * @param use_orientation false to follow only the linear velocity and let the orientation drift
+     * @return joint velocities that move the end effector closest to ef_velocity,
+     * 0 for locked joints
+     * */
+    Vector6d get_joint_velocities(const ArmState &robot_state, const Vector6d &ef_velocity, bool use_orientation);
+
+    /**
+     * Moves robot_state one step of dt seconds towards target_point, at most
+     * SERVO_MAX_LINEAR_SPEED and SERVO_MAX_ANGULAR_SPEED at the end effector and
+     * the max speed of each joint. The step is only taken if the new angles are
+     * safe, and is short enough for the arm to stay safe in between.
+     * @param target_point x, y, z and z-x-z euler angles of the end effector
+     * @return whether robot_state moved, and if not why
+     * */
+    ServoResult servo_step(ArmState &robot_state, const Vector6d &target_point, bool use_orientation, double dt);
+
     std::pair<Vector6d, bool> IK(ArmState &robot_state, const Vector6d &target_point, bool set_random_angles, bool use_euler_angles);
 
+    /**
+     * Runs IK from num_starts starting positions at once on a pool of threads,
+     * each with its own copy of the solver and robot_state. The first start is
+     * the current position and the rest are random, seeded from this solver.
+     * @param closest if true, wait for every start and return the safe solution
+     * closest to the current angles, otherwise return the first safe solution
+     * @param canceled optional, checked before each start and stops the search
+     * when it returns true. Called from the pool threads
+     * @return joint angles of the solution and whether a safe solution was found
+     * */
+    std::pair<Vector6d, bool> IK_multi_start(const ArmState &robot_state, const Vector6d &target_point,
+                                             bool use_euler_angles, int num_starts, bool closest,
+                                             const std::function<bool()> &canceled = std::function<bool()>());
+
+    /**
+     * IK for targets that move a little at a time, like one dragged in the GUI.
+     * Damped least squares starts from the last remembered solution, moved along
+     * the change of target since then with the jacobian there, so it usually
+     * converges in a few iterations. Does nothing without a remembered solution
+     * within MAX_WARM_START_TARGET_DIST of target_point.
+     * @return joint angles of the solution and whether it is safe, reaches the
+     * target and stays within MAX_WARM_START_JOINT_JUMP of the last solution
+     * */
+    std::pair<Vector6d, bool> IK_warm_start(ArmState &robot_state, const Vector6d &target_point, bool use_euler_angles);
+
+    /**
+     * Keeps solution as the one IK_warm_start() starts the next target near target_point from
+     * */
+    void remember_solution(const Vector6d &target_point, const Vector6d &solution);
+
+    void forget_solution();
+
     /**
      * @param robot_state the state to use for testing purposes (will be returned in initial state)
      * @param angles the set of angles for a theoretical arm position
@@ -80,8 +283,32 @@ public:
      * */
     bool is_safe(ArmState &robot_state);
 
+    /**
+     * Checks the whole straight line motion from start to end in joint space,
+     * not only its ends. Uses conservative advancement: from each position on
+     * the way, the arm skips ahead as far as no pair of links could possibly
+     * close its gap, so open space is crossed in a few big steps.
+     * @param robot_state the state to use for testing purposes (will be returned in initial state)
+     * @return true if end is within bounds and nothing collides on the way
+     * */
+    bool is_safe_motion(ArmState &robot_state, const Vector6d &start, const Vector6d &end);
+
     int get_num_iterations();
 
+    /**
+     * @return the obstacle free results this solver remembers, for its lookup counts
+     * */
+    const SafetyCache &get_safety_cache() const;
+
+    void set_IK_mode(IKMode mode);
+
+    IKMode get_IK_mode() const;
+
+    /**
+     * @param mode how the random starting angles of IK() are drawn, from a Halton sequence by default
+     * */
+    void set_sampling_mode(SamplingMode mode);
+
 };
 
 #endif
@@ -1,6 +1,10 @@
 #include "nlohmann/json.hpp"
 #include "mrover_arm.hpp"
 #include "utils.hpp"
+#include "rover_runtime.hpp"
+#include "readiness.hpp"
+#include "memory_report.hpp"
+#include "trace.hpp"
 
 #include <lcm/lcm-cpp.hpp>
 #include <iostream>
@@ -32,7 +36,7 @@ public:
     void armPositionCallback(
         const lcm::ReceiveBuffer* receiveBuffer,
         const std::string& channel,
-        const ArmPosition* arm_pos)
+        const ArmPosition::View* arm_pos)
     {
         arm->arm_position_callback( channel, *arm_pos );
     }
@@ -93,6 +97,14 @@ public:
         arm->arm_preset_callback( channel, *arm_preset );
     }
 
+    void armEnvironmentCallback(
+        const lcm::ReceiveBuffer* receiveBuffer,
+        const std::string& channel,
+        const ArmEnvironment* arm_environment)
+    {
+        arm->arm_environment_callback( channel, *arm_environment );
+    }
+
 private:
     MRoverArm* arm;
 };
@@ -104,6 +116,22 @@ int main() {
     std::cout << std::setprecision(4);
     std::cout << "INITIALIZING KINEMATICS FOR ROBOT ARM\n";
 
+    // With MROVER_TRACE_DIR set, planning and commands to the arm are traced
+    Trace::start("ra_kinematics");
+
+    // Priorities and cores of the threads come from config/threads. Real-time
+    // scheduling of execute_spline and servo_executor keeps commands to the arm
+    // on schedule while planning runs, but needs permission, so without it
+    // they run normally
+    ThreadConfig threads("ra_kinematics");
+
+    // Sent on /heartbeat/ra_kinematics, ready once the arm's maps are loaded
+    // and every thread is running
+    Readiness readiness(threads, "ra_kinematics");
+
+    // Sent on /memory/ra_kinematics every second
+    MemoryReport memory_report(threads, "ra_kinematics");
+
     json geom = read_json_from_file(get_mrover_arm_geom());
 
     lcm::LCM lcmObject;
@@ -111,7 +139,8 @@ int main() {
 
     lcmHandlers handler(&robot_arm);
 
-    lcmObject.subscribe( "/arm_position", &lcmHandlers::armPositionCallback, &handler );
+    // only the newest arm position matters, stale ones are skipped without being decoded
+    lcmObject.subscribe( "/arm_position", &lcmHandlers::armPositionCallback, &handler )->setLatestOnly();
     lcmObject.subscribe( "/target_orientation" , &lcmHandlers::executeCallback, &handler );
     lcmObject.subscribe( "/motion_execute", &lcmHandlers::motionExecuteCallback, &handler );
     lcmObject.subscribe( "/simulation_mode", &lcmHandlers::simModeCallback, &handler );
@@ -121,16 +150,29 @@ int main() {
     lcmObject.subscribe( "/zero_position", &lcmHandlers::zeroPositionCallback, &handler );
     lcmObject.subscribe( "/arm_adjustments", &lcmHandlers::armAdjustCallback, &handler );
     lcmObject.subscribe( "/arm_preset", &lcmHandlers::armPresetCallback, &handler );
-    
-    std::thread execute_spline(&MRoverArm::execute_spline, &robot_arm);
-    std::thread send_arm_position(&MRoverArm::encoder_angles_sender, &robot_arm);
+    // only the newest environment matters, and building one takes a while
+    lcmObject.subscribe( "/arm_environment", &lcmHandlers::armEnvironmentCallback, &handler )->setLatestOnly();
+
+    // IK and motion planning take seconds, so targets are planned on their own
+    // thread instead of holding up arm positions and everything else
+    std::thread path_planner = threads.spawn("path_planner", [&]() { robot_arm.path_planner(); });
+    std::thread execute_spline = threads.spawn("execute_spline", [&]() { robot_arm.execute_spline(); });
+    std::thread send_arm_position = threads.spawn("angles_sender", [&]() { robot_arm.encoder_angles_sender(); });
+    std::thread send_preview = threads.spawn("preview_sender", [&]() { robot_arm.preview_sender(); });
+    std::thread arm_link = threads.spawn("arm_link", [&]() { robot_arm.arm_link_receiver(); });
+    std::thread servo = threads.spawn("servo_executor", [&]() { robot_arm.servo_executor(); });
+    readiness.ready();
 
     while( lcmObject.handle() == 0 ) {
         // run kinematics
     }
 
+    path_planner.join();
     execute_spline.join();
     send_arm_position.join();
+    send_preview.join();
+    arm_link.join();
+    servo.join();
 
     return 0;
 }
@@ -0,0 +1,371 @@
+#include "motion_lattice.hpp"
+#include "arm_state.hpp"
+#include "kinematics.hpp"
+#include "thor.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    // Nodes each task of generate() checks
+    constexpr size_t GENERATE_CHUNK = 512;
+
+    /**
+     * Runs check(node) for every node on the shared pool, this thread included
+     * */
+    void for_each_node(size_t num_nodes, const std::function<void(KinematicsSolver &, ArmState &, size_t)> &check,
+                       const ArmModel &model) {
+        std::atomic<size_t> next_chunk(0);
+        auto worker = [&]() {
+            // checks move the state and use the solver's stack, so each thread has its own
+            ArmState robot(model);
+            KinematicsSolver solver;
+            while (true) {
+                size_t begin = next_chunk++ * GENERATE_CHUNK;
+                if (begin >= num_nodes) {
+                    return;
+                }
+                for (size_t node = begin; node < std::min(begin + GENERATE_CHUNK, num_nodes); ++node) {
+                    check(solver, robot, node);
+                }
+            }
+        };
+
+        Thor::TaskGroup group;
+        for (size_t i = 0; i < Thor::Pool::shared().size(); ++i) {
+            group.run(worker);
+        }
+        worker();
+        group.wait();
+    }
+
+}
+
+MotionLattice::MotionLattice() :
+    nodes(0), num_nodes(0), flags(nullptr), mapping(nullptr), mapping_length(0), fingerprint(0) { }
+
+MotionLattice::~MotionLattice() {
+    unmap();
+}
+
+void MotionLattice::unmap() {
+    if (mapping) {
+        munmap(mapping, mapping_length);
+        mapping = nullptr;
+        mapping_length = 0;
+    }
+}
+
+void MotionLattice::init(const ArmModel &model, size_t nodes_per_joint) {
+    nodes = nodes_per_joint;
+    num_nodes = 1;
+    for (size_t i = NUM_JOINTS; i > 0; --i) {
+        const JointModel &joint = model.joints[i - 1];
+        lower[i - 1] = joint.limits[0];
+        spacing[i - 1] = (joint.limits[1] - joint.limits[0]) / (nodes - 1);
+        stride[i - 1] = num_nodes;
+        num_nodes *= nodes;
+    }
+
+    // Everything which nodes and steps are safe depends on
+    fingerprint = FINGERPRINT_BASIS;
+    fingerprint_add(fingerprint, static_cast<uint64_t>(nodes));
+
+    for (const JointModel &joint : model.joints) {
+        fingerprint_add(fingerprint, joint.pos_local);
+        fingerprint_add(fingerprint, joint.rot_axis);
+        fingerprint_add(fingerprint, joint.limits[0]);
+        fingerprint_add(fingerprint, joint.limits[1]);
+    }
+
+    for (const AvoidanceLinkModel &link : model.avoidance_links) {
+        fingerprint_add(fingerprint, static_cast<uint64_t>(link.joint_origin));
+        fingerprint_add(fingerprint, static_cast<uint32_t>(link.type));
+        fingerprint_add(fingerprint, link.radius);
+        fingerprint_add(fingerprint, link.points[0]);
+        fingerprint_add(fingerprint, link.points[1]);
+    }
+
+    for (const std::array<size_t, 2> &pair : model.collision_pairs) {
+        fingerprint_add(fingerprint, static_cast<uint64_t>(pair[0]));
+        fingerprint_add(fingerprint, static_cast<uint64_t>(pair[1]));
+    }
+}
+
+Vector6d MotionLattice::node_angles(size_t node) const {
+    Vector6d angles;
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        angles(i) = lower[i] + (node / stride[i] % nodes) * spacing[i];
+    }
+    return angles;
+}
+
+void MotionLattice::generate(const ArmModel &model, size_t nodes_per_joint) {
+    unmap();
+    init(model, nodes_per_joint);
+    generated.assign(num_nodes, 0);
+    flags = generated.data();
+
+    for_each_node(num_nodes, [this](KinematicsSolver &solver, ArmState &robot, size_t node) {
+        if (solver.is_safe(robot, vector6dToVec(node_angles(node)))) {
+            generated[node] = NODE_SAFE;
+        }
+    }, model);
+
+    // Each node checks its steps up, the step down from the next node is the
+    // same motion the other way. A task only writes its own nodes' flags
+    std::vector<uint8_t> up(num_nodes, 0);
+    for_each_node(num_nodes, [this, &up](KinematicsSolver &solver, ArmState &robot, size_t node) {
+        if (!(generated[node] & NODE_SAFE)) {
+            return;
+        }
+        Vector6d angles = node_angles(node);
+        for (size_t j = 0; j < NUM_JOINTS; ++j) {
+            size_t next = node + stride[j];
+            if (node / stride[j] % nodes + 1 < nodes && (generated[next] & NODE_SAFE) &&
+                solver.is_safe_motion(robot, angles, node_angles(next))) {
+                up[node] |= 1u << j;
+            }
+        }
+    }, model);
+
+    for (size_t node = 0; node < num_nodes; ++node) {
+        for (size_t j = 0; j < NUM_JOINTS; ++j) {
+            if (up[node] & (1u << j)) {
+                generated[node] |= 1u << (2 * j);
+                generated[node + stride[j]] |= 1u << (2 * j + 1);
+            }
+        }
+    }
+}
+
+bool MotionLattice::save(const std::string &filepath) const {
+    if (empty()) {
+        return false;
+    }
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        std::cout << "Could not write motion lattice " << filepath << "\n";
+        return false;
+    }
+
+    Header header = { MOTION_LATTICE_MAGIC, MOTION_LATTICE_VERSION, fingerprint, static_cast<uint32_t>(nodes), 0 };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(flags), num_nodes * sizeof(uint16_t));
+
+    return static_cast<bool>(file);
+}
+
+bool MotionLattice::load(const std::string &filepath, const ArmModel &model) {
+    unmap();
+    generated.clear();
+    flags = nullptr;
+
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = st.st_size;
+    void *data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+
+    bool valid = header.magic == MOTION_LATTICE_MAGIC && header.version == MOTION_LATTICE_VERSION &&
+                 header.nodes > 1;
+    if (valid) {
+        init(model, header.nodes);
+        valid = header.fingerprint == fingerprint && length == sizeof(Header) + num_nodes * sizeof(uint16_t);
+    }
+
+    if (!valid) {
+        std::cout << "Motion lattice " << filepath << " is not for this arm geometry, regenerate it\n";
+        munmap(data, length);
+        nodes = 0;
+        num_nodes = 0;
+        return false;
+    }
+
+    mapping = data;
+    mapping_length = length;
+    flags = reinterpret_cast<const uint16_t *>(static_cast<const char *>(data) + sizeof(Header));
+    return true;
+}
+
+bool MotionLattice::empty() const {
+    return flags == nullptr;
+}
+
+size_t MotionLattice::num_safe_nodes() const {
+    size_t count = 0;
+    for (size_t node = 0; node < num_nodes; ++node) {
+        count += (flags[node] & NODE_SAFE) ? 1 : 0;
+    }
+    return count;
+}
+
+size_t MotionLattice::num_safe_steps() const {
+    size_t count = 0;
+    for (size_t node = 0; node < num_nodes; ++node) {
+        for (size_t j = 0; j < NUM_JOINTS; ++j) {
+            count += (flags[node] >> (2 * j)) & 1;
+        }
+    }
+    return count;
+}
+
+void MotionLattice::nearest_nodes(const Vector6d &angles, std::vector<size_t> &nearest) const {
+    // the nodes at the corners of the grid cell angles is in
+    std::array<std::array<size_t, 2>, NUM_JOINTS> around;
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        double position = std::min(std::max((angles(i) - lower[i]) / spacing[i], 0.0), nodes - 1.0);
+        around[i][0] = static_cast<size_t>(std::floor(position));
+        around[i][1] = static_cast<size_t>(std::ceil(position));
+    }
+
+    std::vector<std::pair<double, size_t> > corners;
+    for (size_t corner = 0; corner < (1u << NUM_JOINTS); ++corner) {
+        size_t node = 0;
+        for (size_t i = 0; i < NUM_JOINTS; ++i) {
+            node += around[i][(corner >> i) & 1] * stride[i];
+        }
+        if (flags[node] & NODE_SAFE) {
+            corners.emplace_back((node_angles(node) - angles).norm(), node);
+        }
+    }
+
+    // corners on a grid line come up more than once
+    std::sort(corners.begin(), corners.end());
+    corners.erase(std::unique(corners.begin(), corners.end()), corners.end());
+
+    nearest.clear();
+    for (size_t i = 0; i < corners.size() && nearest.size() < MOTION_LATTICE_ENTRY_TRIES; ++i) {
+        nearest.push_back(corners[i].second);
+    }
+}
+
+bool MotionLattice::find_path(ArmState &robot, KinematicsSolver &solver, const Vector6d &start, const Vector6d &goal,
+                              std::vector<Vector6d> &path) const {
+    if (empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        if (robot.get_joint_locked(i)) {
+            return false;
+        }
+    }
+
+    std::vector<size_t> entries;
+    std::vector<size_t> exits;
+    nearest_nodes(start, entries);
+    nearest_nodes(goal, exits);
+    if (entries.empty() || exits.empty()) {
+        return false;
+    }
+
+    // Every step is at least as long as it brings a node closer to goal, so
+    // the distance left to goal never overestimates and the first exit taken
+    // ends the shortest path
+    struct Record {
+        double cost;
+        long parent;
+        bool closed;
+    };
+    std::unordered_map<size_t, Record> records;
+    typedef std::pair<double, size_t> Open;
+    std::priority_queue<Open, std::vector<Open>, std::greater<Open> > open;
+
+    for (size_t entry : entries) {
+        Vector6d angles = node_angles(entry);
+        if (solver.is_safe_motion(robot, start, angles)) {
+            double cost = (angles - start).norm();
+            records[entry] = { cost, -1, false };
+            open.emplace(cost + (goal - angles).norm(), entry);
+        }
+    }
+
+    long last = -1;
+    while (!open.empty() && last == -1) {
+        size_t node = open.top().second;
+        open.pop();
+
+        Record &record = records[node];
+        if (record.closed) {
+            continue;
+        }
+        record.closed = true;
+        double cost = record.cost;
+        Vector6d angles = node_angles(node);
+
+        if (std::find(exits.begin(), exits.end(), node) != exits.end() &&
+            solver.is_safe_motion(robot, angles, goal)) {
+            last = node;
+            break;
+        }
+
+        for (size_t j = 0; j < 2 * NUM_JOINTS; ++j) {
+            if (!(flags[node] & (1u << j))) {
+                continue;
+            }
+
+            size_t next = j % 2 == 0 ? node + stride[j / 2] : node - stride[j / 2];
+            double next_cost = cost + spacing[j / 2];
+            auto found = records.find(next);
+            if (found != records.end() && (found->second.closed || found->second.cost <= next_cost)) {
+                continue;
+            }
+
+            records[next] = { next_cost, static_cast<long>(node), false };
+            open.emplace(next_cost + (goal - node_angles(next)).norm(), next);
+        }
+    }
+
+    if (last == -1) {
+        return false;
+    }
+
+    path.clear();
+    path.push_back(goal);
+    for (long node = last; node != -1; node = records[node].parent) {
+        path.push_back(node_angles(node));
+    }
+    path.push_back(start);
+    std::reverse(path.begin(), path.end());
+
+    // the steps were only checked against the arm itself
+    if (robot.get_environment()) {
+        for (size_t i = 1; i + 2 < path.size(); ++i) {
+            if (!solver.is_safe_motion(robot, path[i], path[i + 1])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
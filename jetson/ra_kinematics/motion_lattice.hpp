@@ -0,0 +1,142 @@
+#ifndef MOTION_LATTICE_H
+#define MOTION_LATTICE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "arm_model.hpp"
+
+using namespace Eigen;
+
+typedef Matrix<double, 6, 1> Vector6d;
+
+class ArmState;
+class KinematicsSolver;
+
+// Nodes along each joint's range, from its lower to its upper limit
+static constexpr size_t MOTION_LATTICE_NODES = 8;
+
+// Nodes next to the start and the goal, nearest first, tried to get onto and off the lattice
+static constexpr size_t MOTION_LATTICE_ENTRY_TRIES = 8;
+
+// Identifies a motion lattice file, and its layout version
+static constexpr uint32_t MOTION_LATTICE_MAGIC = 0x6d61726c;
+static constexpr uint32_t MOTION_LATTICE_VERSION = 1;
+
+/**
+ * Precomputed lattice of collision checked motions through the joint space.
+ *
+ * The nodes are a grid over every joint's range. The motion primitives are
+ * the steps from a node to each of its 12 neighbors, moving one joint by one
+ * node. Each node records which of them is_safe_motion() found safe, so a
+ * plan between two configurations is an A* search that checks nothing but the
+ * motions onto the lattice from the start and off it to the goal. The same
+ * start and goal always give the same path.
+ *
+ * The lattice is generated once for a geometry with `$ make motion_lattice` and
+ * memory-mapped from the file, which also records a fingerprint of the geometry
+ * so a stale lattice is never used. It only knows about the arm itself, so the
+ * motions of a path are checked again when the arm has an environment.
+ * */
+class MotionLattice {
+private:
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fingerprint;
+        uint32_t nodes;
+        uint32_t padding;
+    };
+
+    // Bit 2 * j of a node is set if stepping joint j up to the next node is
+    // safe and bit 2 * j + 1 if stepping it down is, NODE_SAFE if the node is
+    static constexpr uint16_t NODE_SAFE = 1u << (2 * NUM_JOINTS);
+
+    // lower limit and node spacing of each joint, and how far apart in
+    // the flags the nodes one step apart along it are
+    std::array<double, NUM_JOINTS> lower;
+    std::array<double, NUM_JOINTS> spacing;
+    std::array<size_t, NUM_JOINTS> stride;
+    size_t nodes;
+    size_t num_nodes;
+
+    // the num_nodes = nodes^6 flags, joint f changing fastest. Points into mapping
+    // for a loaded lattice or into generated for one generated in memory
+    const uint16_t *flags;
+    std::vector<uint16_t> generated;
+
+    void *mapping;
+    size_t mapping_length;
+
+    uint64_t fingerprint;
+
+    /**
+     * Sets up the grid for model
+     * */
+    void init(const ArmModel &model, size_t nodes_per_joint);
+
+    void unmap();
+
+    Vector6d node_angles(size_t node) const;
+
+    /**
+     * Sets nearest to the safe nodes around angles, nearest first, at most
+     * MOTION_LATTICE_ENTRY_TRIES of them
+     * */
+    void nearest_nodes(const Vector6d &angles, std::vector<size_t> &nearest) const;
+
+public:
+
+    MotionLattice();
+
+    ~MotionLattice();
+
+    MotionLattice(const MotionLattice &) = delete;
+    MotionLattice &operator=(const MotionLattice &) = delete;
+
+    /**
+     * Checks every node and every step between neighboring nodes for model,
+     * with no joint locked
+     * */
+    void generate(const ArmModel &model, size_t nodes_per_joint = MOTION_LATTICE_NODES);
+
+    /**
+     * Writes a generated lattice to filepath
+     * @return true if the file was written
+     * */
+    bool save(const std::string &filepath) const;
+
+    /**
+     * Memory-maps a lattice written by save() for model's geometry
+     * @return false if the file can't be read or is for a different geometry
+     * */
+    bool load(const std::string &filepath, const ArmModel &model);
+
+    bool empty() const;
+
+    /**
+     * @return how many nodes are safe, and how many safe steps there are between them
+     * */
+    size_t num_safe_nodes() const;
+
+    size_t num_safe_steps() const;
+
+    /**
+     * Finds the shortest path in joint space from start to goal that gets onto
+     * the lattice at a node next to start, follows its steps and gets off it at
+     * a node next to goal. The motions onto and off the lattice are checked, and
+     * every step too if robot has an environment. Locked joints can't follow the
+     * lattice's steps, so there is no path with any joint locked
+     * @param path set to start, the nodes on the way and goal
+     * @return false if there is no such path
+     * */
+    bool find_path(ArmState &robot, KinematicsSolver &solver, const Vector6d &start, const Vector6d &goal,
+                   std::vector<Vector6d> &path) const;
+};
+
+#endif
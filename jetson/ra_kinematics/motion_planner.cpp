@@ -1,21 +1,32 @@
 #include "motion_planner.hpp"
+#include "thor.hpp"
 
+#include <algorithm>
 #include <random>
-#include <queue>
 #include <time.h>
 #include <cmath>
+#include <limits>
+#include <atomic>
+#include <mutex>
+
+namespace {
+
+    // planners for the workers of rrt_connect_parallel(), kept between plans
+    Thor::ObjectPool<MotionPlanner> &worker_planners() {
+        static Thor::ObjectPool<MotionPlanner> pool(16);
+        return pool;
+    }
+
+}
 
 
 MotionPlanner::MotionPlanner(const ArmState &robot, KinematicsSolver &solver_in) :
-        solver(solver_in) { 
+        solver(solver_in), planning_time(0), path_length(0) { 
     step_limits.reserve(6);
 
-    // add limits for each joint to joint_limits, after converting to degrees
+    // RRT steps are limited to how far each joint turns in RRT_STEP_TIME
     for (size_t i = 0; i < 6; ++i) {
-      std::vector<double> limits = robot.get_joint_limits(i);
-
-      joint_limits.push_back(limits);
-      step_limits.push_back(robot.get_joint_max_speed(i) / 50.0);
+      step_limits.push_back(robot.get_joint_max_speed(i) * RRT_STEP_TIME);
     }
 
     //time_t timer;
@@ -23,55 +34,45 @@ MotionPlanner::MotionPlanner(const ArmState &robot, KinematicsSolver &solver_in)
 }
 
 Vector6d MotionPlanner::sample(Vector6d start, const ArmState &robot) {
-    Vector6d z_rand;
+    return sampler.sample(robot, start);
+}
 
-    for (size_t i = 0; i < joint_limits.size(); ++i) {
-        if (robot.get_joint_locked(i)) {
-            // if joint is locked, z_rand matches start
-            z_rand(i) = start(i);
-        }
-        else { 
-            // create distribution of angles between limits and choose an angle
-            std::uniform_real_distribution<double> distr(joint_limits[i][0], joint_limits[i][1]);
-            z_rand(i) = distr(eng);
+Vector6d MotionPlanner::sample_informed(const Vector6d &start, const Vector6d &target, double best_cost,
+                                        const ArmState &robot) {
+    Vector6d z_rand = sample(start, robot);
+
+    for (int i = 1; i < INFORMED_SAMPLE_TRIES; ++i) {
+        if ((z_rand - start).norm() + (target - z_rand).norm() < best_cost) {
+            break;
         }
+        z_rand = sample(start, robot);
     }
 
     return z_rand;
 }
 
-MotionPlanner::Node* MotionPlanner::nearest(MotionPlanner::Node* tree_root, const Vector6d &rand) {
-    std::queue<Node*> q;
-    q.push(tree_root);
-
-    double min_dist = std::numeric_limits<double>::max();
-    Node* min_node = nullptr;
-
-    // Run breadth-first search for nearest node in tree
-    while (!q.empty()) {
-        Node* node = q.front();
-        q.pop();
-
-        double dist = (node->config - rand).norm();
-
-        if (dist < min_dist) {
-          min_dist = dist;
-          min_node = node;
-        }
+void MotionPlanner::Tree::reset(const Vector6d &root_config) {
+    nodes.clear();
+    index.clear();
+    add(root_config, -1, 0);
+}
 
-        for (Node* child : node->children) {
-          q.push(child);
-        }
-    }
+int MotionPlanner::Tree::add(const Vector6d &config, int parent, double cost) {
+    int node_index = static_cast<int>(nodes.size());
+    nodes.emplace_back(config, parent, cost);
+    index.insert(config, node_index);
+    return node_index;
+}
 
-    return min_node;
+int MotionPlanner::nearest(const MotionPlanner::Tree &tree, const Vector6d &rand) {
+    return static_cast<int>(tree.index.nearest(rand));
 }
 
 
-Vector6d MotionPlanner::steer(MotionPlanner::Node* start, const Vector6d &end) {
+Vector6d MotionPlanner::steer(const Vector6d &start, const Vector6d &end) {
 
     // calculate the vector from start position to end (each value is a change in angle)
-    Vector6d vec = end - start->config;
+    Vector6d vec = end - start;
 
     // check for any steps that are outside acceptable range
     bool step_too_big = false;
@@ -106,7 +107,7 @@ Vector6d MotionPlanner::steer(MotionPlanner::Node* start, const Vector6d &end) {
     }
     
     // find the biggest possible step from start directly towards end
-    Vector6d new_config = start->config;
+    Vector6d new_config = start;
     for (int i = 0; i < vec.size(); ++i) {
         new_config(i) += min_t * vec[i];
     }
@@ -114,81 +115,88 @@ Vector6d MotionPlanner::steer(MotionPlanner::Node* start, const Vector6d &end) {
     return new_config;
 }
 
-std::vector<Vector6d> MotionPlanner::backtrace_path(MotionPlanner::Node* end, MotionPlanner::Node* root) {
-    std::vector<Vector6d> path;
-
-    // starting at end, add each position config to path
-    while (true) {
-        path.push_back(end->config);
-
-        if (end == root) {
-            return path;
-        }
-
-        end = end->parent;
+double MotionPlanner::path_cost(const MotionPlanner::Tree &tree, int node) const {
+    double cost = 0;
+    for (int node_index = node; node_index != -1; node_index = tree.nodes[node_index].parent) {
+        cost += tree.nodes[node_index].cost;
     }
+    return cost;
 }
 
-void MotionPlanner::delete_tree(MotionPlanner::Node* twig) {
-    if (!twig) {
-        return;
-    }
-    while (twig->parent) {
-        twig = twig->parent;
-    }
-
-    delete_tree_helper(twig);
-}
-
-void MotionPlanner::delete_tree_helper(MotionPlanner::Node* root) {
-    if (root) {
-        for (Node* child : root->children) {
-            delete_tree_helper(child);
-        }
+std::vector<Vector6d> MotionPlanner::backtrace_path(const MotionPlanner::Tree &tree, int end) {
+    std::vector<Vector6d> path;
 
-        delete root;
+    // starting at end, add each position config to path
+    for (int node_index = end; node_index != -1; node_index = tree.nodes[node_index].parent) {
+        path.push_back(tree.nodes[node_index].config);
     }
+
+    return path;
 }
 
-MotionPlanner::Node* MotionPlanner::extend(ArmState &robot, Node* tree, const Vector6d &z_rand) {
+int MotionPlanner::extend(ArmState &robot, Tree &tree, const Vector6d &z_rand) {
 
     // z_nearest is the nearest node in the tree to z_rand
-    Node* z_nearest = nearest(tree, z_rand);
+    int z_nearest = nearest(tree, z_rand);
+    Vector6d z_nearest_config = tree.nodes[z_nearest].config;
 
     // z_new is the set of angles extending from z_nearest towards z_rand, within step_limits
-    Vector6d z_new_6d = steer(z_nearest, z_rand);
+    Vector6d z_new_6d = steer(z_nearest_config, z_rand);
 
-    std::vector<double> z_new = vector6dToVec(z_new_6d);
-
-    // check that we have not violated joint limits or created collisions
-    if (!solver.is_safe(robot, z_new)) {
-        return nullptr;
+    // check that we have not violated joint limits or created collisions anywhere on the edge
+    if (!solver.is_safe_motion(robot, z_nearest_config, z_new_6d)) {
+        return -1;
     }
 
-    // create dynamic node branching from tree
-    Node* new_node = new Node(z_new_6d);
-    new_node->parent = z_nearest;
+    int parent = z_nearest;
+    double new_cost = path_cost(tree, z_nearest) + (z_nearest_config - z_new_6d).norm();
 
-    // cost is previous cost + distance to new set of angles
-    new_node->cost = z_nearest->cost + (z_nearest->config - z_new_6d).norm();
+    // RRT*: branch from whichever nearby node reaches z_new most cheaply
+    if (planning_time > 0) {
+        tree.index.within(z_new_6d, RRT_STAR_RADIUS, near_nodes);
 
-    // add new_node to tree
-    z_nearest->children.push_back(new_node);
+        for (size_t near : near_nodes) {
+            const Vector6d &near_config = tree.nodes[near].config;
+            double cost = path_cost(tree, near) + (near_config - z_new_6d).norm();
+            if (cost < new_cost && solver.is_safe_motion(robot, near_config, z_new_6d)) {
+                parent = near;
+                new_cost = cost;
+            }
+        }
+    }
+
+    // add a node branching from parent to tree
+    int new_node = tree.add(z_new_6d, parent, (tree.nodes[parent].config - z_new_6d).norm());
+
+    // RRT*: reach nearby nodes through z_new if that's cheaper. A node's cost only
+    // counts the edge to its parent, so the nodes below it get cheaper as well
+    if (planning_time > 0) {
+        for (size_t near : near_nodes) {
+            Vector6d near_config = tree.nodes[near].config;
+            double edge = (near_config - z_new_6d).norm();
+            if (new_cost + edge < path_cost(tree, near) && solver.is_safe_motion(robot, z_new_6d, near_config)) {
+                tree.nodes[near].parent = new_node;
+                tree.nodes[near].cost = edge;
+            }
+        }
+    }
 
     return new_node;
 }
 
-MotionPlanner::Node* MotionPlanner::connect(ArmState &robot, Node* tree, const Vector6d &a_new) {
-    Node* extension;
+int MotionPlanner::connect(ArmState &robot, Tree &tree, const Vector6d &a_new) {
+    int extension;
 
     do {
         extension = extend(robot, tree, a_new);
-    } while (extension && extension->config != a_new);
+    } while (extension != -1 && tree.nodes[extension].config != a_new);
 
     return extension;
 }
 
-bool MotionPlanner::rrt_connect(ArmState &robot, const Vector6d &target_angles) {
+bool MotionPlanner::rrt_connect(ArmState &robot, const Vector6d &target_angles,
+                                const std::function<bool()> &canceled) {
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 
     // retrieve starting and target joint angles
     Vector6d start;
@@ -201,137 +209,357 @@ bool MotionPlanner::rrt_connect(ArmState &robot, const Vector6d &target_angles)
 
     Vector6d target = target_angles;
 
-    start_root = new Node(start);
-    goal_root =  new Node(target);
+    start_tree.reset(start);
+    goal_tree.reset(target);
 
-    for (int i = 0; i < MAX_RRT_ITERATIONS; ++i) {
-        Node* a_root = i % 2 == 0 ? start_root : goal_root;
-        Node* b_root = i % 2 == 0 ? goal_root : start_root;
-        Vector6d z_rand = sample(start, robot);
+    // where the trees meet on the shortest path found so far
+    int best_start_node = -1;
+    int best_goal_node = -1;
+    double best_cost = std::numeric_limits<double>::max();
 
-        Node* a_new = extend(robot, a_root, z_rand);
+    for (int i = 0; ; ++i) {
+        bool found = best_start_node != -1;
 
-        if (a_new) {
+        // search until the first path is found, then for RRT* until time runs out
+        if ((!found && i >= MAX_RRT_ITERATIONS) || (canceled && canceled())) {
+            break;
+        }
+        if (found) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+            if (planning_time <= 0 || elapsed.count() >= planning_time) {
+                break;
+            }
 
-            Node* b_new = connect(robot, b_root, a_new->config);
+            // rewiring may have shortened the best path since it was found
+            best_cost = path_cost(start_tree, best_start_node) + path_cost(goal_tree, best_goal_node);
+        }
 
-            // if the trees are connected
-            if (b_new && a_new->config == b_new->config) {
-                std::vector<Vector6d> a_path = backtrace_path(a_new, a_root);
-                std::vector<Vector6d> b_path = backtrace_path(b_new, b_root);
+        bool a_is_start = i % 2 == 0;
+        Tree &a_tree = a_is_start ? start_tree : goal_tree;
+        Tree &b_tree = a_is_start ? goal_tree : start_tree;
+        Vector6d z_rand = found ? sample_informed(start, target, best_cost, robot) : sample(start, robot);
 
-                // reverse a_path
-                for (size_t j = 0; j < a_path.size() / 2; ++j) {
-                    std::swap(a_path[j], a_path[a_path.size() - 1 - j]);
-                }
+        int a_new = extend(robot, a_tree, z_rand);
 
-                // add the intersection of the paths to a_path
-                Vector6d middle;
-                for (int j = 0; j < 6; ++j) {
-                    middle(j) = a_new->config(j);
-                }
+        if (a_new != -1) {
+            const Vector6d &a_new_config = a_tree.nodes[a_new].config;
 
-                a_path.push_back(middle);
-                a_path.reserve(a_path.size() + b_path.size());
+            int b_new = connect(robot, b_tree, a_new_config);
 
-                for (Vector6d b : b_path) {
-                    a_path.push_back(b);
+            // if the trees are connected
+            if (b_new != -1 && a_new_config == b_tree.nodes[b_new].config) {
+                int start_node = a_is_start ? a_new : b_new;
+                int goal_node = a_is_start ? b_new : a_new;
+
+                double cost = path_cost(start_tree, start_node) + path_cost(goal_tree, goal_node);
+                if (cost < best_cost) {
+                    best_start_node = start_node;
+                    best_goal_node = goal_node;
+                    best_cost = cost;
                 }
+            }
+        }
+    } // for loop
 
-                // reverse entire path if a_root is the goal
-                if (i % 2 != 0) {
-                    for (size_t j = 0; j < a_path.size() / 2; ++j) {
-                        std::swap(a_path[j], a_path[a_path.size() - 1 - j]);
-                    }
-                }
+    // if no path found, make sure spline is empty
+    if (best_start_node == -1) {
+        spline.clear();
+        spline_path.clear();
+        return false;
+    }
 
-                spline_size = a_path.size();
+    std::vector<Vector6d> path = join_paths(best_start_node, best_goal_node);
+    shortcut_path(robot, path);
 
-                spline_fitting(a_path);
+    return fit_path(robot, path);
+}
 
-                // delete trees before returning
-                delete_tree(start_root);
-                delete_tree(goal_root);
+bool MotionPlanner::fit_path(ArmState &robot, std::vector<Vector6d> path) {
+    // A spline through few waypoints can swing away from the straight edges
+    // that were checked, so add waypoints until it follows them closely enough.
+    // Where it first collides is repaired first, since the rest of it is
+    // likely fine, then the whole path is made denser
+    spline_fitting(path);
+    int repairs = 0;
+    int rounds = 0;
+    for (double hit = spline_collision(robot); hit >= 0; hit = spline_collision(robot)) {
+        if (path.size() < 2 || (repairs == SPLINE_REPAIR_ROUNDS && rounds == SPLINE_REFINE_ROUNDS)) {
+            spline.clear();
+            spline_path.clear();
+            return false;
+        }
 
-                return true;
-            }
+        // the segments on either side of the one that collides pull on it too
+        size_t first = 0;
+        size_t last = path.size() - 2;
+        if (repairs < SPLINE_REPAIR_ROUNDS) {
+            ++repairs;
+            size_t segment = std::min(static_cast<size_t>(hit * (path.size() - 1)), last);
+            first = segment > 0 ? segment - 1 : 0;
+            last = std::min(segment + 1, last);
+        }
+        else {
+            ++rounds;
+        }
 
+        denser_path.clear();
+        denser_path.reserve(path.size() + last - first + 1);
+        for (size_t j = 0; j + 1 < path.size(); ++j) {
+            denser_path.push_back(path[j]);
+            if (j >= first && j <= last) {
+                denser_path.push_back((path[j] + path[j + 1]) / 2);
+            }
         }
-        
-    } // for loop
+        denser_path.push_back(path.back());
+        path.swap(denser_path);
+
+        spline_fitting(path);
+    }
 
-    delete_tree(start_root);
-    delete_tree(goal_root);
+    spline_size = path.size();
 
-    // if no path found, make sure splines is empty
-    splines = std::vector<tk::spline>();
-    return false;
+    path_length = 0;
+    for (size_t j = 0; j + 1 < path.size(); ++j) {
+        path_length += (path[j + 1] - path[j]).norm();
+    }
 
+    spline_path.swap(path);
+    return true;
 }
 
-void MotionPlanner::spline_fitting(const std::vector<Vector6d> &path) {
+const std::vector<Vector6d> &MotionPlanner::get_spline_path() const {
+    return spline_path;
+}
 
-    // six vectors, each with the path of a single component
-    std::vector< std::vector<double> > separate_paths;
-    separate_paths.resize(6, std::vector<double>(path.size()));
+bool MotionPlanner::rrt_connect_parallel(ArmState &robot, const Vector6d &target_angles, int num_planners,
+                                         const std::function<bool()> &canceled) {
+    std::mutex result_mtx;
+    bool found = false;
+
+    std::atomic<int> next_planner(0);
+    std::atomic<bool> done(false);
+
+    // Each planner gets its own seed, so its result doesn't depend on which
+    // thread happens to run it
+    std::default_random_engine::result_type base_seed = eng();
+
+    // Without a planning time, the first path found stops everyone
+    std::function<bool()> stop = [&]() { return done.load() || (canceled && canceled()); };
+
+    // The results are written back to this while other workers may still
+    // be starting, so they copy the planner from before any of them ran
+    const MotionPlanner base_planner = *this;
+
+    auto worker = [&]() {
+        // Planning mutates the planner and state, so each thread works on copies.
+        // The planner comes from the pool, so its trees keep their memory from
+        // earlier plans instead of growing from nothing every time
+        std::shared_ptr<MotionPlanner> pooled_planner = worker_planners().acquire(base_planner);
+        MotionPlanner &thread_planner = *pooled_planner;
+        ArmState thread_state = robot;
+
+        while (!done) {
+            int planner = next_planner++;
+            if (planner >= num_planners) {
+                break;
+            }
 
-    // convert path to vectors
-    for (size_t i = 0; i < path.size(); ++i) {
-        for (size_t j = 0; j < 6; ++j) {
-            separate_paths[j][i] = path[i](j);
+            thread_planner.eng.seed(base_seed + planner);
+            thread_planner.sampler.seed(base_seed + planner);
+            if (!thread_planner.rrt_connect(thread_state, target_angles, stop)) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(result_mtx);
+            if (!found || thread_planner.path_length < path_length) {
+                found = true;
+                spline = thread_planner.spline;
+                spline_path = thread_planner.spline_path;
+                spline_size = thread_planner.spline_size;
+                path_length = thread_planner.path_length;
+            }
+            if (planning_time <= 0) {
+                done = true;
+            }
         }
+    };
+
+    // one worker per core of the shared pool, this thread being one of them
+    int num_workers = std::max(1, std::min(num_planners, (int) Thor::Pool::shared().size() + 1));
+    Thor::TaskGroup group;
+    for (int i = 1; i < num_workers; ++i) {
+        group.run(worker);
     }
+    worker();
+    group.wait();
 
-    // create a linear space between 0 and 1 with path.size() increments
-    std::vector<double> x_;
-    x_.reserve(path.size());
+    // if no path found, make sure spline is empty
+    if (!found) {
+        spline.clear();
+        spline_path.clear();
+    }
+    return found;
+}
 
-    // find ideal step size for x_, handling edge cases
-    double spline_step;
-    if (path.size() > 1) {
-        spline_step = 1.0 / (path.size() - 1);
+bool MotionPlanner::lattice_connect(ArmState &robot, const MotionLattice &lattice, const Vector6d &target_angles) {
+    std::vector<Vector6d> path;
+    if (!lattice.find_path(robot, solver, robot.get_joint_angles_6d(), target_angles, path)) {
+        return false;
     }
-    else if (path.size() == 1) {
-        for (size_t i = 0; i < 6; ++i) {
-            separate_paths[i].push_back(separate_paths[i][0]);
+
+    straighten_path(robot, path);
+    return fit_path(robot, path);
+}
+
+void MotionPlanner::set_planning_time(double seconds) {
+    planning_time = seconds;
+}
+
+void MotionPlanner::set_sampling_mode(SamplingMode mode) {
+    sampler.set_mode(mode);
+}
+
+std::vector<Vector6d> MotionPlanner::join_paths(int start_node, int goal_node) {
+    std::vector<Vector6d> path = backtrace_path(start_tree, start_node);
+    std::reverse(path.begin(), path.end());
+
+    // the goal tree's path starts with the same config the start tree's path ends with
+    std::vector<Vector6d> goal_path = backtrace_path(goal_tree, goal_node);
+    path.insert(path.end(), goal_path.begin() + 1, goal_path.end());
+
+    return path;
+}
+
+void MotionPlanner::shortcut_path(ArmState &robot, std::vector<Vector6d> &path) {
+    for (int attempt = 0; attempt < SHORTCUT_ATTEMPTS && path.size() > 2; ++attempt) {
+        std::uniform_int_distribution<size_t> distr(0, path.size() - 1);
+        size_t first = distr(eng);
+        size_t last = distr(eng);
+        if (first > last) {
+            std::swap(first, last);
+        }
+
+        // only pays off if there are waypoints to skip
+        if (last - first < 2) {
+            continue;
+        }
+
+        if (solver.is_safe_motion(robot, path[first], path[last])) {
+            path.erase(path.begin() + first + 1, path.begin() + last);
         }
-        spline_step = 1.0;
     }
-    else {
-        std::cout << "Error! Path is of size 0.\n";
+}
+
+void MotionPlanner::straighten_path(ArmState &robot, std::vector<Vector6d> &path) {
+    for (size_t first = 0; first + 2 < path.size(); ++first) {
+        for (size_t last = path.size() - 1; last > first + 1; --last) {
+            if (solver.is_safe_motion(robot, path[first], path[last])) {
+                path.erase(path.begin() + first + 1, path.begin() + last);
+                break;
+            }
+        }
     }
+}
 
-    // create evenly distributed range from 0 to 1 with path.size() steps
-    for (double i = 0.0; i <= 1.0; i += spline_step) {
-        x_.push_back(i);
+double MotionPlanner::spline_collision(ArmState &robot) {
+    // the length of the splines, roughly, sets how many points are checked
+    Vector6d previous, current;
+    get_spline_pos(0, previous);
+    double length = 0;
+    for (int i = 1; i <= SPLINE_CHECK_STEPS; ++i) {
+        get_spline_pos(static_cast<double>(i) / SPLINE_CHECK_STEPS, current);
+        length += (current - previous).norm();
+        previous = current;
     }
+    int steps = static_cast<int>(std::ceil(length / SPLINE_CHECK_SPACING));
+    steps = std::max(SPLINE_CHECK_STEPS, std::min(steps, SPLINE_MAX_CHECK_STEPS));
 
-    // recover from possible floating point issues
-    if (x_.size() == path.size()) {
-        x_[x_.size() - 1] = 1.0;
+    spline_samples.resize(steps + 1);
+    for (int i = 0; i <= steps; ++i) {
+        get_spline_pos(static_cast<double>(i) / steps, spline_samples[i]);
     }
-    else if (x_.size() == path.size() - 1) {
-        x_.push_back(1.0);
+
+    // motion i is from point i to point i + 1. Chunks of them are claimed in
+    // order, and nothing after the first collision found so far is checked
+    int num_chunks = (steps + SPLINE_CHECK_CHUNK - 1) / SPLINE_CHECK_CHUNK;
+    std::atomic<int> next_chunk(0);
+    std::atomic<int> first_hit(steps);
+
+    auto check_chunks = [&](KinematicsSolver &checker, ArmState &state) {
+        while (true) {
+            int chunk = next_chunk++;
+            int begin = chunk * SPLINE_CHECK_CHUNK;
+            if (chunk >= num_chunks || begin >= first_hit) {
+                return;
+            }
+
+            int end = std::min(begin + SPLINE_CHECK_CHUNK, steps);
+            for (int i = begin; i < end && i < first_hit; ++i) {
+                if (!checker.is_safe_motion(state, spline_samples[i], spline_samples[i + 1])) {
+                    int hit = first_hit.load();
+                    while (i < hit && !first_hit.compare_exchange_weak(hit, i)) { }
+
+                    // the chunks left are all after this one
+                    return;
+                }
+            }
+        }
+    };
+
+    if (num_chunks == 1) {
+        check_chunks(solver, robot);
     }
     else {
-        std::cout << "Error! Could not create properly sized spline.\n";
+        // Checking a motion moves the state and uses the solver's stack, so
+        // the other workers check with copies. They copy these, since this
+        // thread starts checking with the originals right away
+        const KinematicsSolver base_solver = solver;
+        const ArmState base_state = robot;
+
+        auto worker = [&]() {
+            if (next_chunk >= num_chunks) {
+                return;
+            }
+            KinematicsSolver thread_solver = base_solver;
+            ArmState thread_state = base_state;
+            check_chunks(thread_solver, thread_state);
+        };
+
+        int num_workers = std::min(num_chunks, (int) Thor::Pool::shared().size() + 1);
+        Thor::TaskGroup group;
+        for (int i = 1; i < num_workers; ++i) {
+            group.run(worker);
+        }
+        check_chunks(solver, robot);
+        group.wait();
     }
 
-    // use tk to create six different splines, representing a spline in 6 dimensions
-    splines.clear();
-    splines.resize(6);
-    for (size_t i = 0; i < 6; ++i) {
-        splines[i].set_points(x_, separate_paths[i]);
+    if (first_hit == steps) {
+        return -1;
     }
+    return (first_hit + 0.5) / steps;
 }
 
-std::vector<double> MotionPlanner::get_spline_pos(double spline_t) {
-    std::vector<double> angles;
-    angles.reserve(6);
-
-    for (const tk::spline &spline : splines) {
-        angles.emplace_back(spline(spline_t));
+void MotionPlanner::spline_fitting(const std::vector<Vector6d> &path) {
+    if (path.empty()) {
+        std::cout << "Error! Path is of size 0.\n";
     }
 
-    return angles;
+    // the path's points are spread evenly over spline_t from 0 to 1
+    spline.fit(path);
+}
+
+std::vector<double> MotionPlanner::get_spline_pos(double spline_t) const {
+    Vector6d angles;
+    get_spline_pos(spline_t, angles);
+
+    return std::vector<double>(angles.data(), angles.data() + 6);
+}
+
+void MotionPlanner::get_spline_pos(double spline_t, Vector6d &angles) const {
+    spline.get_pos(spline_t, angles);
+}
+
+void MotionPlanner::get_spline_deriv(double spline_t, int order, Vector6d &derivs) const {
+    spline.get_deriv(spline_t, order, derivs);
 }
@@ -4,18 +4,55 @@
 #include <vector>
 #include <map>
 #include <random>
+#include <chrono>
+#include <functional>
 
 #include <eigen3/Eigen/Dense>
-#include "kluge/spline.h"
 
 #include "arm_state.hpp"
 #include "kinematics.hpp"
+#include "kd_tree.hpp"
+#include "joint_spline.hpp"
+#include "joint_sampler.hpp"
+#include "motion_lattice.hpp"
 #include "utils.hpp"
 
 using namespace Eigen;
 
 static constexpr int MAX_RRT_ITERATIONS = 500;
 
+// steer() moves each joint at most as far as it turns in this many seconds at max
+// speed. Edges are checked along their length, so steps can be this big
+static constexpr double RRT_STEP_TIME = 1.0;
+
+// Random shortcuts tried on each path before fitting splines to it
+static constexpr int SHORTCUT_ATTEMPTS = 100;
+
+// In RRT* mode, new nodes pick the best parent among, and try to shorten the
+// paths of, the nodes within this many radians
+static constexpr double RRT_STAR_RADIUS = 1.0;
+
+// Samples drawn to find one that could shorten the best path, before using any sample
+static constexpr int INFORMED_SAMPLE_TRIES = 50;
+
+// Points of the fitted splines checked for collisions, and how many times the
+// path is made denser to pull the splines closer to it if they collide
+static constexpr int SPLINE_CHECK_STEPS = 50;
+static constexpr int SPLINE_REFINE_ROUNDS = 4;
+
+// The fitted splines are checked at points this many radians apart in joint
+// space, but at no more than SPLINE_MAX_CHECK_STEPS of them
+static constexpr double SPLINE_CHECK_SPACING = 0.02;
+static constexpr int SPLINE_MAX_CHECK_STEPS = 2000;
+
+// Motions between spline points each task checks when the check is split
+// across the thread pool, shorter splines are checked on the calling thread
+static constexpr int SPLINE_CHECK_CHUNK = 32;
+
+// Times waypoints are added only around where the splines first collide,
+// before the whole path is made denser
+static constexpr int SPLINE_REPAIR_ROUNDS = 8;
+
 /**
  * Use rrt_connect() to map out a path to the target position.
  * */
@@ -23,41 +60,76 @@ class MotionPlanner {
 private:
 
     /**
-     * RRT Node
+     * RRT Node, kept in its Tree's nodes and linked to its parent by index
      * */
-    class Node {
-        friend class MotionPlanner;
-    private:
+    struct Node {
+        Node(const Vector6d &config_in, int parent_in, double cost_in) :
+            config(config_in), parent(parent_in), cost(cost_in) { }
+
         Vector6d config;
-        
-        Node* parent;
-        std::vector<Node*> children;
+
+        // index of the parent in the same tree, -1 for the root
+        int parent;
+
+        // length of the edge from the parent, the cost of reaching the node
+        // is the sum along the way from the root, see path_cost()
         double cost;
+    };
+
+    /**
+     * One of the two RRT trees. Its nodes are stored together, the root
+     * first, so clearing it for the next plan keeps the memory and adding
+     * a node usually doesn't allocate
+     * */
+    struct Tree {
+        std::vector<Node> nodes;
+
+        // nodes by their index, for nearest()
+        KDTree index;
 
-    public:
-        Node(Vector6d config_in) : config(config_in), parent(nullptr), cost(0) { }
-    }; // Node class
+        void reset(const Vector6d &root_config);
+
+        /**
+         * @return index of the new node
+         * */
+        int add(const Vector6d &config, int parent, double cost);
+    };
 
     KinematicsSolver solver;
 
-    std::vector<tk::spline> splines;
+    JointSpline spline;
 
-    /**
-     * joint_limits[i][0 | 1] returns i'th lower/upper limit in degrees
-     * */
-    std::vector< std::vector<double> > joint_limits;
+    // the waypoints spline was fit through
+    std::vector<Vector6d> spline_path;
 
     std::vector<double> step_limits;
 
-    Node* start_root;
-    Node* goal_root;
+    Tree start_tree;
+    Tree goal_tree;
 
-    // random engine for sample()
+    // random engine for picking shortcuts
     std::default_random_engine eng;
 
+    // draws the samples of sample()
+    JointSampler sampler;
+
+    // seconds rrt_connect() spends improving the path with RRT*, 0 to return the first path
+    double planning_time;
+
+    // scratch space for the nodes near a new node in RRT* mode
+    std::vector<size_t> near_nodes;
+
     // for testing only
     int spline_size;
 
+    // length in joint space of the path the splines were fit to
+    double path_length;
+
+    // scratch space for the points spline_collision() checks, and for the
+    // path fit_path() adds waypoints to
+    std::vector<Vector6d> spline_samples;
+    std::vector<Vector6d> denser_path;
+
 public:
     
     MotionPlanner(const ArmState &robot, KinematicsSolver &solver_in);
@@ -68,15 +140,82 @@ public:
      * @param robot starting state with current joint angles
      * @param target the set of joint angles the algorithm must reach
      * 
+     * @param canceled optional, checked every iteration and stops the search
+     * when it returns true
+     * 
+     * @return true if a path was found
+     * */
+    bool rrt_connect(ArmState &robot, const Vector6d &target_angles,
+                     const std::function<bool()> &canceled = std::function<bool()>());
+
+    /**
+     * Runs num_planners independent copies of rrt_connect() with their own
+     * seeds at once on a pool of threads, each with its own copy of robot.
+     * Without a planning time, the first path found is used and the other
+     * planners stop. With one, every planner runs for the whole budget and
+     * the shortest path is used.
+     * 
+     * @param canceled optional, stops every planner like it stops rrt_connect()
+     * 
      * @return true if a path was found
      * */
-    bool rrt_connect(ArmState &robot, const Vector6d &target_angles);
+    bool rrt_connect_parallel(ArmState &robot, const Vector6d &target_angles, int num_planners,
+                              const std::function<bool()> &canceled = std::function<bool()>());
+
+    /**
+     * Makes rrt_connect() an anytime planner. After the trees first connect,
+     * it keeps growing them for the rest of seconds (counted from the start
+     * of planning) as RRT* does, choosing the cheapest parent for new nodes
+     * and rewiring nodes near them through them, and sampling only where a
+     * node could make the path shorter. The shortest connection found is used.
+     * @param seconds the planning time budget, 0 (the default) returns the first path found
+     * */
+    void set_planning_time(double seconds);
+
+    /**
+     * @param mode how sample() draws configs, uniformly by default
+     * */
+    void set_sampling_mode(SamplingMode mode);
+
+    /**
+     * Plans along lattice instead of with RRT, so the same start and target
+     * always give the same path. The lattice's path is straightened with
+     * straighten_path() and fit like the paths rrt_connect() finds
+     * @return false if the lattice has no path or its spline can't be made
+     * safe, rrt_connect() is needed then
+     * */
+    bool lattice_connect(ArmState &robot, const MotionLattice &lattice, const Vector6d &target_angles);
+
+    /**
+     * Fits the spline through path, adding waypoints between the ones there
+     * until the spline is safe, as rrt_connect() does with the paths it finds
+     * @return true if the spline could be made safe, otherwise the spline is empty
+     * */
+    bool fit_path(ArmState &robot, std::vector<Vector6d> path);
+
+    /**
+     * @return the waypoints the current spline was fit through, empty if there is none
+     * */
+    const std::vector<Vector6d> &get_spline_path() const;
 
     /**
      * @param spline_t a time between 0 and 1
      * @return a vector of six doubles representing the angles of each joint at time spline_t
      * */
-    std::vector<double> get_spline_pos(double spline_t);
+    std::vector<double> get_spline_pos(double spline_t) const;
+
+    /**
+     * Same as get_spline_pos(spline_t), without allocating
+     * @param angles set to the angles of each joint at spline_t
+     * */
+    void get_spline_pos(double spline_t, Vector6d &angles) const;
+
+    /**
+     * @param spline_t a time between 0 and 1
+     * @param order 1 or 2
+     * @param derivs set to the order-th derivative of each joint's angle with respect to spline_t
+     * */
+    void get_spline_deriv(double spline_t, int order, Vector6d &derivs) const;
 
 
 private:
@@ -90,34 +229,78 @@ private:
     double modify_spline_t(double spline_t);
 
     /**
-     * Generate a random config based on the joint limits
+     * Generate a random config within the joint limits, with locked joints left at start
      * */
     Vector6d sample(Vector6d start, const ArmState &robot);
 
     /**
-     * @param tree_root the root of the RRT tree
+     * @param tree the RRT tree to search
      * @param rand a random set of angles in the possible space
      * 
-     * @return nearest node in tree to a given random node in config space
+     * @return index of the nearest node in tree to a given random node in config space
      * */
-    Node* nearest(Node* tree_root, const Vector6d &rand);
+    int nearest(const Tree &tree, const Vector6d &rand);
 
     /**
-     * @param start an RRT node that has been found to be near end
+     * @param start the angles of an RRT node that has been found to be near end
      * @param end the target set of angles
      * 
      * @return a set of angles branching from start towards end without violating step_limits
      * */
-    Vector6d steer(Node* start, const Vector6d &end);
+    Vector6d steer(const Vector6d &start, const Vector6d &end);
+
+    /**
+     * @return the configs from node end of tree back to its root
+     * */
+    std::vector<Vector6d> backtrace_path(const Tree &tree, int end);
 
-    std::vector<Vector6d> backtrace_path(Node* end, Node* root);
+    /**
+     * @return length of the path from the root of tree to node
+     * */
+    double path_cost(const Tree &tree, int node) const;
+
+    /**
+     * @return path from the root of start_tree to the root of goal_tree through
+     * start_node and goal_node, which must have the same config
+     * */
+    std::vector<Vector6d> join_paths(int start_node, int goal_node);
+
+    /**
+     * Sample for RRT* mode, from the set of configs whose distance to start
+     * plus distance to target is less than best_cost, so that a node there
+     * could shorten the best path. Gives up and uses the last sample after
+     * INFORMED_SAMPLE_TRIES
+     * */
+    Vector6d sample_informed(const Vector6d &start, const Vector6d &target, double best_cost, const ArmState &robot);
+
+    /**
+     * Removes waypoints of path by trying SHORTCUT_ATTEMPTS random pairs of
+     * waypoints and skipping what's between them if the straight motion
+     * between them is safe
+     * */
+    void shortcut_path(ArmState &robot, std::vector<Vector6d> &path);
 
-    void delete_tree(Node* twig);
-    void delete_tree_helper(Node* root);
+    /**
+     * Removes waypoints of path without randomness: from each waypoint kept,
+     * skips to the furthest later one the straight motion to is safe
+     * */
+    void straighten_path(ArmState &robot, std::vector<Vector6d> &path);
 
-    Node* extend(ArmState &robot, Node* tree, const Vector6d &z_rand);
+    /**
+     * Checks the fitted splines at and between points SPLINE_CHECK_SPACING
+     * apart, split across the thread pool if there are many of them
+     * @return spline_t of the first collision, or -1 if the splines are safe
+     * */
+    double spline_collision(ArmState &robot);
+
+    /**
+     * Adds a node stepping from the nearest node in tree towards z_rand, if the
+     * whole edge to it is collision free
+     * @return index of the new node, or -1 if the edge collides
+     * */
+    int extend(ArmState &robot, Tree &tree, const Vector6d &z_rand);
 
-    Node* connect(ArmState &robot, Node* tree, const Vector6d &a_new);
+    int connect(ArmState &robot, Tree &tree, const Vector6d &a_new);
 
     void spline_fitting(const std::vector<Vector6d> &path);
 
@@ -1,15 +1,33 @@
 #include "mrover_arm.hpp"
 #include "arm_state.hpp"
 #include "motion_planner.hpp"
+#include "trajectory.hpp"
 #include "kinematics.hpp"
+#include "collision_map.hpp"
 #include "utils.hpp"
+#include "trace.hpp"
 
 #include <chrono>
+#include <future>
 #include <thread>
+#include <string>
 #include <limits>
 #include <cmath>
 
 using namespace Eigen;
+
+namespace {
+
+    // in s, the time joint readings are stamped with
+    double steady_seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+}
 using nlohmann::json;
 
 MRoverArm::MRoverArm(json &geom, lcm::LCM &lcm) :
@@ -18,13 +36,16 @@ MRoverArm::MRoverArm(json &geom, lcm::LCM &lcm) :
     motion_planner(arm_state, solver),
     lcm_(lcm),
     control_state(ControlState::OFF),
+    preview_pending(false),
+    plan_target_is_angles(false),
+    plan_pending(false),
+    plan_generation(0),
     sim_mode(true),
     use_orientation(false),
+    trajectory_streaming(geom.value("trajectory_streaming", false)),
     zero_encoders(false),
     prev_angle_b(std::numeric_limits<double>::quiet_NaN())
 {
-    prev_angles.clear();
-    prev_angles.resize(6);
     faulty_encoders.resize(6);
 
     for (size_t joint = 0; joint < faulty_encoders.size(); ++joint) {
@@ -33,6 +54,47 @@ MRoverArm::MRoverArm(json &geom, lcm::LCM &lcm) :
 
     DUD_ENCODER_VALUES.push_back(3.1415);
     DUD_ENCODER_VALUES.push_back(-3.1415);
+
+    // Damped least squares converges in a few iterations, which keeps IK
+    // responsive when targets come from the GUI
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    // Both maps are large files, so the reachability map loads on its own thread
+    // while the collision map loads on this one
+    std::future<bool> reachability_loaded = std::async(std::launch::async, [this]() {
+        return reachability_map.load(get_mrover_arm_reachability_map(), arm_state.get_model());
+    });
+
+    // Copies of arm_state made for planning and IK share the map
+    std::shared_ptr<CollisionMap> collision_map = std::make_shared<CollisionMap>();
+    if (collision_map->load(get_mrover_arm_collision_map(), arm_state.get_model())) {
+        arm_state.set_collision_map(collision_map);
+        std::cout << "Loaded collision map\n";
+    }
+    else {
+        std::cout << "No collision map, checking every collision exactly. Run make collision_map to generate one\n";
+    }
+
+    if (reachability_loaded.get()) {
+        std::cout << "Loaded reachability map\n";
+    }
+    else {
+        std::cout << "No reachability map, running IK for every target. Run make reachability_map to generate one\n";
+    }
+
+    if (motion_lattice.load(get_mrover_arm_motion_lattice(), arm_state.get_model())) {
+        std::cout << "Loaded motion lattice\n";
+    }
+    else {
+        std::cout << "No motion lattice, planning every path with RRT. Run make motion_lattice to generate one\n";
+    }
+
+    // With MROVER_PLAN_LOG set, every planning request is logged to it, for
+    // test/plan_replay.cpp to plan again
+    const char *plan_log_file = getenv("MROVER_PLAN_LOG");
+    if (plan_log_file && plan_log.open(plan_log_file)) {
+        std::cout << "Logging planning requests to " << plan_log_file << "\n";
+    }
 }
 
 void MRoverArm::ra_control_callback(std::string channel, ArmControlState msg) {
@@ -53,14 +115,26 @@ void MRoverArm::ra_control_callback(std::string channel, ArmControlState msg) {
     }
 }
 
-void MRoverArm::arm_position_callback(std::string channel, ArmPosition msg) {
+void MRoverArm::arm_position_callback(std::string channel, const ArmPosition::View &msg) {
+    // the bridge sends the same positions through the arm link, sim mode only
+    // takes them from LCM like before
+    if (!sim_mode && arm_link_alive()) {
+        return;
+    }
 
-    std::vector<double> angles{ msg.joint_a, msg.joint_b, msg.joint_c,
-                            msg.joint_d, msg.joint_e, msg.joint_f };
+    update_arm_position({ msg.joint_a(), msg.joint_b(), msg.joint_c(),
+                          msg.joint_d(), msg.joint_e(), msg.joint_f() },
+                        msg.stale_joints());
+}
+
+void MRoverArm::update_arm_position(std::vector<double> angles, int32_t stale_joints) {
+    std::lock_guard<std::mutex> position_lock(arm_position_mtx);
+    double reading_time = steady_seconds();
 
     check_dud_encoder(angles);
     
     if (zero_encoders) {
+        encoder_angles_sender_mtx.lock();
         for (size_t i = 0; i < 6; ++i)  {
             if (i == 1) {
                 arm_state.set_joint_encoder_offset(i,
@@ -70,6 +144,8 @@ void MRoverArm::arm_position_callback(std::string channel, ArmPosition msg) {
                 arm_state.set_joint_encoder_offset(i, angles[i]);
             }
         }
+        arm_snapshot.reset();
+        encoder_angles_sender_mtx.unlock();
         std::cout << "Zeroed encoders.\n";
 
         zero_encoders = false;
@@ -83,22 +159,29 @@ void MRoverArm::arm_position_callback(std::string channel, ArmPosition msg) {
         }
     }
 
+    encoder_error_mtx.lock();
+
     encoder_error = false;
     encoder_error_message = "Encoder Error in encoder(s) (joint A = 0, F = 5): ";
 
     check_joint_limits(angles);
 
     // If we have less than 5 previous angles to compare to
-    if (prev_angles[0].size() < MAX_NUM_PREV_ANGLES) {
+    if (joint_estimators[0].size() < MAX_NUM_PREV_ANGLES) {
 
         // For each joint
         for (size_t joint = 0; joint < 6; ++joint) {
 
             faulty_encoders[joint] = false;
+
+            // a stale angle is the last one the bridge read, not a new reading that could be faulty
+            if (stale_joints & (1 << joint)) {
+                continue;
+            }
             
             // For each previous angle we have to compare to
-            for (size_t i = 0; i < prev_angles[joint].size(); ++i) {
-                double diff = std::abs(angles[joint] - prev_angles[joint][i]);
+            for (size_t i = 0; i < joint_estimators[joint].size(); ++i) {
+                double diff = std::abs(angles[joint] - joint_estimators[joint].get_reading(i));
 
                 if (diff > ENCODER_ERROR_THRESHOLD * (i + 1)) {
                     faulty_encoders[joint] = true;
@@ -116,10 +199,14 @@ void MRoverArm::arm_position_callback(std::string channel, ArmPosition msg) {
 
             faulty_encoders[joint] = false;
             size_t num_fishy_vals = 0;
+
+            if (stale_joints & (1 << joint)) {
+                continue;
+            }
             
             // For each previous angle we have to compare to
             for (size_t i = 0; i < MAX_NUM_PREV_ANGLES; ++i) {
-                double diff = std::abs(angles[joint] - prev_angles[joint][i]);
+                double diff = std::abs(angles[joint] - joint_estimators[joint].get_reading(i));
 
                 if (diff > ENCODER_ERROR_THRESHOLD * (i + 1)) {
                     ++num_fishy_vals;
@@ -134,21 +221,27 @@ void MRoverArm::arm_position_callback(std::string channel, ArmPosition msg) {
         }
     }
 
-    // Give each angle to prev_angles (stores up to 5 latest values)
+    encoder_error_mtx.unlock();
+
+    // Give each angle to its estimator, which keeps faulty ones to compare
+    // later readings to but doesn't filter them
     for (size_t joint = 0; joint < 6; ++joint) {
-        if (prev_angles[joint].size() >= MAX_NUM_PREV_ANGLES) {
-            prev_angles[joint].pop_back();
+        // repeats of a stale angle would make the next real reading look like a jump
+        if (stale_joints & (1 << joint)) {
+            continue;
         }
 
-        prev_angles[joint].push_front(angles[joint]);
+        joint_estimators[joint].update(reading_time, angles[joint], !faulty_encoders[joint]);
 
         // If the new angle for this joint was considered faulty, replace with last good angle
         if (faulty_encoders[joint]) {
             angles[joint] = arm_state.get_joint_angle(joint);
         }
     }
+    joint_estimates.set(joint_estimators);
 
     // update arm_state
+    encoder_angles_sender_mtx.lock();
     arm_state.set_joint_angles(angles);
 
     // if previewing or finished previewing, don't update GUI based on arm position
@@ -157,6 +250,8 @@ void MRoverArm::arm_position_callback(std::string channel, ArmPosition msg) {
         solver.FK(arm_state);
         publish_transforms(arm_state);
     }
+    arm_snapshot.reset();
+    encoder_angles_sender_mtx.unlock();
 }
 
 void MRoverArm::target_orientation_callback(std::string channel, TargetOrientation msg) {
@@ -170,82 +265,194 @@ void MRoverArm::target_orientation_callback(std::string channel, TargetOrientati
         control_state = ControlState::WAITING_FOR_TARGET;
     }
 
-    if (control_state != ControlState::WAITING_FOR_TARGET) {
-        std::cout << "control_state: " << control_state << "\n";
-        std::cout << "Received target but not currently waiting for target.\n";
+    Vector6d point;
+    point(0) = (double) msg.x;
+    point(1) = (double) msg.y;
+    point(2) = (double) msg.z;
+    point(3) = (double) msg.alpha;
+    point(4) = (double) msg.beta;
+    point(5) = (double) msg.gamma;
+
+    if (!request_plan(point, false)) {
         return;
     }
-    control_state = ControlState::CALCULATING;
 
     std::cout << "Received target!\n";
     std::cout << "Target position: " << msg.x << "\t" << msg.y << "\t" << msg.z << "\n";
     if (use_orientation) {
         std::cout << "Target orientation: " << msg.alpha << "\t" << msg.beta << "\t" << msg.gamma << "\n";
     }
+}
+
+void MRoverArm::go_to_target_angles(ArmPosition msg) {
+    // convert to Vector6d
+    Vector6d target;
+    target[0] = (double) msg.joint_a;
+    target[1] = (double) msg.joint_b;
+    target[2] = (double) msg.joint_c;
+    target[3] = (double) msg.joint_d;
+    target[4] = (double) msg.joint_e;
+    target[5] = (double) msg.joint_f;
+
+    if (!request_plan(target, true)) {
+        return;
+    }
+
+    std::cout << "Received target angles:  ";
+    for (size_t i = 0; i < 6; ++i) {
+        std::cout << target[i] << "  ";
+    }
+    std::cout << "\n";
+}
+
+bool MRoverArm::request_plan(const Vector6d &target, bool is_angles) {
+    std::lock_guard<std::mutex> lock(plan_mtx);
+
+    // claimed in one step, since arm_adjust_callback() can start servoing on the LCM thread meanwhile.
+    // A target that is still being planned is replaced
+    ControlState state = ControlState::WAITING_FOR_TARGET;
+    if (!control_state.compare_exchange_strong(state, ControlState::CALCULATING) &&
+        state != ControlState::CALCULATING) {
+        std::cout << "control_state: " << state << "\n";
+        std::cout << "Received target but not currently waiting for target.\n";
+        return false;
+    }
+
+    if (state == ControlState::CALCULATING) {
+        std::cout << "Replacing the target being planned.\n";
+    }
+
+    plan_target = target;
+    plan_target_is_angles = is_angles;
+    plan_pending = true;
+    ++plan_generation;
+    plan_cv.notify_one();
+    return true;
+}
+
+void MRoverArm::path_planner() {
+    while (true) {
+        // sleep until request_plan() hands over a target
+        std::unique_lock<std::mutex> lock(plan_mtx);
+        plan_cv.wait(lock, [this]() { return plan_pending; });
+        Vector6d target = plan_target;
+        bool is_angles = plan_target_is_angles;
+        unsigned generation = plan_generation;
+        plan_pending = false;
+        lock.unlock();
+
+        // a newer target, or leaving CALCULATING, stops this plan wherever it is
+        std::function<bool()> canceled = [this, generation]() {
+            return plan_generation != generation || control_state != ControlState::CALCULATING;
+        };
+
+        PlanRecord record;
+        if (is_angles) {
+            plan_to_angles(target, canceled, record);
+        }
+        else {
+            plan_to_point(target, canceled, record);
+        }
+        plan_log.write(record);
+    }
+}
+
+void MRoverArm::start_plan_record(const ArmState &hypo_state, const Vector6d &target, bool is_angles,
+                                  PlanRecord &record) {
+    record = PlanRecord();
+    record.time = steady_seconds();
+    record.locks = 0;
+    for (size_t i = 0; i < 6; ++i) {
+        record.start[i] = hypo_state.get_joint_angle(i);
+        record.target[i] = target(i);
+        record.goal[i] = target(i);
+        record.locks |= hypo_state.get_joint_locked(i) ? 1u << i : 0;
+    }
+    record.is_angles = is_angles;
+    record.use_orientation = !is_angles && use_orientation;
+    record.has_environment = hypo_state.get_environment() != nullptr;
+    record.result = PlanResult::CANCELED;
+    record.source = PlanSource::NONE;
+}
+
+void MRoverArm::plan_to_point(const Vector6d &point, const std::function<bool()> &canceled, PlanRecord &record) {
+    Trace::Span span("plan to point");
+    auto ik_start = std::chrono::steady_clock::now();
+    // plan from a copy, since arm_position_callback() keeps updating arm_state meanwhile
+    std::shared_ptr<const ArmState> snapshot = snapshot_arm_state();
+    ArmState hypo_state = *snapshot;
+    start_plan_record(hypo_state, point, false, record);
 
     std::cout << "Initial joint angles: ";
-    for (double ang : arm_state.get_joint_angles()) {
+    for (double ang : hypo_state.get_joint_angles()) {
         std::cout << ang << "\t"; 
     }
     std::cout << "\n";
     
-    if (!solver.is_safe(arm_state)) {
+    if (!solver.is_safe(hypo_state)) {
         std::cout << "STARTING POSITION NOT SAFE, please adjust arm in Open Loop.\n";
-
-        DebugMessage msg;
-        msg.isError = false;
-        msg.message = "Unsafe Starting Position";
-        
-        // send popup message to GUI
-        lcm_.publish("/debug_message", &msg);
-
-        control_state = ControlState::WAITING_FOR_TARGET;
+        record.result = PlanResult::UNSAFE_START;
+        plan_failed(canceled, "Unsafe Starting Position");
         return;
     }
 
-    Vector6d point;
-    point(0) = (double) msg.x;
-    point(1) = (double) msg.y;
-    point(2) = (double) msg.z;
-    point(3) = (double) msg.alpha;
-    point(4) = (double) msg.beta;
-    point(5) = (double) msg.gamma;
+    // no pose puts the end effector there, so IK would only search until it gives up
+    if (!reachability_map.empty() && !reachability_map.is_reachable(point.head(3))) {
+        std::cout << "TARGET OUT OF REACH, please try a different configuration.\n";
+        record.result = PlanResult::OUT_OF_REACH;
+        plan_failed(canceled, "Target out of reach");
+        return;
+    }
 
-    ArmState hypo_state = arm_state;
+    // reuse the solution found the last time this target was sent from here, if it's still safe
+    std::pair<Vector6d, bool> ik_solution;
+    ik_solution.second = solution_cache.find_ik(hypo_state, point, use_orientation, ik_solution.first) &&
+        solver.is_safe(hypo_state, std::vector<double>(ik_solution.first.data(), ik_solution.first.data() + 6));
 
-    // attempt to find ik_solution, starting at current position
-    std::pair<Vector6d, bool> ik_solution = solver.IK(hypo_state, point, false, use_orientation);
+    if (ik_solution.second) {
+        std::cout << "Using cached IK solution.\n";
+    }
+    else {
+        // a target dragged a little from the last one is solved near the last solution
+        ik_solution = solver.IK_warm_start(hypo_state, point, use_orientation);
+    }
 
-    // attempt to find ik_solution, starting at up to 25 random positions
-    for(int i = 0; i < 25; ++i) {
-        if (ik_solution.second) {
-            std::cout << "Solved IK with " << i << " random starting positions\n";
-            break;
+    Vector6d seed;
+    if (!ik_solution.second && reachability_map.find_seed(point, use_orientation, seed)) {
+        // start from the mapped pose that reaches closest to the target, keeping locked joints still
+        ArmState seeded_state = hypo_state;
+        for (size_t i = 0; i < 6; ++i) {
+            if (seeded_state.get_joint_locked(i)) {
+                seed(i) = seeded_state.get_joint_angle(i);
+            }
         }
+        seeded_state.set_joint_angles_6d(seed);
+        ik_solution = solver.IK(seeded_state, point, false, use_orientation);
+    }
 
-        if (control_state != ControlState::CALCULATING) {
-            std::cout << "IK calculations canceled\n";
-            break;
-        }
+    if (!ik_solution.second) {
+        // attempt to find ik_solution, starting at current position and up to 25 random positions,
+        // keeping the safe solution that moves the arm the least
+        ik_solution = solver.IK_multi_start(*snapshot, point, use_orientation, 26, true, canceled);
+    }
 
-        ik_solution = solver.IK(hypo_state, point, true, use_orientation);
+    record.ik_ms = elapsed_ms(ik_start);
+    if (canceled()) {
+        std::cout << "IK calculations canceled\n";
+        return;
     }
 
     // if no solution
     if(!ik_solution.second) {
         std::cout << "NO IK SOLUTION FOUND, please try a different configuration.\n";
-
-        DebugMessage msg;
-        msg.isError = false;
-        msg.message = "No IK solution";
-        
-        // send popup message to GUI
-        lcm_.publish("/debug_message", &msg);
-
-        control_state = ControlState::WAITING_FOR_TARGET;
+        record.result = PlanResult::NO_IK;
+        plan_failed(canceled, "No IK solution");
         return;
     }
 
+    solution_cache.store_ik(hypo_state, point, use_orientation, ik_solution.first);
+    solver.remember_solution(point, ik_solution.first);
+
     std::cout << "Final ik joint angles: \n";
     for (size_t i = 0; i < 6; ++i) {
         std::cout << ik_solution.first[i] << "\t"; 
@@ -256,121 +463,197 @@ void MRoverArm::target_orientation_callback(std::string channel, TargetOrientati
     Vector6d goal = ik_solution.first;
 
     // create path of the angles IK found and preview on GUI
-    plan_path(hypo_state, goal);
+    plan_path(hypo_state, goal, canceled, record);
 }
 
-void MRoverArm::go_to_target_angles(ArmPosition msg) {
-    if (control_state != ControlState::WAITING_FOR_TARGET) {
-        std::cout << "Received target but not in closed-loop waiting state.\n";
+void MRoverArm::plan_to_angles(const Vector6d &target, const std::function<bool()> &canceled, PlanRecord &record) {
+    Trace::Span span("plan to angles");
+    ArmState hypo_state = *snapshot_arm_state();
+    start_plan_record(hypo_state, target, true, record);
+
+    std::cout << "Initial joint angles:  ";
+    for (double ang : hypo_state.get_joint_angles()) {
+        std::cout << ang << "  "; 
+    }
+    std::cout << "\n";
+
+    if (!solver.is_safe(hypo_state)) {
+        std::cout << "STARTING POSITION NOT SAFE, please adjust arm in Open Loop.\n";
+        record.result = PlanResult::UNSAFE_START;
+        plan_failed(canceled, "Unsafe Starting Position");
         return;
     }
-    control_state = ControlState::CALCULATING;
 
-    // convert to Vector6d
-    Vector6d target;
-    target[0] = (double) msg.joint_a;
-    target[1] = (double) msg.joint_b;
-    target[2] = (double) msg.joint_c;
-    target[3] = (double) msg.joint_d;
-    target[4] = (double) msg.joint_e;
-    target[5] = (double) msg.joint_f;
+    // TODO check if target is safe.
 
-    std::cout << "Received target angles:  ";
+    plan_path(hypo_state, target, canceled, record);
+}
+
+void MRoverArm::plan_path(ArmState& hypo_state, Vector6d goal, const std::function<bool()> &canceled,
+                          PlanRecord &record) {
+    Trace::Span span("plan path");
+    auto plan_start = std::chrono::steady_clock::now();
     for (size_t i = 0; i < 6; ++i) {
-        std::cout << target[i] << "  ";
+        record.goal[i] = goal(i);
     }
-    std::cout << "\n";
-
-    std::cout << "Initial joint angles:  ";
-    for (double ang : arm_state.get_joint_angles()) {
-        std::cout << ang << "  "; 
+    // Plan into copies, so a plan that gets canceled never touches the path
+    // and trajectory the rest of the arm uses
+    MotionPlanner planner = motion_planner;
+    Trajectory new_trajectory;
+
+    // race several planners, since how long one takes varies a lot from plan to plan
+    bool path_found = false;
+
+    // Reuse the path planned the last time the arm went from here to goal. It
+    // started and ended slightly off, so move its ends and check it again
+    std::vector<Vector6d> cached_path;
+    if (solution_cache.find_path(hypo_state, goal, cached_path)) {
+        cached_path.front() = vecTo6d(hypo_state.get_joint_angles());
+        cached_path.back() = goal;
+
+        path_found = planner.fit_path(hypo_state, cached_path);
+        if (path_found) {
+            std::cout << "Using cached path.\n";
+            record.source = PlanSource::CACHE;
+        }
     }
-    std::cout << "\n";
 
-    if (!solver.is_safe(arm_state)) {
-        std::cout << "STARTING POSITION NOT SAFE, please adjust arm in Open Loop.\n";
+    // The lattice gives the same path every time it has one, RRT plans the rest
+    if (!path_found && !motion_lattice.empty()) {
+        path_found = planner.lattice_connect(hypo_state, motion_lattice, goal);
+        if (path_found) {
+            std::cout << "Using motion lattice path.\n";
+            record.source = PlanSource::LATTICE;
+            solution_cache.store_path(hypo_state, goal, planner.get_spline_path());
+        }
+    }
 
-        DebugMessage msg;
-        msg.isError = false;
-        msg.message = "Unsafe Starting Position";
-        
-        // send popup message to GUI
-        lcm_.publish("/debug_message", &msg);
+    if (!path_found) {
+        path_found = planner.rrt_connect_parallel(hypo_state, goal, NUM_PARALLEL_PLANNERS, canceled);
+        if (path_found) {
+            record.source = PlanSource::RRT;
+            solution_cache.store_path(hypo_state, goal, planner.get_spline_path());
+        }
+    }
 
-        control_state = ControlState::WAITING_FOR_TARGET;
+    if (!path_found) {
+        record.plan_ms = elapsed_ms(plan_start);
+        record.result = canceled() ? PlanResult::CANCELED : PlanResult::NO_PATH;
+        plan_failed(canceled, "Unable to plan path!");
         return;
     }
 
-    // TODO check if target is safe.
+    // time the path once, so executing it only has to look up where to be
+    new_trajectory.parameterize(planner, hypo_state);
+    record.plan_ms = elapsed_ms(plan_start);
 
-    ArmState hypo_state = arm_state;
+    // Hand the plan over only if it is still the newest, holding plan_mtx so
+    // no newer target can arrive until it is previewing
+    std::lock_guard<std::mutex> lock(plan_mtx);
+    if (canceled()) {
+        std::cout << "Planning canceled\n";
+        return;
+    }
+    record.result = PlanResult::PLANNED;
 
-    plan_path(hypo_state, target);
+    motion_planner = std::move(planner);
+    trajectory = std::move(new_trajectory);
+    preview(hypo_state);
 }
 
-void MRoverArm::plan_path(ArmState& hypo_state, Vector6d goal) {
-    bool path_found = motion_planner.rrt_connect(hypo_state, goal);
+void MRoverArm::plan_failed(const std::function<bool()> &canceled, const std::string &message) {
+    std::lock_guard<std::mutex> lock(plan_mtx);
 
-    if (path_found) {
-        preview(hypo_state);
+    // a newer target, or leaving closed-loop, already decided the state
+    if (canceled()) {
+        return;
     }
-    else {
-        control_state = ControlState::WAITING_FOR_TARGET;
 
-        DebugMessage msg;
-        msg.isError = false;
-        msg.message = "Unable to plan path!";
-        
-        // send popup message to GUI
-        lcm_.publish("/debug_message", &msg);
-    }
+    control_state = ControlState::WAITING_FOR_TARGET;
+
+    DebugMessage msg;
+    msg.isError = false;
+    msg.message = message;
+
+    // send popup message to GUI
+    lcm_.publish("/debug_message", &msg);
 }
 
 void MRoverArm::preview(ArmState& hypo_state) {
     std::cout << "Previewing...\n";
-    control_state = ControlState::PREVIEWING;
 
-    double num_steps = 20.0;
-    double t = 0.0;
-
-    while (t <= 1 && control_state == ControlState::PREVIEWING) {
+    // Compute every frame up front, so preview_sender() never reads the
+    // planner while another target could be planned
+    std::vector<Vector6d> path(PREVIEW_STEPS + 1);
+    for (int i = 0; i <= PREVIEW_STEPS; ++i) {
+        motion_planner.get_spline_pos(static_cast<double>(i) / PREVIEW_STEPS, path[i]);
+    }
 
-        // set hypo_state to next position in the path
-        std::vector<double> target = motion_planner.get_spline_pos(t);
-        hypo_state.set_joint_angles(target);
+    // FK of the whole path at once, hypo_state only supplies the geometry
+    FKBatch batch;
+    solver.FK_batch(hypo_state, path, batch);
+
+    std::vector<FKTransform> frames(PREVIEW_STEPS + 1);
+    for (int i = 0; i <= PREVIEW_STEPS; ++i) {
+        matrix_helper(frames[i].transform_a, batch.get_joint_transform(i, 0));
+        matrix_helper(frames[i].transform_b, batch.get_joint_transform(i, 1));
+        matrix_helper(frames[i].transform_c, batch.get_joint_transform(i, 2));
+        matrix_helper(frames[i].transform_d, batch.get_joint_transform(i, 3));
+        matrix_helper(frames[i].transform_e, batch.get_joint_transform(i, 4));
+        matrix_helper(frames[i].transform_f, batch.get_joint_transform(i, 5));
+    }
 
-        // update transforms
-        solver.FK(hypo_state); 
+    preview_mtx.lock();
+    preview_frames.swap(frames);
+    preview_pending = true;
+    control_state = ControlState::PREVIEWING;
+    preview_mtx.unlock();
+    preview_cv.notify_one();
+}
 
-        // send transforms to GUI
-        publish_transforms(hypo_state);
+void MRoverArm::preview_sender() {
+    const std::chrono::milliseconds period(PREVIEW_FRAME_TIME);
+    std::vector<FKTransform> frames;
 
-        t += 1.0 / num_steps;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
+    while (true) {
+        // sleep until preview() hands over a new preview
+        std::unique_lock<std::mutex> lock(preview_mtx);
+        preview_cv.wait(lock, [this]() { return preview_pending.load(); });
+        frames.swap(preview_frames);
+        preview_pending = false;
+        lock.unlock();
+
+        std::chrono::steady_clock::time_point next_wakeup = std::chrono::steady_clock::now();
+
+        // stop early if the preview is canceled or replaced by a newer one
+        for (const FKTransform &frame : frames) {
+            if (control_state != ControlState::PREVIEWING || preview_pending) {
+                break;
+            }
 
-    // If previewing was canceled early
-    if (control_state != ControlState::PREVIEWING) {
-        std::cout << "Preview interrupted.\n";
+            // send transforms to GUI
+            lcm_.publish("/fk_transform", &frame);
 
-        if (control_state != ControlState::OFF) {
-            std::cout << "UNEXPECTED BEHAVIOR: exited preview but did not leave closed-loop! Setting state to off.\n";
-            control_state = ControlState::OFF;
+            next_wakeup += period;
+            std::this_thread::sleep_until(next_wakeup);
         }
-        return;
-    }
 
-    std::cout <<  "Preview Done\n";
+        // Change state to ready to execute, unless previewing was canceled early
+        ControlState previewing = ControlState::PREVIEWING;
+        if (preview_pending || !control_state.compare_exchange_strong(previewing, ControlState::READY_TO_EXECUTE)) {
+            std::cout << "Preview interrupted.\n";
+            continue;
+        }
 
-    DebugMessage msg;
-    msg.isError = false;
-    msg.message = "Preview Done";
+        std::cout <<  "Preview Done\n";
 
-    // send popup message to GUI
-    lcm_.publish("/debug_message", &msg);
+        DebugMessage msg;
+        msg.isError = false;
+        msg.message = "Preview Done";
 
-    // Change state to ready to execute
-    control_state = ControlState::READY_TO_EXECUTE;
+        // send popup message to GUI
+        lcm_.publish("/debug_message", &msg);
+    }
 }
 
 void MRoverArm::motion_execute_callback(std::string channel, MotionExecute msg) {
@@ -388,8 +671,11 @@ void MRoverArm::motion_execute_callback(std::string channel, MotionExecute msg)
     }
 
     if (execute) {
-        // run loop inside execute_spline()
+        // wake execute_spline(), holding execute_mtx so it can't miss the change
+        execute_mtx.lock();
         control_state = ControlState::EXECUTING;
+        execute_mtx.unlock();
+        execute_cv.notify_one();
     }
     else {
         control_state = ControlState::WAITING_FOR_TARGET;
@@ -398,103 +684,76 @@ void MRoverArm::motion_execute_callback(std::string channel, MotionExecute msg)
 }
 
 void MRoverArm::execute_spline() { 
-    double spline_t = 0.0;
-    double spline_t_iterator;
+    Vector6d target_angles;
 
     while (true) {
-        if (control_state == ControlState::EXECUTING) {
+        // sleep until motion_execute_callback() starts an execution
+        std::unique_lock<std::mutex> lock(execute_mtx);
+        execute_cv.wait(lock, [this]() { return control_state == ControlState::EXECUTING; });
+        lock.unlock();
+
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next_wakeup = start_time;
+        double prev_elapsed = 0;
+        Vector6d stalled_time = Vector6d::Zero();
+        motion_planner.get_spline_pos(0, target_angles);
+
+        while (control_state == ControlState::EXECUTING) {
 
             if (encoder_error) {
-                std::cout << encoder_error_message << "\n";
+                encoder_error_mtx.lock();
+                std::string error_message = encoder_error_message;
+                encoder_error_mtx.unlock();
+
+                std::cout << error_message << "\n";
                 std::cout << "Sending kill command due to encoder error!\n";
-                spline_t = 0.0;
 
                 DebugMessage msg;
                 msg.isError = true;
-                msg.message = encoder_error_message;
+                msg.message = error_message;
 
                 // send popup message to GUI
                 lcm_.publish("/debug_message", &msg);
 
                 if (sim_mode) {
                     for (size_t i = 0; i < MAX_NUM_PREV_ANGLES; ++i) {
-                        publish_config(arm_state.get_joint_angles(), "/arm_position");
+                        publish_config(snapshot_arm_state()->get_joint_angles(), "/arm_position");
                     }
                 }
 
                 control_state = ControlState::WAITING_FOR_TARGET;
                 send_kill_cmd();
-                continue;
+                break;
             }
 
-            //find arm's current angles
-            std::vector<double> init_angles = arm_state.get_joint_angles(); 
-            //find angles D_SPLINE_T (%) further down the spline path
-            std::vector<double> final_angles = motion_planner.get_spline_pos(spline_t + D_SPLINE_T);
-
-            double max_time = -1; //in ms
-
-            // Get max time to travel for joints a through e // for testing (should be through joint f)
-            for (int i = 0; i < 6; ++i) {
-                if (!arm_state.get_joint_locked(i)) {
-                    double max_speed = arm_state.get_joint_max_speed(i);
-
-                    //in ms, time needed to move D_SPLINE_T (%)
-                    double joint_time = std::abs(final_angles[i] - init_angles[i])
-                        / (max_speed / 1000.0); // convert max_speed to rad/ms
-                    
-                    //sets max_time to greater value
-                    if (max_time < joint_time) {
-                        max_time = joint_time;
-                    }
-                }
-            }
-
-            //determines size of iteration by dividing number of iterations by distance
-            spline_t_iterator = D_SPLINE_T / (max_time / SPLINE_WAIT_TIME);
+            // follow the trajectory by how long it has been executing
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            double spline_t = trajectory.get_spline_t(elapsed);
 
-            // Guard against moving too quickly due to uneven path
-            if (spline_t_iterator > MAX_SPLINE_T_IT) {
-                spline_t_iterator = MAX_SPLINE_T_IT;
+            // where the joints were last sent, for telling if one stopped following
+            int stalled_joint = find_stalled_joint(target_angles, elapsed - prev_elapsed, stalled_time);
+            prev_elapsed = elapsed;
+            if (stalled_joint >= 0) {
+                control_state = ControlState::WAITING_FOR_TARGET;
+                report_stall(stalled_joint);
+                break;
             }
 
-            spline_t += spline_t_iterator;
-
             // break out of loop if necessary
-            if (spline_t >= 1.0) {
+            if (elapsed >= trajectory.get_duration()) {
                 std::cout << "Finished executing succesfully!\n";
-                spline_t = 0.999999999999;
                 control_state = ControlState::WAITING_FOR_TARGET;
             }
 
-            // get next set of angles in path
-            std::vector<double> target_angles = motion_planner.get_spline_pos(spline_t);
-
-            for (size_t i = 0; i < 6; ++i) {
-                if (target_angles[i] < arm_state.get_joint_limits(i)[0]) {
-                    target_angles[i] = arm_state.get_joint_limits(i)[0];
-                }
-                else if (target_angles[i] > arm_state.get_joint_limits(i)[1]) {
-                    target_angles[i] = arm_state.get_joint_limits(i)[1];
-                }
-            }
-
-            // if not in sim_mode, send physical arm a new target
-            if (!sim_mode) {
-                // TODO make publish function names more intuitive?
-
-                // Adjust for encoders not being properly zeroed.
-                for (size_t i = 0; i < 6; ++i) {
-                    target_angles[i] *= arm_state.get_joint_encoder_multiplier(i);
-                    target_angles[i] += arm_state.get_joint_encoder_offset(i);
-                }
-
-                publish_config(target_angles, "/ik_ra_control");
+            // stream whole segments to controllers that can follow them, which
+            // takes fewer messages than sending each set of angles in the path
+            bool streaming = trajectory_streaming && !sim_mode;
+            motion_planner.get_spline_pos(spline_t, target_angles);
+            if (streaming) {
+                send_joint_trajectory(elapsed);
             }
-
-            // if in sim_mode, simulate that we have gotten a new current position
             else {
-                arm_state.set_joint_angles(target_angles);
+                send_joint_targets(target_angles);
             }
 
             if (control_state != ControlState::EXECUTING) {
@@ -502,18 +761,169 @@ void MRoverArm::execute_spline() {
                 std::this_thread::sleep_for(std::chrono::milliseconds(2000));
                 std::cout << "Sending kill command!\n";
                 send_kill_cmd();
+                break;
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds((int) SPLINE_WAIT_TIME));
+            // Wake on a fixed schedule, so time spent publishing doesn't add up.
+            // After falling more than a period behind, start the schedule over
+            const std::chrono::milliseconds period(streaming ? TRAJECTORY_SEGMENT_PERIOD : SPLINE_WAIT_TIME);
+            next_wakeup += period;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (next_wakeup + period < now) {
+                next_wakeup = now;
+            }
+            std::this_thread::sleep_until(next_wakeup);
+        }
+    }
+}
+
+int MRoverArm::find_stalled_joint(const Vector6d &target_angles, double dt, Vector6d &stalled_time) {
+    // sim_mode moves arm_state straight to its targets, so nothing can hold it back
+    if (sim_mode) {
+        return -1;
+    }
+
+    std::array<JointEstimator, 6> estimators = joint_estimates.clone();
+    double now = steady_seconds();
+
+    int stalled_joint = -1;
+    for (size_t joint = 0; joint < 6; ++joint) {
+        const JointEstimator &estimator = estimators[joint];
+
+        // a joint with no recent readings can't be told apart from one not moving
+        if (!estimator.is_fresh(now)) {
+            stalled_time(joint) = 0;
+            continue;
+        }
+
+        double error = std::abs(target_angles(joint) - estimator.get_position(now));
+        if (error > STALL_ERROR && std::abs(estimator.get_velocity()) < STALL_VELOCITY) {
+            stalled_time(joint) += dt;
         }
         else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
-            spline_t = 0;
-            spline_t_iterator = 0.001;
-        }   
+            stalled_time(joint) = 0;
+        }
+
+        if (stalled_joint < 0 && stalled_time(joint) >= STALL_TIME) {
+            stalled_joint = joint;
+        }
+    }
+    return stalled_joint;
+}
+
+void MRoverArm::report_stall(int joint) {
+    std::string message = "Joint " + std::to_string(joint) + " stalled (joint A = 0, F = 5)";
+    std::cout << message << "\n";
+    std::cout << "Sending kill command due to stall!\n";
+
+    DebugMessage msg;
+    msg.isError = true;
+    msg.message = message;
+    lcm_.publish("/debug_message", &msg);
+
+    send_kill_cmd();
+}
+
+void MRoverArm::send_joint_targets(Vector6d target_angles) {
+    Trace::Span span("send joint targets");
+    for (size_t i = 0; i < 6; ++i) {
+        if (target_angles(i) < arm_state.get_joint_limits(i)[0]) {
+            target_angles(i) = arm_state.get_joint_limits(i)[0];
+        }
+        else if (target_angles(i) > arm_state.get_joint_limits(i)[1]) {
+            target_angles(i) = arm_state.get_joint_limits(i)[1];
+        }
+    }
+
+    // if not in sim_mode, send physical arm a new target
+    if (!sim_mode) {
+        // TODO make publish function names more intuitive?
+
+        // feed forward what holds the arm up at the target, so the controllers
+        // only have to correct the error
+        Vector6d torques = get_gravity_torques(target_angles);
+
+        // Adjust for encoders not being properly zeroed.
+        for (size_t i = 0; i < 6; ++i) {
+            target_angles(i) *= arm_state.get_joint_encoder_multiplier(i);
+            target_angles(i) += arm_state.get_joint_encoder_offset(i);
+            torques(i) *= arm_state.get_joint_encoder_multiplier(i);
+        }
+
+        if (!send_arm_link(target_angles, torques)) {
+            RAClosedLoopCmd cmd;
+            for (size_t i = 0; i < 6; ++i) {
+                cmd.angle[i] = target_angles(i);
+                cmd.torque[i] = torques(i);
+            }
+            lcm_.publish("/ra_closedloop_cmd", &cmd);
+            Trace::flowOut(Trace::messageId(cmd));
+        }
+    }
+
+    // if in sim_mode, simulate that we have gotten a new current position
+    else {
+        encoder_angles_sender_mtx.lock();
+        for (size_t i = 0; i < 6; ++i) {
+            arm_state.set_joint_angle(i, target_angles(i));
+        }
+        arm_snapshot.reset();
+        encoder_angles_sender_mtx.unlock();
     }
 }
 
+Vector6d MRoverArm::get_gravity_torques(const Vector6d &angles) {
+    // work on a copy, since arm_position_callback() keeps updating arm_state
+    ArmState gravity_state = *snapshot_arm_state();
+
+    for (size_t i = 0; i < 6; ++i) {
+        gravity_state.set_joint_angle(i, angles(i));
+    }
+    gravity_state.update_transforms();
+    return gravity_state.update_gravity_torques();
+}
+
+void MRoverArm::send_joint_trajectory(double elapsed) {
+    Trace::Span span("send joint trajectory");
+    RATrajectoryCmd cmd;
+    cmd.num_knots = NUM_TRAJECTORY_KNOTS;
+
+    Vector6d angles;
+    Vector6d derivs;
+    for (int k = 0; k < NUM_TRAJECTORY_KNOTS; ++k) {
+        // knots are timed from now, half a segment apart
+        double knot_time = (k + 1) * TRAJECTORY_SEGMENT_PERIOD / 2000.0;
+        double spline_t = trajectory.get_spline_t(elapsed + knot_time);
+        double speed = trajectory.get_spline_speed(elapsed + knot_time);
+
+        motion_planner.get_spline_pos(spline_t, angles);
+        motion_planner.get_spline_deriv(spline_t, 1, derivs);
+        cmd.time[k] = knot_time;
+
+        for (size_t i = 0; i < 6; ++i) {
+            double angle = angles(i);
+            double velocity = derivs(i) * speed;
+
+            // a joint held at its limit doesn't move
+            if (angle <= arm_state.get_joint_limits(i)[0]) {
+                angle = arm_state.get_joint_limits(i)[0];
+                velocity = 0.0;
+            }
+            else if (angle >= arm_state.get_joint_limits(i)[1]) {
+                angle = arm_state.get_joint_limits(i)[1];
+                velocity = 0.0;
+            }
+
+            // Adjust for encoders not being properly zeroed.
+            cmd.angle[i][k] = angle * arm_state.get_joint_encoder_multiplier(i) + arm_state.get_joint_encoder_offset(i);
+            cmd.velocity[i][k] = velocity * arm_state.get_joint_encoder_multiplier(i);
+        }
+    }
+
+    lcm_.publish("/ra_trajectory_cmd", &cmd);
+    Trace::flowOut(Trace::messageId(cmd));
+}
+
 void MRoverArm::simulation_mode_callback(std::string channel, SimulationMode msg) {
     sim_mode = msg.sim_mode;
     std::cout << "Received Simulation Mode value: " << sim_mode << "\n";
@@ -527,12 +937,15 @@ void MRoverArm::use_orientation_callback(std::string channel, UseOrientation msg
 void MRoverArm::lock_joints_callback(std::string channel, LockJoints msg) {
     std::cout << "Running lock_joints_callback:   ";
 
+    encoder_angles_sender_mtx.lock();
     arm_state.set_joint_locked(0, (bool) msg.joint_a);
     arm_state.set_joint_locked(1, (bool) msg.joint_b);
     arm_state.set_joint_locked(2, (bool) msg.joint_c);
     arm_state.set_joint_locked(3, (bool) msg.joint_d);
     arm_state.set_joint_locked(4, (bool) msg.joint_e);
     arm_state.set_joint_locked(5, (bool) msg.joint_f);
+    arm_snapshot.reset();
+    encoder_angles_sender_mtx.unlock();
 
     std::cout << "\n";
 }
@@ -544,22 +957,139 @@ void MRoverArm::zero_position_callback(std::string channel, ZeroPosition msg) {
 }
 
 void MRoverArm::arm_adjust_callback(std::string channel, ArmAdjustments msg) {
-    if (control_state != ControlState::WAITING_FOR_TARGET) {
+    servo_mtx.lock();
+
+    // Claimed in one step, like request_plan() claims it for a target to calculate
+    ControlState state = ControlState::WAITING_FOR_TARGET;
+    bool starting = control_state.compare_exchange_strong(state, ControlState::SERVOING);
+    if (!starting && state != ControlState::SERVOING) {
+        servo_mtx.unlock();
         std::cout << "Received target but not in closed-loop waiting state.\n";
         return;
     }
 
-    std::vector<double> current_pos = arm_state.get_ef_pos_and_euler_angles();
+    // A new servo starts from where the arm is, later adjustments move its target further
+    if (starting) {
+        servo_target = vecTo6d(snapshot_arm_state()->get_ef_pos_and_euler_angles());
+    }
+
+    servo_target(0) += msg.x * 0.0254; // 1 inch = 0.0254 meters
+    servo_target(1) += msg.y * 0.0254;
+    servo_target(2) += msg.z * 0.0254;
+    servo_target(3) += msg.alpha * 0.0174533; // 1 degree = 0.0174533 radians
+    servo_target(4) += msg.beta * 0.0174533;
+    servo_target(5) += msg.gamma * 0.0174533;
+
+    servo_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SERVO_TIMEOUT);
+
+    servo_mtx.unlock();
+    servo_cv.notify_one();
+}
+
+void MRoverArm::servo_executor() {
+    const std::chrono::milliseconds period(SERVO_PERIOD);
+    const double dt = std::chrono::duration<double>(period).count();
+
+    while (true) {
+        // sleep until arm_adjust_callback() starts servoing
+        std::unique_lock<std::mutex> lock(servo_mtx);
+        servo_cv.wait(lock, [this]() { return control_state == ControlState::SERVOING; });
+        lock.unlock();
+
+        // Targets aren't planned and IK isn't solved while servoing, so copies
+        // of the solver and arm taken now stay this thread's own. Steps build on
+        // the commanded angles, which the encoders only catch up to later
+        KinematicsSolver servo_solver = solver;
+        ArmState servo_state = *snapshot_arm_state();
+
+        std::chrono::steady_clock::time_point next_wakeup = std::chrono::steady_clock::now();
+        bool killed = false;
+        Vector6d stalled_time = Vector6d::Zero();
+
+        while (control_state == ControlState::SERVOING) {
+            if (encoder_error) {
+                encoder_error_mtx.lock();
+                std::string error_message = encoder_error_message;
+                encoder_error_mtx.unlock();
+
+                std::cout << error_message << "\n";
+                std::cout << "Sending kill command due to encoder error!\n";
+
+                DebugMessage msg;
+                msg.isError = true;
+                msg.message = error_message;
+                lcm_.publish("/debug_message", &msg);
+
+                servo_mtx.lock();
+                if (control_state == ControlState::SERVOING) {
+                    control_state = ControlState::WAITING_FOR_TARGET;
+                }
+                servo_mtx.unlock();
+
+                send_kill_cmd();
+                killed = true;
+                break;
+            }
+
+            // the steps keep going from where the arm was commanded, so one
+            // joint held back would otherwise leave it further behind each step
+            int stalled_joint = find_stalled_joint(vecTo6d(servo_state.get_joint_angles()), dt, stalled_time);
+            if (stalled_joint >= 0) {
+                servo_mtx.lock();
+                if (control_state == ControlState::SERVOING) {
+                    control_state = ControlState::WAITING_FOR_TARGET;
+                }
+                servo_mtx.unlock();
+
+                report_stall(stalled_joint);
+                killed = true;
+                break;
+            }
+
+            servo_mtx.lock();
+            Vector6d target = servo_target;
+            std::chrono::steady_clock::time_point deadline = servo_deadline;
+            servo_mtx.unlock();
+
+            ServoResult result = servo_solver.servo_step(servo_state, target, use_orientation, dt);
+            if (result == ServoResult::MOVING) {
+                send_joint_targets(vecTo6d(servo_state.get_joint_angles()));
+            }
+
+            bool timed_out = std::chrono::steady_clock::now() > deadline;
+            if (result != ServoResult::MOVING || timed_out) {
+                // Only stop if no adjustment moved the target in the meantime
+                servo_mtx.lock();
+                if (control_state == ControlState::SERVOING && servo_target == target) {
+                    control_state = ControlState::WAITING_FOR_TARGET;
 
-    TargetOrientation target;
-    target.x = current_pos[0] + (msg.x * 0.0254); // 1 inch = 0.0254 meters
-    target.y = current_pos[1] + (msg.y * 0.0254);
-    target.z = current_pos[2] + (msg.z * 0.0254);
-    target.alpha = current_pos[3] + (msg.alpha * 0.0174533); // 1 degree = 0.0174533 radians
-    target.beta = current_pos[4] + (msg.beta * 0.0174533);
-    target.gamma = current_pos[5] + (msg.gamma * 0.0174533);
+                    if (result == ServoResult::BLOCKED) {
+                        std::cout << "Stopped servoing, the next step would collide or leave the joint limits.\n";
+                    }
+                    else if (result == ServoResult::MOVING) {
+                        std::cout << "Stopped servoing, target not reached in time.\n";
+                    }
+                }
+                servo_mtx.unlock();
+            }
+
+            next_wakeup += period;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (next_wakeup + period < now) {
+                next_wakeup = now;
+            }
+            std::this_thread::sleep_until(next_wakeup);
+        }
 
-    target_orientation_callback("", target);
+        // Give the arm time to reach the last step, then stop driving it
+        // unless another adjustment has started servoing again
+        if (!killed) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SERVO_SETTLE_TIME));
+            if (control_state != ControlState::SERVOING) {
+                send_kill_cmd();
+            }
+        }
+    }
 }
 
 void MRoverArm::arm_preset_callback(std::string channel, ArmPreset msg) {
@@ -572,11 +1102,44 @@ void MRoverArm::arm_preset_callback(std::string channel, ArmPreset msg) {
     new_msg.joint_d = angles[3];
     new_msg.joint_e = angles[4];
     new_msg.joint_f = angles[5];
+    new_msg.stale_joints = 0;
 
     go_to_target_angles(new_msg);
 }
 
+void MRoverArm::arm_environment_callback(std::string channel, const ArmEnvironment &msg) {
+    ArmState current_state = *snapshot_arm_state();
+    current_state.transform_avoidance_links();
+
+    std::vector<Vector3d> points;
+    points.reserve(msg.num_points);
+    for (const std::vector<float> &point : msg.points) {
+        Vector3d position(point[0], point[1], point[2]);
+        if (current_state.get_point_gap(position) > ENVIRONMENT_SELF_MARGIN) {
+            points.push_back(position);
+        }
+    }
+
+    // Plans already running keep the environment they started with
+    std::shared_ptr<const EnvironmentMap> environment = std::make_shared<EnvironmentMap>(points);
+    encoder_angles_sender_mtx.lock();
+    arm_state.set_environment(environment);
+    arm_snapshot.reset();
+    encoder_angles_sender_mtx.unlock();
+}
+
+std::shared_ptr<const ArmState> MRoverArm::snapshot_arm_state() {
+    std::lock_guard<std::mutex> lock(encoder_angles_sender_mtx);
+    if (!arm_snapshot) {
+        arm_snapshot = std::make_shared<const ArmState>(arm_state);
+    }
+    return arm_snapshot;
+}
+
 void MRoverArm::encoder_angles_sender() {
+    const std::chrono::milliseconds period(SPLINE_WAIT_TIME);
+    std::chrono::steady_clock::time_point next_wakeup = std::chrono::steady_clock::now();
+
     // Continuously send mock values if in sim mode
     while (true) {
         if (sim_mode) {
@@ -589,15 +1152,69 @@ void MRoverArm::encoder_angles_sender() {
             arm_position.joint_d = arm_state.get_joint_angle(3);
             arm_position.joint_e = arm_state.get_joint_angle(4);
             arm_position.joint_f = arm_state.get_joint_angle(5);
+            arm_position.stale_joints = 0;
             lcm_.publish("/arm_position", &arm_position);
 
             encoder_angles_sender_mtx.unlock();
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(SPLINE_WAIT_TIME));
+        next_wakeup += period;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (next_wakeup + period < now) {
+            next_wakeup = now;
+        }
+        std::this_thread::sleep_until(next_wakeup);
+    }
+}
+
+void MRoverArm::arm_link_receiver() {
+    std::shared_ptr<ArmLink> link;
+
+    while (true) {
+        // the bridge makes a new segment each time it starts, so one that
+        // stopped being written to is given up for whatever is there now
+        if (!link || !link->is_alive()) {
+            std::shared_ptr<ArmLink> opened(ArmLink::open());
+            if (!opened || !opened->is_alive()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(ARM_LINK_RETRY_TIME));
+                continue;
+            }
+            if (!link) {
+                std::cout << "Connected to the nucleo bridge's arm link.\n";
+            }
+            link = opened;
+            std::lock_guard<std::mutex> lock(arm_link_mtx);
+            arm_link = link;
+        }
+
+        ArmLinkFeedback feedback;
+        if (link->read_feedback(feedback, std::chrono::milliseconds(ARM_LINK_WAIT)) && !sim_mode) {
+            update_arm_position(std::vector<double>(feedback.angle, feedback.angle + ARM_LINK_JOINTS),
+                                feedback.stale_joints);
+        }
     }
 }
 
+bool MRoverArm::send_arm_link(const Vector6d &target_angles, const Vector6d &torques) {
+    std::lock_guard<std::mutex> lock(arm_link_mtx);
+    if (!arm_link || !arm_link->is_alive()) {
+        return false;
+    }
+
+    ArmLinkSetpoint setpoint;
+    for (size_t i = 0; i < ARM_LINK_JOINTS; ++i) {
+        setpoint.angle[i] = target_angles(i);
+        setpoint.torque[i] = torques(i);
+    }
+    arm_link->write_setpoint(setpoint);
+    return true;
+}
+
+bool MRoverArm::arm_link_alive() {
+    std::lock_guard<std::mutex> lock(arm_link_mtx);
+    return arm_link && arm_link->is_alive();
+}
+
 void MRoverArm::publish_config(const std::vector<double> &config, std::string channel) {
        ArmPosition arm_position;
        arm_position.joint_a = config[0];
@@ -606,20 +1223,37 @@ void MRoverArm::publish_config(const std::vector<double> &config, std::string ch
        arm_position.joint_d = config[3];
        arm_position.joint_e = config[4];
        arm_position.joint_f = config[5];
+       arm_position.stale_joints = 0;
        lcm_.publish(channel, &arm_position); //no matching call to publish should take in const msg type msg
 }
 
+void MRoverArm::publish_config(const Vector6d &config, std::string channel) {
+       ArmPosition arm_position;
+       arm_position.joint_a = config(0);
+       arm_position.joint_b = config(1);
+       arm_position.joint_c = config(2);
+       arm_position.joint_d = config(3);
+       arm_position.joint_e = config(4);
+       arm_position.joint_f = config(5);
+       arm_position.stale_joints = 0;
+       lcm_.publish(channel, &arm_position);
+}
+
 void MRoverArm::publish_transforms(const ArmState& arbitrary_state) {
     FKTransform tm;
+    fill_transforms(tm, arbitrary_state);
+
+    lcm_.publish("/fk_transform", &tm);
+}
+
+void MRoverArm::fill_transforms(FKTransform &tm, const ArmState& arbitrary_state) {
     matrix_helper(tm.transform_a, arbitrary_state.get_joint_transform(0));
     matrix_helper(tm.transform_b, arbitrary_state.get_joint_transform(1));
     matrix_helper(tm.transform_c, arbitrary_state.get_joint_transform(2));
     matrix_helper(tm.transform_d, arbitrary_state.get_joint_transform(3));
     matrix_helper(tm.transform_e, arbitrary_state.get_joint_transform(4));
     matrix_helper(tm.transform_f, arbitrary_state.get_joint_transform(5));
-
-    lcm_.publish("/fk_transform", &tm);
-}      
+}
 
 void MRoverArm::matrix_helper(double arr[4][4], const Matrix4d &mat) {
    for (int i = 0; i < 4; ++i) {
@@ -652,7 +1286,7 @@ void MRoverArm::check_dud_encoder(std::vector<double> &angles) const {
 void MRoverArm::check_joint_limits(std::vector<double> &angles) {
     // For each angle
     for (size_t i = 0; i < angles.size(); ++i) {
-        std::vector<double> limits = arm_state.get_joint_limits(i);
+        const std::array<double, 2> &limits = arm_state.get_joint_limits(i);
 
         // If angle is only just past lower limit
         if (angles[i] < limits[0] && std::abs(angles[i] - limits[0]) < ACCEPTABLE_BEYOND_LIMIT) {
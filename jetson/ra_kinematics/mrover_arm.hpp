@@ -5,15 +5,27 @@
 #include <lcm/lcm-cpp.hpp>
 #include "nlohmann/json.hpp"
 #include <eigen3/Eigen/Dense>
-#include "kluge/spline.h"
 
-#include <deque>
+#include <array>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <functional>
 
 #include "mrover_arm.hpp"
 #include "arm_state.hpp"
 #include "motion_planner.hpp"
+#include "trajectory.hpp"
+#include "solution_cache.hpp"
+#include "reachability_map.hpp"
+#include "motion_lattice.hpp"
+#include "plan_log.hpp"
+#include "joint_estimator.hpp"
 #include "kinematics.hpp"
+#include "arm_link.hpp"
+#include "thor.hpp"
 
 // LCM messages
 #include "rover_msgs/ArmPosition.hpp"
@@ -32,6 +44,9 @@
 #include "rover_msgs/UseOrientation.hpp"
 #include "rover_msgs/ArmPreset.hpp"
 #include "rover_msgs/ArmAdjustments.hpp"
+#include "rover_msgs/RATrajectoryCmd.hpp"
+#include "rover_msgs/RAClosedLoopCmd.hpp"
+#include "rover_msgs/ArmEnvironment.hpp"
 
 using namespace rover_msgs;
  
@@ -40,21 +55,56 @@ using namespace Eigen;
  
 typedef Matrix<double, 6, 1> Vector6d;
 
-// percentage of path to calculate move time
-static constexpr double D_SPLINE_T = 0.05;
-static constexpr double MAX_SPLINE_T_IT = 0.02;
-
 // in ms, wait time for execute_spline loop
 static constexpr int SPLINE_WAIT_TIME = 50;
 
+// in ms, time between the trajectory segments execute_spline() sends when
+// trajectory_streaming is set. Each segment has NUM_TRAJECTORY_KNOTS knots
+// half a period apart, so it reaches past the next one
+static constexpr int TRAJECTORY_SEGMENT_PERIOD = 100;
+static constexpr int NUM_TRAJECTORY_KNOTS = 3;
+
+// Frames of the preview sent to the GUI, and ms between them
+static constexpr int PREVIEW_STEPS = 30;
+static constexpr int PREVIEW_FRAME_TIME = 33;
+
+// in ms, time between steps of Cartesian servoing
+static constexpr int SERVO_PERIOD = 10;
+
+// in ms, servoing gives up on a target it hasn't reached this long after the last adjustment
+static constexpr int SERVO_TIMEOUT = 2000;
+
+// in ms, wait after servoing stops before sending the kill command, unless it starts again
+static constexpr int SERVO_SETTLE_TIME = 500;
+
+// in ms, how often arm_link_receiver() looks for the bridge's arm link while there is none
+static constexpr int ARM_LINK_RETRY_TIME = 1000;
+
+// in ms, longest arm_link_receiver() waits for feedback before checking the link is still up
+static constexpr int ARM_LINK_WAIT = 100;
+
+// RRT-Connect planners raced against each other for each path
+static constexpr int NUM_PARALLEL_PLANNERS = 4;
+
+// in meters, points of an ArmEnvironment this close to the arm where it is are taken to
+// be the arm itself, which the point cloud it comes from sees too
+static constexpr double ENVIRONMENT_SELF_MARGIN = 0.05;
+
 // Angle in radians to determine when encoders are sending faulty values
 static constexpr double ENCODER_ERROR_THRESHOLD = 0.1;
 
 static constexpr size_t MAX_NUM_PREV_ANGLES = 5;
+static_assert(MAX_NUM_PREV_ANGLES <= JOINT_ESTIMATOR_HISTORY, "joint estimators keep too few readings");
 static constexpr size_t MAX_FISHY_VALS = 1;
 
 static constexpr double DUD_ENCODER_EPSILON = 0.005;
 
+// A joint is stalled once it has been more than STALL_ERROR radians from where it is
+// driven to, moving slower than STALL_VELOCITY radians/s, for STALL_TIME seconds
+static constexpr double STALL_ERROR = 0.2;
+static constexpr double STALL_VELOCITY = 0.05;
+static constexpr double STALL_TIME = 0.3;
+
 //Angle in radians that physical arm can be without causing problems
 static constexpr double ACCEPTABLE_BEYOND_LIMIT = 0.05;
 
@@ -72,6 +122,17 @@ private:
     ArmState arm_state;
     KinematicsSolver solver;
     MotionPlanner motion_planner;
+    Trajectory trajectory;
+    SolutionCache solution_cache;
+
+    // empty unless `$ make reachability_map` generated one for this geometry
+    ReachabilityMap reachability_map;
+
+    // empty unless `$ make motion_lattice` generated one for this geometry
+    MotionLattice motion_lattice;
+
+    // closed unless MROVER_PLAN_LOG names a file to log planning requests to
+    PlanLog plan_log;
     lcm::LCM &lcm_;
     
     enum ControlState {
@@ -80,27 +141,91 @@ private:
         CALCULATING,        // Running IK and motion planning
         PREVIEWING,         // Showing the preview on hypothetical arm
         READY_TO_EXECUTE,   // Previewed, ready for execution
-        EXECUTING           // Executing arm movement
+        EXECUTING,          // Executing arm movement
+        SERVOING            // Following arm adjustments with the jacobian, without planning
     };
 
-    ControlState control_state;
-
-    bool sim_mode;
+    // Written by the LCM thread and read by execute_spline(). The planned path
+    // and its trajectory are only changed while not EXECUTING, so switching to
+    // EXECUTING hands them to execute_spline()
+    std::atomic<ControlState> control_state;
+
+    // execute_spline() waits on this until control_state is EXECUTING
+    std::mutex execute_mtx;
+    std::condition_variable execute_cv;
+
+    // plan_path() fills preview_frames and sets preview_pending, and
+    // preview_sender() sends them. Both are guarded by preview_mtx
+    std::vector<FKTransform> preview_frames;
+    std::atomic<bool> preview_pending;
+    std::mutex preview_mtx;
+    std::condition_variable preview_cv;
+
+    // arm_adjust_callback() moves servo_target and servo_deadline, and
+    // servo_executor() follows it. Both are guarded by servo_mtx, which is also
+    // held to move control_state in or out of SERVOING
+    Vector6d servo_target;
+    std::chrono::steady_clock::time_point servo_deadline;
+    std::mutex servo_mtx;
+    std::condition_variable servo_cv;
+
+    // request_plan() leaves the newest target in plan_target for path_planner()
+    // and bumps plan_generation, which cancels the plan of any older target.
+    // Guarded by plan_mtx, which is also held while a finished plan is handed
+    // over, so only the plan of the newest target is ever used
+    Vector6d plan_target;
+    bool plan_target_is_angles;
+    bool plan_pending;
+    std::atomic<unsigned> plan_generation;
+    std::mutex plan_mtx;
+    std::condition_variable plan_cv;
+
+    std::atomic<bool> sim_mode;
     bool use_orientation;
+
+    // set by "trajectory_streaming" in the geometry config, for controllers
+    // that interpolate trajectory segments themselves
+    bool trajectory_streaming;
     bool zero_encoders;
 
     double prev_angle_b;
 
-    bool encoder_error;
+    // encoder_error_mtx guards encoder_error_message
+    std::atomic<bool> encoder_error;
     std::string encoder_error_message;
+    std::mutex encoder_error_mtx;
 
-    std::vector< std::deque<double> > prev_angles;
+    // filtered position and velocity of each joint from its encoder readings,
+    // guarded by arm_position_mtx
+    std::array<JointEstimator, 6> joint_estimators;
+
+    // copy of joint_estimators after every arm position, for execute_spline()
+    // to check every period without waiting on a position being handled
+    Thor::SeqVolatile<std::array<JointEstimator, 6>> joint_estimates;
     std::vector<bool> faulty_encoders;
 
+    // Guards arm_state against the threads that copy it: path_planner(),
+    // servo_executor() and encoder_angles_sender()
     std::mutex encoder_angles_sender_mtx;
+
+    // Immutable copy of arm_state that every reader shares until arm_state
+    // changes, see snapshot_arm_state(). Also guarded by encoder_angles_sender_mtx,
+    // and reset along with every change to arm_state
+    std::shared_ptr<const ArmState> arm_snapshot;
     
     std::vector<double> DUD_ENCODER_VALUES;
 
+    // Shared memory path to a nucleo bridge on the same machine built with
+    // arm_link. arm_link_receiver() opens it, and opens it again after the
+    // bridge restarts. arm_link_mtx guards the pointer and writing
+    // setpoints, which execute_spline() and servo_executor() both do
+    std::shared_ptr<ArmLink> arm_link;
+    std::mutex arm_link_mtx;
+
+    // Arm positions come from the LCM thread or arm_link_receiver(), and
+    // both can for a moment while the link comes up or goes down
+    std::mutex arm_position_mtx;
+
 public:
 
     /**
@@ -124,13 +249,15 @@ public:
      * update arm_state and call FK() to adjust transforms
      * 
      * @param channel expected: "/arm_position"
-     * @param msg format: double joint_a, joint_b, ... , joint_f
+     * @param msg format: double joint_a, joint_b, ... , joint_f,
+     * read in place from the received buffer
+     * Ignored while the arm link is up, which carries the same positions
      * */
-    void arm_position_callback(std::string channel, ArmPosition msg);
+    void arm_position_callback(std::string channel, const ArmPosition::View &msg);
 
     /**
-     * Handle new target position by calculating angles and plotting path,
-     * then preview path
+     * Handle new target position by having path_planner() calculate angles
+     * and plot a path, then preview it. Replaces a target still being planned
      * 
      * @param channel expected: "/target_orientation" or "/arm_adjustments"
      * @param msg float x, y, z, alpha, beta, gamma
@@ -138,7 +265,8 @@ public:
     void target_orientation_callback(std::string channel, TargetOrientation msg);
 
     /**
-     * Handle request to go to specific set of angles
+     * Handle request to go to specific set of angles, planned by path_planner()
+     * like target_orientation_callback() targets
      * @param msg format: double joint_a, joint_b, joint_c, joint_d, joint_e, joint_f
      * */
     void go_to_target_angles(ArmPosition msg);
@@ -184,11 +312,12 @@ public:
     void zero_position_callback(std::string channel, ZeroPosition msg);
 
     /**
-     * Calculate new target orientation using current pos and adjustments and
-     * call target_orientation_callback 
+     * Move the servo target by the adjustments, starting from the current
+     * pose, and start servoing towards it. Adjustments that arrive while
+     * servoing add up, so the arm follows a stream of small nudges without planning
      * 
      * @param channel expected: "/arm_adjustments"
-     * @param msg float x, y, z, alpha, beta, gamma
+     * @param msg float x, y, z in inches, alpha, beta, gamma in degrees
      * */
     void arm_adjust_callback(std::string channel, ArmAdjustments msg);
 
@@ -200,27 +329,163 @@ public:
      */
     void arm_preset_callback(std::string channel, ArmPreset msg);
 
+    /**
+     * Handle the occupied space around the arm, which targets planned after
+     * it avoid. Points on the arm where it is now are dropped
+     * 
+     * @param channel expected: "/arm_environment"
+     * @param msg format: points in meters, in the frame of the arm's base
+     */
+    void arm_environment_callback(std::string channel, const ArmEnvironment &msg);
+
     /**
      * Asynchronous function, runs when control_state is "EXECUTING"
      * Executes current path on physical rover, unless sim_mode is true
+     * Wakes every SPLINE_WAIT_TIME ms on absolute deadlines while executing,
+     * or every TRAJECTORY_SEGMENT_PERIOD ms when streaming trajectory segments,
+     * and sleeps until execution starts otherwise
      * */
     void execute_spline();
 
+    /**
+     * Asynchronous function, runs when control_state is "SERVOING"
+     * Takes a step towards servo_target every SERVO_PERIOD ms, checking each
+     * step for collisions and joint limits, until it is reached, a step is
+     * blocked or SERVO_TIMEOUT passes without an adjustment
+     * */
+    void servo_executor();
+
+    /**
+     * Asynchronous function, runs when control_state is "CALCULATING"
+     * Plans the newest target from request_plan(), off the LCM thread so arm
+     * positions keep being handled, and gives up on it as soon as a newer one
+     * arrives. Only a plan that is still the newest replaces motion_planner
+     * and trajectory, and goes on to preview
+     * */
+    void path_planner();
+
+    /**
+     * Asynchronous function, runs when control_state is "PREVIEWING"
+     * Sends the frames of the latest preview to the GUI every PREVIEW_FRAME_TIME
+     * ms, then waits for execution to be approved
+     * */
+    void preview_sender();
+
     /**
      * Asynchronous function, runs when sim_mode is true
      * Sends mock encoder values based on arm_state
      */
     void encoder_angles_sender();
 
+    /**
+     * Asynchronous function, looks for the nucleo bridge's arm link every
+     * ARM_LINK_RETRY_TIME ms until it finds one that is up, then handles the
+     * arm positions it sends like arm_position_callback() does.
+     * While the link is up, send_joint_targets() sends through it instead of LCM
+     * */
+    void arm_link_receiver();
+
 private:
 
-    void plan_path(ArmState& hypo_state, Vector6d goal);
+    /**
+     * Hands target to path_planner(), as joint angles or an end effector
+     * point. Fails unless waiting for a target or already calculating one
+     * */
+    bool request_plan(const Vector6d &target, bool is_angles);
+
+    /**
+     * Plans to the target, filling in how it went and how long it took in record
+     * */
+    void plan_to_point(const Vector6d &point, const std::function<bool()> &canceled, PlanRecord &record);
+
+    void plan_to_angles(const Vector6d &target, const std::function<bool()> &canceled, PlanRecord &record);
+
+    /**
+     * Plans a path to goal into copies of motion_planner and trajectory,
+     * which replace them and are previewed unless canceled
+     * */
+    void plan_path(ArmState& hypo_state, Vector6d goal, const std::function<bool()> &canceled, PlanRecord &record);
+
+    /**
+     * Starts record of a request to plan to target from hypo_state
+     * */
+    void start_plan_record(const ArmState &hypo_state, const Vector6d &target, bool is_angles, PlanRecord &record);
+
+    /**
+     * Goes back to waiting for a target and tells the GUI why, unless the
+     * plan was canceled and something else has decided the state
+     * */
+    void plan_failed(const std::function<bool()> &canceled, const std::string &message);
+
+    /**
+     * Computes the transforms along the planned path and hands them to preview_sender()
+     * */
     void preview(ArmState& hypo_state);
 
+    /**
+     * Sends target_angles, clipped to the joint limits, to the arm with the
+     * torques that hold it up there, or moves arm_state there in sim_mode
+     * */
+    void send_joint_targets(Vector6d target_angles);
+
+    /**
+     * @return the torque each joint needs to hold the arm still at angles
+     * against gravity, in N*m
+     * */
+    Vector6d get_gravity_torques(const Vector6d &angles);
+
+    /**
+     * Planners, IK workers, preview and servoing hold it while arm_state keeps
+     * updating, and copy it only to move it. It's copied from arm_state the
+     * first time it's asked for after a change, so readers between changes
+     * share one copy and never hold the lock while copying it themselves
+     * @return snapshot of arm_state as of now
+     * */
+    std::shared_ptr<const ArmState> snapshot_arm_state();
+
+    /**
+     * Sends the physical arm the next segment of the trajectory from elapsed
+     * seconds in, as NUM_TRAJECTORY_KNOTS angles and velocities per joint,
+     * clipped to the joint limits, for the controllers to interpolate between
+     * */
+    void send_joint_trajectory(double elapsed);
+
+    /**
+     * Handles joint angles read by the encoders, from either "/arm_position"
+     * or the arm link
+     * */
+    void update_arm_position(std::vector<double> angles, int32_t stale_joints);
+
+    /**
+     * Checks the estimated joints against target_angles, which they are being
+     * driven to
+     * @param dt seconds since the last check
+     * @param stalled_time how long each joint has looked stalled, updated for this check
+     * @return the first joint stalled for STALL_TIME, or -1
+     * */
+    int find_stalled_joint(const Vector6d &target_angles, double dt, Vector6d &stalled_time);
+
+    /**
+     * Stops the arm for the joint find_stalled_joint() found, and tells the GUI
+     * */
+    void report_stall(int joint);
+
+    /**
+     * Sends target_angles and their feed forward torques, already adjusted for
+     * the encoders, through the arm link. Returns false if the link isn't up,
+     * so they have to go over LCM
+     * */
+    bool send_arm_link(const Vector6d &target_angles, const Vector6d &torques);
+
+    bool arm_link_alive();
+
     void publish_config(const std::vector<double> &config, std::string channel);
+    void publish_config(const Vector6d &config, std::string channel);
 
     void publish_transforms(const ArmState& arbitrary_state);
 
+    void fill_transforms(FKTransform &tm, const ArmState& arbitrary_state);
+
     void matrix_helper(double arr[4][4], const Matrix4d &mat);
 
     void check_dud_encoder(std::vector<double> &angles) const;
@@ -0,0 +1,51 @@
+#include "plan_log.hpp"
+
+#include <iostream>
+
+bool PlanLog::open(const std::string &filepath) {
+    file.open(filepath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "Could not write plan log " << filepath << "\n";
+        return false;
+    }
+
+    Header header = { PLAN_LOG_MAGIC, PLAN_LOG_VERSION, sizeof(PlanRecord), 0 };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.flush();
+    return static_cast<bool>(file);
+}
+
+bool PlanLog::is_open() const {
+    return file.is_open();
+}
+
+void PlanLog::write(const PlanRecord &record) {
+    if (!file.is_open()) {
+        return;
+    }
+
+    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    file.flush();
+}
+
+bool PlanLog::read(const std::string &filepath, std::vector<PlanRecord> &records) {
+    records.clear();
+
+    std::ifstream file(filepath, std::ios::binary);
+    Header header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return false;
+    }
+
+    if (header.magic != PLAN_LOG_MAGIC || header.version != PLAN_LOG_VERSION ||
+        header.record_size != sizeof(PlanRecord)) {
+        std::cout << "Plan log " << filepath << " is not a plan log of this version\n";
+        return false;
+    }
+
+    PlanRecord record;
+    while (file.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+        records.push_back(record);
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef PLAN_LOG_H
+#define PLAN_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Identifies a plan log file, and its layout version
+static constexpr uint32_t PLAN_LOG_MAGIC = 0x6d61706c;
+static constexpr uint32_t PLAN_LOG_VERSION = 1;
+
+// How a planning request ended
+enum class PlanResult : uint8_t {
+    PLANNED,
+    UNSAFE_START,
+    OUT_OF_REACH,
+    NO_IK,
+    NO_PATH,
+    CANCELED
+};
+
+// Where the path of a planned request came from
+enum class PlanSource : uint8_t {
+    NONE,
+    CACHE,
+    LATTICE,
+    RRT
+};
+
+/**
+ * One planning request as MRoverArm received and planned it. The arm's
+ * environment isn't recorded, only whether it had one.
+ * */
+struct PlanRecord {
+    // in s since the steady clock's epoch, when planning started
+    double time;
+
+    double start[6];
+
+    // joint angles if is_angles, otherwise the end effector point and angles
+    double target[6];
+
+    // joint angles planned to, the target itself or the IK solution
+    double goal[6];
+
+    // in ms, spent on IK and on planning the path
+    double ik_ms;
+    double plan_ms;
+
+    // bit i is set if joint i was locked
+    uint8_t locks;
+
+    uint8_t is_angles;
+    uint8_t use_orientation;
+    uint8_t has_environment;
+
+    PlanResult result;
+    PlanSource source;
+    uint8_t padding[2];
+};
+
+/**
+ * Binary log of planning requests, a header followed by PlanRecords in the
+ * order they were planned. Records are written whole and flushed one at a
+ * time, so a log cut off by a crash still reads up to its last request.
+ * */
+class PlanLog {
+private:
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t padding;
+    };
+
+    std::ofstream file;
+
+public:
+
+    /**
+     * Starts a new log at filepath, replacing one that is there
+     * @return true if the file was opened
+     * */
+    bool open(const std::string &filepath);
+
+    bool is_open() const;
+
+    void write(const PlanRecord &record);
+
+    /**
+     * Reads every whole record of the log at filepath into records
+     * @return false if the file can't be read or isn't a plan log of this version
+     * */
+    static bool read(const std::string &filepath, std::vector<PlanRecord> &records);
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "reachability_map.hpp"
+#include "arm_state.hpp"
+#include "joint_sampler.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    /**
+     * @return bytes of the reachable flags in a file, padded so the seeds after them stay aligned
+     * */
+    size_t reachable_bytes(size_t cells) {
+        size_t bytes = cells * cells * cells;
+        return (bytes + sizeof(float) - 1) / sizeof(float) * sizeof(float);
+    }
+
+}
+
+ReachabilityMap::ReachabilityMap() :
+    width(0), cells(0), reachable(nullptr), seeds(nullptr), mapping(nullptr), mapping_length(0), fingerprint(0) { }
+
+ReachabilityMap::~ReachabilityMap() {
+    unmap();
+}
+
+void ReachabilityMap::unmap() {
+    if (mapping) {
+        munmap(mapping, mapping_length);
+        mapping = nullptr;
+        mapping_length = 0;
+    }
+}
+
+void ReachabilityMap::init(const ArmModel &model, size_t num_cells) {
+    cells = num_cells;
+
+    // Joint a turns about the first joint's position, so the grid is centered there
+    double reach = get_max_reach(model);
+    lower = model.joints[0].pos_local - Vector3d::Constant(reach);
+    width = 2 * reach / num_cells;
+
+    // Everything where the end effector gets to and which poses are safe depend on
+    fingerprint = FINGERPRINT_BASIS;
+    fingerprint_add(fingerprint, static_cast<uint64_t>(num_cells));
+    fingerprint_add(fingerprint, static_cast<uint64_t>(REACHABILITY_MAP_ORIENTATIONS));
+    fingerprint_add(fingerprint, model.ef_xyz);
+
+    for (const JointModel &joint : model.joints) {
+        fingerprint_add(fingerprint, joint.pos_local);
+        fingerprint_add(fingerprint, joint.rot_axis);
+        fingerprint_add(fingerprint, joint.limits[0]);
+        fingerprint_add(fingerprint, joint.limits[1]);
+    }
+
+    for (const AvoidanceLinkModel &link : model.avoidance_links) {
+        fingerprint_add(fingerprint, static_cast<uint64_t>(link.joint_origin));
+        fingerprint_add(fingerprint, static_cast<uint32_t>(link.type));
+        fingerprint_add(fingerprint, link.radius);
+        fingerprint_add(fingerprint, link.points[0]);
+        fingerprint_add(fingerprint, link.points[1]);
+    }
+
+    for (const std::array<size_t, 2> &pair : model.collision_pairs) {
+        fingerprint_add(fingerprint, static_cast<uint64_t>(pair[0]));
+        fingerprint_add(fingerprint, static_cast<uint64_t>(pair[1]));
+    }
+}
+
+long ReachabilityMap::cell_index(const Vector3d &position) const {
+    long index = 0;
+    for (int i = 0; i < 3; ++i) {
+        double cell = std::floor((position(i) - lower(i)) / width);
+        if (!(cell >= 0 && cell < cells)) {
+            return -1;
+        }
+        index = index * cells + static_cast<long>(cell);
+    }
+    return index;
+}
+
+size_t ReachabilityMap::orientation_index(const Matrix3d &rotation) {
+    // the face of the cube the end effector's x axis points through
+    Vector3d x_axis = rotation.col(0);
+    Vector3d::Index axis;
+    x_axis.cwiseAbs().maxCoeff(&axis);
+    return 2 * axis + (x_axis(axis) < 0 ? 1 : 0);
+}
+
+void ReachabilityMap::generate(const ArmModel &model, size_t num_samples, size_t num_cells) {
+    unmap();
+    init(model, num_cells);
+
+    size_t num_positions = cells * cells * cells;
+    Seed none;
+    std::fill(none.angles, none.angles + NUM_JOINTS, std::numeric_limits<float>::quiet_NaN());
+    generated_seeds.assign(num_positions * REACHABILITY_MAP_ORIENTATIONS, none);
+
+    // how far each seed's end effector is from the center of its cell
+    std::vector<double> seed_dist(generated_seeds.size(), std::numeric_limits<double>::infinity());
+
+    // all joints unlocked, so the map covers all the arm can reach
+    ArmState robot(model);
+    JointSampler sampler;
+    sampler.set_mode(SamplingMode::HALTON);
+    sampler.seed(0);
+    Vector6d zero = Vector6d::Zero();
+
+    for (size_t n = 0; n < num_samples; ++n) {
+        Vector6d angles = sampler.sample(robot, zero);
+        robot.set_joint_angles_6d(angles);
+        robot.update_transforms();
+        if (!robot.obstacle_free()) {
+            continue;
+        }
+
+        Matrix4d ef_transform = robot.get_ef_transform();
+        Vector3d position = ef_transform.block(0, 3, 3, 1);
+        long cell = cell_index(position);
+        if (cell < 0) {
+            continue;
+        }
+
+        Vector3d center;
+        for (int i = 0; i < 3; ++i) {
+            center(i) = lower(i) + (std::floor((position(i) - lower(i)) / width) + 0.5) * width;
+        }
+
+        size_t index = cell * REACHABILITY_MAP_ORIENTATIONS + orientation_index(ef_transform.block(0, 0, 3, 3));
+        double dist = (position - center).norm();
+        if (dist < seed_dist[index]) {
+            seed_dist[index] = dist;
+            for (size_t i = 0; i < NUM_JOINTS; ++i) {
+                generated_seeds[index].angles[i] = static_cast<float>(angles(i));
+            }
+        }
+    }
+
+    // Samples near the edge of the workspace are sparse, so a cell next to
+    // one a pose was found in could still be reached and isn't ruled out
+    generated_reachable.assign(num_positions, 0);
+    for (size_t cell = 0; cell < num_positions; ++cell) {
+        bool found = false;
+        for (size_t o = 0; o < REACHABILITY_MAP_ORIENTATIONS; ++o) {
+            found = found || !std::isnan(generated_seeds[cell * REACHABILITY_MAP_ORIENTATIONS + o].angles[0]);
+        }
+        if (!found) {
+            continue;
+        }
+
+        long x = cell / (cells * cells);
+        long y = cell / cells % cells;
+        long z = cell % cells;
+        for (long dx = std::max(x - 1, 0L); dx <= std::min(x + 1, static_cast<long>(cells) - 1); ++dx) {
+            for (long dy = std::max(y - 1, 0L); dy <= std::min(y + 1, static_cast<long>(cells) - 1); ++dy) {
+                for (long dz = std::max(z - 1, 0L); dz <= std::min(z + 1, static_cast<long>(cells) - 1); ++dz) {
+                    generated_reachable[(dx * cells + dy) * cells + dz] = 1;
+                }
+            }
+        }
+    }
+
+    reachable = generated_reachable.data();
+    seeds = generated_seeds.data();
+}
+
+bool ReachabilityMap::save(const std::string &filepath) const {
+    if (empty()) {
+        return false;
+    }
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        std::cout << "Could not write reachability map " << filepath << "\n";
+        return false;
+    }
+
+    Header header = { REACHABILITY_MAP_MAGIC, REACHABILITY_MAP_VERSION, fingerprint, static_cast<uint32_t>(cells),
+                      static_cast<uint32_t>(REACHABILITY_MAP_ORIENTATIONS), { lower(0), lower(1), lower(2) }, width };
+    size_t num_positions = cells * cells * cells;
+    std::vector<char> padding(reachable_bytes(cells) - num_positions, 0);
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(reachable), num_positions);
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char *>(seeds), num_positions * REACHABILITY_MAP_ORIENTATIONS * sizeof(Seed));
+
+    return static_cast<bool>(file);
+}
+
+bool ReachabilityMap::load(const std::string &filepath, const ArmModel &model) {
+    unmap();
+    generated_reachable.clear();
+    generated_seeds.clear();
+    reachable = nullptr;
+    seeds = nullptr;
+
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = st.st_size;
+    void *data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+
+    size_t num_positions = static_cast<size_t>(header.cells) * header.cells * header.cells;
+    bool valid = header.magic == REACHABILITY_MAP_MAGIC && header.version == REACHABILITY_MAP_VERSION &&
+                 header.cells > 0 && header.orientations == REACHABILITY_MAP_ORIENTATIONS &&
+                 length == sizeof(Header) + reachable_bytes(header.cells) +
+                           num_positions * REACHABILITY_MAP_ORIENTATIONS * sizeof(Seed);
+    if (valid) {
+        init(model, header.cells);
+        valid = header.fingerprint == fingerprint;
+    }
+
+    if (!valid) {
+        std::cout << "Reachability map " << filepath << " is not for this arm geometry, regenerate it\n";
+        munmap(data, length);
+        cells = 0;
+        return false;
+    }
+
+    mapping = data;
+    mapping_length = length;
+    reachable = static_cast<const uint8_t *>(data) + sizeof(Header);
+    seeds = reinterpret_cast<const Seed *>(reachable + reachable_bytes(cells));
+    return true;
+}
+
+bool ReachabilityMap::empty() const {
+    return reachable == nullptr;
+}
+
+bool ReachabilityMap::is_reachable(const Vector3d &position) const {
+    long cell = cell_index(position);
+    return cell >= 0 && reachable[cell];
+}
+
+bool ReachabilityMap::find_seed(const Vector6d &target_point, bool use_orientation, Vector6d &seed) const {
+    if (empty()) {
+        return false;
+    }
+
+    long cell = cell_index(target_point.head(3));
+    if (cell < 0) {
+        return false;
+    }
+
+    const Seed *cell_seeds = seeds + cell * REACHABILITY_MAP_ORIENTATIONS;
+    const Seed *found = nullptr;
+    if (use_orientation) {
+        const Seed &oriented = cell_seeds[orientation_index(compute_rotation_matrix(target_point.tail(3)))];
+        if (!std::isnan(oriented.angles[0])) {
+            found = &oriented;
+        }
+    }
+
+    // any way the end effector points in the cell is a better start than nothing
+    for (size_t o = 0; !found && o < REACHABILITY_MAP_ORIENTATIONS; ++o) {
+        if (!std::isnan(cell_seeds[o].angles[0])) {
+            found = &cell_seeds[o];
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    for (size_t i = 0; i < NUM_JOINTS; ++i) {
+        seed(i) = found->angles[i];
+    }
+    return true;
+}
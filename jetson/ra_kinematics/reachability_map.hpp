@@ -0,0 +1,144 @@
+#ifndef REACHABILITY_MAP_H
+#define REACHABILITY_MAP_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "arm_model.hpp"
+
+using namespace Eigen;
+
+typedef Matrix<double, 6, 1> Vector6d;
+
+// Cells each side of the box around everything the end effector can reach is split into
+static constexpr size_t REACHABILITY_MAP_CELLS = 32;
+
+// Coarse orientations of the end effector, by which face of a cube its x axis points through
+static constexpr size_t REACHABILITY_MAP_ORIENTATIONS = 6;
+
+// Poses sampled to fill in the map
+static constexpr size_t REACHABILITY_MAP_SAMPLES = 2000000;
+
+// Identifies a reachability map file, and its layout version
+static constexpr uint32_t REACHABILITY_MAP_MAGIC = 0x6d617272;
+static constexpr uint32_t REACHABILITY_MAP_VERSION = 1;
+
+/**
+ * Precomputed map of where the end effector can get to.
+ *
+ * Safe poses spread evenly over the joint space are sorted into a grid over
+ * the end effector's position and coarse orientation. A cell keeps the pose
+ * that puts the end effector closest to its center, as a seed for IK, and a
+ * position is only reachable if a pose was found in its cell or one next to
+ * it. Targets where no pose can put the end effector are rejected without
+ * running IK, and the rest start IK from their cell's seed.
+ *
+ * The map is generated once for a geometry with `$ make reachability_map`
+ * and memory-mapped from the file, which also records a fingerprint of the
+ * geometry so a stale map is never used. Locked joints only take away from
+ * where the arm reaches, so they don't make the map wrong either.
+ * */
+class ReachabilityMap {
+private:
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fingerprint;
+        uint32_t cells;
+        uint32_t orientations;
+        double lower[3];
+        double width;
+    };
+
+    // the angles of a cell's seed, NaN in a cell no pose was found in
+    struct Seed {
+        float angles[NUM_JOINTS];
+    };
+
+    // corner of the grid and width of its cells
+    Vector3d lower;
+    double width;
+    size_t cells;
+
+    // cells^3 flags, z changing fastest. 1 where a pose was found in or next to the cell
+    const uint8_t *reachable;
+
+    // cells^3 * REACHABILITY_MAP_ORIENTATIONS seeds, orientation changing fastest
+    const Seed *seeds;
+
+    // the map's storage, a file mapping for a loaded map and vectors for a generated one
+    std::vector<uint8_t> generated_reachable;
+    std::vector<Seed> generated_seeds;
+    void *mapping;
+    size_t mapping_length;
+
+    uint64_t fingerprint;
+
+    /**
+     * Sets up the grid for model, reaching as far as the end effector could
+     * */
+    void init(const ArmModel &model, size_t num_cells);
+
+    void unmap();
+
+    /**
+     * @return the index of the position cell, or -1 outside the grid
+     * */
+    long cell_index(const Vector3d &position) const;
+
+public:
+
+    ReachabilityMap();
+
+    ~ReachabilityMap();
+
+    ReachabilityMap(const ReachabilityMap &) = delete;
+    ReachabilityMap &operator=(const ReachabilityMap &) = delete;
+
+    /**
+     * @return which of the REACHABILITY_MAP_ORIENTATIONS an end effector rotated by rotation falls in
+     * */
+    static size_t orientation_index(const Matrix3d &rotation);
+
+    /**
+     * Fills in the map for model from num_samples Halton poses with no joint
+     * locked, keeping the safe ones
+     * */
+    void generate(const ArmModel &model, size_t num_samples = REACHABILITY_MAP_SAMPLES,
+                  size_t num_cells = REACHABILITY_MAP_CELLS);
+
+    /**
+     * Writes a generated map to filepath
+     * @return true if the file was written
+     * */
+    bool save(const std::string &filepath) const;
+
+    /**
+     * Memory-maps a map written by save() for model's geometry
+     * @return false if the file can't be read or is for a different geometry
+     * */
+    bool load(const std::string &filepath, const ArmModel &model);
+
+    bool empty() const;
+
+    /**
+     * @return false if no safe pose puts the end effector in or next to the cell of position
+     * */
+    bool is_reachable(const Vector3d &position) const;
+
+    /**
+     * @param target_point x, y, z and z-x-z euler angles of the end effector
+     * @param use_orientation false to take a seed with the end effector pointing any way
+     * @param seed set to the angles of the pose found closest to the center
+     * of target_point's cell, pointing the same way if one was found
+     * @return false if no pose was found in the cell
+     * */
+    bool find_seed(const Vector6d &target_point, bool use_orientation, Vector6d &seed) const;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "safety_cache.hpp"
+
+#include <cmath>
+
+size_t SafetyCache::KeyHash::operator()(const Key &key) const {
+    size_t hash = 0;
+    for (long value : key) {
+        hash = hash * 1000003 ^ std::hash<long>()(value);
+    }
+    return hash;
+}
+
+SafetyCache::SafetyCache() :
+    newest(-1), oldest(-1), num_lookups(0), num_hits(0) { }
+
+SafetyCache::SafetyCache(const SafetyCache &other) :
+    SafetyCache() { }
+
+SafetyCache &SafetyCache::operator=(const SafetyCache &other) {
+    if (this != &other) {
+        clear();
+    }
+    return *this;
+}
+
+SafetyCache::Key SafetyCache::make_key(const Vector6d &angles) const {
+    Key key;
+    for (size_t i = 0; i < 6; ++i) {
+        key[i] = std::lround(angles(i) / SAFETY_CACHE_RESOLUTION);
+    }
+    return key;
+}
+
+void SafetyCache::use_context(const ArmState &robot) {
+    if (model == robot.get_model_ptr() && collision_map == robot.get_collision_map() &&
+        environment == robot.get_environment()) {
+        return;
+    }
+
+    clear();
+    model = robot.get_model_ptr();
+    collision_map = robot.get_collision_map();
+    environment = robot.get_environment();
+}
+
+void SafetyCache::unlink(int entry) {
+    Entry &unlinked = entries[entry];
+    if (unlinked.newer == -1) {
+        newest = unlinked.older;
+    }
+    else {
+        entries[unlinked.newer].older = unlinked.older;
+    }
+
+    if (unlinked.older == -1) {
+        oldest = unlinked.newer;
+    }
+    else {
+        entries[unlinked.older].newer = unlinked.newer;
+    }
+}
+
+void SafetyCache::link_newest(int entry) {
+    entries[entry].newer = -1;
+    entries[entry].older = newest;
+    if (newest != -1) {
+        entries[newest].newer = entry;
+    }
+    newest = entry;
+    if (oldest == -1) {
+        oldest = entry;
+    }
+}
+
+bool SafetyCache::find(const ArmState &robot, const Vector6d &angles, bool &safe) {
+    use_context(robot);
+    ++num_lookups;
+
+    auto it = index.find(make_key(angles));
+    if (it == index.end()) {
+        return false;
+    }
+
+    ++num_hits;
+    if (it->second != newest) {
+        unlink(it->second);
+        link_newest(it->second);
+    }
+    safe = entries[it->second].safe;
+    return true;
+}
+
+void SafetyCache::store(const ArmState &robot, const Vector6d &angles, bool safe) {
+    use_context(robot);
+    Key key = make_key(angles);
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        entries[it->second].safe = safe;
+        return;
+    }
+
+    int entry;
+    if (entries.size() < SAFETY_CACHE_SIZE) {
+        if (entries.empty()) {
+            entries.reserve(SAFETY_CACHE_SIZE);
+            index.reserve(SAFETY_CACHE_SIZE);
+        }
+        entry = entries.size();
+        entries.emplace_back();
+    }
+    else {
+        // reuse the least recently used entry
+        entry = oldest;
+        unlink(entry);
+        index.erase(entries[entry].key);
+    }
+
+    entries[entry].key = key;
+    entries[entry].safe = safe;
+    link_newest(entry);
+    index.emplace(key, entry);
+}
+
+void SafetyCache::clear() {
+    entries.clear();
+    index.clear();
+    newest = -1;
+    oldest = -1;
+    model.reset();
+    collision_map.reset();
+    environment.reset();
+}
+
+size_t SafetyCache::lookups() const {
+    return num_lookups;
+}
+
+size_t SafetyCache::hits() const {
+    return num_hits;
+}
@@ -0,0 +1,103 @@
+#ifndef SAFETY_CACHE_H
+#define SAFETY_CACHE_H
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "arm_state.hpp"
+
+using namespace Eigen;
+
+// Joint angles in radians closer than this are treated as the same configuration,
+// well below the steps the planner and IK take
+static constexpr double SAFETY_CACHE_RESOLUTION = 0.0001;
+
+// Configurations kept, the least recently used is dropped to make room for a new one
+static constexpr size_t SAFETY_CACHE_SIZE = 4096;
+
+/**
+ * Remembers whether configurations were obstacle free, so KinematicsSolver
+ * doesn't redo FK and obstacle_free() for configurations the planner and IK
+ * check again and again, like the ends of RRT edges.
+ *
+ * Entries are looked up by the joint angles rounded to SAFETY_CACHE_RESOLUTION.
+ * They only hold for the geometry, collision map and environment they were
+ * found with, so the cache starts over when the arm it's used with has others.
+ *
+ * The entries are linked by index from the most to the least recently used,
+ * so they never move. Copies start empty, since each solver a copy is made
+ * for is used by another thread and copying the entries isn't worth it.
+ * */
+class SafetyCache {
+private:
+
+    typedef std::array<long, 6> Key;
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    struct Entry {
+        Key key;
+        bool safe;
+
+        // indices of the next more and less recently used entries, -1 at the ends
+        int newer;
+        int older;
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_map<Key, int, KeyHash> index;
+    int newest;
+    int oldest;
+
+    // what the entries were found with
+    std::shared_ptr<const ArmModel> model;
+    std::shared_ptr<const CollisionMap> collision_map;
+    std::shared_ptr<const EnvironmentMap> environment;
+
+    size_t num_lookups;
+    size_t num_hits;
+
+    Key make_key(const Vector6d &angles) const;
+
+    /**
+     * Starts over if robot has a different geometry, collision map or environment
+     * */
+    void use_context(const ArmState &robot);
+
+    void unlink(int entry);
+
+    void link_newest(int entry);
+
+public:
+
+    SafetyCache();
+
+    SafetyCache(const SafetyCache &other);
+
+    SafetyCache &operator=(const SafetyCache &other);
+
+    /**
+     * @param safe set to whether robot was obstacle free at angles
+     * @return true if angles were checked for robot's geometry, collision map and environment
+     * */
+    bool find(const ArmState &robot, const Vector6d &angles, bool &safe);
+
+    void store(const ArmState &robot, const Vector6d &angles, bool safe);
+
+    void clear();
+
+    /**
+     * @return how many times find() was called, and how many of those found an entry
+     * */
+    size_t lookups() const;
+
+    size_t hits() const;
+};
+
+#endif
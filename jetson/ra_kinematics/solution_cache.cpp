@@ -0,0 +1,92 @@
+#include "solution_cache.hpp"
+
+#include <cmath>
+
+namespace {
+
+    /**
+     * Sets entries[key] to value, dropping the oldest entry if the cache is full
+     * */
+    template <typename Value>
+    void store_entry(std::map<std::vector<long>, Value> &entries, std::deque<std::vector<long> > &order,
+                     const std::vector<long> &key, const Value &value) {
+        if (entries.find(key) == entries.end()) {
+            if (order.size() == SOLUTION_CACHE_SIZE) {
+                entries.erase(order.front());
+                order.pop_front();
+            }
+            order.push_back(key);
+        }
+        entries[key] = value;
+    }
+
+}
+
+SolutionCache::Key SolutionCache::start_key(const ArmState &robot) const {
+    Key key;
+    key.reserve(24);
+
+    Vector6d angles;
+    for (size_t i = 0; i < 6; ++i) {
+        angles(i) = robot.get_joint_angle(i);
+        key.push_back(robot.get_joint_locked(i) ? 1 : 0);
+    }
+    append(key, angles, CACHE_ANGLE_RESOLUTION);
+
+    return key;
+}
+
+void SolutionCache::append(Key &key, const Vector6d &values, double resolution) const {
+    for (size_t i = 0; i < 6; ++i) {
+        key.push_back(std::lround(values(i) / resolution));
+    }
+}
+
+bool SolutionCache::find_ik(const ArmState &robot, const Vector6d &target, bool use_orientation, Vector6d &solution) const {
+    Key key = start_key(robot);
+    key.push_back(use_orientation ? 1 : 0);
+    append(key, target, CACHE_TARGET_RESOLUTION);
+
+    auto it = ik_solutions.find(key);
+    if (it == ik_solutions.end()) {
+        return false;
+    }
+
+    solution = it->second;
+    return true;
+}
+
+void SolutionCache::store_ik(const ArmState &robot, const Vector6d &target, bool use_orientation, const Vector6d &solution) {
+    Key key = start_key(robot);
+    key.push_back(use_orientation ? 1 : 0);
+    append(key, target, CACHE_TARGET_RESOLUTION);
+
+    store_entry(ik_solutions, ik_order, key, solution);
+}
+
+bool SolutionCache::find_path(const ArmState &robot, const Vector6d &goal, std::vector<Vector6d> &path) const {
+    Key key = start_key(robot);
+    append(key, goal, CACHE_ANGLE_RESOLUTION);
+
+    auto it = paths.find(key);
+    if (it == paths.end()) {
+        return false;
+    }
+
+    path = it->second;
+    return true;
+}
+
+void SolutionCache::store_path(const ArmState &robot, const Vector6d &goal, const std::vector<Vector6d> &path) {
+    Key key = start_key(robot);
+    append(key, goal, CACHE_ANGLE_RESOLUTION);
+
+    store_entry(paths, path_order, key, path);
+}
+
+void SolutionCache::clear() {
+    ik_solutions.clear();
+    ik_order.clear();
+    paths.clear();
+    path_order.clear();
+}
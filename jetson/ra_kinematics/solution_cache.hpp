@@ -0,0 +1,74 @@
+#ifndef SOLUTION_CACHE_H
+#define SOLUTION_CACHE_H
+
+#include <vector>
+#include <map>
+#include <deque>
+
+#include <eigen3/Eigen/Dense>
+
+#include "arm_state.hpp"
+
+using namespace Eigen;
+
+// Joint angles in radians closer than this are treated as the same start or goal
+static constexpr double CACHE_ANGLE_RESOLUTION = 0.01;
+
+// IK targets closer than this, in meters and radians, are treated as the same target
+static constexpr double CACHE_TARGET_RESOLUTION = 0.001;
+
+// IK solutions and paths kept, the oldest is dropped to make room for a new one
+static constexpr size_t SOLUTION_CACHE_SIZE = 32;
+
+/**
+ * Remembers IK solutions and planned paths, so moving the arm between the
+ * same positions again, like to a preset and back, skips IK and planning.
+ *
+ * Entries are looked up by the arm's joint angles and locks, rounded to
+ * CACHE_ANGLE_RESOLUTION, along with the target. A found entry may still be
+ * unsafe or start slightly off from where the arm is, so the caller has to
+ * check it before using it.
+ * */
+class SolutionCache {
+private:
+
+    typedef std::vector<long> Key;
+
+    std::map<Key, Vector6d> ik_solutions;
+    std::deque<Key> ik_order;
+
+    std::map<Key, std::vector<Vector6d> > paths;
+    std::deque<Key> path_order;
+
+    /**
+     * @return a key for robot's joint angles and locks
+     * */
+    Key start_key(const ArmState &robot) const;
+
+    /**
+     * Appends values rounded to resolution to key
+     * */
+    void append(Key &key, const Vector6d &values, double resolution) const;
+
+public:
+
+    /**
+     * @param solution set to the joint angles IK found for target from robot's position
+     * @return true if there is a solution
+     * */
+    bool find_ik(const ArmState &robot, const Vector6d &target, bool use_orientation, Vector6d &solution) const;
+
+    void store_ik(const ArmState &robot, const Vector6d &target, bool use_orientation, const Vector6d &solution);
+
+    /**
+     * @param path set to the waypoints of a path planned from robot's position to goal
+     * @return true if there is a path
+     * */
+    bool find_path(const ArmState &robot, const Vector6d &goal, std::vector<Vector6d> &path) const;
+
+    void store_path(const ArmState &robot, const Vector6d &goal, const std::vector<Vector6d> &path);
+
+    void clear();
+};
+
+#endif
@@ -1,9 +1,19 @@
 #include "unit_test_framework.h"
 #include "nlohmann/json.hpp"
 #include "../arm_state.hpp"
+#include "../arm_model.hpp"
+#include "../collision.hpp"
+#include "../collision_map.hpp"
+#include "../environment_map.hpp"
 #include "../utils.hpp"
+#include "../kinematics.hpp"
+#include "../joint_estimator.hpp"
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
+#include <limits>
+#include <random>
 
 using namespace nlohmann;
 
@@ -76,5 +86,326 @@ TEST(json_read_test) {
     ArmState arm = ArmState(geom);
 }
 
+TEST(arm_model_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+
+    // Joints come out in order
+    ASSERT_EQUAL(model.joint_names[0], "joint_a");
+    ASSERT_EQUAL(model.joint_names[5], "joint_f");
+    ASSERT_EQUAL(-3.01, model.joints[2].limits[0]);
+    ASSERT_TRUE(model.joints[0].continuous_range);
+    ASSERT_FALSE(model.joints[1].continuous_range);
+
+    // Avoidance links are sorted by link_num
+    ASSERT_EQUAL(19, model.avoidance_links.size());
+    for (size_t i = 0; i < model.avoidance_links.size(); ++i) {
+        ASSERT_EQUAL((int) i, model.avoidance_links[i].link_num);
+        ASSERT_TRUE(model.avoidance_links[i].type == ShapeType::CAPSULE);
+    }
+
+    // Copies of an arm share the model but not their angles
+    ArmState arm = ArmState(model);
+    ArmState copy = arm;
+    copy.set_joint_angle(0, 1.5);
+    ASSERT_EQUAL(0, arm.get_joint_angle(0));
+    ASSERT_EQUAL(1.0, arm.get_joint_angle(1));
+}
+
+// A geometry without 6 joints is rejected
+TEST(arm_model_joint_count_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    geom["joints"].erase("joint_f");
+
+    bool thrown = false;
+    try {
+        read_arm_model(geom);
+    }
+    catch (std::invalid_argument &e) {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown);
+}
+
+// Test that batched segment distances match closest_dist_bet_lines
+TEST(segment_pairs_test) {
+    std::default_random_engine eng(7);
+    std::uniform_real_distribution<double> coord(-1, 1);
+
+    SegmentPairs pairs;
+    pairs.reserve(200);
+
+    std::vector<double> expected;
+    for (int i = 0; i < 200; ++i) {
+        Vector3d a0(coord(eng), coord(eng), coord(eng));
+        Vector3d a1(coord(eng), coord(eng), coord(eng));
+        Vector3d b0(coord(eng), coord(eng), coord(eng));
+        Vector3d b1(coord(eng), coord(eng), coord(eng));
+
+        // Some parallel segments and points too
+        if (i % 10 == 1) {
+            b1 = b0 + (a1 - a0);
+        }
+        if (i % 10 == 2) {
+            b1 = b0;
+        }
+        if (i % 10 == 3) {
+            a1 = a0;
+        }
+
+        pairs.add(a0, a1, b0, b1, 0);
+        if (i % 10 == 2) {
+            // closest_dist_bet_lines doesn't handle b being a point, so
+            // project b0 onto a instead
+            double s = (b0 - a0).dot(a1 - a0) / (a1 - a0).squaredNorm();
+            s = std::max(0.0, std::min(1.0, s));
+            expected.push_back((a0 + s * (a1 - a0) - b0).norm());
+        }
+        else {
+            expected.push_back(closest_dist_bet_lines(a0, a1, b0, b1));
+        }
+    }
+
+    ASSERT_FALSE(pairs.any_within());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_ALMOST_EQUAL(expected[i], std::sqrt(pairs.get_dists_squared()(i)), 0.0001);
+    }
+}
+
+// Test that obstacle_free agrees with checking each pair with link_link_check
+TEST(obstacle_free_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+    ArmState arm = ArmState(model);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::default_random_engine eng(11);
+    std::uniform_real_distribution<double> angle(-3, 3);
+
+    int num_free = 0;
+    for (int i = 0; i < 500; ++i) {
+        arm.set_joint_angles({angle(eng), angle(eng), angle(eng), angle(eng), angle(eng), angle(eng)});
+        solver.FK(arm);
+
+        bool free = arm.obstacle_free();
+
+        bool expected_free = true;
+        for (const std::array<size_t, 2> &pair : model.collision_pairs) {
+            if (arm.link_link_check(pair[0], pair[1])) {
+                expected_free = false;
+            }
+        }
+
+        ASSERT_EQUAL(expected_free, free);
+        num_free += free;
+    }
+
+    // Random angles should give both outcomes
+    ASSERT_TRUE(num_free > 0 && num_free < 500);
+}
+
+// Test that obstacle_free gives the same answers with a collision map, and
+// that a saved map only loads for the geometry it was generated for
+TEST(collision_map_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+    ArmState arm = ArmState(model);
+    ArmState mapped_arm = ArmState(model);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::shared_ptr<CollisionMap> map = std::make_shared<CollisionMap>();
+    map->generate(mapped_arm, 32);
+    mapped_arm.set_collision_map(map);
+
+    std::default_random_engine eng(12);
+    int num_free = 0;
+    for (int i = 0; i < 2000; ++i) {
+        std::vector<double> angles(6);
+        for (size_t j = 0; j < 6; ++j) {
+            const std::array<double, 2> &limits = arm.get_joint_limits(j);
+            angles[j] = std::uniform_real_distribution<double>(limits[0], limits[1])(eng);
+        }
+
+        arm.set_joint_angles(angles);
+        mapped_arm.set_joint_angles(angles);
+        solver.FK(arm);
+        solver.FK(mapped_arm);
+
+        bool free = arm.obstacle_free();
+        ASSERT_EQUAL(free, mapped_arm.obstacle_free());
+        num_free += free;
+    }
+    ASSERT_TRUE(num_free > 0 && num_free < 2000);
+
+    std::string filename = "collision_map_test.bin";
+    ASSERT_TRUE(map->save(filename));
+
+    CollisionMap loaded;
+    ASSERT_TRUE(loaded.load(filename, model));
+
+    std::array<double, NUM_JOINTS> angles = {{ 0, 0.5, 1.0, -2.0, 0, 0 }};
+    ASSERT_EQUAL(map->lookup(angles), loaded.lookup(angles));
+
+    // a map for a different arm must not be used
+    model.avoidance_links[4].radius += 0.01;
+    CollisionMap stale;
+    ASSERT_FALSE(stale.load(filename, model));
+    ASSERT_TRUE(stale.empty());
+
+    std::remove(filename.c_str());
+}
+
+// Test that capsule gaps to the environment match checking every point, and
+// that the arm is only safe where it stays clear of the environment
+TEST(environment_map_test) {
+    std::default_random_engine eng(7);
+    std::uniform_real_distribution<double> unit(-1, 1);
+
+    std::vector<Vector3d> points;
+    for (int i = 0; i < 3000; ++i) {
+        points.push_back(Vector3d(unit(eng), unit(eng), 0.2 * unit(eng) - 0.5));
+    }
+    EnvironmentMap environment(points);
+    ASSERT_EQUAL(points.size(), environment.size());
+
+    for (int i = 0; i < 500; ++i) {
+        Vector3d a(unit(eng), unit(eng), unit(eng));
+        Vector3d b = a + 0.3 * Vector3d(unit(eng), unit(eng), unit(eng));
+        double radius = 0.05;
+
+        double exact = std::numeric_limits<double>::infinity();
+        for (const Vector3d &point : points) {
+            Vector3d ab = b - a;
+            double t = std::min(std::max((point - a).dot(ab) / ab.squaredNorm(), 0.0), 1.0);
+            exact = std::min(exact, (a + t * ab - point).norm() - radius);
+        }
+
+        // exact below min_gap, and otherwise never more than the real gap
+        double min_gap = 0.1;
+        double gap = environment.capsule_gap(a, b, radius, min_gap);
+        if (exact < min_gap) {
+            ASSERT_ALMOST_EQUAL(exact, gap, 0.0000001);
+        }
+        else {
+            ASSERT_TRUE(gap >= min_gap && gap <= exact + 0.0000001);
+        }
+    }
+
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver;
+
+    Vector6d start = vecTo6d({0, 1, -1, 0, 0, 0});
+    Vector6d end = vecTo6d({0.4, 0.7, -1.3, 0.3, -0.4, 0.2});
+    ASSERT_TRUE(solver.is_safe_motion(arm, start, end));
+
+    // a point on the end effector's path blocks the motion, but not its start
+    arm.set_joint_angles_6d(start + 0.5 * (end - start));
+    solver.FK(arm);
+    std::vector<Vector3d> blocking = { arm.get_ef_pos_world() };
+    arm.set_environment(std::make_shared<EnvironmentMap>(blocking));
+
+    arm.set_joint_angles_6d(start);
+    solver.FK(arm);
+    arm.transform_avoidance_links();
+    ASSERT_TRUE(arm.get_point_gap(blocking[0]) > 0);
+    ASSERT_TRUE(solver.is_safe(arm));
+    ASSERT_FALSE(solver.is_safe_motion(arm, start, end));
+
+    // and nothing is blocked without it
+    arm.set_environment(nullptr);
+    ASSERT_TRUE(solver.is_safe_motion(arm, start, end));
+}
+
+TEST(gravity_torque_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver;
+
+    // the torque holding a joint still is how fast the potential energy of the
+    // arm rises as the joint turns
+    auto potential_energy = [](const ArmState &state) {
+        double energy = 0.0;
+        for (size_t i = 0; i < 6; ++i) {
+            energy += state.get_joint_mass(i) * GRAVITY * state.get_joint_com(i)(2);
+        }
+        return energy;
+    };
+
+    // the links' masses are added to the joints they move with
+    ASSERT_TRUE(arm.get_joint_mass(1) > geom["joints"]["joint_b"]["mass_data"]["mass"].get<double>());
+
+    std::default_random_engine eng(7);
+    const double step = 1e-6;
+    for (int trial = 0; trial < 20; ++trial) {
+        std::vector<double> angles(6);
+        for (size_t j = 0; j < 6; ++j) {
+            const std::array<double, 2> &limits = arm.get_joint_limits(j);
+            angles[j] = std::uniform_real_distribution<double>(limits[0], limits[1])(eng);
+        }
+
+        arm.set_joint_angles(angles);
+        solver.FK(arm);
+        Vector6d torques = arm.update_gravity_torques();
+
+        for (size_t i = 0; i < 6; ++i) {
+            ArmState moved = arm;
+            moved.set_joint_angle(i, angles[i] + step);
+            solver.FK(moved);
+            double energy_high = potential_energy(moved);
+
+            moved.set_joint_angle(i, angles[i] - step);
+            solver.FK(moved);
+            double energy_low = potential_energy(moved);
+
+            ASSERT_ALMOST_EQUAL(torques(i), (energy_high - energy_low) / (2 * step), 1e-5);
+            ASSERT_ALMOST_EQUAL(arm.get_joint_torque(i).dot(arm.get_joint_axis_world(i)), torques(i), 1e-9);
+        }
+    }
+}
+
+TEST(joint_estimator_test) {
+    JointEstimator estimator;
+    ASSERT_FALSE(estimator.is_fresh(0));
+
+    // readings of a joint turning steadily, a little noisy
+    std::default_random_engine eng(3);
+    std::uniform_real_distribution<double> noise(-0.002, 0.002);
+    const double velocity = 0.4;
+    const double dt = 0.02;
+    double time = 0;
+    for (int i = 0; i < 200; ++i) {
+        time = i * dt;
+        estimator.update(time, 1 + velocity * time + noise(eng));
+    }
+    ASSERT_TRUE(estimator.is_fresh(time));
+    ASSERT_ALMOST_EQUAL(estimator.get_velocity(), velocity, 0.05);
+    ASSERT_ALMOST_EQUAL(estimator.get_position(time), 1 + velocity * time, 0.01);
+    ASSERT_ALMOST_EQUAL(estimator.get_position(time + 0.1), 1 + velocity * (time + 0.1), 0.01);
+
+    // the history holds the newest readings, first to last
+    ASSERT_EQUAL(estimator.size(), JOINT_ESTIMATOR_HISTORY);
+    estimator.update(time + dt, 5, false);
+    ASSERT_EQUAL(estimator.get_reading(0), 5);
+    ASSERT_ALMOST_EQUAL(estimator.get_reading(1), 1 + velocity * time, 0.01);
+
+    // an untrusted reading doesn't move the estimate
+    ASSERT_ALMOST_EQUAL(estimator.get_velocity(), velocity, 0.05);
+
+    // the joint stopping shows in the velocity within a few readings
+    double stopped = 1 + velocity * time;
+    for (int i = 1; i <= 15; ++i) {
+        estimator.update(time + i * dt, stopped);
+    }
+    ASSERT_TRUE(std::abs(estimator.get_velocity()) < 0.05);
+    ASSERT_ALMOST_EQUAL(estimator.get_position(time + 15 * dt), stopped, 0.01);
+
+    // and readings after a long gap start over
+    time += 15 * dt + 2 * JOINT_ESTIMATOR_MAX_GAP;
+    ASSERT_FALSE(estimator.is_fresh(time));
+    estimator.update(time, -1);
+    ASSERT_EQUAL(estimator.get_position(time), -1);
+    ASSERT_EQUAL(estimator.get_velocity(), 0);
+}
 
 TEST_MAIN()
@@ -0,0 +1,74 @@
+#include "nlohmann/json.hpp"
+#include "../arm_state.hpp"
+#include "../collision_map.hpp"
+#include "../utils.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/**
+ * Generates the collision map for mrover_arm_geom.json and writes it next to
+ * the geometry, or to the file given as the first argument. Run again after
+ * changing the geometry, ra_kinematics ignores a map made for other geometry.
+ * */
+
+int main(int argc, char **argv) {
+    std::string output_file = argc > 1 ? argv[1] : get_mrover_arm_collision_map();
+
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+
+    auto start = std::chrono::steady_clock::now();
+
+    CollisionMap map;
+    map.generate(arm);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // count the cells the map settles, and the pairs left to check in the rest
+    size_t num_free = 0;
+    size_t num_colliding = 0;
+    size_t num_marked = 0;
+    const ArmModel &model = arm.get_model();
+    std::array<double, NUM_JOINTS> angles;
+    angles.fill(0);
+
+    for (size_t b = 0; b < COLLISION_MAP_CELLS; ++b) {
+        for (size_t c = 0; c < COLLISION_MAP_CELLS; ++c) {
+            for (size_t d = 0; d < COLLISION_MAP_CELLS; ++d) {
+                size_t cell_index[3] = { b, c, d };
+                for (size_t i = 0; i < COLLISION_MAP_DIMS; ++i) {
+                    const std::array<double, 2> &limits = model.joints[COLLISION_MAP_FIRST_JOINT + i].limits;
+                    angles[COLLISION_MAP_FIRST_JOINT + i] = limits[0] + (cell_index[i] + 0.5) * (limits[1] - limits[0]) / COLLISION_MAP_CELLS;
+                }
+
+                uint32_t cell = map.lookup(angles);
+                if (cell & COLLISION_MAP_COLLIDING) {
+                    ++num_colliding;
+                    continue;
+                }
+                if (cell == 0) {
+                    ++num_free;
+                }
+                for (size_t i = 0; i < map.get_mapped_pairs().size(); ++i) {
+                    num_marked += (cell >> i) & 1;
+                }
+            }
+        }
+    }
+
+    size_t num_cells = COLLISION_MAP_CELLS * COLLISION_MAP_CELLS * COLLISION_MAP_CELLS;
+    std::cout << "Generated " << COLLISION_MAP_CELLS << "^3 cells in " << seconds << " s, covering "
+              << map.get_mapped_pairs().size() << " of " << model.collision_pairs.size() << " collision pairs\n";
+    std::cout << "colliding cells: " << num_colliding << ", cells with no pair to check: " << num_free
+              << ", mean mapped pairs left to check: "
+              << static_cast<double>(num_marked) / (num_cells - num_colliding) << "\n";
+
+    if (!map.save(output_file)) {
+        return 1;
+    }
+
+    std::cout << "Wrote " << output_file << "\n";
+    return 0;
+}
@@ -0,0 +1,290 @@
+#include "nlohmann/json.hpp"
+#include "../arm_state.hpp"
+#include "../kinematics.hpp"
+#include "../motion_planner.hpp"
+#include "../kd_tree.hpp"
+#include "../collision_map.hpp"
+#include "../utils.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Times the kinematics and planning code over a fixed corpus of random safe
+ * configurations of the arm in mrover_arm_geom.json. Everything random is
+ * seeded, so two runs on the same code measure the same work and results
+ * can be compared between changes.
+ *
+ * Writes the results as JSON to the file given as the first argument, or
+ * kinematics_benchmark.json, and prints them when done.
+ * */
+
+using nlohmann::json;
+
+// seed of the corpus and of the kd-tree queries
+static constexpr unsigned BENCHMARK_SEED = 280;
+
+// safe configurations in the corpus, also the targets of IK
+static constexpr size_t NUM_CONFIGS = 200;
+
+// times each microbenchmark goes over the corpus
+static constexpr int NUM_REPEATS = 20;
+
+// paths planned between consecutive configurations of the corpus
+static constexpr size_t NUM_PLANS = 20;
+
+// points in the kd-tree, and positions looked up in it
+static constexpr size_t NUM_TREE_POINTS = 1000;
+static constexpr size_t NUM_TREE_QUERIES = 10000;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Draws random angles within the joint limits until num_configs of them are safe
+ * */
+static std::vector< std::vector<double> > make_corpus(ArmState &arm, KinematicsSolver &solver,
+                                                      std::default_random_engine &eng, size_t num_configs) {
+    std::vector< std::vector<double> > corpus;
+    std::vector<double> angles(6);
+
+    while (corpus.size() < num_configs) {
+        for (size_t j = 0; j < 6; ++j) {
+            const std::array<double, 2> &limits = arm.get_joint_limits(j);
+            angles[j] = std::uniform_real_distribution<double>(limits[0], limits[1])(eng);
+        }
+
+        if (solver.is_safe(arm, angles)) {
+            corpus.push_back(angles);
+        }
+    }
+
+    return corpus;
+}
+
+static json bench_fk(ArmState &arm, KinematicsSolver &solver, const std::vector< std::vector<double> > &corpus) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < NUM_REPEATS; ++r) {
+        for (const std::vector<double> &angles : corpus) {
+            arm.set_joint_angles(angles);
+            solver.FK(arm);
+        }
+    }
+
+    return { { "calls", NUM_REPEATS * corpus.size() }, { "ns_per_call", elapsed_ns(start) / (NUM_REPEATS * corpus.size()) } };
+}
+
+static json bench_fk_batch(const ArmState &arm, const KinematicsSolver &solver,
+                          const std::vector< std::vector<double> > &corpus) {
+    std::vector<Vector6d> configs;
+    for (const std::vector<double> &angles : corpus) {
+        configs.push_back(vecTo6d(angles));
+    }
+
+    FKBatch batch;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < NUM_REPEATS; ++r) {
+        solver.FK_batch(arm, configs, batch);
+    }
+
+    return { { "configs", NUM_REPEATS * corpus.size() }, { "ns_per_config", elapsed_ns(start) / (NUM_REPEATS * corpus.size()) } };
+}
+
+static json bench_obstacle_free(ArmState &arm, KinematicsSolver &solver, const std::vector< std::vector<double> > &corpus) {
+    double total_ns = 0;
+
+    // only the collision check is timed, not the FK it needs first
+    for (const std::vector<double> &angles : corpus) {
+        arm.set_joint_angles(angles);
+        solver.FK(arm);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < NUM_REPEATS; ++r) {
+            arm.obstacle_free();
+        }
+        total_ns += elapsed_ns(start);
+    }
+
+    return { { "calls", NUM_REPEATS * corpus.size() }, { "ns_per_call", total_ns / (NUM_REPEATS * corpus.size()) } };
+}
+
+/**
+ * Solves for the end effector pose of each configuration in the corpus, starting
+ * from the configuration before it
+ * */
+static json bench_ik(ArmState &arm, KinematicsSolver &solver, const std::vector< std::vector<double> > &corpus,
+                     IKMode mode) {
+    std::vector<Vector6d> targets;
+    for (const std::vector<double> &angles : corpus) {
+        arm.set_joint_angles(angles);
+        solver.FK(arm);
+
+        Vector6d target;
+        target.head(3) = arm.get_ef_pos_world();
+        target.tail(3) = arm.get_ef_ang_world();
+        targets.push_back(target);
+    }
+
+    solver.set_IK_mode(mode);
+
+    size_t successes = 0;
+    long total_iterations = 0;
+    double total_ns = 0;
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        arm.set_joint_angles(corpus[(i + corpus.size() - 1) % corpus.size()]);
+        solver.FK(arm);
+
+        auto start = std::chrono::steady_clock::now();
+        std::pair<Vector6d, bool> solution = solver.IK(arm, targets[i], false, false);
+        total_ns += elapsed_ns(start);
+
+        total_iterations += solver.get_num_iterations();
+        if (solution.second) {
+            ++successes;
+        }
+    }
+
+    return { { "solves", targets.size() },
+             { "success_rate", static_cast<double>(successes) / targets.size() },
+             { "mean_iterations", static_cast<double>(total_iterations) / targets.size() },
+             { "us_per_solve", total_ns / targets.size() / 1000 } };
+}
+
+static json bench_nearest(const ArmState &arm, std::default_random_engine &eng) {
+    std::vector< std::uniform_real_distribution<double> > joint_dists;
+    for (size_t j = 0; j < 6; ++j) {
+        const std::array<double, 2> &limits = arm.get_joint_limits(j);
+        joint_dists.emplace_back(limits[0], limits[1]);
+    }
+
+    auto random_point = [&]() {
+        Vector6d point;
+        for (size_t j = 0; j < 6; ++j) {
+            point(j) = joint_dists[j](eng);
+        }
+        return point;
+    };
+
+    KDTree tree;
+    for (size_t i = 0; i < NUM_TREE_POINTS; ++i) {
+        tree.insert(random_point(), i);
+    }
+
+    std::vector<Vector6d> queries;
+    for (size_t i = 0; i < NUM_TREE_QUERIES; ++i) {
+        queries.push_back(random_point());
+    }
+
+    // sum the ids so the lookups can't be optimized away
+    size_t id_sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Vector6d &query : queries) {
+        id_sum += tree.nearest(query);
+    }
+    double total_ns = elapsed_ns(start);
+
+    return { { "tree_size", NUM_TREE_POINTS }, { "queries", NUM_TREE_QUERIES },
+             { "ns_per_query", total_ns / NUM_TREE_QUERIES }, { "id_sum", id_sum } };
+}
+
+/**
+ * Plans between consecutive configurations of the corpus, sampling with mode,
+ * then times spline evaluation along the last path found
+ * */
+static json bench_planning(ArmState &arm, KinematicsSolver &solver, const std::vector< std::vector<double> > &corpus,
+                           SamplingMode mode, json &spline_results) {
+    MotionPlanner planner(arm, solver);
+    planner.set_sampling_mode(mode);
+
+    size_t successes = 0;
+    double total_ns = 0;
+    double total_length = 0;
+
+    for (size_t i = 0; i < NUM_PLANS; ++i) {
+        arm.set_joint_angles(corpus[i]);
+
+        auto start = std::chrono::steady_clock::now();
+        bool found = planner.rrt_connect(arm, vecTo6d(corpus[i + 1]));
+        total_ns += elapsed_ns(start);
+
+        if (found) {
+            ++successes;
+            const std::vector<Vector6d> &path = planner.get_spline_path();
+            for (size_t j = 0; j + 1 < path.size(); ++j) {
+                total_length += (path[j + 1] - path[j]).norm();
+            }
+        }
+    }
+
+    if (successes > 0) {
+        const int num_points = 100000;
+        Vector6d angles;
+        double angle_sum = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < num_points; ++k) {
+            planner.get_spline_pos(static_cast<double>(k) / num_points, angles);
+            angle_sum += angles(0);
+        }
+        double eval_ns = elapsed_ns(start);
+
+        spline_results = { { "calls", num_points }, { "ns_per_call", eval_ns / num_points },
+                           { "angle_sum", angle_sum } };
+    }
+
+    return { { "plans", NUM_PLANS },
+             { "success_rate", static_cast<double>(successes) / NUM_PLANS },
+             { "ms_per_plan", total_ns / NUM_PLANS / 1e6 },
+             { "mean_path_length", successes > 0 ? total_length / successes : 0.0 } };
+}
+
+int main(int argc, char **argv) {
+    std::string output_file = argc > 1 ? argv[1] : "kinematics_benchmark.json";
+
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::default_random_engine eng(BENCHMARK_SEED);
+    std::vector< std::vector<double> > corpus = make_corpus(arm, solver, eng, NUM_CONFIGS);
+
+    json results;
+    results["seed"] = BENCHMARK_SEED;
+    results["configs"] = NUM_CONFIGS;
+
+    results["fk"] = bench_fk(arm, solver, corpus);
+    results["fk_batch"] = bench_fk_batch(arm, solver, corpus);
+    results["obstacle_free"] = bench_obstacle_free(arm, solver, corpus);
+
+    // the same checks with a collision map, on a copy so the rest runs without one
+    ArmState mapped_arm = arm;
+    std::shared_ptr<CollisionMap> collision_map = std::make_shared<CollisionMap>();
+    collision_map->generate(mapped_arm);
+    mapped_arm.set_collision_map(collision_map);
+    results["obstacle_free_mapped"] = bench_obstacle_free(mapped_arm, solver, corpus);
+    results["ik_fixed_step"] = bench_ik(arm, solver, corpus, IKMode::FIXED_STEP);
+    results["ik_damped_least_squares"] = bench_ik(arm, solver, corpus, IKMode::DAMPED_LEAST_SQUARES);
+    results["nearest"] = bench_nearest(arm, eng);
+
+    json spline_results;
+    results["rrt_connect"] = bench_planning(arm, solver, corpus, SamplingMode::UNIFORM, spline_results);
+    results["spline_eval"] = spline_results;
+
+    json halton_spline_results;
+    results["rrt_connect_halton"] = bench_planning(arm, solver, corpus, SamplingMode::HALTON, halton_spline_results);
+
+    std::ofstream file(output_file);
+    file << results.dump(4) << "\n";
+
+    std::cout << results.dump(4) << "\n";
+    std::cout << "Wrote " << output_file << "\n";
+
+    return 0;
+}
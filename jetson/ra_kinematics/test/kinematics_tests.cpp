@@ -3,11 +3,13 @@
 #include "../arm_state.hpp"
 #include "../utils.hpp"
 #include "../kinematics.hpp"
+#include "../reachability_map.hpp"
 
 #include <iostream>
 #include <string>
 #include <iomanip>
 #include <chrono>
+#include <random>
 
 using namespace nlohmann;
 
@@ -362,4 +364,531 @@ TEST(ik_test_orientation_experiment) {
     ASSERT_TRUE(result.second);
 }
 
+// Test that the analytic jacobian matches moving each joint a small amount
+TEST(jacobian_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::vector<double> angles = {0.3, 0.8, -1.2, 0.4, -0.5, 0.2};
+    arm.set_joint_angles(angles);
+    solver.FK(arm);
+
+    Matrix<double, 6, 6> jacobian = solver.get_jacobian(arm);
+    Vector3d ef_pos = arm.get_ef_pos_world();
+    Matrix3d ef_rot = arm.get_ef_transform().block(0, 0, 3, 3);
+
+    for (size_t i = 0; i < 6; ++i) {
+        arm.set_joint_angle(i, angles[i] + DELTA_THETA);
+        solver.FK(arm);
+
+        Vector3d linear = (arm.get_ef_pos_world() - ef_pos) / DELTA_THETA;
+
+        Matrix3d new_rot = arm.get_ef_transform().block(0, 0, 3, 3);
+        AngleAxisd rotation(new_rot * ef_rot.transpose());
+        Vector3d angular = rotation.angle() * rotation.axis() / DELTA_THETA;
+
+        ASSERT_TRUE(vec3dAlmostEqual(jacobian.block(0, i, 3, 1), linear, 0.001));
+        ASSERT_TRUE(vec3dAlmostEqual(jacobian.block(3, i, 3, 1), angular, 0.001));
+
+        arm.set_joint_angle(i, angles[i]);
+    }
+}
+
+// Test that batch FK gives the same transforms as FK of each configuration
+TEST(fk_batch_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::default_random_engine eng(280);
+    std::vector<Vector6d> configs;
+    for (size_t k = 0; k < 50; ++k) {
+        Vector6d angles;
+        for (size_t i = 0; i < 6; ++i) {
+            const std::array<double, 2> &limits = arm.get_joint_limits(i);
+            angles(i) = std::uniform_real_distribution<double>(limits[0], limits[1])(eng);
+        }
+        configs.push_back(angles);
+    }
+
+    std::vector<double> start_angles = arm.get_joint_angles();
+    FKBatch batch;
+    solver.FK_batch(arm, configs, batch);
+
+    // the state given for its geometry is left alone
+    ASSERT_TRUE(arm.get_joint_angles() == start_angles);
+    ASSERT_EQUAL(batch.size, configs.size());
+
+    for (size_t k = 0; k < configs.size(); ++k) {
+        for (size_t i = 0; i < 6; ++i) {
+            arm.set_joint_angle(i, configs[k](i));
+        }
+        solver.FK(arm);
+
+        for (size_t i = 0; i < 6; ++i) {
+            ASSERT_TRUE(batch.get_joint_transform(k, i).isApprox(arm.get_joint_transform(i), 1e-12));
+        }
+        ASSERT_TRUE(batch.get_ef_transform(k).isApprox(arm.get_ef_transform(), 1e-12));
+    }
+
+    // an empty batch is fine too
+    solver.FK_batch(arm, std::vector<Vector6d>(), batch);
+    ASSERT_EQUAL(batch.size, 0u);
+}
+
+// Test that compute_rotation_matrix undoes compute_euler_angles
+TEST(euler_angles_round_trip) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+
+    arm.set_joint_angles({0.3, 0.8, -1.2, 0.4, -0.5, 0.2});
+    solver.FK(arm);
+
+    Matrix3d ef_rot = arm.get_ef_transform().block(0, 0, 3, 3);
+    Matrix3d rebuilt = compute_rotation_matrix(arm.get_ef_ang_world());
+
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(vec3dAlmostEqual(ef_rot.col(i), rebuilt.col(i), 0.000001));
+    }
+}
+
+// Test that damped least squares reaches a position and orientation in few iterations
+TEST(ik_test_damped) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    // Starting angles.
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+
+    // Angles to find a target position.
+    std::vector<double> target = {0.4, 0.7, -1.3, 0.3, -0.4, 0.2};
+
+    ASSERT_TRUE(solver.is_safe(arm, start));
+    ASSERT_TRUE(solver.is_safe(arm, target));
+
+    // Generate the target position.
+    arm.set_joint_angles(target);
+    solver.FK(arm);
+
+    Vector6d target_pos;
+    target_pos.head(3) = arm.get_ef_pos_world();
+    target_pos.tail(3) = arm.get_ef_ang_world();
+
+    // Reset arm to starting position.
+    arm.set_joint_angles(start);
+    solver.FK(arm);
+
+    // Run IK with and without orientation
+    ASSERT_TRUE(solver.IK(arm, target_pos, false, false).second);
+    std::cout << "position only: " << solver.get_num_iterations() << " iterations\n";
+    ASSERT_TRUE(solver.get_num_iterations() <= 10);
+
+    // The start is a wrist singularity (joints d and f line up), which
+    // takes a few more damped steps to leave
+    ASSERT_TRUE(solver.IK(arm, target_pos, false, true).second);
+    std::cout << "with orientation: " << solver.get_num_iterations() << " iterations\n";
+    ASSERT_TRUE(solver.get_num_iterations() <= 15);
+
+    // IK leaves the arm where it started
+    ASSERT_ALMOST_EQUAL(start[1], arm.get_joint_angle(1), 0.0000001);
+}
+
+// Test that damped least squares respects the locking of joints
+TEST(ik_test_damped_lock) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {0.1, 0.9, -1.1, 0.1, -0.1, 0};
+
+    arm.set_joint_angles(target);
+    solver.FK(arm);
+
+    Vector6d target_pos;
+    target_pos.head(3) = arm.get_ef_pos_world();
+    target_pos.tail(3) = arm.get_ef_ang_world();
+
+    // Lock joint c
+    arm.set_joint_locked(2, true);
+
+    arm.set_joint_angles(start);
+    solver.FK(arm);
+
+    std::pair<Vector6d, bool> result = solver.IK(arm, target_pos, false, false);
+
+    // Check that joint c did not move from the start position.
+    ASSERT_ALMOST_EQUAL(-1, result.first[2], 0.0000001);
+    ASSERT_TRUE(result.second);
+}
+
+// Test that IK solves with only the unlocked joints, when the target can be
+// reached by moving only them, and that servoing moves nothing locked
+TEST(ik_test_reduced_lock) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {0, 0.9, -0.9, 0, -0.2, 0};
+    ASSERT_TRUE(solver.is_safe(arm, target));
+
+    arm.set_joint_angles(target);
+    solver.FK(arm);
+
+    Vector6d target_pos;
+    target_pos.head(3) = arm.get_ef_pos_world();
+    target_pos.tail(3) = arm.get_ef_ang_world();
+
+    // Lock joints a, d and f
+    arm.set_joint_locked(0, true);
+    arm.set_joint_locked(3, true);
+    arm.set_joint_locked(5, true);
+
+    arm.set_joint_angles(start);
+    solver.FK(arm);
+
+    std::pair<Vector6d, bool> result = solver.IK(arm, target_pos, false, false);
+    ASSERT_TRUE(result.second);
+    ASSERT_ALMOST_EQUAL(0, result.first[0], 0.0000001);
+    ASSERT_ALMOST_EQUAL(0, result.first[3], 0.0000001);
+    ASSERT_ALMOST_EQUAL(0, result.first[5], 0.0000001);
+
+    Vector6d ef_velocity;
+    ef_velocity << 0.01, 0.02, -0.01, 0.1, 0, 0.1;
+    Vector6d velocities = solver.get_joint_velocities(arm, ef_velocity, true);
+    ASSERT_EQUAL(velocities(0), 0);
+    ASSERT_EQUAL(velocities(3), 0);
+    ASSERT_EQUAL(velocities(5), 0);
+    ASSERT_TRUE(velocities.norm() > 0);
+
+    // nothing moves with every joint locked
+    for (size_t i = 0; i < 6; ++i) {
+        arm.set_joint_locked(i, true);
+    }
+    ASSERT_TRUE(solver.get_joint_velocities(arm, ef_velocity, true).isZero());
+    ASSERT_FALSE(solver.IK(arm, target_pos, false, false).second);
+}
+
+// Test that multi-start IK finds the target from a start IK can't solve from directly
+TEST(ik_test_multi_start) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {2.5, 0.6, 1.2, -1, 0.8, 0.5};
+
+    ASSERT_TRUE(solver.is_safe(arm, start));
+    ASSERT_TRUE(solver.is_safe(arm, target));
+
+    arm.set_joint_angles(target);
+    solver.FK(arm);
+
+    Vector6d target_pos;
+    target_pos.head(3) = arm.get_ef_pos_world();
+    target_pos.tail(3) = arm.get_ef_ang_world();
+
+    arm.set_joint_angles(start);
+    solver.FK(arm);
+
+    std::pair<Vector6d, bool> first = solver.IK_multi_start(arm, target_pos, true, 32, false);
+    ASSERT_TRUE(first.second);
+
+    std::pair<Vector6d, bool> closest = solver.IK_multi_start(arm, target_pos, true, 32, true);
+    ASSERT_TRUE(closest.second);
+    ASSERT_TRUE(solver.is_safe(arm, vector6dToVec(closest.first)));
+
+    // The solution reaches the target
+    arm.set_joint_angles(vector6dToVec(closest.first));
+    solver.FK(arm);
+    ASSERT_TRUE((arm.get_ef_pos_world() - target_pos.head(3)).norm() < POS_THRESHOLD);
+
+    // A canceled search doesn't run any starts
+    std::pair<Vector6d, bool> canceled = solver.IK_multi_start(arm, target_pos, true, 32, true, []() { return true; });
+    ASSERT_FALSE(canceled.second);
+    ASSERT_EQUAL(0, solver.get_num_iterations());
+}
+
+// Test that warm starting solves a target dragged a little in a few iterations, close to the last solution
+TEST(ik_test_warm_start) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> first = {0.4, 0.7, -1.3, 0.3, -0.4, 0.2};
+    std::vector<double> second = {0.43, 0.72, -1.27, 0.32, -0.42, 0.22};
+
+    ASSERT_TRUE(solver.is_safe(arm, first));
+    ASSERT_TRUE(solver.is_safe(arm, second));
+
+    arm.set_joint_angles(first);
+    solver.FK(arm);
+    Vector6d first_pos = vecTo6d(arm.get_ef_pos_and_euler_angles());
+
+    arm.set_joint_angles(second);
+    solver.FK(arm);
+    Vector6d second_pos = vecTo6d(arm.get_ef_pos_and_euler_angles());
+
+    arm.set_joint_angles(start);
+    solver.FK(arm);
+
+    // Nothing to start from yet
+    ASSERT_FALSE(solver.IK_warm_start(arm, second_pos, true).second);
+
+    solver.remember_solution(first_pos, vecTo6d(first));
+    std::pair<Vector6d, bool> result = solver.IK_warm_start(arm, second_pos, true);
+    std::cout << "warm start: " << solver.get_num_iterations() << " iterations\n";
+    ASSERT_TRUE(result.second);
+    ASSERT_TRUE(solver.get_num_iterations() <= 5);
+    ASSERT_TRUE((result.first - vecTo6d(first)).cwiseAbs().maxCoeff() <= MAX_WARM_START_JOINT_JUMP);
+
+    arm.set_joint_angles(vector6dToVec(result.first));
+    solver.FK(arm);
+    ASSERT_TRUE((arm.get_ef_pos_world() - second_pos.head(3)).norm() < POS_THRESHOLD);
+
+    // IK_warm_start() leaves the arm where it started
+    arm.set_joint_angles(start);
+    solver.FK(arm);
+    ASSERT_TRUE(solver.IK_warm_start(arm, second_pos, true).second);
+    ASSERT_ALMOST_EQUAL(start[1], arm.get_joint_angle(1), 0.0000001);
+
+    // A target far from the remembered one isn't warm started
+    Vector6d far_pos = second_pos;
+    far_pos(0) += 2 * MAX_WARM_START_TARGET_DIST;
+    ASSERT_FALSE(solver.IK_warm_start(arm, far_pos, true).second);
+
+    solver.forget_solution();
+    ASSERT_FALSE(solver.IK_warm_start(arm, second_pos, true).second);
+}
+
+// Test that the reachability map rules out targets out of reach and seeds IK for the rest
+TEST(reachability_map_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+    ArmState arm = ArmState(model);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    ReachabilityMap map;
+    ASSERT_TRUE(map.empty());
+    map.generate(model, 200000, 16);
+    ASSERT_FALSE(map.empty());
+
+    std::vector<double> target = {0.4, 0.7, -1.3, 0.3, -0.4, 0.2};
+    ASSERT_TRUE(solver.is_safe(arm, target));
+    arm.set_joint_angles(target);
+    solver.FK(arm);
+    Vector6d target_pos = vecTo6d(arm.get_ef_pos_and_euler_angles());
+
+    // Somewhere the arm gets to is reachable, and its seed gets IK there
+    ASSERT_TRUE(map.is_reachable(target_pos.head(3)));
+    Vector6d seed;
+    ASSERT_TRUE(map.find_seed(target_pos, true, seed));
+
+    arm.set_joint_angles(vector6dToVec(seed));
+    solver.FK(arm);
+    ASSERT_TRUE(solver.is_safe(arm));
+    ASSERT_TRUE(solver.IK(arm, target_pos, false, true).second);
+
+    // Far past the end of the arm isn't
+    Vector6d far_pos = target_pos;
+    far_pos(2) += 3;
+    ASSERT_FALSE(map.is_reachable(far_pos.head(3)));
+    ASSERT_FALSE(map.find_seed(far_pos, true, seed));
+
+    std::string filename = "reachability_map_test.bin";
+    ASSERT_TRUE(map.save(filename));
+
+    ReachabilityMap loaded;
+    ASSERT_TRUE(loaded.load(filename, model));
+    Vector6d loaded_seed;
+    ASSERT_TRUE(loaded.find_seed(target_pos, true, loaded_seed));
+    map.find_seed(target_pos, true, seed);
+    ASSERT_TRUE(seed == loaded_seed);
+
+    // a map for a different arm must not be used
+    model.ef_xyz(0) += 0.01;
+    ReachabilityMap stale;
+    ASSERT_FALSE(stale.load(filename, model));
+    ASSERT_TRUE(stale.empty());
+
+    std::remove(filename.c_str());
+}
+
+// Test that is_safe_motion never passes a motion that collides somewhere on the way
+TEST(is_safe_motion_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::default_random_engine eng(5);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    auto random_angles = [&]() {
+        Vector6d angles;
+        for (size_t i = 0; i < 6; ++i) {
+            const std::array<double, 2> &limits = arm.get_joint_limits(i);
+            angles(i) = limits[0] + unit(eng) * (limits[1] - limits[0]);
+        }
+        return angles;
+    };
+
+    std::vector<double> initial = arm.get_joint_angles();
+
+    int num_safe = 0;
+    int num_blocked = 0;
+    for (int i = 0; i < 300; ++i) {
+        Vector6d start = random_angles();
+        Vector6d end = random_angles();
+        if (!solver.is_safe(arm, vector6dToVec(start)) || !solver.is_safe(arm, vector6dToVec(end))) {
+            continue;
+        }
+
+        bool sampled_safe = true;
+        for (int k = 1; k < 500 && sampled_safe; ++k) {
+            sampled_safe = solver.is_safe(arm, vector6dToVec(start + (k / 500.0) * (end - start)));
+        }
+
+        if (solver.is_safe_motion(arm, start, end)) {
+            ASSERT_TRUE(sampled_safe);
+            ++num_safe;
+        }
+        else if (!sampled_safe) {
+            ++num_blocked;
+        }
+    }
+
+    // Both kinds of motion came up, and the arm is back where it started
+    ASSERT_TRUE(num_safe > 0);
+    ASSERT_TRUE(num_blocked > 0);
+    ASSERT_TRUE(arm.get_joint_angles() == initial);
+}
+
+// Test that remembered obstacle free results match checking again, are
+// dropped least recently used first, and aren't used with another environment
+TEST(safety_cache_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    KinematicsSolver uncached = KinematicsSolver();
+
+    std::default_random_engine eng(7);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    std::vector<std::vector<double> > configs;
+    for (int i = 0; i < 200; ++i) {
+        std::vector<double> angles(6);
+        for (size_t j = 0; j < 6; ++j) {
+            const std::array<double, 2> &limits = arm.get_joint_limits(j);
+            angles[j] = limits[0] + unit(eng) * (limits[1] - limits[0]);
+        }
+        configs.push_back(angles);
+    }
+
+    for (int round = 0; round < 2; ++round) {
+        for (const std::vector<double> &angles : configs) {
+            ASSERT_EQUAL(solver.is_safe(arm, angles), uncached.is_safe(arm, angles));
+        }
+    }
+    ASSERT_EQUAL(solver.get_safety_cache().lookups(), 400);
+    ASSERT_EQUAL(solver.get_safety_cache().hits(), 200);
+
+    // copies start over
+    KinematicsSolver copy = solver;
+    ASSERT_EQUAL(copy.get_safety_cache().lookups(), 0);
+
+    // a new environment isn't checked with the results from without one
+    arm.set_environment(std::make_shared<EnvironmentMap>(std::vector<Vector3d>{ Vector3d(5, 5, 5) }));
+    ASSERT_EQUAL(solver.is_safe(arm, configs[0]), uncached.is_safe(arm, configs[0]));
+    ASSERT_EQUAL(solver.get_safety_cache().hits(), 200);
+
+    SafetyCache cache;
+    bool safe;
+    for (size_t i = 0; i <= SAFETY_CACHE_SIZE; ++i) {
+        Vector6d angles = Vector6d::Zero();
+        angles(0) = i * SAFETY_CACHE_RESOLUTION * 2;
+        cache.store(arm, angles, i % 2 == 0);
+
+        // the first entry stays the most recently used up to here
+        if (i + 1 < SAFETY_CACHE_SIZE) {
+            ASSERT_TRUE(cache.find(arm, Vector6d::Zero(), safe));
+        }
+    }
+    ASSERT_TRUE(cache.find(arm, Vector6d::Zero(), safe));
+    ASSERT_TRUE(safe);
+    Vector6d dropped = Vector6d::Zero();
+    dropped(0) = SAFETY_CACHE_RESOLUTION * 2;
+    ASSERT_FALSE(cache.find(arm, dropped, safe));
+}
+
+// Test that servoing reaches nearby targets within the speed limits, staying
+// safe on the way, and stops when no joint can move
+TEST(servo_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+
+    std::vector<double> start{0, 0.6, 1.2, 0, 0.6, 0};
+    ASSERT_TRUE(solver.is_safe(arm, start));
+
+    const double dt = 0.01;
+
+    for (bool use_orientation : { false, true }) {
+        arm.set_joint_angles(start);
+        solver.FK(arm);
+
+        // 3 cm over and 2 cm down, turning the hand a little with orientation
+        Vector6d target = vecTo6d(arm.get_ef_pos_and_euler_angles());
+        target(0) += 0.03;
+        target(2) -= 0.02;
+        if (use_orientation) {
+            target(4) += 0.05;
+        }
+
+        ServoResult result = ServoResult::MOVING;
+        int steps = 0;
+        while (result == ServoResult::MOVING && steps < 1000) {
+            Vector6d prev_angles = vecTo6d(arm.get_joint_angles());
+            Vector3d prev_pos = arm.get_ef_pos_world();
+
+            result = solver.servo_step(arm, target, use_orientation, dt);
+            ++steps;
+
+            Vector6d angles = vecTo6d(arm.get_joint_angles());
+            for (size_t i = 0; i < 6; ++i) {
+                ASSERT_TRUE(std::abs(angles(i) - prev_angles(i)) <= arm.get_joint_max_speed(i) * dt + 1e-9);
+            }
+            ASSERT_TRUE((arm.get_ef_pos_world() - prev_pos).norm() <= SERVO_MAX_LINEAR_SPEED * dt * 1.5);
+            ASSERT_TRUE(solver.is_safe(arm, arm.get_joint_angles()));
+        }
+
+        ASSERT_TRUE(result == ServoResult::REACHED);
+        ASSERT_TRUE(solver.get_ef_error(arm, target).head(3).norm() < SERVO_POS_TOLERANCE);
+        if (use_orientation) {
+            ASSERT_TRUE(solver.get_ef_error(arm, target).tail(3).norm() < SERVO_ANGLE_TOLERANCE);
+        }
+    }
+
+    // With every joint locked nothing can move towards the target
+    for (size_t i = 0; i < 6; ++i) {
+        arm.set_joint_locked(i, true);
+    }
+    Vector6d target = vecTo6d(arm.get_ef_pos_and_euler_angles());
+    target(0) += 0.03;
+    std::vector<double> locked_angles = arm.get_joint_angles();
+
+    ASSERT_TRUE(solver.servo_step(arm, target, false, dt) == ServoResult::BLOCKED);
+    ASSERT_TRUE(arm.get_joint_angles() == locked_angles);
+}
+
 TEST_MAIN()
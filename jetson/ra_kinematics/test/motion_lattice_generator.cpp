@@ -0,0 +1,38 @@
+#include "nlohmann/json.hpp"
+#include "../arm_model.hpp"
+#include "../motion_lattice.hpp"
+#include "../utils.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/**
+ * Generates the motion lattice for mrover_arm_geom.json and writes it next
+ * to the geometry, or to the file given as the first argument. Run again after
+ * changing the geometry, ra_kinematics ignores a lattice made for other geometry.
+ * */
+
+int main(int argc, char **argv) {
+    std::string output_file = argc > 1 ? argv[1] : get_mrover_arm_motion_lattice();
+
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+
+    auto start = std::chrono::steady_clock::now();
+
+    MotionLattice lattice;
+    lattice.generate(model);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Checked " << MOTION_LATTICE_NODES << "^" << NUM_JOINTS << " nodes in " << seconds << " s\n";
+    std::cout << "safe nodes: " << lattice.num_safe_nodes() << ", safe steps: " << lattice.num_safe_steps() << "\n";
+
+    if (!lattice.save(output_file)) {
+        return 1;
+    }
+
+    std::cout << "Wrote " << output_file << "\n";
+    return 0;
+}
@@ -3,9 +3,20 @@
 #include "../arm_state.hpp"
 #include "../kinematics.hpp"
 #include "../motion_planner.hpp"
+#include "../kd_tree.hpp"
+#include "../trajectory.hpp"
+#include "../joint_spline.hpp"
+#include "../solution_cache.hpp"
+#include "../joint_sampler.hpp"
+#include "../motion_lattice.hpp"
+#include "../plan_log.hpp"
+#include "kluge/spline.h"
 #include <lcm/lcm-cpp.hpp>
 #include "../utils.hpp"
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <random>
 
 TEST(motion_planner_init) {
     // read arm geometry
@@ -252,4 +263,485 @@ TEST(test_lock) {
     }
 }
 
+// Test that the shortcut path and the anytime RRT* path are both safe along the whole spline
+TEST(rrt_star_and_shortcuts) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    MotionPlanner planner = MotionPlanner(arm, solver);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {2.5, 0.6, 1.2, -1, 0.8, 0.5};
+
+    ASSERT_TRUE(solver.is_safe(arm, start));
+    ASSERT_TRUE(solver.is_safe(arm, target));
+
+    for (double planning_time : {0.0, 0.05}) {
+        planner.set_planning_time(planning_time);
+
+        arm.set_joint_angles(start);
+        ASSERT_TRUE(planner.rrt_connect(arm, vecTo6d(target)));
+
+        for (size_t j = 0; j < 6; ++j) {
+            ASSERT_ALMOST_EQUAL(planner.get_spline_pos(0)[j], start[j], 0.01);
+            ASSERT_ALMOST_EQUAL(planner.get_spline_pos(1)[j], target[j], 0.01);
+        }
+
+        for (int k = 0; k <= 200; ++k) {
+            ASSERT_TRUE(solver.is_safe(arm, planner.get_spline_pos(k / 200.0)));
+        }
+    }
+}
+
+// Test that racing planners finds a safe path, with and without a planning time
+TEST(rrt_connect_parallel_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    MotionPlanner planner = MotionPlanner(arm, solver);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {2.5, 0.6, 1.2, -1, 0.8, 0.5};
+
+    for (double planning_time : {0.0, 0.02}) {
+        planner.set_planning_time(planning_time);
+
+        arm.set_joint_angles(start);
+        ASSERT_TRUE(planner.rrt_connect_parallel(arm, vecTo6d(target), 4));
+
+        // the state passed in isn't changed
+        ASSERT_TRUE(arm.get_joint_angles() == start);
+
+        for (size_t j = 0; j < 6; ++j) {
+            ASSERT_ALMOST_EQUAL(planner.get_spline_pos(0)[j], start[j], 0.01);
+            ASSERT_ALMOST_EQUAL(planner.get_spline_pos(1)[j], target[j], 0.01);
+        }
+
+        for (int k = 0; k <= 200; ++k) {
+            ASSERT_TRUE(solver.is_safe(arm, planner.get_spline_pos(k / 200.0)));
+        }
+    }
+}
+
+// Test that a path found with few waypoints is fit with splines that are safe
+// everywhere between them, not only at the points they were checked at
+TEST(fit_path_dense_check) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    MotionPlanner planner = MotionPlanner(arm, solver);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {2.5, 0.6, 1.2, -1, 0.8, 0.5};
+
+    arm.set_joint_angles(start);
+    ASSERT_TRUE(planner.rrt_connect(arm, vecTo6d(target)));
+
+    // refitting the path found keeps its ends and is as safe
+    std::vector<Vector6d> path = planner.get_spline_path();
+    ASSERT_TRUE(planner.fit_path(arm, path));
+    ASSERT_TRUE(arm.get_joint_angles() == start);
+    ASSERT_TRUE(planner.get_spline_path().size() >= path.size());
+
+    for (size_t j = 0; j < 6; ++j) {
+        ASSERT_ALMOST_EQUAL(planner.get_spline_pos(0)[j], start[j], 0.01);
+        ASSERT_ALMOST_EQUAL(planner.get_spline_pos(1)[j], target[j], 0.01);
+    }
+
+    for (int k = 0; k <= 5000; ++k) {
+        ASSERT_TRUE(solver.is_safe(arm, planner.get_spline_pos(k / 5000.0)));
+    }
+}
+
+// Test that a lattice path starts and ends where asked and is safe all the
+// way, that no path is planned with a joint locked, and that a saved lattice
+// only loads for the geometry and resolution it was generated for
+TEST(motion_lattice_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+    ArmState arm = ArmState(model);
+    KinematicsSolver solver = KinematicsSolver();
+    MotionPlanner planner = MotionPlanner(arm, solver);
+
+    MotionLattice lattice;
+    lattice.generate(model, 5);
+    ASSERT_TRUE(lattice.num_safe_nodes() > 0 && lattice.num_safe_steps() > 0);
+
+    std::string filename = "motion_lattice_test.bin";
+    ASSERT_TRUE(lattice.save(filename));
+
+    MotionLattice loaded;
+    ASSERT_TRUE(loaded.load(filename, model));
+    ASSERT_EQUAL(loaded.num_safe_nodes(), lattice.num_safe_nodes());
+    ASSERT_EQUAL(loaded.num_safe_steps(), lattice.num_safe_steps());
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {2.5, 0.6, 1.2, -1, 0.8, 0.5};
+
+    arm.set_joint_angles(start);
+    ASSERT_TRUE(planner.lattice_connect(arm, loaded, vecTo6d(target)));
+    ASSERT_TRUE(arm.get_joint_angles() == start);
+
+    for (size_t j = 0; j < 6; ++j) {
+        ASSERT_ALMOST_EQUAL(planner.get_spline_pos(0)[j], start[j], 0.01);
+        ASSERT_ALMOST_EQUAL(planner.get_spline_pos(1)[j], target[j], 0.01);
+    }
+
+    for (int k = 0; k <= 2000; ++k) {
+        ASSERT_TRUE(solver.is_safe(arm, planner.get_spline_pos(k / 2000.0)));
+    }
+
+    // the same start and target give the same path
+    std::vector<Vector6d> path = planner.get_spline_path();
+    ASSERT_TRUE(planner.lattice_connect(arm, loaded, vecTo6d(target)));
+    ASSERT_TRUE(planner.get_spline_path() == path);
+
+    arm.set_joint_locked(3, true);
+    ASSERT_FALSE(planner.lattice_connect(arm, loaded, vecTo6d(target)));
+    arm.set_joint_locked(3, false);
+
+    // a lattice for a different arm must not be used
+    model.avoidance_links[4].radius += 0.01;
+    MotionLattice stale;
+    ASSERT_FALSE(stale.load(filename, model));
+    ASSERT_TRUE(stale.empty());
+
+    std::remove(filename.c_str());
+}
+
+// Test that a plan log reads back the records written to it in order, and
+// that a log cut off partway through a record reads up to the last whole one
+TEST(plan_log_test) {
+    std::string filename = "plan_log_test.bin";
+
+    PlanLog log;
+    ASSERT_TRUE(log.open(filename));
+    ASSERT_TRUE(log.is_open());
+
+    for (int n = 0; n < 3; ++n) {
+        PlanRecord record = PlanRecord();
+        record.time = n;
+        for (size_t i = 0; i < 6; ++i) {
+            record.start[i] = n + 0.1 * i;
+            record.target[i] = -n - 0.1 * i;
+        }
+        record.plan_ms = 10 * n;
+        record.locks = 1u << n;
+        record.is_angles = n % 2;
+        record.result = n == 2 ? PlanResult::NO_PATH : PlanResult::PLANNED;
+        record.source = n == 2 ? PlanSource::NONE : PlanSource::RRT;
+        log.write(record);
+    }
+
+    std::vector<PlanRecord> records;
+    ASSERT_TRUE(PlanLog::read(filename, records));
+    ASSERT_EQUAL(records.size(), 3);
+    for (int n = 0; n < 3; ++n) {
+        ASSERT_EQUAL(records[n].time, n);
+        ASSERT_EQUAL(records[n].start[5], n + 0.5);
+        ASSERT_EQUAL(records[n].target[5], -n - 0.5);
+        ASSERT_EQUAL(records[n].plan_ms, 10 * n);
+        ASSERT_EQUAL(records[n].locks, 1u << n);
+        ASSERT_EQUAL(records[n].is_angles, n % 2);
+    }
+    ASSERT_TRUE(records[2].result == PlanResult::NO_PATH);
+    ASSERT_TRUE(records[1].source == PlanSource::RRT);
+
+    PlanRecord partial = PlanRecord();
+    std::ofstream file(filename, std::ios::binary | std::ios::app);
+    file.write(reinterpret_cast<const char *>(&partial), sizeof(partial) / 2);
+    file.close();
+
+    ASSERT_TRUE(PlanLog::read(filename, records));
+    ASSERT_EQUAL(records.size(), 3);
+
+    ASSERT_FALSE(PlanLog::read("plan_log_test_missing.bin", records));
+
+    std::remove(filename.c_str());
+}
+
+// Test that a timed path starts and ends at rest and keeps within the joints' limits
+TEST(trajectory_limits) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    MotionPlanner planner = MotionPlanner(arm, solver);
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    std::vector<double> target = {2.5, 0.6, 1.2, -1, 0.8, 0.5};
+
+    arm.set_joint_angles(start);
+    ASSERT_TRUE(planner.rrt_connect(arm, vecTo6d(target)));
+
+    Trajectory trajectory;
+    trajectory.parameterize(planner, arm);
+
+    double duration = trajectory.get_duration();
+    ASSERT_TRUE(duration > 0);
+    ASSERT_ALMOST_EQUAL(trajectory.get_spline_t(0), 0, 1e-9);
+    ASSERT_ALMOST_EQUAL(trajectory.get_spline_t(duration), 1, 1e-9);
+
+    // no joint could move its whole way any faster
+    for (size_t j = 0; j < 6; ++j) {
+        ASSERT_TRUE(std::abs(target[j] - start[j]) / arm.get_joint_max_speed(j) <= duration);
+    }
+
+    // speeds and accelerations by finite differences, which are a bit off from
+    // the ones the trajectory was timed with
+    const int steps = 200;
+    double dt = duration / steps;
+    std::vector< std::vector<double> > angles;
+    for (int k = 0; k <= steps; ++k) {
+        angles.push_back(planner.get_spline_pos(trajectory.get_spline_t(k * dt)));
+    }
+
+    for (int k = 1; k < steps; ++k) {
+        for (size_t j = 0; j < 6; ++j) {
+            double speed = (angles[k + 1][j] - angles[k - 1][j]) / (2 * dt);
+            double accel = (angles[k + 1][j] - 2 * angles[k][j] + angles[k - 1][j]) / (dt * dt);
+
+            ASSERT_TRUE(std::abs(speed) <= arm.get_joint_max_speed(j) * 1.05);
+            ASSERT_TRUE(std::abs(accel) <= arm.get_joint_max_acceleration(j) * 1.1);
+        }
+    }
+}
+
+// Test that JointSpline is the same curve as a tk::spline through each joint
+TEST(joint_spline_matches_tk) {
+    std::default_random_engine eng(5);
+    std::uniform_real_distribution<double> angle(-3, 3);
+
+    for (size_t num_points : {1, 2, 3, 7}) {
+        std::vector<Vector6d> points(num_points);
+        for (Vector6d &point : points) {
+            for (size_t j = 0; j < 6; ++j) {
+                point(j) = angle(eng);
+            }
+        }
+
+        JointSpline spline;
+        spline.fit(points);
+        ASSERT_FALSE(spline.empty());
+
+        Vector6d pos, first, second;
+        if (num_points == 1) {
+            spline.get_pos(0.5, pos);
+            ASSERT_TRUE(pos == points[0]);
+            continue;
+        }
+
+        // tk::spline needs three points, and through two a natural spline is a line
+        if (num_points == 2) {
+            for (int k = 0; k <= 10; ++k) {
+                double t = k / 10.0;
+                spline.get_pos(t, pos);
+                spline.get_deriv(t, 1, first);
+                ASSERT_TRUE((pos - (points[0] + t * (points[1] - points[0]))).norm() < 1e-9);
+                ASSERT_TRUE((first - (points[1] - points[0])).norm() < 1e-9);
+            }
+            continue;
+        }
+
+        std::vector<double> x;
+        for (size_t i = 0; i < num_points; ++i) {
+            x.push_back(static_cast<double>(i) / (num_points - 1));
+        }
+
+        for (size_t j = 0; j < 6; ++j) {
+            std::vector<double> y;
+            for (const Vector6d &point : points) {
+                y.push_back(point(j));
+            }
+
+            tk::spline tk_spline;
+            tk_spline.set_points(x, y);
+
+            for (int k = 0; k <= 100; ++k) {
+                double t = k / 100.0;
+                spline.get_pos(t, pos);
+                spline.get_deriv(t, 1, first);
+                spline.get_deriv(t, 2, second);
+                ASSERT_ALMOST_EQUAL(pos(j), tk_spline(t), 1e-9);
+                ASSERT_ALMOST_EQUAL(first(j), tk_spline.deriv(1, t), 1e-7);
+                ASSERT_ALMOST_EQUAL(second(j), tk_spline.deriv(2, t), 1e-6);
+            }
+        }
+    }
+}
+
+// Test that cached paths are found from nearby starts and can be fit again
+TEST(solution_cache_paths) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    MotionPlanner planner = MotionPlanner(arm, solver);
+    SolutionCache cache;
+
+    std::vector<double> start = {0, 1, -1, 0, 0, 0};
+    Vector6d goal = vecTo6d({2.5, 0.6, 1.2, -1, 0.8, 0.5});
+
+    arm.set_joint_angles(start);
+    ASSERT_TRUE(planner.rrt_connect(arm, goal));
+    cache.store_path(arm, goal, planner.get_spline_path());
+
+    // within the resolution of the start, the path is found
+    std::vector<Vector6d> path;
+    arm.set_joint_angles({0.001, 1, -1.002, 0, 0, 0});
+    ASSERT_TRUE(cache.find_path(arm, goal, path));
+    ASSERT_TRUE(path == planner.get_spline_path());
+
+    // and fitting it again from where the arm is gives a safe spline between the right ends
+    path.front() = vecTo6d(arm.get_joint_angles());
+    MotionPlanner other = MotionPlanner(arm, solver);
+    ASSERT_TRUE(other.fit_path(arm, path));
+    for (size_t j = 0; j < 6; ++j) {
+        ASSERT_ALMOST_EQUAL(other.get_spline_pos(0)[j], arm.get_joint_angle(j), 1e-9);
+        ASSERT_ALMOST_EQUAL(other.get_spline_pos(1)[j], goal(j), 1e-9);
+    }
+
+    // a different start, goal or set of locked joints doesn't find it
+    arm.set_joint_angles({0.1, 1, -1, 0, 0, 0});
+    ASSERT_FALSE(cache.find_path(arm, goal, path));
+
+    arm.set_joint_angles(start);
+    ASSERT_FALSE(cache.find_path(arm, goal * 0.5, path));
+
+    arm.set_joint_locked(5, true);
+    ASSERT_FALSE(cache.find_path(arm, goal, path));
+    arm.set_joint_locked(5, false);
+
+    // filling the cache drops the oldest entry
+    for (size_t i = 0; i < SOLUTION_CACHE_SIZE; ++i) {
+        Vector6d other_goal = goal;
+        other_goal(0) = i * 0.1 - 3;
+        cache.store_path(arm, other_goal, planner.get_spline_path());
+    }
+    ASSERT_FALSE(cache.find_path(arm, goal, path));
+}
+
+// Test that cached IK solutions are kept apart by target and by whether orientation was used
+TEST(solution_cache_ik) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    SolutionCache cache;
+
+    Vector6d target = vecTo6d({0.3, 0.2, 0.4, 0, 1, 0});
+    Vector6d solution = vecTo6d({0.5, 0.6, 0.7, 0.8, 0.9, 1.0});
+    cache.store_ik(arm, target, false, solution);
+
+    Vector6d found;
+    ASSERT_TRUE(cache.find_ik(arm, target, false, found));
+    ASSERT_TRUE(found == solution);
+    ASSERT_FALSE(cache.find_ik(arm, target, true, found));
+
+    target(0) += 0.01;
+    ASSERT_FALSE(cache.find_ik(arm, target, false, found));
+
+    cache.clear();
+    target(0) -= 0.01;
+    ASSERT_FALSE(cache.find_ik(arm, target, false, found));
+}
+
+// Test that KDTree finds the same nearest point as checking every point
+// Test that both sampling modes stay within the limits, keep locked joints
+// and repeat for the same seed, and that Halton samples spread evenly
+TEST(joint_sampler_test) {
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    arm.set_joint_locked(2, true);
+
+    Vector6d current;
+    current << 0.1, 0.5, 1.2, -0.3, 0.2, 0.4;
+
+    for (SamplingMode mode : { SamplingMode::UNIFORM, SamplingMode::HALTON }) {
+        JointSampler sampler;
+        sampler.set_mode(mode);
+        sampler.seed(5);
+
+        JointSampler repeat;
+        repeat.set_mode(mode);
+        repeat.seed(5);
+
+        std::vector<int> bins(8, 0);
+        for (int i = 0; i < 64; ++i) {
+            Vector6d angles = sampler.sample(arm, current);
+            ASSERT_TRUE(angles == repeat.sample(arm, current));
+            ASSERT_EQUAL(current(2), angles(2));
+
+            for (size_t j = 0; j < 6; ++j) {
+                const std::array<double, 2> &limits = arm.get_joint_limits(j);
+                ASSERT_TRUE(angles(j) >= limits[0] && angles(j) <= limits[1]);
+            }
+
+            const std::array<double, 2> &limits = arm.get_joint_limits(0);
+            size_t bin = static_cast<size_t>((angles(0) - limits[0]) / (limits[1] - limits[0]) * bins.size());
+            ++bins[std::min(bin, bins.size() - 1)];
+        }
+
+        if (mode == SamplingMode::HALTON) {
+            for (int count : bins) {
+                ASSERT_TRUE(count >= 6 && count <= 10);
+            }
+        }
+    }
+}
+
+TEST(kd_tree_nearest) {
+    std::default_random_engine eng(3);
+    std::uniform_real_distribution<double> angle(-3, 3);
+
+    KDTree tree;
+    std::vector<Vector6d> points;
+
+    for (size_t i = 0; i < 1000; ++i) {
+        Vector6d point;
+        for (size_t j = 0; j < 6; ++j) {
+            point(j) = angle(eng);
+        }
+
+        // like a locked joint, every point has the same last angle
+        point(5) = 0.5;
+
+        // and some points are added many times
+        if (i % 50 > 30) {
+            point = points[i - i % 50 + 30];
+        }
+
+        tree.insert(point, i);
+        points.push_back(point);
+
+        Vector6d target;
+        for (size_t j = 0; j < 6; ++j) {
+            target(j) = angle(eng);
+        }
+
+        size_t closest = 0;
+        for (size_t j = 1; j < points.size(); ++j) {
+            if ((points[j] - target).norm() < (points[closest] - target).norm()) {
+                closest = j;
+            }
+        }
+
+        ASSERT_ALMOST_EQUAL((points[closest] - target).norm(), (points[tree.nearest(target)] - target).norm(), 1e-12);
+    }
+
+    // within() finds the points close to target, each copy only by its first id
+    Vector6d target = Vector6d::Zero();
+    std::vector<size_t> found;
+    tree.within(target, 3, found);
+
+    size_t num_within = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (i % 50 <= 30 && (points[i] - target).norm() < 3) {
+            ++num_within;
+            ASSERT_TRUE(std::find(found.begin(), found.end(), i) != found.end());
+        }
+    }
+    ASSERT_EQUAL(num_within, found.size());
+
+    ASSERT_EQUAL(1000, tree.size());
+    tree.clear();
+    ASSERT_EQUAL(0, tree.size());
+}
+
 TEST_MAIN()
@@ -0,0 +1,220 @@
+#include "nlohmann/json.hpp"
+#include "../arm_state.hpp"
+#include "../kinematics.hpp"
+#include "../motion_planner.hpp"
+#include "../collision_map.hpp"
+#include "../reachability_map.hpp"
+#include "../motion_lattice.hpp"
+#include "../plan_log.hpp"
+#include "../utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Plans every request of a plan log written by MRoverArm again with the
+ * current code, and compares how many succeed and how long they take with
+ * what the log recorded. Uses the collision map, reachability map and motion
+ * lattice of mrover_arm_geom.json when they are there, like MRoverArm.
+ *
+ * The log is the file given as the first argument, or $MROVER_PLAN_LOG. Writes
+ * the results as JSON to the file given as the second argument, or
+ * plan_replay.json, and prints them when done.
+ *
+ * Requests are planned cold: the solution cache and IK's warm start only help
+ * when the same moves come again, and the environment the arm had isn't logged,
+ * so requests planned with one are counted but planned without it.
+ * */
+
+using nlohmann::json;
+
+// IK starts and RRT-Connect planners per request, as many as MRoverArm uses
+static constexpr int NUM_IK_STARTS = 26;
+static constexpr int NUM_REPLAY_PLANNERS = 4;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static const char *result_name(PlanResult result) {
+    switch (result) {
+        case PlanResult::PLANNED: return "planned";
+        case PlanResult::UNSAFE_START: return "unsafe start";
+        case PlanResult::OUT_OF_REACH: return "out of reach";
+        case PlanResult::NO_IK: return "no IK solution";
+        case PlanResult::NO_PATH: return "no path";
+        case PlanResult::CANCELED: return "canceled";
+    }
+    return "unknown";
+}
+
+/**
+ * Plans record's request from its start, the way MRoverArm does without a
+ * cached solution or path
+ * */
+static PlanRecord replay(ArmState arm, KinematicsSolver &solver, const ReachabilityMap &reachability_map,
+                         const MotionLattice &motion_lattice, const PlanRecord &logged) {
+    PlanRecord record = logged;
+    record.ik_ms = 0;
+    record.plan_ms = 0;
+    record.source = PlanSource::NONE;
+
+    std::vector<double> start(logged.start, logged.start + 6);
+    Vector6d target;
+    for (size_t i = 0; i < 6; ++i) {
+        target(i) = logged.target[i];
+        arm.set_joint_locked(i, logged.locks & (1u << i));
+    }
+    arm.set_joint_angles(start);
+
+    if (!solver.is_safe(arm)) {
+        record.result = PlanResult::UNSAFE_START;
+        return record;
+    }
+
+    Vector6d goal = target;
+    if (!logged.is_angles) {
+        auto ik_start = std::chrono::steady_clock::now();
+        if (!reachability_map.empty() && !reachability_map.is_reachable(target.head(3))) {
+            record.result = PlanResult::OUT_OF_REACH;
+            record.ik_ms = elapsed_ms(ik_start);
+            return record;
+        }
+
+        std::pair<Vector6d, bool> ik_solution = solver.IK_multi_start(arm, target, logged.use_orientation,
+                                                                      NUM_IK_STARTS, true);
+        record.ik_ms = elapsed_ms(ik_start);
+        if (!ik_solution.second) {
+            record.result = PlanResult::NO_IK;
+            return record;
+        }
+        goal = ik_solution.first;
+    }
+
+    for (size_t i = 0; i < 6; ++i) {
+        record.goal[i] = goal(i);
+    }
+
+    auto plan_start = std::chrono::steady_clock::now();
+    MotionPlanner planner(arm, solver);
+    if (!motion_lattice.empty() && planner.lattice_connect(arm, motion_lattice, goal)) {
+        record.source = PlanSource::LATTICE;
+    }
+    else if (planner.rrt_connect_parallel(arm, goal, NUM_REPLAY_PLANNERS)) {
+        record.source = PlanSource::RRT;
+    }
+    record.plan_ms = elapsed_ms(plan_start);
+    record.result = record.source == PlanSource::NONE ? PlanResult::NO_PATH : PlanResult::PLANNED;
+    return record;
+}
+
+/**
+ * @return the count, success rate and latency percentiles in ms of the planned requests of records
+ * */
+static json summarize(const std::vector<PlanRecord> &records) {
+    std::vector<double> latencies;
+    size_t planned = 0;
+    for (const PlanRecord &record : records) {
+        latencies.push_back(record.ik_ms + record.plan_ms);
+        planned += record.result == PlanResult::PLANNED;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+
+    double total = 0;
+    for (double latency : latencies) {
+        total += latency;
+    }
+
+    return { { "requests", records.size() },
+             { "success_rate", records.empty() ? 0.0 : static_cast<double>(planned) / records.size() },
+             { "mean_ms", records.empty() ? 0.0 : total / records.size() },
+             { "p50_ms", percentile(0.50) },
+             { "p90_ms", percentile(0.90) },
+             { "max_ms", latencies.empty() ? 0.0 : latencies.back() } };
+}
+
+int main(int argc, char **argv) {
+    const char *log_env = getenv("MROVER_PLAN_LOG");
+    if (argc < 2 && !log_env) {
+        std::cout << "Usage: plan_replay <plan log> [results json], or set MROVER_PLAN_LOG\n";
+        return 1;
+    }
+    std::string log_file = argc > 1 ? argv[1] : log_env;
+    std::string output_file = argc > 2 ? argv[2] : "plan_replay.json";
+
+    std::vector<PlanRecord> logged;
+    if (!PlanLog::read(log_file, logged)) {
+        std::cout << "Could not read plan log " << log_file << "\n";
+        return 1;
+    }
+
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmState arm = ArmState(geom);
+    KinematicsSolver solver = KinematicsSolver();
+    solver.set_IK_mode(IKMode::DAMPED_LEAST_SQUARES);
+
+    std::shared_ptr<CollisionMap> collision_map = std::make_shared<CollisionMap>();
+    if (collision_map->load(get_mrover_arm_collision_map(), arm.get_model())) {
+        arm.set_collision_map(collision_map);
+    }
+    ReachabilityMap reachability_map;
+    reachability_map.load(get_mrover_arm_reachability_map(), arm.get_model());
+    MotionLattice motion_lattice;
+    motion_lattice.load(get_mrover_arm_motion_lattice(), arm.get_model());
+
+    // canceled requests never finished, so there is nothing to compare them with
+    std::vector<PlanRecord> before;
+    std::vector<PlanRecord> after;
+    size_t num_canceled = 0;
+    size_t num_with_environment = 0;
+    size_t newly_planned = 0;
+    size_t newly_failed = 0;
+
+    for (const PlanRecord &record : logged) {
+        if (record.result == PlanResult::CANCELED) {
+            ++num_canceled;
+            continue;
+        }
+        num_with_environment += record.has_environment;
+
+        PlanRecord replayed = replay(arm, solver, reachability_map, motion_lattice, record);
+        bool was_planned = record.result == PlanResult::PLANNED;
+        bool is_planned = replayed.result == PlanResult::PLANNED;
+        newly_planned += !was_planned && is_planned;
+        newly_failed += was_planned && !is_planned;
+
+        std::cout << "request " << before.size() << ": logged " << result_name(record.result) << " in "
+                  << record.ik_ms + record.plan_ms << " ms, replayed " << result_name(replayed.result) << " in "
+                  << replayed.ik_ms + replayed.plan_ms << " ms\n";
+
+        before.push_back(record);
+        after.push_back(replayed);
+    }
+
+    json results;
+    results["log"] = log_file;
+    results["canceled"] = num_canceled;
+    results["with_environment"] = num_with_environment;
+    results["logged"] = summarize(before);
+    results["replayed"] = summarize(after);
+    results["newly_planned"] = newly_planned;
+    results["newly_failed"] = newly_failed;
+
+    std::ofstream file(output_file);
+    file << results.dump(4) << "\n";
+
+    std::cout << results.dump(4) << "\n";
+    std::cout << "Wrote " << output_file << "\n";
+
+    return 0;
+}
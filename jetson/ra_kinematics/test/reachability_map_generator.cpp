@@ -0,0 +1,61 @@
+#include "nlohmann/json.hpp"
+#include "../arm_model.hpp"
+#include "../reachability_map.hpp"
+#include "../utils.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/**
+ * Generates the reachability map for mrover_arm_geom.json and writes it next
+ * to the geometry, or to the file given as the first argument. Run again after
+ * changing the geometry, ra_kinematics ignores a map made for other geometry.
+ * */
+
+int main(int argc, char **argv) {
+    std::string output_file = argc > 1 ? argv[1] : get_mrover_arm_reachability_map();
+
+    json geom = read_json_from_file(get_mrover_arm_geom());
+    ArmModel model = read_arm_model(geom);
+
+    auto start = std::chrono::steady_clock::now();
+
+    ReachabilityMap map;
+    map.generate(model);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // count the cells the end effector was found in, and the ones left reachable next to them
+    size_t num_seeded = 0;
+    size_t num_reachable = 0;
+    Vector6d point = Vector6d::Zero();
+    Vector6d seed;
+    double width = 2 * get_max_reach(model) / REACHABILITY_MAP_CELLS;
+
+    for (size_t x = 0; x < REACHABILITY_MAP_CELLS; ++x) {
+        for (size_t y = 0; y < REACHABILITY_MAP_CELLS; ++y) {
+            for (size_t z = 0; z < REACHABILITY_MAP_CELLS; ++z) {
+                size_t cell_index[3] = { x, y, z };
+                for (size_t i = 0; i < 3; ++i) {
+                    point(i) = model.joints[0].pos_local(i) + (cell_index[i] + 0.5) * width
+                               - width * REACHABILITY_MAP_CELLS / 2;
+                }
+
+                num_reachable += map.is_reachable(point.head(3));
+                num_seeded += map.find_seed(point, false, seed);
+            }
+        }
+    }
+
+    std::cout << "Sampled " << REACHABILITY_MAP_SAMPLES << " poses into " << REACHABILITY_MAP_CELLS << "^3 cells in "
+              << seconds << " s\n";
+    std::cout << "cells with a seed: " << num_seeded << ", reachable cells: " << num_reachable << "\n";
+
+    if (!map.save(output_file)) {
+        return 1;
+    }
+
+    std::cout << "Wrote " << output_file << "\n";
+    return 0;
+}
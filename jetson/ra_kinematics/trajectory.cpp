@@ -0,0 +1,160 @@
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Joints moving less than this per unit of spline_t don't bound the speed along it
+static constexpr double MIN_TRAJECTORY_DERIV = 1e-9;
+
+void Trajectory::parameterize(MotionPlanner &planner, const ArmState &robot) {
+    joints.clear();
+    max_speeds.assign(robot.num_joints(), 0.0);
+    max_accelerations.assign(robot.num_joints(), 0.0);
+
+    for (size_t i = 0; i < static_cast<size_t>(robot.num_joints()); ++i) {
+        if (!robot.get_joint_locked(i)) {
+            joints.push_back(i);
+            max_speeds[i] = robot.get_joint_max_speed(i);
+            max_accelerations[i] = robot.get_joint_max_acceleration(i);
+        }
+    }
+
+    const double ds = 1.0 / TRAJECTORY_STEPS;
+
+    spline_ts.resize(TRAJECTORY_STEPS + 1);
+    firsts.resize(TRAJECTORY_STEPS + 1);
+    seconds.resize(TRAJECTORY_STEPS + 1);
+
+    // the fastest (ds/dt)^2 allowed at each point
+    std::vector<double> speeds_squared(TRAJECTORY_STEPS + 1);
+
+    for (size_t k = 0; k <= TRAJECTORY_STEPS; ++k) {
+        spline_ts[k] = k * ds;
+        planner.get_spline_deriv(spline_ts[k], 1, firsts[k]);
+        planner.get_spline_deriv(spline_ts[k], 2, seconds[k]);
+        speeds_squared[k] = max_speed_squared(k);
+    }
+
+    // Speed up as hard as possible from rest. Where the fastest speed drops,
+    // this stays at it and leaves slowing down in time to the backward pass.
+    double lowest, highest;
+    speeds_squared[0] = 0.0;
+    for (size_t k = 0; k < TRAJECTORY_STEPS; ++k) {
+        double accel = acceleration_bounds(k, speeds_squared[k], lowest, highest) ? std::max(highest, 0.0) : 0.0;
+        speeds_squared[k + 1] = std::min(speeds_squared[k + 1], speeds_squared[k] + 2.0 * accel * ds);
+    }
+
+    // slow down as hard as allowed to stop at the end
+    speeds_squared[TRAJECTORY_STEPS] = 0.0;
+    for (size_t k = TRAJECTORY_STEPS; k > 0; --k) {
+        double accel = acceleration_bounds(k, speeds_squared[k], lowest, highest) ? std::min(lowest, 0.0) : 0.0;
+        speeds_squared[k - 1] = std::min(speeds_squared[k - 1], speeds_squared[k] - 2.0 * accel * ds);
+    }
+
+    speeds.resize(TRAJECTORY_STEPS + 1);
+    for (size_t k = 0; k <= TRAJECTORY_STEPS; ++k) {
+        speeds[k] = std::sqrt(speeds_squared[k]);
+    }
+
+    // ds/dt changes linearly in time between points, so each step takes its
+    // length over the average of the speeds at its ends
+    times.resize(TRAJECTORY_STEPS + 1);
+    times[0] = 0.0;
+    for (size_t k = 0; k < TRAJECTORY_STEPS; ++k) {
+        double speed_sum = speeds[k] + speeds[k + 1];
+        times[k + 1] = times[k] + 2.0 * ds / std::max(speed_sum, std::numeric_limits<double>::min());
+    }
+}
+
+double Trajectory::get_duration() const {
+    return times.empty() ? 0.0 : times.back();
+}
+
+double Trajectory::get_spline_t(double time) const {
+    if (times.empty() || time <= 0.0) {
+        return 0.0;
+    }
+    if (time >= times.back()) {
+        return spline_ts.back();
+    }
+
+    size_t k = std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+    double step_time = time - times[k];
+    double accel = (speeds[k + 1] - speeds[k]) / (times[k + 1] - times[k]);
+
+    double spline_t = spline_ts[k] + speeds[k] * step_time + 0.5 * accel * step_time * step_time;
+    return std::min(spline_t, spline_ts[k + 1]);
+}
+
+double Trajectory::get_spline_speed(double time) const {
+    // the trajectory starts and ends at rest
+    if (times.empty() || time <= 0.0 || time >= times.back()) {
+        return 0.0;
+    }
+
+    size_t k = std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+    double accel = (speeds[k + 1] - speeds[k]) / (times[k + 1] - times[k]);
+    return speeds[k] + accel * (time - times[k]);
+}
+
+bool Trajectory::acceleration_bounds(size_t k, double speed_squared, double &lowest, double &highest) const {
+    lowest = -std::numeric_limits<double>::infinity();
+    highest = std::numeric_limits<double>::infinity();
+
+    for (size_t i : joints) {
+        double first = firsts[k](i);
+        double second = seconds[k](i);
+        double max_accel = max_accelerations[i];
+
+        // a joint that isn't moving along the spline accelerates only from its curve
+        if (std::abs(first) < MIN_TRAJECTORY_DERIV) {
+            if (std::abs(second) * speed_squared > max_accel) {
+                return false;
+            }
+            continue;
+        }
+
+        double low = (-max_accel - second * speed_squared) / first;
+        double high = (max_accel - second * speed_squared) / first;
+        if (first < 0.0) {
+            std::swap(low, high);
+        }
+
+        lowest = std::max(lowest, low);
+        highest = std::min(highest, high);
+    }
+
+    return lowest <= highest;
+}
+
+double Trajectory::max_speed_squared(size_t k) const {
+    double upper = MAX_TRAJECTORY_SPEED * MAX_TRAJECTORY_SPEED;
+
+    for (size_t i : joints) {
+        double first = std::abs(firsts[k](i));
+        if (first >= MIN_TRAJECTORY_DERIV) {
+            double speed = max_speeds[i] / first;
+            upper = std::min(upper, speed * speed);
+        }
+    }
+
+    double lowest, highest;
+    if (acceleration_bounds(k, upper, lowest, highest)) {
+        return upper;
+    }
+
+    // the speeds that leave some acceleration run from 0 up to the answer
+    double lower = 0.0;
+    for (int i = 0; i < TRAJECTORY_BISECTION_STEPS; ++i) {
+        double middle = 0.5 * (lower + upper);
+        if (acceleration_bounds(k, middle, lowest, highest)) {
+            lower = middle;
+        }
+        else {
+            upper = middle;
+        }
+    }
+
+    return lower;
+}
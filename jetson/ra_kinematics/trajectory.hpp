@@ -0,0 +1,85 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <vector>
+
+#include "arm_state.hpp"
+#include "motion_planner.hpp"
+
+// Intervals the spline is split into when timing it
+static constexpr size_t TRAJECTORY_STEPS = 500;
+
+// Bisection steps to find the fastest speed along the spline at one point
+static constexpr int TRAJECTORY_BISECTION_STEPS = 50;
+
+// Most of the spline covered per second, the limit for joints that barely move
+static constexpr double MAX_TRAJECTORY_SPEED = 1000.0;
+
+/**
+ * Times the planned spline so it is driven as fast as each unlocked joint's
+ * max speed and max acceleration allow, starting and ending at rest.
+ *
+ * The spline is a path q(s) for s from 0 to 1. Along it, each joint moves at
+ * q'(s) * ds/dt and accelerates at q'(s) * d2s/dt2 + q''(s) * (ds/dt)^2, so the
+ * limits bound ds/dt and d2s/dt2 at every s. The fastest (ds/dt)^2 at each point
+ * is found first, then a forward pass speeds up as hard as it can from the start
+ * and a backward pass slows down as hard as it has to before the end.
+ * */
+class Trajectory {
+private:
+
+    // times[k] in seconds is when spline_t reaches spline_ts[k], moving at
+    // speeds[k] per second. Between points d2s/dt2 is constant
+    std::vector<double> times;
+    std::vector<double> spline_ts;
+    std::vector<double> speeds;
+
+    // first and second derivatives of each joint's angle at each of spline_ts
+    std::vector<Vector6d> firsts;
+    std::vector<Vector6d> seconds;
+
+    // the joints that move, with their limits by joint index
+    std::vector<size_t> joints;
+    std::vector<double> max_speeds;
+    std::vector<double> max_accelerations;
+
+    /**
+     * Finds the range of d2s/dt2 that keeps every joint within its max
+     * acceleration at point k when (ds/dt)^2 is speed_squared
+     * @return false if there is none
+     * */
+    bool acceleration_bounds(size_t k, double speed_squared, double &lowest, double &highest) const;
+
+    /**
+     * @return the largest (ds/dt)^2 at point k within the joints' max speeds that
+     * leaves some d2s/dt2 within their max accelerations
+     * */
+    double max_speed_squared(size_t k) const;
+
+public:
+
+    /**
+     * Times the splines last fit by planner
+     * @param robot the joint limits and locks to time the splines for
+     * */
+    void parameterize(MotionPlanner &planner, const ArmState &robot);
+
+    /**
+     * @return the seconds it takes to drive the whole spline
+     * */
+    double get_duration() const;
+
+    /**
+     * @param time seconds since the start of the trajectory
+     * @return how far along the spline the arm should be at time, between 0 and 1
+     * */
+    double get_spline_t(double time) const;
+
+    /**
+     * @param time seconds since the start of the trajectory
+     * @return how fast the arm should be moving along the spline at time, per second
+     * */
+    double get_spline_speed(double time) const;
+};
+
+#endif
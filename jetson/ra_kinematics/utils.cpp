@@ -13,6 +13,21 @@ std::string get_mrover_arm_geom() {
     return config_folder + "/config_kinematics/mrover_arm_geom.json";
 }
 
+std::string get_mrover_arm_collision_map() {
+    std::string config_folder = getenv("MROVER_CONFIG");
+    return config_folder + "/config_kinematics/mrover_arm_collision_map.bin";
+}
+
+std::string get_mrover_arm_reachability_map() {
+    std::string config_folder = getenv("MROVER_CONFIG");
+    return config_folder + "/config_kinematics/mrover_arm_reachability_map.bin";
+}
+
+std::string get_mrover_arm_motion_lattice() {
+    std::string config_folder = getenv("MROVER_CONFIG");
+    return config_folder + "/config_kinematics/mrover_arm_motion_lattice.bin";
+}
+
 json read_json_from_file(const std::string &filepath) {
     std::ifstream file(filepath);
 
@@ -122,6 +137,15 @@ Vector3d compute_euler_angles(const Matrix3d &rotation_matrix) {
     return Vector3d(alpha, beta, gamma);
 }
 
+Matrix3d compute_rotation_matrix(const Vector3d &euler_angles) {
+    // compute_euler_angles() reads the angles of Rz(alpha) * Rx(beta) * Rz(gamma)
+    Matrix3d rotation_matrix;
+    rotation_matrix = AngleAxisd(euler_angles(0), Vector3d::UnitZ())
+                      * AngleAxisd(euler_angles(1), Vector3d::UnitX())
+                      * AngleAxisd(euler_angles(2), Vector3d::UnitZ());
+    return rotation_matrix;
+}
+
 double degrees_to_radians(double degrees) {
     return degrees * 2 * acos(0.0) / 180;
 }
@@ -168,3 +192,9 @@ std::vector<double> vector6dToVec(const Vector6d &inVector6d) {
     }
     return retVec;
 }
+
+void fingerprint_add(uint64_t &hash, const Vector3d &vec) {
+    for (int i = 0; i < 3; ++i) {
+        fingerprint_add(hash, vec(i));
+    }
+}
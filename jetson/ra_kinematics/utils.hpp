@@ -4,6 +4,8 @@
 #include "nlohmann/json.hpp"
 #include <eigen3/Eigen/Dense>
 
+#include <cstdint>
+
 using namespace nlohmann;
 using namespace Eigen;
 
@@ -12,6 +14,21 @@ typedef Matrix<double, 6, 1> Vector6d;
 
 std::string get_mrover_arm_geom();
 
+/**
+ * @return where `$ make collision_map` writes the collision map for the geometry
+ * */
+std::string get_mrover_arm_collision_map();
+
+/**
+ * @return where `$ make reachability_map` writes the reachability map for the geometry
+ * */
+std::string get_mrover_arm_reachability_map();
+
+/**
+ * @return where `$ make motion_lattice` writes the motion lattice for the geometry
+ * */
+std::string get_mrover_arm_motion_lattice();
+
 json read_json_from_file(const std::string &filepath);
 
 double point_line_distance(const Vector3d &end1, const Vector3d &end2, const Vector3d &point);
@@ -20,6 +37,11 @@ double closest_dist_bet_lines(const Vector3d &a0, const Vector3d &a1, const Vect
 
 Vector3d compute_euler_angles(const Matrix3d &xform_mat);
 
+/**
+ * Inverse of compute_euler_angles(), builds the rotation matrix of z-x-z euler angles
+ * */
+Matrix3d compute_rotation_matrix(const Vector3d &euler_angles);
+
 double degrees_to_radians(double degrees);
 
 double radians_to_degrees(double radians);
@@ -36,4 +58,22 @@ Vector6d vecTo6d(const std::vector<double> &inVec);
 
 std::vector<double> vector6dToVec(const Vector6d &inVector6d);
 
+// Start of a fingerprint_add() hash
+static constexpr uint64_t FINGERPRINT_BASIS = 0xcbf29ce484222325ULL;
+
+/**
+ * 64 bit FNV-1a, folded over the bytes of value. Precomputed maps
+ * fingerprint the geometry they were made for this way
+ * */
+template <typename T>
+void fingerprint_add(uint64_t &hash, const T &value) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+void fingerprint_add(uint64_t &hash, const Vector3d &vec);
+
 #endif
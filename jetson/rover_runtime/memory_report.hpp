@@ -0,0 +1,102 @@
+#ifndef ROVER_MEMORY_REPORT_HPP
+#define ROVER_MEMORY_REPORT_HPP
+
+#include "memory_stats.hpp"
+#include "rover_runtime.hpp"
+#include "rover_msgs/ProcessMemory.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <lcm/lcm-cpp.hpp>
+
+// Sends a component's MemoryStats::snapshot() as a rover_msgs::ProcessMemory
+// on /memory/<component> every period, so growth over a mission and
+// allocation regressions show up in a log of the run instead of in the
+// rover slowing down.
+//
+// Only uses LCM from the components' side, like Readiness, so it is kept
+// to this header.
+class MemoryReport
+{
+public:
+    // Starts sending component's memory usage from the memory thread of
+    // threads.
+    MemoryReport( const ThreadConfig& threads, const std::string& component,
+                  std::chrono::milliseconds period = std::chrono::milliseconds( 1000 ) )
+        : mChannel( "/memory/" + component )
+        , mComponent( component )
+        , mPeriod( period )
+        , mStop( false )
+    {
+        mSender = threads.spawn( "memory", [this]() { send(); } );
+    } // MemoryReport()
+
+    ~MemoryReport()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+            mStop = true;
+        }
+        mCondition.notify_all();
+        mSender.join();
+    } // ~MemoryReport()
+
+    MemoryReport( const MemoryReport& ) = delete;
+
+    MemoryReport& operator=( const MemoryReport& ) = delete;
+
+private:
+    void send()
+    {
+        lcm::LCM lcm;
+        rover_msgs::ProcessMemory message;
+        message.module = mComponent;
+
+        std::unique_lock<std::mutex> lock( mMutex );
+        while( !mCondition.wait_for( lock, mPeriod, [this]() { return mStop; } ) )
+        {
+            lock.unlock();
+            const MemoryStats::Snapshot snapshot = MemoryStats::snapshot();
+            message.rss_bytes = snapshot.rssBytes;
+            message.peak_rss_bytes = snapshot.peakRssBytes;
+            message.heap_in_use_bytes = snapshot.heapInUseBytes;
+            message.heap_free_bytes = snapshot.heapFreeBytes;
+            message.heap_mmap_bytes = snapshot.heapMmapBytes;
+            message.threads.resize( snapshot.threads.size() );
+            for( size_t i = 0; i < snapshot.threads.size(); ++i )
+            {
+                const MemoryStats::ThreadAllocations& from = snapshot.threads[ i ];
+                rover_msgs::ThreadAllocations& to = message.threads[ i ];
+                to.thread = from.name;
+                to.tid = from.tid;
+                to.allocations = from.allocations;
+                to.frees = from.frees;
+                to.allocated_bytes = from.allocatedBytes;
+                to.freed_bytes = from.freedBytes;
+            }
+            message.num_threads = message.threads.size();
+            lcm.publish( mChannel, &message );
+            lock.lock();
+        }
+    } // send()
+
+    const std::string mChannel;
+
+    const std::string mComponent;
+
+    const std::chrono::milliseconds mPeriod;
+
+    std::mutex mMutex;
+
+    std::condition_variable mCondition;
+
+    bool mStop;
+
+    std::thread mSender;
+};
+
+#endif // ROVER_MEMORY_REPORT_HPP
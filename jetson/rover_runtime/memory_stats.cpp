@@ -0,0 +1,318 @@
+#include "memory_stats.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    // Threads counted on their own at once. Any more share one set of
+    // counters, reported with the exited threads.
+    const size_t MAX_THREADS = 256;
+
+    struct Counters
+    {
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> allocatedBytes;
+        std::atomic<uint64_t> freedBytes;
+    };
+
+    // Everything here is zero or constant initialized, so it is ready for
+    // allocations made before any constructor runs.
+    struct Slot
+    {
+        Counters counts;
+        bool used;
+        pthread_t thread;
+        long tid;
+    };
+
+    Slot gSlots[ MAX_THREADS ];
+
+    // What the threads that exited allocated, and the threads that got no
+    // slot.
+    Counters gExited;
+    Counters gShared;
+
+    // Guards claiming and letting go of slots, and reading them.
+    std::mutex gRegistryMutex;
+
+    pthread_once_t gKeyOnce = PTHREAD_ONCE_INIT;
+    pthread_key_t gKey;
+
+    // Initial exec, so reaching a thread's counters never allocates.
+    __attribute__( ( tls_model( "initial-exec" ) ) ) thread_local Counters* tCounters = nullptr;
+    __attribute__( ( tls_model( "initial-exec" ) ) ) thread_local bool tRegistering = false;
+
+    void add( Counters& to, const Counters& from )
+    {
+        to.allocations.fetch_add( from.allocations.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        to.frees.fetch_add( from.frees.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        to.allocatedBytes.fetch_add( from.allocatedBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        to.freedBytes.fetch_add( from.freedBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    } // add()
+
+    // Runs as a thread exits, folding its counts into the exited ones
+    // and freeing its slot.
+    void releaseSlot( void* value )
+    {
+        Slot* slot = static_cast<Slot*>( value );
+        {
+            std::lock_guard<std::mutex> lock( gRegistryMutex );
+            add( gExited, slot->counts );
+            slot->used = false;
+        }
+        // Anything the rest of the thread's exit frees
+        tCounters = &gShared;
+    } // releaseSlot()
+
+    void createKey()
+    {
+        pthread_key_create( &gKey, releaseSlot );
+    } // createKey()
+
+    Counters* registerThread()
+    {
+        pthread_once( &gKeyOnce, createKey );
+        Slot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock( gRegistryMutex );
+            for( size_t i = 0; i < MAX_THREADS && !slot; ++i )
+            {
+                if( !gSlots[ i ].used )
+                {
+                    slot = &gSlots[ i ];
+                }
+            }
+            if( !slot )
+            {
+                return &gShared;
+            }
+            slot->counts.allocations.store( 0, std::memory_order_relaxed );
+            slot->counts.frees.store( 0, std::memory_order_relaxed );
+            slot->counts.allocatedBytes.store( 0, std::memory_order_relaxed );
+            slot->counts.freedBytes.store( 0, std::memory_order_relaxed );
+            slot->used = true;
+            slot->thread = pthread_self();
+            slot->tid = static_cast<long>( syscall( SYS_gettid ) );
+        }
+        pthread_setspecific( gKey, slot );
+        return &slot->counts;
+    } // registerThread()
+
+    // The calling thread's counters, claiming it a slot the first time.
+    Counters& counters()
+    {
+        if( !tCounters )
+        {
+            // Whatever registering allocates goes to the shared counters
+            if( tRegistering )
+            {
+                return gShared;
+            }
+            tRegistering = true;
+            tCounters = registerThread();
+            tRegistering = false;
+        }
+        return *tCounters;
+    } // counters()
+
+    // Only the owning thread writes its counters, so a load and a store
+    // do without a locked add.
+    void bump( std::atomic<uint64_t>& counter, uint64_t by )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + by, std::memory_order_relaxed );
+    } // bump()
+
+    void* allocate( size_t size )
+    {
+        void* pointer;
+        while( ( pointer = malloc( size ? size : 1 ) ) == nullptr )
+        {
+            std::new_handler handler = std::get_new_handler();
+            if( !handler )
+            {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+
+        Counters& counts = counters();
+        if( &counts == &gShared )
+        {
+            counts.allocations.fetch_add( 1, std::memory_order_relaxed );
+            counts.allocatedBytes.fetch_add( malloc_usable_size( pointer ), std::memory_order_relaxed );
+        }
+        else
+        {
+            bump( counts.allocations, 1 );
+            bump( counts.allocatedBytes, malloc_usable_size( pointer ) );
+        }
+        return pointer;
+    } // allocate()
+
+    void deallocate( void* pointer )
+    {
+        if( !pointer )
+        {
+            return;
+        }
+
+        Counters& counts = counters();
+        if( &counts == &gShared )
+        {
+            counts.frees.fetch_add( 1, std::memory_order_relaxed );
+            counts.freedBytes.fetch_add( malloc_usable_size( pointer ), std::memory_order_relaxed );
+        }
+        else
+        {
+            bump( counts.frees, 1 );
+            bump( counts.freedBytes, malloc_usable_size( pointer ) );
+        }
+        free( pointer );
+    } // deallocate()
+
+    MemoryStats::ThreadAllocations read( const Counters& counts )
+    {
+        MemoryStats::ThreadAllocations allocations;
+        allocations.tid = 0;
+        allocations.allocations = counts.allocations.load( std::memory_order_relaxed );
+        allocations.frees = counts.frees.load( std::memory_order_relaxed );
+        allocations.allocatedBytes = counts.allocatedBytes.load( std::memory_order_relaxed );
+        allocations.freedBytes = counts.freedBytes.load( std::memory_order_relaxed );
+        return allocations;
+    } // read()
+} // namespace
+
+void* operator new( size_t size )
+{
+    return allocate( size );
+}
+
+void* operator new[]( size_t size )
+{
+    return allocate( size );
+}
+
+void* operator new( size_t size, const std::nothrow_t& ) noexcept
+{
+    try
+    {
+        return allocate( size );
+    }
+    catch( ... )
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept
+{
+    try
+    {
+        return allocate( size );
+    }
+    catch( ... )
+    {
+        return nullptr;
+    }
+}
+
+void operator delete( void* pointer ) noexcept
+{
+    deallocate( pointer );
+}
+
+void operator delete[]( void* pointer ) noexcept
+{
+    deallocate( pointer );
+}
+
+void operator delete( void* pointer, size_t ) noexcept
+{
+    deallocate( pointer );
+}
+
+void operator delete[]( void* pointer, size_t ) noexcept
+{
+    deallocate( pointer );
+}
+
+void operator delete( void* pointer, const std::nothrow_t& ) noexcept
+{
+    deallocate( pointer );
+}
+
+void operator delete[]( void* pointer, const std::nothrow_t& ) noexcept
+{
+    deallocate( pointer );
+}
+
+MemoryStats::Snapshot MemoryStats::snapshot()
+{
+    Snapshot snapshot;
+    snapshot.threads.reserve( MAX_THREADS + 1 );
+
+    // Registers the calling thread now, while it doesn't hold the
+    // registry lock
+    counters();
+
+    const long pageSize = sysconf( _SC_PAGESIZE );
+    long residentPages = 0;
+    FILE* statm = fopen( "/proc/self/statm", "r" );
+    if( statm )
+    {
+        if( fscanf( statm, "%*s %ld", &residentPages ) != 1 )
+        {
+            residentPages = 0;
+        }
+        fclose( statm );
+    }
+    snapshot.rssBytes = int64_t( residentPages ) * pageSize;
+
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    snapshot.peakRssBytes = int64_t( usage.ru_maxrss ) * 1024;
+
+#if defined( __GLIBC__ ) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 33 ) )
+    struct mallinfo2 info = mallinfo2();
+#else
+    // Its counts are ints, which wrap past 2 GB
+    struct mallinfo info = mallinfo();
+#endif
+    snapshot.heapInUseBytes = int64_t( info.uordblks ) + int64_t( info.hblkhd );
+    snapshot.heapFreeBytes = int64_t( info.fordblks );
+    snapshot.heapMmapBytes = int64_t( info.hblkhd );
+
+    std::lock_guard<std::mutex> lock( gRegistryMutex );
+    for( const Slot& slot : gSlots )
+    {
+        if( !slot.used )
+        {
+            continue;
+        }
+        // A thread keeps its slot until it is exiting, which takes the
+        // lock, so it is still there to ask for its name.
+        char name[ 16 ] = "";
+        pthread_getname_np( slot.thread, name, sizeof( name ) );
+        snapshot.threads.push_back( read( slot.counts ) );
+        snapshot.threads.back().name = name;
+        snapshot.threads.back().tid = slot.tid;
+    }
+
+    Counters exited{};
+    add( exited, gExited );
+    add( exited, gShared );
+    snapshot.threads.push_back( read( exited ) );
+    snapshot.threads.back().name = "exited";
+    return snapshot;
+} // snapshot()
@@ -0,0 +1,59 @@
+#ifndef ROVER_MEMORY_STATS_HPP
+#define ROVER_MEMORY_STATS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap usage of the process, for catching components that grow over a
+// mission and allocations that creep into hot loops. Linking
+// rover_runtime replaces the global operator new and delete with ones
+// that count, per thread, the allocations and bytes that go through
+// them, so every component that links it is counted from its first
+// allocation. Counting is a few relaxed atomic adds to counters only
+// the allocating thread writes, and never locks after a thread's first
+// allocation.
+//
+// Only operator new and delete are counted per thread. Memory allocated
+// with malloc directly, such as by C libraries or OpenCV, and over-aligned
+// operator new still shows up in the allocator's totals.
+namespace MemoryStats
+{
+    // What one thread allocated and freed through operator new and delete
+    // since it started.
+    struct ThreadAllocations
+    {
+        // Its name as top -H shows it, "exited" for every thread that has
+        // exited, added up.
+        std::string name;
+        long tid;
+        uint64_t allocations;
+        uint64_t frees;
+        uint64_t allocatedBytes;
+        uint64_t freedBytes;
+    };
+
+    struct Snapshot
+    {
+        // Resident set size now and at its highest since startup.
+        int64_t rssBytes;
+        int64_t peakRssBytes;
+
+        // From malloc: the bytes handed out and not freed, including
+        // blocks too big for its arenas, the bytes it holds but has
+        // free, and the bytes of those big blocks, which it maps on their
+        // own.
+        int64_t heapInUseBytes;
+        int64_t heapFreeBytes;
+        int64_t heapMmapBytes;
+
+        std::vector<ThreadAllocations> threads;
+    };
+
+    // Reads the process's memory usage and every live thread's
+    // allocations, with those of the threads that exited folded into one
+    // entry at the end.
+    Snapshot snapshot();
+} // namespace MemoryStats
+
+#endif // ROVER_MEMORY_STATS_HPP
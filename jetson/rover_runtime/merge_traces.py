@@ -0,0 +1,46 @@
+#!/usr/bin/python3
+# Merges the trace files the jetson components write to MROVER_TRACE_DIR
+# into one trace for ui.perfetto.dev or chrome://tracing.
+#
+#     python3 merge_traces.py $MROVER_TRACE_DIR merged.json
+#
+# Every component stamps its events with the same monotonic clock, so the
+# events are concatenated as they are. Files of processes that were killed
+# end without closing their array, which is fixed up here.
+import glob
+import json
+import os
+import sys
+
+
+def read_events(path):
+    with open(path, 'r') as f:
+        text = f.read().strip()
+    if not text:
+        return []
+    if not text.endswith(']'):
+        text = text.rstrip(',') + ']'
+    try:
+        return json.loads(text)
+    except ValueError:
+        # killed partway through writing an event, drop the partial one
+        text = text[:text.rfind('\n')].rstrip(',') + ']'
+        return json.loads(text)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('usage: merge_traces.py <trace folder> <output file>')
+        sys.exit(1)
+
+    events = []
+    for path in sorted(glob.glob(os.path.join(sys.argv[1], '*.json'))):
+        events += read_events(path)
+
+    with open(sys.argv[2], 'w') as f:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
+    print('merged {} events into {}'.format(len(events), sys.argv[2]))
+
+
+if __name__ == '__main__':
+    main()
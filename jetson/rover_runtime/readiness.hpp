@@ -0,0 +1,126 @@
+#ifndef ROVER_READINESS_HPP
+#define ROVER_READINESS_HPP
+
+#include "rover_runtime.hpp"
+#include "rover_msgs/Heartbeat.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <lcm/lcm-cpp.hpp>
+
+// Where a component is in its startup, sent as a rover_msgs::Heartbeat on
+// /heartbeat/<component> as soon as it changes and every period
+// otherwise, so the components that depend on it and the base station
+// can tell when it is up instead of guessing. A component is STARTING
+// until everything it needs to do its job is set up, then READY, or
+// FAILED if something it can't run without couldn't be set up.
+//
+// Only uses LCM from the components' side, so it is kept to this header
+// and rover_runtime itself doesn't link LCM.
+class Readiness
+{
+public:
+    // Starts sending component's state from the heartbeat thread of
+    // threads.
+    Readiness( const ThreadConfig& threads, const std::string& component,
+               std::chrono::milliseconds period = std::chrono::milliseconds( 500 ) )
+        : mChannel( "/heartbeat/" + component )
+        , mComponent( component )
+        , mPeriod( period )
+        , mState( rover_msgs::Heartbeat::STARTING )
+        , mChanged( true )
+        , mStop( false )
+    {
+        mSender = threads.spawn( "heartbeat", [this]() { send(); } );
+    } // Readiness()
+
+    ~Readiness()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+            mStop = true;
+        }
+        mCondition.notify_all();
+        mSender.join();
+    } // ~Readiness()
+
+    Readiness( const Readiness& ) = delete;
+
+    Readiness& operator=( const Readiness& ) = delete;
+
+    void ready()
+    {
+        set( rover_msgs::Heartbeat::READY );
+    } // ready()
+
+    void failed()
+    {
+        set( rover_msgs::Heartbeat::FAILED );
+    } // failed()
+
+private:
+    void set( int8_t state )
+    {
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+            mChanged = mChanged || state != mState;
+            mState = state;
+        }
+        mCondition.notify_all();
+    } // set()
+
+    void send()
+    {
+        lcm::LCM lcm;
+        rover_msgs::Heartbeat heartbeat;
+        heartbeat.recv_ack_id = 0;
+        heartbeat.new_ack_id = 0;
+        heartbeat.module = mComponent;
+
+        std::unique_lock<std::mutex> lock( mMutex );
+        while( true )
+        {
+            mCondition.wait_for( lock, mPeriod, [this]() { return mStop || mChanged; } );
+            // A state set right before stopping, such as FAILED on the
+            // way out, is still sent.
+            if( mStop && !mChanged )
+            {
+                break;
+            }
+            mChanged = false;
+            heartbeat.state = mState;
+
+            // Not holding the lock while publishing keeps set() from
+            // waiting on the network.
+            lock.unlock();
+            lcm.publish( mChannel, &heartbeat );
+            lock.lock();
+        }
+    } // send()
+
+    const std::string mChannel;
+
+    const std::string mComponent;
+
+    const std::chrono::milliseconds mPeriod;
+
+    std::mutex mMutex;
+
+    std::condition_variable mCondition;
+
+    int8_t mState;
+
+    // Whether the state changed since it was last sent.
+    bool mChanged;
+
+    bool mStop;
+
+    std::thread mSender;
+};
+
+#endif // ROVER_READINESS_HPP
@@ -0,0 +1,148 @@
+#include "rover_runtime.hpp"
+#include "config_loader.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    // Niceness of background threads that don't set their own.
+    const int BACKGROUND_NICENESS = 10;
+
+    // Linux keeps 15 characters of a thread's name.
+    const size_t MAX_THREAD_NAME = 15;
+} // namespace
+
+ThreadPolicy::ThreadPolicy()
+    : rtPriority( 0 )
+    , niceness( 0 )
+{
+} // ThreadPolicy()
+
+bool applyThreadPolicy( const ThreadPolicy& policy )
+{
+    bool applied = true;
+    if( !policy.name.empty() )
+    {
+        pthread_setname_np( pthread_self(), policy.name.substr( 0, MAX_THREAD_NAME ).c_str() );
+    }
+
+    if( !policy.cores.empty() )
+    {
+        cpu_set_t cores;
+        CPU_ZERO( &cores );
+        for( int core : policy.cores )
+        {
+            CPU_SET( core, &cores );
+        }
+        const int error = pthread_setaffinity_np( pthread_self(), sizeof( cores ), &cores );
+        if( error != 0 )
+        {
+            std::cerr << "Could not pin " << policy.name << " to its cores: " << strerror( error ) << "\n";
+            applied = false;
+        }
+    }
+
+    if( policy.rtPriority > 0 )
+    {
+        sched_param param;
+        param.sched_priority = policy.rtPriority;
+        const int error = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+        if( error != 0 )
+        {
+            std::cerr << "Could not give " << policy.name << " real-time priority, running it normally: "
+                      << strerror( error ) << "\n";
+            applied = false;
+        }
+    }
+    // Under the normal scheduler Linux keeps a niceness for each thread.
+    else if( policy.niceness != 0 &&
+             setpriority( PRIO_PROCESS, static_cast<id_t>( syscall( SYS_gettid ) ), policy.niceness ) != 0 )
+    {
+        std::cerr << "Could not set the niceness of " << policy.name << ": " << strerror( errno ) << "\n";
+        applied = false;
+    }
+    return applied;
+} // applyThreadPolicy()
+
+ThreadConfig::ThreadConfig( const std::string& component )
+{
+    const char* configFolder = getenv( "MROVER_CONFIG" );
+    if( !configFolder )
+    {
+        std::cerr << "MROVER_CONFIG is not set, " << component << " threads run with normal scheduling\n";
+        return;
+    }
+    const std::string path = std::string( configFolder ) + "/config_threads/config.json";
+    ConfigFile config;
+    if( !config.load( path ) || !config.IsObject() )
+    {
+        std::cerr << "Could not read " << path << ", " << component << " threads run with normal scheduling\n";
+        return;
+    }
+    if( !config.HasMember( component.c_str() ) )
+    {
+        return;
+    }
+
+    // The document's strings point into the file, so everything is copied out.
+    for( const auto& thread : config[ component.c_str() ].GetObject() )
+    {
+        ThreadPolicy policy;
+        policy.name = thread.name.GetString();
+        const rapidjson::Value& value = thread.value;
+
+        const std::string priority = value.HasMember( "priority" ) ? value[ "priority" ].GetString() : "normal";
+        if( priority == "realtime" )
+        {
+            policy.rtPriority = value.HasMember( "rtPriority" ) ? value[ "rtPriority" ].GetInt() : 1;
+        }
+        else if( priority == "background" )
+        {
+            policy.niceness = BACKGROUND_NICENESS;
+        }
+        else if( priority != "normal" )
+        {
+            std::cerr << "Unknown priority " << priority << " of " << component << " thread "
+                      << policy.name << ", running it normally\n";
+        }
+        if( value.HasMember( "niceness" ) )
+        {
+            policy.niceness = value[ "niceness" ].GetInt();
+        }
+
+        if( value.HasMember( "cores" ) )
+        {
+            for( const auto& core : value[ "cores" ].GetArray() )
+            {
+                policy.cores.push_back( core.GetInt() );
+            }
+        }
+        mPolicies[ policy.name ] = policy;
+    }
+} // ThreadConfig()
+
+ThreadPolicy ThreadConfig::policy( const std::string& name ) const
+{
+    auto it = mPolicies.find( name );
+    if( it != mPolicies.end() )
+    {
+        return it->second;
+    }
+    ThreadPolicy policy;
+    policy.name = name;
+    return policy;
+} // policy()
+
+bool ThreadConfig::apply( const std::string& name ) const
+{
+    return applyThreadPolicy( policy( name ) );
+} // apply()
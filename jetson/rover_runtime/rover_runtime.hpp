@@ -0,0 +1,74 @@
+#ifndef ROVER_RUNTIME_HPP
+#define ROVER_RUNTIME_HPP
+
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// How one thread of a component is scheduled.
+struct ThreadPolicy
+{
+    ThreadPolicy();
+
+    // Shown by top -H, perf and gdb, cut to the 15 characters Linux keeps.
+    std::string name;
+
+    // SCHED_FIFO priority from 1 to 99, or 0 for the normal scheduler.
+    int rtPriority;
+
+    // Nice value under the normal scheduler, higher for background work.
+    int niceness;
+
+    // Cores the thread may run on, any if empty.
+    std::vector<int> cores;
+};
+
+// Names the calling thread and applies the rest of policy to it. Whatever
+// the process isn't allowed to, such as real-time scheduling without the
+// permission for it, is reported and skipped, and the thread runs on as
+// it was. Returns false if anything was skipped.
+bool applyThreadPolicy( const ThreadPolicy& policy );
+
+// The thread policies of one component, from its section of
+// $MROVER_CONFIG/config_threads/config.json, which lays out every
+// component's threads on the Jetson's cores in one place. A section
+// looks like
+//
+//     "ra_kinematics": {
+//         "execute_spline": { "priority": "realtime", "rtPriority": 50, "cores": [ 5 ] },
+//         "path_planner": { "priority": "background" }
+//     }
+//
+// where priority is realtime, normal or background, rtPriority only
+// applies to realtime threads and niceness overrides the background
+// default of 10. Threads missing from the file run as normal threads on
+// any core.
+class ThreadConfig
+{
+public:
+    // Reads component's section, reporting a missing or invalid file.
+    explicit ThreadConfig( const std::string& component );
+
+    ThreadPolicy policy( const std::string& name ) const;
+
+    // Applies name's policy to the calling thread, such as main.
+    bool apply( const std::string& name ) const;
+
+    // Starts a thread that applies name's policy and then calls func.
+    template <typename Function>
+    std::thread spawn( const std::string& name, Function func ) const
+    {
+        ThreadPolicy threadPolicy = policy( name );
+        return std::thread( [threadPolicy, func]() mutable
+        {
+            applyThreadPolicy( threadPolicy );
+            func();
+        } );
+    }
+
+private:
+    std::unordered_map<std::string, ThreadPolicy> mPolicies;
+};
+
+#endif // ROVER_RUNTIME_HPP
@@ -0,0 +1,349 @@
+#include "trace.hpp"
+#include "thor_ring.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    // Events a thread can record before the writer gets to them. Each
+    // traced thread keeps this many, 32 bytes apiece.
+    const size_t RING_SIZE = 4096;
+
+    // How often the writer drains the threads' rings, which is also how
+    // much of the end of a trace is lost if the process is killed.
+    const std::chrono::milliseconds FLUSH_INTERVAL( 100 );
+
+    struct Event
+    {
+        char phase;
+        const char* name;
+        int64_t timestamp;
+
+        // Duration of a span, value of a counter or id of a flow.
+        int64_t arg;
+    };
+
+    struct ThreadBuffer
+    {
+        ThreadBuffer()
+            : tid( static_cast<long>( syscall( SYS_gettid ) ) )
+            , dropped( 0 )
+            , alive( true )
+            , reportedDropped( 0 )
+            , named( false )
+        {
+            // Threads started through ThreadConfig are named before they
+            // run anything that traces.
+            name[ 0 ] = '\0';
+            pthread_getname_np( pthread_self(), name, sizeof( name ) );
+        } // ThreadBuffer()
+
+        Thor::SpscRing<Event, RING_SIZE> events;
+        long tid;
+        char name[ 16 ];
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool> alive;
+
+        // Only touched by the writer.
+        uint64_t reportedDropped;
+        bool named;
+    };
+
+    // Marks the thread's buffer for the writer to let go of once the
+    // thread exits and the writer has drained it.
+    struct BufferHolder
+    {
+        ~BufferHolder()
+        {
+            if( buffer )
+            {
+                buffer->alive.store( false, std::memory_order_release );
+            }
+        } // ~BufferHolder()
+
+        std::shared_ptr<ThreadBuffer> buffer;
+    };
+
+    class TraceWriter
+    {
+    public:
+        TraceWriter()
+            : mFile( nullptr )
+            , mPid( static_cast<int>( getpid() ) )
+            , mFirst( true )
+            , mStopping( false )
+        {
+        } // TraceWriter()
+
+        bool start( const std::string& component )
+        {
+            std::unique_lock<std::mutex> lock( mMutex );
+            if( mFile )
+            {
+                return true;
+            }
+            const char* traceFolder = getenv( "MROVER_TRACE_DIR" );
+            if( !traceFolder )
+            {
+                return false;
+            }
+            const std::string path = std::string( traceFolder ) + "/" + component + "-" + std::to_string( mPid ) + ".json";
+            mFile = fopen( path.c_str(), "w" );
+            if( !mFile )
+            {
+                std::cerr << "Could not open " << path << ", " << component << " runs without tracing\n";
+                return false;
+            }
+
+            // Perfetto and chrome://tracing read an array left open by a
+            // process that was killed, so the file is valid as it grows.
+            fputs( "[\n", mFile );
+            mFirst = true;
+            beginEvent();
+            fprintf( mFile, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":", mPid );
+            writeString( component.c_str() );
+            fputs( "}}", mFile );
+
+            mStopping = false;
+            mThread = std::thread( &TraceWriter::run, this );
+            Trace::detail::gEnabled.store( true, std::memory_order_release );
+            return true;
+        } // start()
+
+        void stop()
+        {
+            Trace::detail::gEnabled.store( false, std::memory_order_release );
+            {
+                std::unique_lock<std::mutex> lock( mMutex );
+                if( !mFile || mStopping )
+                {
+                    return;
+                }
+                mStopping = true;
+            }
+            mWake.notify_all();
+            mThread.join();
+        } // stop()
+
+        std::shared_ptr<ThreadBuffer> add()
+        {
+            std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+            std::unique_lock<std::mutex> lock( mMutex );
+            mBuffers.push_back( buffer );
+            return buffer;
+        } // add()
+
+    private:
+        void run()
+        {
+            std::unique_lock<std::mutex> lock( mMutex );
+            while( !mStopping )
+            {
+                mWake.wait_for( lock, FLUSH_INTERVAL, [this]() { return mStopping; } );
+                drain();
+            }
+            fputs( "\n]\n", mFile );
+            fclose( mFile );
+            mFile = nullptr;
+        } // run()
+
+        // Called with mMutex held.
+        void drain()
+        {
+            for( auto it = mBuffers.begin(); it != mBuffers.end(); )
+            {
+                ThreadBuffer& buffer = **it;
+                // Read first, so whatever the thread recorded before exiting is drained
+                const bool alive = buffer.alive.load( std::memory_order_acquire );
+                if( !buffer.named && buffer.name[ 0 ] != '\0' )
+                {
+                    beginEvent();
+                    fprintf( mFile, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":",
+                             mPid, buffer.tid );
+                    writeString( buffer.name );
+                    fputs( "}}", mFile );
+                    buffer.named = true;
+                }
+
+                Event event;
+                while( buffer.events.try_pop( event ) )
+                {
+                    writeEvent( buffer.tid, event );
+                }
+
+                const uint64_t dropped = buffer.dropped.load( std::memory_order_relaxed );
+                if( dropped != buffer.reportedDropped )
+                {
+                    Event droppedEvent = { 'C', "trace dropped events", Trace::detail::now(), static_cast<int64_t>( dropped ) };
+                    writeEvent( buffer.tid, droppedEvent );
+                    buffer.reportedDropped = dropped;
+                }
+
+                it = alive ? it + 1 : mBuffers.erase( it );
+            }
+            fflush( mFile );
+        } // drain()
+
+        void writeEvent( long tid, const Event& event )
+        {
+            beginEvent();
+            fprintf( mFile, "{\"ph\":\"%c\",\"pid\":%d,\"tid\":%ld,\"ts\":", event.phase, mPid, tid );
+            writeMicroseconds( event.timestamp );
+            switch( event.phase )
+            {
+                case 'X':
+                    fputs( ",\"dur\":", mFile );
+                    writeMicroseconds( event.arg );
+                    break;
+
+                case 'C':
+                    fprintf( mFile, ",\"args\":{\"value\":%" PRId64 "}", event.arg );
+                    break;
+
+                case 'i':
+                    fputs( ",\"s\":\"t\"", mFile );
+                    break;
+
+                // Flows are matched on category, name and id across
+                // every process in the trace
+                case 's':
+                case 'f':
+                    fprintf( mFile, ",\"cat\":\"lcm\",\"name\":\"message\",\"id\":\"0x%" PRIx64 "\"",
+                             static_cast<uint64_t>( event.arg ) );
+                    if( event.phase == 'f' )
+                    {
+                        // ends on the span it is recorded in, not the next one
+                        fputs( ",\"bp\":\"e\"", mFile );
+                    }
+                    break;
+            }
+            if( event.name )
+            {
+                fputs( ",\"name\":", mFile );
+                writeString( event.name );
+            }
+            fputc( '}', mFile );
+        } // writeEvent()
+
+        void beginEvent()
+        {
+            if( !mFirst )
+            {
+                fputs( ",\n", mFile );
+            }
+            mFirst = false;
+        } // beginEvent()
+
+        void writeMicroseconds( int64_t nanoseconds )
+        {
+            fprintf( mFile, "%" PRId64 ".%03" PRId64, nanoseconds / 1000, nanoseconds % 1000 );
+        } // writeMicroseconds()
+
+        void writeString( const char* str )
+        {
+            fputc( '"', mFile );
+            for( ; *str; ++str )
+            {
+                if( *str == '"' || *str == '\\' )
+                {
+                    fputc( '\\', mFile );
+                }
+                fputc( *str, mFile );
+            }
+            fputc( '"', mFile );
+        } // writeString()
+
+        std::mutex mMutex;
+        std::condition_variable mWake;
+        std::thread mThread;
+        std::vector<std::shared_ptr<ThreadBuffer>> mBuffers;
+        FILE* mFile;
+        int mPid;
+        bool mFirst;
+        bool mStopping;
+    };
+
+    // Never destroyed, so threads still tracing while the process exits
+    // don't outlive it.
+    TraceWriter& writer()
+    {
+        static TraceWriter* traceWriter = new TraceWriter();
+        return *traceWriter;
+    } // writer()
+
+    void stopAtExit()
+    {
+        Trace::stop();
+    } // stopAtExit()
+} // namespace
+
+namespace Trace
+{
+    namespace detail
+    {
+        std::atomic<bool> gEnabled( false );
+
+        int64_t now()
+        {
+            timespec time;
+            clock_gettime( CLOCK_MONOTONIC, &time );
+            return static_cast<int64_t>( time.tv_sec ) * 1000000000 + time.tv_nsec;
+        } // now()
+
+        void record( char phase, const char* name, int64_t timestamp, int64_t arg )
+        {
+            static thread_local BufferHolder holder;
+            if( !holder.buffer )
+            {
+                holder.buffer = writer().add();
+            }
+            Event event = { phase, name, timestamp, arg };
+            if( !holder.buffer->events.try_push( event ) )
+            {
+                holder.buffer->dropped.fetch_add( 1, std::memory_order_relaxed );
+            }
+        } // record()
+    } // namespace detail
+
+    bool start( const std::string& component )
+    {
+        static std::once_flag registered;
+        if( !writer().start( component ) )
+        {
+            return false;
+        }
+        std::call_once( registered, []() { std::atexit( stopAtExit ); } );
+        return true;
+    } // start()
+
+    void stop()
+    {
+        writer().stop();
+    } // stop()
+
+    uint64_t detail::hash( const void* data, size_t size )
+    {
+        // FNV-1a
+        const uint8_t* bytes = static_cast<const uint8_t*>( data );
+        uint64_t value = 14695981039346656037ULL;
+        for( size_t i = 0; i < size; ++i )
+        {
+            value ^= bytes[ i ];
+            value *= 1099511628211ULL;
+        }
+        return value;
+    } // hash()
+} // namespace Trace
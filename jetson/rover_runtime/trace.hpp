@@ -0,0 +1,141 @@
+#ifndef ROVER_TRACE_HPP
+#define ROVER_TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Timing of the jetson components, recorded as Chrome trace events that
+// ui.perfetto.dev and chrome://tracing open. With MROVER_TRACE_DIR set,
+// each process writes $MROVER_TRACE_DIR/<component>-<pid>.json, and
+// merge_traces.py puts the files of one run together into one trace.
+// Every process stamps its events with CLOCK_MONOTONIC, which all of
+// them on the Jetson share, so the merged trace lines up without any
+// clock syncing.
+//
+// Each thread records into a lock-free ring of its own, which a writer
+// thread drains to the file, so recording never blocks or allocates
+// after a thread's first event. A thread that outruns the writer loses
+// events and the trace counts them. With tracing off every call is a
+// relaxed load and a branch.
+//
+// Names are kept as pointers, so they have to be string literals or
+// otherwise outlive the process.
+namespace Trace
+{
+    // Starts the writer if MROVER_TRACE_DIR is set. Returns whether it did.
+    bool start( const std::string& component );
+
+    // Writes out what is left and closes the trace. Also runs at exit.
+    void stop();
+
+    namespace detail
+    {
+        extern std::atomic<bool> gEnabled;
+
+        // Nanoseconds of CLOCK_MONOTONIC.
+        int64_t now();
+
+        void record( char phase, const char* name, int64_t timestamp, int64_t arg );
+
+        uint64_t hash( const void* data, size_t size );
+    } // namespace detail
+
+    inline bool enabled()
+    {
+        return detail::gEnabled.load( std::memory_order_relaxed );
+    } // enabled()
+
+    // Time spent from construction to destruction, shown as a slice on
+    // the thread's track.
+    class Span
+    {
+    public:
+        explicit Span( const char* name )
+            : mName( name )
+            , mStart( enabled() ? detail::now() : -1 )
+        {
+        } // Span()
+
+        ~Span()
+        {
+            if( mStart >= 0 )
+            {
+                detail::record( 'X', mName, mStart, detail::now() - mStart );
+            }
+        } // ~Span()
+
+        Span( const Span& ) = delete;
+        Span& operator=( const Span& ) = delete;
+
+    private:
+        const char* mName;
+        int64_t mStart;
+    };
+
+    // A value over time, such as a queue depth, shown as its own track.
+    inline void counter( const char* name, int64_t value )
+    {
+        if( enabled() )
+        {
+            detail::record( 'C', name, detail::now(), value );
+        }
+    } // counter()
+
+    // Something that happened at one moment, such as a dropped frame.
+    inline void instant( const char* name )
+    {
+        if( enabled() )
+        {
+            detail::record( 'i', name, detail::now(), 0 );
+        }
+    } // instant()
+
+    // An arrow from the enclosing span to the span that calls flowIn with
+    // the same id, in this process or another one. Call both inside a Span.
+    inline void flowOut( uint64_t id )
+    {
+        if( enabled() )
+        {
+            detail::record( 's', nullptr, detail::now(), static_cast<int64_t>( id ) );
+        }
+    } // flowOut()
+
+    inline void flowIn( uint64_t id )
+    {
+        if( enabled() )
+        {
+            detail::record( 'f', nullptr, detail::now(), static_cast<int64_t>( id ) );
+        }
+    } // flowIn()
+
+    // Flow id of an LCM message from its encoded bytes, such as a
+    // lcm::ReceiveBuffer's, so a subscriber gets the id its publisher
+    // got without the message carrying a sequence number. Identical
+    // messages in a row share an id, so their arrows can land on the
+    // wrong one of them. Returns 0 while tracing is off.
+    inline uint64_t messageId( const void* data, size_t size )
+    {
+        return enabled() ? detail::hash( data, size ) : 0;
+    } // messageId()
+
+    // Flow id of a message about to be published, the same one its
+    // subscribers get from the receive buffer. Encodes the message, which
+    // is skipped while tracing is off.
+    template <typename Message>
+    uint64_t messageId( const Message& message )
+    {
+        if( !enabled() )
+        {
+            return 0;
+        }
+        static thread_local std::vector<uint8_t> encoded;
+        encoded.resize( static_cast<size_t>( message.getEncodedSize() ) );
+        message.encode( encoded.data(), 0, static_cast<int>( encoded.size() ) );
+        return detail::hash( encoded.data(), encoded.size() );
+    } // messageId()
+} // namespace Trace
+
+#endif // ROVER_TRACE_HPP
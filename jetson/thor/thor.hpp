@@ -0,0 +1,8 @@
+#pragma once
+
+#include "thor_wait.hpp"
+#include "thor_volatile.hpp"
+#include "thor_mailbox.hpp"
+#include "thor_ring.hpp"
+#include "thor_pool.hpp"
+#include "thor_object_pool.hpp"
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "thor_wait.hpp"
+
+namespace Thor {
+    // Latest value of a trivially copyable message, for one writer thread
+    // and any number of reader threads. Neither side ever blocks: the
+    // writer bumps a sequence number around the copy and readers retry
+    // if the sequence changed while they were copying.
+    template <typename T>
+    class SeqLock {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "SeqLock needs a trivially copyable type, use Mailbox instead");
+
+        public:
+            SeqLock() : seq_(0) {
+                this->store(T());
+            }
+
+            // Must only be called from one thread at a time.
+            void set(const T & val) {
+                uint64_t seq = this->seq_.load(std::memory_order_relaxed);
+                this->seq_.store(seq + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                this->store(val);
+                this->seq_.store(seq + 2, std::memory_order_release);
+                this->doorbell_.ring();
+            }
+
+            // Rung after every set, see wait_any_until.
+            Doorbell & doorbell() const {
+                return this->doorbell_;
+            }
+
+            // Number of times set has been called.
+            uint64_t version() const {
+                return this->seq_.load(std::memory_order_acquire) / 2;
+            }
+
+            // Returns a consistent copy of the latest value, and the
+            // version it belongs to if version is not null.
+            T get(uint64_t *version = nullptr) const {
+                T val;
+                uint64_t before;
+                uint64_t after;
+                do {
+                    before = this->seq_.load(std::memory_order_acquire);
+                    if (before & 1) {
+                        continue;
+                    }
+                    this->load(val);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    after = this->seq_.load(std::memory_order_relaxed);
+                } while ((before & 1) || before != after);
+
+                if (version) {
+                    *version = before / 2;
+                }
+                return val;
+            }
+
+        private:
+            static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+            // The value is kept in atomic words so concurrent copies are
+            // not data races, torn reads are caught by the sequence.
+            void store(const T & val) {
+                uint64_t words[WORDS] = {};
+                std::memcpy(words, &val, sizeof(T));
+                for (size_t i = 0; i < WORDS; ++i) {
+                    this->words_[i].store(words[i], std::memory_order_relaxed);
+                }
+            }
+
+            void load(T & val) const {
+                uint64_t words[WORDS];
+                for (size_t i = 0; i < WORDS; ++i) {
+                    words[i] = this->words_[i].load(std::memory_order_relaxed);
+                }
+                std::memcpy(&val, words, sizeof(T));
+            }
+
+            std::atomic<uint64_t> seq_;
+            std::array<std::atomic<uint64_t>, WORDS> words_;
+            mutable Doorbell doorbell_;
+    };
+
+    // Latest value of any message, including ones that own memory such
+    // as a Course. The writer publishes a new immutable copy by swapping
+    // a shared pointer, so readers keep whichever copy they loaded for as
+    // long as they need it and never see it change underneath them.
+    template <typename T>
+    class Mailbox {
+        public:
+            Mailbox() : val_(std::make_shared<const T>()), version_(0) {}
+
+            void set(T val) {
+                std::shared_ptr<const T> next = std::make_shared<const T>(std::move(val));
+                std::atomic_store(&this->val_, next);
+                this->version_.fetch_add(1, std::memory_order_release);
+                this->doorbell_.ring();
+            }
+
+            // Rung after every set, see wait_any_until.
+            Doorbell & doorbell() const {
+                return this->doorbell_;
+            }
+
+            // Number of times set has been called.
+            uint64_t version() const {
+                return this->version_.load(std::memory_order_acquire);
+            }
+
+            // Returns the latest value, and its version if version is not
+            // null. The value may be newer than the version but never older.
+            std::shared_ptr<const T> get(uint64_t *version = nullptr) const {
+                if (version) {
+                    *version = this->version_.load(std::memory_order_acquire);
+                }
+                return std::atomic_load(&this->val_);
+            }
+
+        private:
+            std::shared_ptr<const T> val_;
+            std::atomic<uint64_t> version_;
+            mutable Doorbell doorbell_;
+    };
+}
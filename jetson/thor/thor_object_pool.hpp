@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Thor {
+    // Objects that are expensive to build, such as frames holding image
+    // buffers, handed out and taken back instead of allocated for every
+    // use. An object comes back as its last user left it, so buffers in
+    // it keep their memory and refilling them usually doesn't allocate.
+    // Objects can be released on any thread, and the pool keeps at most
+    // max_free of them, so a burst doesn't hold on to memory for good.
+    template <typename T>
+    class ObjectPool {
+        public:
+            explicit ObjectPool(size_t max_free = 8) : state_(std::make_shared<State>(max_free)) {}
+
+            // Returns a free object, or a new one if there is none. It goes
+            // back to the pool once the last copy of the pointer is gone,
+            // which can be after the pool itself is destroyed.
+            std::shared_ptr<T> acquire() {
+                std::unique_ptr<T> obj = this->state_->take();
+                if (!obj) {
+                    obj.reset(new T());
+                }
+                return this->share(std::move(obj));
+            }
+
+            // Returns a free object assigned from prototype, which keeps
+            // the free object's memory where it can, or a copy of prototype
+            // if there is none.
+            std::shared_ptr<T> acquire(const T & prototype) {
+                std::unique_ptr<T> obj = this->state_->take();
+                if (obj) {
+                    *obj = prototype;
+                }
+                else {
+                    obj.reset(new T(prototype));
+                }
+                return this->share(std::move(obj));
+            }
+
+            // Number of objects waiting to be handed out again.
+            size_t free() const {
+                std::unique_lock<std::mutex> lock_(this->state_->mut);
+                return this->state_->objs.size();
+            }
+
+        private:
+            // Outlives the pool while any object it handed out is in use.
+            struct State {
+                // Reserved up front, so giving an object back never allocates
+                explicit State(size_t max_free_in) : max_free(max_free_in) {
+                    this->objs.reserve(max_free_in);
+                }
+
+                std::unique_ptr<T> take() {
+                    std::unique_lock<std::mutex> lock_(this->mut);
+                    if (this->objs.empty()) {
+                        return nullptr;
+                    }
+                    std::unique_ptr<T> obj = std::move(this->objs.back());
+                    this->objs.pop_back();
+                    return obj;
+                }
+
+                // Deletes the object instead if the pool is full, after
+                // letting go of the lock.
+                void give(T * ptr) {
+                    std::unique_ptr<T> obj(ptr);
+                    std::unique_lock<std::mutex> lock_(this->mut);
+                    if (this->objs.size() < this->max_free) {
+                        this->objs.push_back(std::move(obj));
+                    }
+                }
+
+                std::mutex mut;
+                std::vector<std::unique_ptr<T>> objs;
+                size_t max_free;
+            };
+
+            std::shared_ptr<T> share(std::unique_ptr<T> obj) {
+                std::shared_ptr<State> state = this->state_;
+                return std::shared_ptr<T>(obj.release(), [state](T * ptr) {
+                    state->give(ptr);
+                });
+            }
+
+            std::shared_ptr<State> state_;
+    };
+}
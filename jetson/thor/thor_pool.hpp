@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "thor_ring.hpp"
+
+namespace Thor {
+    // Worker threads shared by everything in a process that splits work
+    // across cores, instead of each caller starting threads of its own.
+    // Each worker keeps its own queue and runs the newest task in it
+    // first, since that is the one whose data is still in its cache, and
+    // a worker with nothing left takes the oldest task from another one.
+    class Pool {
+        public:
+            // Starts num_workers workers, pinned one to each of cores in
+            // turn, or left to the scheduler if cores is empty.
+            explicit Pool(size_t num_workers, std::vector<int> cores = std::vector<int>()) :
+                cores_(std::move(cores)), workers_(std::max<size_t>(num_workers, 1)),
+                pending_(0), next_(0), stopping_(false) {
+                for (size_t i = 0; i < this->workers_.size(); ++i) {
+                    this->threads_.emplace_back(&Pool::work, this, i);
+                }
+            }
+
+            ~Pool() {
+                this->stopping_.store(true, std::memory_order_release);
+                this->doorbell_.ring();
+                for (std::thread & thread : this->threads_) {
+                    thread.join();
+                }
+            }
+
+            Pool(const Pool &) = delete;
+            Pool & operator=(const Pool &) = delete;
+
+            // The process's pool. The THOR_CORES environment variable lists
+            // the cores to put a worker on, comma separated, such as only
+            // the big cores of a big.LITTLE board. Without it there is an
+            // unpinned worker for every core.
+            static Pool & shared() {
+                static const std::vector<int> cores = Pool::env_cores();
+                static Pool pool(cores.empty() ? std::thread::hardware_concurrency() : cores.size(), cores);
+                return pool;
+            }
+
+            size_t size() const {
+                return this->workers_.size();
+            }
+
+            // Queues task, on the calling worker's own queue if it is one
+            // of this pool's workers.
+            void submit(std::function<void()> task) {
+                size_t index = this->own_index();
+                if (index == NONE) {
+                    index = this->next_.fetch_add(1, std::memory_order_relaxed) % this->workers_.size();
+                }
+                {
+                    std::unique_lock<std::mutex> lock_(this->workers_[index].mut);
+                    this->workers_[index].tasks.push_back(std::move(task));
+                }
+                this->pending_.fetch_add(1, std::memory_order_release);
+                this->doorbell_.ring();
+            }
+
+            // Runs one queued task on the calling thread. Returns false if
+            // there was none.
+            bool run_one() {
+                std::function<void()> task;
+                if (!this->take(task)) {
+                    return false;
+                }
+                task();
+                return true;
+            }
+
+        private:
+            static const size_t NONE = static_cast<size_t>(-1);
+
+            struct alignas(CACHE_LINE) Worker {
+                std::mutex mut;
+                std::deque<std::function<void()>> tasks;
+            };
+
+            static std::vector<int> env_cores() {
+                std::vector<int> cores;
+                const char *env = std::getenv("THOR_CORES");
+                if (!env) {
+                    return cores;
+                }
+                std::string list(env);
+                size_t start = 0;
+                while (start < list.size()) {
+                    size_t end = list.find(',', start);
+                    if (end == std::string::npos) {
+                        end = list.size();
+                    }
+                    if (end > start) {
+                        cores.push_back(std::atoi(list.substr(start, end - start).c_str()));
+                    }
+                    start = end + 1;
+                }
+                return cores;
+            }
+
+            // Which of the pool's workers the calling thread is, or NONE.
+            size_t own_index() const {
+                return current_pool() == this ? current_index() : NONE;
+            }
+
+            static const Pool *& current_pool() {
+                static thread_local const Pool *pool = nullptr;
+                return pool;
+            }
+
+            static size_t & current_index() {
+                static thread_local size_t index = NONE;
+                return index;
+            }
+
+            bool take(std::function<void()> & task) {
+                if (this->pending_.load(std::memory_order_acquire) == 0) {
+                    return false;
+                }
+
+                size_t own = this->own_index();
+                if (own != NONE) {
+                    Worker & worker = this->workers_[own];
+                    std::unique_lock<std::mutex> lock_(worker.mut);
+                    if (!worker.tasks.empty()) {
+                        task = std::move(worker.tasks.back());
+                        worker.tasks.pop_back();
+                        this->pending_.fetch_sub(1, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+
+                size_t start = own == NONE ? 0 : own + 1;
+                for (size_t i = 0; i < this->workers_.size(); ++i) {
+                    Worker & victim = this->workers_[(start + i) % this->workers_.size()];
+                    std::unique_lock<std::mutex> lock_(victim.mut);
+                    if (!victim.tasks.empty()) {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                        this->pending_.fetch_sub(1, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void work(size_t index) {
+                current_pool() = this;
+                current_index() = index;
+                this->pin(index);
+
+                while (true) {
+                    if (this->run_one()) {
+                        continue;
+                    }
+                    if (this->stopping_.load(std::memory_order_acquire)) {
+                        return;
+                    }
+                    this->doorbell_.wait([this]() {
+                        return this->pending_.load(std::memory_order_acquire) > 0 ||
+                               this->stopping_.load(std::memory_order_acquire);
+                    });
+                }
+            }
+
+            void pin(size_t index) {
+#ifdef __linux__
+                if (this->cores_.empty()) {
+                    return;
+                }
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(this->cores_[index % this->cores_.size()], &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+                (void) index;
+#endif
+            }
+
+            std::vector<int> cores_;
+            std::vector<Worker> workers_;
+            std::vector<std::thread> threads_;
+
+            // Tasks queued and not yet taken, so idle workers know to look.
+            std::atomic<size_t> pending_;
+            std::atomic<size_t> next_;
+            std::atomic<bool> stopping_;
+            Doorbell doorbell_;
+    };
+
+    // Tasks run on a pool and waited for together. The thread that waits
+    // runs queued tasks itself until the group's are done, so a task can
+    // wait on a group of its own without tying up a worker.
+    class TaskGroup {
+        public:
+            explicit TaskGroup(Pool & pool = Pool::shared()) : pool_(pool), pending_(0) {}
+
+            ~TaskGroup() {
+                this->join();
+            }
+
+            TaskGroup(const TaskGroup &) = delete;
+            TaskGroup & operator=(const TaskGroup &) = delete;
+
+            template <typename Function>
+            void run(Function func) {
+                this->pending_.fetch_add(1, std::memory_order_relaxed);
+                this->pool_.submit([this, func]() mutable {
+                    try {
+                        func();
+                    }
+                    catch (...) {
+                        std::unique_lock<std::mutex> lock_(this->mut_);
+                        if (!this->error_) {
+                            this->error_ = std::current_exception();
+                        }
+                    }
+
+                    // Under the lock so the waiter can't return, and the
+                    // group go away, before this is done with it
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    if (this->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        this->cv_.notify_all();
+                    }
+                });
+            }
+
+            // Blocks until every task run so far is done, then rethrows the
+            // first exception one of them threw.
+            void wait() {
+                this->join();
+                std::exception_ptr error;
+                {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    std::swap(error, this->error_);
+                }
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+
+        private:
+            void join() {
+                while (this->pending_.load(std::memory_order_acquire) > 0) {
+                    if (this->pool_.run_one()) {
+                        continue;
+                    }
+                    // everything left is already running somewhere
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    this->cv_.wait(lock_, [this]() {
+                        return this->pending_.load(std::memory_order_acquire) == 0;
+                    });
+                }
+                std::unique_lock<std::mutex> lock_(this->mut_);
+            }
+
+            Pool & pool_;
+            std::atomic<size_t> pending_;
+            std::exception_ptr error_;
+            std::mutex mut_;
+            std::condition_variable cv_;
+    };
+
+    // Calls func(i) for every i in [begin, end) across the pool, in chunks
+    // of at least grain indices so every task is worth handing to another
+    // core. The calling thread takes the first chunk.
+    template <typename Function>
+    void parallel_for(size_t begin, size_t end, size_t grain, Function func, Pool & pool = Pool::shared()) {
+        if (end <= begin) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+
+        // a few chunks per worker, so the ones that finish early take more
+        size_t num_chunks = std::min((end - begin + grain - 1) / grain, pool.size() * 4 + 1);
+        size_t step = (end - begin + num_chunks - 1) / num_chunks;
+
+        TaskGroup group(pool);
+        for (size_t start = begin + step; start < end; start += step) {
+            size_t stop = std::min(start + step, end);
+            group.run([start, stop, &func]() {
+                for (size_t i = start; i < stop; ++i) {
+                    func(i);
+                }
+            });
+        }
+        for (size_t i = begin; i < std::min(begin + step, end); ++i) {
+            func(i);
+        }
+        group.wait();
+    }
+}
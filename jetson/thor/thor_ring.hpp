@@ -0,0 +1,200 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "thor_wait.hpp"
+
+namespace Thor {
+    // Indices written by different threads are kept this far apart, so a
+    // producer and a consumer don't keep taking the same cache line from
+    // each other.
+    static const size_t CACHE_LINE = 64;
+
+    // Bounded queue from one producer thread to one consumer thread, of
+    // up to N values. Neither side locks or waits on the other, except a
+    // consumer that chooses to block in pop_wait.
+    template <typename T, size_t N>
+    class SpscRing {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "ring size has to be a power of two");
+
+        public:
+            SpscRing() : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {}
+
+            // Producer only. Returns false if the ring is full.
+            bool try_push(T val) {
+                size_t tail = this->tail_.load(std::memory_order_relaxed);
+                if (tail - this->cached_head_ == N) {
+                    this->cached_head_ = this->head_.load(std::memory_order_acquire);
+                    if (tail - this->cached_head_ == N) {
+                        return false;
+                    }
+                }
+                this->slots_[tail & (N - 1)] = std::move(val);
+                this->tail_.store(tail + 1, std::memory_order_release);
+                this->doorbell_.ring();
+                return true;
+            }
+
+            // Consumer only. Returns false if the ring is empty.
+            bool try_pop(T & val) {
+                size_t head = this->head_.load(std::memory_order_relaxed);
+                if (head == this->cached_tail_) {
+                    this->cached_tail_ = this->tail_.load(std::memory_order_acquire);
+                    if (head == this->cached_tail_) {
+                        return false;
+                    }
+                }
+                val = std::move(this->slots_[head & (N - 1)]);
+                this->head_.store(head + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Consumer only. Blocks until a value is pushed.
+            void pop_wait(T & val) {
+                this->doorbell_.wait([this]() { return !this->empty(); });
+                this->try_pop(val);
+            }
+
+            // Consumer only. Blocks until a value is pushed or deadline
+            // passes. Returns false if nothing was popped.
+            template <typename Clock, typename Duration>
+            bool pop_wait_until(const std::chrono::time_point<Clock, Duration> & deadline, T & val) {
+                return this->doorbell_.wait_until(deadline, [this]() { return !this->empty(); }) && this->try_pop(val);
+            }
+
+            template <typename Rep, typename Period>
+            bool pop_wait_for(const std::chrono::duration<Rep, Period> & timeout, T & val) {
+                return this->pop_wait_until(std::chrono::steady_clock::now() + timeout, val);
+            }
+
+            // Rung after every push, see wait_any_until.
+            Doorbell & doorbell() const {
+                return this->doorbell_;
+            }
+
+            bool empty() const {
+                return this->head_.load(std::memory_order_acquire) ==
+                       this->tail_.load(std::memory_order_acquire);
+            }
+
+            // Changes while the other side pushes or pops, exact only on
+            // the side that would make it smaller or larger next.
+            size_t size() const {
+                return this->tail_.load(std::memory_order_acquire) -
+                       this->head_.load(std::memory_order_acquire);
+            }
+
+        private:
+            std::array<T, N> slots_;
+
+            // Written by the consumer, with the producer's last read of it
+            // next to the producer's own index, and the other way around
+            alignas(CACHE_LINE) std::atomic<size_t> head_;
+            size_t cached_tail_;
+            alignas(CACHE_LINE) std::atomic<size_t> tail_;
+            size_t cached_head_;
+
+            alignas(CACHE_LINE) mutable Doorbell doorbell_;
+    };
+
+    // Bounded queue from any number of producer threads to one consumer
+    // thread, of up to N values. Producers claim a slot with a compare and
+    // swap and never wait on each other to fill theirs in, each slot's
+    // sequence number tells the consumer when the value in it is ready.
+    template <typename T, size_t N>
+    class MpscRing {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "ring size has to be a power of two");
+
+        public:
+            MpscRing() : head_(0), tail_(0) {
+                for (size_t i = 0; i < N; ++i) {
+                    this->slots_[i].seq.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            // Any thread. Returns false if the ring is full.
+            bool try_push(T val) {
+                size_t tail = this->tail_.load(std::memory_order_relaxed);
+                Slot *slot;
+                while (true) {
+                    slot = &this->slots_[tail & (N - 1)];
+                    size_t seq = slot->seq.load(std::memory_order_acquire);
+                    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(tail);
+                    if (diff == 0) {
+                        if (this->tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    }
+                    else if (diff < 0) {
+                        // the consumer hasn't emptied this slot since the last lap
+                        return false;
+                    }
+                    else {
+                        tail = this->tail_.load(std::memory_order_relaxed);
+                    }
+                }
+                slot->val = std::move(val);
+                slot->seq.store(tail + 1, std::memory_order_release);
+                this->doorbell_.ring();
+                return true;
+            }
+
+            // Consumer only. Returns false if the ring is empty, or the
+            // oldest push hasn't finished filling in its slot yet.
+            bool try_pop(T & val) {
+                size_t head = this->head_.load(std::memory_order_relaxed);
+                Slot &slot = this->slots_[head & (N - 1)];
+                if (slot.seq.load(std::memory_order_acquire) != head + 1) {
+                    return false;
+                }
+                val = std::move(slot.val);
+                slot.seq.store(head + N, std::memory_order_release);
+                this->head_.store(head + 1, std::memory_order_relaxed);
+                return true;
+            }
+
+            // Consumer only. Blocks until a value is pushed.
+            void pop_wait(T & val) {
+                this->doorbell_.wait([this]() { return this->ready(); });
+                this->try_pop(val);
+            }
+
+            // Consumer only. Blocks until a value is pushed or deadline
+            // passes. Returns false if nothing was popped.
+            template <typename Clock, typename Duration>
+            bool pop_wait_until(const std::chrono::time_point<Clock, Duration> & deadline, T & val) {
+                return this->doorbell_.wait_until(deadline, [this]() { return this->ready(); }) && this->try_pop(val);
+            }
+
+            template <typename Rep, typename Period>
+            bool pop_wait_for(const std::chrono::duration<Rep, Period> & timeout, T & val) {
+                return this->pop_wait_until(std::chrono::steady_clock::now() + timeout, val);
+            }
+
+            // Rung after every push, see wait_any_until.
+            Doorbell & doorbell() const {
+                return this->doorbell_;
+            }
+
+            // Consumer only. Whether try_pop would return a value.
+            bool ready() const {
+                size_t head = this->head_.load(std::memory_order_relaxed);
+                return this->slots_[head & (N - 1)].seq.load(std::memory_order_acquire) == head + 1;
+            }
+
+        private:
+            struct alignas(CACHE_LINE) Slot {
+                std::atomic<size_t> seq;
+                T val;
+            };
+
+            std::array<Slot, N> slots_;
+            alignas(CACHE_LINE) std::atomic<size_t> head_;
+            alignas(CACHE_LINE) std::atomic<size_t> tail_;
+            alignas(CACHE_LINE) mutable Doorbell doorbell_;
+    };
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include "thor_mailbox.hpp"
+#include "thor_wait.hpp"
+
+namespace Thor {
+    template <typename T>
+    class Volatile {
+        public:
+            Volatile() : changed_(false) {}
+            Volatile(const T & val) : val_(val), changed_(false) {}
+
+            void set(const T & val) {
+                {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    this->unsafe_set_possibly_race(val);
+                }
+                this->doorbell_.ring();
+            }
+            template <typename Function>
+            bool set_conditionally(const T & val, Function func) {
+                {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    if (!func(this->val_)) {
+                        return false;
+                    }
+                    this->unsafe_set_possibly_race(val);
+                }
+                this->doorbell_.ring();
+                return true;
+            }
+            void unsafe_set_possibly_race(const T & val) {
+                // this->changed_ = (val != this->val_);
+                this->val_ = val;
+                this->changed_ = true;
+                this->cv_.notify_all();
+            }
+
+            template <typename Function>
+            void wait_for(Function func) {
+                std::unique_lock<std::mutex> lock_(this->mut_);
+                this->cv_.wait(lock_, [&]() {
+                    return func(this->val_);
+                });
+            }
+
+            // Gives up once timeout passes, returns whether func returned true.
+            template <typename Function, typename Rep, typename Period>
+            bool wait_for(Function func, const std::chrono::duration<Rep, Period> & timeout) {
+                return this->wait_until(func, std::chrono::steady_clock::now() + timeout);
+            }
+
+            template <typename Function, typename Clock, typename Duration>
+            bool wait_until(Function func, const std::chrono::time_point<Clock, Duration> & deadline) {
+                std::unique_lock<std::mutex> lock_(this->mut_);
+                return this->cv_.wait_until(lock_, deadline, [&]() {
+                    return func(this->val_);
+                });
+            }
+
+            template <typename Function>
+            void transaction(Function func) {
+                bool changed;
+                {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    this->changed_ |= func(this->val_);
+                    changed = this->changed_;
+                    if (changed) {
+                        this->cv_.notify_all();
+                    }
+                }
+                if (changed) {
+                    this->doorbell_.ring();
+                }
+            }
+
+            T clone_when_changed() const {
+                std::unique_lock<std::mutex> lock_(this->mut_);
+                this->cv_.wait(lock_, [&]() {
+                    return this->changed_;
+                });
+                this->changed_ = false;
+                return T(this->val_);
+            }
+
+            // Gives up once timeout passes, returns whether *t was set.
+            template <typename Rep, typename Period>
+            bool clone_when_changed_for(const std::chrono::duration<Rep, Period> & timeout, T *t) const {
+                return this->clone_when_changed_until(std::chrono::steady_clock::now() + timeout, t);
+            }
+
+            template <typename Clock, typename Duration>
+            bool clone_when_changed_until(const std::chrono::time_point<Clock, Duration> & deadline, T *t) const {
+                std::unique_lock<std::mutex> lock_(this->mut_);
+                if (!this->cv_.wait_until(lock_, deadline, [&]() { return this->changed_; })) {
+                    return false;
+                }
+                this->changed_ = false;
+                *t = T(this->val_);
+                return true;
+            }
+
+            // Rung after every change, see wait_any_until.
+            Doorbell & doorbell() const {
+                return this->doorbell_;
+            }
+
+            T clone() const {
+                std::unique_lock<std::mutex> lock_(this->mut_);
+                this->changed_ = false;
+                return T(this->val_);
+            }
+
+            template <typename Function>
+            bool clone_conditional(Function pred, T *t) const {
+                std::unique_lock<std::mutex> lock_(this->mut_);
+                if (pred(this->val_)) {
+                    *t = T(this->val_);
+                    this->changed_ = false;
+                    return true;
+                }
+                return false;
+            }
+
+        private:
+            T val_;
+            mutable bool changed_;
+            mutable std::mutex mut_;
+            mutable std::condition_variable cv_;
+            mutable Doorbell doorbell_;
+    };
+
+    // Volatile for read-mostly state that is trivially copyable, such as
+    // odometry or joint angles. Readers copy it through a SeqLock without
+    // locking, so they never wait on a writer mid-write, and writers only
+    // take a mutex among themselves, never waiting on readers. Instead of
+    // a changed flag every reader keeps the version it last saw, since
+    // readers writing to shared state would contend with each other.
+    template <typename T>
+    class SeqVolatile {
+        public:
+            SeqVolatile() {}
+            SeqVolatile(const T & val) {
+                this->seq_.set(val);
+            }
+
+            void set(const T & val) {
+                std::unique_lock<std::mutex> lock_(this->write_mut_);
+                this->seq_.set(val);
+            }
+
+            // Changes the value in place, keeping the change if func
+            // returns true. Readers see either all of it or none of it.
+            template <typename Function>
+            void transaction(Function func) {
+                std::unique_lock<std::mutex> lock_(this->write_mut_);
+                T val = this->seq_.get();
+                if (func(val)) {
+                    this->seq_.set(val);
+                }
+            }
+
+            T clone() const {
+                return this->seq_.get();
+            }
+
+            // Copies the value into *t if it changed since *version, and
+            // updates *version to the copy's. Returns whether it copied.
+            bool clone_if_changed(uint64_t *version, T *t) const {
+                if (this->seq_.version() == *version) {
+                    return false;
+                }
+                *t = this->seq_.get(version);
+                return true;
+            }
+
+            template <typename Clock, typename Duration>
+            bool clone_when_changed_until(const std::chrono::time_point<Clock, Duration> & deadline,
+                                          uint64_t *version, T *t) const {
+                return wait_any_until(deadline, [&]() { return this->seq_.version() != *version; }, this->seq_) &&
+                       this->clone_if_changed(version, t);
+            }
+
+            template <typename Rep, typename Period>
+            bool clone_when_changed_for(const std::chrono::duration<Rep, Period> & timeout,
+                                        uint64_t *version, T *t) const {
+                return this->clone_when_changed_until(std::chrono::steady_clock::now() + timeout, version, t);
+            }
+
+            // Number of times the value has been changed.
+            uint64_t version() const {
+                return this->seq_.version();
+            }
+
+            // Rung after every change, see wait_any_until.
+            Doorbell & doorbell() const {
+                return this->seq_.doorbell();
+            }
+
+        private:
+            SeqLock<T> seq_;
+            std::mutex write_mut_;
+    };
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace Thor {
+    // Wakes threads blocked until something changes, such as a ring
+    // getting a value. Ringing stays lock-free: the mutexes are only
+    // taken when a thread is waiting on this or a doorbell forwarded to.
+    class Doorbell {
+        public:
+            Doorbell() : waiting_(0), forwards_(0) {}
+
+            Doorbell(const Doorbell &) = delete;
+            Doorbell & operator=(const Doorbell &) = delete;
+
+            // Called after making whatever the waiters check for true.
+            void ring() {
+                // Orders the caller's change before reading waiting_ and
+                // forwards_, paired with the increments in wait and forward
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (this->waiting_.load(std::memory_order_relaxed) > 0) {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    this->cv_.notify_all();
+                }
+                if (this->forwards_.load(std::memory_order_relaxed) > 0) {
+                    std::unique_lock<std::mutex> lock_(this->forward_mut_);
+                    for (Doorbell *other : this->forward_to_) {
+                        other->ring();
+                    }
+                }
+            }
+
+            // Blocks until ready returns true, checking it after every ring.
+            template <typename Function>
+            void wait(Function ready) {
+                if (ready()) {
+                    return;
+                }
+                this->waiting_.fetch_add(1, std::memory_order_seq_cst);
+                {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    this->cv_.wait(lock_, ready);
+                }
+                this->waiting_.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            // Blocks until ready returns true or deadline passes. Returns
+            // whether ready did.
+            template <typename Clock, typename Duration, typename Function>
+            bool wait_until(const std::chrono::time_point<Clock, Duration> & deadline, Function ready) {
+                if (ready()) {
+                    return true;
+                }
+                this->waiting_.fetch_add(1, std::memory_order_seq_cst);
+                bool result;
+                {
+                    std::unique_lock<std::mutex> lock_(this->mut_);
+                    result = this->cv_.wait_until(lock_, deadline, ready);
+                }
+                this->waiting_.fetch_sub(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            // Rings other whenever this rings, until unforward. Once
+            // unforward returns this never touches other again.
+            void forward(Doorbell * other) {
+                std::unique_lock<std::mutex> lock_(this->forward_mut_);
+                this->forward_to_.push_back(other);
+                this->forwards_.fetch_add(1, std::memory_order_seq_cst);
+            }
+
+            void unforward(Doorbell * other) {
+                std::unique_lock<std::mutex> lock_(this->forward_mut_);
+                auto it = std::find(this->forward_to_.begin(), this->forward_to_.end(), other);
+                if (it != this->forward_to_.end()) {
+                    this->forward_to_.erase(it);
+                    this->forwards_.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+
+        private:
+            std::atomic<int> waiting_;
+            std::mutex mut_;
+            std::condition_variable cv_;
+
+            std::atomic<int> forwards_;
+            std::mutex forward_mut_;
+            std::vector<Doorbell *> forward_to_;
+    };
+
+    // Blocks until ready returns true or deadline passes, checking ready
+    // again whenever any of sources changes. A source is anything with a
+    // doorbell(): Volatiles, SeqLocks, Mailboxes and rings. Returns
+    // whether ready did, so a thread can wait on several inputs at once
+    // instead of polling them.
+    template <typename Clock, typename Duration, typename Function, typename... Sources>
+    bool wait_any_until(const std::chrono::time_point<Clock, Duration> & deadline, Function ready,
+                        const Sources &... sources) {
+        static_assert(sizeof...(Sources) > 0, "wait_any_until needs something to wait on");
+
+        Doorbell doorbell;
+        Doorbell *sources_[] = { &sources.doorbell()... };
+        for (Doorbell *source : sources_) {
+            source->forward(&doorbell);
+        }
+        bool result = doorbell.wait_until(deadline, ready);
+        for (Doorbell *source : sources_) {
+            source->unforward(&doorbell);
+        }
+        return result;
+    }
+
+    template <typename Rep, typename Period, typename Function, typename... Sources>
+    bool wait_any_for(const std::chrono::duration<Rep, Period> & timeout, Function ready,
+                      const Sources &... sources) {
+        return wait_any_until(std::chrono::steady_clock::now() + timeout, ready, sources...);
+    }
+}
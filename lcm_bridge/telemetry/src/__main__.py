@@ -0,0 +1,116 @@
+"""
+Carries telemetry over the radio link as one compact frame per tick.
+
+Run as 'rover' on the rover, where it subscribes to the configured channels,
+and as 'base' on the base station, where it republishes them for the GUI.
+For the frames to be all that crosses the radio, the rover's publishers of
+these channels need an LCM URL that stays on the rover (ttl=0).
+"""
+import asyncio
+import json
+import random
+import socket
+import sys
+from os import getenv
+
+from rover_common import aiolcm
+from rover_common.aiohelper import run_coroutines
+from .codec import Channel, Decoder, Encoder
+
+
+def usage():
+    print('usage: {} rover|base'.format(sys.argv[0]))
+
+
+def load_config():
+    config_path = getenv('MROVER_CONFIG')
+    config_path += "/config_telemetry/config.json"
+    with open(config_path, "r") as config:
+        return json.load(config)
+
+
+class RoverLink(asyncio.DatagramProtocol):
+    """
+    Sends the channels' newest messages to the base station every tick,
+    as deltas against what it acknowledged.
+    """
+
+    def __init__(self, config, channels):
+        self.config = config
+        self.encoder = Encoder(channels, random.getrandbits(32))
+        self.transport = None
+
+        self.lcm = aiolcm.AsyncLCM()
+        for channel in channels:
+            self.lcm.subscribe(channel.name, self._callback(channel))
+
+    def _callback(self, channel):
+        def callback(topic, data):
+            self.encoder.update(channel, channel.lcm_type.decode(data))
+        return callback
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        self.encoder.ack(data)
+
+    async def run(self):
+        loop = asyncio.get_event_loop()
+        base = self.config['base_station']
+        await loop.create_datagram_endpoint(
+            lambda: self, remote_addr=(base['host'], base['port']))
+
+        period = 1.0 / self.config['rate_hz']
+        while True:
+            frame = self.encoder.frame()
+            if frame is not None:
+                self.transport.sendto(frame)
+            await asyncio.sleep(period)
+
+
+class BaseLink(asyncio.DatagramProtocol):
+    """ Republishes the rover's frames and acknowledges them. """
+
+    def __init__(self, config, channels):
+        self.config = config
+        self.decoder = Decoder(channels)
+        self.transport = None
+        self.lcm = aiolcm.AsyncLCM()
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        messages, ack = self.decoder.decode(data)
+        for channel, msg in messages:
+            self.lcm.publish(channel.name, msg.encode())
+        if ack is not None:
+            self.transport.sendto(ack, addr)
+
+    async def run(self):
+        loop = asyncio.get_event_loop()
+        await loop.create_datagram_endpoint(
+            lambda: self, local_addr=('0.0.0.0',
+                                      self.config['base_station']['port']),
+            family=socket.AF_INET)
+
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] not in ('rover', 'base'):
+        usage()
+        sys.exit(1)
+
+    config = load_config()
+    channels = [Channel(i, c) for i, c in enumerate(config['channels'])]
+
+    if sys.argv[1] == 'rover':
+        link = RoverLink(config, channels)
+        run_coroutines(link.lcm.loop(), link.run())
+    else:
+        link = BaseLink(config, channels)
+        run_coroutines(link.lcm.loop(), link.run())
+
+
+if __name__ == '__main__':
+    main()
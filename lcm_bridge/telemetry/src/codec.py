@@ -0,0 +1,296 @@
+"""
+Encoding of telemetry frames for the radio link.
+
+A frame holds the channels that got a new message since the last one. Each
+channel's message is sent either in full, as its LCM encoding, or as the
+difference from a reference: a copy of the channel the base station
+acknowledged receiving. Numbers are quantized before they are compared, so
+a field that barely moved costs a byte, and strings that didn't change
+cost one too.
+
+Frame:  magic, session, sequence number, then for each channel
+        channel index (byte), reference distance (varint, 0 if in full),
+        record length (varint), record
+Ack:    magic, session, sequence number of the frame received
+"""
+import struct
+
+import rover_msgs
+
+MAGIC = 0x4d54
+HEADER = struct.Struct('>HII')
+
+# how many frames back a reference can be, which is also how many frames of
+# each channel the base station keeps to decode against
+REF_WINDOW = 50
+
+# radio packets stay under the MTU; what doesn't fit waits for the next frame
+MAX_PACKET = 1200
+
+
+def encode_varint(n, out):
+    while n >= 0x80:
+        out.append((n & 0x7f) | 0x80)
+        n >>= 7
+    out.append(n)
+
+
+def decode_varint(buf, pos):
+    n = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        n |= (b & 0x7f) << shift
+        if b < 0x80:
+            return n, pos
+        shift += 7
+
+
+def _zigzag(n):
+    return n * 2 if n >= 0 else -n * 2 - 1
+
+
+def _unzigzag(n):
+    return n // 2 if n % 2 == 0 else -(n + 1) // 2
+
+
+def _is_lcm_object(obj):
+    return hasattr(obj, '_get_packed_fingerprint')
+
+
+def _leaves(val, out):
+    if isinstance(val, (list, tuple)):
+        for elt in val:
+            _leaves(elt, out)
+    elif _is_lcm_object(val):
+        for slot in val.__slots__:
+            _leaves(getattr(val, slot), out)
+    else:
+        out.append(val)
+    return out
+
+
+def _shape(val, out):
+    """ List lengths, which have to match for a delta to apply. """
+    if isinstance(val, (list, tuple)):
+        out.append(len(val))
+        for elt in val:
+            _shape(elt, out)
+    elif _is_lcm_object(val):
+        for slot in val.__slots__:
+            _shape(getattr(val, slot), out)
+    return out
+
+
+def quantize(msg, step):
+    """
+    Returns the leaf fields of a message in slot order, with floats as
+    multiples of step.
+    """
+    values = []
+    for leaf in _leaves(msg, []):
+        if isinstance(leaf, float):
+            values.append(int(round(leaf / step)))
+        elif isinstance(leaf, (bool, int)):
+            values.append(int(leaf))
+        else:
+            values.append(leaf)
+    return values
+
+
+def _set_leaves(val, values, step, pos):
+    """
+    Replaces the leaves of val with values[pos:], returning the new val and
+    the position of the next value.
+    """
+    if isinstance(val, (list, tuple)):
+        new = []
+        for elt in val:
+            elt, pos = _set_leaves(elt, values, step, pos)
+            new.append(elt)
+        return new, pos
+    if _is_lcm_object(val):
+        for slot in val.__slots__:
+            leaf, pos = _set_leaves(getattr(val, slot), values, step, pos)
+            setattr(val, slot, leaf)
+        return val, pos
+    v = values[pos]
+    if isinstance(val, bool):
+        v = bool(v)
+    elif isinstance(val, float):
+        v = v * step
+    return v, pos + 1
+
+
+class Channel:
+    """ A telemetry channel, as configured on both ends of the link. """
+
+    def __init__(self, index, config):
+        self.index = index
+        self.name = config['channel']
+        self.lcm_type = getattr(rover_msgs, config['type'])
+        self.step = config.get('step', 1e-4)
+
+
+class Reference:
+    """ A copy of a channel both ends have, for deltas against it. """
+
+    def __init__(self, seq, msg, step):
+        self.seq = seq
+        self.msg = msg
+        self.values = quantize(msg, step)
+        self.shape = _shape(msg, [])
+
+
+def _encode_delta(values, ref_values):
+    out = bytearray()
+    for v, r in zip(values, ref_values):
+        if isinstance(v, int):
+            encode_varint(_zigzag(v - r), out)
+        elif v == r:
+            encode_varint(0, out)
+        else:
+            data = v.encode('utf-8') if isinstance(v, str) else bytes(v)
+            encode_varint(len(data) + 1, out)
+            out += data
+    return out
+
+
+def _decode_delta(record, ref_values):
+    values = []
+    pos = 0
+    for r in ref_values:
+        n, pos = decode_varint(record, pos)
+        if isinstance(r, int):
+            values.append(r + _unzigzag(n))
+        elif n == 0:
+            values.append(r)
+        else:
+            data = bytes(record[pos:pos + n - 1])
+            pos += n - 1
+            values.append(data.decode('utf-8') if isinstance(r, str) else data)
+    return values
+
+
+class Encoder:
+    """ The rover's end: packs new messages into frames. """
+
+    def __init__(self, channels, session):
+        self.channels = channels
+        self.session = session
+        self.seq = 0
+        self.pending = {}   # channel index to its newest unsent message
+        self.sent = {}      # channel index to {seq: Reference} not acked
+        self.acked = {}     # channel index to its newest acked Reference
+
+    def update(self, channel, msg):
+        self.pending[channel.index] = msg
+
+    def frame(self):
+        """ Returns the next frame, or None if nothing changed. """
+        if not self.pending:
+            return None
+        self.seq += 1
+        out = bytearray(HEADER.pack(MAGIC, self.session, self.seq))
+
+        for index in list(self.pending):
+            channel = self.channels[index]
+            msg = self.pending[index]
+            sent = Reference(self.seq, msg, channel.step)
+            ref = self.acked.get(index)
+            if (ref is not None and self.seq - ref.seq <= REF_WINDOW and
+                    ref.shape == sent.shape):
+                distance = self.seq - ref.seq
+                record = _encode_delta(sent.values, ref.values)
+            else:
+                distance = 0
+                record = msg.encode()
+
+            head = bytearray([index])
+            encode_varint(distance, head)
+            encode_varint(len(record), head)
+            if (len(out) + len(head) + len(record) > MAX_PACKET and
+                    len(out) > HEADER.size):
+                continue
+            out += head
+            out += record
+
+            del self.pending[index]
+            self.sent.setdefault(index, {})[self.seq] = sent
+        return bytes(out)
+
+    def ack(self, packet):
+        if len(packet) != HEADER.size:
+            return
+        magic, session, seq = HEADER.unpack(packet)
+        if magic != MAGIC or session != self.session:
+            return
+        for index, sent in self.sent.items():
+            if seq in sent and (index not in self.acked or
+                                self.acked[index].seq < seq):
+                self.acked[index] = sent[seq]
+            for old in [s for s in sent if s <= seq or
+                        self.seq - s > REF_WINDOW]:
+                del sent[old]
+
+
+class Decoder:
+    """ The base station's end: unpacks frames into messages. """
+
+    def __init__(self, channels):
+        self.channels = channels
+        self.session = None
+        self.received = {}  # channel index to {seq: Reference}
+
+    def decode(self, packet):
+        """
+        Returns the messages in a frame as (channel, message) pairs, and the
+        ack to send back, which is None unless every message was decoded.
+        """
+        if len(packet) < HEADER.size:
+            return [], None
+        magic, session, seq = HEADER.unpack_from(packet)
+        if magic != MAGIC:
+            return [], None
+        if session != self.session:
+            # the rover restarted, so its references are from scratch
+            self.session = session
+            self.received = {}
+
+        messages = []
+        complete = True
+        pos = HEADER.size
+        try:
+            while pos < len(packet):
+                index = packet[pos]
+                distance, pos = decode_varint(packet, pos + 1)
+                length, pos = decode_varint(packet, pos)
+                record = packet[pos:pos + length]
+                pos += length
+                if index >= len(self.channels):
+                    complete = False
+                    continue
+
+                channel = self.channels[index]
+                received = self.received.setdefault(index, {})
+                if distance == 0:
+                    msg = channel.lcm_type.decode(bytes(record))
+                elif seq - distance in received:
+                    ref = received[seq - distance]
+                    values = _decode_delta(record, ref.values)
+                    msg = channel.lcm_type.decode(ref.msg.encode())
+                    msg, _ = _set_leaves(msg, values, channel.step, 0)
+                else:
+                    complete = False
+                    continue
+
+                received[seq] = Reference(seq, msg, channel.step)
+                for old in [s for s in received if seq - s > REF_WINDOW]:
+                    del received[old]
+                messages.append((channel, msg))
+        except (IndexError, ValueError):
+            complete = False
+
+        ack = HEADER.pack(MAGIC, session, seq) if complete else None
+        return messages, ack
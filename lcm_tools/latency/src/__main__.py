@@ -0,0 +1,140 @@
+"""
+Reports how old messages are when they reach a handler, per channel.
+
+Publishers have to trace their messages (LCM URL option trace=1, or shm://)
+for their latency to be known. Latency is split into the part spent getting
+the message to this host (publish to receive) and the part spent waiting to
+be handled (receive to handler), which tells IPC delays from a busy
+subscriber. Publishers on other hosts need a synchronized clock.
+
+Lost messages are counted from gaps in the sequence numbers, assuming one
+publisher per channel.
+"""
+import asyncio
+import re
+import sys
+import time
+from rover_common import aiolcm
+from rover_common.aiohelper import run_coroutines
+
+# upper bounds of the histogram buckets, in microseconds
+BUCKETS = [100, 300, 1000, 3000, 10000, 30000, 100000, 300000]
+
+
+def usage():
+    print('usage: {} [CHANNEL_REGEX] [PERIOD_S]'.format(sys.argv[0]))
+
+
+def bucket_label(bound):
+    if bound < 1000:
+        return '<{}us'.format(bound)
+    return '<{}ms'.format(bound // 1000)
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    return sorted_values[min(len(sorted_values) - 1,
+                             int(p * len(sorted_values)))]
+
+
+class ChannelStats:
+
+    def __init__(self):
+        self.last_seqno = None
+        self.clear()
+
+    def clear(self):
+        self.count = 0
+        self.untraced = 0
+        self.lost = 0
+        self.transport = []
+        self.total = []
+
+    def add(self, recv_utime, send_utime, send_seqno, now):
+        self.count += 1
+        if send_utime == 0:
+            self.untraced += 1
+            return
+
+        if self.last_seqno is not None and send_seqno > self.last_seqno:
+            self.lost += send_seqno - self.last_seqno - 1
+        # a lower sequence number is a restarted publisher
+        self.last_seqno = send_seqno
+
+        self.transport.append(recv_utime - send_utime)
+        self.total.append(now - send_utime)
+
+
+class LatencyMonitor:
+
+    def __init__(self, channel_regex, period):
+        self.period = period
+        self.stats = {}
+        self.lcm = aiolcm.AsyncLCM()
+        self.lcm.subscribe(channel_regex, self.callback)
+
+    def callback(self, channel, data):
+        now = int(time.time() * 1e6)
+        recv_utime, send_utime, send_seqno = self.lcm.receive_info()
+        if channel not in self.stats:
+            self.stats[channel] = ChannelStats()
+        self.stats[channel].add(recv_utime, send_utime, send_seqno, now)
+
+    def report(self):
+        print('{:<24} {:>6} {:>5}  {:>24}  {:>24}'.format(
+            'channel', 'msgs', 'lost', 'publish->recv p50/p99 us',
+            'publish->handler p50/p99/max us'))
+        for channel in sorted(self.stats):
+            stats = self.stats[channel]
+            if stats.count == 0:
+                continue
+            if not stats.total:
+                print('{:<24} {:>6} {:>5}  {:>24}'.format(
+                    channel, stats.count, '-', 'not traced'))
+                stats.clear()
+                continue
+
+            transport = sorted(stats.transport)
+            total = sorted(stats.total)
+            print('{:<24} {:>6} {:>5}  {:>11} / {:<10}  {:>8} / {:>6} / {:<8}'
+                  .format(channel, stats.count, stats.lost,
+                          percentile(transport, 0.5),
+                          percentile(transport, 0.99),
+                          percentile(total, 0.5), percentile(total, 0.99),
+                          total[-1]))
+
+            counts = [0] * (len(BUCKETS) + 1)
+            for latency in total:
+                i = 0
+                while i < len(BUCKETS) and latency >= BUCKETS[i]:
+                    i += 1
+                counts[i] += 1
+            labels = [bucket_label(b) for b in BUCKETS] + ['more']
+            print('    ' + '  '.join('{} {}'.format(label, count)
+                                     for label, count in zip(labels, counts)
+                                     if count))
+            stats.clear()
+        print()
+
+    async def run(self):
+        while True:
+            await asyncio.sleep(self.period)
+            self.report()
+
+
+def main():
+    if len(sys.argv) > 3:
+        usage()
+        sys.exit(1)
+
+    channel_regex = sys.argv[1] if len(sys.argv) > 1 else '.*'
+    try:
+        period = float(sys.argv[2]) if len(sys.argv) > 2 else 5.0
+        re.compile(channel_regex)
+    except (ValueError, re.error):
+        usage()
+        sys.exit(1)
+
+    monitor = LatencyMonitor(channel_regex, period)
+    run_coroutines(monitor.lcm.loop(), monitor.run())
@@ -15,6 +15,13 @@ class AsyncLCM:
     def unsubscribe(self, subscription):
         self.lcm_.unsubscribe(subscription)
 
+    def receive_info(self):
+        """
+        Returns (recv_utime, send_utime, send_seqno) of the message being
+        handled. send_utime is 0 unless its publisher traces messages.
+        """
+        return self.lcm_.receive_info()
+
     async def handle(self, *, timeout=None):
         loop = asyncio.get_event_loop()
         handled_queue = asyncio.Queue()